@@ -0,0 +1,438 @@
+#include "animation.h"
+#include "jobs.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define ANIM_SSE2 1
+#endif
+
+#define kAnimLanes 4
+#define kAnimCharactersPerJob 16
+#define kAnimMaxGroups (kAnimMaxJoints / kAnimLanes)
+
+// ---------------------------------------------------------------------------
+// Four lanes of floats: SSE2 where available, plain C otherwise
+// ---------------------------------------------------------------------------
+
+#ifdef ANIM_SSE2
+
+typedef __m128 Lane4;
+
+static inline Lane4 lane4Load(const float* p) { return _mm_loadu_ps(p); }
+static inline void lane4Store(float* p, Lane4 a) { _mm_storeu_ps(p, a); }
+static inline Lane4 lane4Set(float s) { return _mm_set1_ps(s); }
+static inline Lane4 lane4Add(Lane4 a, Lane4 b) { return _mm_add_ps(a, b); }
+static inline Lane4 lane4Sub(Lane4 a, Lane4 b) { return _mm_sub_ps(a, b); }
+static inline Lane4 lane4Mul(Lane4 a, Lane4 b) { return _mm_mul_ps(a, b); }
+static inline Lane4 lane4Abs(Lane4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline Lane4 lane4InvSqrt(Lane4 a) { return _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(a)); }
+
+/** `a`, negated in the lanes where `s` is negative. */
+static inline Lane4 lane4MulSign(Lane4 a, Lane4 s)
+{
+    return _mm_xor_ps(a, _mm_and_ps(s, _mm_set1_ps(-0.0f)));
+}
+
+static inline Lane4 lane4FromInt16(const int16_t* p)
+{
+    __m128i packed = _mm_loadl_epi64((const __m128i*)p);
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16));
+}
+
+static inline Lane4 lane4FromUint16(const uint16_t* p)
+{
+    __m128i packed = _mm_loadl_epi64((const __m128i*)p);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(packed, _mm_setzero_si128()));
+}
+
+#else
+
+typedef struct {
+    float v[kAnimLanes];
+} Lane4;
+
+static inline Lane4 lane4Load(const float* p) { Lane4 r; memcpy(r.v, p, sizeof r.v); return r; }
+static inline void lane4Store(float* p, Lane4 a) { memcpy(p, a.v, sizeof a.v); }
+static inline Lane4 lane4Set(float s) { Lane4 r = { { s, s, s, s } }; return r; }
+
+#define LANE4_MAP(expression) \
+    Lane4 r; \
+    for (int i = 0; i < kAnimLanes; ++i) r.v[i] = (expression); \
+    return r
+
+static inline Lane4 lane4Add(Lane4 a, Lane4 b) { LANE4_MAP(a.v[i] + b.v[i]); }
+static inline Lane4 lane4Sub(Lane4 a, Lane4 b) { LANE4_MAP(a.v[i] - b.v[i]); }
+static inline Lane4 lane4Mul(Lane4 a, Lane4 b) { LANE4_MAP(a.v[i] * b.v[i]); }
+static inline Lane4 lane4Abs(Lane4 a) { LANE4_MAP(fabsf(a.v[i])); }
+static inline Lane4 lane4InvSqrt(Lane4 a) { LANE4_MAP(1.0f / sqrtf(a.v[i])); }
+static inline Lane4 lane4MulSign(Lane4 a, Lane4 s) { LANE4_MAP(signbit(s.v[i]) ? -a.v[i] : a.v[i]); }
+static inline Lane4 lane4FromInt16(const int16_t* p) { LANE4_MAP((float)p[i]); }
+static inline Lane4 lane4FromUint16(const uint16_t* p) { LANE4_MAP((float)p[i]); }
+
+#undef LANE4_MAP
+
+#endif // ANIM_SSE2
+
+static inline Lane4 lane4Lerp(Lane4 a, Lane4 b, Lane4 t)
+{
+    return lane4Add(a, lane4Mul(lane4Sub(b, a), t));
+}
+
+// ---------------------------------------------------------------------------
+// Poses, four joints at a time
+// ---------------------------------------------------------------------------
+
+/** Local transforms of four joints, by component. */
+typedef struct {
+    float rotation[4][kAnimLanes];
+    float translation[3][kAnimLanes];
+    float scale[kAnimLanes];
+} PoseGroup;
+
+/** Local 3x4 matrices of four joints: element [row * 4 + column][joint]. */
+typedef struct {
+    float m[12][kAnimLanes];
+} MatrixGroup;
+
+/**
+ * Approximated slerp from a to b, along the shorter arc (Zeux's onlerp
+ * fit): corrects t for the angle between them, then normalized lerp.
+ */
+static void slerpLanes(const Lane4 a[4], const Lane4 b[4], Lane4 t, float out[4][kAnimLanes])
+{
+    Lane4 d = lane4Add(lane4Add(lane4Mul(a[0], b[0]), lane4Mul(a[1], b[1])),
+                       lane4Add(lane4Mul(a[2], b[2]), lane4Mul(a[3], b[3])));
+    Lane4 ad = lane4Abs(d);
+    Lane4 k1 = lane4Add(lane4Set(1.0904f),
+                        lane4Mul(ad, lane4Add(lane4Set(-3.2452f),
+                                              lane4Mul(ad, lane4Sub(lane4Set(3.55645f),
+                                                                    lane4Mul(ad, lane4Set(1.43519f)))))));
+    Lane4 k2 = lane4Add(lane4Set(0.848013f),
+                        lane4Mul(ad, lane4Add(lane4Set(-1.06021f), lane4Mul(ad, lane4Set(0.215638f)))));
+    Lane4 centered = lane4Sub(t, lane4Set(0.5f));
+    Lane4 k = lane4Add(lane4Mul(k1, lane4Mul(centered, centered)), k2);
+    Lane4 corrected = lane4Add(t, lane4Mul(lane4Mul(t, centered), lane4Mul(lane4Sub(t, lane4Set(1.0f)), k)));
+
+    Lane4 r[4];
+    for (int c = 0; c < 4; ++c) {
+        r[c] = lane4Lerp(a[c], lane4MulSign(b[c], d), corrected);
+    }
+    Lane4 length2 = lane4Add(lane4Add(lane4Mul(r[0], r[0]), lane4Mul(r[1], r[1])),
+                             lane4Add(lane4Mul(r[2], r[2]), lane4Mul(r[3], r[3])));
+    Lane4 inverseLength = lane4InvSqrt(length2);
+    for (int c = 0; c < 4; ++c) {
+        lane4Store(out[c], lane4Mul(r[c], inverseLength));
+    }
+}
+
+static float wrapTime(const AnimClip* clip, float time)
+{
+    if (clip->duration <= 0.0f) return 0.0f;
+    time = fmodf(time, clip->duration);
+    return time < 0.0f ? time + clip->duration : time;
+}
+
+static void sampleClipGroup(const AnimClip* clip, float time, uint32_t group, PoseGroup* out)
+{
+    float frame = wrapTime(clip, time) * clip->sampleRate;
+    uint32_t f0 = (uint32_t)frame;
+    if (f0 >= clip->frameCount - 1) f0 = clip->frameCount > 1 ? clip->frameCount - 2 : 0;
+    uint32_t f1 = clip->frameCount > 1 ? f0 + 1 : 0;
+    Lane4 t = lane4Set(fminf(frame - (float)f0, 1.0f));
+
+    const AnimKeyGroup* k0 = &clip->keys[f0 * clip->groupCount + group];
+    const AnimKeyGroup* k1 = &clip->keys[f1 * clip->groupCount + group];
+    const AnimTrackRange* range = &clip->ranges[group];
+
+    Lane4 unit = lane4Set(1.0f / 32767.0f);
+    Lane4 q0[4], q1[4];
+    for (int c = 0; c < 4; ++c) {
+        q0[c] = lane4Mul(lane4FromInt16(k0->rotation[c]), unit);
+        q1[c] = lane4Mul(lane4FromInt16(k1->rotation[c]), unit);
+    }
+    slerpLanes(q0, q1, t, out->rotation);
+
+    for (int c = 0; c < 3; ++c) {
+        Lane4 min = lane4Load(range->translationMin[c]);
+        Lane4 step = lane4Load(range->translationStep[c]);
+        Lane4 a = lane4Add(min, lane4Mul(lane4FromUint16(k0->translation[c]), step));
+        Lane4 b = lane4Add(min, lane4Mul(lane4FromUint16(k1->translation[c]), step));
+        lane4Store(out->translation[c], lane4Lerp(a, b, t));
+    }
+    Lane4 min = lane4Load(range->scaleMin);
+    Lane4 step = lane4Load(range->scaleStep);
+    Lane4 a = lane4Add(min, lane4Mul(lane4FromUint16(k0->scale), step));
+    Lane4 b = lane4Add(min, lane4Mul(lane4FromUint16(k1->scale), step));
+    lane4Store(out->scale, lane4Lerp(a, b, t));
+}
+
+static void blendGroups(const PoseGroup* a, const PoseGroup* b, float weight, PoseGroup* out)
+{
+    Lane4 t = lane4Set(weight);
+    Lane4 qa[4], qb[4];
+    for (int c = 0; c < 4; ++c) {
+        qa[c] = lane4Load(a->rotation[c]);
+        qb[c] = lane4Load(b->rotation[c]);
+    }
+    slerpLanes(qa, qb, t, out->rotation);
+    for (int c = 0; c < 3; ++c) {
+        lane4Store(out->translation[c], lane4Lerp(lane4Load(a->translation[c]), lane4Load(b->translation[c]), t));
+    }
+    lane4Store(out->scale, lane4Lerp(lane4Load(a->scale), lane4Load(b->scale), t));
+}
+
+/** Rotation matrix scaled, next to the translation. */
+static void poseToMatrices(const PoseGroup* pose, MatrixGroup* out)
+{
+    Lane4 x = lane4Load(pose->rotation[0]);
+    Lane4 y = lane4Load(pose->rotation[1]);
+    Lane4 z = lane4Load(pose->rotation[2]);
+    Lane4 w = lane4Load(pose->rotation[3]);
+    Lane4 s = lane4Load(pose->scale);
+    Lane4 s2 = lane4Add(s, s);
+    Lane4 one = lane4Set(1.0f);
+
+    Lane4 xx = lane4Mul(x, x), yy = lane4Mul(y, y), zz = lane4Mul(z, z);
+    Lane4 xy = lane4Mul(x, y), xz = lane4Mul(x, z), yz = lane4Mul(y, z);
+    Lane4 wx = lane4Mul(w, x), wy = lane4Mul(w, y), wz = lane4Mul(w, z);
+
+    Lane4 m[12] = {
+        lane4Mul(s, lane4Sub(one, lane4Mul(lane4Set(2.0f), lane4Add(yy, zz)))),
+        lane4Mul(s2, lane4Sub(xy, wz)),
+        lane4Mul(s2, lane4Add(xz, wy)),
+        lane4Load(pose->translation[0]),
+        lane4Mul(s2, lane4Add(xy, wz)),
+        lane4Mul(s, lane4Sub(one, lane4Mul(lane4Set(2.0f), lane4Add(xx, zz)))),
+        lane4Mul(s2, lane4Sub(yz, wx)),
+        lane4Load(pose->translation[1]),
+        lane4Mul(s2, lane4Sub(xz, wy)),
+        lane4Mul(s2, lane4Add(yz, wx)),
+        lane4Mul(s, lane4Sub(one, lane4Mul(lane4Set(2.0f), lane4Add(xx, yy)))),
+        lane4Load(pose->translation[2]),
+    };
+    for (int i = 0; i < 12; ++i) {
+        lane4Store(out->m[i], m[i]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Joint hierarchy, one joint at a time
+// ---------------------------------------------------------------------------
+
+/** out = a * b, both affine (an implicit 0 0 0 1 last row). `out` may not alias. */
+static void affineMul(const SkinJoint* a, const SkinJoint* b, SkinJoint* out)
+{
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            out->rows[r][c] = a->rows[r][0] * b->rows[0][c] + a->rows[r][1] * b->rows[1][c] +
+                              a->rows[r][2] * b->rows[2][c] + (c == 3 ? a->rows[r][3] : 0.0f);
+        }
+    }
+}
+
+static SkinJoint jointFromMat4(Mat4 m)
+{
+    SkinJoint joint;
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            joint.rows[r][c] = m.m[c * 4 + r];  // column-major
+        }
+    }
+    return joint;
+}
+
+static void sampleCharacter(const AnimCharacter* character)
+{
+    const AnimSkeleton* skeleton = character->skeleton;
+    const uint32_t groupCount = (skeleton->jointCount + kAnimLanes - 1) / kAnimLanes;
+    const AnimNode* nodes = character->nodes;
+
+    // The whole tree per group: its poses stay within a couple of kilobytes
+    MatrixGroup locals[kAnimMaxGroups];
+    for (uint32_t group = 0; group < groupCount; ++group) {
+        PoseGroup poses[kAnimMaxNodes];
+        for (uint32_t n = 0; n < character->nodeCount; ++n) {
+            const AnimNode* node = &nodes[n];
+            if (node->type == AnimNode_Clip) {
+                sampleClipGroup(node->clip, node->time, group, &poses[n]);
+            } else {
+                blendGroups(&poses[node->a], &poses[node->b], node->weight, &poses[n]);
+            }
+        }
+        poseToMatrices(&poses[character->nodeCount - 1], &locals[group]);
+    }
+
+    SkinJoint model = jointFromMat4(character->model);
+    SkinJoint world[kAnimMaxJoints];
+    for (uint32_t j = 0; j < skeleton->jointCount; ++j) {
+        const MatrixGroup* group = &locals[j / kAnimLanes];
+        uint32_t lane = j % kAnimLanes;
+        SkinJoint local;
+        for (int i = 0; i < 12; ++i) {
+            local.rows[i / 4][i % 4] = group->m[i][lane];
+        }
+        int32_t parent = skeleton->parents[j];
+        affineMul(parent >= 0 ? &world[parent] : &model, &local, &world[j]);
+        affineMul(&world[j], &skeleton->inverseBind[j], &character->palette[j]);
+    }
+}
+
+typedef struct {
+    const AnimCharacter* characters;
+    uint32_t count;
+} AnimSampleJob;
+
+static void sampleCharactersJob(void* userData, uint32_t jobIndex)
+{
+    const AnimSampleJob* job = userData;
+    uint32_t begin = jobIndex * kAnimCharactersPerJob;
+    uint32_t end = begin + kAnimCharactersPerJob;
+    if (end > job->count) end = job->count;
+
+    for (uint32_t i = begin; i < end; ++i) {
+        sampleCharacter(&job->characters[i]);
+    }
+}
+
+static bool validateCharacter(const AnimCharacter* character, uint32_t index)
+{
+    const AnimSkeleton* skeleton = character->skeleton;
+    if (!skeleton || skeleton->jointCount == 0 || skeleton->jointCount > kAnimMaxJoints || !character->palette) {
+        fprintf(stderr, "animSampleCharacters: character %u needs a skeleton of 1..%u joints and a palette\n",
+                index, kAnimMaxJoints);
+        return false;
+    }
+    for (uint32_t j = 0; j < skeleton->jointCount; ++j) {
+        if (skeleton->parents[j] >= (int32_t)j) {
+            fprintf(stderr, "animSampleCharacters: joint %u of character %u comes before its parent\n", j, index);
+            return false;
+        }
+    }
+    if (character->nodeCount == 0 || character->nodeCount > kAnimMaxNodes) {
+        fprintf(stderr, "animSampleCharacters: character %u has %u blend nodes (1..%u)\n",
+                index, character->nodeCount, kAnimMaxNodes);
+        return false;
+    }
+    for (uint32_t n = 0; n < character->nodeCount; ++n) {
+        const AnimNode* node = &character->nodes[n];
+        bool valid = node->type == AnimNode_Clip
+            ? node->clip && node->clip->jointCount >= skeleton->jointCount
+            : node->a < n && node->b < n;
+        if (!valid) {
+            fprintf(stderr, "animSampleCharacters: node %u of character %u doesn't fit its skeleton or tree\n",
+                    n, index);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool animSampleCharacters(const AnimCharacter* characters, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!validateCharacter(&characters[i], i)) return false;
+    }
+    AnimSampleJob job = { characters, count };
+    jobsParallelFor((count + kAnimCharactersPerJob - 1) / kAnimCharactersPerJob, sampleCharactersJob, &job);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Clip compression
+// ---------------------------------------------------------------------------
+
+static uint16_t quantizeUnit(float value, float min, float step)
+{
+    if (step <= 0.0f) return 0;
+    float q = roundf((value - min) / step);
+    return (uint16_t)fminf(fmaxf(q, 0.0f), 65535.0f);
+}
+
+bool createAnimClip(AnimClip* clip, const AnimKey* keys, uint32_t jointCount, uint32_t frameCount, float sampleRate)
+{
+    memset(clip, 0, sizeof *clip);
+    if (jointCount == 0 || jointCount > kAnimMaxJoints || frameCount == 0 || sampleRate <= 0.0f) {
+        fprintf(stderr, "createAnimClip: %u joints (1..%u), %u frames at %g per second\n",
+                jointCount, kAnimMaxJoints, frameCount, sampleRate);
+        return false;
+    }
+    clip->jointCount = jointCount;
+    clip->groupCount = (jointCount + kAnimLanes - 1) / kAnimLanes;
+    clip->frameCount = frameCount;
+    clip->sampleRate = sampleRate;
+    clip->duration = (float)(frameCount - 1) / sampleRate;
+    clip->keys = calloc((size_t)frameCount * clip->groupCount, sizeof *clip->keys);
+    clip->ranges = calloc(clip->groupCount, sizeof *clip->ranges);
+    if (!clip->keys || !clip->ranges) {
+        fprintf(stderr, "createAnimClip: out of memory\n");
+        releaseAnimClip(clip);
+        return false;
+    }
+
+    // Ranges over the whole clip, per joint; padding lanes stay at zero translation and unit scale
+    for (uint32_t group = 0; group < clip->groupCount; ++group) {
+        AnimTrackRange* range = &clip->ranges[group];
+        for (uint32_t lane = 0; lane < kAnimLanes; ++lane) {
+            uint32_t joint = group * kAnimLanes + lane;
+            if (joint >= jointCount) {
+                range->scaleMin[lane] = 1.0f;
+                continue;
+            }
+            float min[4], max[4];
+            for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                const AnimKey* key = &keys[(size_t)frame * jointCount + joint];
+                float values[4] = { key->translation[0], key->translation[1], key->translation[2], key->scale };
+                for (int c = 0; c < 4; ++c) {
+                    min[c] = frame == 0 ? values[c] : fminf(min[c], values[c]);
+                    max[c] = frame == 0 ? values[c] : fmaxf(max[c], values[c]);
+                }
+            }
+            for (int c = 0; c < 3; ++c) {
+                range->translationMin[c][lane] = min[c];
+                range->translationStep[c][lane] = (max[c] - min[c]) / 65535.0f;
+            }
+            range->scaleMin[lane] = min[3];
+            range->scaleStep[lane] = (max[3] - min[3]) / 65535.0f;
+        }
+    }
+
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        for (uint32_t group = 0; group < clip->groupCount; ++group) {
+            AnimKeyGroup* out = &clip->keys[frame * clip->groupCount + group];
+            const AnimTrackRange* range = &clip->ranges[group];
+            for (uint32_t lane = 0; lane < kAnimLanes; ++lane) {
+                uint32_t joint = group * kAnimLanes + lane;
+                if (joint >= jointCount) {
+                    out->rotation[3][lane] = 32767;
+                    continue;
+                }
+                const AnimKey* key = &keys[(size_t)frame * jointCount + joint];
+                const float* q = key->rotation;
+                float length = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+                float scale = length > 0.0f ? 32767.0f / length : 0.0f;
+                for (int c = 0; c < 4; ++c) {
+                    out->rotation[c][lane] = (int16_t)roundf(q[c] * scale);
+                }
+                if (length == 0.0f) out->rotation[3][lane] = 32767;
+                for (int c = 0; c < 3; ++c) {
+                    out->translation[c][lane] = quantizeUnit(key->translation[c], range->translationMin[c][lane],
+                                                             range->translationStep[c][lane]);
+                }
+                out->scale[lane] = quantizeUnit(key->scale, range->scaleMin[lane], range->scaleStep[lane]);
+            }
+        }
+    }
+    return true;
+}
+
+void releaseAnimClip(AnimClip* clip)
+{
+    free(clip->keys);
+    free(clip->ranges);
+    memset(clip, 0, sizeof *clip);
+}
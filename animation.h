@@ -0,0 +1,120 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "linalg.h"
+#include "skinning.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * ANIMATION SAMPLING
+ *
+ * CPU side of skinned characters: clips are sampled, blended through a
+ * small blend tree, and the pose is turned into a joint palette written
+ * straight into the skinning upload region (skinJointPalette()).
+ *
+ * Everything before the joint hierarchy works on joints four at a time,
+ * structure-of-arrays: a group holds the x of four rotations, then their
+ * y, and so on, so one SSE register carries one component of four joints
+ * (plain C elsewhere, same results). Per group, the whole blend tree is
+ * evaluated before moving on, keeping its poses in a few cache lines.
+ * Characters are spread over the job system in batches.
+ *
+ * Clips are keyframed at a fixed rate and compressed to 16 bytes a key:
+ * rotations quantized to 16 bits per component, translations and scale
+ * to 16 bits within each joint's range over the clip. Keys are stored
+ * frame by frame in the same four-joint groups, so sampling a group reads
+ * two contiguous 64-byte blocks.
+ *
+ * Rotations are interpolated with an approximated slerp: a normalized lerp
+ * whose parameter is corrected by a polynomial in the angle, within about
+ * 1e-3 of the real one, without any trigonometry.
+ *
+ * Per frame:
+ *      ... set each character's node times and weights ...
+ *      animSampleCharacters(characters, count);    // palettes into the skinning upload region
+ *      skinUpload(&skin);
+ */
+
+#define kAnimMaxJoints kSkinMaxJoints
+#define kAnimMaxNodes 16
+
+/** One raw key of one joint, for createAnimClip(). Scale is uniform. */
+typedef struct {
+    float rotation[4];          // x, y, z, w
+    float translation[3];
+    float scale;
+} AnimKey;
+
+/** One frame of four joints, quantized, laid out by component (64 bytes). */
+typedef struct {
+    int16_t rotation[4][4];     // [component][joint], x 32767
+    uint16_t translation[3][4]; // within the group's AnimTrackRange
+    uint16_t scale[4];
+} AnimKeyGroup;
+
+/** Dequantization of one group's translation and scale: min + key * step. */
+typedef struct {
+    float translationMin[3][4];
+    float translationStep[3][4];
+    float scaleMin[4];
+    float scaleStep[4];
+} AnimTrackRange;
+
+typedef struct {
+    uint32_t jointCount;
+    uint32_t groupCount;        // of four joints, the last one padded with identities
+    uint32_t frameCount;
+    float sampleRate;           // frames per second
+    float duration;             // seconds from the first frame to the last; sampling wraps around
+    AnimKeyGroup* keys;         // [frame * groupCount + group]
+    AnimTrackRange* ranges;     // [group]
+} AnimClip;
+
+/** Joints are ordered parents first. */
+typedef struct {
+    uint32_t jointCount;        // up to kAnimMaxJoints
+    const int32_t* parents;     // -1 for roots, else an earlier joint
+    const SkinJoint* inverseBind;   // model space to each joint's bind space
+} AnimSkeleton;
+
+typedef enum {
+    AnimNode_Clip,
+    AnimNode_Blend,
+} AnimNodeType;
+
+/** One node of a blend tree. */
+typedef struct {
+    AnimNodeType type;
+    const AnimClip* clip;       // clip: sampled at `time` seconds
+    float time;
+    uint32_t a, b;              // blend: earlier nodes, mixed by `weight` (0 is all a)
+    float weight;
+} AnimNode;
+
+typedef struct {
+    const AnimSkeleton* skeleton;
+    const AnimNode* nodes;      // children before parents; the last node is the root
+    uint32_t nodeCount;         // up to kAnimMaxNodes
+    Mat4 model;                 // placed in the world by the palette
+    SkinJoint* palette;         // skeleton->jointCount joints, e.g. skinJointPalette()
+} AnimCharacter;
+
+/**
+ * Compress `frameCount` frames of `jointCount` joints, `keys` frame by
+ * frame, sampled at `sampleRate` per second. A looping clip repeats its
+ * first frame at the end.
+ */
+bool createAnimClip(AnimClip* clip, const AnimKey* keys, uint32_t jointCount, uint32_t frameCount, float sampleRate);
+
+void releaseAnimClip(AnimClip* clip);
+
+/**
+ * Sample, blend and write the palette of every character, in parallel
+ * over the job system. Fails without writing anything if a character's
+ * tree or clips don't fit its skeleton.
+ */
+bool animSampleCharacters(const AnimCharacter* characters, uint32_t count);
+
+#endif // ANIMATION_H
@@ -0,0 +1,559 @@
+#include "atlas.h"
+#include "webgpu-utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Only repack layers that are at least this full, however fragmented. */
+#define kAtlasDefragMinCoverage 0.25f
+
+/** Merge dirty rectangles whose union wastes less than this share. */
+#define kAtlasDirtyMergeSlack 0.25f
+
+static void resetSkyline(AtlasLayer* layer, uint32_t width)
+{
+    layer->nodes[0].x = 0;
+    layer->nodes[0].y = 0;
+    layer->nodes[0].width = width;
+    layer->nodeCount = 1;
+    layer->liveArea = 0;
+}
+
+/** Area below the skyline, i.e. what the layer has handed out so far. */
+static uint64_t skylineArea(const AtlasLayer* layer)
+{
+    uint64_t area = 0;
+    for (uint32_t i = 0; i < layer->nodeCount; ++i) {
+        area += (uint64_t)layer->nodes[i].y * layer->nodes[i].width;
+    }
+    return area;
+}
+
+/**
+ * Top of a w x h rectangle whose left edge sits on node `index`, or false
+ * if it would leave the layer.
+ */
+static bool skylineFit(const AtlasLayer* layer, uint32_t layerWidth, uint32_t layerHeight,
+                       uint32_t index, uint32_t w, uint32_t h, uint32_t* y)
+{
+    if (layer->nodes[index].x + w > layerWidth) return false;
+
+    uint32_t top = 0;
+    uint32_t widthLeft = w;
+    for (uint32_t i = index; widthLeft > 0; ++i) {
+        if (layer->nodes[i].y > top) top = layer->nodes[i].y;
+        if (top + h > layerHeight) return false;
+        if (layer->nodes[i].width >= widthLeft) break;
+        widthLeft -= layer->nodes[i].width;
+    }
+    *y = top;
+    return true;
+}
+
+/**
+ * SKYLINE ALLOCATE
+ *
+ * Bottom-left rule: lowest resulting top first, then the narrowest
+ * segment, which keeps wide gaps for wide rectangles.
+ */
+static bool skylineAllocate(AtlasLayer* layer, uint32_t layerWidth, uint32_t layerHeight,
+                            uint32_t w, uint32_t h, uint32_t* x, uint32_t* y)
+{
+    uint32_t bestIndex = UINT32_MAX;
+    uint32_t bestTop = UINT32_MAX;
+    uint32_t bestWidth = UINT32_MAX;
+    uint32_t bestY = 0;
+
+    for (uint32_t i = 0; i < layer->nodeCount; ++i) {
+        uint32_t top;
+        if (!skylineFit(layer, layerWidth, layerHeight, i, w, h, &top)) continue;
+        if (top + h < bestTop || (top + h == bestTop && layer->nodes[i].width < bestWidth)) {
+            bestIndex = i;
+            bestTop = top + h;
+            bestWidth = layer->nodes[i].width;
+            bestY = top;
+        }
+    }
+    if (bestIndex == UINT32_MAX) return false;
+
+    *x = layer->nodes[bestIndex].x;
+    *y = bestY;
+
+    // Insert the new segment, then trim or drop the segments it covers
+    SkylineNode* nodes = layer->nodes;
+    memmove(&nodes[bestIndex + 1], &nodes[bestIndex],
+            (layer->nodeCount - bestIndex) * sizeof *nodes);
+    nodes[bestIndex].x = *x;
+    nodes[bestIndex].y = bestY + h;
+    nodes[bestIndex].width = w;
+    layer->nodeCount++;
+
+    uint32_t right = *x + w;
+    uint32_t i = bestIndex + 1;
+    while (i < layer->nodeCount && nodes[i].x < right) {
+        uint32_t nodeRight = nodes[i].x + nodes[i].width;
+        if (nodeRight <= right) {
+            memmove(&nodes[i], &nodes[i + 1], (layer->nodeCount - i - 1) * sizeof *nodes);
+            layer->nodeCount--;
+        } else {
+            nodes[i].width = nodeRight - right;
+            nodes[i].x = right;
+            break;
+        }
+    }
+
+    // Merge neighbours of equal height
+    for (i = 0; i + 1 < layer->nodeCount; ) {
+        if (nodes[i].y == nodes[i + 1].y) {
+            nodes[i].width += nodes[i + 1].width;
+            memmove(&nodes[i + 1], &nodes[i + 2], (layer->nodeCount - i - 2) * sizeof *nodes);
+            layer->nodeCount--;
+        } else {
+            ++i;
+        }
+    }
+    return true;
+}
+
+static uint64_t rectArea(AtlasRect r)
+{
+    return (uint64_t)(r.x1 - r.x0) * (r.y1 - r.y0);
+}
+
+static AtlasRect rectUnion(AtlasRect a, AtlasRect b)
+{
+    AtlasRect r;
+    r.x0 = a.x0 < b.x0 ? a.x0 : b.x0;
+    r.y0 = a.y0 < b.y0 ? a.y0 : b.y0;
+    r.x1 = a.x1 > b.x1 ? a.x1 : b.x1;
+    r.y1 = a.y1 > b.y1 ? a.y1 : b.y1;
+    return r;
+}
+
+/**
+ * Record a dirty rectangle, folding it into an existing one when their
+ * union is mostly made of the two. Glyphs inserted in a burst land next
+ * to each other on the skyline and end up as a handful of uploads.
+ */
+static void markDirty(AtlasLayer* layer, AtlasRect rect)
+{
+    for (uint32_t i = 0; i < layer->dirtyCount; ++i) {
+        AtlasRect merged = rectUnion(layer->dirty[i], rect);
+        uint64_t parts = rectArea(layer->dirty[i]) + rectArea(rect);
+        if (rectArea(merged) <= parts + (uint64_t)(parts * kAtlasDirtyMergeSlack)) {
+            layer->dirty[i] = layer->dirty[--layer->dirtyCount];
+            markDirty(layer, merged);
+            return;
+        }
+    }
+
+    if (layer->dirtyCount == kAtlasMaxDirtyRects) {
+        for (uint32_t i = 1; i < layer->dirtyCount; ++i) {
+            layer->dirty[0] = rectUnion(layer->dirty[0], layer->dirty[i]);
+        }
+        layer->dirty[0] = rectUnion(layer->dirty[0], rect);
+        layer->dirtyCount = 1;
+        return;
+    }
+    layer->dirty[layer->dirtyCount++] = rect;
+}
+
+bool createTextureAtlas(TextureAtlas* atlas,
+                        WGPUDevice device,
+                        WGPUQueue queue,
+                        const TextureAtlasDescriptor* desc)
+{
+    memset(atlas, 0, sizeof *atlas);
+
+    uint32_t blockWidth, blockHeight, bytesPerBlock;
+    if (!textureFormatBlockInfo(desc->format, &blockWidth, &blockHeight, &bytesPerBlock) ||
+        blockWidth != 1 || blockHeight != 1) {
+        fprintf(stderr, "createTextureAtlas: format 0x%x can't be packed\n", (unsigned)desc->format);
+        return false;
+    }
+
+    atlas->device = device;
+    atlas->queue = queue;
+    atlas->format = desc->format;
+    atlas->bytesPerPixel = bytesPerBlock;
+    atlas->width = desc->width;
+    atlas->height = desc->height;
+    atlas->layerCount = desc->layerCount ? desc->layerCount : 1;
+    atlas->padding = desc->padding;
+    atlas->defragThreshold = desc->defragThreshold;
+
+    atlas->layers = calloc(atlas->layerCount, sizeof *atlas->layers);
+    if (!atlas->layers) {
+        fprintf(stderr, "createTextureAtlas: out of memory\n");
+        return false;
+    }
+    size_t layerBytes = (size_t)atlas->width * atlas->height * atlas->bytesPerPixel;
+    for (uint32_t l = 0; l < atlas->layerCount; ++l) {
+        AtlasLayer* layer = &atlas->layers[l];
+        // A skyline never has more segments than the layer has columns
+        layer->nodes = malloc((atlas->width + 1) * sizeof *layer->nodes);
+        layer->pixels = calloc(1, layerBytes);
+        if (!layer->nodes || !layer->pixels) {
+            fprintf(stderr, "createTextureAtlas: out of memory\n");
+            releaseTextureAtlas(atlas);
+            return false;
+        }
+        resetSkyline(layer, atlas->width);
+    }
+
+    WGPUTextureDescriptor textureDesc = {0};
+    textureDesc.label = desc->label;
+    textureDesc.usage = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst;
+    textureDesc.dimension = WGPUTextureDimension_2D;
+    textureDesc.size.width = atlas->width;
+    textureDesc.size.height = atlas->height;
+    textureDesc.size.depthOrArrayLayers = atlas->layerCount;
+    textureDesc.format = atlas->format;
+    textureDesc.mipLevelCount = 1;
+    textureDesc.sampleCount = 1;
+    atlas->texture = wgpuDeviceCreateTexture(device, &textureDesc);
+    if (!atlas->texture) {
+        releaseTextureAtlas(atlas);
+        return false;
+    }
+
+    WGPUTextureViewDescriptor viewDesc = {0};
+    viewDesc.label = desc->label;
+    viewDesc.format = atlas->format;
+    viewDesc.dimension = WGPUTextureViewDimension_2DArray;
+    viewDesc.baseMipLevel = 0;
+    viewDesc.mipLevelCount = 1;
+    viewDesc.baseArrayLayer = 0;
+    viewDesc.arrayLayerCount = atlas->layerCount;
+    viewDesc.aspect = WGPUTextureAspect_All;
+    atlas->view = wgpuTextureCreateView(atlas->texture, &viewDesc);
+    if (!atlas->view) {
+        releaseTextureAtlas(atlas);
+        return false;
+    }
+
+    // Start from a known (cleared) texture
+    for (uint32_t l = 0; l < atlas->layerCount; ++l) {
+        AtlasRect all = { 0, 0, atlas->width, atlas->height };
+        markDirty(&atlas->layers[l], all);
+    }
+    return true;
+}
+
+void releaseTextureAtlas(TextureAtlas* atlas)
+{
+    if (atlas->view) wgpuTextureViewRelease(atlas->view);
+    if (atlas->texture) {
+        wgpuTextureDestroy(atlas->texture);
+        wgpuTextureRelease(atlas->texture);
+    }
+    if (atlas->layers) {
+        for (uint32_t l = 0; l < atlas->layerCount; ++l) {
+            free(atlas->layers[l].nodes);
+            free(atlas->layers[l].pixels);
+        }
+        free(atlas->layers);
+    }
+    free(atlas->entries);
+    memset(atlas, 0, sizeof *atlas);
+}
+
+/** Place a w x h padded rectangle in the first of `layers` (the atlas's, or a repack's) it fits. */
+static bool allocateEntry(const TextureAtlas* atlas, AtlasLayer* layers, uint32_t w, uint32_t h, AtlasEntry* entry)
+{
+    for (uint32_t l = 0; l < atlas->layerCount; ++l) {
+        AtlasLayer* layer = &layers[l];
+        uint32_t x, y;
+        if (skylineAllocate(layer, atlas->width, atlas->height, w, h, &x, &y)) {
+            entry->x = x;
+            entry->y = y;
+            entry->width = w;
+            entry->height = h;
+            entry->layer = l;
+            layer->liveArea += (uint64_t)w * h;
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Clear the padded rectangle and copy the image into its interior. */
+static void writeEntry(TextureAtlas* atlas, const AtlasEntry* entry,
+                       const uint8_t* pixels, uint32_t bytesPerRow)
+{
+    AtlasLayer* layer = &atlas->layers[entry->layer];
+    size_t pitch = (size_t)atlas->width * atlas->bytesPerPixel;
+    size_t rowBytes = (size_t)entry->width * atlas->bytesPerPixel;
+    uint8_t* base = layer->pixels + entry->y * pitch + (size_t)entry->x * atlas->bytesPerPixel;
+
+    for (uint32_t row = 0; row < entry->height; ++row) {
+        memset(base + row * pitch, 0, rowBytes);
+    }
+
+    uint32_t p = atlas->padding;
+    size_t imageRowBytes = (size_t)(entry->width - 2 * p) * atlas->bytesPerPixel;
+    for (uint32_t row = 0; row < entry->height - 2 * p; ++row) {
+        memcpy(base + (row + p) * pitch + (size_t)p * atlas->bytesPerPixel,
+               pixels + (size_t)row * bytesPerRow, imageRowBytes);
+    }
+
+    AtlasRect rect = { entry->x, entry->y, entry->x + entry->width, entry->y + entry->height };
+    markDirty(layer, rect);
+}
+
+AtlasHandle atlasInsert(TextureAtlas* atlas,
+                        uint32_t width,
+                        uint32_t height,
+                        const void* pixels,
+                        uint32_t bytesPerRow)
+{
+    uint32_t w = width + 2 * atlas->padding;
+    uint32_t h = height + 2 * atlas->padding;
+    if (width == 0 || height == 0 || w > atlas->width || h > atlas->height) {
+        fprintf(stderr, "atlasInsert: %ux%u doesn't fit a %ux%u atlas\n",
+                width, height, atlas->width, atlas->height);
+        return kAtlasInvalidHandle;
+    }
+
+    AtlasEntry entry = {0};
+    if (!allocateEntry(atlas, atlas->layers, w, h, &entry)) {
+        // Only worth repacking if removals freed at least that much
+        if (atlas->freedArea < (uint64_t)w * h) return kAtlasInvalidHandle;
+
+        if (!atlasDefragment(atlas) || !allocateEntry(atlas, atlas->layers, w, h, &entry)) {
+            return kAtlasInvalidHandle;
+        }
+    }
+    entry.live = true;
+
+    AtlasHandle handle;
+    if (atlas->freeList != kAtlasInvalidHandle) {
+        handle = atlas->freeList;
+        atlas->freeList = atlas->entries[handle - 1].nextFree;
+    } else {
+        if (atlas->entryCount == atlas->entryCapacity) {
+            uint32_t capacity = atlas->entryCapacity ? atlas->entryCapacity * 2 : 64;
+            AtlasEntry* entries = realloc(atlas->entries, capacity * sizeof *entries);
+            if (!entries) {
+                fprintf(stderr, "atlasInsert: out of memory\n");
+                atlas->layers[entry.layer].liveArea -= (uint64_t)w * h;
+                return kAtlasInvalidHandle;
+            }
+            atlas->entries = entries;
+            atlas->entryCapacity = capacity;
+        }
+        handle = ++atlas->entryCount;
+    }
+
+    atlas->entries[handle - 1] = entry;
+    writeEntry(atlas, &entry, pixels, bytesPerRow);
+    return handle;
+}
+
+void atlasRemove(TextureAtlas* atlas, AtlasHandle handle)
+{
+    if (handle == kAtlasInvalidHandle || handle > atlas->entryCount) return;
+    AtlasEntry* entry = &atlas->entries[handle - 1];
+    if (!entry->live) return;
+
+    AtlasLayer* layer = &atlas->layers[entry->layer];
+    layer->liveArea -= (uint64_t)entry->width * entry->height;
+    atlas->freedArea += (uint64_t)entry->width * entry->height;
+    entry->live = false;
+    entry->nextFree = atlas->freeList;
+    atlas->freeList = handle;
+
+    // Repack on the next flush rather than in the middle of a frame's removals
+    uint64_t layerArea = (uint64_t)atlas->width * atlas->height;
+    if (skylineArea(layer) >= layerArea * kAtlasDefragMinCoverage &&
+        atlasFragmentation(atlas, entry->layer) > atlas->defragThreshold) {
+        atlas->defragRequested = true;
+    }
+}
+
+bool atlasGetRegion(const TextureAtlas* atlas, AtlasHandle handle, AtlasRegion* region)
+{
+    if (handle == kAtlasInvalidHandle || handle > atlas->entryCount) return false;
+    const AtlasEntry* entry = &atlas->entries[handle - 1];
+    if (!entry->live) return false;
+
+    region->x = entry->x + atlas->padding;
+    region->y = entry->y + atlas->padding;
+    region->width = entry->width - 2 * atlas->padding;
+    region->height = entry->height - 2 * atlas->padding;
+    region->layer = entry->layer;
+    return true;
+}
+
+float atlasFragmentation(const TextureAtlas* atlas, uint32_t layer)
+{
+    uint64_t packed = skylineArea(&atlas->layers[layer]);
+    if (packed == 0) return 0.0f;
+    return 1.0f - (float)atlas->layers[layer].liveArea / (float)packed;
+}
+
+typedef struct {
+    uint32_t handle;
+    uint32_t width, height;
+} PackOrder;
+
+static int compareByHeight(const void* a, const void* b)
+{
+    const PackOrder* pa = a;
+    const PackOrder* pb = b;
+    if (pa->height != pb->height) return pa->height > pb->height ? -1 : 1;
+    if (pa->width != pb->width) return pa->width > pb->width ? -1 : 1;
+    return pa->handle < pb->handle ? -1 : pa->handle > pb->handle;
+}
+
+static void freeLayers(AtlasLayer* layers, uint32_t layerCount)
+{
+    if (!layers) return;
+    for (uint32_t l = 0; l < layerCount; ++l) {
+        free(layers[l].nodes);
+        free(layers[l].pixels);
+    }
+    free(layers);
+}
+
+/**
+ * ATLAS DEFRAGMENT
+ *
+ * Tallest first packs a skyline best. The live entries are packed into
+ * fresh layers (skylines and CPU copies) on the side, and only swapped in
+ * once every one of them has found a place: a repack that doesn't fit,
+ * which the packing order doesn't rule out, leaves the atlas as it was.
+ * The new layers are re-uploaded whole on the next flush; handles stay
+ * valid, only their regions change.
+ */
+bool atlasDefragment(TextureAtlas* atlas)
+{
+    atlas->defragRequested = false;
+
+    uint32_t liveCount = 0;
+    for (uint32_t i = 0; i < atlas->entryCount; ++i) {
+        if (atlas->entries[i].live) liveCount++;
+    }
+
+    PackOrder* order = malloc((liveCount ? liveCount : 1) * sizeof *order);
+    AtlasEntry* placed = malloc((liveCount ? liveCount : 1) * sizeof *placed);
+    AtlasLayer* layers = calloc(atlas->layerCount, sizeof *layers);
+    size_t layerBytes = (size_t)atlas->width * atlas->height * atlas->bytesPerPixel;
+    bool ok = order && placed && layers;
+    for (uint32_t l = 0; ok && l < atlas->layerCount; ++l) {
+        layers[l].nodes = malloc((atlas->width + 1) * sizeof *layers[l].nodes);
+        layers[l].pixels = calloc(1, layerBytes);
+        ok = layers[l].nodes && layers[l].pixels;
+        if (ok) resetSkyline(&layers[l], atlas->width);
+    }
+    if (!ok) {
+        fprintf(stderr, "atlasDefragment: out of memory\n");
+        freeLayers(layers, atlas->layerCount);
+        free(placed);
+        free(order);
+        return false;
+    }
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < atlas->entryCount; ++i) {
+        if (!atlas->entries[i].live) continue;
+        order[n].handle = i + 1;
+        order[n].width = atlas->entries[i].width;
+        order[n].height = atlas->entries[i].height;
+        n++;
+    }
+    qsort(order, n, sizeof *order, compareByHeight);
+
+    for (uint32_t i = 0; i < n; ++i) {
+        placed[i] = atlas->entries[order[i].handle - 1];
+        if (!allocateEntry(atlas, layers, order[i].width, order[i].height, &placed[i])) {
+            fprintf(stderr, "atlasDefragment: %u live entries don't fit once repacked, keeping the current layout\n",
+                    n);
+            freeLayers(layers, atlas->layerCount);
+            free(placed);
+            free(order);
+            return false;
+        }
+    }
+
+    size_t pitch = (size_t)atlas->width * atlas->bytesPerPixel;
+    for (uint32_t i = 0; i < n; ++i) {
+        AtlasEntry* entry = &atlas->entries[order[i].handle - 1];
+        const AtlasEntry* moved = &placed[i];
+        size_t rowBytes = (size_t)entry->width * atlas->bytesPerPixel;
+        const uint8_t* from = atlas->layers[entry->layer].pixels + entry->y * pitch +
+                              (size_t)entry->x * atlas->bytesPerPixel;
+        uint8_t* to = layers[moved->layer].pixels + moved->y * pitch + (size_t)moved->x * atlas->bytesPerPixel;
+        for (uint32_t row = 0; row < entry->height; ++row) {
+            memcpy(to + row * pitch, from + row * pitch, rowBytes);
+        }
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        atlas->entries[order[i].handle - 1] = placed[i];
+    }
+
+    for (uint32_t l = 0; l < atlas->layerCount; ++l) {
+        AtlasLayer* layer = &atlas->layers[l];
+        free(layer->nodes);
+        free(layer->pixels);
+        layer->nodes = layers[l].nodes;
+        layer->nodeCount = layers[l].nodeCount;
+        layer->liveArea = layers[l].liveArea;
+        layer->pixels = layers[l].pixels;
+        AtlasRect all = { 0, 0, atlas->width, atlas->height };
+        layer->dirtyCount = 0;
+        markDirty(layer, all);
+    }
+    free(layers);
+    free(placed);
+    free(order);
+
+    atlas->freedArea = 0;
+    atlas->generation++;
+    atlas->defragCount++;
+    return true;
+}
+
+void atlasFlush(TextureAtlas* atlas)
+{
+    if (atlas->defragRequested) {
+        atlasDefragment(atlas);
+    }
+
+    atlas->uploadedBytes = 0;
+    atlas->uploadCount = 0;
+
+    size_t pitch = (size_t)atlas->width * atlas->bytesPerPixel;
+    for (uint32_t l = 0; l < atlas->layerCount; ++l) {
+        AtlasLayer* layer = &atlas->layers[l];
+        for (uint32_t i = 0; i < layer->dirtyCount; ++i) {
+            AtlasRect r = layer->dirty[i];
+            uint32_t w = r.x1 - r.x0;
+            uint32_t h = r.y1 - r.y0;
+
+            WGPUImageCopyTexture destination = {0};
+            destination.texture = atlas->texture;
+            destination.mipLevel = 0;
+            destination.origin.x = r.x0;
+            destination.origin.y = r.y0;
+            destination.origin.z = l;
+            destination.aspect = WGPUTextureAspect_All;
+
+            // Upload straight out of the layer copy, using its pitch
+            WGPUTextureDataLayout layout = {0};
+            layout.offset = 0;
+            layout.bytesPerRow = (uint32_t)pitch;
+            layout.rowsPerImage = h;
+
+            const uint8_t* data = layer->pixels + r.y0 * pitch + (size_t)r.x0 * atlas->bytesPerPixel;
+            size_t size = (h - 1) * pitch + (size_t)w * atlas->bytesPerPixel;
+            WGPUExtent3D extent = { w, h, 1 };
+            wgpuQueueWriteTexture(atlas->queue, &destination, data, size, &layout, &extent);
+
+            atlas->uploadedBytes += (uint64_t)w * h * atlas->bytesPerPixel;
+            atlas->uploadCount++;
+        }
+        layer->dirtyCount = 0;
+    }
+}
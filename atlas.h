@@ -0,0 +1,144 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * TEXTURE ATLAS
+ *
+ * Packs many small images (glyphs, icons, decals) into the layers of one
+ * 2D array texture, so they share one bind group and draws using them can
+ * be batched.
+ *
+ * Each layer is packed with a bottom-left skyline: the top outline of the
+ * packed rectangles is kept as a list of horizontal segments, and a new
+ * rectangle goes where its top ends lowest. Removed entries leave holes
+ * below the skyline that can't be reused; once the wasted share of a layer
+ * passes `defragThreshold`, every live entry is repacked from scratch.
+ *
+ * Pixels live in a CPU copy of each layer. Insertions only write there and
+ * record a dirty rectangle; atlasFlush() merges nearby rectangles and
+ * uploads each with one WriteTexture. Repacking moves entries: it bumps
+ * `generation`, after which cached regions must be looked up again.
+ */
+
+#define kAtlasInvalidHandle 0
+
+typedef uint32_t AtlasHandle;
+
+/** Where an entry is, in texels, without its padding. */
+typedef struct {
+    uint32_t x, y;
+    uint32_t width, height;
+    uint32_t layer;
+} AtlasRegion;
+
+typedef struct {
+    uint32_t x, y, width;       // segment [x, x + width) with its top at y
+} SkylineNode;
+
+typedef struct {
+    uint32_t x0, y0, x1, y1;    // half-open
+} AtlasRect;
+
+#define kAtlasMaxDirtyRects 32
+
+typedef struct {
+    SkylineNode* nodes;
+    uint32_t nodeCount;
+    uint64_t liveArea;          // padded area of the live entries
+
+    uint8_t* pixels;            // CPU copy of the layer
+    AtlasRect dirty[kAtlasMaxDirtyRects];
+    uint32_t dirtyCount;
+} AtlasLayer;
+
+typedef struct {
+    uint32_t x, y;              // padded rectangle
+    uint32_t width, height;
+    uint32_t layer;
+    uint32_t nextFree;          // free list link while unused
+    bool live;
+} AtlasEntry;
+
+typedef struct {
+    const char* label;
+    uint32_t width;
+    uint32_t height;
+    uint32_t layerCount;
+    WGPUTextureFormat format;   // uncompressed, e.g. R8Unorm or RGBA8Unorm
+    uint32_t padding;           // empty texels kept around every entry
+    float defragThreshold;      // wasted share of a layer that triggers repacking
+} TextureAtlasDescriptor;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+    WGPUTexture texture;
+    WGPUTextureView view;       // 2D array view of every layer
+
+    WGPUTextureFormat format;
+    uint32_t bytesPerPixel;
+    uint32_t width, height, layerCount;
+    uint32_t padding;
+    float defragThreshold;
+
+    AtlasLayer* layers;
+
+    AtlasEntry* entries;        // indexed by handle - 1
+    uint32_t entryCount;
+    uint32_t entryCapacity;
+    uint32_t freeList;          // handle of the first unused entry
+    uint64_t freedArea;         // removed since the last repacking
+
+    uint32_t generation;        // bumped whenever entries move
+    bool defragRequested;
+
+    // Stats for the last flush
+    uint64_t uploadedBytes;
+    uint32_t uploadCount;
+    uint32_t defragCount;       // total
+} TextureAtlas;
+
+bool createTextureAtlas(TextureAtlas* atlas,
+                        WGPUDevice device,
+                        WGPUQueue queue,
+                        const TextureAtlasDescriptor* desc);
+
+void releaseTextureAtlas(TextureAtlas* atlas);
+
+/**
+ * Copy an image into the atlas. `bytesPerRow` is the source pitch.
+ * Repacks right away if nothing fits but repacking would make room.
+ * Returns kAtlasInvalidHandle when the atlas is full.
+ */
+AtlasHandle atlasInsert(TextureAtlas* atlas,
+                        uint32_t width,
+                        uint32_t height,
+                        const void* pixels,
+                        uint32_t bytesPerRow);
+
+/** Free an entry. Its space is only reclaimed by the next repacking. */
+void atlasRemove(TextureAtlas* atlas, AtlasHandle handle);
+
+bool atlasGetRegion(const TextureAtlas* atlas, AtlasHandle handle, AtlasRegion* region);
+
+/** Share of the packed area of a layer that belongs to no live entry. */
+float atlasFragmentation(const TextureAtlas* atlas, uint32_t layer);
+
+/**
+ * Repack every live entry, dropping the holes left by removals. Returns
+ * false, with the layout unchanged, if they don't all fit once repacked.
+ */
+bool atlasDefragment(TextureAtlas* atlas);
+
+/**
+ * Upload everything inserted since the last flush (after repacking, if a
+ * removal asked for it). Call once per frame before drawing with the atlas.
+ */
+void atlasFlush(TextureAtlas* atlas);
+
+#endif // ATLAS_H
@@ -0,0 +1,259 @@
+#include "auto-exposure.h"
+#include "webgpu-utils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Uniform block of both passes. Must match ExposureUniforms in
+ * kExposureWGSL (32 bytes).
+ */
+typedef struct {
+    float minLogLuminance;
+    float logLuminanceRange;
+    float timeDelta;
+    float speedUp;
+    float speedDown;
+    float compensation;
+    float minExposure;
+    float maxExposure;
+} ExposureUniforms;
+
+static const char* kExposureWGSL =
+"struct ExposureUniforms {\n"
+"    minLogLuminance: f32,\n"
+"    logLuminanceRange: f32,\n"
+"    timeDelta: f32,\n"
+"    speedUp: f32,\n"
+"    speedDown: f32,\n"
+"    compensation: f32,\n"
+"    minExposure: f32,\n"
+"    maxExposure: f32,\n"
+"}\n"
+"struct ExposureState {\n"
+"    luminance: f32,\n"
+"    exposure: f32,\n"
+"}\n"
+"\n"
+"@group(0) @binding(0) var<uniform> settings: ExposureUniforms;\n"
+"@group(0) @binding(1) var scene: texture_2d<f32>;\n"
+"@group(0) @binding(2) var<storage, read_write> histogram: array<atomic<u32>, 256>;\n"
+"@group(0) @binding(3) var<storage, read_write> state: ExposureState;\n"
+"\n"
+"// Middle grey: the average luminance is exposed to this\n"
+"const kKey = 0.18;\n"
+"\n"
+"var<workgroup> localBins: array<atomic<u32>, 256>;\n"
+"var<workgroup> weightedBins: array<f32, 256>;\n"
+"var<workgroup> pixelCounts: array<f32, 256>;\n"
+"\n"
+"// Bin 0 holds black pixels, bins 1-255 the log2 luminance range\n"
+"fn luminanceBin(c: vec3f) -> u32 {\n"
+"    let luminance = dot(c, vec3f(0.2126, 0.7152, 0.0722));\n"
+"    if (luminance < 1e-5) {\n"
+"        return 0u;\n"
+"    }\n"
+"    let t = saturate((log2(luminance) - settings.minLogLuminance) / settings.logLuminanceRange);\n"
+"    return u32(t * 254.0 + 1.0);\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(16, 16)\n"
+"fn buildHistogram(@builtin(global_invocation_id) id: vec3u,\n"
+"                  @builtin(local_invocation_index) lane: u32) {\n"
+"    atomicStore(&localBins[lane], 0u);\n"
+"    workgroupBarrier();\n"
+"\n"
+"    if (all(id.xy < textureDimensions(scene))) {\n"
+"        atomicAdd(&localBins[luminanceBin(textureLoad(scene, id.xy, 0).rgb)], 1u);\n"
+"    }\n"
+"    workgroupBarrier();\n"
+"\n"
+"    // One global atomic per non-empty bin and workgroup instead of one per pixel\n"
+"    let count = atomicLoad(&localBins[lane]);\n"
+"    if (count > 0u) {\n"
+"        atomicAdd(&histogram[lane], count);\n"
+"    }\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(256)\n"
+"fn adapt(@builtin(local_invocation_index) lane: u32) {\n"
+"    let count = f32(atomicLoad(&histogram[lane]));\n"
+"    atomicStore(&histogram[lane], 0u);\n"
+"    weightedBins[lane] = count * f32(lane);\n"
+"    pixelCounts[lane] = select(count, 0.0, lane == 0u);\n"
+"    workgroupBarrier();\n"
+"\n"
+"    for (var stride = 128u; stride > 0u; stride >>= 1u) {\n"
+"        if (lane < stride) {\n"
+"            weightedBins[lane] += weightedBins[lane + stride];\n"
+"            pixelCounts[lane] += pixelCounts[lane + stride];\n"
+"        }\n"
+"        workgroupBarrier();\n"
+"    }\n"
+"\n"
+"    // An all-black frame keeps the previous exposure\n"
+"    if (lane != 0u || pixelCounts[0] == 0.0) {\n"
+"        return;\n"
+"    }\n"
+"    let averageBin = weightedBins[0] / pixelCounts[0];\n"
+"    let goal = exp2((averageBin - 1.0) / 254.0 * settings.logLuminanceRange + settings.minLogLuminance);\n"
+"\n"
+"    var adapted = state.luminance;\n"
+"    if (adapted <= 0.0) {\n"
+"        adapted = goal;\n"
+"    } else {\n"
+"        let speed = select(settings.speedDown, settings.speedUp, goal > adapted);\n"
+"        adapted += (goal - adapted) * (1.0 - exp(-settings.timeDelta * speed));\n"
+"    }\n"
+"    state.luminance = adapted;\n"
+"    state.exposure = clamp(kKey / adapted * exp2(settings.compensation),\n"
+"                           settings.minExposure, settings.maxExposure);\n"
+"}\n";
+
+AutoExposureSettings defaultExposureSettings(void)
+{
+    AutoExposureSettings settings;
+    settings.minLogLuminance = -10.0f;
+    settings.maxLogLuminance = 6.0f;
+    settings.speedUp = 3.0f;
+    settings.speedDown = 1.0f;
+    settings.compensation = 0.0f;
+    settings.minExposure = 1.0f / 64.0f;
+    settings.maxExposure = 64.0f;
+    return settings;
+}
+
+bool createAutoExposure(AutoExposure* exposure,
+                        WGPUDevice device,
+                        WGPUQueue queue,
+                        const AutoExposureSettings* settings)
+{
+    memset(exposure, 0, sizeof *exposure);
+    exposure->device = device;
+    exposure->queue = queue;
+    exposure->settings = settings ? *settings : defaultExposureSettings();
+
+    // New buffers are zeroed: empty bins, and a state the first update replaces
+    exposure->uniformBuffer = createBuffer(device, "Exposure uniforms", sizeof(ExposureUniforms),
+                                           WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    exposure->histogramBuffer = createBuffer(device, "Exposure histogram",
+                                             kExposureHistogramBins * sizeof(uint32_t),
+                                             WGPUBufferUsage_Storage);
+    exposure->stateBuffer = createBuffer(device, "Exposure state", sizeof(ExposureState),
+                                         WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst);
+
+    WGPUShaderModule module = createShaderModule(device, "Exposure shader", kExposureWGSL);
+    if (module) {
+        exposure->histogramPipeline = createComputePipeline(device, "Exposure histogram pipeline", module,
+                                                            "buildHistogram");
+        exposure->adaptPipeline = createComputePipeline(device, "Exposure adapt pipeline", module, "adapt");
+        wgpuShaderModuleRelease(module);
+    }
+    if (!exposure->uniformBuffer || !exposure->histogramBuffer || !exposure->stateBuffer ||
+        !exposure->histogramPipeline || !exposure->adaptPipeline) {
+        releaseAutoExposure(exposure);
+        return false;
+    }
+
+    // A black first frame would leave the exposure at 0 until something shows up
+    ExposureState initial = { 0.0f, 1.0f };
+    wgpuQueueWriteBuffer(queue, exposure->stateBuffer, 0, &initial, sizeof initial);
+
+    WGPUBindGroupEntry entries[3] = {0};
+    entries[0].binding = 0;
+    entries[0].buffer = exposure->uniformBuffer;
+    entries[0].size = sizeof(ExposureUniforms);
+    entries[1].binding = 2;
+    entries[1].buffer = exposure->histogramBuffer;
+    entries[1].size = kExposureHistogramBins * sizeof(uint32_t);
+    entries[2].binding = 3;
+    entries[2].buffer = exposure->stateBuffer;
+    entries[2].size = sizeof(ExposureState);
+
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(exposure->adaptPipeline, 0);
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = "Exposure adapt bind group";
+    desc.layout = layout;
+    desc.entryCount = 3;
+    desc.entries = entries;
+    exposure->adaptBindGroup = wgpuDeviceCreateBindGroup(device, &desc);
+    wgpuBindGroupLayoutRelease(layout);
+    if (!exposure->adaptBindGroup) {
+        releaseAutoExposure(exposure);
+        return false;
+    }
+    return true;
+}
+
+void releaseAutoExposure(AutoExposure* exposure)
+{
+    if (exposure->adaptBindGroup) wgpuBindGroupRelease(exposure->adaptBindGroup);
+    if (exposure->histogramPipeline) wgpuComputePipelineRelease(exposure->histogramPipeline);
+    if (exposure->adaptPipeline) wgpuComputePipelineRelease(exposure->adaptPipeline);
+    WGPUBuffer buffers[3] = { exposure->uniformBuffer, exposure->histogramBuffer, exposure->stateBuffer };
+    for (int i = 0; i < 3; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    memset(exposure, 0, sizeof *exposure);
+}
+
+void exposureUpdate(AutoExposure* exposure,
+                    WGPUCommandEncoder encoder,
+                    WGPUTextureView scene,
+                    uint32_t width,
+                    uint32_t height,
+                    float timeDelta,
+                    const WGPUComputePassTimestampWrites* timestamps)
+{
+    const AutoExposureSettings* settings = &exposure->settings;
+    ExposureUniforms uniforms;
+    uniforms.minLogLuminance = settings->minLogLuminance;
+    uniforms.logLuminanceRange = settings->maxLogLuminance - settings->minLogLuminance;
+    uniforms.timeDelta = timeDelta;
+    uniforms.speedUp = settings->speedUp;
+    uniforms.speedDown = settings->speedDown;
+    uniforms.compensation = settings->compensation;
+    uniforms.minExposure = settings->minExposure;
+    uniforms.maxExposure = settings->maxExposure;
+    wgpuQueueWriteBuffer(exposure->queue, exposure->uniformBuffer, 0, &uniforms, sizeof uniforms);
+
+    WGPUBindGroupEntry entries[3] = {0};
+    entries[0].binding = 0;
+    entries[0].buffer = exposure->uniformBuffer;
+    entries[0].size = sizeof(ExposureUniforms);
+    entries[1].binding = 1;
+    entries[1].textureView = scene;
+    entries[2].binding = 2;
+    entries[2].buffer = exposure->histogramBuffer;
+    entries[2].size = kExposureHistogramBins * sizeof(uint32_t);
+
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(exposure->histogramPipeline, 0);
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = "Exposure histogram bind group";
+    desc.layout = layout;
+    desc.entryCount = 3;
+    desc.entries = entries;
+    WGPUBindGroup histogramBindGroup = wgpuDeviceCreateBindGroup(exposure->device, &desc);
+    wgpuBindGroupLayoutRelease(layout);
+    if (!histogramBindGroup) return;
+
+    WGPUComputePassDescriptor passDesc = {0};
+    passDesc.label = "Exposure pass";
+    passDesc.timestampWrites = timestamps;
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+
+    wgpuComputePassEncoderSetPipeline(pass, exposure->histogramPipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, histogramBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, (width + 15) / 16, (height + 15) / 16, 1);
+
+    wgpuComputePassEncoderSetPipeline(pass, exposure->adaptPipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, exposure->adaptBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, 1, 1, 1);
+
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+    wgpuBindGroupRelease(histogramBindGroup);
+}
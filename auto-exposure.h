@@ -0,0 +1,76 @@
+#ifndef AUTO_EXPOSURE_H
+#define AUTO_EXPOSURE_H
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * AUTO EXPOSURE
+ *
+ * Exposure from the scene's average luminance, computed and smoothed
+ * entirely on the GPU, so the CPU never waits for a readback:
+ *  - a histogram of log2 luminance over every pixel, built with atomics on
+ *    workgroup-shared bins, merged into the global bins once per workgroup
+ *  - a single-workgroup pass that averages the histogram (black pixels
+ *    excluded), adapts the previous luminance towards it exponentially
+ *    with the frame time, and writes the exposure; it also clears the bins
+ *    for the next frame
+ *
+ * The result lives in `stateBuffer` (ExposureState below), which shaders
+ * bind read-only; the post-processing chain multiplies its tonemap input
+ * by it.
+ */
+
+#define kExposureHistogramBins 256
+
+/** Layout of stateBuffer. */
+typedef struct {
+    float luminance;            // adapted average, 0 until the first update
+    float exposure;
+} ExposureState;
+
+typedef struct {
+    float minLogLuminance;      // histogram range, log2
+    float maxLogLuminance;
+    float speedUp;              // adaptation rates, 1/s, towards brighter / darker
+    float speedDown;
+    float compensation;         // EV
+    float minExposure;
+    float maxExposure;
+} AutoExposureSettings;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+    AutoExposureSettings settings;
+
+    WGPUBuffer uniformBuffer;
+    WGPUBuffer histogramBuffer;
+    WGPUBuffer stateBuffer;
+    WGPUComputePipeline histogramPipeline;
+    WGPUComputePipeline adaptPipeline;
+    WGPUBindGroup adaptBindGroup;
+} AutoExposure;
+
+/** log2 luminance in [-10, 6], adapts in about a second. */
+AutoExposureSettings defaultExposureSettings(void);
+
+bool createAutoExposure(AutoExposure* exposure,
+                        WGPUDevice device,
+                        WGPUQueue queue,
+                        const AutoExposureSettings* settings);
+
+void releaseAutoExposure(AutoExposure* exposure);
+
+/** Record the histogram and adaptation of `scene` (HDR color) in its own compute pass. */
+void exposureUpdate(AutoExposure* exposure,
+                    WGPUCommandEncoder encoder,
+                    WGPUTextureView scene,
+                    uint32_t width,
+                    uint32_t height,
+                    float timeDelta,
+                    const WGPUComputePassTimestampWrites* timestamps);
+
+#endif // AUTO_EXPOSURE_H
@@ -0,0 +1,961 @@
+#include "block-encoder.h"
+#include "compressed-texture.h"
+#include "webgpu-utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Blocks per workgroup along each axis. Must match the WGSL below. */
+#define kBlockEncoderGroupSize 8
+
+static const char* const kBlockEncoderWGSL[] = {
+"@group(0) @binding(0) var source: texture_2d<f32>;\n"
+"@group(0) @binding(1) var<storage, read_write> blocks: array<u32>;\n"
+"@group(0) @binding(2) var<uniform> params: vec4u; // x: re-encode linear values to sRGB\n"
+"\n"
+"var<private> texels: array<vec4f, 16>;\n"
+"var<private> weights: array<f32, 16>;   // weight of endpoint 0, per texel\n"
+"var<private> indices: array<u32, 16>;\n"
+"var<private> packed: array<u32, 4>;\n"
+"var<private> bitOffset: u32;\n"
+"\n"
+"fn linearToSrgb(c: vec3f) -> vec3f {\n"
+"    let lo = c * 12.92;\n"
+"    let hi = 1.055 * pow(c, vec3f(1.0 / 2.4)) - 0.055;\n"
+"    return select(hi, lo, c <= vec3f(0.0031308));\n"
+"}\n"
+"\n"
+"fn blockCount() -> vec2u {\n"
+"    return (textureDimensions(source) + 3u) / 4u;\n"
+"}\n"
+"\n"
+"// Blocks per output row: rows are padded to 256 bytes for texture copies\n"
+"fn rowPitch(blocksWide: u32, bytesPerBlock: u32) -> u32 {\n"
+"    return (blocksWide * bytesPerBlock + 255u) / 256u * 256u / bytesPerBlock;\n"
+"}\n"
+"\n"
+"// Edge blocks repeat the last row/column\n"
+"fn loadBlock(block: vec2u) {\n"
+"    let last = textureDimensions(source) - 1u;\n"
+"    for (var i = 0u; i < 16u; i++) {\n"
+"        let texel = min(block * 4u + vec2u(i & 3u, i >> 2u), last);\n"
+"        var c = saturate(textureLoad(source, texel, 0));\n"
+"        if (params.x != 0u) {\n"
+"            c = vec4f(linearToSrgb(c.rgb), c.a);\n"
+"        }\n"
+"        texels[i] = c;\n"
+"    }\n"
+"}\n"
+"\n"
+"fn blockMean(mask: vec4f) -> vec4f {\n"
+"    var sum = vec4f(0.0);\n"
+"    for (var i = 0u; i < 16u; i++) {\n"
+"        sum += texels[i];\n"
+"    }\n"
+"    return sum / 16.0 * mask;\n"
+"}\n"
+"\n"
+"// Bounding box corners, with the diagonal flipped on the channels that\n"
+"// decrease while the channel of largest extent increases.\n"
+"fn boxEndpoints(mask: vec4f, e0: ptr<function, vec4f>, e1: ptr<function, vec4f>) {\n"
+"    var lo = vec4f(1.0);\n"
+"    var hi = vec4f(0.0);\n"
+"    for (var i = 0u; i < 16u; i++) {\n"
+"        lo = min(lo, texels[i]);\n"
+"        hi = max(hi, texels[i]);\n"
+"    }\n"
+"    lo *= mask;\n"
+"    hi *= mask;\n"
+"\n"
+"    var extent = hi - lo;\n"
+"    var major = 0u;\n"
+"    for (var c = 1u; c < 4u; c++) {\n"
+"        if (extent[c] > extent[major]) {\n"
+"            major = c;\n"
+"        }\n"
+"    }\n"
+"\n"
+"    let mean = blockMean(mask);\n"
+"    var covariance = vec4f(0.0);\n"
+"    for (var i = 0u; i < 16u; i++) {\n"
+"        var d = texels[i] * mask - mean;\n"
+"        covariance += d * d[major];\n"
+"    }\n"
+"    let flip = covariance < vec4f(0.0);\n"
+"    *e0 = select(lo, hi, flip);\n"
+"    *e1 = select(hi, lo, flip);\n"
+"}\n"
+"\n"
+"// Extremes of the block along its principal axis (power iteration on\n"
+"// the covariance matrix, seeded with the bounding box diagonal).\n"
+"fn principalEndpoints(mask: vec4f, e0: ptr<function, vec4f>, e1: ptr<function, vec4f>) {\n"
+"    let mean = blockMean(mask);\n"
+"    var covariance = mat4x4f();\n"
+"    for (var i = 0u; i < 16u; i++) {\n"
+"        let d = texels[i] * mask - mean;\n"
+"        covariance += mat4x4f(d * d.x, d * d.y, d * d.z, d * d.w);\n"
+"    }\n"
+"\n"
+"    var b0: vec4f;\n"
+"    var b1: vec4f;\n"
+"    boxEndpoints(mask, &b0, &b1);\n"
+"    var axis = b1 - b0;\n"
+"    if (dot(axis, axis) < 1e-12) {\n"
+"        *e0 = mean;\n"
+"        *e1 = mean;\n"
+"        return;\n"
+"    }\n"
+"    for (var iteration = 0u; iteration < 8u; iteration++) {\n"
+"        let next = covariance * axis;\n"
+"        let len = length(next);\n"
+"        if (len < 1e-8) {\n"
+"            break;\n"
+"        }\n"
+"        axis = next / len;\n"
+"    }\n"
+"    axis = normalize(axis);\n"
+"\n"
+"    var tMin = 1e30;\n"
+"    var tMax = -1e30;\n"
+"    for (var i = 0u; i < 16u; i++) {\n"
+"        let t = dot(texels[i] * mask - mean, axis);\n"
+"        tMin = min(tMin, t);\n"
+"        tMax = max(tMax, t);\n"
+"    }\n"
+"    *e0 = saturate(mean + axis * tMin) * mask;\n"
+"    *e1 = saturate(mean + axis * tMax) * mask;\n"
+"}\n"
+"\n",
+"// Least-squares endpoints for the current per-texel weights.\n"
+"fn fitEndpoints(mask: vec4f, e0: ptr<function, vec4f>, e1: ptr<function, vec4f>) -> bool {\n"
+"    var aa = 0.0;\n"
+"    var bb = 0.0;\n"
+"    var ab = 0.0;\n"
+"    var ax = vec4f(0.0);\n"
+"    var bx = vec4f(0.0);\n"
+"    for (var i = 0u; i < 16u; i++) {\n"
+"        let a = weights[i];\n"
+"        let b = 1.0 - a;\n"
+"        aa += a * a;\n"
+"        bb += b * b;\n"
+"        ab += a * b;\n"
+"        ax += a * texels[i];\n"
+"        bx += b * texels[i];\n"
+"    }\n"
+"    let det = aa * bb - ab * ab;\n"
+"    if (abs(det) < 1e-6) {\n"
+"        return false;\n"
+"    }\n"
+"    *e0 = saturate((ax * bb - bx * ab) / det) * mask;\n"
+"    *e1 = saturate((bx * aa - ax * ab) / det) * mask;\n"
+"    return true;\n"
+"}\n"
+"\n"
+"// ---- BC1 ----\n"
+"\n"
+"fn quantize565(c: vec4f) -> u32 {\n"
+"    let q = vec3u(round(saturate(c.rgb) * vec3f(31.0, 63.0, 31.0)));\n"
+"    return (q.r << 11u) | (q.g << 5u) | q.b;\n"
+"}\n"
+"\n"
+"fn expand565(c: u32) -> vec3f {\n"
+"    return vec3f(f32((c >> 11u) & 31u) / 31.0,\n"
+"                 f32((c >> 5u) & 63u) / 63.0,\n"
+"                 f32(c & 31u) / 31.0);\n"
+"}\n"
+"\n"
+"// Closest four-colour palette entry per texel. Returns the packed indices\n"
+"// and the squared error, and fills `weights`.\n"
+"fn bc1Indices(c0: u32, c1: u32, error: ptr<function, f32>) -> u32 {\n"
+"    let p0 = expand565(c0);\n"
+"    let p1 = expand565(c1);\n"
+"    var palette = array<vec3f, 4>(p0, p1, mix(p0, p1, 1.0 / 3.0), mix(p0, p1, 2.0 / 3.0));\n"
+"    var paletteWeights = array<f32, 4>(1.0, 0.0, 2.0 / 3.0, 1.0 / 3.0);\n"
+"\n"
+"    var bits = 0u;\n"
+"    var total = 0.0;\n"
+"    for (var i = 0u; i < 16u; i++) {\n"
+"        var best = 0u;\n"
+"        var bestError = 1e30;\n"
+"        for (var p = 0u; p < 4u; p++) {\n"
+"            let d = texels[i].rgb - palette[p];\n"
+"            let e = dot(d, d);\n"
+"            if (e < bestError) {\n"
+"                bestError = e;\n"
+"                best = p;\n"
+"            }\n"
+"        }\n"
+"        bits |= best << (2u * i);\n"
+"        weights[i] = paletteWeights[best];\n"
+"        total += bestError;\n"
+"    }\n"
+"    *error = total;\n"
+"    return bits;\n"
+"}\n"
+"\n"
+"fn encodeBC1Block(high: bool) -> vec2u {\n"
+"    let mask = vec4f(1.0, 1.0, 1.0, 0.0);\n"
+"    var e0: vec4f;\n"
+"    var e1: vec4f;\n"
+"    if (high) {\n"
+"        principalEndpoints(mask, &e0, &e1);\n"
+"    } else {\n"
+"        // The box corners are rarely hit exactly: pull them in a bit\n"
+"        boxEndpoints(mask, &e0, &e1);\n"
+"        let inset = (e1 - e0) / 16.0;\n"
+"        e0 += inset;\n"
+"        e1 -= inset;\n"
+"    }\n"
+"\n"
+"    // Four-colour mode needs c0 > c1; equal endpoints make a solid block\n"
+"    var c0 = quantize565(e0);\n"
+"    var c1 = quantize565(e1);\n"
+"    if (c0 < c1) {\n"
+"        let t = c0;\n"
+"        c0 = c1;\n"
+"        c1 = t;\n"
+"    }\n"
+"    if (c0 == c1) {\n"
+"        return vec2u(c0 | (c1 << 16u), 0u);\n"
+"    }\n"
+"\n"
+"    var error = 0.0;\n"
+"    var bits = bc1Indices(c0, c1, &error);\n"
+"    if (high) {\n"
+"        for (var iteration = 0u; iteration < 2u; iteration++) {\n"
+"            if (!fitEndpoints(mask, &e0, &e1)) {\n"
+"                break;\n"
+"            }\n"
+"            var r0 = quantize565(e0);\n"
+"            var r1 = quantize565(e1);\n"
+"            if (r0 < r1) {\n"
+"                let t = r0;\n"
+"                r0 = r1;\n"
+"                r1 = t;\n"
+"            }\n"
+"            if (r0 == r1) {\n"
+"                break;\n"
+"            }\n"
+"            var refinedError = 0.0;\n"
+"            let refined = bc1Indices(r0, r1, &refinedError);\n"
+"            if (refinedError >= error) {\n"
+"                break;\n"
+"            }\n"
+"            c0 = r0;\n"
+"            c1 = r1;\n"
+"            bits = refined;\n"
+"            error = refinedError;\n"
+"        }\n"
+"    }\n"
+"    return vec2u(c0 | (c1 << 16u), bits);\n"
+"}\n"
+"\n",
+"fn storeBC1(block: vec2u, high: bool) {\n"
+"    let count = blockCount();\n"
+"    if (any(block >= count)) {\n"
+"        return;\n"
+"    }\n"
+"    loadBlock(block);\n"
+"    let encoded = encodeBC1Block(high);\n"
+"    let index = (block.y * rowPitch(count.x, 8u) + block.x) * 2u;\n"
+"    blocks[index] = encoded.x;\n"
+"    blocks[index + 1u] = encoded.y;\n"
+"}\n"
+"\n"
+"// ---- BC7 mode 6 ----\n"
+"\n"
+"// 4-bit index weights 0, 4, 9, 13, ... 60, 64\n"
+"fn bc7Weight(index: u32) -> u32 {\n"
+"    return (index * 64u + 7u) / 15u;\n"
+"}\n"
+"\n"
+"fn quantizeMode6(e: vec4f, pbit: u32) -> vec4u {\n"
+"    return vec4u(clamp(round((e * 255.0 - f32(pbit)) * 0.5), vec4f(0.0), vec4f(127.0)));\n"
+"}\n"
+"\n"
+"fn expandMode6(q: vec4u, pbit: u32) -> vec4u {\n"
+"    return q * 2u + pbit;\n"
+"}\n"
+"\n"
+"fn bestPBit(e: vec4f) -> u32 {\n"
+"    let d0 = e * 255.0 - vec4f(expandMode6(quantizeMode6(e, 0u), 0u));\n"
+"    let d1 = e * 255.0 - vec4f(expandMode6(quantizeMode6(e, 1u), 1u));\n"
+"    return select(0u, 1u, dot(d1, d1) < dot(d0, d0));\n"
+"}\n"
+"\n"
+"// Index per texel for 8-bit endpoints: project onto the segment, then\n"
+"// settle on the best of the neighbouring weights. Returns the squared\n"
+"// error (8-bit units) and fills `indices` and `weights`.\n"
+"fn bc7Indices(q0: vec4u, q1: vec4u) -> f32 {\n"
+"    let p0 = vec4f(q0);\n"
+"    let axis = vec4f(q1) - p0;\n"
+"    let axisLength = max(dot(axis, axis), 1e-6);\n"
+"\n"
+"    var total = 0.0;\n"
+"    for (var i = 0u; i < 16u; i++) {\n"
+"        let x = texels[i] * 255.0;\n"
+"        let guess = u32(clamp(round(dot(x - p0, axis) / axisLength * 15.0), 0.0, 15.0));\n"
+"        var best = guess;\n"
+"        var bestError = 1e30;\n"
+"        for (var j = max(guess, 1u) - 1u; j <= min(guess + 1u, 15u); j++) {\n"
+"            let w = bc7Weight(j);\n"
+"            let c = vec4f((q0 * (64u - w) + q1 * w + 32u) >> vec4u(6u));\n"
+"            let d = x - c;\n"
+"            let e = dot(d, d);\n"
+"            if (e < bestError) {\n"
+"                bestError = e;\n"
+"                best = j;\n"
+"            }\n"
+"        }\n"
+"        indices[i] = best;\n"
+"        weights[i] = 1.0 - f32(bc7Weight(best)) / 64.0;\n"
+"        total += bestError;\n"
+"    }\n"
+"    return total;\n"
+"}\n"
+"\n"
+"fn putBits(value: u32, count: u32) {\n"
+"    let word = bitOffset >> 5u;\n"
+"    let shift = bitOffset & 31u;\n"
+"    packed[word] |= value << shift;\n"
+"    if (shift + count > 32u) {\n"
+"        packed[word + 1u] |= value >> (32u - shift);\n"
+"    }\n"
+"    bitOffset += count;\n"
+"}\n"
+"\n",
+"fn encodeBC7Block(high: bool) -> vec4u {\n"
+"    let mask = vec4f(1.0);\n"
+"    var e0: vec4f;\n"
+"    var e1: vec4f;\n"
+"    var q0 = vec4u(0u);\n"
+"    var q1 = vec4u(0u);\n"
+"    var p0 = 0u;\n"
+"    var p1 = 0u;\n"
+"\n"
+"    if (!high) {\n"
+"        boxEndpoints(mask, &e0, &e1);\n"
+"        p0 = bestPBit(e0);\n"
+"        p1 = bestPBit(e1);\n"
+"        q0 = quantizeMode6(e0, p0);\n"
+"        q1 = quantizeMode6(e1, p1);\n"
+"        bc7Indices(expandMode6(q0, p0), expandMode6(q1, p1));\n"
+"    } else {\n"
+"        principalEndpoints(mask, &e0, &e1);\n"
+"        var error = 1e30;\n"
+"        var bestIndices = indices;\n"
+"        var bestWeights = weights;\n"
+"        for (var iteration = 0u; iteration < 3u; iteration++) {\n"
+"            if (iteration > 0u) {\n"
+"                weights = bestWeights;\n"
+"                if (!fitEndpoints(mask, &e0, &e1)) {\n"
+"                    break;\n"
+"                }\n"
+"            }\n"
+"            for (var pbits = 0u; pbits < 4u; pbits++) {\n"
+"                let a = pbits & 1u;\n"
+"                let b = pbits >> 1u;\n"
+"                let qa = quantizeMode6(e0, a);\n"
+"                let qb = quantizeMode6(e1, b);\n"
+"                let candidate = bc7Indices(expandMode6(qa, a), expandMode6(qb, b));\n"
+"                if (candidate < error) {\n"
+"                    error = candidate;\n"
+"                    q0 = qa;\n"
+"                    q1 = qb;\n"
+"                    p0 = a;\n"
+"                    p1 = b;\n"
+"                    bestIndices = indices;\n"
+"                    bestWeights = weights;\n"
+"                }\n"
+"            }\n"
+"        }\n"
+"        indices = bestIndices;\n"
+"    }\n"
+"\n"
+"    // The anchor (texel 0) index is stored without its top bit\n"
+"    if (indices[0] >= 8u) {\n"
+"        let tq = q0;\n"
+"        q0 = q1;\n"
+"        q1 = tq;\n"
+"        let tp = p0;\n"
+"        p0 = p1;\n"
+"        p1 = tp;\n"
+"        for (var i = 0u; i < 16u; i++) {\n"
+"            indices[i] = 15u - indices[i];\n"
+"        }\n"
+"    }\n"
+"\n"
+"    packed = array<u32, 4>(0u, 0u, 0u, 0u);\n"
+"    bitOffset = 0u;\n"
+"    putBits(1u << 6u, 7u); // mode 6\n"
+"    for (var c = 0u; c < 4u; c++) {\n"
+"        putBits(q0[c], 7u);\n"
+"        putBits(q1[c], 7u);\n"
+"    }\n"
+"    putBits(p0, 1u);\n"
+"    putBits(p1, 1u);\n"
+"    putBits(indices[0], 3u);\n"
+"    for (var i = 1u; i < 16u; i++) {\n"
+"        putBits(indices[i], 4u);\n"
+"    }\n"
+"    return vec4u(packed[0], packed[1], packed[2], packed[3]);\n"
+"}\n"
+"\n"
+"fn storeBC7(block: vec2u, high: bool) {\n"
+"    let count = blockCount();\n"
+"    if (any(block >= count)) {\n"
+"        return;\n"
+"    }\n"
+"    loadBlock(block);\n"
+"    let encoded = encodeBC7Block(high);\n"
+"    let index = (block.y * rowPitch(count.x, 16u) + block.x) * 4u;\n"
+"    blocks[index] = encoded.x;\n"
+"    blocks[index + 1u] = encoded.y;\n"
+"    blocks[index + 2u] = encoded.z;\n"
+"    blocks[index + 3u] = encoded.w;\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn encodeBC1Fast(@builtin(global_invocation_id) id: vec3u) {\n"
+"    storeBC1(id.xy, false);\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn encodeBC1(@builtin(global_invocation_id) id: vec3u) {\n"
+"    storeBC1(id.xy, true);\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn encodeBC7Fast(@builtin(global_invocation_id) id: vec3u) {\n"
+"    storeBC7(id.xy, false);\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn encodeBC7(@builtin(global_invocation_id) id: vec3u) {\n"
+"    storeBC7(id.xy, true);\n"
+"}\n",
+};
+
+static bool isSrgbFormat(WGPUTextureFormat format)
+{
+    return format == WGPUTextureFormat_RGBA8UnormSrgb ||
+           format == WGPUTextureFormat_BGRA8UnormSrgb ||
+           format == WGPUTextureFormat_BC1RGBAUnormSrgb ||
+           format == WGPUTextureFormat_BC7RGBAUnormSrgb;
+}
+
+static WGPUComputePipeline selectPipeline(const BlockEncoder* encoder,
+                                          WGPUTextureFormat format,
+                                          bool fast)
+{
+    switch (format) {
+    case WGPUTextureFormat_BC1RGBAUnorm:
+    case WGPUTextureFormat_BC1RGBAUnormSrgb:
+        return fast ? encoder->bc1Fast : encoder->bc1;
+    case WGPUTextureFormat_BC7RGBAUnorm:
+    case WGPUTextureFormat_BC7RGBAUnormSrgb:
+        return fast ? encoder->bc7Fast : encoder->bc7;
+    default:
+        return NULL;
+    }
+}
+
+bool createBlockEncoder(BlockEncoder* encoder, WGPUDevice device, WGPUQueue queue)
+{
+    memset(encoder, 0, sizeof *encoder);
+    encoder->device = device;
+    encoder->queue = queue;
+
+    WGPUShaderModule module = createShaderModuleFromParts(device, "Block encoder shader", kBlockEncoderWGSL,
+                                                          sizeof kBlockEncoderWGSL / sizeof kBlockEncoderWGSL[0]);
+    if (!module) {
+        return false;
+    }
+    encoder->bc1Fast = createComputePipeline(device, "BC1 encoder (fast)", module, "encodeBC1Fast");
+    encoder->bc1 = createComputePipeline(device, "BC1 encoder", module, "encodeBC1");
+    encoder->bc7Fast = createComputePipeline(device, "BC7 encoder (fast)", module, "encodeBC7Fast");
+    encoder->bc7 = createComputePipeline(device, "BC7 encoder", module, "encodeBC7");
+    wgpuShaderModuleRelease(module);
+
+    const uint32_t linear[4] = { 0, 0, 0, 0 };
+    const uint32_t srgb[4] = { 1, 0, 0, 0 };
+    encoder->linearParams = createBuffer(device, "Block encoder params (linear)", sizeof linear,
+                                         WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    encoder->srgbParams = createBuffer(device, "Block encoder params (sRGB)", sizeof srgb,
+                                       WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+
+    if (!encoder->bc1Fast || !encoder->bc1 || !encoder->bc7Fast || !encoder->bc7 ||
+        !encoder->linearParams || !encoder->srgbParams) {
+        releaseBlockEncoder(encoder);
+        return false;
+    }
+
+    wgpuQueueWriteBuffer(queue, encoder->linearParams, 0, linear, sizeof linear);
+    wgpuQueueWriteBuffer(queue, encoder->srgbParams, 0, srgb, sizeof srgb);
+    return true;
+}
+
+void releaseBlockEncoder(BlockEncoder* encoder)
+{
+    WGPUComputePipeline pipelines[] = {
+        encoder->bc1Fast, encoder->bc1, encoder->bc7Fast, encoder->bc7
+    };
+    for (size_t i = 0; i < sizeof pipelines / sizeof pipelines[0]; ++i) {
+        if (pipelines[i]) wgpuComputePipelineRelease(pipelines[i]);
+    }
+
+    WGPUBuffer buffers[] = { encoder->linearParams, encoder->srgbParams };
+    for (size_t i = 0; i < sizeof buffers / sizeof buffers[0]; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    memset(encoder, 0, sizeof *encoder);
+}
+
+uint64_t encodedBlocksSize(WGPUTextureFormat format,
+                           uint32_t width,
+                           uint32_t height,
+                           uint32_t* bytesPerRow)
+{
+    uint32_t blockWidth, blockHeight, bytesPerBlock;
+    if (!textureFormatBlockInfo(format, &blockWidth, &blockHeight, &bytesPerBlock)) {
+        return 0;
+    }
+
+    uint32_t blocksWide = (width + blockWidth - 1) / blockWidth;
+    uint32_t blocksHigh = (height + blockHeight - 1) / blockHeight;
+    uint32_t pitch = (blocksWide * bytesPerBlock + 255) & ~255u;
+    if (bytesPerRow) *bytesPerRow = pitch;
+    return (uint64_t)pitch * blocksHigh;
+}
+
+/**
+ * ENCODE TEXTURE BLOCKS
+ *
+ * The source level gets its own view so that textureDimensions() in the
+ * shader is the size of that level. Sampling an sRGB texture returns
+ * linear values, which are re-encoded before fitting when the target is
+ * sRGB too; every other combination is encoded as loaded.
+ */
+bool encodeTextureBlocks(BlockEncoder* encoder,
+                         WGPUCommandEncoder commands,
+                         WGPUTexture source,
+                         uint32_t mipLevel,
+                         WGPUTextureFormat format,
+                         bool fast,
+                         WGPUBuffer blocks,
+                         uint64_t offset)
+{
+    WGPUComputePipeline pipeline = selectPipeline(encoder, format, fast);
+    if (!pipeline) {
+        fprintf(stderr, "encodeTextureBlocks: format 0x%x is not BC1 or BC7\n", (unsigned)format);
+        return false;
+    }
+    if (offset % 256 != 0) {
+        fprintf(stderr, "encodeTextureBlocks: offset %llu is not 256-byte aligned\n",
+                (unsigned long long)offset);
+        return false;
+    }
+
+    WGPUTextureFormat sourceFormat = wgpuTextureGetFormat(source);
+    uint32_t width = wgpuTextureGetWidth(source) >> mipLevel;
+    uint32_t height = wgpuTextureGetHeight(source) >> mipLevel;
+    if (width == 0) width = 1;
+    if (height == 0) height = 1;
+    uint64_t size = encodedBlocksSize(format, width, height, NULL);
+
+    WGPUTextureViewDescriptor viewDesc = {0};
+    viewDesc.label = "Block encoder source";
+    viewDesc.format = sourceFormat;
+    viewDesc.dimension = WGPUTextureViewDimension_2D;
+    viewDesc.baseMipLevel = mipLevel;
+    viewDesc.mipLevelCount = 1;
+    viewDesc.baseArrayLayer = 0;
+    viewDesc.arrayLayerCount = 1;
+    viewDesc.aspect = WGPUTextureAspect_All;
+    WGPUTextureView view = wgpuTextureCreateView(source, &viewDesc);
+    if (!view) {
+        return false;
+    }
+
+    bool toSrgb = isSrgbFormat(format) && isSrgbFormat(sourceFormat);
+
+    WGPUBindGroupEntry entries[3] = {0};
+    entries[0].binding = 0;
+    entries[0].textureView = view;
+    entries[1].binding = 1;
+    entries[1].buffer = blocks;
+    entries[1].offset = offset;
+    entries[1].size = size;
+    entries[2].binding = 2;
+    entries[2].buffer = toSrgb ? encoder->srgbParams : encoder->linearParams;
+    entries[2].offset = 0;
+    entries[2].size = 4 * sizeof(uint32_t);
+
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(pipeline, 0);
+    WGPUBindGroupDescriptor bindGroupDesc = {0};
+    bindGroupDesc.label = "Block encoder bind group";
+    bindGroupDesc.layout = layout;
+    bindGroupDesc.entryCount = 3;
+    bindGroupDesc.entries = entries;
+    WGPUBindGroup bindGroup = wgpuDeviceCreateBindGroup(encoder->device, &bindGroupDesc);
+    wgpuBindGroupLayoutRelease(layout);
+    wgpuTextureViewRelease(view);
+    if (!bindGroup) {
+        return false;
+    }
+
+    uint32_t blocksWide = (width + 3) / 4;
+    uint32_t blocksHigh = (height + 3) / 4;
+
+    WGPUComputePassDescriptor passDesc = {0};
+    passDesc.label = "Block encoder pass";
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(commands, &passDesc);
+    wgpuComputePassEncoderSetPipeline(pass, pipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, bindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass,
+        (blocksWide + kBlockEncoderGroupSize - 1) / kBlockEncoderGroupSize,
+        (blocksHigh + kBlockEncoderGroupSize - 1) / kBlockEncoderGroupSize,
+        1);
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+    wgpuBindGroupRelease(bindGroup);
+    return true;
+}
+
+/**
+ * COMPRESS TEXTURE
+ *
+ * Every level is encoded into one scratch buffer (each level starts on a
+ * 256-byte boundary since rows are padded) and then copied into the BC
+ * texture. Levels smaller than a block are copied as a whole block, which
+ * is what WebGPU expects for compressed mips.
+ */
+WGPUTexture compressTexture(BlockEncoder* encoder,
+                            const Context* context,
+                            WGPUCommandEncoder commands,
+                            WGPUTexture source,
+                            WGPUTextureFormat format,
+                            bool fast,
+                            const char* label)
+{
+    if (!context->textureCompressionBC) {
+        fprintf(stderr, "compressTexture: device has no BC texture support\n");
+        return NULL;
+    }
+    if (!selectPipeline(encoder, format, fast)) {
+        fprintf(stderr, "compressTexture: format 0x%x is not BC1 or BC7\n", (unsigned)format);
+        return NULL;
+    }
+
+    uint32_t width = wgpuTextureGetWidth(source);
+    uint32_t height = wgpuTextureGetHeight(source);
+    uint32_t mipCount = wgpuTextureGetMipLevelCount(source);
+    if (width % 4 != 0 || height % 4 != 0) {
+        fprintf(stderr, "compressTexture: %ux%u is not a multiple of the 4x4 block size\n",
+                width, height);
+        return NULL;
+    }
+    if (mipCount > kCompressedImageMaxLevels) mipCount = kCompressedImageMaxLevels;
+
+    uint64_t offsets[kCompressedImageMaxLevels];
+    uint32_t pitches[kCompressedImageMaxLevels];
+    uint64_t total = 0;
+    for (uint32_t level = 0; level < mipCount; ++level) {
+        uint32_t w = width >> level ? width >> level : 1;
+        uint32_t h = height >> level ? height >> level : 1;
+        offsets[level] = total;
+        total += encodedBlocksSize(format, w, h, &pitches[level]);
+    }
+
+    WGPUBuffer blocks = createBuffer(context->device, "Block encoder output", total,
+                                     WGPUBufferUsage_Storage | WGPUBufferUsage_CopySrc);
+    if (!blocks) {
+        return NULL;
+    }
+
+    WGPUTextureDescriptor desc = {0};
+    desc.label = label;
+    desc.usage = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst;
+    desc.dimension = WGPUTextureDimension_2D;
+    desc.size.width = width;
+    desc.size.height = height;
+    desc.size.depthOrArrayLayers = 1;
+    desc.format = format;
+    desc.mipLevelCount = mipCount;
+    desc.sampleCount = 1;
+    WGPUTexture texture = wgpuDeviceCreateTexture(context->device, &desc);
+    if (!texture) {
+        wgpuBufferRelease(blocks);
+        return NULL;
+    }
+
+    for (uint32_t level = 0; level < mipCount; ++level) {
+        if (!encodeTextureBlocks(encoder, commands, source, level, format, fast, blocks, offsets[level])) {
+            // Nothing recorded reads the texture yet; `blocks` may be, so only release it
+            wgpuTextureDestroy(texture);
+            wgpuTextureRelease(texture);
+            wgpuBufferRelease(blocks);
+            return NULL;
+        }
+    }
+
+    for (uint32_t level = 0; level < mipCount; ++level) {
+        uint32_t w = width >> level ? width >> level : 1;
+        uint32_t h = height >> level ? height >> level : 1;
+        uint32_t blocksWide = (w + 3) / 4;
+        uint32_t blocksHigh = (h + 3) / 4;
+
+        WGPUImageCopyBuffer from = {0};
+        from.buffer = blocks;
+        from.layout.offset = offsets[level];
+        from.layout.bytesPerRow = pitches[level];
+        from.layout.rowsPerImage = blocksHigh;
+
+        WGPUImageCopyTexture to = {0};
+        to.texture = texture;
+        to.mipLevel = level;
+        to.aspect = WGPUTextureAspect_All;
+
+        WGPUExtent3D extent = { blocksWide * 4, blocksHigh * 4, 1 };
+        wgpuCommandEncoderCopyBufferToTexture(commands, &from, &to, &extent);
+    }
+
+    // The recorded commands keep the scratch buffer alive until they ran
+    wgpuBufferRelease(blocks);
+    return texture;
+}
+
+/**
+ * TEST BLOCK ENCODER
+ */
+
+#define kTestImageSize 256
+
+/**
+ * Ramps, hard diagonal edges and a varying alpha: smooth blocks, blocks
+ * split by an edge and blocks where alpha goes against colour.
+ */
+static void fillTestImage(uint8_t* rgba)
+{
+    for (uint32_t y = 0; y < kTestImageSize; ++y) {
+        for (uint32_t x = 0; x < kTestImageSize; ++x) {
+            uint8_t* p = rgba + (y * kTestImageSize + x) * 4;
+            p[0] = (uint8_t)x;
+            p[1] = (uint8_t)y;
+            p[2] = ((x + y) / 6) & 1 ? 200 : 40;
+            p[3] = (uint8_t)(255 - (x + y) / 2);
+        }
+    }
+}
+
+static uint32_t readBits(const uint8_t* block, uint32_t* offset, uint32_t count)
+{
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < count; ++i, ++*offset) {
+        value |= (uint32_t)((block[*offset >> 3] >> (*offset & 7)) & 1) << i;
+    }
+    return value;
+}
+
+/** Reference decoder for the only BC7 mode the encoder produces. */
+static bool decodeBC7Mode6Block(const uint8_t* block, uint8_t texels[16][4])
+{
+    uint32_t offset = 0;
+    if (readBits(block, &offset, 7) != 1u << 6) {
+        return false;
+    }
+
+    uint32_t endpoints[2][4];
+    for (int c = 0; c < 4; ++c) {
+        endpoints[0][c] = readBits(block, &offset, 7);
+        endpoints[1][c] = readBits(block, &offset, 7);
+    }
+    uint32_t p0 = readBits(block, &offset, 1);
+    uint32_t p1 = readBits(block, &offset, 1);
+    for (int c = 0; c < 4; ++c) {
+        endpoints[0][c] = endpoints[0][c] << 1 | p0;
+        endpoints[1][c] = endpoints[1][c] << 1 | p1;
+    }
+
+    for (int i = 0; i < 16; ++i) {
+        uint32_t index = readBits(block, &offset, i == 0 ? 3 : 4);
+        uint32_t w = (index * 64 + 7) / 15;
+        for (int c = 0; c < 4; ++c) {
+            texels[i][c] = (uint8_t)(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+        }
+    }
+    return true;
+}
+
+static bool decodeBC7Mode6(const uint8_t* blocks, uint8_t* rgba)
+{
+    const uint32_t blocksWide = kTestImageSize / 4;
+    for (uint32_t by = 0; by < kTestImageSize / 4; ++by) {
+        for (uint32_t bx = 0; bx < blocksWide; ++bx) {
+            uint8_t texels[16][4];
+            if (!decodeBC7Mode6Block(blocks + (by * blocksWide + bx) * 16, texels)) {
+                return false;
+            }
+            for (uint32_t i = 0; i < 16; ++i) {
+                uint32_t x = bx * 4 + (i & 3);
+                uint32_t y = by * 4 + (i >> 2);
+                memcpy(rgba + (y * kTestImageSize + x) * 4, texels[i], 4);
+            }
+        }
+    }
+    return true;
+}
+
+static double rootMeanSquareError(const uint8_t* a, const uint8_t* b, uint32_t channels)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < (size_t)kTestImageSize * kTestImageSize; ++i) {
+        for (uint32_t c = 0; c < channels; ++c) {
+            double d = (double)a[i * 4 + c] - (double)b[i * 4 + c];
+            sum += d * d;
+        }
+    }
+    return sqrt(sum / ((double)kTestImageSize * kTestImageSize * channels));
+}
+
+/**
+ * The source is 256x256, so the 256-byte padded rows of both formats are
+ * tightly packed and the blocks decode in place. BC1 goes through the
+ * CPU decoder of compressed-texture.c; the error thresholds are loose,
+ * they catch broken encoders, not small regressions.
+ */
+bool testBlockEncoder(BlockEncoder* encoder)
+{
+    typedef struct {
+        const char* name;
+        WGPUTextureFormat format;
+        bool fast;
+        uint32_t channels;
+        double maxError;
+    } EncoderCase;
+
+    const EncoderCase cases[] = {
+        { "BC1 (fast)", WGPUTextureFormat_BC1RGBAUnorm, true,  3, 12.0 },
+        { "BC1",        WGPUTextureFormat_BC1RGBAUnorm, false, 3, 10.0 },
+        { "BC7 (fast)", WGPUTextureFormat_BC7RGBAUnorm, true,  4, 8.0 },
+        { "BC7",        WGPUTextureFormat_BC7RGBAUnorm, false, 4, 6.0 },
+    };
+
+    const size_t imageSize = (size_t)kTestImageSize * kTestImageSize * 4;
+    uint8_t* image = malloc(imageSize);
+    uint8_t* decoded = malloc(imageSize);
+    uint8_t* encoded = malloc(imageSize); // BC7 is 1 byte per texel, BC1 half that
+    if (!image || !decoded || !encoded) {
+        fprintf(stderr, "testBlockEncoder: out of memory\n");
+        free(image);
+        free(decoded);
+        free(encoded);
+        return false;
+    }
+    fillTestImage(image);
+
+    WGPUTextureDescriptor desc = {0};
+    desc.label = "Block encoder test image";
+    desc.usage = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst;
+    desc.dimension = WGPUTextureDimension_2D;
+    desc.size.width = kTestImageSize;
+    desc.size.height = kTestImageSize;
+    desc.size.depthOrArrayLayers = 1;
+    desc.format = WGPUTextureFormat_RGBA8Unorm;
+    desc.mipLevelCount = 1;
+    desc.sampleCount = 1;
+    WGPUTexture source = wgpuDeviceCreateTexture(encoder->device, &desc);
+    if (!source) {
+        fprintf(stderr, "testBlockEncoder: failed to create the test image\n");
+        free(image);
+        free(decoded);
+        free(encoded);
+        return false;
+    }
+
+    WGPUImageCopyTexture destination = {0};
+    destination.texture = source;
+    destination.mipLevel = 0;
+    destination.aspect = WGPUTextureAspect_All;
+    WGPUTextureDataLayout layout = {0};
+    layout.bytesPerRow = kTestImageSize * 4;
+    layout.rowsPerImage = kTestImageSize;
+    WGPUExtent3D extent = { kTestImageSize, kTestImageSize, 1 };
+    wgpuQueueWriteTexture(encoder->queue, &destination, image, imageSize, &layout, &extent);
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < sizeof cases / sizeof cases[0]; ++i) {
+        const EncoderCase* test = &cases[i];
+        uint64_t size = encodedBlocksSize(test->format, kTestImageSize, kTestImageSize, NULL);
+
+        WGPUBuffer blocks = createBuffer(encoder->device, "Block encoder test blocks", size,
+                                         WGPUBufferUsage_Storage | WGPUBufferUsage_CopySrc);
+        WGPUBuffer readback = createBuffer(encoder->device, "Block encoder test readback", size,
+                                           WGPUBufferUsage_MapRead | WGPUBufferUsage_CopyDst);
+
+        WGPUCommandEncoderDescriptor encoderDesc = {0};
+        encoderDesc.label = "Block encoder test";
+        WGPUCommandEncoder commands = wgpuDeviceCreateCommandEncoder(encoder->device, &encoderDesc);
+        ok = blocks && readback &&
+             encodeTextureBlocks(encoder, commands, source, 0, test->format, test->fast, blocks, 0);
+        if (ok) {
+            wgpuCommandEncoderCopyBufferToBuffer(commands, blocks, 0, readback, 0, size);
+        }
+        WGPUCommandBuffer commandBuffer = wgpuCommandEncoderFinish(commands, NULL);
+        wgpuCommandEncoderRelease(commands);
+
+        uint64_t start = SDL_GetTicksNS();
+        wgpuQueueSubmit(encoder->queue, 1, &commandBuffer);
+        wgpuCommandBufferRelease(commandBuffer);
+        ok = ok && readBufferSync(encoder->device, readback, 0, size, encoded);
+        double milliseconds = (double)(SDL_GetTicksNS() - start) / 1e6;
+
+        if (ok) {
+            if (test->format == WGPUTextureFormat_BC1RGBAUnorm) {
+                CompressedImage compressed = {0};
+                compressed.format = test->format;
+                compressed.width = kTestImageSize;
+                compressed.height = kTestImageSize;
+                compressed.mipCount = 1;
+                compressed.levels[0] = encoded;
+                compressed.levelSizes[0] = (size_t)size;
+                ok = decodeCompressedLevel(&compressed, 0, decoded);
+            } else {
+                ok = decodeBC7Mode6(encoded, decoded);
+            }
+            if (!ok) {
+                fprintf(stderr, "%s: produced blocks that don't decode\n", test->name);
+            }
+        }
+
+        if (ok) {
+            double error = rootMeanSquareError(image, decoded, test->channels);
+            printf("%-10s RMSE %5.2f (limit %5.2f), %.2f ms submit to readback\n",
+                   test->name, error, test->maxError, milliseconds);
+            ok = error <= test->maxError;
+        }
+
+        if (blocks) {
+            wgpuBufferDestroy(blocks);
+            wgpuBufferRelease(blocks);
+        }
+        if (readback) {
+            wgpuBufferDestroy(readback);
+            wgpuBufferRelease(readback);
+        }
+    }
+
+    wgpuTextureDestroy(source);
+    wgpuTextureRelease(source);
+    free(image);
+    free(decoded);
+    free(encoded);
+
+    printf("Block encoder test %s\n", ok ? "passed" : "FAILED");
+    return ok;
+}
@@ -0,0 +1,97 @@
+#ifndef BLOCK_ENCODER_H
+#define BLOCK_ENCODER_H
+
+#include "global.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * GPU BLOCK COMPRESSION
+ *
+ * Compute-shader encoders for textures produced at runtime (baked
+ * lightmaps, composited atlases, video frames), so that they are sampled
+ * compressed like every other texture. One invocation encodes one 4x4
+ * block into a storage buffer, which is then copied into the BC texture.
+ *
+ *  - BC1: RGB, 8 bytes per block (alpha is ignored, blocks are opaque)
+ *  - BC7: RGBA, 16 bytes per block, mode 6 only (one subset, 4-bit
+ *         indices, 7.7.7.7 endpoints plus a p-bit)
+ *
+ * Fast mode fits endpoints to the bounding box of the block. Otherwise
+ * endpoints follow the principal axis of the block and are refined by a
+ * least-squares fit to the chosen indices (and, for BC7, every p-bit pair
+ * is tried).
+ *
+ * Encoding itself works on any device; only the final copy into a BC
+ * texture needs the TextureCompressionBC feature. The encoders run on the
+ * fallback adapter (SwiftShader), see testBlockEncoder().
+ */
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+
+    WGPUComputePipeline bc1Fast;
+    WGPUComputePipeline bc1;
+    WGPUComputePipeline bc7Fast;
+    WGPUComputePipeline bc7;
+
+    // Constant parameter blocks: as-is, or re-encode linear values to sRGB
+    WGPUBuffer linearParams;
+    WGPUBuffer srgbParams;
+} BlockEncoder;
+
+bool createBlockEncoder(BlockEncoder* encoder, WGPUDevice device, WGPUQueue queue);
+
+void releaseBlockEncoder(BlockEncoder* encoder);
+
+/**
+ * Size of the encoded blocks of a width x height level of a BC1 or BC7
+ * format. Rows of blocks are padded to 256 bytes (`bytesPerRow`) so the
+ * buffer can be copied straight into a texture.
+ */
+uint64_t encodedBlocksSize(WGPUTextureFormat format,
+                           uint32_t width,
+                           uint32_t height,
+                           uint32_t* bytesPerRow);
+
+/**
+ * Record the encoding of one level of `source` (any float-sampleable
+ * format, TextureBinding usage) into `blocks` at `offset`, a multiple of
+ * 256. Partial blocks on the right and bottom edges repeat the edge texels.
+ */
+bool encodeTextureBlocks(BlockEncoder* encoder,
+                         WGPUCommandEncoder commands,
+                         WGPUTexture source,
+                         uint32_t mipLevel,
+                         WGPUTextureFormat format,
+                         bool fast,
+                         WGPUBuffer blocks,
+                         uint64_t offset);
+
+/**
+ * Compress every level of `source` into a new BC1/BC7 texture. Requires
+ * the TextureCompressionBC feature and a block-aligned level 0. The work
+ * is recorded into `commands`; the result can be sampled once they are
+ * submitted.
+ */
+WGPUTexture compressTexture(BlockEncoder* encoder,
+                            const Context* context,
+                            WGPUCommandEncoder commands,
+                            WGPUTexture source,
+                            WGPUTextureFormat format,
+                            bool fast,
+                            const char* label);
+
+/**
+ * Encode a procedural image with every encoder, read the blocks back and
+ * compare the decoded result with the source. Prints the error of each
+ * encoder; returns false if one of them is off. Blocking, meant for a
+ * headless device.
+ */
+bool testBlockEncoder(BlockEncoder* encoder);
+
+#endif // BLOCK_ENCODER_H
@@ -0,0 +1,319 @@
+#include "bloom.h"
+#include "webgpu-utils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define kBloomDefaultScatter 0.7f
+
+static const char* kBloomWGSL =
+"@group(0) @binding(0) var source: texture_2d<f32>;\n"
+"@group(0) @binding(1) var linearSampler: sampler;\n"
+"@group(0) @binding(2) var destination: texture_storage_2d<rgba16float, write>;\n"
+"@group(0) @binding(3) var<uniform> bloomParams: vec4f;    // x: scatter\n"
+"@group(0) @binding(4) var detail: texture_2d<f32>;\n"
+"\n"
+"fn tap(uv: vec2f) -> vec3f {\n"
+"    return textureSampleLevel(source, linearSampler, uv, 0.0).rgb;\n"
+"}\n"
+"\n"
+"fn luminanceWeight(c: vec3f) -> f32 {\n"
+"    return 1.0 / (1.0 + dot(c, vec3f(0.2126, 0.7152, 0.0722)));\n"
+"}\n"
+"\n"
+"// 13 bilinear taps two source texels apart, read as five overlapping 2x2\n"
+"// boxes: the inner box weighs 1/2, the four corner ones 1/8 each\n"
+"fn downsample(id: vec2u, karisAverage: bool) -> vec3f {\n"
+"    let uv = (vec2f(id) + 0.5) / vec2f(textureDimensions(destination));\n"
+"    let texel = 1.0 / vec2f(textureDimensions(source));\n"
+"    let a = tap(uv + texel * vec2f(-2.0, -2.0));\n"
+"    let b = tap(uv + texel * vec2f(0.0, -2.0));\n"
+"    let c = tap(uv + texel * vec2f(2.0, -2.0));\n"
+"    let d = tap(uv + texel * vec2f(-1.0, -1.0));\n"
+"    let e = tap(uv + texel * vec2f(1.0, -1.0));\n"
+"    let f = tap(uv + texel * vec2f(-2.0, 0.0));\n"
+"    let g = tap(uv);\n"
+"    let h = tap(uv + texel * vec2f(2.0, 0.0));\n"
+"    let i = tap(uv + texel * vec2f(-1.0, 1.0));\n"
+"    let j = tap(uv + texel * vec2f(1.0, 1.0));\n"
+"    let k = tap(uv + texel * vec2f(-2.0, 2.0));\n"
+"    let l = tap(uv + texel * vec2f(0.0, 2.0));\n"
+"    let m = tap(uv + texel * vec2f(2.0, 2.0));\n"
+"\n"
+"    let inner = (d + e + i + j) * 0.25;\n"
+"    let topLeft = (a + b + f + g) * 0.25;\n"
+"    let topRight = (b + c + g + h) * 0.25;\n"
+"    let bottomLeft = (f + g + k + l) * 0.25;\n"
+"    let bottomRight = (g + h + l + m) * 0.25;\n"
+"    var innerWeight = 0.5;\n"
+"    var cornerWeights = vec4f(0.125);\n"
+"    if (karisAverage) {\n"
+"        innerWeight *= luminanceWeight(inner);\n"
+"        cornerWeights *= vec4f(luminanceWeight(topLeft), luminanceWeight(topRight),\n"
+"                               luminanceWeight(bottomLeft), luminanceWeight(bottomRight));\n"
+"    }\n"
+"    let sum = inner * innerWeight + topLeft * cornerWeights.x + topRight * cornerWeights.y +\n"
+"              bottomLeft * cornerWeights.z + bottomRight * cornerWeights.w;\n"
+"    return max(sum / (innerWeight + dot(cornerWeights, vec4f(1.0))), vec3f(0.0));\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn prefilter(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (any(id.xy >= textureDimensions(destination))) {\n"
+"        return;\n"
+"    }\n"
+"    textureStore(destination, id.xy, vec4f(downsample(id.xy, true), 1.0));\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn downsampleLevel(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (any(id.xy >= textureDimensions(destination))) {\n"
+"        return;\n"
+"    }\n"
+"    textureStore(destination, id.xy, vec4f(downsample(id.xy, false), 1.0));\n"
+"}\n"
+"\n"
+"// `source` is the coarser result, `detail` this level's downsample\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn upsampleLevel(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (any(id.xy >= textureDimensions(destination))) {\n"
+"        return;\n"
+"    }\n"
+"    let uv = (vec2f(id.xy) + 0.5) / vec2f(textureDimensions(destination));\n"
+"    let texel = 1.0 / vec2f(textureDimensions(source));\n"
+"    var tent = tap(uv) * 4.0;\n"
+"    tent += (tap(uv + vec2f(texel.x, 0.0)) + tap(uv - vec2f(texel.x, 0.0)) +\n"
+"             tap(uv + vec2f(0.0, texel.y)) + tap(uv - vec2f(0.0, texel.y))) * 2.0;\n"
+"    tent += tap(uv + texel) + tap(uv - texel) +\n"
+"            tap(uv + vec2f(texel.x, -texel.y)) + tap(uv + vec2f(-texel.x, texel.y));\n"
+"    let own = textureLoad(detail, id.xy, 0).rgb;\n"
+"    textureStore(destination, id.xy, vec4f(mix(own, tent / 16.0, bloomParams.x), 1.0));\n"
+"}\n";
+
+static uint32_t mipSize(uint32_t size, uint32_t mip)
+{
+    return size >> mip ? size >> mip : 1;
+}
+
+static WGPUTextureView createMipView(WGPUTexture texture, uint32_t mip)
+{
+    WGPUTextureViewDescriptor desc = {0};
+    desc.label = "Bloom view";
+    desc.format = kBloomFormat;
+    desc.dimension = WGPUTextureViewDimension_2D;
+    desc.baseMipLevel = mip;
+    desc.mipLevelCount = 1;
+    desc.baseArrayLayer = 0;
+    desc.arrayLayerCount = 1;
+    desc.aspect = WGPUTextureAspect_All;
+    return wgpuTextureCreateView(texture, &desc);
+}
+
+static WGPUTexture createPyramid(WGPUDevice device, const char* label,
+                                 uint32_t width, uint32_t height, uint32_t mipCount)
+{
+    WGPUTextureDescriptor desc = {0};
+    desc.label = label;
+    desc.usage = WGPUTextureUsage_StorageBinding | WGPUTextureUsage_TextureBinding;
+    desc.dimension = WGPUTextureDimension_2D;
+    desc.size = (WGPUExtent3D){ width, height, 1 };
+    desc.format = kBloomFormat;
+    desc.mipLevelCount = mipCount;
+    desc.sampleCount = 1;
+    return wgpuDeviceCreateTexture(device, &desc);
+}
+
+static WGPUBindGroup createLevelBindGroup(Bloom* bloom, WGPUComputePipeline pipeline,
+                                          WGPUTextureView source, WGPUTextureView destination,
+                                          WGPUTextureView detail)
+{
+    WGPUBindGroupEntry entries[5] = {0};
+    entries[0].binding = 0;
+    entries[0].textureView = source;
+    entries[1].binding = 1;
+    entries[1].sampler = bloom->sampler;
+    entries[2].binding = 2;
+    entries[2].textureView = destination;
+    entries[3].binding = 3;
+    entries[3].buffer = bloom->uniformBuffer;
+    entries[3].size = 4 * sizeof(float);
+    entries[4].binding = 4;
+    entries[4].textureView = detail;
+
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(pipeline, 0);
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = "Bloom bind group";
+    desc.layout = layout;
+    desc.entryCount = detail ? 5 : 3;
+    desc.entries = entries;
+    WGPUBindGroup bindGroup = wgpuDeviceCreateBindGroup(bloom->device, &desc);
+    wgpuBindGroupLayoutRelease(layout);
+    return bindGroup;
+}
+
+static void releasePyramid(Bloom* bloom)
+{
+    for (uint32_t mip = 0; mip < kBloomMaxMips; ++mip) {
+        if (bloom->downBindGroups[mip]) wgpuBindGroupRelease(bloom->downBindGroups[mip]);
+        if (bloom->upBindGroups[mip]) wgpuBindGroupRelease(bloom->upBindGroups[mip]);
+        if (bloom->downViews[mip]) wgpuTextureViewRelease(bloom->downViews[mip]);
+        if (bloom->upViews[mip]) wgpuTextureViewRelease(bloom->upViews[mip]);
+    }
+    memset(bloom->downBindGroups, 0, sizeof bloom->downBindGroups);
+    memset(bloom->upBindGroups, 0, sizeof bloom->upBindGroups);
+    memset(bloom->downViews, 0, sizeof bloom->downViews);
+    memset(bloom->upViews, 0, sizeof bloom->upViews);
+    WGPUTexture textures[2] = { bloom->downTexture, bloom->upTexture };
+    for (int i = 0; i < 2; ++i) {
+        if (textures[i]) {
+            wgpuTextureDestroy(textures[i]);
+            wgpuTextureRelease(textures[i]);
+        }
+    }
+    bloom->downTexture = NULL;
+    bloom->upTexture = NULL;
+    bloom->mipCount = 0;
+}
+
+bool createBloom(Bloom* bloom, WGPUDevice device, WGPUQueue queue)
+{
+    memset(bloom, 0, sizeof *bloom);
+    bloom->device = device;
+    bloom->queue = queue;
+    bloom->scatter = kBloomDefaultScatter;
+
+    WGPUShaderModule module = createShaderModule(device, "Bloom shader", kBloomWGSL);
+    if (!module) return false;
+    bloom->prefilterPipeline = createComputePipeline(device, "Bloom prefilter pipeline", module, "prefilter");
+    bloom->downsamplePipeline = createComputePipeline(device, "Bloom downsample pipeline", module, "downsampleLevel");
+    bloom->upsamplePipeline = createComputePipeline(device, "Bloom upsample pipeline", module, "upsampleLevel");
+    wgpuShaderModuleRelease(module);
+
+    WGPUSamplerDescriptor samplerDesc = {0};
+    samplerDesc.label = "Bloom sampler";
+    samplerDesc.addressModeU = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeV = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeW = WGPUAddressMode_ClampToEdge;
+    samplerDesc.magFilter = WGPUFilterMode_Linear;
+    samplerDesc.minFilter = WGPUFilterMode_Linear;
+    samplerDesc.mipmapFilter = WGPUMipmapFilterMode_Nearest;
+    samplerDesc.lodMinClamp = 0.0f;
+    samplerDesc.lodMaxClamp = 1.0f;
+    samplerDesc.maxAnisotropy = 1;
+    bloom->sampler = wgpuDeviceCreateSampler(device, &samplerDesc);
+
+    bloom->uniformBuffer = createBuffer(device, "Bloom uniforms", 4 * sizeof(float),
+                                        WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+
+    if (!bloom->prefilterPipeline || !bloom->downsamplePipeline || !bloom->upsamplePipeline ||
+        !bloom->sampler || !bloom->uniformBuffer || !bloomSetOutputSize(bloom, 1, 1)) {
+        releaseBloom(bloom);
+        return false;
+    }
+    return true;
+}
+
+void releaseBloom(Bloom* bloom)
+{
+    releasePyramid(bloom);
+    if (bloom->uniformBuffer) {
+        wgpuBufferDestroy(bloom->uniformBuffer);
+        wgpuBufferRelease(bloom->uniformBuffer);
+    }
+    if (bloom->sampler) wgpuSamplerRelease(bloom->sampler);
+    if (bloom->prefilterPipeline) wgpuComputePipelineRelease(bloom->prefilterPipeline);
+    if (bloom->downsamplePipeline) wgpuComputePipelineRelease(bloom->downsamplePipeline);
+    if (bloom->upsamplePipeline) wgpuComputePipelineRelease(bloom->upsamplePipeline);
+    memset(bloom, 0, sizeof *bloom);
+}
+
+bool bloomSetOutputSize(Bloom* bloom, uint32_t width, uint32_t height)
+{
+    releasePyramid(bloom);
+    bloom->width = width / 2 ? width / 2 : 1;
+    bloom->height = height / 2 ? height / 2 : 1;
+
+    // Stop while the smallest level is still at least 2 texels across
+    uint32_t smallest = bloom->width < bloom->height ? bloom->width : bloom->height;
+    bloom->mipCount = 1;
+    while (bloom->mipCount < kBloomMaxMips && (smallest >> bloom->mipCount) >= 2) bloom->mipCount++;
+
+    bloom->downTexture = createPyramid(bloom->device, "Bloom downsample", bloom->width, bloom->height,
+                                       bloom->mipCount);
+    if (!bloom->downTexture) {
+        fprintf(stderr, "bloomSetOutputSize: failed to create the pyramid\n");
+        releasePyramid(bloom);
+        return false;
+    }
+    for (uint32_t mip = 0; mip < bloom->mipCount; ++mip) {
+        bloom->downViews[mip] = createMipView(bloom->downTexture, mip);
+    }
+    for (uint32_t mip = 1; mip < bloom->mipCount; ++mip) {
+        bloom->downBindGroups[mip] = createLevelBindGroup(bloom, bloom->downsamplePipeline,
+                                                          bloom->downViews[mip - 1], bloom->downViews[mip], NULL);
+    }
+
+    if (bloom->mipCount > 1) {
+        bloom->upTexture = createPyramid(bloom->device, "Bloom upsample", bloom->width, bloom->height,
+                                         bloom->mipCount - 1);
+        if (!bloom->upTexture) {
+            fprintf(stderr, "bloomSetOutputSize: failed to create the pyramid\n");
+            releasePyramid(bloom);
+            return false;
+        }
+        for (uint32_t mip = 0; mip + 1 < bloom->mipCount; ++mip) {
+            bloom->upViews[mip] = createMipView(bloom->upTexture, mip);
+        }
+        for (uint32_t mip = 0; mip + 1 < bloom->mipCount; ++mip) {
+            WGPUTextureView coarser = mip + 2 == bloom->mipCount ? bloom->downViews[mip + 1] : bloom->upViews[mip + 1];
+            bloom->upBindGroups[mip] = createLevelBindGroup(bloom, bloom->upsamplePipeline, coarser,
+                                                            bloom->upViews[mip], bloom->downViews[mip]);
+        }
+    }
+    return true;
+}
+
+void bloomRender(Bloom* bloom,
+                 WGPUCommandEncoder encoder,
+                 WGPUTextureView source,
+                 const WGPUComputePassTimestampWrites* timestamps)
+{
+    float uniforms[4] = { bloom->scatter, 0.0f, 0.0f, 0.0f };
+    wgpuQueueWriteBuffer(bloom->queue, bloom->uniformBuffer, 0, uniforms, sizeof uniforms);
+
+    WGPUBindGroup prefilterBindGroup = createLevelBindGroup(bloom, bloom->prefilterPipeline, source,
+                                                            bloom->downViews[0], NULL);
+    if (!prefilterBindGroup) return;
+
+    WGPUComputePassDescriptor passDesc = {0};
+    passDesc.label = "Bloom pass";
+    passDesc.timestampWrites = timestamps;
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+
+    wgpuComputePassEncoderSetPipeline(pass, bloom->prefilterPipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, prefilterBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, (bloom->width + 7) / 8, (bloom->height + 7) / 8, 1);
+
+    wgpuComputePassEncoderSetPipeline(pass, bloom->downsamplePipeline);
+    for (uint32_t mip = 1; mip < bloom->mipCount; ++mip) {
+        wgpuComputePassEncoderSetBindGroup(pass, 0, bloom->downBindGroups[mip], 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, (mipSize(bloom->width, mip) + 7) / 8,
+                                                 (mipSize(bloom->height, mip) + 7) / 8, 1);
+    }
+
+    wgpuComputePassEncoderSetPipeline(pass, bloom->upsamplePipeline);
+    for (uint32_t mip = bloom->mipCount - 1; mip-- > 0;) {
+        wgpuComputePassEncoderSetBindGroup(pass, 0, bloom->upBindGroups[mip], 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, (mipSize(bloom->width, mip) + 7) / 8,
+                                                 (mipSize(bloom->height, mip) + 7) / 8, 1);
+    }
+
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+    wgpuBindGroupRelease(prefilterBindGroup);
+}
+
+WGPUTextureView bloomOutput(const Bloom* bloom)
+{
+    return bloom->mipCount > 1 ? bloom->upViews[0] : bloom->downViews[0];
+}
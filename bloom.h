@@ -0,0 +1,70 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * BLOOM
+ *
+ * HDR bloom as a chain of compute dispatches over a mip pyramid, all in
+ * one compute pass: every dispatch reads the level the previous one
+ * wrote, and nothing touches the frame at full resolution.
+ *
+ *  - downsample: each level is a 13-tap filter of the one above (level 0
+ *    of the scene color), which doesn't alias when bright pixels move. On
+ *    the first level the taps are averaged in groups weighted by inverse
+ *    luminance, so single very bright pixels don't blow up into fireflies.
+ *  - upsample: from the smallest level up, each level is a 3x3 tent of
+ *    the coarser result blended with its own downsample by `scatter`; the
+ *    blend keeps the energy of the image, so there is no threshold: every
+ *    pixel blooms a little, and only the bright ones show
+ *
+ * Level 0 is half the output size and the scene color is sampled by UV,
+ * so the pyramid doesn't follow dynamic resolution changes. The result,
+ * bloomOutput(), is meant for postBloomComposite() before tonemapping.
+ */
+
+#define kBloomMaxMips 8
+#define kBloomFormat WGPUTextureFormat_RGBA16Float
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+    uint32_t width, height;     // level 0
+    uint32_t mipCount;
+    float scatter;              // share of the coarser levels, in [0, 1]
+
+    WGPUTexture downTexture;
+    WGPUTexture upTexture;      // one level less: the smallest is downTexture's
+    WGPUTextureView downViews[kBloomMaxMips];
+    WGPUTextureView upViews[kBloomMaxMips];
+
+    WGPUComputePipeline prefilterPipeline;  // scene -> level 0
+    WGPUComputePipeline downsamplePipeline;
+    WGPUComputePipeline upsamplePipeline;
+    WGPUSampler sampler;
+    WGPUBuffer uniformBuffer;
+    WGPUBindGroup downBindGroups[kBloomMaxMips];    // [0] is made per frame
+    WGPUBindGroup upBindGroups[kBloomMaxMips];
+} Bloom;
+
+bool createBloom(Bloom* bloom, WGPUDevice device, WGPUQueue queue);
+
+void releaseBloom(Bloom* bloom);
+
+/** Recreate the pyramid for a new output size. */
+bool bloomSetOutputSize(Bloom* bloom, uint32_t width, uint32_t height);
+
+/** Record the bloom of `source` (HDR scene color, any size) in its own compute pass. */
+void bloomRender(Bloom* bloom,
+                 WGPUCommandEncoder encoder,
+                 WGPUTextureView source,
+                 const WGPUComputePassTimestampWrites* timestamps);
+
+/** The result, half the output size. */
+WGPUTextureView bloomOutput(const Bloom* bloom);
+
+#endif // BLOOM_H
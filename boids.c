@@ -0,0 +1,636 @@
+#include "boids.h"
+#include "webgpu-utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Uniform block of every boid shader. Must match BoidUniforms in kBoidCommonWGSL (144 bytes). */
+typedef struct {
+    float viewProj[16];
+    float boundsHalfExtent[3];
+    float perceptionRadius;
+    float separationRadius;
+    float separationWeight;
+    float alignmentWeight;
+    float cohesionWeight;
+    float boundsWeight;
+    float minSpeed;
+    float maxSpeed;
+    float timeDelta;
+    float agentSize;
+    uint32_t agentCount;
+    uint32_t tableSize;
+    uint32_t maxNeighbours;
+    uint32_t seed;
+    uint32_t _pad0[3];
+} BoidUniforms;
+
+/** Must match Agent in kBoidCommonWGSL. */
+typedef struct {
+    float position[3];
+    float _pad0;
+    float velocity[3];
+    float _pad1;
+} GpuAgent;
+
+#define kBoidGroupSize 256
+
+#define kBoidCommonWGSL \
+"struct BoidUniforms {\n" \
+"    viewProj: mat4x4f,\n" \
+"    boundsHalfExtent: vec3f,\n" \
+"    perceptionRadius: f32,\n" \
+"    separationRadius: f32,\n" \
+"    separationWeight: f32,\n" \
+"    alignmentWeight: f32,\n" \
+"    cohesionWeight: f32,\n" \
+"    boundsWeight: f32,\n" \
+"    minSpeed: f32,\n" \
+"    maxSpeed: f32,\n" \
+"    timeDelta: f32,\n" \
+"    agentSize: f32,\n" \
+"    agentCount: u32,\n" \
+"    tableSize: u32,\n" \
+"    maxNeighbours: u32,\n" \
+"    seed: u32,\n" \
+"    _pad0: u32,\n" \
+"    _pad1: u32,\n" \
+"    _pad2: u32,\n" \
+"}\n" \
+"struct Agent {\n" \
+"    position: vec3f,\n" \
+"    velocity: vec3f,\n" \
+"}\n"
+
+static const char* const kBoidWGSL[] = {
+kBoidCommonWGSL
+"@group(0) @binding(0) var<uniform> settings: BoidUniforms;\n"
+"@group(0) @binding(1) var<storage, read_write> agents: array<Agent>;\n"
+"@group(0) @binding(2) var<storage, read_write> sortedAgents: array<Agent>;\n"
+"@group(0) @binding(3) var<storage, read_write> keys: array<u32>;\n"
+"@group(0) @binding(4) var<storage, read_write> indices: array<u32>;\n"
+"@group(0) @binding(5) var<storage, read_write> cells: array<vec2u>;\n"
+"\n"
+kRandomWGSL
+"\n"
+"fn cellOf(position: vec3f) -> vec3i {\n"
+"    return vec3i(floor(position / settings.perceptionRadius));\n"
+"}\n"
+"\n"
+"// Unbounded grid folded into the table: distant cells may share a bucket,\n"
+"// which only costs extra candidates, rejected by distance\n"
+"fn cellHash(cell: vec3i) -> u32 {\n"
+"    let c = bitcast<vec3u>(cell);\n"
+"    return ((c.x * 73856093u) ^ (c.y * 19349663u) ^ (c.z * 83492791u)) & (settings.tableSize - 1u);\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(256)\n"
+"fn spawn(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (id.x >= settings.agentCount) {\n"
+"        return;\n"
+"    }\n"
+"    var seed = pcg(id.x ^ pcg(settings.seed));\n"
+"    var agent: Agent;\n"
+"    agent.position = (vec3f(random(&seed), random(&seed), random(&seed)) * 2.0 - 1.0) * settings.boundsHalfExtent;\n"
+"    agent.velocity = randomDirection(&seed) * mix(settings.minSpeed, settings.maxSpeed, random(&seed));\n"
+"    agents[id.x] = agent;\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(256)\n"
+"fn hashAgents(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (id.x >= settings.agentCount) {\n"
+"        return;\n"
+"    }\n"
+"    keys[id.x] = cellHash(cellOf(agents[id.x].position));\n"
+"    indices[id.x] = id.x;\n"
+"}\n"
+"\n"
+"// Ranges of the buckets nobody is in are left from earlier steps: lookups\n"
+"// check that the key at the range start is still theirs\n"
+"@compute @workgroup_size(256)\n"
+"fn findCells(@builtin(global_invocation_id) id: vec3u) {\n"
+"    let i = id.x;\n"
+"    if (i >= settings.agentCount) {\n"
+"        return;\n"
+"    }\n"
+"    let key = keys[i];\n"
+"    if (i == 0u || keys[i - 1u] != key) {\n"
+"        cells[key].x = i;\n"
+"    }\n"
+"    if (i == settings.agentCount - 1u || keys[i + 1u] != key) {\n"
+"        cells[key].y = i + 1u;\n"
+"    }\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(256)\n"
+"fn gather(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (id.x < settings.agentCount) {\n"
+"        sortedAgents[id.x] = agents[indices[id.x]];\n"
+"    }\n"
+"}\n"
+"\n",
+"@compute @workgroup_size(256)\n"
+"fn steer(@builtin(global_invocation_id) id: vec3u) {\n"
+"    let i = id.x;\n"
+"    if (i >= settings.agentCount) {\n"
+"        return;\n"
+"    }\n"
+"    var agent = sortedAgents[i];\n"
+"    let home = cellOf(agent.position);\n"
+"    let perception2 = settings.perceptionRadius * settings.perceptionRadius;\n"
+"    let separation2 = settings.separationRadius * settings.separationRadius;\n"
+"\n"
+"    var visited: array<u32, 27>;\n"
+"    var visitedCount = 0u;\n"
+"    var neighbours = 0u;\n"
+"    var away = vec3f(0.0);\n"
+"    var velocitySum = vec3f(0.0);\n"
+"    var positionSum = vec3f(0.0);\n"
+"    for (var z = -1; z <= 1; z++) {\n"
+"        for (var y = -1; y <= 1; y++) {\n"
+"            for (var x = -1; x <= 1; x++) {\n"
+"                // Neighbouring cells can hash to the same bucket: visit it once\n"
+"                let hash = cellHash(home + vec3i(x, y, z));\n"
+"                var seen = false;\n"
+"                for (var v = 0u; v < visitedCount; v++) {\n"
+"                    seen = seen || visited[v] == hash;\n"
+"                }\n"
+"                if (seen) {\n"
+"                    continue;\n"
+"                }\n"
+"                visited[visitedCount] = hash;\n"
+"                visitedCount++;\n"
+"\n"
+"                let range = cells[hash];\n"
+"                if (range.x >= settings.agentCount || keys[range.x] != hash) {\n"
+"                    continue;\n"
+"                }\n"
+"                for (var j = range.x; j < range.y && neighbours < settings.maxNeighbours; j++) {\n"
+"                    if (j == i) {\n"
+"                        continue;\n"
+"                    }\n"
+"                    let other = sortedAgents[j];\n"
+"                    let offset = agent.position - other.position;\n"
+"                    let distance2 = dot(offset, offset);\n"
+"                    if (distance2 >= perception2 || distance2 == 0.0) {\n"
+"                        continue;\n"
+"                    }\n"
+"                    neighbours++;\n"
+"                    velocitySum += other.velocity;\n"
+"                    positionSum += other.position;\n"
+"                    if (distance2 < separation2) {\n"
+"                        // Stronger the closer they are\n"
+"                        away += offset / distance2;\n"
+"                    }\n"
+"                }\n"
+"            }\n"
+"        }\n"
+"    }\n"
+"\n"
+"    var acceleration = away * settings.separationWeight;\n"
+"    if (neighbours > 0u) {\n"
+"        let inverse = 1.0 / f32(neighbours);\n"
+"        acceleration += (velocitySum * inverse - agent.velocity) * settings.alignmentWeight;\n"
+"        acceleration += (positionSum * inverse - agent.position) * settings.cohesionWeight;\n"
+"    }\n"
+"    // Past a face of the box, pulled back in proportion to how far out\n"
+"    let outside = max(abs(agent.position) - settings.boundsHalfExtent, vec3f(0.0));\n"
+"    acceleration -= sign(agent.position) * outside * settings.boundsWeight;\n"
+"\n"
+"    agent.velocity += acceleration * settings.timeDelta;\n"
+"    let speed = length(agent.velocity);\n"
+"    if (speed > 1e-6) {\n"
+"        agent.velocity *= clamp(speed, settings.minSpeed, settings.maxSpeed) / speed;\n"
+"    }\n"
+"    agent.position += agent.velocity * settings.timeDelta;\n"
+"    agents[indices[i]] = agent;\n"
+"}\n",
+};
+
+static const char* kBoidRenderWGSL = kBoidCommonWGSL
+"@group(0) @binding(0) var<uniform> settings: BoidUniforms;\n"
+"@group(0) @binding(1) var<storage, read> agents: array<Agent>;\n"
+"\n"
+"struct VertexOutput {\n"
+"    @builtin(position) position: vec4f,\n"
+"    @location(0) color: vec3f,\n"
+"}\n"
+"\n"
+"@vertex\n"
+"fn vs_main(@builtin(vertex_index) vertex: u32, @builtin(instance_index) instance: u32) -> VertexOutput {\n"
+"    // A dart along +z: tip, then a triangular base; four faces\n"
+"    var corners = array<vec3f, 4>(vec3f(0.0, 0.0, 0.5), vec3f(-0.3, -0.15, -0.5),\n"
+"                                  vec3f(0.3, -0.15, -0.5), vec3f(0.0, 0.2, -0.5));\n"
+"    var faces = array<u32, 12>(0u, 1u, 2u, 0u, 2u, 3u, 0u, 3u, 1u, 1u, 3u, 2u);\n"
+"    var shades = array<f32, 4>(0.6, 1.0, 0.8, 0.4);\n"
+"\n"
+"    let agent = agents[instance];\n"
+"    let speed = length(agent.velocity);\n"
+"    var forward = vec3f(0.0, 0.0, 1.0);\n"
+"    if (speed > 1e-6) {\n"
+"        forward = agent.velocity / speed;\n"
+"    }\n"
+"    var up = vec3f(0.0, 1.0, 0.0);\n"
+"    if (abs(forward.y) > 0.99) {\n"
+"        up = vec3f(1.0, 0.0, 0.0);\n"
+"    }\n"
+"    let right = normalize(cross(up, forward));\n"
+"    up = cross(forward, right);\n"
+"\n"
+"    let corner = corners[faces[vertex]] * settings.agentSize;\n"
+"    let world = agent.position + right * corner.x + up * corner.y + forward * corner.z;\n"
+"\n"
+"    var out: VertexOutput;\n"
+"    out.position = settings.viewProj * vec4f(world, 1.0);\n"
+"    // Colored by heading, shaded per face\n"
+"    out.color = (forward * 0.35 + 0.65) * shades[vertex / 3u];\n"
+"    return out;\n"
+"}\n"
+"\n"
+"@fragment\n"
+"fn fs_main(in: VertexOutput) -> @location(0) vec4f {\n"
+"    return vec4f(in.color, 1.0);\n"
+"}\n";
+
+BoidsSettings defaultBoidsSettings(void)
+{
+    BoidsSettings settings;
+    memset(&settings, 0, sizeof settings);
+    settings.perceptionRadius = 2.5f;
+    settings.separationRadius = 1.0f;
+    settings.separationWeight = 1.5f;
+    settings.alignmentWeight = 1.0f;
+    settings.cohesionWeight = 0.5f;
+    settings.boundsWeight = 2.0f;
+    settings.boundsHalfExtent = vec3(50.0f, 50.0f, 50.0f);
+    settings.minSpeed = 2.0f;
+    settings.maxSpeed = 6.0f;
+    settings.maxNeighbours = 64;
+    settings.agentSize = 0.6f;
+    return settings;
+}
+
+/** Bind group entry `binding` of kBoidWGSL; userData is the Boids. */
+static void fillBoidEntry(void* userData, uint32_t binding, WGPUBindGroupEntry* entry)
+{
+    const Boids* boids = userData;
+    memset(entry, 0, sizeof *entry);
+    entry->binding = binding;
+    switch (binding) {
+    case 0:
+        entry->buffer = boids->uniformBuffer;
+        entry->size = sizeof(BoidUniforms);
+        break;
+    case 1:
+        entry->buffer = boids->agentBuffer;
+        entry->size = (uint64_t)boids->agentCount * sizeof(GpuAgent);
+        break;
+    case 2:
+        entry->buffer = boids->sortedAgentBuffer;
+        entry->size = (uint64_t)boids->agentCount * sizeof(GpuAgent);
+        break;
+    case 3:
+        entry->buffer = boids->keyBuffer;
+        entry->size = (uint64_t)boids->sort.capacity * sizeof(uint32_t);
+        break;
+    case 4:
+        entry->buffer = boids->indexBuffer;
+        entry->size = (uint64_t)boids->sort.capacity * sizeof(uint32_t);
+        break;
+    case 5:
+        entry->buffer = boids->cellBuffer;
+        entry->size = (uint64_t)boids->tableSize * 2 * sizeof(uint32_t);
+        break;
+    }
+}
+
+static const uint32_t kSpawnBindings[] = { 0, 1 };
+static const uint32_t kHashBindings[] = { 0, 1, 3, 4 };
+static const uint32_t kCellsBindings[] = { 0, 3, 5 };
+static const uint32_t kGatherBindings[] = { 0, 1, 2, 4 };
+static const uint32_t kSteerBindings[] = { 0, 1, 2, 3, 4, 5 };
+
+static bool createKernels(Boids* boids)
+{
+    WGPUShaderModule module = createShaderModuleFromParts(boids->device, "Boid shader", kBoidWGSL,
+                                                          sizeof kBoidWGSL / sizeof kBoidWGSL[0]);
+    if (!module) return false;
+    boids->spawnPipeline = createComputePipeline(boids->device, "Boid spawn pipeline", module, "spawn");
+    boids->hashPipeline = createComputePipeline(boids->device, "Boid hash pipeline", module, "hashAgents");
+    boids->cellsPipeline = createComputePipeline(boids->device, "Boid cells pipeline", module, "findCells");
+    boids->gatherPipeline = createComputePipeline(boids->device, "Boid gather pipeline", module, "gather");
+    boids->steerPipeline = createComputePipeline(boids->device, "Boid steer pipeline", module, "steer");
+    wgpuShaderModuleRelease(module);
+    if (!boids->spawnPipeline || !boids->hashPipeline || !boids->cellsPipeline || !boids->gatherPipeline ||
+        !boids->steerPipeline) {
+        return false;
+    }
+
+    boids->spawnBindGroup = createAutoLayoutBindGroup(boids->device, boids->spawnPipeline,
+                                                      "Boid spawn bind group", kSpawnBindings,
+                                                      kBindingCount(kSpawnBindings), fillBoidEntry, boids);
+    boids->hashBindGroup = createAutoLayoutBindGroup(boids->device, boids->hashPipeline,
+                                                     "Boid hash bind group", kHashBindings,
+                                                     kBindingCount(kHashBindings), fillBoidEntry, boids);
+    boids->cellsBindGroup = createAutoLayoutBindGroup(boids->device, boids->cellsPipeline,
+                                                      "Boid cells bind group", kCellsBindings,
+                                                      kBindingCount(kCellsBindings), fillBoidEntry, boids);
+    boids->gatherBindGroup = createAutoLayoutBindGroup(boids->device, boids->gatherPipeline,
+                                                       "Boid gather bind group", kGatherBindings,
+                                                       kBindingCount(kGatherBindings), fillBoidEntry, boids);
+    boids->steerBindGroup = createAutoLayoutBindGroup(boids->device, boids->steerPipeline,
+                                                      "Boid steer bind group", kSteerBindings,
+                                                      kBindingCount(kSteerBindings), fillBoidEntry, boids);
+    return boids->spawnBindGroup && boids->hashBindGroup && boids->cellsBindGroup && boids->gatherBindGroup &&
+           boids->steerBindGroup;
+}
+
+static bool createRenderPipeline(Boids* boids,
+                                 WGPUTextureFormat colorFormat,
+                                 WGPUTextureFormat depthFormat,
+                                 uint32_t sampleCount)
+{
+    WGPUShaderModule module = createShaderModule(boids->device, "Boid render shader", kBoidRenderWGSL);
+    if (!module) return false;
+
+    WGPUColorTargetState colorTarget = {0};
+    colorTarget.format = colorFormat;
+    colorTarget.blend = NULL;
+    colorTarget.writeMask = WGPUColorWriteMask_All;
+
+    WGPUFragmentState fragment = {0};
+    fragment.module = module;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &colorTarget;
+
+    WGPUDepthStencilState depthStencil = {0};
+    depthStencil.format = depthFormat;
+    depthStencil.depthWriteEnabled = true;
+    depthStencil.depthCompare = WGPUCompareFunction_Less;
+    depthStencil.stencilFront.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilBack.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilReadMask = 0;
+    depthStencil.stencilWriteMask = 0;
+
+    WGPURenderPipelineDescriptor desc = {0};
+    desc.label = "Boid render pipeline";
+    desc.layout = NULL; // auto layout
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
+    desc.primitive.frontFace = WGPUFrontFace_CCW;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.depthStencil = depthFormat != WGPUTextureFormat_Undefined ? &depthStencil : NULL;
+    desc.multisample.count = sampleCount > 1 ? sampleCount : 1;
+    desc.multisample.mask = ~0u;
+    desc.multisample.alphaToCoverageEnabled = false;
+    desc.fragment = &fragment;
+
+    boids->renderPipeline = wgpuDeviceCreateRenderPipeline(boids->device, &desc);
+    wgpuShaderModuleRelease(module);
+    if (!boids->renderPipeline) {
+        fprintf(stderr, "Failed to create %s\n", desc.label);
+        return false;
+    }
+
+    WGPUBindGroupEntry entries[2];
+    fillBoidEntry(boids, 0, &entries[0]);
+    fillBoidEntry(boids, 1, &entries[1]);
+    WGPUBindGroupLayout layout = wgpuRenderPipelineGetBindGroupLayout(boids->renderPipeline, 0);
+    WGPUBindGroupDescriptor bindGroupDesc = {0};
+    bindGroupDesc.label = "Boid render bind group";
+    bindGroupDesc.layout = layout;
+    bindGroupDesc.entryCount = 2;
+    bindGroupDesc.entries = entries;
+    boids->renderBindGroup = wgpuDeviceCreateBindGroup(boids->device, &bindGroupDesc);
+    wgpuBindGroupLayoutRelease(layout);
+    return boids->renderBindGroup != NULL;
+}
+
+bool createBoids(Boids* boids,
+                 WGPUDevice device,
+                 WGPUQueue queue,
+                 uint32_t agentCount,
+                 const BoidsSettings* settings,
+                 WGPUTextureFormat colorFormat,
+                 WGPUTextureFormat depthFormat,
+                 uint32_t sampleCount)
+{
+    memset(boids, 0, sizeof *boids);
+    if (agentCount == 0 || agentCount > kBoidsMaxAgents) {
+        fprintf(stderr, "createBoids: agent count %u out of range (1..%u)\n", agentCount, kBoidsMaxAgents);
+        return false;
+    }
+    boids->device = device;
+    boids->queue = queue;
+    boids->agentCount = agentCount;
+    boids->pendingSpawn = true;
+    boids->viewProj = mat4Identity();
+    boidsSetSettings(boids, settings);
+    if (!createGpuSort(&boids->sort, device, queue, agentCount)) return false;
+
+    // About two buckets per agent keeps unrelated cells from sharing one
+    boids->tableSize = 1;
+    while (boids->tableSize < 2 * agentCount) boids->tableSize <<= 1;
+
+    const WGPUBufferUsageFlags storage = WGPUBufferUsage_Storage;
+    const uint64_t agentsSize = (uint64_t)agentCount * sizeof(GpuAgent);
+    const uint64_t listSize = (uint64_t)boids->sort.capacity * sizeof(uint32_t);
+    boids->uniformBuffer = createBuffer(device, "Boid uniforms", sizeof(BoidUniforms),
+                                        WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    boids->agentBuffer = createBuffer(device, "Boid agents", agentsSize, storage | WGPUBufferUsage_CopySrc);
+    boids->sortedAgentBuffer = createBuffer(device, "Boid sorted agents", agentsSize, storage);
+    boids->keyBuffer = createBuffer(device, "Boid cell keys", listSize, storage);
+    boids->indexBuffer = createBuffer(device, "Boid agent indices", listSize, storage);
+    boids->cellBuffer = createBuffer(device, "Boid cell ranges", (uint64_t)boids->tableSize * 2 * sizeof(uint32_t),
+                                     storage);
+    boids->countBuffer = createBuffer(device, "Boid count", sizeof(uint32_t), storage | WGPUBufferUsage_CopyDst);
+    if (boids->countBuffer) {
+        wgpuQueueWriteBuffer(queue, boids->countBuffer, 0, &agentCount, sizeof agentCount);
+    }
+
+    bool drawable = colorFormat != WGPUTextureFormat_Undefined;
+    if (!boids->uniformBuffer || !boids->agentBuffer || !boids->sortedAgentBuffer || !boids->keyBuffer ||
+        !boids->indexBuffer || !boids->cellBuffer || !boids->countBuffer || !createKernels(boids) ||
+        !createGpuSortList(&boids->sort, &boids->sortList, boids->keyBuffer, boids->indexBuffer,
+                           boids->countBuffer, 0) ||
+        (drawable && !createRenderPipeline(boids, colorFormat, depthFormat, sampleCount))) {
+        releaseBoids(boids);
+        return false;
+    }
+    return true;
+}
+
+void releaseBoids(Boids* boids)
+{
+    WGPUBindGroup bindGroups[6] = {
+        boids->spawnBindGroup, boids->hashBindGroup, boids->cellsBindGroup,
+        boids->gatherBindGroup, boids->steerBindGroup, boids->renderBindGroup,
+    };
+    for (int i = 0; i < 6; ++i) {
+        if (bindGroups[i]) wgpuBindGroupRelease(bindGroups[i]);
+    }
+    WGPUComputePipeline pipelines[5] = {
+        boids->spawnPipeline, boids->hashPipeline, boids->cellsPipeline,
+        boids->gatherPipeline, boids->steerPipeline,
+    };
+    for (int i = 0; i < 5; ++i) {
+        if (pipelines[i]) wgpuComputePipelineRelease(pipelines[i]);
+    }
+    if (boids->renderPipeline) wgpuRenderPipelineRelease(boids->renderPipeline);
+    releaseGpuSortList(&boids->sortList);
+    releaseGpuSort(&boids->sort);
+    WGPUBuffer buffers[7] = {
+        boids->uniformBuffer, boids->agentBuffer, boids->sortedAgentBuffer, boids->keyBuffer,
+        boids->indexBuffer, boids->cellBuffer, boids->countBuffer,
+    };
+    for (int i = 0; i < 7; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    memset(boids, 0, sizeof *boids);
+}
+
+void boidsSetSettings(Boids* boids, const BoidsSettings* settings)
+{
+    boids->settings = settings ? *settings : defaultBoidsSettings();
+    // The radius is the cell size: zero would put every agent in its own cell at infinity
+    boids->settings.perceptionRadius = fmaxf(boids->settings.perceptionRadius, 1e-3f);
+    boids->settings.maxSpeed = fmaxf(boids->settings.maxSpeed, boids->settings.minSpeed);
+}
+
+void boidsRespawn(Boids* boids, uint32_t seed)
+{
+    boids->seed = seed;
+    boids->pendingSpawn = true;
+}
+
+void boidsSetViewProj(Boids* boids, Mat4 viewProj)
+{
+    boids->viewProj = viewProj;
+}
+
+void boidsStep(Boids* boids,
+               WGPUCommandEncoder encoder,
+               float timeDelta,
+               const WGPUComputePassTimestampWrites* timestamps)
+{
+    const BoidsSettings* settings = &boids->settings;
+
+    BoidUniforms uniforms = {0};
+    memcpy(uniforms.viewProj, boids->viewProj.m, sizeof uniforms.viewProj);
+    uniforms.boundsHalfExtent[0] = settings->boundsHalfExtent.x;
+    uniforms.boundsHalfExtent[1] = settings->boundsHalfExtent.y;
+    uniforms.boundsHalfExtent[2] = settings->boundsHalfExtent.z;
+    uniforms.perceptionRadius = settings->perceptionRadius;
+    uniforms.separationRadius = settings->separationRadius;
+    uniforms.separationWeight = settings->separationWeight;
+    uniforms.alignmentWeight = settings->alignmentWeight;
+    uniforms.cohesionWeight = settings->cohesionWeight;
+    uniforms.boundsWeight = settings->boundsWeight;
+    uniforms.minSpeed = settings->minSpeed;
+    uniforms.maxSpeed = settings->maxSpeed;
+    uniforms.timeDelta = timeDelta;
+    uniforms.agentSize = settings->agentSize;
+    uniforms.agentCount = boids->agentCount;
+    uniforms.tableSize = boids->tableSize;
+    uniforms.maxNeighbours = settings->maxNeighbours;
+    uniforms.seed = boids->seed;
+    wgpuQueueWriteBuffer(boids->queue, boids->uniformBuffer, 0, &uniforms, sizeof uniforms);
+
+    WGPUComputePassDescriptor passDesc = {0};
+    passDesc.label = "Boid pass";
+    passDesc.timestampWrites = timestamps;
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+
+    const uint32_t groups = (boids->agentCount + kBoidGroupSize - 1) / kBoidGroupSize;
+    if (boids->pendingSpawn) {
+        wgpuComputePassEncoderSetPipeline(pass, boids->spawnPipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, boids->spawnBindGroup, 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, groups, 1, 1);
+        boids->pendingSpawn = false;
+    }
+
+    wgpuComputePassEncoderSetPipeline(pass, boids->hashPipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, boids->hashBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, groups, 1, 1);
+
+    gpuSortRecord(&boids->sort, &boids->sortList, pass);
+
+    wgpuComputePassEncoderSetPipeline(pass, boids->cellsPipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, boids->cellsBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, groups, 1, 1);
+
+    wgpuComputePassEncoderSetPipeline(pass, boids->gatherPipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, boids->gatherBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, groups, 1, 1);
+
+    wgpuComputePassEncoderSetPipeline(pass, boids->steerPipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, boids->steerBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, groups, 1, 1);
+
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+}
+
+void boidsDraw(Boids* boids, WGPURenderPassEncoder pass)
+{
+    if (!boids->renderPipeline) return;
+    wgpuRenderPassEncoderSetPipeline(pass, boids->renderPipeline);
+    wgpuRenderPassEncoderSetBindGroup(pass, 0, boids->renderBindGroup, 0, NULL);
+    wgpuRenderPassEncoderDraw(pass, 12, boids->agentCount, 0, 0);
+}
+
+/** Volume per agent in the benchmark's box: about as crowded as the defaults with 15k agents. */
+#define kBenchmarkVolumePerAgent 64.0f
+#define kBenchmarkTimeDelta (1.0f / 60.0f)
+#define kBenchmarkWarmupSteps 4
+
+static void benchmarkStep(void* userData, WGPUCommandEncoder encoder)
+{
+    boidsStep(userData, encoder, kBenchmarkTimeDelta, NULL);
+}
+
+bool boidsBenchmark(WGPUDevice device, WGPUQueue queue, uint32_t agentCount, uint32_t steps)
+{
+    // The box grows with the crowd, so the neighbour count per agent stays the same
+    BoidsSettings settings = defaultBoidsSettings();
+    float halfExtent = 0.5f * cbrtf((float)agentCount * kBenchmarkVolumePerAgent);
+    settings.boundsHalfExtent = vec3(halfExtent, halfExtent, halfExtent);
+
+    Boids boids;
+    if (!createBoids(&boids, device, queue, agentCount, &settings,
+                     WGPUTextureFormat_Undefined, WGPUTextureFormat_Undefined, 1)) {
+        return false;
+    }
+
+    // The first agent comes back as the result
+    GpuBenchmark benchmark = {0};
+    benchmark.label = "Boid benchmark";
+    benchmark.step = benchmarkStep;
+    benchmark.userData = &boids;
+    benchmark.warmupSteps = kBenchmarkWarmupSteps;
+    benchmark.steps = steps;
+    benchmark.resultBuffer = boids.agentBuffer;
+    benchmark.resultSize = sizeof(GpuAgent);
+    GpuAgent agent;
+    double seconds = runGpuBenchmark(device, queue, &benchmark, NULL, &agent);
+    bool ok = seconds >= 0.0;
+
+    if (ok && !(isfinite(agent.position[0]) && isfinite(agent.position[1]) && isfinite(agent.position[2]))) {
+        fprintf(stderr, "boidsBenchmark: agent 0 left with a non-finite position\n");
+        ok = false;
+    }
+    if (ok) {
+        printf("Boids: %u agents, %u steps, %.3f ms/step, %.1f M agent steps/s\n",
+               agentCount, steps, seconds * 1e3 / steps, (double)agentCount * steps / seconds / 1e6);
+    }
+
+    releaseBoids(&boids);
+    return ok;
+}
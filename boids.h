@@ -0,0 +1,133 @@
+#ifndef BOIDS_H
+#define BOIDS_H
+
+#include "gpu-sort.h"
+#include "linalg.h"
+#include "webgpu-utils.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * BOIDS
+ *
+ * Flocking agents simulated in compute, with neighbour search through a
+ * spatial hash so the cost grows with the agent count, not its square.
+ * One compute pass per step:
+ *  - hash: every agent's key is the hash of the uniform grid cell it is in
+ *    (cells as large as the perception radius)
+ *  - sort: agent indices by key (see gpu-sort.h)
+ *  - cells: the first and last sorted position of every occupied hash
+ *    bucket; buckets nobody is in keep stale ranges from earlier steps,
+ *    which the lookup rejects by checking the key at the range start
+ *  - gather: agents copied in sorted order, so neighbours read memory that
+ *    is close together
+ *  - steer: separation, alignment and cohesion over the neighbours in the
+ *    27 surrounding cells (up to `maxNeighbours`), a pull back into the
+ *    bounds, then integration; results are scattered back to each agent's
+ *    own slot, so agent indices are stable
+ *
+ * Agents are drawn as one instanced draw of small arrows pointing along
+ * their velocity. boidsBenchmark() runs the simulation alone and reports
+ * agent steps per second.
+ */
+
+// Agent storage, 32 bytes each, must fit in one storage buffer binding
+#define kBoidsMaxAgents (uint32_t)(kMaxStorageBindingSize / 32)
+
+typedef struct {
+    float perceptionRadius;     // neighbours further away are ignored; also the grid cell size
+    float separationRadius;
+    float separationWeight;
+    float alignmentWeight;
+    float cohesionWeight;
+    float boundsWeight;         // steering back towards the box past its faces
+    Vec3 boundsHalfExtent;      // box centered on the origin, agents spawn in it
+    float minSpeed, maxSpeed;
+    uint32_t maxNeighbours;
+    float agentSize;            // arrow length when drawn
+} BoidsSettings;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+    BoidsSettings settings;
+    uint32_t agentCount;
+    uint32_t tableSize;         // hash buckets, a power of two
+    uint32_t seed;
+    bool pendingSpawn;
+    Mat4 viewProj;
+
+    WGPUBuffer uniformBuffer;
+    WGPUBuffer agentBuffer;
+    WGPUBuffer sortedAgentBuffer;
+    WGPUBuffer keyBuffer;
+    WGPUBuffer indexBuffer;     // agent indices, sorted with the keys
+    WGPUBuffer cellBuffer;      // per bucket: first and one past the last sorted position
+    WGPUBuffer countBuffer;     // the agent count, for the sort
+
+    GpuSort sort;
+    GpuSortList sortList;
+
+    WGPUComputePipeline spawnPipeline;
+    WGPUComputePipeline hashPipeline;
+    WGPUComputePipeline cellsPipeline;
+    WGPUComputePipeline gatherPipeline;
+    WGPUComputePipeline steerPipeline;
+    WGPUBindGroup spawnBindGroup;
+    WGPUBindGroup hashBindGroup;
+    WGPUBindGroup cellsBindGroup;
+    WGPUBindGroup gatherBindGroup;
+    WGPUBindGroup steerBindGroup;
+
+    WGPURenderPipeline renderPipeline;  // NULL when created without a color format
+    WGPUBindGroup renderBindGroup;
+} Boids;
+
+/** A loose flock in a 100-unit box. */
+BoidsSettings defaultBoidsSettings(void);
+
+/**
+ * `agentCount` agents, up to kBoidsMaxAgents, spawned at random in the
+ * bounds with random headings. With a color format the agents can be drawn
+ * in passes with these formats and sample count; pass
+ * WGPUTextureFormat_Undefined to only simulate.
+ */
+bool createBoids(Boids* boids,
+                 WGPUDevice device,
+                 WGPUQueue queue,
+                 uint32_t agentCount,
+                 const BoidsSettings* settings,
+                 WGPUTextureFormat colorFormat,
+                 WGPUTextureFormat depthFormat,
+                 uint32_t sampleCount);
+
+void releaseBoids(Boids* boids);
+
+/** Takes effect on the next step. */
+void boidsSetSettings(Boids* boids, const BoidsSettings* settings);
+
+/** Respawn every agent on the next step. */
+void boidsRespawn(Boids* boids, uint32_t seed);
+
+/** The camera of the next boidsDraw(), uploaded by the next step. */
+void boidsSetViewProj(Boids* boids, Mat4 viewProj);
+
+/** Record one simulation step in its own compute pass. */
+void boidsStep(Boids* boids,
+               WGPUCommandEncoder encoder,
+               float timeDelta,
+               const WGPUComputePassTimestampWrites* timestamps);
+
+void boidsDraw(Boids* boids, WGPURenderPassEncoder pass);
+
+/**
+ * Simulate `agentCount` agents for `steps` steps, waiting for the GPU at
+ * the end, and print the throughput in agent steps per second. Blocking,
+ * meant for a headless device.
+ */
+bool boidsBenchmark(WGPUDevice device, WGPUQueue queue, uint32_t agentCount, uint32_t steps);
+
+#endif // BOIDS_H
@@ -0,0 +1,645 @@
+#include "compressed-texture.h"
+#include "webgpu-utils.h"
+#include "jobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define COMPRESSED_SSE2 1
+#endif
+
+#define FOURCC(a, b, c, d) \
+    ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+
+#define kDDSMagic           FOURCC('D', 'D', 'S', ' ')
+#define kDDSHeaderSize      124
+#define kDDSPixelFormatFourCC 0x4
+#define kDDSDX10HeaderSize  20
+
+// DXGI_FORMAT values used in DX10 headers
+#define kDXGIBC1Unorm       71
+#define kDXGIBC1UnormSrgb   72
+#define kDXGIBC2Unorm       74
+#define kDXGIBC2UnormSrgb   75
+#define kDXGIBC3Unorm       77
+#define kDXGIBC3UnormSrgb   78
+#define kDXGIBC4Unorm       80
+#define kDXGIBC5Unorm       83
+#define kDXGIBC7Unorm       98
+#define kDXGIBC7UnormSrgb   99
+
+#define kKTXHeaderSize      64
+#define kKTXEndianness      0x04030201u
+#define kGLETC1RGB8         0x8D64  // ETC1_RGB8_OES
+#define kGLETC2RGB8         0x9274  // COMPRESSED_RGB8_ETC2
+
+static const uint8_t kKTXIdentifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+static uint32_t readU32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static WGPUTextureFormat formatFromFourCC(uint32_t fourCC)
+{
+    switch (fourCC) {
+    case FOURCC('D', 'X', 'T', '1'): return WGPUTextureFormat_BC1RGBAUnorm;
+    case FOURCC('D', 'X', 'T', '2'):
+    case FOURCC('D', 'X', 'T', '3'): return WGPUTextureFormat_BC2RGBAUnorm;
+    case FOURCC('D', 'X', 'T', '4'):
+    case FOURCC('D', 'X', 'T', '5'): return WGPUTextureFormat_BC3RGBAUnorm;
+    case FOURCC('A', 'T', 'I', '1'):
+    case FOURCC('B', 'C', '4', 'U'): return WGPUTextureFormat_BC4RUnorm;
+    case FOURCC('A', 'T', 'I', '2'):
+    case FOURCC('B', 'C', '5', 'U'): return WGPUTextureFormat_BC5RGUnorm;
+    default:                         return WGPUTextureFormat_Undefined;
+    }
+}
+
+static WGPUTextureFormat formatFromDXGI(uint32_t dxgi)
+{
+    switch (dxgi) {
+    case kDXGIBC1Unorm:     return WGPUTextureFormat_BC1RGBAUnorm;
+    case kDXGIBC1UnormSrgb: return WGPUTextureFormat_BC1RGBAUnormSrgb;
+    case kDXGIBC2Unorm:     return WGPUTextureFormat_BC2RGBAUnorm;
+    case kDXGIBC2UnormSrgb: return WGPUTextureFormat_BC2RGBAUnormSrgb;
+    case kDXGIBC3Unorm:     return WGPUTextureFormat_BC3RGBAUnorm;
+    case kDXGIBC3UnormSrgb: return WGPUTextureFormat_BC3RGBAUnormSrgb;
+    case kDXGIBC4Unorm:     return WGPUTextureFormat_BC4RUnorm;
+    case kDXGIBC5Unorm:     return WGPUTextureFormat_BC5RGUnorm;
+    case kDXGIBC7Unorm:     return WGPUTextureFormat_BC7RGBAUnorm;
+    case kDXGIBC7UnormSrgb: return WGPUTextureFormat_BC7RGBAUnormSrgb;
+    default:                return WGPUTextureFormat_Undefined;
+    }
+}
+
+static bool isSrgbFormat(WGPUTextureFormat format)
+{
+    return format == WGPUTextureFormat_BC1RGBAUnormSrgb ||
+           format == WGPUTextureFormat_BC2RGBAUnormSrgb ||
+           format == WGPUTextureFormat_BC3RGBAUnormSrgb ||
+           format == WGPUTextureFormat_BC7RGBAUnormSrgb;
+}
+
+/** Reject empty images and keep mipCount within the chain down to 1x1. */
+static bool checkImageLevels(const char* loader, CompressedImage* image)
+{
+    if (image->width == 0 || image->height == 0) {
+        fprintf(stderr, "%s: empty %ux%u image\n", loader, image->width, image->height);
+        return false;
+    }
+
+    uint32_t fullChain = 1;
+    for (uint32_t extent = image->width > image->height ? image->width : image->height; extent > 1; extent >>= 1) {
+        fullChain++;
+    }
+    if (image->mipCount == 0) image->mipCount = 1;
+    if (image->mipCount > fullChain) {
+        fprintf(stderr, "%s: %u mips for a %ux%u image, keeping %u\n",
+                loader, image->mipCount, image->width, image->height, fullChain);
+        image->mipCount = fullChain;
+    }
+    if (image->mipCount > kCompressedImageMaxLevels) image->mipCount = kCompressedImageMaxLevels;
+    return true;
+}
+
+/**
+ * LOAD DDS
+ *
+ * Layout: "DDS " magic, 124-byte header (pixel format at +72 of the
+ * header), optional 20-byte DX10 header, then every mip level back to back.
+ */
+bool loadDDS(const void* data, size_t size, CompressedImage* image)
+{
+    const uint8_t* bytes = data;
+    memset(image, 0, sizeof *image);
+
+    if (size < 4 + kDDSHeaderSize || readU32(bytes) != kDDSMagic ||
+        readU32(bytes + 4) != kDDSHeaderSize) {
+        fprintf(stderr, "loadDDS: not a DDS file\n");
+        return false;
+    }
+
+    const uint8_t* header = bytes + 4;
+    image->height = readU32(header + 8);
+    image->width = readU32(header + 12);
+    image->mipCount = readU32(header + 24);
+    if (!checkImageLevels("loadDDS", image)) return false;
+
+    const uint8_t* pixelFormat = header + 72;
+    uint32_t pixelFormatFlags = readU32(pixelFormat + 4);
+    uint32_t fourCC = readU32(pixelFormat + 8);
+    size_t offset = 4 + kDDSHeaderSize;
+
+    if (!(pixelFormatFlags & kDDSPixelFormatFourCC)) {
+        fprintf(stderr, "loadDDS: uncompressed DDS files are not supported\n");
+        return false;
+    }
+    if (fourCC == FOURCC('D', 'X', '1', '0')) {
+        if (size < offset + kDDSDX10HeaderSize) {
+            fprintf(stderr, "loadDDS: truncated DX10 header\n");
+            return false;
+        }
+        image->format = formatFromDXGI(readU32(bytes + offset));
+        offset += kDDSDX10HeaderSize;
+    } else {
+        image->format = formatFromFourCC(fourCC);
+    }
+    if (image->format == WGPUTextureFormat_Undefined) {
+        fprintf(stderr, "loadDDS: unsupported pixel format\n");
+        return false;
+    }
+
+    uint32_t blockWidth, blockHeight, bytesPerBlock;
+    textureFormatBlockInfo(image->format, &blockWidth, &blockHeight, &bytesPerBlock);
+
+    for (uint32_t level = 0; level < image->mipCount; ++level) {
+        uint32_t w = image->width >> level ? image->width >> level : 1;
+        uint32_t h = image->height >> level ? image->height >> level : 1;
+        size_t levelSize = (size_t)((w + blockWidth - 1) / blockWidth) *
+                           ((h + blockHeight - 1) / blockHeight) * bytesPerBlock;
+        if (offset + levelSize > size) {
+            fprintf(stderr, "loadDDS: truncated at mip %u\n", level);
+            return false;
+        }
+        image->levels[level] = bytes + offset;
+        image->levelSizes[level] = levelSize;
+        offset += levelSize;
+    }
+    return true;
+}
+
+/**
+ * LOAD KTX
+ *
+ * KTX 1.1: 12-byte identifier, 52 bytes of header fields, key/value data,
+ * then each level as a 32-bit byte count followed by its blocks (8-byte
+ * ETC blocks need no padding). Only little-endian 2D files.
+ */
+bool loadKTX(const void* data, size_t size, CompressedImage* image)
+{
+    const uint8_t* bytes = data;
+    memset(image, 0, sizeof *image);
+
+    if (size < kKTXHeaderSize || memcmp(bytes, kKTXIdentifier, sizeof kKTXIdentifier) != 0) {
+        fprintf(stderr, "loadKTX: not a KTX 1.1 file\n");
+        return false;
+    }
+    if (readU32(bytes + 12) != kKTXEndianness) {
+        fprintf(stderr, "loadKTX: big-endian files are not supported\n");
+        return false;
+    }
+
+    uint32_t internalFormat = readU32(bytes + 28);
+    image->width = readU32(bytes + 36);
+    image->height = readU32(bytes + 40);
+    uint32_t depth = readU32(bytes + 44);
+    uint32_t arrayElements = readU32(bytes + 48);
+    uint32_t faces = readU32(bytes + 52);
+    image->mipCount = readU32(bytes + 56);
+    uint32_t keyValueBytes = readU32(bytes + 60);
+
+    switch (internalFormat) {
+    case kGLETC1RGB8:
+        // ETC1 blocks are ETC2 RGB8 blocks that also decode on the CPU
+        image->format = WGPUTextureFormat_ETC2RGB8Unorm;
+        image->etc1 = true;
+        break;
+    case kGLETC2RGB8:
+        image->format = WGPUTextureFormat_ETC2RGB8Unorm;
+        break;
+    default:
+        fprintf(stderr, "loadKTX: unsupported internal format 0x%x\n", internalFormat);
+        return false;
+    }
+    if (depth > 1 || arrayElements > 0 || faces != 1) {
+        fprintf(stderr, "loadKTX: only 2D textures are supported\n");
+        return false;
+    }
+    if (!checkImageLevels("loadKTX", image)) return false;
+
+    size_t offset = (size_t)kKTXHeaderSize + keyValueBytes;
+    for (uint32_t level = 0; level < image->mipCount; ++level) {
+        uint32_t w = image->width >> level ? image->width >> level : 1;
+        uint32_t h = image->height >> level ? image->height >> level : 1;
+        size_t levelSize = (size_t)((w + 3) / 4) * ((h + 3) / 4) * 8;
+        if (offset + 4 > size || readU32(bytes + offset) != levelSize || offset + 4 + levelSize > size) {
+            fprintf(stderr, "loadKTX: truncated or mis-sized mip %u\n", level);
+            return false;
+        }
+        image->levels[level] = bytes + offset + 4;
+        image->levelSizes[level] = levelSize;
+        offset += 4 + levelSize;
+    }
+    return true;
+}
+
+bool isCompressedFormatSupported(const Context* context, WGPUTextureFormat format)
+{
+    switch (format) {
+    case WGPUTextureFormat_BC1RGBAUnorm:
+    case WGPUTextureFormat_BC1RGBAUnormSrgb:
+    case WGPUTextureFormat_BC2RGBAUnorm:
+    case WGPUTextureFormat_BC2RGBAUnormSrgb:
+    case WGPUTextureFormat_BC3RGBAUnorm:
+    case WGPUTextureFormat_BC3RGBAUnormSrgb:
+    case WGPUTextureFormat_BC4RUnorm:
+    case WGPUTextureFormat_BC5RGUnorm:
+    case WGPUTextureFormat_BC7RGBAUnorm:
+    case WGPUTextureFormat_BC7RGBAUnormSrgb:
+        return context->textureCompressionBC;
+    case WGPUTextureFormat_ETC2RGB8Unorm:
+    case WGPUTextureFormat_ETC2RGBA8Unorm:
+        return context->textureCompressionETC2;
+    case WGPUTextureFormat_ASTC4x4Unorm:
+        return context->textureCompressionASTC;
+    default:
+        return true; // not compressed
+    }
+}
+
+/**
+ * BC1 colour block: two RGB565 endpoints and 2-bit indices. With
+ * c0 <= c1 (only honoured for BC1 itself) index 3 is transparent black.
+ */
+static void decodeColorBlock(const uint8_t* block, uint8_t texels[16][4], bool allowPunchThrough)
+{
+    uint32_t c0 = (uint32_t)block[0] | (uint32_t)block[1] << 8;
+    uint32_t c1 = (uint32_t)block[2] | (uint32_t)block[3] << 8;
+
+    uint8_t palette[4][4];
+    for (int i = 0; i < 2; ++i) {
+        uint32_t c = i == 0 ? c0 : c1;
+        uint32_t r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        palette[i][0] = (uint8_t)((r << 3) | (r >> 2));
+        palette[i][1] = (uint8_t)((g << 2) | (g >> 4));
+        palette[i][2] = (uint8_t)((b << 3) | (b >> 2));
+        palette[i][3] = 255;
+    }
+    if (c0 > c1 || !allowPunchThrough) {
+        for (int k = 0; k < 3; ++k) {
+            palette[2][k] = (uint8_t)((2 * palette[0][k] + palette[1][k]) / 3);
+            palette[3][k] = (uint8_t)((palette[0][k] + 2 * palette[1][k]) / 3);
+        }
+        palette[2][3] = palette[3][3] = 255;
+    } else {
+        for (int k = 0; k < 3; ++k) {
+            palette[2][k] = (uint8_t)((palette[0][k] + palette[1][k]) / 2);
+            palette[3][k] = 0;
+        }
+        palette[2][3] = 255;
+        palette[3][3] = 0;
+    }
+
+    uint32_t indices = readU32(block + 4);
+    for (int i = 0; i < 16; ++i) {
+        memcpy(texels[i], palette[(indices >> (2 * i)) & 3], 4);
+    }
+}
+
+/** BC4 block (also BC3 alpha / BC5 channels): two 8-bit endpoints, 3-bit indices. */
+static void decodeChannelBlock(const uint8_t* block, uint8_t values[16])
+{
+    uint32_t a0 = block[0], a1 = block[1];
+    uint8_t palette[8];
+    palette[0] = (uint8_t)a0;
+    palette[1] = (uint8_t)a1;
+    if (a0 > a1) {
+        for (uint32_t i = 1; i < 7; ++i) palette[i + 1] = (uint8_t)(((7 - i) * a0 + i * a1) / 7);
+    } else {
+        for (uint32_t i = 1; i < 5; ++i) palette[i + 1] = (uint8_t)(((5 - i) * a0 + i * a1) / 5);
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i) indices |= (uint64_t)block[2 + i] << (8 * i);
+    for (int i = 0; i < 16; ++i) values[i] = palette[(indices >> (3 * i)) & 7];
+}
+
+/** ETC1 intensity modifiers, by table and by pixel index (msb << 1 | lsb). */
+static const int16_t kEtc1Modifiers[8][4] = {
+    {  2,   8,  -2,   -8 }, {  5,  17,  -5,  -17 }, {  9,  29,  -9,  -29 }, { 13,  42, -13,  -42 },
+    { 18,  60, -18,  -60 }, { 24,  80, -24,  -80 }, { 33, 106, -33, -106 }, { 47, 183, -47, -183 },
+};
+
+/**
+ * ETC1 block, 64 bits big-endian: a base colour for each 2x4 (or, flipped,
+ * 4x2) half, either 4:4:4 each or 5:5:5 plus a 3-bit delta for the second;
+ * a modifier table per half; a 2-bit index per pixel, stored column by
+ * column, that picks the intensity added to all three channels.
+ *
+ * With SSE2, the 16 pixels of a channel are two vectors of eight 16-bit
+ * lanes: base + modifier, clamped by the saturating pack to bytes.
+ */
+static void decodeEtc1Block(const uint8_t* block, uint8_t texels[16][4])
+{
+    uint32_t high = (uint32_t)block[0] << 24 | (uint32_t)block[1] << 16 | (uint32_t)block[2] << 8 | block[3];
+    uint32_t low = (uint32_t)block[4] << 24 | (uint32_t)block[5] << 16 | (uint32_t)block[6] << 8 | block[7];
+
+    int base[2][3];
+    for (int c = 0; c < 3; ++c) {
+        if (high & 2) {
+            // Differential: 5 bits + signed 3-bit delta (overflow is ETC2-only)
+            int first = (int)(high >> (27 - 8 * c)) & 31;
+            int delta = (int)(high >> (24 - 8 * c)) & 7;
+            int second = (first + (delta >= 4 ? delta - 8 : delta)) & 31;
+            base[0][c] = (first << 3) | (first >> 2);
+            base[1][c] = (second << 3) | (second >> 2);
+        } else {
+            int first = (int)(high >> (28 - 8 * c)) & 15;
+            int second = (int)(high >> (24 - 8 * c)) & 15;
+            base[0][c] = first * 17;
+            base[1][c] = second * 17;
+        }
+    }
+    const int16_t* tables[2] = { kEtc1Modifiers[(high >> 5) & 7], kEtc1Modifiers[(high >> 2) & 7] };
+    bool flip = high & 1;
+
+    int16_t offsets[16];
+    for (int i = 0; i < 16; ++i) {
+        int x = i & 3, y = i >> 2;
+        int bit = x * 4 + y;
+        uint32_t index = ((low >> (bit + 15)) & 2) | ((low >> bit) & 1);
+        offsets[i] = tables[flip ? y >= 2 : x >= 2][index];
+    }
+
+#ifdef COMPRESSED_SSE2
+    // Lanes of the second half: columns 2-3 of every row, or rows 2-3
+    const __m128i columns = _mm_set_epi16(-1, -1, 0, 0, -1, -1, 0, 0);
+    __m128i maskLow = flip ? _mm_setzero_si128() : columns;
+    __m128i maskHigh = flip ? _mm_set1_epi16(-1) : columns;
+    __m128i offsetLow = _mm_loadu_si128((const __m128i*)&offsets[0]);
+    __m128i offsetHigh = _mm_loadu_si128((const __m128i*)&offsets[8]);
+
+    __m128i channels[3];
+    for (int c = 0; c < 3; ++c) {
+        __m128i first = _mm_set1_epi16((short)base[0][c]);
+        __m128i second = _mm_set1_epi16((short)base[1][c]);
+        __m128i low8 = _mm_or_si128(_mm_andnot_si128(maskLow, first), _mm_and_si128(maskLow, second));
+        __m128i high8 = _mm_or_si128(_mm_andnot_si128(maskHigh, first), _mm_and_si128(maskHigh, second));
+        channels[c] = _mm_packus_epi16(_mm_add_epi16(low8, offsetLow), _mm_add_epi16(high8, offsetHigh));
+    }
+
+    // Interleave into RGBA, four texels per store
+    __m128i alpha = _mm_set1_epi8(-1);
+    __m128i rg = _mm_unpacklo_epi8(channels[0], channels[1]);
+    __m128i ba = _mm_unpacklo_epi8(channels[2], alpha);
+    _mm_storeu_si128((__m128i*)texels[0], _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i*)texels[4], _mm_unpackhi_epi16(rg, ba));
+    rg = _mm_unpackhi_epi8(channels[0], channels[1]);
+    ba = _mm_unpackhi_epi8(channels[2], alpha);
+    _mm_storeu_si128((__m128i*)texels[8], _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i*)texels[12], _mm_unpackhi_epi16(rg, ba));
+#else
+    for (int i = 0; i < 16; ++i) {
+        const int* color = base[flip ? i >= 8 : (i & 3) >= 2];
+        for (int c = 0; c < 3; ++c) {
+            int value = color[c] + offsets[i];
+            texels[i][c] = (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+        }
+        texels[i][3] = 255;
+    }
+#endif
+}
+
+/** Decode any supported 4x4 block into 16 RGBA8 texels. */
+static bool decodeBlock(const CompressedImage* image, const uint8_t* block, uint8_t texels[16][4])
+{
+    uint8_t channel[16];
+
+    switch (image->format) {
+    case WGPUTextureFormat_BC1RGBAUnorm:
+    case WGPUTextureFormat_BC1RGBAUnormSrgb:
+        decodeColorBlock(block, texels, true);
+        return true;
+    case WGPUTextureFormat_BC2RGBAUnorm:
+    case WGPUTextureFormat_BC2RGBAUnormSrgb:
+        decodeColorBlock(block + 8, texels, false);
+        for (int i = 0; i < 16; ++i) {
+            uint32_t a = (block[i / 2] >> (4 * (i & 1))) & 15;
+            texels[i][3] = (uint8_t)(a * 17);
+        }
+        return true;
+    case WGPUTextureFormat_BC3RGBAUnorm:
+    case WGPUTextureFormat_BC3RGBAUnormSrgb:
+        decodeColorBlock(block + 8, texels, false);
+        decodeChannelBlock(block, channel);
+        for (int i = 0; i < 16; ++i) texels[i][3] = channel[i];
+        return true;
+    case WGPUTextureFormat_BC4RUnorm:
+        decodeChannelBlock(block, channel);
+        for (int i = 0; i < 16; ++i) {
+            texels[i][0] = channel[i];
+            texels[i][1] = texels[i][2] = 0;
+            texels[i][3] = 255;
+        }
+        return true;
+    case WGPUTextureFormat_BC5RGUnorm:
+        decodeChannelBlock(block, channel);
+        for (int i = 0; i < 16; ++i) texels[i][0] = channel[i];
+        decodeChannelBlock(block + 8, channel);
+        for (int i = 0; i < 16; ++i) {
+            texels[i][1] = channel[i];
+            texels[i][2] = 0;
+            texels[i][3] = 255;
+        }
+        return true;
+    case WGPUTextureFormat_ETC2RGB8Unorm:
+        // ETC2's extra modes aren't decoded, only the ETC1 subset
+        if (!image->etc1) return false;
+        decodeEtc1Block(block, texels);
+        return true;
+    default:
+        return false;
+    }
+}
+
+typedef struct {
+    const CompressedImage* image;
+    uint32_t level;
+    uint32_t width, height;
+    uint32_t blocksWide;
+    uint32_t bytesPerBlock;
+    uint8_t* rgba;
+} DecodeJob;
+
+/** One job decodes one row of blocks. */
+static void decodeBlockRowJob(void* userData, uint32_t blockRow)
+{
+    DecodeJob* job = userData;
+    const uint8_t* blocks = job->image->levels[job->level] +
+                            (size_t)blockRow * job->blocksWide * job->bytesPerBlock;
+    uint8_t texels[16][4];
+
+    for (uint32_t bx = 0; bx < job->blocksWide; ++bx) {
+        decodeBlock(job->image, blocks + (size_t)bx * job->bytesPerBlock, texels);
+
+        for (uint32_t y = 0; y < 4; ++y) {
+            uint32_t py = blockRow * 4 + y;
+            if (py >= job->height) break;
+            uint32_t columns = job->width - bx * 4 < 4 ? job->width - bx * 4 : 4;
+            memcpy(job->rgba + ((size_t)py * job->width + bx * 4) * 4, texels[y * 4], columns * 4);
+        }
+    }
+}
+
+/** Does decodeBlock() know the image's blocks? */
+static bool hasCpuDecoder(const CompressedImage* image)
+{
+    uint8_t probe[16][4];
+    static const uint8_t zeroBlock[16] = {0};
+    return decodeBlock(image, zeroBlock, probe);
+}
+
+static const char* compressionFeatureName(WGPUTextureFormat format)
+{
+    switch (format) {
+    case WGPUTextureFormat_ETC2RGB8Unorm:
+    case WGPUTextureFormat_ETC2RGBA8Unorm:
+        return "TextureCompressionETC2";
+    case WGPUTextureFormat_ASTC4x4Unorm:
+        return "TextureCompressionASTC";
+    default:
+        return "TextureCompressionBC";
+    }
+}
+
+bool decodeCompressedLevel(const CompressedImage* image, uint32_t level, uint8_t* rgba)
+{
+    if (level >= image->mipCount || !hasCpuDecoder(image)) {
+        fprintf(stderr, "decodeCompressedLevel: no CPU decoder for format 0x%x\n", (unsigned)image->format);
+        return false;
+    }
+
+    uint32_t blockWidth, blockHeight, bytesPerBlock;
+    textureFormatBlockInfo(image->format, &blockWidth, &blockHeight, &bytesPerBlock);
+
+    DecodeJob job;
+    job.image = image;
+    job.level = level;
+    job.width = image->width >> level ? image->width >> level : 1;
+    job.height = image->height >> level ? image->height >> level : 1;
+    job.blocksWide = (job.width + 3) / 4;
+    job.bytesPerBlock = bytesPerBlock;
+    job.rgba = rgba;
+
+    jobsParallelFor((job.height + 3) / 4, decodeBlockRowJob, &job);
+    return true;
+}
+
+/**
+ * CREATE COMPRESSED TEXTURE
+ */
+WGPUTexture createCompressedTexture(const Context* context,
+                                    const CompressedImage* image,
+                                    const char* label)
+{
+    uint32_t blockWidth, blockHeight, bytesPerBlock;
+    textureFormatBlockInfo(image->format, &blockWidth, &blockHeight, &bytesPerBlock);
+
+    // WebGPU wants a block-aligned level 0 for compressed formats
+    bool supported = isCompressedFormatSupported(context, image->format);
+    bool native = supported && image->width % blockWidth == 0 && image->height % blockHeight == 0;
+
+    // Without native sampling the only way left is the CPU decoder
+    if (!native && !hasCpuDecoder(image)) {
+        if (!supported) {
+            fprintf(stderr, "createCompressedTexture: '%s' needs %s (format 0x%x), which the device lacks, "
+                    "and only BC1-BC5 and ETC1 have a CPU fallback\n",
+                    label ? label : "", compressionFeatureName(image->format), (unsigned)image->format);
+        } else {
+            fprintf(stderr, "createCompressedTexture: '%s' is %ux%u, not a multiple of the %ux%u blocks of "
+                    "format 0x%x, and only BC1-BC5 and ETC1 have a CPU fallback\n",
+                    label ? label : "", image->width, image->height, blockWidth, blockHeight,
+                    (unsigned)image->format);
+        }
+        return NULL;
+    }
+
+    WGPUTextureDescriptor desc = {0};
+    desc.label = label;
+    desc.usage = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst;
+    desc.dimension = WGPUTextureDimension_2D;
+    desc.size.width = image->width;
+    desc.size.height = image->height;
+    desc.size.depthOrArrayLayers = 1;
+    desc.format = native ? image->format
+                         : isSrgbFormat(image->format) ? WGPUTextureFormat_RGBA8UnormSrgb
+                                                       : WGPUTextureFormat_RGBA8Unorm;
+    desc.mipLevelCount = image->mipCount;
+    desc.sampleCount = 1;
+
+    if (!native) {
+        printf("Texture '%s': format 0x%x unsupported by device, decoding to RGBA8\n",
+               label ? label : "", (unsigned)image->format);
+    }
+
+    uint8_t* scratch = NULL;
+    if (!native) {
+        scratch = malloc((size_t)image->width * image->height * 4);
+        if (!scratch) {
+            fprintf(stderr, "createCompressedTexture: out of memory\n");
+            return NULL;
+        }
+    }
+
+    WGPUTexture texture = wgpuDeviceCreateTexture(context->device, &desc);
+    if (!texture) {
+        free(scratch);
+        return NULL;
+    }
+
+    for (uint32_t level = 0; level < image->mipCount; ++level) {
+        uint32_t w = image->width >> level ? image->width >> level : 1;
+        uint32_t h = image->height >> level ? image->height >> level : 1;
+
+        WGPUImageCopyTexture destination = {0};
+        destination.texture = texture;
+        destination.mipLevel = level;
+        destination.aspect = WGPUTextureAspect_All;
+
+        WGPUTextureDataLayout layout = {0};
+        WGPUExtent3D extent = { w, h, 1 };
+        const void* data = image->levels[level];
+        size_t size = image->levelSizes[level];
+
+        if (native) {
+            uint32_t blocksWide = (w + blockWidth - 1) / blockWidth;
+            uint32_t blocksHigh = (h + blockHeight - 1) / blockHeight;
+            layout.bytesPerRow = blocksWide * bytesPerBlock;
+            layout.rowsPerImage = blocksHigh;
+            extent.width = blocksWide * blockWidth;
+            extent.height = blocksHigh * blockHeight;
+        } else {
+            if (!decodeCompressedLevel(image, level, scratch)) {
+                wgpuTextureDestroy(texture);
+                wgpuTextureRelease(texture);
+                free(scratch);
+                return NULL;
+            }
+            layout.bytesPerRow = w * 4;
+            layout.rowsPerImage = h;
+            data = scratch;
+            size = (size_t)w * h * 4;
+        }
+
+        wgpuQueueWriteTexture(context->queue, &destination, data, size, &layout, &extent);
+    }
+
+    free(scratch);
+    return texture;
+}
+
+const void* compressedImageMipSource(void* userData, uint32_t mipLevel, size_t* size)
+{
+    const CompressedImage* image = userData;
+    if (mipLevel >= image->mipCount) return NULL;
+    *size = image->levelSizes[mipLevel];
+    return image->levels[mipLevel];
+}
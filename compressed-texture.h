@@ -0,0 +1,75 @@
+#ifndef COMPRESSED_TEXTURE_H
+#define COMPRESSED_TEXTURE_H
+
+#include "global.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * COMPRESSED TEXTURES
+ *
+ * Pre-compressed (block-compressed) images are loaded from DDS and KTX
+ * files as-is and uploaded without touching the blocks when the device
+ * negotiated the matching compression feature. On adapters without it, the
+ * blocks are decoded to RGBA8 on the CPU, spread over the job system.
+ *
+ * ETC1 (in KTX files) is the universal intermediate: every ETC1 block is a
+ * valid ETC2 RGB8 block, so ETC2 devices (mobile) sample it as-is, and
+ * everything else gets it decoded with SSE2 lanes. It is opaque RGB only.
+ *
+ * Supported: BC1, BC2, BC3, BC4, BC5 and ETC1 (decode + upload), BC7 and
+ * ETC2 RGB8 (upload only: there is no CPU fallback for them).
+ */
+
+#define kCompressedImageMaxLevels 16
+
+/**
+ * A parsed image. Level pointers point into the buffer given to
+ * loadDDS() or loadKTX(), which must outlive the image.
+ */
+typedef struct {
+    WGPUTextureFormat format;
+    bool etc1;                  // ETC2 RGB8 blocks limited to ETC1, which the CPU decodes
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    const uint8_t* levels[kCompressedImageMaxLevels];
+    size_t levelSizes[kCompressedImageMaxLevels];
+} CompressedImage;
+
+/** Parse a DDS file in memory (legacy FourCC or DX10 header). */
+bool loadDDS(const void* data, size_t size, CompressedImage* image);
+
+/** Parse a KTX 1.1 file in memory holding ETC1 or ETC2 RGB8 blocks. */
+bool loadKTX(const void* data, size_t size, CompressedImage* image);
+
+/** Does the device negotiated in `context` sample this format natively? */
+bool isCompressedFormatSupported(const Context* context, WGPUTextureFormat format);
+
+/**
+ * Decode one level to tightly packed RGBA8 (width * height * 4 bytes).
+ * Block rows are decoded in parallel on the job system.
+ */
+bool decodeCompressedLevel(const CompressedImage* image, uint32_t level, uint8_t* rgba);
+
+/**
+ * Create a sampled texture with every level of the image, either as the
+ * native compressed format or, when unsupported, as RGBA8 (sRGB preserved).
+ * NULL, with a message, for an unsupported format without a CPU decoder
+ * (BC7, ETC2 beyond ETC1, ASTC).
+ */
+WGPUTexture createCompressedTexture(const Context* context,
+                                    const CompressedImage* image,
+                                    const char* label);
+
+/**
+ * TextureMipSource for the texture streamer, with userData pointing at a
+ * CompressedImage whose format is natively supported.
+ */
+const void* compressedImageMipSource(void* userData, uint32_t mipLevel, size_t* size);
+
+#endif // COMPRESSED_TEXTURE_H
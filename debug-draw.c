@@ -0,0 +1,415 @@
+#include "debug-draw.h"
+#include "webgpu-utils.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define kSphereSegments 32
+
+static const char* kDebugDrawWGSL =
+"@group(0) @binding(0) var<uniform> viewProj: mat4x4f;\n"
+"\n"
+"struct VertexOutput {\n"
+"    @builtin(position) position: vec4f,\n"
+"    @location(0) color: vec4f,\n"
+"}\n"
+"\n"
+"@vertex\n"
+"fn vs_main(@location(0) position: vec3f, @location(1) color: vec4f) -> VertexOutput {\n"
+"    var out: VertexOutput;\n"
+"    out.position = viewProj * vec4f(position, 1.0);\n"
+"    out.color = color;\n"
+"    return out;\n"
+"}\n"
+"\n"
+"@fragment\n"
+"fn fs_main(in: VertexOutput) -> @location(0) vec4f {\n"
+"    return in.color;\n"
+"}\n";
+
+static WGPURenderPipeline createDebugPipeline(WGPUDevice device,
+                                              WGPUShaderModule module,
+                                              WGPUPipelineLayout layout,
+                                              WGPUTextureFormat colorFormat,
+                                              WGPUTextureFormat depthFormat,
+                                              uint32_t sampleCount,
+                                              DebugDrawMode mode)
+{
+    WGPUVertexAttribute attributes[2] = {
+        { WGPUVertexFormat_Float32x3, offsetof(DebugVertex, position), 0 },
+        { WGPUVertexFormat_Unorm8x4, offsetof(DebugVertex, color), 1 },
+    };
+    WGPUVertexBufferLayout vertexLayout = {0};
+    vertexLayout.arrayStride = sizeof(DebugVertex);
+    vertexLayout.stepMode = WGPUVertexStepMode_Vertex;
+    vertexLayout.attributeCount = 2;
+    vertexLayout.attributes = attributes;
+
+    WGPUBlendState blend = {0};
+    blend.color.operation = WGPUBlendOperation_Add;
+    blend.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+    blend.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    blend.alpha.operation = WGPUBlendOperation_Add;
+    blend.alpha.srcFactor = WGPUBlendFactor_One;
+    blend.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+
+    WGPUColorTargetState colorTarget = {0};
+    colorTarget.format = colorFormat;
+    colorTarget.blend = &blend;
+    colorTarget.writeMask = WGPUColorWriteMask_All;
+
+    WGPUFragmentState fragment = {0};
+    fragment.module = module;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &colorTarget;
+
+    // Lines never write depth; the overlay ignores it but must still
+    // declare the attachment to be usable in the same pass
+    WGPUDepthStencilState depthStencil = {0};
+    depthStencil.format = depthFormat;
+    depthStencil.depthWriteEnabled = false;
+    depthStencil.depthCompare = mode == DebugDraw_DepthTest ? WGPUCompareFunction_LessEqual
+                                                            : WGPUCompareFunction_Always;
+    depthStencil.stencilFront.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilBack.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilReadMask = 0;
+    depthStencil.stencilWriteMask = 0;
+
+    WGPURenderPipelineDescriptor desc = {0};
+    desc.label = mode == DebugDraw_DepthTest ? "Debug draw pipeline" : "Debug draw overlay pipeline";
+    desc.layout = layout;
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.vertex.bufferCount = 1;
+    desc.vertex.buffers = &vertexLayout;
+    desc.primitive.topology = WGPUPrimitiveTopology_LineList;
+    desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
+    desc.primitive.frontFace = WGPUFrontFace_CCW;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.depthStencil = depthFormat != WGPUTextureFormat_Undefined ? &depthStencil : NULL;
+    desc.multisample.count = sampleCount > 1 ? sampleCount : 1;
+    desc.multisample.mask = ~0u;
+    desc.multisample.alphaToCoverageEnabled = false;
+    desc.fragment = &fragment;
+
+    WGPURenderPipeline pipeline = wgpuDeviceCreateRenderPipeline(device, &desc);
+    if (!pipeline) {
+        fprintf(stderr, "Failed to create %s\n", desc.label);
+    }
+    return pipeline;
+}
+
+bool createDebugDraw(DebugDraw* debug,
+                     WGPUDevice device,
+                     WGPUQueue queue,
+                     WGPUTextureFormat colorFormat,
+                     WGPUTextureFormat depthFormat,
+                     uint32_t sampleCount)
+{
+    memset(debug, 0, sizeof *debug);
+    debug->device = device;
+    debug->queue = queue;
+
+    debug->mutex = SDL_CreateMutex();
+    if (!debug->mutex) {
+        fprintf(stderr, "createDebugDraw: %s\n", SDL_GetError());
+        return false;
+    }
+
+    // Both pipelines share one bind group, so the layout is explicit:
+    // automatic layouts of different pipelines are never compatible
+    WGPUBindGroupLayoutEntry layoutEntry = {0};
+    layoutEntry.binding = 0;
+    layoutEntry.visibility = WGPUShaderStage_Vertex;
+    layoutEntry.buffer.type = WGPUBufferBindingType_Uniform;
+    layoutEntry.buffer.minBindingSize = sizeof(Mat4);
+
+    WGPUBindGroupLayoutDescriptor layoutDesc = {0};
+    layoutDesc.label = "Debug draw bind group layout";
+    layoutDesc.entryCount = 1;
+    layoutDesc.entries = &layoutEntry;
+    debug->bindGroupLayout = wgpuDeviceCreateBindGroupLayout(device, &layoutDesc);
+
+    WGPUPipelineLayoutDescriptor pipelineLayoutDesc = {0};
+    pipelineLayoutDesc.label = "Debug draw pipeline layout";
+    pipelineLayoutDesc.bindGroupLayoutCount = 1;
+    pipelineLayoutDesc.bindGroupLayouts = &debug->bindGroupLayout;
+    WGPUPipelineLayout pipelineLayout = wgpuDeviceCreatePipelineLayout(device, &pipelineLayoutDesc);
+
+    WGPUShaderModule module = createShaderModule(device, "Debug draw shader", kDebugDrawWGSL);
+    if (!module || !pipelineLayout) {
+        if (module) wgpuShaderModuleRelease(module);
+        if (pipelineLayout) wgpuPipelineLayoutRelease(pipelineLayout);
+        releaseDebugDraw(debug);
+        return false;
+    }
+    for (int mode = 0; mode < DebugDraw_ModeCount; ++mode) {
+        debug->pipelines[mode] = createDebugPipeline(device, module, pipelineLayout, colorFormat,
+                                                     depthFormat, sampleCount, (DebugDrawMode)mode);
+    }
+    wgpuShaderModuleRelease(module);
+    wgpuPipelineLayoutRelease(pipelineLayout);
+
+    debug->uniformBuffer = createBuffer(device, "Debug draw uniforms", sizeof(Mat4),
+                                        WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    if (!debug->pipelines[DebugDraw_DepthTest] || !debug->pipelines[DebugDraw_Overlay] ||
+        !debug->uniformBuffer) {
+        releaseDebugDraw(debug);
+        return false;
+    }
+
+    WGPUBindGroupEntry entry = {0};
+    entry.binding = 0;
+    entry.buffer = debug->uniformBuffer;
+    entry.offset = 0;
+    entry.size = sizeof(Mat4);
+
+    WGPUBindGroupDescriptor bindGroupDesc = {0};
+    bindGroupDesc.label = "Debug draw bind group";
+    bindGroupDesc.layout = debug->bindGroupLayout;
+    bindGroupDesc.entryCount = 1;
+    bindGroupDesc.entries = &entry;
+    debug->bindGroup = wgpuDeviceCreateBindGroup(device, &bindGroupDesc);
+
+    if (!debug->bindGroup) {
+        releaseDebugDraw(debug);
+        return false;
+    }
+    return true;
+}
+
+void releaseDebugDraw(DebugDraw* debug)
+{
+    if (debug->bindGroup) wgpuBindGroupRelease(debug->bindGroup);
+    if (debug->bindGroupLayout) wgpuBindGroupLayoutRelease(debug->bindGroupLayout);
+    for (int mode = 0; mode < DebugDraw_ModeCount; ++mode) {
+        if (debug->pipelines[mode]) wgpuRenderPipelineRelease(debug->pipelines[mode]);
+    }
+
+    WGPUBuffer buffers[] = { debug->uniformBuffer, debug->vertexBuffer };
+    for (size_t i = 0; i < sizeof buffers / sizeof buffers[0]; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+
+    // Other threads' TLS slots still point at the freed buffers. Resetting
+    // `threadBuffer` below means a new DebugDraw gets a new TLS id and
+    // never looks at them.
+    while (debug->threads) {
+        DebugDrawThread* thread = debug->threads;
+        debug->threads = thread->next;
+        for (int mode = 0; mode < DebugDraw_ModeCount; ++mode) free(thread->vertices[mode]);
+        free(thread);
+    }
+    if (debug->mutex) SDL_DestroyMutex(debug->mutex);
+    memset(debug, 0, sizeof *debug);
+}
+
+/** This thread's buffers, registered on its first primitive. */
+static DebugDrawThread* getThreadBuffer(DebugDraw* debug)
+{
+    DebugDrawThread* thread = SDL_GetTLS(&debug->threadBuffer);
+    if (thread) return thread;
+
+    thread = calloc(1, sizeof *thread);
+    if (!thread) return NULL;
+    if (!SDL_SetTLS(&debug->threadBuffer, thread, NULL)) {
+        free(thread);
+        return NULL;
+    }
+    SDL_LockMutex(debug->mutex);
+    thread->next = debug->threads;
+    debug->threads = thread;
+    SDL_UnlockMutex(debug->mutex);
+    return thread;
+}
+
+/** Room for `count` more vertices in this thread's buffer for `mode`. */
+static DebugVertex* appendVertices(DebugDraw* debug, DebugDrawMode mode, uint32_t count)
+{
+    DebugDrawThread* thread = getThreadBuffer(debug);
+    if (!thread) return NULL;
+
+    if (thread->count[mode] + count > thread->capacity[mode]) {
+        uint32_t capacity = thread->capacity[mode] ? thread->capacity[mode] : 4096;
+        while (capacity < thread->count[mode] + count) capacity *= 2;
+
+        DebugVertex* vertices = realloc(thread->vertices[mode], (size_t)capacity * sizeof *vertices);
+        if (!vertices) {
+            fprintf(stderr, "debugDraw: out of memory\n");
+            return NULL;
+        }
+        thread->vertices[mode] = vertices;
+        thread->capacity[mode] = capacity;
+    }
+    DebugVertex* out = thread->vertices[mode] + thread->count[mode];
+    thread->count[mode] += count;
+    return out;
+}
+
+static inline void setVertex(DebugVertex* vertex, Vec3 p, uint32_t color)
+{
+    vertex->position[0] = p.x;
+    vertex->position[1] = p.y;
+    vertex->position[2] = p.z;
+    vertex->color = color;
+}
+
+/** The 12 edges of a box given by its corners, bit i of the index picking axis i. */
+static void appendBoxEdges(DebugVertex* out, const Vec3 corners[8], uint32_t color)
+{
+    static const uint8_t kEdges[12][2] = {
+        {0, 1}, {2, 3}, {4, 5}, {6, 7},     // along x
+        {0, 2}, {1, 3}, {4, 6}, {5, 7},     // along y
+        {0, 4}, {1, 5}, {2, 6}, {3, 7},     // along z
+    };
+    for (int e = 0; e < 12; ++e) {
+        setVertex(out++, corners[kEdges[e][0]], color);
+        setVertex(out++, corners[kEdges[e][1]], color);
+    }
+}
+
+void debugLine(DebugDraw* debug, Vec3 a, Vec3 b, uint32_t color, DebugDrawMode mode)
+{
+    DebugVertex* out = appendVertices(debug, mode, 2);
+    if (!out) return;
+    setVertex(&out[0], a, color);
+    setVertex(&out[1], b, color);
+}
+
+void debugAabb(DebugDraw* debug, Vec3 min, Vec3 max, uint32_t color, DebugDrawMode mode)
+{
+    DebugVertex* out = appendVertices(debug, mode, 24);
+    if (!out) return;
+
+    Vec3 corners[8];
+    for (int i = 0; i < 8; ++i) {
+        corners[i] = vec3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z);
+    }
+    appendBoxEdges(out, corners, color);
+}
+
+void debugSphere(DebugDraw* debug, Vec3 center, float radius, uint32_t color, DebugDrawMode mode)
+{
+    // One circle in each of the XY, YZ and ZX planes
+    DebugVertex* out = appendVertices(debug, mode, 3 * kSphereSegments * 2);
+    if (!out) return;
+
+    float cosines[kSphereSegments + 1];
+    float sines[kSphereSegments + 1];
+    for (int i = 0; i <= kSphereSegments; ++i) {
+        float angle = 2.0f * 3.14159265f * i / kSphereSegments;
+        cosines[i] = cosf(angle) * radius;
+        sines[i] = sinf(angle) * radius;
+    }
+    for (int i = 0; i < kSphereSegments; ++i) {
+        float c0 = cosines[i], s0 = sines[i];
+        float c1 = cosines[i + 1], s1 = sines[i + 1];
+        setVertex(out++, vec3Add(center, vec3(c0, s0, 0.0f)), color);
+        setVertex(out++, vec3Add(center, vec3(c1, s1, 0.0f)), color);
+        setVertex(out++, vec3Add(center, vec3(0.0f, c0, s0)), color);
+        setVertex(out++, vec3Add(center, vec3(0.0f, c1, s1)), color);
+        setVertex(out++, vec3Add(center, vec3(s0, 0.0f, c0)), color);
+        setVertex(out++, vec3Add(center, vec3(s1, 0.0f, c1)), color);
+    }
+}
+
+void debugFrustum(DebugDraw* debug, Mat4 viewProj, uint32_t color, DebugDrawMode mode)
+{
+    DebugVertex* out = appendVertices(debug, mode, 24);
+    if (!out) return;
+
+    // Unproject the corners of the clip volume (depth in [0, 1])
+    Mat4 inverse = mat4Inverse(viewProj);
+    Vec3 corners[8];
+    for (int i = 0; i < 8; ++i) {
+        Vec3 clip = vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : 0.0f);
+        corners[i] = mat4TransformProject(inverse, clip);
+    }
+    appendBoxEdges(out, corners, color);
+}
+
+void debugAxis(DebugDraw* debug, Mat4 transform, float size, DebugDrawMode mode)
+{
+    DebugVertex* out = appendVertices(debug, mode, 6);
+    if (!out) return;
+
+    Vec3 origin = vec3(transform.m[12], transform.m[13], transform.m[14]);
+    const uint32_t colors[3] = {
+        debugColor(255, 0, 0, 255), debugColor(0, 255, 0, 255), debugColor(0, 0, 255, 255),
+    };
+    for (int axis = 0; axis < 3; ++axis) {
+        Vec3 direction = vec3FromArray(&transform.m[axis * 4]);
+        setVertex(out++, origin, colors[axis]);
+        setVertex(out++, vec3Add(origin, vec3Scale(direction, size)), colors[axis]);
+    }
+}
+
+void debugDrawUpload(DebugDraw* debug, Mat4 viewProj)
+{
+    wgpuQueueWriteBuffer(debug->queue, debug->uniformBuffer, 0, viewProj.m, sizeof viewProj.m);
+
+    uint32_t total[DebugDraw_ModeCount] = {0};
+    for (DebugDrawThread* thread = debug->threads; thread; thread = thread->next) {
+        for (int mode = 0; mode < DebugDraw_ModeCount; ++mode) total[mode] += thread->count[mode];
+    }
+    uint32_t vertexCount = total[DebugDraw_DepthTest] + total[DebugDraw_Overlay];
+
+    memset(debug->drawCount, 0, sizeof debug->drawCount);
+    if (vertexCount > debug->vertexBufferCapacity) {
+        if (debug->vertexBuffer) {
+            wgpuBufferDestroy(debug->vertexBuffer);
+            wgpuBufferRelease(debug->vertexBuffer);
+        }
+        uint32_t capacity = debug->vertexBufferCapacity ? debug->vertexBufferCapacity : 16384;
+        while (capacity < vertexCount) capacity *= 2;
+        debug->vertexBuffer = createBuffer(debug->device, "Debug draw vertices",
+                                           (uint64_t)capacity * sizeof(DebugVertex),
+                                           WGPUBufferUsage_Vertex | WGPUBufferUsage_CopyDst);
+        debug->vertexBufferCapacity = debug->vertexBuffer ? capacity : 0;
+    }
+
+    // Every thread's chunk is written straight to its place in the stream
+    // (no CPU-side merge copy); depth-tested vertices come first
+    if (debug->vertexBuffer) {
+        uint64_t offset[DebugDraw_ModeCount] = { 0, (uint64_t)total[DebugDraw_DepthTest] * sizeof(DebugVertex) };
+        for (DebugDrawThread* thread = debug->threads; thread; thread = thread->next) {
+            for (int mode = 0; mode < DebugDraw_ModeCount; ++mode) {
+                size_t size = (size_t)thread->count[mode] * sizeof(DebugVertex);
+                if (size == 0) continue;
+                wgpuQueueWriteBuffer(debug->queue, debug->vertexBuffer, offset[mode],
+                                     thread->vertices[mode], size);
+                offset[mode] += size;
+            }
+        }
+        memcpy(debug->drawCount, total, sizeof total);
+    }
+
+    for (DebugDrawThread* thread = debug->threads; thread; thread = thread->next) {
+        memset(thread->count, 0, sizeof thread->count);
+    }
+}
+
+void debugDrawRender(DebugDraw* debug, WGPURenderPassEncoder pass)
+{
+    uint32_t depthCount = debug->drawCount[DebugDraw_DepthTest];
+    uint32_t overlayCount = debug->drawCount[DebugDraw_Overlay];
+    if (depthCount + overlayCount == 0) return;
+
+    wgpuRenderPassEncoderSetBindGroup(pass, 0, debug->bindGroup, 0, NULL);
+    wgpuRenderPassEncoderSetVertexBuffer(pass, 0, debug->vertexBuffer, 0,
+                                         (uint64_t)(depthCount + overlayCount) * sizeof(DebugVertex));
+    if (depthCount > 0) {
+        wgpuRenderPassEncoderSetPipeline(pass, debug->pipelines[DebugDraw_DepthTest]);
+        wgpuRenderPassEncoderDraw(pass, depthCount, 1, 0, 0);
+    }
+    if (overlayCount > 0) {
+        wgpuRenderPassEncoderSetPipeline(pass, debug->pipelines[DebugDraw_Overlay]);
+        wgpuRenderPassEncoderDraw(pass, overlayCount, 1, depthCount, 0);
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef DEBUG_DRAW_H
+#define DEBUG_DRAW_H
+
+#include "linalg.h"
+
+#include <webgpu/webgpu.h>
+#include <SDL3/SDL.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * DEBUG DRAW
+ *
+ * Immediate-mode lines, boxes, spheres, frusta and axes for debugging
+ * culling, BVHs and the like. Every primitive is expanded into line-list
+ * vertices on the calling thread, into a buffer owned by that thread (found
+ * through SDL thread-local storage), so jobs can draw without any locking.
+ *
+ * debugDrawUpload() merges every thread's vertices into one vertex stream,
+ * depth-tested lines first and overlay lines after them, and
+ * debugDrawRender() draws the stream with two draws: one with depth
+ * testing and one on top of everything. It must run while no other thread
+ * is drawing, e.g. between frames once the jobs are done.
+ */
+
+typedef enum {
+    DebugDraw_DepthTest,        // hidden behind scene geometry
+    DebugDraw_Overlay,          // always visible
+    DebugDraw_ModeCount,
+} DebugDrawMode;
+
+/** One line endpoint. Must match the vertex layout in debug-draw.c. */
+typedef struct {
+    float position[3];
+    uint32_t color;             // RGBA8, see debugColor()
+} DebugVertex;
+
+typedef struct DebugDrawThread {
+    DebugVertex* vertices[DebugDraw_ModeCount];
+    uint32_t count[DebugDraw_ModeCount];
+    uint32_t capacity[DebugDraw_ModeCount];
+    struct DebugDrawThread* next;
+} DebugDrawThread;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+
+    WGPURenderPipeline pipelines[DebugDraw_ModeCount];
+    WGPUBindGroupLayout bindGroupLayout;
+    WGPUBuffer uniformBuffer;   // view-projection matrix
+    WGPUBindGroup bindGroup;
+
+    WGPUBuffer vertexBuffer;
+    uint32_t vertexBufferCapacity;
+    uint32_t drawCount[DebugDraw_ModeCount];   // vertices uploaded for drawing
+
+    SDL_TLSID threadBuffer;     // this thread's DebugDrawThread
+    SDL_Mutex* mutex;           // guards the list below
+    DebugDrawThread* threads;
+} DebugDraw;
+
+/** Pack a color for the debug primitives. */
+static inline uint32_t debugColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    return (uint32_t)r | (uint32_t)g << 8 | (uint32_t)b << 16 | (uint32_t)a << 24;
+}
+
+/**
+ * `depthFormat` is the depth attachment of the pass the lines are drawn
+ * in; with WGPUTextureFormat_Undefined (no depth attachment) both modes
+ * draw on top. `sampleCount` is the pass's, see msaa.h.
+ */
+bool createDebugDraw(DebugDraw* debug,
+                     WGPUDevice device,
+                     WGPUQueue queue,
+                     WGPUTextureFormat colorFormat,
+                     WGPUTextureFormat depthFormat,
+                     uint32_t sampleCount);
+
+void releaseDebugDraw(DebugDraw* debug);
+
+// Callable from any thread
+void debugLine(DebugDraw* debug, Vec3 a, Vec3 b, uint32_t color, DebugDrawMode mode);
+void debugAabb(DebugDraw* debug, Vec3 min, Vec3 max, uint32_t color, DebugDrawMode mode);
+void debugSphere(DebugDraw* debug, Vec3 center, float radius, uint32_t color, DebugDrawMode mode);
+/** Outline of the volume a view-projection matrix sees. */
+void debugFrustum(DebugDraw* debug, Mat4 viewProj, uint32_t color, DebugDrawMode mode);
+/** X, Y and Z axes of `transform` in red, green and blue. */
+void debugAxis(DebugDraw* debug, Mat4 transform, float size, DebugDrawMode mode);
+
+/** Merge and upload every thread's primitives, then start the next frame. */
+void debugDrawUpload(DebugDraw* debug, Mat4 viewProj);
+
+/** Draw everything uploaded by the last debugDrawUpload(). */
+void debugDrawRender(DebugDraw* debug, WGPURenderPassEncoder pass);
+
+#endif // DEBUG_DRAW_H
@@ -0,0 +1,287 @@
+#include "dynamic-resolution.h"
+#include "webgpu-utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Aim this far under the budget when scaling down, to leave some slack. */
+#define kResolutionDownMargin 0.95f
+
+static const char* kUpscaleWGSL =
+"@group(0) @binding(0) var source: texture_2d<f32>;\n"
+"@group(0) @binding(1) var sourceSampler: sampler;\n"
+"\n"
+"struct VertexOutput {\n"
+"    @builtin(position) position: vec4f,\n"
+"    @location(0) uv: vec2f,\n"
+"}\n"
+"\n"
+"// One triangle covering the whole target\n"
+"@vertex\n"
+"fn vs_main(@builtin(vertex_index) vertex: u32) -> VertexOutput {\n"
+"    let corner = vec2f(f32((vertex << 1u) & 2u), f32(vertex & 2u));\n"
+"    var out: VertexOutput;\n"
+"    out.position = vec4f(corner * vec2f(2.0, -2.0) + vec2f(-1.0, 1.0), 0.0, 1.0);\n"
+"    out.uv = corner;\n"
+"    return out;\n"
+"}\n"
+"\n"
+"fn tap(uv: vec2f) -> vec4f {\n"
+"    return textureSampleLevel(source, sourceSampler, uv, 0.0);\n"
+"}\n"
+"\n"
+"// Catmull-Rom over 4x4 texels. The two middle weights of each axis are\n"
+"// positive, so those texels are fetched together with one bilinear tap.\n"
+"@fragment\n"
+"fn fs_main(in: VertexOutput) -> @location(0) vec4f {\n"
+"    let size = vec2f(textureDimensions(source));\n"
+"    let position = in.uv * size;\n"
+"    let center = floor(position - 0.5) + 0.5;\n"
+"    let f = position - center;\n"
+"\n"
+"    let w0 = f * (-0.5 + f * (1.0 - 0.5 * f));\n"
+"    let w1 = 1.0 + f * f * (-2.5 + 1.5 * f);\n"
+"    let w2 = f * (0.5 + f * (2.0 - 1.5 * f));\n"
+"    let w3 = f * f * (-0.5 + 0.5 * f);\n"
+"    let w12 = w1 + w2;\n"
+"\n"
+"    let uv0 = (center - 1.0) / size;\n"
+"    let uv12 = (center + w2 / w12) / size;\n"
+"    let uv3 = (center + 2.0) / size;\n"
+"\n"
+"    var color = tap(vec2f(uv0.x, uv0.y)) * w0.x * w0.y;\n"
+"    color += tap(vec2f(uv12.x, uv0.y)) * w12.x * w0.y;\n"
+"    color += tap(vec2f(uv3.x, uv0.y)) * w3.x * w0.y;\n"
+"    color += tap(vec2f(uv0.x, uv12.y)) * w0.x * w12.y;\n"
+"    color += tap(vec2f(uv12.x, uv12.y)) * w12.x * w12.y;\n"
+"    color += tap(vec2f(uv3.x, uv12.y)) * w3.x * w12.y;\n"
+"    color += tap(vec2f(uv0.x, uv3.y)) * w0.x * w3.y;\n"
+"    color += tap(vec2f(uv12.x, uv3.y)) * w12.x * w3.y;\n"
+"    color += tap(vec2f(uv3.x, uv3.y)) * w3.x * w3.y;\n"
+"    // The negative lobes can ring below zero next to sharp edges\n"
+"    return max(color, vec4f(0.0));\n"
+"}\n";
+
+DynamicResolutionSettings defaultResolutionSettings(void)
+{
+    DynamicResolutionSettings settings;
+    settings.targetMilliseconds = 1000.0f / 60.0f;
+    settings.minScale = 0.5f;
+    settings.maxScale = 1.0f;
+    settings.scaleStep = 0.05f;
+    settings.upThreshold = 0.85f;
+    settings.upFrames = 30;
+    settings.downFrames = 2;
+    return settings;
+}
+
+static WGPURenderPipeline createUpscalePipeline(WGPUDevice device, WGPUTextureFormat outputFormat)
+{
+    WGPUShaderModule module = createShaderModule(device, "Upscale shader", kUpscaleWGSL);
+    if (!module) return NULL;
+
+    WGPUColorTargetState colorTarget = {0};
+    colorTarget.format = outputFormat;
+    colorTarget.blend = NULL;
+    colorTarget.writeMask = WGPUColorWriteMask_All;
+
+    WGPUFragmentState fragment = {0};
+    fragment.module = module;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &colorTarget;
+
+    WGPURenderPipelineDescriptor desc = {0};
+    desc.label = "Upscale pipeline";
+    desc.layout = NULL; // auto layout
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.vertex.bufferCount = 0;
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
+    desc.primitive.frontFace = WGPUFrontFace_CCW;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.depthStencil = NULL;
+    desc.multisample.count = 1;
+    desc.multisample.mask = ~0u;
+    desc.multisample.alphaToCoverageEnabled = false;
+    desc.fragment = &fragment;
+
+    WGPURenderPipeline pipeline = wgpuDeviceCreateRenderPipeline(device, &desc);
+    wgpuShaderModuleRelease(module);
+    if (!pipeline) {
+        fprintf(stderr, "Failed to create upscale pipeline\n");
+    }
+    return pipeline;
+}
+
+static void applyScale(DynamicResolution* resolution, float scale)
+{
+    const DynamicResolutionSettings* settings = &resolution->settings;
+    scale = roundf(scale / settings->scaleStep) * settings->scaleStep;
+    if (scale < settings->minScale) scale = settings->minScale;
+    if (scale > settings->maxScale) scale = settings->maxScale;
+
+    resolution->scale = scale;
+    resolution->renderWidth = (uint32_t)(resolution->outputWidth * scale + 0.5f);
+    resolution->renderHeight = (uint32_t)(resolution->outputHeight * scale + 0.5f);
+    if (resolution->renderWidth == 0) resolution->renderWidth = 1;
+    if (resolution->renderHeight == 0) resolution->renderHeight = 1;
+}
+
+bool createDynamicResolution(DynamicResolution* resolution,
+                             WGPUDevice device,
+                             Profiler* profiler,
+                             WGPUTextureFormat outputFormat,
+                             const DynamicResolutionSettings* settings)
+{
+    memset(resolution, 0, sizeof *resolution);
+    resolution->device = device;
+    resolution->profiler = profiler;
+    resolution->settings = settings ? *settings : defaultResolutionSettings();
+    resolution->lastGpuFrame = profiler->gpuFrameCount;
+
+    WGPUSamplerDescriptor samplerDesc = {0};
+    samplerDesc.label = "Upscale sampler";
+    samplerDesc.addressModeU = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeV = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeW = WGPUAddressMode_ClampToEdge;
+    samplerDesc.magFilter = WGPUFilterMode_Linear;
+    samplerDesc.minFilter = WGPUFilterMode_Linear;
+    samplerDesc.mipmapFilter = WGPUMipmapFilterMode_Nearest;
+    samplerDesc.lodMinClamp = 0.0f;
+    samplerDesc.lodMaxClamp = 1.0f;
+    samplerDesc.maxAnisotropy = 1;
+    resolution->sampler = wgpuDeviceCreateSampler(device, &samplerDesc);
+    resolution->upscalePipeline = createUpscalePipeline(device, outputFormat);
+    if (!resolution->sampler || !resolution->upscalePipeline) {
+        releaseDynamicResolution(resolution);
+        return false;
+    }
+
+    resolutionSetOutputSize(resolution, 1, 1);
+    resolutionSetEnabled(resolution, true);
+    return true;
+}
+
+void releaseDynamicResolution(DynamicResolution* resolution)
+{
+    if (resolution->enabled) profilerWantGpuTiming(resolution->profiler, false);
+    if (resolution->upscalePipeline) wgpuRenderPipelineRelease(resolution->upscalePipeline);
+    if (resolution->sampler) wgpuSamplerRelease(resolution->sampler);
+    memset(resolution, 0, sizeof *resolution);
+}
+
+void resolutionSetEnabled(DynamicResolution* resolution, bool enabled)
+{
+    if (enabled == resolution->enabled) return;
+    resolution->enabled = enabled;
+    profilerWantGpuTiming(resolution->profiler, enabled);
+
+    // Start from full quality either way; an enabled controller scales down within a few frames
+    resolution->overBudgetFrames = 0;
+    resolution->underBudgetFrames = 0;
+    resolution->settleFrames = kProfilerFramesInFlight + 1;
+    resolution->lastGpuFrame = resolution->profiler->gpuFrameCount;
+    applyScale(resolution, resolution->settings.maxScale);
+}
+
+void resolutionSetOutputSize(DynamicResolution* resolution, uint32_t width, uint32_t height)
+{
+    resolution->outputWidth = width;
+    resolution->outputHeight = height;
+    applyScale(resolution, resolution->scale > 0.0f ? resolution->scale : resolution->settings.maxScale);
+}
+
+void resolutionUpdate(DynamicResolution* resolution)
+{
+    const Profiler* profiler = resolution->profiler;
+    const DynamicResolutionSettings* settings = &resolution->settings;
+    if (!resolution->enabled || profiler->gpuFrameCount == resolution->lastGpuFrame) return;
+    resolution->lastGpuFrame = profiler->gpuFrameCount;
+
+    // Frames still in flight at the last change may have rendered at the old scale
+    if (resolution->settleFrames > 0) {
+        resolution->settleFrames--;
+        return;
+    }
+
+    float measured = (float)profiler->gpuFrameMilliseconds;
+    float target = settings->targetMilliseconds;
+    if (measured <= 0.0f) return;
+
+    float scale = resolution->scale;
+    float newScale = scale;
+    if (measured > target) {
+        resolution->underBudgetFrames = 0;
+        if (++resolution->overBudgetFrames >= settings->downFrames) {
+            // Cost ~ pixels ~ scale^2; always at least one step down
+            float fit = scale * sqrtf(target * kResolutionDownMargin / measured);
+            newScale = fminf(fit, scale - settings->scaleStep);
+            newScale = floorf(newScale / settings->scaleStep + 0.01f) * settings->scaleStep;
+        }
+    } else {
+        resolution->overBudgetFrames = 0;
+        float up = scale + settings->scaleStep;
+        float predicted = measured * (up * up) / (scale * scale);
+        if (scale < settings->maxScale && predicted < target * settings->upThreshold) {
+            if (++resolution->underBudgetFrames >= settings->upFrames) newScale = up;
+        } else {
+            resolution->underBudgetFrames = 0;
+        }
+    }
+
+    applyScale(resolution, newScale);
+    if (resolution->scale != scale) {
+        resolution->overBudgetFrames = 0;
+        resolution->underBudgetFrames = 0;
+        resolution->settleFrames = kProfilerFramesInFlight + 1;
+    }
+}
+
+void resolutionUpscale(DynamicResolution* resolution,
+                       WGPUCommandEncoder encoder,
+                       WGPUTextureView source,
+                       WGPUTextureView target,
+                       const WGPURenderPassTimestampWrites* timestamps)
+{
+    // The source comes from the texture pool and changes with the scale, so
+    // the bind group is made for this pass only
+    WGPUBindGroupEntry entries[2] = {0};
+    entries[0].binding = 0;
+    entries[0].textureView = source;
+    entries[1].binding = 1;
+    entries[1].sampler = resolution->sampler;
+
+    WGPUBindGroupLayout layout = wgpuRenderPipelineGetBindGroupLayout(resolution->upscalePipeline, 0);
+    WGPUBindGroupDescriptor bindGroupDesc = {0};
+    bindGroupDesc.label = "Upscale bind group";
+    bindGroupDesc.layout = layout;
+    bindGroupDesc.entryCount = 2;
+    bindGroupDesc.entries = entries;
+    WGPUBindGroup bindGroup = wgpuDeviceCreateBindGroup(resolution->device, &bindGroupDesc);
+    wgpuBindGroupLayoutRelease(layout);
+
+    WGPURenderPassColorAttachment colorAttachment = {0};
+    colorAttachment.view = target;
+    colorAttachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+    colorAttachment.loadOp = WGPULoadOp_Clear;
+    colorAttachment.storeOp = WGPUStoreOp_Store;
+    colorAttachment.clearValue = (WGPUColor){0.0, 0.0, 0.0, 1.0};
+
+    WGPURenderPassDescriptor passDesc = {0};
+    passDesc.label = "Upscale pass";
+    passDesc.colorAttachmentCount = 1;
+    passDesc.colorAttachments = &colorAttachment;
+    passDesc.timestampWrites = timestamps;
+    WGPURenderPassEncoder pass = wgpuCommandEncoderBeginRenderPass(encoder, &passDesc);
+    if (bindGroup) {
+        wgpuRenderPassEncoderSetPipeline(pass, resolution->upscalePipeline);
+        wgpuRenderPassEncoderSetBindGroup(pass, 0, bindGroup, 0, NULL);
+        wgpuRenderPassEncoderDraw(pass, 3, 1, 0, 0);
+    }
+    wgpuRenderPassEncoderEnd(pass);
+    wgpuRenderPassEncoderRelease(pass);
+    if (bindGroup) wgpuBindGroupRelease(bindGroup);
+}
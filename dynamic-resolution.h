@@ -0,0 +1,100 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include "profiler.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * DYNAMIC RESOLUTION
+ *
+ * Renders the scene at a fraction of the output size, chosen every frame
+ * to hold a GPU frame time, then upscales it to the output.
+ *
+ * The controller reads the per-frame GPU time the profiler collects from
+ * timestamp queries (a few frames late) and assumes the cost scales with
+ * the pixel count, i.e. with scale^2:
+ *  - `downFrames` timed frames in a row over budget scale down right away
+ *    to the scale predicted to fit, so missed deadlines are short-lived
+ *  - scaling up goes one step at a time, and only after `upFrames` frames
+ *    in a row where the next step is predicted to stay under
+ *    `upThreshold` of the budget, so the scale doesn't oscillate
+ *  - after a change, the timings of frames that may still have been
+ *    rendered at the old scale are ignored
+ *
+ * Scales are multiples of `scaleStep` between `minScale` (the quality
+ * floor) and `maxScale`, so the render targets, acquired from the texture
+ * pool at renderWidth x renderHeight, come in a handful of sizes.
+ *
+ * The upscale is a Catmull-Rom (bicubic) filter, done with 9 bilinear taps
+ * instead of 16 point taps; it stays sharp where bilinear would blur.
+ *
+ * Per frame:
+ *      resolutionUpdate(&resolution);
+ *      ... render the scene into a renderWidth x renderHeight target ...
+ *      resolutionUpscale(&resolution, encoder, sceneView, surfaceView, timestamps);
+ *      ... draw the UI at the output resolution ...
+ */
+
+typedef struct {
+    float targetMilliseconds;   // GPU frame time to hold
+    float minScale;             // quality floor
+    float maxScale;
+    float scaleStep;
+    float upThreshold;          // share of the budget the next step up must fit in
+    uint32_t upFrames;
+    uint32_t downFrames;
+} DynamicResolutionSettings;
+
+typedef struct {
+    DynamicResolutionSettings settings;
+    bool enabled;
+    float scale;
+    uint32_t outputWidth, outputHeight;
+    uint32_t renderWidth, renderHeight;
+
+    // Controller state, counted in timed frames
+    uint64_t lastGpuFrame;      // profiler->gpuFrameCount already looked at
+    uint32_t overBudgetFrames;
+    uint32_t underBudgetFrames;
+    uint32_t settleFrames;      // timings still to ignore after a change
+
+    WGPUDevice device;
+    Profiler* profiler;         // GPU timings, requested while enabled
+    WGPURenderPipeline upscalePipeline;
+    WGPUSampler sampler;
+} DynamicResolution;
+
+/** Settings for a 60 Hz budget with a 50% floor. */
+DynamicResolutionSettings defaultResolutionSettings(void);
+
+bool createDynamicResolution(DynamicResolution* resolution,
+                             WGPUDevice device,
+                             Profiler* profiler,
+                             WGPUTextureFormat outputFormat,
+                             const DynamicResolutionSettings* settings);
+
+void releaseDynamicResolution(DynamicResolution* resolution);
+
+/** While disabled the scene renders at maxScale. Starts enabled. */
+void resolutionSetEnabled(DynamicResolution* resolution, bool enabled);
+
+void resolutionSetOutputSize(DynamicResolution* resolution, uint32_t width, uint32_t height);
+
+/** Pick this frame's render size. Call before rendering the scene. */
+void resolutionUpdate(DynamicResolution* resolution);
+
+/**
+ * Record the upscale of `source` (filterable, any size) to all of
+ * `target` in its own render pass.
+ */
+void resolutionUpscale(DynamicResolution* resolution,
+                       WGPUCommandEncoder encoder,
+                       WGPUTextureView source,
+                       WGPUTextureView target,
+                       const WGPURenderPassTimestampWrites* timestamps);
+
+#endif // DYNAMIC_RESOLUTION_H
@@ -0,0 +1,1045 @@
+#include "fluid.h"
+#include "webgpu-utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Uniform block of the fluid shaders. Must match FluidUniforms in kFluidCommonWGSL (144 bytes). */
+typedef struct {
+    float boxToClip[16];
+    uint32_t size[3];
+    float timeDelta;
+    float sourcePosition[3];    // cells
+    float sourceRadius;         // cells
+    float sourceForce[3];
+    float velocityDissipation;
+    float sourceColor[3];
+    float dyeDissipation;
+    float vorticity;
+    float sliceWeight;
+    uint32_t _pad0;
+    uint32_t _pad1;
+} FluidUniforms;
+
+/** Must match LevelParams in kFluidPressureWGSL. */
+typedef struct {
+    uint32_t size[3];
+    uint32_t color;             // red-black: cells with (x + y + z) % 2 == color are updated
+    uint32_t fineSize[3];       // of the level above, for restriction and prolongation
+    uint32_t _pad0;
+} LevelParams;
+
+#define kFluidGroupSize 8
+#define kLevelStride kUniformOffsetAlignment
+#define kFluidTextureFormat WGPUTextureFormat_RGBA16Float
+
+// One float per cell: each pressure field must fit one storage buffer binding
+#define kFluidMaxCells (uint32_t)(kMaxStorageBindingSize / sizeof(float))
+
+// Multigrid: red-black sweeps before and after each coarse correction, and on the coarsest level
+#define kPreSweeps 2
+#define kPostSweeps 2
+#define kCoarsestSweeps 16
+
+#define kFluidCommonWGSL \
+"struct FluidUniforms {\n" \
+"    boxToClip: mat4x4f,\n" \
+"    size: vec3u,\n" \
+"    timeDelta: f32,\n" \
+"    sourcePosition: vec3f,\n" \
+"    sourceRadius: f32,\n" \
+"    sourceForce: vec3f,\n" \
+"    velocityDissipation: f32,\n" \
+"    sourceColor: vec3f,\n" \
+"    dyeDissipation: f32,\n" \
+"    vorticity: f32,\n" \
+"    sliceWeight: f32,\n" \
+"    _pad0: u32,\n" \
+"    _pad1: u32,\n" \
+"}\n"
+
+static const char* const kFluidWGSL[] = {
+kFluidCommonWGSL
+"@group(0) @binding(0) var<uniform> settings: FluidUniforms;\n"
+"@group(0) @binding(1) var velocityIn: texture_3d<f32>;\n"
+"@group(0) @binding(2) var velocityOut: texture_storage_3d<rgba16float, write>;\n"
+"@group(0) @binding(3) var dyeIn: texture_3d<f32>;\n"
+"@group(0) @binding(4) var dyeOut: texture_storage_3d<rgba16float, write>;\n"
+"@group(0) @binding(5) var linearSampler: sampler;\n"
+"@group(0) @binding(6) var<storage, read_write> pressure: array<f32>;\n"
+"@group(0) @binding(7) var<storage, read_write> divergence: array<f32>;\n"
+"@group(0) @binding(8) var curlOut: texture_storage_3d<rgba16float, write>;\n"
+"@group(0) @binding(9) var curlIn: texture_3d<f32>;\n"
+"\n"
+"const kX = vec3i(1, 0, 0);\n"
+"const kY = vec3i(0, 1, 0);\n"
+"const kZ = vec3i(0, 0, 1);\n"
+"\n"
+"fn inGrid(cell: vec3u) -> bool {\n"
+"    return all(cell < settings.size);\n"
+"}\n"
+"\n"
+"fn clampCell(cell: vec3i) -> vec3i {\n"
+"    return clamp(cell, vec3i(0), vec3i(settings.size) - 1);\n"
+"}\n"
+"\n"
+"fn cellIndex(cell: vec3i) -> u32 {\n"
+"    let c = vec3u(cell);\n"
+"    return c.x + settings.size.x * (c.y + settings.size.y * c.z);\n"
+"}\n"
+"\n"
+"fn sourceWeight(cell: vec3u) -> f32 {\n"
+"    let offset = vec3f(cell) + 0.5 - settings.sourcePosition;\n"
+"    return exp(-dot(offset, offset) / (settings.sourceRadius * settings.sourceRadius));\n"
+"}\n"
+"\n"
+"// Where what is in `cell` now was one step ago, in texture coordinates\n"
+"fn backTrace(cell: vec3u) -> vec3f {\n"
+"    let velocity = textureLoad(velocityIn, cell, 0).xyz;\n"
+"    return (vec3f(cell) + 0.5 - velocity * settings.timeDelta) / vec3f(settings.size);\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8, 1)\n"
+"fn clearVelocity(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (inGrid(id)) {\n"
+"        textureStore(velocityOut, id, vec4f(0.0));\n"
+"    }\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8, 1)\n"
+"fn clearDye(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (inGrid(id)) {\n"
+"        textureStore(dyeOut, id, vec4f(0.0));\n"
+"    }\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8, 1)\n"
+"fn advectVelocity(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (!inGrid(id)) {\n"
+"        return;\n"
+"    }\n"
+"    var velocity = textureSampleLevel(velocityIn, linearSampler, backTrace(id), 0.0).xyz;\n"
+"    velocity = velocity / (1.0 + settings.velocityDissipation * settings.timeDelta) +\n"
+"               settings.sourceForce * (sourceWeight(id) * settings.timeDelta);\n"
+"    textureStore(velocityOut, id, vec4f(velocity, 0.0));\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8, 1)\n"
+"fn advectDye(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (!inGrid(id)) {\n"
+"        return;\n"
+"    }\n"
+"    var dye = textureSampleLevel(dyeIn, linearSampler, backTrace(id), 0.0);\n"
+"    dye = dye / (1.0 + settings.dyeDissipation * settings.timeDelta) +\n"
+"          vec4f(settings.sourceColor, 0.0) * (sourceWeight(id) * settings.timeDelta);\n"
+"    textureStore(dyeOut, id, dye);\n"
+"}\n"
+"\n"
+"fn velocityAt(cell: vec3i) -> vec3f {\n"
+"    return textureLoad(velocityIn, clampCell(cell), 0).xyz;\n"
+"}\n"
+"\n"
+"// Vorticity, and its length in w\n"
+"@compute @workgroup_size(8, 8, 1)\n"
+"fn curl(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (!inGrid(id)) {\n"
+"        return;\n"
+"    }\n"
+"    let c = vec3i(id);\n"
+"    let dx = (velocityAt(c + kX) - velocityAt(c - kX)) * 0.5;\n"
+"    let dy = (velocityAt(c + kY) - velocityAt(c - kY)) * 0.5;\n"
+"    let dz = (velocityAt(c + kZ) - velocityAt(c - kZ)) * 0.5;\n"
+"    let w = vec3f(dy.z - dz.y, dz.x - dx.z, dx.y - dy.x);\n"
+"    textureStore(curlOut, id, vec4f(w, length(w)));\n"
+"}\n"
+"\n",
+"fn curlLength(cell: vec3i) -> f32 {\n"
+"    return textureLoad(curlIn, clampCell(cell), 0).w;\n"
+"}\n"
+"\n"
+"// Pushes across the vorticity, away from where it is weaker: spins the swirls back up\n"
+"@compute @workgroup_size(8, 8, 1)\n"
+"fn confine(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (!inGrid(id)) {\n"
+"        return;\n"
+"    }\n"
+"    let c = vec3i(id);\n"
+"    let gradient = vec3f(curlLength(c + kX) - curlLength(c - kX),\n"
+"                         curlLength(c + kY) - curlLength(c - kY),\n"
+"                         curlLength(c + kZ) - curlLength(c - kZ)) * 0.5;\n"
+"    let normal = gradient / (length(gradient) + 1e-5);\n"
+"    let w = textureLoad(curlIn, id, 0).xyz;\n"
+"    let velocity = textureLoad(velocityIn, id, 0).xyz + cross(normal, w) * (settings.vorticity * settings.timeDelta);\n"
+"    textureStore(velocityOut, id, vec4f(velocity, 0.0));\n"
+"}\n"
+"\n"
+"// Across a wall the velocity is mirrored: nothing flows through it\n"
+"fn wallVelocity(cell: vec3i) -> vec3f {\n"
+"    let inside = clampCell(cell);\n"
+"    let velocity = textureLoad(velocityIn, inside, 0).xyz;\n"
+"    return select(velocity, -velocity, any(inside != cell));\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8, 1)\n"
+"fn findDivergence(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (!inGrid(id)) {\n"
+"        return;\n"
+"    }\n"
+"    let c = vec3i(id);\n"
+"    divergence[cellIndex(c)] = 0.5 * (wallVelocity(c + kX).x - wallVelocity(c - kX).x +\n"
+"                                      wallVelocity(c + kY).y - wallVelocity(c - kY).y +\n"
+"                                      wallVelocity(c + kZ).z - wallVelocity(c - kZ).z);\n"
+"}\n"
+"\n"
+"// Walls repeat the pressure next to them: no gradient across\n"
+"fn pressureAt(cell: vec3i) -> f32 {\n"
+"    return pressure[cellIndex(clampCell(cell))];\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8, 1)\n"
+"fn subtractGradient(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (!inGrid(id)) {\n"
+"        return;\n"
+"    }\n"
+"    let c = vec3i(id);\n"
+"    let gradient = vec3f(pressureAt(c + kX) - pressureAt(c - kX),\n"
+"                         pressureAt(c + kY) - pressureAt(c - kY),\n"
+"                         pressureAt(c + kZ) - pressureAt(c - kZ)) * 0.5;\n"
+"    textureStore(velocityOut, id, vec4f(textureLoad(velocityIn, id, 0).xyz - gradient, 0.0));\n"
+"}\n",
+};
+
+/**
+ * Solves laplacian(pressure) = rhs, the Laplacian counting distances in
+ * the level's own cells. Every kernel reads its level's size from `level`.
+ */
+static const char* kFluidPressureWGSL =
+"struct LevelParams {\n"
+"    size: vec3u,\n"
+"    color: u32,\n"
+"    fineSize: vec3u,\n"
+"    _pad0: u32,\n"
+"}\n"
+"\n"
+"@group(0) @binding(0) var<uniform> level: LevelParams;\n"
+"@group(0) @binding(1) var<storage, read_write> pressure: array<f32>;\n"
+"@group(0) @binding(2) var<storage, read_write> rhs: array<f32>;\n"
+"@group(0) @binding(3) var<storage, read_write> coarsePressure: array<f32>;\n"
+"@group(0) @binding(4) var<storage, read_write> coarseRhs: array<f32>;\n"
+"@group(0) @binding(5) var<storage, read_write> pressureOut: array<f32>;\n"
+"\n"
+"fn cellIndex(cell: vec3u, size: vec3u) -> u32 {\n"
+"    return cell.x + size.x * (cell.y + size.y * cell.z);\n"
+"}\n"
+"\n"
+"// Sum and count of the neighbours inside the grid. A wall repeats the\n"
+"// cell's own pressure, which cancels out of the Laplacian: a 2D grid\n"
+"// (depth 1) has four neighbours per cell.\n"
+"fn neighbours(cell: vec3u, size: vec3u) -> vec2f {\n"
+"    var offsets = array<vec3i, 6>(vec3i(1, 0, 0), vec3i(-1, 0, 0), vec3i(0, 1, 0),\n"
+"                                  vec3i(0, -1, 0), vec3i(0, 0, 1), vec3i(0, 0, -1));\n"
+"    var total = vec2f(0.0);\n"
+"    for (var k = 0u; k < 6u; k++) {\n"
+"        let n = vec3i(cell) + offsets[k];\n"
+"        if (all(n >= vec3i(0)) && all(vec3u(n) < size)) {\n"
+"            total += vec2f(pressure[cellIndex(vec3u(n), size)], 1.0);\n"
+"        }\n"
+"    }\n"
+"    return total;\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8, 1)\n"
+"fn jacobi(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (any(id >= level.size)) {\n"
+"        return;\n"
+"    }\n"
+"    let terms = neighbours(id, level.size);\n"
+"    let index = cellIndex(id, level.size);\n"
+"    pressureOut[index] = (terms.x - rhs[index]) / max(terms.y, 1.0);\n"
+"}\n"
+"\n"
+"// One color of a red-black Gauss-Seidel sweep, in place: the cells of a\n"
+"// color only have neighbours of the other one\n"
+"@compute @workgroup_size(8, 8, 1)\n"
+"fn relax(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (any(id >= level.size) || ((id.x + id.y + id.z) & 1u) != level.color) {\n"
+"        return;\n"
+"    }\n"
+"    let terms = neighbours(id, level.size);\n"
+"    let index = cellIndex(id, level.size);\n"
+"    pressure[index] = (terms.x - rhs[index]) / max(terms.y, 1.0);\n"
+"}\n"
+"\n"
+"// Average residual of the fine children, as the right-hand side of a\n"
+"// correction starting at zero\n"
+"@compute @workgroup_size(8, 8, 1)\n"
+"fn restrictResidual(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (any(id >= level.size)) {\n"
+"        return;\n"
+"    }\n"
+"    var residual = 0.0;\n"
+"    var children = 0.0;\n"
+"    for (var k = 0u; k < 8u; k++) {\n"
+"        let child = id * 2u + vec3u(k & 1u, (k >> 1u) & 1u, k >> 2u);\n"
+"        if (all(child < level.fineSize)) {\n"
+"            let terms = neighbours(child, level.fineSize);\n"
+"            let index = cellIndex(child, level.fineSize);\n"
+"            residual += rhs[index] - (terms.x - terms.y * pressure[index]);\n"
+"            children += 1.0;\n"
+"        }\n"
+"    }\n"
+"    let coarse = cellIndex(id, level.size);\n"
+"    // Coarse cells are twice as large: the Laplacian in their units is four times the fine one\n"
+"    coarseRhs[coarse] = 4.0 * residual / max(children, 1.0);\n"
+"    coarsePressure[coarse] = 0.0;\n"
+"}\n"
+"\n"
+"// Adds the coarse correction to the fine level, one coarse cell per 2x2x2 fine ones\n"
+"@compute @workgroup_size(8, 8, 1)\n"
+"fn prolong(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (any(id >= level.fineSize)) {\n"
+"        return;\n"
+"    }\n"
+"    pressure[cellIndex(id, level.fineSize)] += coarsePressure[cellIndex(id / 2u, level.size)];\n"
+"}\n";
+
+static const char* kFluidRenderWGSL = kFluidCommonWGSL
+"@group(0) @binding(0) var<uniform> settings: FluidUniforms;\n"
+"@group(0) @binding(1) var dye: texture_3d<f32>;\n"
+"@group(0) @binding(2) var linearSampler: sampler;\n"
+"\n"
+"struct VertexOutput {\n"
+"    @builtin(position) position: vec4f,\n"
+"    @location(0) box: vec3f,\n"
+"}\n"
+"\n"
+"// One quad per slice of cells, through their centers\n"
+"@vertex\n"
+"fn vs_main(@builtin(vertex_index) vertex: u32, @builtin(instance_index) slice: u32) -> VertexOutput {\n"
+"    var corners = array<vec2f, 6>(vec2f(0.0, 0.0), vec2f(1.0, 0.0), vec2f(1.0, 1.0),\n"
+"                                  vec2f(0.0, 0.0), vec2f(1.0, 1.0), vec2f(0.0, 1.0));\n"
+"    let box = vec3f(corners[vertex], (f32(slice) + 0.5) / f32(settings.size.z));\n"
+"    var out: VertexOutput;\n"
+"    out.position = settings.boxToClip * vec4f(box, 1.0);\n"
+"    out.box = box;\n"
+"    return out;\n"
+"}\n"
+"\n"
+"@fragment\n"
+"fn fs_main(in: VertexOutput) -> @location(0) vec4f {\n"
+"    let color = textureSample(dye, linearSampler, in.box).rgb;\n"
+"    return vec4f(color * settings.sliceWeight, 0.0);\n"
+"}\n";
+
+FluidSettings defaultFluidSettings(void)
+{
+    FluidSettings settings;
+    memset(&settings, 0, sizeof settings);
+    settings.solver = FluidSolver_Multigrid;
+    settings.iterations = 2;
+    settings.timeDelta = 1.0f / 60.0f;
+    settings.velocityDissipation = 0.1f;
+    settings.dyeDissipation = 0.3f;
+    settings.vorticity = 2.0f;
+    settings.sourcePosition = vec3(0.5f, 0.1f, 0.5f);
+    settings.sourceRadius = 0.05f;
+    settings.sourceForce = vec3(0.0f, 200.0f, 0.0f);
+    const float sourceColor[3] = { 5.0f, 3.0f, 1.5f };
+    memcpy(settings.sourceColor, sourceColor, sizeof sourceColor);
+    return settings;
+}
+
+static uint64_t levelCellCount(const Fluid* fluid, uint32_t level)
+{
+    const uint32_t* size = fluid->levelSizes[level];
+    return (uint64_t)size[0] * size[1] * size[2];
+}
+
+static WGPUBuffer levelPressure(const Fluid* fluid, uint32_t level)
+{
+    return level == 0 ? fluid->pressureBuffers[0] : fluid->coarsePressureBuffers[level];
+}
+
+static WGPUBuffer levelRhs(const Fluid* fluid, uint32_t level)
+{
+    return level == 0 ? fluid->divergenceBuffer : fluid->coarseRhsBuffers[level];
+}
+
+/**
+ * Bind group entry `binding` of kFluidWGSL. `velocity` and `dye` are the
+ * textures read; the other ones are written.
+ */
+static void fillFluidEntry(const Fluid* fluid, uint32_t binding, uint32_t velocity, uint32_t dye,
+                           WGPUBindGroupEntry* entry)
+{
+    memset(entry, 0, sizeof *entry);
+    entry->binding = binding;
+    switch (binding) {
+    case 0:
+        entry->buffer = fluid->uniformBuffer;
+        entry->size = sizeof(FluidUniforms);
+        break;
+    case 1:
+    case 2:
+        entry->textureView = fluid->velocityViews[binding == 1 ? velocity : velocity ^ 1];
+        break;
+    case 3:
+    case 4:
+        entry->textureView = fluid->dyeViews[binding == 3 ? dye : dye ^ 1];
+        break;
+    case 5:
+        entry->sampler = fluid->sampler;
+        break;
+    case 6:
+        entry->buffer = fluid->pressureBuffers[0];
+        entry->size = levelCellCount(fluid, 0) * sizeof(float);
+        break;
+    case 7:
+        entry->buffer = fluid->divergenceBuffer;
+        entry->size = levelCellCount(fluid, 0) * sizeof(float);
+        break;
+    case 8:
+    case 9:
+        entry->textureView = fluid->curlView;
+        break;
+    }
+}
+
+static WGPUBindGroup createBindGroup(const Fluid* fluid, WGPUComputePipeline pipeline, const char* label,
+                                     const WGPUBindGroupEntry* entries, uint32_t entryCount)
+{
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(pipeline, 0);
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = label;
+    desc.layout = layout;
+    desc.entryCount = entryCount;
+    desc.entries = entries;
+    WGPUBindGroup bindGroup = wgpuDeviceCreateBindGroup(fluid->device, &desc);
+    wgpuBindGroupLayoutRelease(layout);
+    return bindGroup;
+}
+
+/** What fillFluidEntry() needs besides the binding. */
+typedef struct {
+    const Fluid* fluid;
+    uint32_t velocity;
+    uint32_t dye;
+} FluidBindings;
+
+static void fillKernelEntry(void* userData, uint32_t binding, WGPUBindGroupEntry* entry)
+{
+    const FluidBindings* kernel = userData;
+    fillFluidEntry(kernel->fluid, binding, kernel->velocity, kernel->dye, entry);
+}
+
+/** A bind group of kFluidWGSL for one kernel's auto layout. */
+static WGPUBindGroup createFluidBindGroup(const Fluid* fluid, WGPUComputePipeline pipeline, const char* label,
+                                          const uint32_t* bindings, uint32_t bindingCount,
+                                          uint32_t velocity, uint32_t dye)
+{
+    FluidBindings kernel = { fluid, velocity, dye };
+    return createAutoLayoutBindGroup(fluid->device, pipeline, label, bindings, bindingCount, fillKernelEntry,
+                                     &kernel);
+}
+
+static WGPUBindGroupEntry bufferEntry(uint32_t binding, WGPUBuffer buffer, uint64_t offset, uint64_t size)
+{
+    WGPUBindGroupEntry entry = {0};
+    entry.binding = binding;
+    entry.buffer = buffer;
+    entry.offset = offset;
+    entry.size = size;
+    return entry;
+}
+
+/** The LevelParams block of `level` and `color` in levelBuffer. */
+static WGPUBindGroupEntry levelEntry(const Fluid* fluid, uint32_t level, uint32_t color)
+{
+    return bufferEntry(0, fluid->levelBuffer, (uint64_t)(level * 2 + color) * kLevelStride, sizeof(LevelParams));
+}
+
+static WGPUBindGroupEntry levelBufferEntry(const Fluid* fluid, uint32_t binding, WGPUBuffer buffer, uint32_t level)
+{
+    return bufferEntry(binding, buffer, 0, levelCellCount(fluid, level) * sizeof(float));
+}
+
+static const uint32_t kClearVelocityBindings[] = { 0, 2 };
+static const uint32_t kClearDyeBindings[] = { 0, 4 };
+static const uint32_t kAdvectVelocityBindings[] = { 0, 1, 2, 5 };
+static const uint32_t kAdvectDyeBindings[] = { 0, 1, 3, 4, 5 };
+static const uint32_t kCurlBindings[] = { 0, 1, 8 };
+static const uint32_t kConfineBindings[] = { 0, 1, 2, 9 };
+static const uint32_t kDivergenceBindings[] = { 0, 1, 7 };
+static const uint32_t kGradientBindings[] = { 0, 1, 2, 6 };
+
+static bool createVelocityKernels(Fluid* fluid)
+{
+    WGPUDevice device = fluid->device;
+    WGPUShaderModule module = createShaderModuleFromParts(device, "Fluid shader", kFluidWGSL,
+                                                          sizeof kFluidWGSL / sizeof kFluidWGSL[0]);
+    if (!module) return false;
+    fluid->clearVelocityPipeline = createComputePipeline(device, "Fluid clear velocity pipeline", module,
+                                                         "clearVelocity");
+    fluid->clearDyePipeline = createComputePipeline(device, "Fluid clear dye pipeline", module, "clearDye");
+    fluid->advectVelocityPipeline = createComputePipeline(device, "Fluid advect velocity pipeline", module,
+                                                          "advectVelocity");
+    fluid->advectDyePipeline = createComputePipeline(device, "Fluid advect dye pipeline", module, "advectDye");
+    fluid->curlPipeline = createComputePipeline(device, "Fluid curl pipeline", module, "curl");
+    fluid->confinePipeline = createComputePipeline(device, "Fluid confine pipeline", module, "confine");
+    fluid->divergencePipeline = createComputePipeline(device, "Fluid divergence pipeline", module, "findDivergence");
+    fluid->gradientPipeline = createComputePipeline(device, "Fluid gradient pipeline", module, "subtractGradient");
+    wgpuShaderModuleRelease(module);
+    if (!fluid->clearVelocityPipeline || !fluid->clearDyePipeline || !fluid->advectVelocityPipeline ||
+        !fluid->advectDyePipeline || !fluid->curlPipeline || !fluid->confinePipeline ||
+        !fluid->divergencePipeline || !fluid->gradientPipeline) {
+        return false;
+    }
+
+    for (uint32_t v = 0; v < 2; ++v) {
+        fluid->clearVelocityBindGroups[v] =
+            createFluidBindGroup(fluid, fluid->clearVelocityPipeline, "Fluid clear velocity bind group",
+                                 kClearVelocityBindings, kBindingCount(kClearVelocityBindings), v, 0);
+        fluid->clearDyeBindGroups[v] =
+            createFluidBindGroup(fluid, fluid->clearDyePipeline, "Fluid clear dye bind group",
+                                 kClearDyeBindings, kBindingCount(kClearDyeBindings), 0, v);
+        fluid->advectVelocityBindGroups[v] =
+            createFluidBindGroup(fluid, fluid->advectVelocityPipeline, "Fluid advect velocity bind group",
+                                 kAdvectVelocityBindings, kBindingCount(kAdvectVelocityBindings), v, 0);
+        for (uint32_t d = 0; d < 2; ++d) {
+            fluid->advectDyeBindGroups[v][d] =
+                createFluidBindGroup(fluid, fluid->advectDyePipeline, "Fluid advect dye bind group",
+                                     kAdvectDyeBindings, kBindingCount(kAdvectDyeBindings), v, d);
+            if (!fluid->advectDyeBindGroups[v][d]) return false;
+        }
+        fluid->curlBindGroups[v] =
+            createFluidBindGroup(fluid, fluid->curlPipeline, "Fluid curl bind group",
+                                 kCurlBindings, kBindingCount(kCurlBindings), v, 0);
+        fluid->confineBindGroups[v] =
+            createFluidBindGroup(fluid, fluid->confinePipeline, "Fluid confine bind group",
+                                 kConfineBindings, kBindingCount(kConfineBindings), v, 0);
+        fluid->divergenceBindGroups[v] =
+            createFluidBindGroup(fluid, fluid->divergencePipeline, "Fluid divergence bind group",
+                                 kDivergenceBindings, kBindingCount(kDivergenceBindings), v, 0);
+        fluid->gradientBindGroups[v] =
+            createFluidBindGroup(fluid, fluid->gradientPipeline, "Fluid gradient bind group",
+                                 kGradientBindings, kBindingCount(kGradientBindings), v, 0);
+        if (!fluid->clearVelocityBindGroups[v] || !fluid->clearDyeBindGroups[v] ||
+            !fluid->advectVelocityBindGroups[v] || !fluid->curlBindGroups[v] || !fluid->confineBindGroups[v] ||
+            !fluid->divergenceBindGroups[v] || !fluid->gradientBindGroups[v]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool createPressureKernels(Fluid* fluid)
+{
+    WGPUDevice device = fluid->device;
+    WGPUShaderModule module = createShaderModule(device, "Fluid pressure shader", kFluidPressureWGSL);
+    if (!module) return false;
+    fluid->jacobiPipeline = createComputePipeline(device, "Fluid Jacobi pipeline", module, "jacobi");
+    fluid->smoothPipeline = createComputePipeline(device, "Fluid red-black pipeline", module, "relax");
+    fluid->restrictPipeline = createComputePipeline(device, "Fluid restrict pipeline", module, "restrictResidual");
+    fluid->prolongPipeline = createComputePipeline(device, "Fluid prolong pipeline", module, "prolong");
+    wgpuShaderModuleRelease(module);
+    if (!fluid->jacobiPipeline || !fluid->smoothPipeline || !fluid->restrictPipeline || !fluid->prolongPipeline) {
+        return false;
+    }
+
+    for (uint32_t input = 0; input < 2; ++input) {
+        WGPUBindGroupEntry entries[4] = {
+            levelEntry(fluid, 0, 0),
+            levelBufferEntry(fluid, 1, fluid->pressureBuffers[input], 0),
+            levelBufferEntry(fluid, 2, fluid->divergenceBuffer, 0),
+            levelBufferEntry(fluid, 5, fluid->pressureBuffers[input ^ 1], 0),
+        };
+        fluid->jacobiBindGroups[input] = createBindGroup(fluid, fluid->jacobiPipeline, "Fluid Jacobi bind group",
+                                                         entries, 4);
+        if (!fluid->jacobiBindGroups[input]) return false;
+    }
+
+    for (uint32_t level = 0; level < fluid->levelCount; ++level) {
+        for (uint32_t color = 0; color < 2; ++color) {
+            WGPUBindGroupEntry entries[3] = {
+                levelEntry(fluid, level, color),
+                levelBufferEntry(fluid, 1, levelPressure(fluid, level), level),
+                levelBufferEntry(fluid, 2, levelRhs(fluid, level), level),
+            };
+            fluid->smoothBindGroups[level][color] = createBindGroup(fluid, fluid->smoothPipeline,
+                                                                    "Fluid red-black bind group", entries, 3);
+            if (!fluid->smoothBindGroups[level][color]) return false;
+        }
+        if (level == 0) continue;
+
+        WGPUBindGroupEntry restrictEntries[5] = {
+            levelEntry(fluid, level, 0),
+            levelBufferEntry(fluid, 1, levelPressure(fluid, level - 1), level - 1),
+            levelBufferEntry(fluid, 2, levelRhs(fluid, level - 1), level - 1),
+            levelBufferEntry(fluid, 3, levelPressure(fluid, level), level),
+            levelBufferEntry(fluid, 4, levelRhs(fluid, level), level),
+        };
+        fluid->restrictBindGroups[level] = createBindGroup(fluid, fluid->restrictPipeline,
+                                                           "Fluid restrict bind group", restrictEntries, 5);
+        WGPUBindGroupEntry prolongEntries[3] = {
+            levelEntry(fluid, level, 0),
+            levelBufferEntry(fluid, 1, levelPressure(fluid, level - 1), level - 1),
+            levelBufferEntry(fluid, 3, levelPressure(fluid, level), level),
+        };
+        fluid->prolongBindGroups[level] = createBindGroup(fluid, fluid->prolongPipeline,
+                                                          "Fluid prolong bind group", prolongEntries, 3);
+        if (!fluid->restrictBindGroups[level] || !fluid->prolongBindGroups[level]) return false;
+    }
+    return true;
+}
+
+static bool createRenderPipeline(Fluid* fluid,
+                                 WGPUTextureFormat colorFormat,
+                                 WGPUTextureFormat depthFormat,
+                                 uint32_t sampleCount)
+{
+    WGPUShaderModule module = createShaderModule(fluid->device, "Fluid render shader", kFluidRenderWGSL);
+    if (!module) return false;
+
+    // Slices add up along the view, in any order, keeping the destination alpha
+    WGPUBlendState blend = {0};
+    blend.color.operation = WGPUBlendOperation_Add;
+    blend.color.srcFactor = WGPUBlendFactor_One;
+    blend.color.dstFactor = WGPUBlendFactor_One;
+    blend.alpha.operation = WGPUBlendOperation_Add;
+    blend.alpha.srcFactor = WGPUBlendFactor_Zero;
+    blend.alpha.dstFactor = WGPUBlendFactor_One;
+
+    WGPUColorTargetState colorTarget = {0};
+    colorTarget.format = colorFormat;
+    colorTarget.blend = &blend;
+    colorTarget.writeMask = WGPUColorWriteMask_All;
+
+    WGPUFragmentState fragment = {0};
+    fragment.module = module;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &colorTarget;
+
+    WGPUDepthStencilState depthStencil = {0};
+    depthStencil.format = depthFormat;
+    depthStencil.depthWriteEnabled = false;
+    depthStencil.depthCompare = WGPUCompareFunction_LessEqual;
+    depthStencil.stencilFront.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilBack.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilReadMask = 0;
+    depthStencil.stencilWriteMask = 0;
+
+    WGPURenderPipelineDescriptor desc = {0};
+    desc.label = "Fluid render pipeline";
+    desc.layout = NULL; // auto layout
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
+    desc.primitive.frontFace = WGPUFrontFace_CCW;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.depthStencil = depthFormat != WGPUTextureFormat_Undefined ? &depthStencil : NULL;
+    desc.multisample.count = sampleCount > 1 ? sampleCount : 1;
+    desc.multisample.mask = ~0u;
+    desc.multisample.alphaToCoverageEnabled = false;
+    desc.fragment = &fragment;
+
+    fluid->renderPipeline = wgpuDeviceCreateRenderPipeline(fluid->device, &desc);
+    wgpuShaderModuleRelease(module);
+    if (!fluid->renderPipeline) {
+        fprintf(stderr, "Failed to create %s\n", desc.label);
+        return false;
+    }
+
+    WGPUBindGroupLayout layout = wgpuRenderPipelineGetBindGroupLayout(fluid->renderPipeline, 0);
+    for (uint32_t dye = 0; dye < 2; ++dye) {
+        WGPUBindGroupEntry entries[3];
+        fillFluidEntry(fluid, 0, 0, dye, &entries[0]);
+        fillFluidEntry(fluid, 3, 0, dye, &entries[1]);
+        fillFluidEntry(fluid, 5, 0, dye, &entries[2]);
+        entries[1].binding = 1;
+        entries[2].binding = 2;
+
+        WGPUBindGroupDescriptor bindGroupDesc = {0};
+        bindGroupDesc.label = "Fluid render bind group";
+        bindGroupDesc.layout = layout;
+        bindGroupDesc.entryCount = 3;
+        bindGroupDesc.entries = entries;
+        fluid->renderBindGroups[dye] = wgpuDeviceCreateBindGroup(fluid->device, &bindGroupDesc);
+    }
+    wgpuBindGroupLayoutRelease(layout);
+    return fluid->renderBindGroups[0] && fluid->renderBindGroups[1];
+}
+
+static bool createVolume(Fluid* fluid, const char* label, WGPUTexture* texture, WGPUTextureView* view)
+{
+    WGPUTextureDescriptor desc = {0};
+    desc.label = label;
+    desc.usage = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_StorageBinding;
+    desc.dimension = WGPUTextureDimension_3D;
+    desc.size = (WGPUExtent3D){ fluid->size[0], fluid->size[1], fluid->size[2] };
+    desc.format = kFluidTextureFormat;
+    desc.mipLevelCount = 1;
+    desc.sampleCount = 1;
+    *texture = wgpuDeviceCreateTexture(fluid->device, &desc);
+    if (!*texture) {
+        fprintf(stderr, "Failed to create %s\n", label);
+        return false;
+    }
+    *view = wgpuTextureCreateView(*texture, NULL);
+    return *view != NULL;
+}
+
+/** Multigrid levels, halving until the smallest side would drop under 8 cells. */
+static void computeLevels(Fluid* fluid)
+{
+    memcpy(fluid->levelSizes[0], fluid->size, sizeof fluid->size);
+    fluid->levelCount = 1;
+    while (fluid->levelCount < kFluidMaxLevels) {
+        const uint32_t* size = fluid->levelSizes[fluid->levelCount - 1];
+        uint32_t smallest = size[0] < size[1] ? size[0] : size[1];
+        if (size[2] > 1 && size[2] < smallest) smallest = size[2];
+        if (smallest < 16) break;
+        uint32_t* coarse = fluid->levelSizes[fluid->levelCount++];
+        for (int axis = 0; axis < 3; ++axis) {
+            coarse[axis] = (size[axis] + 1) / 2;
+        }
+    }
+}
+
+static bool createLevels(Fluid* fluid)
+{
+    uint8_t blocks[kFluidMaxLevels * 2 * kLevelStride] = {0};
+    for (uint32_t level = 0; level < fluid->levelCount; ++level) {
+        for (uint32_t color = 0; color < 2; ++color) {
+            LevelParams params = {0};
+            memcpy(params.size, fluid->levelSizes[level], sizeof params.size);
+            params.color = color;
+            memcpy(params.fineSize, fluid->levelSizes[level > 0 ? level - 1 : 0], sizeof params.fineSize);
+            memcpy(blocks + (level * 2 + color) * kLevelStride, &params, sizeof params);
+        }
+    }
+    fluid->levelBuffer = createBuffer(fluid->device, "Fluid levels", sizeof blocks,
+                                      WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    if (!fluid->levelBuffer) return false;
+    wgpuQueueWriteBuffer(fluid->queue, fluid->levelBuffer, 0, blocks, sizeof blocks);
+
+    for (uint32_t level = 1; level < fluid->levelCount; ++level) {
+        uint64_t size = levelCellCount(fluid, level) * sizeof(float);
+        fluid->coarsePressureBuffers[level] = createBuffer(fluid->device, "Fluid coarse pressure", size,
+                                                           WGPUBufferUsage_Storage);
+        fluid->coarseRhsBuffers[level] = createBuffer(fluid->device, "Fluid coarse residual", size,
+                                                      WGPUBufferUsage_Storage);
+        if (!fluid->coarsePressureBuffers[level] || !fluid->coarseRhsBuffers[level]) return false;
+    }
+    return true;
+}
+
+bool createFluid(Fluid* fluid,
+                 WGPUDevice device,
+                 WGPUQueue queue,
+                 uint32_t width,
+                 uint32_t height,
+                 uint32_t depth,
+                 const FluidSettings* settings,
+                 WGPUTextureFormat colorFormat,
+                 WGPUTextureFormat depthFormat,
+                 uint32_t sampleCount)
+{
+    memset(fluid, 0, sizeof *fluid);
+    if (width == 0 || height == 0 || depth == 0 ||
+        width > kFluidMaxSize || height > kFluidMaxSize || depth > kFluidMaxSize) {
+        fprintf(stderr, "createFluid: %ux%ux%u grid out of range (1..%u per axis)\n",
+                width, height, depth, kFluidMaxSize);
+        return false;
+    }
+    if ((uint64_t)width * height * depth > kFluidMaxCells) {
+        fprintf(stderr, "createFluid: %ux%ux%u grid is over %u cells\n", width, height, depth, kFluidMaxCells);
+        return false;
+    }
+    fluid->device = device;
+    fluid->queue = queue;
+    fluid->size[0] = width;
+    fluid->size[1] = height;
+    fluid->size[2] = depth;
+    fluid->boxToClip = mat4Identity();
+    fluidSetSettings(fluid, settings);
+    computeLevels(fluid);
+
+    WGPUSamplerDescriptor samplerDesc = {0};
+    samplerDesc.label = "Fluid sampler";
+    samplerDesc.addressModeU = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeV = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeW = WGPUAddressMode_ClampToEdge;
+    samplerDesc.magFilter = WGPUFilterMode_Linear;
+    samplerDesc.minFilter = WGPUFilterMode_Linear;
+    samplerDesc.mipmapFilter = WGPUMipmapFilterMode_Nearest;
+    samplerDesc.lodMinClamp = 0.0f;
+    samplerDesc.lodMaxClamp = 1.0f;
+    samplerDesc.maxAnisotropy = 1;
+    fluid->sampler = wgpuDeviceCreateSampler(device, &samplerDesc);
+
+    // Textures and buffers start zeroed: at rest, without dye
+    const uint64_t fieldSize = levelCellCount(fluid, 0) * sizeof(float);
+    const WGPUBufferUsageFlags storage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst;
+    fluid->uniformBuffer = createBuffer(device, "Fluid uniforms", sizeof(FluidUniforms),
+                                        WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    fluid->pressureBuffers[0] = createBuffer(device, "Fluid pressure", fieldSize, storage);
+    fluid->pressureBuffers[1] = createBuffer(device, "Fluid pressure", fieldSize, storage);
+    fluid->divergenceBuffer = createBuffer(device, "Fluid divergence", fieldSize, storage);
+
+    bool drawable = colorFormat != WGPUTextureFormat_Undefined;
+    if (!fluid->sampler || !fluid->uniformBuffer || !fluid->pressureBuffers[0] || !fluid->pressureBuffers[1] ||
+        !fluid->divergenceBuffer ||
+        !createVolume(fluid, "Fluid velocity", &fluid->velocityTextures[0], &fluid->velocityViews[0]) ||
+        !createVolume(fluid, "Fluid velocity", &fluid->velocityTextures[1], &fluid->velocityViews[1]) ||
+        !createVolume(fluid, "Fluid dye", &fluid->dyeTextures[0], &fluid->dyeViews[0]) ||
+        !createVolume(fluid, "Fluid dye", &fluid->dyeTextures[1], &fluid->dyeViews[1]) ||
+        !createVolume(fluid, "Fluid curl", &fluid->curlTexture, &fluid->curlView) ||
+        !createLevels(fluid) || !createVelocityKernels(fluid) || !createPressureKernels(fluid) ||
+        (drawable && !createRenderPipeline(fluid, colorFormat, depthFormat, sampleCount))) {
+        releaseFluid(fluid);
+        return false;
+    }
+    return true;
+}
+
+void releaseFluid(Fluid* fluid)
+{
+    WGPUBindGroup bindGroups[20] = {
+        fluid->clearVelocityBindGroups[0], fluid->clearVelocityBindGroups[1],
+        fluid->clearDyeBindGroups[0], fluid->clearDyeBindGroups[1],
+        fluid->advectVelocityBindGroups[0], fluid->advectVelocityBindGroups[1],
+        fluid->advectDyeBindGroups[0][0], fluid->advectDyeBindGroups[0][1],
+        fluid->advectDyeBindGroups[1][0], fluid->advectDyeBindGroups[1][1],
+        fluid->curlBindGroups[0], fluid->curlBindGroups[1],
+        fluid->confineBindGroups[0], fluid->confineBindGroups[1],
+        fluid->divergenceBindGroups[0], fluid->divergenceBindGroups[1],
+        fluid->gradientBindGroups[0], fluid->gradientBindGroups[1],
+        fluid->jacobiBindGroups[0], fluid->jacobiBindGroups[1],
+    };
+    for (int i = 0; i < 20; ++i) {
+        if (bindGroups[i]) wgpuBindGroupRelease(bindGroups[i]);
+    }
+    for (int level = 0; level < kFluidMaxLevels; ++level) {
+        if (fluid->smoothBindGroups[level][0]) wgpuBindGroupRelease(fluid->smoothBindGroups[level][0]);
+        if (fluid->smoothBindGroups[level][1]) wgpuBindGroupRelease(fluid->smoothBindGroups[level][1]);
+        if (fluid->restrictBindGroups[level]) wgpuBindGroupRelease(fluid->restrictBindGroups[level]);
+        if (fluid->prolongBindGroups[level]) wgpuBindGroupRelease(fluid->prolongBindGroups[level]);
+    }
+    if (fluid->renderBindGroups[0]) wgpuBindGroupRelease(fluid->renderBindGroups[0]);
+    if (fluid->renderBindGroups[1]) wgpuBindGroupRelease(fluid->renderBindGroups[1]);
+
+    WGPUComputePipeline pipelines[12] = {
+        fluid->clearVelocityPipeline, fluid->clearDyePipeline, fluid->advectVelocityPipeline,
+        fluid->advectDyePipeline, fluid->curlPipeline, fluid->confinePipeline,
+        fluid->divergencePipeline, fluid->gradientPipeline, fluid->jacobiPipeline,
+        fluid->smoothPipeline, fluid->restrictPipeline, fluid->prolongPipeline,
+    };
+    for (int i = 0; i < 12; ++i) {
+        if (pipelines[i]) wgpuComputePipelineRelease(pipelines[i]);
+    }
+    if (fluid->renderPipeline) wgpuRenderPipelineRelease(fluid->renderPipeline);
+
+    WGPUTextureView views[5] = {
+        fluid->velocityViews[0], fluid->velocityViews[1], fluid->dyeViews[0], fluid->dyeViews[1], fluid->curlView,
+    };
+    WGPUTexture textures[5] = {
+        fluid->velocityTextures[0], fluid->velocityTextures[1],
+        fluid->dyeTextures[0], fluid->dyeTextures[1], fluid->curlTexture,
+    };
+    for (int i = 0; i < 5; ++i) {
+        if (views[i]) wgpuTextureViewRelease(views[i]);
+        if (textures[i]) {
+            wgpuTextureDestroy(textures[i]);
+            wgpuTextureRelease(textures[i]);
+        }
+    }
+    if (fluid->sampler) wgpuSamplerRelease(fluid->sampler);
+
+    WGPUBuffer buffers[5 + 2 * kFluidMaxLevels] = {
+        fluid->uniformBuffer, fluid->levelBuffer, fluid->pressureBuffers[0], fluid->pressureBuffers[1],
+        fluid->divergenceBuffer,
+    };
+    for (int level = 0; level < kFluidMaxLevels; ++level) {
+        buffers[5 + 2 * level] = fluid->coarsePressureBuffers[level];
+        buffers[6 + 2 * level] = fluid->coarseRhsBuffers[level];
+    }
+    for (int i = 0; i < 5 + 2 * kFluidMaxLevels; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    memset(fluid, 0, sizeof *fluid);
+}
+
+void fluidSetSettings(Fluid* fluid, const FluidSettings* settings)
+{
+    fluid->settings = settings ? *settings : defaultFluidSettings();
+    if (fluid->settings.iterations == 0) fluid->settings.iterations = 1;
+    // A zero radius would divide by zero in the source falloff
+    fluid->settings.sourceRadius = fmaxf(fluid->settings.sourceRadius, 1e-4f);
+}
+
+void fluidReset(Fluid* fluid)
+{
+    fluid->pendingReset = true;
+}
+
+void fluidSetTransform(Fluid* fluid, Mat4 boxToClip)
+{
+    fluid->boxToClip = boxToClip;
+}
+
+static void dispatchLevel(const Fluid* fluid, WGPUComputePassEncoder pass, uint32_t level)
+{
+    const uint32_t* size = fluid->levelSizes[level];
+    wgpuComputePassEncoderDispatchWorkgroups(pass, (size[0] + kFluidGroupSize - 1) / kFluidGroupSize,
+                                             (size[1] + kFluidGroupSize - 1) / kFluidGroupSize, size[2]);
+}
+
+/** Velocity kernel reading the current velocity and writing the other one. */
+static void dispatchVelocity(Fluid* fluid, WGPUComputePassEncoder pass, WGPUComputePipeline pipeline,
+                             WGPUBindGroup const bindGroups[2], bool flip)
+{
+    wgpuComputePassEncoderSetPipeline(pass, pipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, bindGroups[fluid->velocityCurrent], 0, NULL);
+    dispatchLevel(fluid, pass, 0);
+    if (flip) fluid->velocityCurrent ^= 1;
+}
+
+static void relaxLevel(const Fluid* fluid, WGPUComputePassEncoder pass, uint32_t level, uint32_t sweeps)
+{
+    wgpuComputePassEncoderSetPipeline(pass, fluid->smoothPipeline);
+    for (uint32_t sweep = 0; sweep < sweeps; ++sweep) {
+        for (uint32_t color = 0; color < 2; ++color) {
+            wgpuComputePassEncoderSetBindGroup(pass, 0, fluid->smoothBindGroups[level][color], 0, NULL);
+            dispatchLevel(fluid, pass, level);
+        }
+    }
+}
+
+static void recordVCycle(const Fluid* fluid, WGPUComputePassEncoder pass)
+{
+    const uint32_t coarsest = fluid->levelCount - 1;
+    for (uint32_t level = 0; level < coarsest; ++level) {
+        relaxLevel(fluid, pass, level, kPreSweeps);
+        wgpuComputePassEncoderSetPipeline(pass, fluid->restrictPipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, fluid->restrictBindGroups[level + 1], 0, NULL);
+        dispatchLevel(fluid, pass, level + 1);
+    }
+    relaxLevel(fluid, pass, coarsest, kCoarsestSweeps);
+    for (uint32_t level = coarsest; level > 0; --level) {
+        wgpuComputePassEncoderSetPipeline(pass, fluid->prolongPipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, fluid->prolongBindGroups[level], 0, NULL);
+        dispatchLevel(fluid, pass, level - 1);
+        relaxLevel(fluid, pass, level - 1, kPostSweeps);
+    }
+}
+
+/** Leaves the pressure in pressureBuffers[0], where the gradient kernel reads it. */
+static void recordPressureSolve(const Fluid* fluid, WGPUComputePassEncoder pass)
+{
+    const FluidSettings* settings = &fluid->settings;
+    switch (settings->solver) {
+    case FluidSolver_Jacobi: {
+        // An even count ends back in the first buffer
+        uint32_t iterations = (settings->iterations + 1) & ~1u;
+        wgpuComputePassEncoderSetPipeline(pass, fluid->jacobiPipeline);
+        for (uint32_t i = 0; i < iterations; ++i) {
+            wgpuComputePassEncoderSetBindGroup(pass, 0, fluid->jacobiBindGroups[i & 1], 0, NULL);
+            dispatchLevel(fluid, pass, 0);
+        }
+        break;
+    }
+    case FluidSolver_RedBlack:
+        relaxLevel(fluid, pass, 0, settings->iterations);
+        break;
+    case FluidSolver_Multigrid:
+        for (uint32_t cycle = 0; cycle < settings->iterations; ++cycle) {
+            recordVCycle(fluid, pass);
+        }
+        break;
+    }
+}
+
+void fluidStep(Fluid* fluid, WGPUCommandEncoder encoder, const WGPUComputePassTimestampWrites* timestamps)
+{
+    const FluidSettings* settings = &fluid->settings;
+    const float width = (float)fluid->size[0];
+
+    FluidUniforms uniforms = {0};
+    memcpy(uniforms.boxToClip, fluid->boxToClip.m, sizeof uniforms.boxToClip);
+    memcpy(uniforms.size, fluid->size, sizeof uniforms.size);
+    uniforms.timeDelta = settings->timeDelta;
+    uniforms.sourcePosition[0] = settings->sourcePosition.x * (float)fluid->size[0];
+    uniforms.sourcePosition[1] = settings->sourcePosition.y * (float)fluid->size[1];
+    uniforms.sourcePosition[2] = settings->sourcePosition.z * (float)fluid->size[2];
+    uniforms.sourceRadius = settings->sourceRadius * width;
+    uniforms.sourceForce[0] = settings->sourceForce.x;
+    uniforms.sourceForce[1] = settings->sourceForce.y;
+    // A 2D grid has no third axis to push along
+    uniforms.sourceForce[2] = fluid->size[2] > 1 ? settings->sourceForce.z : 0.0f;
+    uniforms.velocityDissipation = settings->velocityDissipation;
+    memcpy(uniforms.sourceColor, settings->sourceColor, sizeof uniforms.sourceColor);
+    uniforms.dyeDissipation = settings->dyeDissipation;
+    uniforms.vorticity = settings->vorticity;
+    // Enough slices in a column add up to about four times their average
+    uniforms.sliceWeight = fluid->size[2] > 1 ? 4.0f / (float)fluid->size[2] : 1.0f;
+    wgpuQueueWriteBuffer(fluid->queue, fluid->uniformBuffer, 0, &uniforms, sizeof uniforms);
+
+    if (fluid->pendingReset) {
+        const uint64_t fieldSize = levelCellCount(fluid, 0) * sizeof(float);
+        wgpuCommandEncoderClearBuffer(encoder, fluid->pressureBuffers[0], 0, fieldSize);
+        wgpuCommandEncoderClearBuffer(encoder, fluid->pressureBuffers[1], 0, fieldSize);
+    }
+
+    WGPUComputePassDescriptor passDesc = {0};
+    passDesc.label = "Fluid pass";
+    passDesc.timestampWrites = timestamps;
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+
+    if (fluid->pendingReset) {
+        dispatchVelocity(fluid, pass, fluid->clearVelocityPipeline, fluid->clearVelocityBindGroups, true);
+        wgpuComputePassEncoderSetPipeline(pass, fluid->clearDyePipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, fluid->clearDyeBindGroups[fluid->dyeCurrent], 0, NULL);
+        dispatchLevel(fluid, pass, 0);
+        fluid->dyeCurrent ^= 1;
+        fluid->pendingReset = false;
+    }
+
+    // Dye first, along the velocity it was in before advection
+    wgpuComputePassEncoderSetPipeline(pass, fluid->advectDyePipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, fluid->advectDyeBindGroups[fluid->velocityCurrent][fluid->dyeCurrent],
+                                       0, NULL);
+    dispatchLevel(fluid, pass, 0);
+    fluid->dyeCurrent ^= 1;
+    dispatchVelocity(fluid, pass, fluid->advectVelocityPipeline, fluid->advectVelocityBindGroups, true);
+
+    if (settings->vorticity > 0.0f) {
+        dispatchVelocity(fluid, pass, fluid->curlPipeline, fluid->curlBindGroups, false);
+        dispatchVelocity(fluid, pass, fluid->confinePipeline, fluid->confineBindGroups, true);
+    }
+
+    dispatchVelocity(fluid, pass, fluid->divergencePipeline, fluid->divergenceBindGroups, false);
+    recordPressureSolve(fluid, pass);
+    dispatchVelocity(fluid, pass, fluid->gradientPipeline, fluid->gradientBindGroups, true);
+
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+}
+
+void fluidDraw(Fluid* fluid, WGPURenderPassEncoder pass)
+{
+    if (!fluid->renderPipeline) return;
+    wgpuRenderPassEncoderSetPipeline(pass, fluid->renderPipeline);
+    wgpuRenderPassEncoderSetBindGroup(pass, 0, fluid->renderBindGroups[fluid->dyeCurrent], 0, NULL);
+    wgpuRenderPassEncoderDraw(pass, 6, fluid->size[2], 0, 0);
+}
+
+WGPUTextureView fluidDyeView(const Fluid* fluid)
+{
+    return fluid->dyeViews[fluid->dyeCurrent];
+}
@@ -0,0 +1,164 @@
+#ifndef FLUID_H
+#define FLUID_H
+
+#include "linalg.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * GRID FLUID
+ *
+ * Stable fluids (semi-Lagrangian advection, then pressure projection) on a
+ * collocated grid of up to kFluidMaxSize cells per axis, 2D when the depth
+ * is 1. Everything runs in one compute pass per step:
+ *  - advection of the dye and the velocity, which also take the source's
+ *    push and color and lose the dissipation
+ *  - vorticity confinement (optional): the curl of the velocity, then a
+ *    push along it that gives back the small swirls advection smears out
+ *  - projection: the divergence of the velocity, a pressure Poisson solve,
+ *    and the pressure gradient taken off the velocity
+ *
+ * Velocity and dye are rgba16float 3D textures, sampled with linear
+ * filtering for advection and written as storage textures: the format is
+ * filterable and storage-capable in core WebGPU, so no optional feature is
+ * needed, and it halves the bandwidth of rgba32float. Pressure and
+ * divergence stay f32, in storage buffers, so Gauss-Seidel can update them
+ * in place. Walls bound the grid on every side: no flow through them, no
+ * pressure gradient across them.
+ *
+ * The pressure solvers, by increasing cost per iteration and decreasing
+ * iterations needed:
+ *  - Jacobi: every cell from last iteration's neighbours
+ *  - red-black Gauss-Seidel: half the cells, then the other half with the
+ *    new values; about twice as fast to converge
+ *  - multigrid: V-cycles of red-black smoothing over grids halving down to
+ *    8 cells, where the large scale error Gauss-Seidel is slow on is cheap
+ *
+ * Drawn as slices through the dye volume (one quad for a 2D grid), or
+ * sampled by any pass through fluidDyeView().
+ */
+
+#define kFluidMaxSize 512
+#define kFluidMaxLevels 8
+
+typedef enum {
+    FluidSolver_Jacobi,
+    FluidSolver_RedBlack,
+    FluidSolver_Multigrid,
+} FluidSolver;
+
+typedef struct {
+    FluidSolver solver;
+    uint32_t iterations;        // of Jacobi and Gauss-Seidel; V-cycles of multigrid
+    float timeDelta;            // of one step, seconds
+    float velocityDissipation;  // 1/s
+    float dyeDissipation;       // 1/s
+    float vorticity;            // confinement strength; 0 turns it off
+
+    // Source, in box coordinates: the grid spans 0..1 on each axis
+    Vec3 sourcePosition;
+    float sourceRadius;
+    Vec3 sourceForce;           // cells/s^2 at the center
+    float sourceColor[3];       // dye/s at the center
+} FluidSettings;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+    FluidSettings settings;
+    uint32_t size[3];
+    uint32_t levelCount;        // multigrid levels, the full grid first
+    uint32_t levelSizes[kFluidMaxLevels][3];
+    uint32_t velocityCurrent;   // velocity texture holding the latest step
+    uint32_t dyeCurrent;
+    bool pendingReset;
+    Mat4 boxToClip;
+
+    WGPUBuffer uniformBuffer;
+    WGPUBuffer levelBuffer;     // per level and color, one block per 256 bytes, bound at an offset
+    WGPUTexture velocityTextures[2];
+    WGPUTextureView velocityViews[2];
+    WGPUTexture dyeTextures[2];
+    WGPUTextureView dyeViews[2];
+    WGPUTexture curlTexture;
+    WGPUTextureView curlView;
+    WGPUSampler sampler;
+    WGPUBuffer pressureBuffers[2];                  // Jacobi ping-pongs, Gauss-Seidel uses the first
+    WGPUBuffer divergenceBuffer;
+    WGPUBuffer coarsePressureBuffers[kFluidMaxLevels];  // multigrid levels from 1
+    WGPUBuffer coarseRhsBuffers[kFluidMaxLevels];
+
+    WGPUComputePipeline clearVelocityPipeline;
+    WGPUComputePipeline clearDyePipeline;
+    WGPUComputePipeline advectVelocityPipeline;
+    WGPUComputePipeline advectDyePipeline;
+    WGPUComputePipeline curlPipeline;
+    WGPUComputePipeline confinePipeline;
+    WGPUComputePipeline divergencePipeline;
+    WGPUComputePipeline gradientPipeline;
+    WGPUComputePipeline jacobiPipeline;
+    WGPUComputePipeline smoothPipeline;
+    WGPUComputePipeline restrictPipeline;
+    WGPUComputePipeline prolongPipeline;
+
+    // By input velocity (and dye) texture
+    WGPUBindGroup clearVelocityBindGroups[2];
+    WGPUBindGroup clearDyeBindGroups[2];
+    WGPUBindGroup advectVelocityBindGroups[2];
+    WGPUBindGroup advectDyeBindGroups[2][2];        // [velocity][dye]
+    WGPUBindGroup curlBindGroups[2];
+    WGPUBindGroup confineBindGroups[2];
+    WGPUBindGroup divergenceBindGroups[2];
+    WGPUBindGroup gradientBindGroups[2];
+    WGPUBindGroup jacobiBindGroups[2];              // by input pressure buffer
+    WGPUBindGroup smoothBindGroups[kFluidMaxLevels][2];     // by level and color
+    WGPUBindGroup restrictBindGroups[kFluidMaxLevels];      // by coarse level
+    WGPUBindGroup prolongBindGroups[kFluidMaxLevels];
+
+    WGPURenderPipeline renderPipeline;  // NULL when created without a color format
+    WGPUBindGroup renderBindGroups[2];  // by dye texture
+} Fluid;
+
+/** Smoke pushed up from the bottom of the box, multigrid, with vorticity. */
+FluidSettings defaultFluidSettings(void);
+
+/**
+ * A `width` x `height` x `depth` grid, at rest and without dye. With a
+ * color format the dye can be drawn, additively, in passes with these
+ * formats and sample count; pass WGPUTextureFormat_Undefined to only
+ * simulate.
+ */
+bool createFluid(Fluid* fluid,
+                 WGPUDevice device,
+                 WGPUQueue queue,
+                 uint32_t width,
+                 uint32_t height,
+                 uint32_t depth,
+                 const FluidSettings* settings,
+                 WGPUTextureFormat colorFormat,
+                 WGPUTextureFormat depthFormat,
+                 uint32_t sampleCount);
+
+void releaseFluid(Fluid* fluid);
+
+/** Takes effect on the next step. */
+void fluidSetSettings(Fluid* fluid, const FluidSettings* settings);
+
+/** Back at rest without dye on the next step. */
+void fluidReset(Fluid* fluid);
+
+/** Where the next fluidDraw() puts the 0..1 box, uploaded by the next step. */
+void fluidSetTransform(Fluid* fluid, Mat4 boxToClip);
+
+/** Record one step in its own compute pass. */
+void fluidStep(Fluid* fluid, WGPUCommandEncoder encoder, const WGPUComputePassTimestampWrites* timestamps);
+
+void fluidDraw(Fluid* fluid, WGPURenderPassEncoder pass);
+
+/** The dye of the last step: a 3D rgba16float view, filterable. */
+WGPUTextureView fluidDyeView(const Fluid* fluid);
+
+#endif // FLUID_H
@@ -13,6 +13,20 @@ typedef struct{
     WGPUDevice device;
     WGPUQueue queue;
     WGPUSurface surface;
+    WGPUTextureFormat surfaceFormat;
+
+    // Optional features negotiated in initWebGPU()
+    bool textureCompressionBC;
+    bool textureCompressionETC2;
+    bool textureCompressionASTC;
+    bool timestampQuery;
+
+    // Samples of the multisampled scene passes, 1 or 4 (see msaa.h)
+    uint32_t sampleCount;
+
+    // What the device runs on, for benchmark reports
+    char adapterName[128];
+    WGPUBackendType backendType;
 } Context;
 
 extern const uint32_t kScreenWidth;
@@ -0,0 +1,380 @@
+#include "gpu-sort.h"
+#include "webgpu-utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * GpuSortList.argsBuffer, in u32s: the dispatch size of every sort
+ * dispatch, then the count, the padded count, and the two constants
+ * written at creation.
+ */
+#define kArgsCount        3
+#define kArgsPadded       4
+#define kArgsCountIndex   5
+#define kArgsCapacity     6
+#define kArgsSize         (8 * sizeof(uint32_t))
+
+#define kStepStride 256     // minUniformBufferOffsetAlignment
+
+static const char* kSortPrepareWGSL =
+"@group(0) @binding(0) var<storage, read> counts: array<u32>;\n"
+"@group(0) @binding(1) var<storage, read_write> sortArgs: array<u32, 8>;\n"
+"\n"
+"const kSortBlock = 512u;\n"
+"\n"
+"@compute @workgroup_size(1)\n"
+"fn prepare() {\n"
+"    let count = min(counts[sortArgs[5]], sortArgs[6]);\n"
+"    var padded = kSortBlock;\n"
+"    while (padded < count) {\n"
+"        padded <<= 1u;\n"
+"    }\n"
+"    sortArgs[0] = select(0u, padded / kSortBlock, count > 1u);\n"
+"    sortArgs[1] = 1u;\n"
+"    sortArgs[2] = 1u;\n"
+"    sortArgs[3] = count;\n"
+"    sortArgs[4] = padded;\n"
+"}\n";
+
+/**
+ * Every dispatch covers the padded count with 256 threads per 512
+ * elements: one compare-exchange each.
+ */
+static const char* kSortWGSL =
+"struct SortStep {\n"
+"    blockSize: u32,\n"
+"    distance: u32,\n"
+"}\n"
+"\n"
+"@group(0) @binding(0) var<uniform> sortStep: SortStep;\n"
+"@group(0) @binding(1) var<storage, read_write> sortKeys: array<u32>;\n"
+"@group(0) @binding(2) var<storage, read_write> sortValues: array<u32>;\n"
+"@group(0) @binding(3) var<storage, read> sortArgs: array<u32, 8>;\n"
+"\n"
+"const kSortBlock = 512u;\n"
+"\n"
+"var<workgroup> localKeys: array<u32, 512>;\n"
+"var<workgroup> localValues: array<u32, 512>;\n"
+"\n"
+"// First element of pair `lane` in a step comparing elements `distance` apart\n"
+"fn pairFirst(lane: u32, distance: u32) -> u32 {\n"
+"    return ((lane & ~(distance - 1u)) << 1u) | (lane & (distance - 1u));\n"
+"}\n"
+"\n"
+"fn compareLocal(lane: u32, blockStart: u32, blockSize: u32, distance: u32) {\n"
+"    let i = pairFirst(lane, distance);\n"
+"    let partner = i | distance;\n"
+"    let ascending = ((blockStart + i) & blockSize) == 0u;\n"
+"    let a = localKeys[i];\n"
+"    let b = localKeys[partner];\n"
+"    if ((a > b) == ascending && a != b) {\n"
+"        localKeys[i] = b;\n"
+"        localKeys[partner] = a;\n"
+"        let value = localValues[i];\n"
+"        localValues[i] = localValues[partner];\n"
+"        localValues[partner] = value;\n"
+"    }\n"
+"}\n"
+"\n"
+"fn storeLocal(lane: u32, blockStart: u32) {\n"
+"    for (var e = lane; e < kSortBlock; e += 256u) {\n"
+"        sortKeys[blockStart + e] = localKeys[e];\n"
+"        sortValues[blockStart + e] = localValues[e];\n"
+"    }\n"
+"}\n"
+"\n"
+"// Sorts every 512-element block, in alternating directions\n"
+"@compute @workgroup_size(256)\n"
+"fn presort(@builtin(workgroup_id) blockIndex: vec3u, @builtin(local_invocation_index) lane: u32) {\n"
+"    let blockStart = blockIndex.x * kSortBlock;\n"
+"    let count = sortArgs[3];\n"
+"    for (var e = lane; e < kSortBlock; e += 256u) {\n"
+"        let index = blockStart + e;\n"
+"        let live = index < count;\n"
+"        localKeys[e] = select(0xffffffffu, sortKeys[index], live);\n"
+"        localValues[e] = select(0xffffffffu, sortValues[index], live);\n"
+"    }\n"
+"    for (var blockSize = 2u; blockSize <= kSortBlock; blockSize <<= 1u) {\n"
+"        for (var distance = blockSize >> 1u; distance > 0u; distance >>= 1u) {\n"
+"            workgroupBarrier();\n"
+"            compareLocal(lane, blockStart, blockSize, distance);\n"
+"        }\n"
+"    }\n"
+"    workgroupBarrier();\n"
+"    storeLocal(lane, blockStart);\n"
+"}\n"
+"\n"
+"// The steps of a merge whose pairs are less than 512 elements apart\n"
+"@compute @workgroup_size(256)\n"
+"fn merge(@builtin(workgroup_id) blockIndex: vec3u, @builtin(local_invocation_index) lane: u32) {\n"
+"    let blockStart = blockIndex.x * kSortBlock;\n"
+"    for (var e = lane; e < kSortBlock; e += 256u) {\n"
+"        localKeys[e] = sortKeys[blockStart + e];\n"
+"        localValues[e] = sortValues[blockStart + e];\n"
+"    }\n"
+"    for (var distance = kSortBlock >> 1u; distance > 0u; distance >>= 1u) {\n"
+"        workgroupBarrier();\n"
+"        compareLocal(lane, blockStart, sortStep.blockSize, distance);\n"
+"    }\n"
+"    workgroupBarrier();\n"
+"    storeLocal(lane, blockStart);\n"
+"}\n"
+"\n"
+"// One step of a merge whose pairs are 512 elements apart or more\n"
+"@compute @workgroup_size(256)\n"
+"fn mergeStep(@builtin(global_invocation_id) id: vec3u) {\n"
+"    let i = pairFirst(id.x, sortStep.distance);\n"
+"    let partner = i | sortStep.distance;\n"
+"    if (partner >= sortArgs[4]) {\n"
+"        return;\n"
+"    }\n"
+"    let ascending = (i & sortStep.blockSize) == 0u;\n"
+"    let a = sortKeys[i];\n"
+"    let b = sortKeys[partner];\n"
+"    if ((a > b) == ascending && a != b) {\n"
+"        sortKeys[i] = b;\n"
+"        sortKeys[partner] = a;\n"
+"        let value = sortValues[i];\n"
+"        sortValues[i] = sortValues[partner];\n"
+"        sortValues[partner] = value;\n"
+"    }\n"
+"}\n";
+
+static WGPUComputePipeline createSortPipeline(WGPUDevice device, const char* label, WGPUBindGroupLayout layout,
+                                              WGPUShaderModule module, const char* entryPoint)
+{
+    WGPUPipelineLayoutDescriptor pipelineLayoutDesc = {0};
+    pipelineLayoutDesc.label = label;
+    pipelineLayoutDesc.bindGroupLayoutCount = 1;
+    pipelineLayoutDesc.bindGroupLayouts = &layout;
+    WGPUPipelineLayout pipelineLayout = wgpuDeviceCreatePipelineLayout(device, &pipelineLayoutDesc);
+    if (!pipelineLayout) return NULL;
+
+    WGPUComputePipelineDescriptor desc = {0};
+    desc.label = label;
+    desc.layout = pipelineLayout;
+    desc.compute.module = module;
+    desc.compute.entryPoint = entryPoint;
+    WGPUComputePipeline pipeline = wgpuDeviceCreateComputePipeline(device, &desc);
+    wgpuPipelineLayoutRelease(pipelineLayout);
+    if (!pipeline) {
+        fprintf(stderr, "Failed to create %s\n", label);
+    }
+    return pipeline;
+}
+
+static bool createLayouts(GpuSort* sort)
+{
+    WGPUBindGroupLayoutEntry prepareEntries[2] = {0};
+    prepareEntries[0].binding = 0;
+    prepareEntries[0].visibility = WGPUShaderStage_Compute;
+    prepareEntries[0].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+    prepareEntries[1].binding = 1;
+    prepareEntries[1].visibility = WGPUShaderStage_Compute;
+    prepareEntries[1].buffer.type = WGPUBufferBindingType_Storage;
+
+    WGPUBindGroupLayoutDescriptor layoutDesc = {0};
+    layoutDesc.label = "Sort prepare layout";
+    layoutDesc.entryCount = 2;
+    layoutDesc.entries = prepareEntries;
+    sort->prepareLayout = wgpuDeviceCreateBindGroupLayout(sort->device, &layoutDesc);
+
+    // The args are read-only here: the same dispatches read them as indirect arguments
+    WGPUBindGroupLayoutEntry sortEntries[4] = {0};
+    for (uint32_t i = 0; i < 4; ++i) {
+        sortEntries[i].binding = i;
+        sortEntries[i].visibility = WGPUShaderStage_Compute;
+    }
+    sortEntries[0].buffer.type = WGPUBufferBindingType_Uniform;
+    sortEntries[0].buffer.hasDynamicOffset = true;
+    sortEntries[0].buffer.minBindingSize = 2 * sizeof(uint32_t);
+    sortEntries[1].buffer.type = WGPUBufferBindingType_Storage;
+    sortEntries[2].buffer.type = WGPUBufferBindingType_Storage;
+    sortEntries[3].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+
+    layoutDesc.label = "Sort layout";
+    layoutDesc.entryCount = 4;
+    layoutDesc.entries = sortEntries;
+    sort->sortLayout = wgpuDeviceCreateBindGroupLayout(sort->device, &layoutDesc);
+
+    return sort->prepareLayout && sort->sortLayout;
+}
+
+static bool createSteps(GpuSort* sort)
+{
+    // The step parameters differ per dispatch: one block each, picked by dynamic offset
+    uint8_t* steps = calloc(kGpuSortMaxSteps, kStepStride);
+    if (!steps) {
+        fprintf(stderr, "createGpuSort: out of memory\n");
+        return false;
+    }
+    uint32_t count = 0;
+    sort->stepLocal[count++] = true; // presort
+    for (uint32_t blockSize = 2 * kGpuSortBlock; blockSize <= sort->capacity; blockSize <<= 1) {
+        for (uint32_t distance = blockSize / 2; distance >= kGpuSortBlock; distance >>= 1) {
+            uint32_t step[2] = { blockSize, distance };
+            memcpy(steps + count * kStepStride, step, sizeof step);
+            sort->stepLocal[count++] = false;
+        }
+        uint32_t step[2] = { blockSize, 0 };
+        memcpy(steps + count * kStepStride, step, sizeof step);
+        sort->stepLocal[count++] = true;
+    }
+    sort->stepCount = count;
+
+    sort->stepBuffer = createBuffer(sort->device, "Sort steps", (uint64_t)count * kStepStride,
+                                    WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    if (sort->stepBuffer) {
+        wgpuQueueWriteBuffer(sort->queue, sort->stepBuffer, 0, steps, (size_t)count * kStepStride);
+    }
+    free(steps);
+    return sort->stepBuffer != NULL;
+}
+
+bool createGpuSort(GpuSort* sort, WGPUDevice device, WGPUQueue queue, uint32_t maxCount)
+{
+    memset(sort, 0, sizeof *sort);
+    if (maxCount > kGpuSortMaxCapacity) {
+        fprintf(stderr, "createGpuSort: %u elements is over the maximum of %u\n", maxCount, kGpuSortMaxCapacity);
+        return false;
+    }
+    sort->device = device;
+    sort->queue = queue;
+    sort->capacity = kGpuSortBlock;
+    while (sort->capacity < maxCount) sort->capacity <<= 1;
+
+    if (!createLayouts(sort) || !createSteps(sort)) {
+        releaseGpuSort(sort);
+        return false;
+    }
+
+    WGPUShaderModule prepareModule = createShaderModule(device, "Sort prepare shader", kSortPrepareWGSL);
+    WGPUShaderModule module = createShaderModule(device, "Sort shader", kSortWGSL);
+    if (prepareModule) {
+        sort->preparePipeline = createSortPipeline(device, "Sort prepare pipeline", sort->prepareLayout,
+                                                   prepareModule, "prepare");
+        wgpuShaderModuleRelease(prepareModule);
+    }
+    if (module) {
+        sort->presortPipeline = createSortPipeline(device, "Sort presort pipeline", sort->sortLayout, module,
+                                                   "presort");
+        sort->mergePipeline = createSortPipeline(device, "Sort merge pipeline", sort->sortLayout, module, "merge");
+        sort->mergeStepPipeline = createSortPipeline(device, "Sort merge step pipeline", sort->sortLayout, module,
+                                                     "mergeStep");
+        wgpuShaderModuleRelease(module);
+    }
+    if (!sort->preparePipeline || !sort->presortPipeline || !sort->mergePipeline || !sort->mergeStepPipeline) {
+        releaseGpuSort(sort);
+        return false;
+    }
+    return true;
+}
+
+void releaseGpuSort(GpuSort* sort)
+{
+    if (sort->preparePipeline) wgpuComputePipelineRelease(sort->preparePipeline);
+    if (sort->presortPipeline) wgpuComputePipelineRelease(sort->presortPipeline);
+    if (sort->mergePipeline) wgpuComputePipelineRelease(sort->mergePipeline);
+    if (sort->mergeStepPipeline) wgpuComputePipelineRelease(sort->mergeStepPipeline);
+    if (sort->prepareLayout) wgpuBindGroupLayoutRelease(sort->prepareLayout);
+    if (sort->sortLayout) wgpuBindGroupLayoutRelease(sort->sortLayout);
+    if (sort->stepBuffer) {
+        wgpuBufferDestroy(sort->stepBuffer);
+        wgpuBufferRelease(sort->stepBuffer);
+    }
+    memset(sort, 0, sizeof *sort);
+}
+
+bool createGpuSortList(GpuSort* sort,
+                       GpuSortList* list,
+                       WGPUBuffer keys,
+                       WGPUBuffer values,
+                       WGPUBuffer counts,
+                       uint32_t countIndex)
+{
+    memset(list, 0, sizeof *list);
+    uint64_t listSize = (uint64_t)sort->capacity * sizeof(uint32_t);
+    if (wgpuBufferGetSize(keys) < listSize || wgpuBufferGetSize(values) < listSize) {
+        fprintf(stderr, "createGpuSortList: keys and values need room for %u elements\n", sort->capacity);
+        return false;
+    }
+
+    list->argsBuffer = createBuffer(sort->device, "Sort args", kArgsSize,
+                                    WGPUBufferUsage_Storage | WGPUBufferUsage_Indirect | WGPUBufferUsage_CopyDst);
+    if (!list->argsBuffer) return false;
+    uint32_t args[8] = {0};
+    args[kArgsCountIndex] = countIndex;
+    args[kArgsCapacity] = sort->capacity;
+    wgpuQueueWriteBuffer(sort->queue, list->argsBuffer, 0, args, sizeof args);
+
+    WGPUBindGroupEntry prepareEntries[2] = {0};
+    prepareEntries[0].binding = 0;
+    prepareEntries[0].buffer = counts;
+    prepareEntries[0].size = wgpuBufferGetSize(counts);
+    prepareEntries[1].binding = 1;
+    prepareEntries[1].buffer = list->argsBuffer;
+    prepareEntries[1].size = kArgsSize;
+
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = "Sort prepare bind group";
+    desc.layout = sort->prepareLayout;
+    desc.entryCount = 2;
+    desc.entries = prepareEntries;
+    list->prepareBindGroup = wgpuDeviceCreateBindGroup(sort->device, &desc);
+
+    WGPUBindGroupEntry sortEntries[4] = {0};
+    sortEntries[0].binding = 0;
+    sortEntries[0].buffer = sort->stepBuffer;
+    sortEntries[0].size = 2 * sizeof(uint32_t);
+    sortEntries[1].binding = 1;
+    sortEntries[1].buffer = keys;
+    sortEntries[1].size = listSize;
+    sortEntries[2].binding = 2;
+    sortEntries[2].buffer = values;
+    sortEntries[2].size = listSize;
+    sortEntries[3].binding = 3;
+    sortEntries[3].buffer = list->argsBuffer;
+    sortEntries[3].size = kArgsSize;
+
+    desc.label = "Sort bind group";
+    desc.layout = sort->sortLayout;
+    desc.entryCount = 4;
+    desc.entries = sortEntries;
+    list->sortBindGroup = wgpuDeviceCreateBindGroup(sort->device, &desc);
+
+    if (!list->prepareBindGroup || !list->sortBindGroup) {
+        releaseGpuSortList(list);
+        return false;
+    }
+    return true;
+}
+
+void releaseGpuSortList(GpuSortList* list)
+{
+    if (list->prepareBindGroup) wgpuBindGroupRelease(list->prepareBindGroup);
+    if (list->sortBindGroup) wgpuBindGroupRelease(list->sortBindGroup);
+    if (list->argsBuffer) {
+        wgpuBufferDestroy(list->argsBuffer);
+        wgpuBufferRelease(list->argsBuffer);
+    }
+    memset(list, 0, sizeof *list);
+}
+
+void gpuSortRecord(const GpuSort* sort, const GpuSortList* list, WGPUComputePassEncoder pass)
+{
+    wgpuComputePassEncoderSetPipeline(pass, sort->preparePipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, list->prepareBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, 1, 1, 1);
+
+    for (uint32_t i = 0; i < sort->stepCount; ++i) {
+        WGPUComputePipeline pipeline = i == 0 ? sort->presortPipeline
+                                     : sort->stepLocal[i] ? sort->mergePipeline
+                                                          : sort->mergeStepPipeline;
+        uint32_t offset = i * kStepStride;
+        wgpuComputePassEncoderSetPipeline(pass, pipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, list->sortBindGroup, 1, &offset);
+        wgpuComputePassEncoderDispatchWorkgroupsIndirect(pass, list->argsBuffer, 0);
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef GPU_SORT_H
+#define GPU_SORT_H
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * GPU SORT
+ *
+ * Bitonic sort of (u32 key, u32 value) pairs, ascending by key, in place,
+ * recorded into a compute pass. The element count is read on the GPU when
+ * the sort runs, so lists produced by earlier dispatches (compaction,
+ * culling) sort without a readback:
+ *  - prepare: reads the count and writes the dispatch size, the count
+ *    padded to a power of two
+ *  - presort: sorts every 512-element block in workgroup memory, padding
+ *    the list with 0xffffffff keys
+ *  - merges: pairs 512 elements apart or more are merged one step per
+ *    dispatch in global memory, closer ones in workgroup memory
+ *
+ * Every step is recorded for the full capacity; the ones the count
+ * doesn't reach dispatch over a list that is already sorted and change
+ * nothing. Key and value buffers need room for `capacity` elements (the
+ * max count rounded up to a power of two): the padding is written there.
+ *
+ * Float keys sort correctly through sortableFloat() in kGpuSortKeyWGSL.
+ */
+
+#define kGpuSortBlock 512
+#define kGpuSortMaxCapacity (1u << 24)
+#define kGpuSortMaxSteps 136
+
+/** WGSL helper mapping f32 to u32 keys of the same order; NaNs excluded. */
+#define kGpuSortKeyWGSL \
+"fn sortableFloat(value: f32) -> u32 {\n" \
+"    let bits = bitcast<u32>(value);\n" \
+"    return bits ^ select(0x80000000u, 0xffffffffu, (bits & 0x80000000u) != 0u);\n" \
+"}\n"
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+    uint32_t capacity;          // power of two, at least kGpuSortBlock
+
+    WGPUBindGroupLayout prepareLayout;
+    WGPUBindGroupLayout sortLayout;
+    WGPUComputePipeline preparePipeline;
+    WGPUComputePipeline presortPipeline;
+    WGPUComputePipeline mergePipeline;
+    WGPUComputePipeline mergeStepPipeline;
+    WGPUBuffer stepBuffer;      // one block per sort dispatch, dynamic offsets
+    uint32_t stepCount;
+    bool stepLocal[kGpuSortMaxSteps];   // merge in workgroup memory, else one global step
+} GpuSort;
+
+/** One list sorted by a GpuSort, and where its count comes from. */
+typedef struct {
+    WGPUBuffer argsBuffer;      // dispatch arguments, count and padded count (Indirect | Storage)
+    WGPUBindGroup prepareBindGroup;
+    WGPUBindGroup sortBindGroup;
+} GpuSortList;
+
+/** Sorts lists of up to `maxCount` elements. */
+bool createGpuSort(GpuSort* sort, WGPUDevice device, WGPUQueue queue, uint32_t maxCount);
+
+void releaseGpuSort(GpuSort* sort);
+
+/**
+ * The element count is the u32 at index `countIndex` of `counts` (a
+ * storage buffer); counts above the capacity are clamped.
+ */
+bool createGpuSortList(GpuSort* sort,
+                       GpuSortList* list,
+                       WGPUBuffer keys,
+                       WGPUBuffer values,
+                       WGPUBuffer counts,
+                       uint32_t countIndex);
+
+void releaseGpuSortList(GpuSortList* list);
+
+/** Record the sort of `list`, after whatever wrote it in the same pass. */
+void gpuSortRecord(const GpuSort* sort, const GpuSortList* list, WGPUComputePassEncoder pass);
+
+#endif // GPU_SORT_H
@@ -0,0 +1,193 @@
+#include "hiz.h"
+#include "webgpu-utils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* kHiZWGSL =
+"@group(0) @binding(0) var depth: texture_depth_2d;\n"
+"@group(0) @binding(1) var source: texture_2d<f32>;\n"
+"@group(0) @binding(2) var destination: texture_storage_2d<r32float, write>;\n"
+"\n"
+"// Level 0 is smaller than the depth buffer by a factor in [1, 2) per axis:\n"
+"// take the max over every depth texel the level 0 texel overlaps\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn reduceDepth(@builtin(global_invocation_id) id: vec3u) {\n"
+"    let size = textureDimensions(destination);\n"
+"    if (any(id.xy >= size)) {\n"
+"        return;\n"
+"    }\n"
+"    let depthSize = textureDimensions(depth);\n"
+"    let texelMin = id.xy * depthSize / size;\n"
+"    let texelMax = min(((id.xy + 1u) * depthSize + size - 1u) / size, depthSize);\n"
+"    var farthest = 0.0;\n"
+"    for (var y = texelMin.y; y < texelMax.y; y++) {\n"
+"        for (var x = texelMin.x; x < texelMax.x; x++) {\n"
+"            farthest = max(farthest, textureLoad(depth, vec2u(x, y), 0));\n"
+"        }\n"
+"    }\n"
+"    textureStore(destination, id.xy, vec4f(farthest, 0.0, 0.0, 0.0));\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn reduceLevel(@builtin(global_invocation_id) id: vec3u) {\n"
+"    let size = textureDimensions(destination);\n"
+"    if (any(id.xy >= size)) {\n"
+"        return;\n"
+"    }\n"
+"    // Once an axis is down to one texel the other keeps halving: clamp\n"
+"    let edge = textureDimensions(source) - 1u;\n"
+"    let base = id.xy * 2u;\n"
+"    let a = textureLoad(source, min(base, edge), 0).r;\n"
+"    let b = textureLoad(source, min(base + vec2u(1u, 0u), edge), 0).r;\n"
+"    let c = textureLoad(source, min(base + vec2u(0u, 1u), edge), 0).r;\n"
+"    let d = textureLoad(source, min(base + vec2u(1u, 1u), edge), 0).r;\n"
+"    textureStore(destination, id.xy, vec4f(max(max(a, b), max(c, d)), 0.0, 0.0, 0.0));\n"
+"}\n";
+
+static uint32_t floorPowerOfTwo(uint32_t value)
+{
+    uint32_t result = 1;
+    while (result * 2 <= value) result *= 2;
+    return result;
+}
+
+static WGPUTextureView createMipView(WGPUTexture texture, uint32_t baseMip, uint32_t mipCount)
+{
+    WGPUTextureViewDescriptor desc = {0};
+    desc.label = "Hi-Z view";
+    desc.format = WGPUTextureFormat_R32Float;
+    desc.dimension = WGPUTextureViewDimension_2D;
+    desc.baseMipLevel = baseMip;
+    desc.mipLevelCount = mipCount;
+    desc.baseArrayLayer = 0;
+    desc.arrayLayerCount = 1;
+    desc.aspect = WGPUTextureAspect_All;
+    return wgpuTextureCreateView(texture, &desc);
+}
+
+static WGPUBindGroup createReduceBindGroup(HiZPyramid* hiz, WGPUComputePipeline pipeline,
+                                           uint32_t sourceBinding, WGPUTextureView source,
+                                           WGPUTextureView destination)
+{
+    WGPUBindGroupEntry entries[2] = {0};
+    entries[0].binding = sourceBinding;
+    entries[0].textureView = source;
+    entries[1].binding = 2;
+    entries[1].textureView = destination;
+
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(pipeline, 0);
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = "Hi-Z bind group";
+    desc.layout = layout;
+    desc.entryCount = 2;
+    desc.entries = entries;
+    WGPUBindGroup bindGroup = wgpuDeviceCreateBindGroup(hiz->device, &desc);
+    wgpuBindGroupLayoutRelease(layout);
+    return bindGroup;
+}
+
+bool createHiZPyramid(HiZPyramid* hiz, WGPUDevice device, uint32_t depthWidth, uint32_t depthHeight)
+{
+    memset(hiz, 0, sizeof *hiz);
+    hiz->device = device;
+    hiz->depthWidth = depthWidth;
+    hiz->depthHeight = depthHeight;
+    hiz->width = floorPowerOfTwo(depthWidth);
+    hiz->height = floorPowerOfTwo(depthHeight);
+
+    uint32_t largest = hiz->width > hiz->height ? hiz->width : hiz->height;
+    hiz->mipCount = 1;
+    while ((largest >> hiz->mipCount) > 0 && hiz->mipCount < kHiZMaxMips) hiz->mipCount++;
+
+    WGPUTextureDescriptor textureDesc = {0};
+    textureDesc.label = "Hi-Z pyramid";
+    textureDesc.usage = WGPUTextureUsage_StorageBinding | WGPUTextureUsage_TextureBinding;
+    textureDesc.dimension = WGPUTextureDimension_2D;
+    textureDesc.size.width = hiz->width;
+    textureDesc.size.height = hiz->height;
+    textureDesc.size.depthOrArrayLayers = 1;
+    textureDesc.format = WGPUTextureFormat_R32Float;
+    textureDesc.mipLevelCount = hiz->mipCount;
+    textureDesc.sampleCount = 1;
+    hiz->texture = wgpuDeviceCreateTexture(device, &textureDesc);
+    if (!hiz->texture) {
+        fprintf(stderr, "createHiZPyramid: could not create the pyramid texture\n");
+        return false;
+    }
+    hiz->view = createMipView(hiz->texture, 0, hiz->mipCount);
+    for (uint32_t mip = 0; mip < hiz->mipCount; ++mip) {
+        hiz->mipViews[mip] = createMipView(hiz->texture, mip, 1);
+    }
+
+    WGPUShaderModule module = createShaderModule(device, "Hi-Z shader", kHiZWGSL);
+    if (!module) {
+        releaseHiZPyramid(hiz);
+        return false;
+    }
+    hiz->firstPipeline = createComputePipeline(device, "Hi-Z depth pipeline", module, "reduceDepth");
+    hiz->reducePipeline = createComputePipeline(device, "Hi-Z reduce pipeline", module, "reduceLevel");
+    wgpuShaderModuleRelease(module);
+    if (!hiz->firstPipeline || !hiz->reducePipeline) {
+        releaseHiZPyramid(hiz);
+        return false;
+    }
+
+    for (uint32_t mip = 1; mip < hiz->mipCount; ++mip) {
+        hiz->reduceBindGroups[mip] = createReduceBindGroup(hiz, hiz->reducePipeline, 1,
+                                                           hiz->mipViews[mip - 1], hiz->mipViews[mip]);
+        if (!hiz->reduceBindGroups[mip]) {
+            releaseHiZPyramid(hiz);
+            return false;
+        }
+    }
+    return true;
+}
+
+void releaseHiZPyramid(HiZPyramid* hiz)
+{
+    if (hiz->firstBindGroup) wgpuBindGroupRelease(hiz->firstBindGroup);
+    for (uint32_t mip = 0; mip < kHiZMaxMips; ++mip) {
+        if (hiz->reduceBindGroups[mip]) wgpuBindGroupRelease(hiz->reduceBindGroups[mip]);
+        if (hiz->mipViews[mip]) wgpuTextureViewRelease(hiz->mipViews[mip]);
+    }
+    if (hiz->firstPipeline) wgpuComputePipelineRelease(hiz->firstPipeline);
+    if (hiz->reducePipeline) wgpuComputePipelineRelease(hiz->reducePipeline);
+    if (hiz->view) wgpuTextureViewRelease(hiz->view);
+    if (hiz->texture) {
+        wgpuTextureDestroy(hiz->texture);
+        wgpuTextureRelease(hiz->texture);
+    }
+    memset(hiz, 0, sizeof *hiz);
+}
+
+void hizBuild(HiZPyramid* hiz, WGPUCommandEncoder encoder, WGPUTextureView depthView)
+{
+    // The depth view only changes when the caller recreates its depth buffer
+    if (hiz->firstBindGroupSource != depthView) {
+        if (hiz->firstBindGroup) wgpuBindGroupRelease(hiz->firstBindGroup);
+        hiz->firstBindGroup = createReduceBindGroup(hiz, hiz->firstPipeline, 0, depthView, hiz->mipViews[0]);
+        hiz->firstBindGroupSource = depthView;
+        if (!hiz->firstBindGroup) return;
+    }
+
+    WGPUComputePassDescriptor passDesc = {0};
+    passDesc.label = "Hi-Z build pass";
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+
+    wgpuComputePassEncoderSetPipeline(pass, hiz->firstPipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, hiz->firstBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, (hiz->width + 7) / 8, (hiz->height + 7) / 8, 1);
+
+    // Each dispatch reads the level the previous one wrote
+    wgpuComputePassEncoderSetPipeline(pass, hiz->reducePipeline);
+    for (uint32_t mip = 1; mip < hiz->mipCount; ++mip) {
+        uint32_t width = hiz->width >> mip ? hiz->width >> mip : 1;
+        uint32_t height = hiz->height >> mip ? hiz->height >> mip : 1;
+        wgpuComputePassEncoderSetBindGroup(pass, 0, hiz->reduceBindGroups[mip], 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, (width + 7) / 8, (height + 7) / 8, 1);
+    }
+
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+}
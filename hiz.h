@@ -0,0 +1,48 @@
+#ifndef HIZ_H
+#define HIZ_H
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * HIERARCHICAL Z
+ *
+ * A max-depth pyramid of a depth buffer, built in compute. Level 0 is the
+ * depth buffer's size rounded down to powers of two, and every texel of
+ * every level holds the farthest depth of the screen area it covers, so
+ * a bounding box whose nearest depth is farther than the (at most 2x2)
+ * texels under it is hidden.
+ *
+ * The pyramid is an R32Float texture with a full mip chain; `view` sees
+ * every level for textureLoad() in culling shaders.
+ */
+
+#define kHiZMaxMips 16
+
+typedef struct {
+    WGPUDevice device;
+    WGPUTexture texture;
+    WGPUTextureView view;                   // all levels, for culling
+    WGPUTextureView mipViews[kHiZMaxMips];  // one level each, for the build
+    uint32_t width, height;                 // level 0
+    uint32_t mipCount;
+    uint32_t depthWidth, depthHeight;
+
+    WGPUComputePipeline firstPipeline;      // depth buffer -> level 0
+    WGPUComputePipeline reducePipeline;     // level i - 1 -> level i
+    WGPUBindGroup firstBindGroup;
+    WGPUTextureView firstBindGroupSource;   // depth view firstBindGroup reads
+    WGPUBindGroup reduceBindGroups[kHiZMaxMips];
+} HiZPyramid;
+
+/** Pyramid for a depth buffer of the given size (recreate it on resize). */
+bool createHiZPyramid(HiZPyramid* hiz, WGPUDevice device, uint32_t depthWidth, uint32_t depthHeight);
+
+void releaseHiZPyramid(HiZPyramid* hiz);
+
+/** Record the pyramid build from a depth view (single sample, any depth format). */
+void hizBuild(HiZPyramid* hiz, WGPUCommandEncoder encoder, WGPUTextureView depthView);
+
+#endif // HIZ_H
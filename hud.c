@@ -0,0 +1,120 @@
+#include "hud.h"
+
+#include <stdio.h>
+
+#define kHudGraphFrames 120
+#define kHudGraphHeight 48.0f
+#define kHudBarWidth 2.0f
+#define kHudPadding 6.0f
+
+void initPerfHud(PerfHud* hud)
+{
+    hud->visible = false;
+    hud->x = 8.0f;
+    hud->y = 8.0f;
+    hud->textSize = 12.0f;
+    hud->budgetMilliseconds = 1000.0f / 60.0f;
+}
+
+void hudToggle(PerfHud* hud, Profiler* profiler)
+{
+    hud->visible = !hud->visible;
+    // Timestamps only matter while someone is looking at them
+    profilerWantGpuTiming(profiler, hud->visible);
+}
+
+/** Format a counter value into `buffer` according to its unit. */
+static void formatCounter(const ProfilerCounter* counter, char* buffer, size_t size)
+{
+    switch (counter->unit) {
+    case ProfilerUnit_Bytes:
+        if (counter->value >= 1024.0 * 1024.0) {
+            snprintf(buffer, size, "%.1f MB", counter->value / (1024.0 * 1024.0));
+        } else if (counter->value >= 1024.0) {
+            snprintf(buffer, size, "%.1f KB", counter->value / 1024.0);
+        } else {
+            snprintf(buffer, size, "%.0f B", counter->value);
+        }
+        break;
+    case ProfilerUnit_Milliseconds:
+        snprintf(buffer, size, "%.2f ms", counter->value);
+        break;
+    case ProfilerUnit_Count:
+    default:
+        snprintf(buffer, size, "%.0f", counter->value);
+        break;
+    }
+}
+
+static void drawFrameGraph(const PerfHud* hud, const Profiler* profiler, TextRenderer* text,
+                           float x, float y)
+{
+    const uint32_t green = textColor(64, 200, 64, 230);
+    const uint32_t yellow = textColor(230, 200, 40, 230);
+    const uint32_t red = textColor(230, 50, 40, 230);
+
+    // The top of the graph is two budgets; the budget line sits halfway up
+    float scale = kHudGraphHeight / (2.0f * hud->budgetMilliseconds);
+    for (uint32_t i = 0; i < kHudGraphFrames; ++i) {
+        float milliseconds = profilerFrameMilliseconds(profiler, kHudGraphFrames - 1 - i);
+        if (milliseconds <= 0.0f) continue;
+
+        float height = milliseconds * scale;
+        if (height > kHudGraphHeight) height = kHudGraphHeight;
+        uint32_t color = milliseconds <= hud->budgetMilliseconds        ? green
+                         : milliseconds <= 2.0f * hud->budgetMilliseconds ? yellow
+                                                                          : red;
+        textDrawRect(text, x + i * kHudBarWidth, y + kHudGraphHeight - height, kHudBarWidth - 0.5f,
+                     height, color);
+    }
+    textDrawRect(text, x, y + kHudGraphHeight * 0.5f, kHudGraphFrames * kHudBarWidth, 1.0f,
+                 textColor(255, 255, 255, 96));
+}
+
+void hudDraw(const PerfHud* hud, const Profiler* profiler, TextRenderer* text)
+{
+    if (!hud->visible) return;
+
+    const uint32_t white = textColor(255, 255, 255, 255);
+    const uint32_t grey = textColor(170, 170, 170, 255);
+    float line = textLineHeight(hud->textSize);
+    float width = kHudGraphFrames * kHudBarWidth;
+
+    uint32_t lineCount = 3 + profiler->passCount + profiler->counterCount;
+    float height = kHudGraphHeight + kHudPadding + lineCount * line;
+    textDrawRect(text, hud->x - kHudPadding, hud->y - kHudPadding, width + 2 * kHudPadding,
+                 height + 2 * kHudPadding, textColor(0, 0, 0, 160));
+
+    float y = hud->y;
+    drawFrameGraph(hud, profiler, text, hud->x, y);
+    y += kHudGraphHeight + kHudPadding;
+
+    uint32_t last = (uint32_t)((profiler->frameIndex + kProfilerHistory - 1) % kProfilerHistory);
+    float frame = profilerFrameMilliseconds(profiler, 0);
+    textPrintf(text, hud->x, y, hud->textSize, white, "frame %6.2f ms  %5.0f fps",
+               frame, frame > 0.0f ? 1000.0f / frame : 0.0f);
+    y += line;
+    textPrintf(text, hud->x, y, hud->textSize, white, "cpu   %6.2f ms  queue %u",
+               profiler->frameIndex ? profiler->cpuMilliseconds[last] : 0.0f,
+               profilerQueueDepth(profiler));
+    y += line;
+
+    if (!profiler->gpuTimingSupported) {
+        textDraw(text, hud->x, y, hud->textSize, grey, "gpu   no timestamp queries");
+    } else {
+        textPrintf(text, hud->x, y, hud->textSize, white, "gpu   %6.2f ms", profiler->gpuMilliseconds);
+    }
+    y += line;
+    for (uint32_t i = 0; i < profiler->passCount; ++i) {
+        textPrintf(text, hud->x, y, hud->textSize, grey, "  %-14.14s %6.2f ms",
+                   profiler->passes[i].name, profiler->passes[i].milliseconds);
+        y += line;
+    }
+
+    for (uint32_t i = 0; i < profiler->counterCount; ++i) {
+        char value[32];
+        formatCounter(&profiler->counters[i], value, sizeof value);
+        textPrintf(text, hud->x, y, hud->textSize, grey, "%-16.16s %10s", profiler->counters[i].name, value);
+        y += line;
+    }
+}
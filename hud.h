@@ -0,0 +1,39 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include "profiler.h"
+#include "text.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * PERF HUD
+ *
+ * An overlay drawn into the frame from what the profiler collected:
+ *  - a bar graph of recent frame times, green under the frame budget,
+ *    yellow under twice the budget and red above
+ *  - CPU time, smoothed GPU time per pass and the queue depth
+ *  - every registered profiler counter (memory, uploads, allocations, ...)
+ *
+ * Everything, panel and graph included, goes through the text renderer,
+ * so the whole HUD is part of its single instanced draw. While hidden,
+ * hudDraw() returns right away and the HUD stops asking the profiler for
+ * GPU timestamps, so a hidden HUD costs nothing.
+ */
+
+typedef struct {
+    bool visible;
+    float x, y;                 // top-left corner, in pixels
+    float textSize;
+    float budgetMilliseconds;   // frame time the graph is colored against
+} PerfHud;
+
+void initPerfHud(PerfHud* hud);
+
+void hudToggle(PerfHud* hud, Profiler* profiler);
+
+/** Queue the HUD for this frame (nothing when hidden). */
+void hudDraw(const PerfHud* hud, const Profiler* profiler, TextRenderer* text);
+
+#endif // HUD_H
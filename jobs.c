@@ -0,0 +1,194 @@
+#include "jobs.h"
+
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define kMaxWorkers 64
+
+/**
+ * The one loop currently being executed by the pool.
+ *
+ * - next:     next iteration index to hand out
+ * - finished: iterations completed so far
+ * - active:   workers that still hold a reference to this batch
+ */
+typedef struct {
+    JobFunction function;
+    void* userData;
+    uint32_t count;
+    SDL_AtomicInt next;
+    SDL_AtomicInt finished;
+    SDL_AtomicInt active;
+} JobBatch;
+
+typedef struct {
+    SDL_Thread* threads[kMaxWorkers];
+    uint32_t workerCount;
+
+    SDL_Mutex* mutex;           // guards batch / generation / quit
+    SDL_Condition* wake;        // workers wait for a new generation
+    SDL_Condition* done;        // submitter waits for the batch to drain
+    SDL_Mutex* submitMutex;     // one loop in flight at a time
+
+    JobBatch* batch;
+    uint64_t generation;
+    bool quit;
+} JobSystem;
+
+static JobSystem gJobs = {0};
+static SDL_TLSID gInsideJob;
+
+/** Pull iterations until the batch is exhausted. */
+static void runBatch(JobBatch* batch)
+{
+    for (;;) {
+        int index = SDL_AddAtomicInt(&batch->next, 1);
+        if ((uint32_t)index >= batch->count) break;
+        batch->function(batch->userData, (uint32_t)index);
+        SDL_AddAtomicInt(&batch->finished, 1);
+    }
+}
+
+static int workerMain(void* unused)
+{
+    (void)unused;
+    SDL_SetTLS(&gInsideJob, &gJobs, NULL);
+
+    uint64_t seenGeneration = 0;
+    SDL_LockMutex(gJobs.mutex);
+    for (;;) {
+        while (!gJobs.quit && gJobs.generation == seenGeneration) {
+            SDL_WaitCondition(gJobs.wake, gJobs.mutex);
+        }
+        if (gJobs.quit) break;
+
+        seenGeneration = gJobs.generation;
+        JobBatch* batch = gJobs.batch;
+        if (!batch) continue; // woke up after the submitter already drained it
+
+        SDL_AddAtomicInt(&batch->active, 1);
+        SDL_UnlockMutex(gJobs.mutex);
+
+        runBatch(batch);
+
+        SDL_LockMutex(gJobs.mutex);
+        if (SDL_AddAtomicInt(&batch->active, -1) == 1) {
+            SDL_BroadcastCondition(gJobs.done);
+        }
+    }
+    SDL_UnlockMutex(gJobs.mutex);
+    return 0;
+}
+
+/**
+ * INIT JOB SYSTEM
+ */
+bool initJobSystem(uint32_t workerCount)
+{
+    if (gJobs.mutex) return true; // already running
+
+    if (workerCount == 0) {
+        int cores = SDL_GetNumLogicalCPUCores();
+        workerCount = cores > 1 ? (uint32_t)(cores - 1) : 0;
+    }
+    if (workerCount > kMaxWorkers) workerCount = kMaxWorkers;
+
+    gJobs.mutex = SDL_CreateMutex();
+    gJobs.submitMutex = SDL_CreateMutex();
+    gJobs.wake = SDL_CreateCondition();
+    gJobs.done = SDL_CreateCondition();
+    if (!gJobs.mutex || !gJobs.submitMutex || !gJobs.wake || !gJobs.done) {
+        fprintf(stderr, "Could not create job system primitives: %s\n", SDL_GetError());
+        shutdownJobSystem();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < workerCount; ++i) {
+        gJobs.threads[i] = SDL_CreateThread(workerMain, "Job worker", NULL);
+        if (!gJobs.threads[i]) {
+            fprintf(stderr, "Could not create job worker %u: %s\n", i, SDL_GetError());
+            break;
+        }
+        gJobs.workerCount++;
+    }
+
+    printf("Job system: %u workers\n", gJobs.workerCount);
+    return true;
+}
+
+void shutdownJobSystem(void)
+{
+    if (gJobs.mutex) {
+        SDL_LockMutex(gJobs.mutex);
+        gJobs.quit = true;
+        SDL_BroadcastCondition(gJobs.wake);
+        SDL_UnlockMutex(gJobs.mutex);
+    }
+    for (uint32_t i = 0; i < gJobs.workerCount; ++i) {
+        SDL_WaitThread(gJobs.threads[i], NULL);
+    }
+
+    if (gJobs.done) SDL_DestroyCondition(gJobs.done);
+    if (gJobs.wake) SDL_DestroyCondition(gJobs.wake);
+    if (gJobs.submitMutex) SDL_DestroyMutex(gJobs.submitMutex);
+    if (gJobs.mutex) SDL_DestroyMutex(gJobs.mutex);
+
+    JobSystem empty = {0};
+    gJobs = empty;
+}
+
+uint32_t jobsThreadCount(void)
+{
+    return gJobs.workerCount + 1;
+}
+
+/**
+ * PARALLEL FOR
+ *
+ * Publishes the batch, helps running it, then waits until no worker still
+ * references it (the batch lives on this stack frame).
+ */
+void jobsParallelFor(uint32_t count, JobFunction function, void* userData)
+{
+    if (count == 0) return;
+
+    bool runInline = gJobs.workerCount == 0 || count == 1 || SDL_GetTLS(&gInsideJob) != NULL;
+    if (runInline) {
+        for (uint32_t i = 0; i < count; ++i) function(userData, i);
+        return;
+    }
+
+    JobBatch batch;
+    batch.function = function;
+    batch.userData = userData;
+    batch.count = count;
+    SDL_SetAtomicInt(&batch.next, 0);
+    SDL_SetAtomicInt(&batch.finished, 0);
+    SDL_SetAtomicInt(&batch.active, 0);
+
+    SDL_LockMutex(gJobs.submitMutex);
+
+    SDL_LockMutex(gJobs.mutex);
+    gJobs.batch = &batch;
+    gJobs.generation++;
+    SDL_BroadcastCondition(gJobs.wake);
+    SDL_UnlockMutex(gJobs.mutex);
+
+    SDL_SetTLS(&gInsideJob, &gJobs, NULL);
+    runBatch(&batch);
+    SDL_SetTLS(&gInsideJob, NULL, NULL);
+
+    // Every iteration is handed out; wait for the stragglers to finish
+    // and for all workers to let go of the batch before it goes out of scope.
+    SDL_LockMutex(gJobs.mutex);
+    while ((uint32_t)SDL_GetAtomicInt(&batch.finished) < count ||
+           SDL_GetAtomicInt(&batch.active) > 0) {
+        SDL_WaitCondition(gJobs.done, gJobs.mutex);
+    }
+    gJobs.batch = NULL;
+    SDL_UnlockMutex(gJobs.mutex);
+
+    SDL_UnlockMutex(gJobs.submitMutex);
+}
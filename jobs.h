@@ -0,0 +1,38 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * JOB SYSTEM
+ *
+ * A fixed pool of SDL worker threads running data-parallel loops. The
+ * calling thread always takes part in the loop, so jobsParallelFor() is
+ * safe to call before initJobSystem() (or after shutdownJobSystem()): it
+ * then simply runs every iteration inline.
+ *
+ * Calls made from inside a job (nested loops) also run inline, and loops
+ * submitted concurrently from different threads are serialized.
+ */
+
+typedef void (*JobFunction)(void* userData, uint32_t index);
+
+/**
+ * Start the worker threads. workerCount = 0 picks one worker per logical
+ * core, minus the calling thread.
+ */
+bool initJobSystem(uint32_t workerCount);
+
+void shutdownJobSystem(void);
+
+/** Number of threads taking part in a loop (workers + caller). */
+uint32_t jobsThreadCount(void);
+
+/**
+ * Run function(userData, i) for i in [0, count), spread over the pool,
+ * and return once every iteration has finished.
+ */
+void jobsParallelFor(uint32_t count, JobFunction function, void* userData);
+
+#endif // JOBS_H
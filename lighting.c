@@ -0,0 +1,431 @@
+#include "lighting.h"
+#include "webgpu-utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Uniform block shared by the culling and forward shaders. Must match
+ * ClusterUniforms in kLightingCommonWGSL (176 bytes).
+ */
+typedef struct {
+    float view[16];
+    float inverseProjection[16];
+    uint32_t gridSize[3];
+    uint32_t lightCount;
+    float screenSize[2];
+    float zNear;
+    float zFar;
+    float sliceScale;
+    float sliceBias;
+    float _pad[2];
+} ClusterUniforms;
+
+/** View-space bounds of one light. Must match ViewLight in kLightCullWGSL. */
+typedef struct {
+    float sphere[4];            // center, range
+    float cone[4];              // direction, cosine of the outer angle
+} ViewLight;
+
+#define kLightingCommonWGSL \
+"struct Light {\n" \
+"    position: vec3f,\n" \
+"    range: f32,\n" \
+"    color: vec3f,\n" \
+"    intensity: f32,\n" \
+"    direction: vec3f,\n" \
+"    lightType: u32,\n" \
+"    spotInnerCos: f32,\n" \
+"    spotOuterCos: f32,\n" \
+"    _pad: vec2f,\n" \
+"}\n" \
+"struct ClusterUniforms {\n" \
+"    view: mat4x4f,\n" \
+"    inverseProjection: mat4x4f,\n" \
+"    gridSize: vec3u,\n" \
+"    lightCount: u32,\n" \
+"    screenSize: vec2f,\n" \
+"    zNear: f32,\n" \
+"    zFar: f32,\n" \
+"    sliceScale: f32,\n" \
+"    sliceBias: f32,\n" \
+"}\n" \
+"const kClusterMaxLights = 256u;\n" \
+"const kLightSpot = 1u;\n"
+
+static const char* const kLightCullWGSL[] = {
+kLightingCommonWGSL
+"struct ViewLight {\n"
+"    sphere: vec4f,\n"
+"    cone: vec4f,\n"
+"}\n"
+"\n"
+"@group(0) @binding(0) var<uniform> clusters: ClusterUniforms;\n"
+"@group(0) @binding(1) var<storage, read> lights: array<Light>;\n"
+"@group(0) @binding(2) var<storage, read_write> viewLights: array<ViewLight>;\n"
+"@group(0) @binding(3) var<storage, read_write> clusterLightCounts: array<u32>;\n"
+"@group(0) @binding(4) var<storage, read_write> clusterLightIndices: array<u32>;\n"
+"\n"
+"@compute @workgroup_size(64)\n"
+"fn transformLights(@builtin(global_invocation_id) id: vec3u) {\n"
+"    let index = id.x;\n"
+"    if (index >= clusters.lightCount) {\n"
+"        return;\n"
+"    }\n"
+"    let light = lights[index];\n"
+"    var out: ViewLight;\n"
+"    out.sphere = vec4f((clusters.view * vec4f(light.position, 1.0)).xyz, light.range);\n"
+"    // Cones of 90 degrees and wider are culled as their bounding sphere\n"
+"    out.cone = vec4f(0.0, 0.0, -1.0, -1.0);\n"
+"    if (light.lightType == kLightSpot && light.spotOuterCos > 0.0) {\n"
+"        let direction = normalize((clusters.view * vec4f(light.direction, 0.0)).xyz);\n"
+"        out.cone = vec4f(direction, light.spotOuterCos);\n"
+"    }\n"
+"    viewLights[index] = out;\n"
+"}\n"
+"\n"
+"// Point on the near plane under a normalized device coordinate\n"
+"fn nearPlanePoint(ndc: vec2f) -> vec3f {\n"
+"    let p = clusters.inverseProjection * vec4f(ndc, 0.0, 1.0);\n"
+"    return p.xyz / p.w;\n"
+"}\n"
+"\n"
+"fn sliceDepth(slice: u32) -> f32 {\n"
+"    return clusters.zNear * pow(clusters.zFar / clusters.zNear, f32(slice) / f32(clusters.gridSize.z));\n"
+"}\n"
+"\n"
+"fn sphereTouchesBox(center: vec3f, radius: f32, boxMin: vec3f, boxMax: vec3f) -> bool {\n"
+"    let d = center - clamp(center, boxMin, boxMax);\n"
+"    return dot(d, d) <= radius * radius;\n"
+"}\n"
+"\n"
+"// Cone against the froxel's bounding sphere\n"
+"fn coneTouchesSphere(light: ViewLight, center: vec3f, radius: f32) -> bool {\n"
+"    let cosAngle = light.cone.w;\n"
+"    if (cosAngle <= 0.0) {\n"
+"        return true;\n"
+"    }\n"
+"    let v = center - light.sphere.xyz;\n"
+"    let lengthSq = dot(v, v);\n"
+"    let along = dot(v, light.cone.xyz);\n"
+"    let sinAngle = sqrt(1.0 - cosAngle * cosAngle);\n"
+"    let closest = cosAngle * sqrt(max(lengthSq - along * along, 0.0)) - along * sinAngle;\n"
+"    return !(closest > radius || along > radius + light.sphere.w || along < -radius);\n"
+"}\n"
+"\n"
+"var<workgroup> tile: array<ViewLight, 64>;\n"
+"\n",
+"// One froxel per invocation. The workgroup walks the light list in\n"
+"// batches of 64 staged in workgroup memory, so every light is read from\n"
+"// storage once per workgroup instead of once per froxel.\n"
+"@compute @workgroup_size(64)\n"
+"fn cullLights(@builtin(global_invocation_id) id: vec3u,\n"
+"              @builtin(local_invocation_index) lid: u32) {\n"
+"    let grid = clusters.gridSize;\n"
+"    let cluster = id.x;\n"
+"    let valid = cluster < grid.x * grid.y * grid.z;\n"
+"\n"
+"    let x = cluster % grid.x;\n"
+"    let y = (cluster / grid.x) % grid.y;\n"
+"    let z = cluster / (grid.x * grid.y);\n"
+"    // Tile rows go down the screen, like fragment coordinates\n"
+"    let ndcMin = vec2f(f32(x) / f32(grid.x) * 2.0 - 1.0, 1.0 - f32(y + 1u) / f32(grid.y) * 2.0);\n"
+"    let ndcMax = vec2f(f32(x + 1u) / f32(grid.x) * 2.0 - 1.0, 1.0 - f32(y) / f32(grid.y) * 2.0);\n"
+"    let rayMin = nearPlanePoint(ndcMin);\n"
+"    let rayMax = nearPlanePoint(ndcMax);\n"
+"    let depthNear = sliceDepth(z);\n"
+"    let depthFar = sliceDepth(z + 1u);\n"
+"    // The camera looks down -z: a point at distance d along a ray is ray * d / -ray.z\n"
+"    let p0 = rayMin * (depthNear / -rayMin.z);\n"
+"    let p1 = rayMin * (depthFar / -rayMin.z);\n"
+"    let p2 = rayMax * (depthNear / -rayMax.z);\n"
+"    let p3 = rayMax * (depthFar / -rayMax.z);\n"
+"    let boxMin = min(min(p0, p1), min(p2, p3));\n"
+"    let boxMax = max(max(p0, p1), max(p2, p3));\n"
+"    let boxCenter = (boxMin + boxMax) * 0.5;\n"
+"    let boxRadius = length(boxMax - boxMin) * 0.5;\n"
+"\n"
+"    var count = 0u;\n"
+"    for (var base = 0u; base < clusters.lightCount; base += 64u) {\n"
+"        if (base + lid < clusters.lightCount) {\n"
+"            tile[lid] = viewLights[base + lid];\n"
+"        }\n"
+"        workgroupBarrier();\n"
+"        let batch = min(64u, clusters.lightCount - base);\n"
+"        for (var i = 0u; valid && i < batch; i++) {\n"
+"            let light = tile[i];\n"
+"            if (count < kClusterMaxLights &&\n"
+"                sphereTouchesBox(light.sphere.xyz, light.sphere.w, boxMin, boxMax) &&\n"
+"                coneTouchesSphere(light, boxCenter, boxRadius)) {\n"
+"                clusterLightIndices[cluster * kClusterMaxLights + count] = base + i;\n"
+"                count++;\n"
+"            }\n"
+"        }\n"
+"        workgroupBarrier();\n"
+"    }\n"
+"    if (valid) {\n"
+"        clusterLightCounts[cluster] = count;\n"
+"    }\n"
+"}\n",
+};
+
+const char* kClusteredLightingWGSL =
+kLightingCommonWGSL
+"\n"
+"@group(1) @binding(0) var<uniform> clusters: ClusterUniforms;\n"
+"@group(1) @binding(1) var<storage, read> lights: array<Light>;\n"
+"@group(1) @binding(2) var<storage, read> clusterLightCounts: array<u32>;\n"
+"@group(1) @binding(3) var<storage, read> clusterLightIndices: array<u32>;\n"
+"\n"
+"// viewDepth is the positive distance along the view direction\n"
+"fn clusterIndex(fragCoord: vec2f, viewDepth: f32) -> u32 {\n"
+"    let grid = clusters.gridSize;\n"
+"    let tile = min(vec2u(fragCoord / clusters.screenSize * vec2f(grid.xy)), grid.xy - 1u);\n"
+"    let slice = min(u32(max(log(viewDepth) * clusters.sliceScale - clusters.sliceBias, 0.0)), grid.z - 1u);\n"
+"    return tile.x + tile.y * grid.x + slice * grid.x * grid.y;\n"
+"}\n"
+"\n"
+"// Inverse square falloff, windowed to reach zero at the light's range\n"
+"fn lightFalloff(lightDistance: f32, range: f32) -> f32 {\n"
+"    let ratio = lightDistance / range;\n"
+"    let ratio2 = ratio * ratio;\n"
+"    let window = saturate(1.0 - ratio2 * ratio2);\n"
+"    return window * window / max(lightDistance * lightDistance, 1e-4);\n"
+"}\n"
+"\n"
+"// Diffuse light reaching a surface point, from the lights of its froxel\n"
+"fn shadeClusteredLights(fragCoord: vec2f, worldPosition: vec3f, normal: vec3f, viewDepth: f32) -> vec3f {\n"
+"    let cluster = clusterIndex(fragCoord, viewDepth);\n"
+"    let count = clusterLightCounts[cluster];\n"
+"    var total = vec3f(0.0);\n"
+"    for (var i = 0u; i < count; i++) {\n"
+"        let light = lights[clusterLightIndices[cluster * kClusterMaxLights + i]];\n"
+"        let toLight = light.position - worldPosition;\n"
+"        let lightDistance = length(toLight);\n"
+"        let l = toLight / max(lightDistance, 1e-4);\n"
+"        var attenuation = lightFalloff(lightDistance, light.range);\n"
+"        if (light.lightType == kLightSpot) {\n"
+"            let cosAngle = dot(-l, light.direction);\n"
+"            attenuation *= smoothstep(light.spotOuterCos, light.spotInnerCos, cosAngle);\n"
+"        }\n"
+"        total += light.color * light.intensity * attenuation * max(dot(normal, l), 0.0);\n"
+"    }\n"
+"    return total;\n"
+"}\n";
+
+static WGPUBindGroup createPassBindGroup(WGPUDevice device,
+                                         WGPUComputePipeline pipeline,
+                                         const char* label,
+                                         const uint32_t* bindings,
+                                         const WGPUBuffer* buffers,
+                                         uint32_t count)
+{
+    WGPUBindGroupEntry entries[5] = {0};
+    for (uint32_t i = 0; i < count; ++i) {
+        entries[i].binding = bindings[i];
+        entries[i].buffer = buffers[i];
+        entries[i].offset = 0;
+        entries[i].size = wgpuBufferGetSize(buffers[i]);
+    }
+
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(pipeline, 0);
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = label;
+    desc.layout = layout;
+    desc.entryCount = count;
+    desc.entries = entries;
+    WGPUBindGroup bindGroup = wgpuDeviceCreateBindGroup(device, &desc);
+    wgpuBindGroupLayoutRelease(layout);
+    return bindGroup;
+}
+
+/** Layout and bind group that forward pipelines use at kLightingBindGroup. */
+static bool createForwardBindGroup(ClusteredLighting* lighting)
+{
+    WGPUBindGroupLayoutEntry layoutEntries[4] = {0};
+    for (uint32_t i = 0; i < 4; ++i) {
+        layoutEntries[i].binding = i;
+        layoutEntries[i].visibility = WGPUShaderStage_Fragment | WGPUShaderStage_Compute;
+        layoutEntries[i].buffer.type = i == 0 ? WGPUBufferBindingType_Uniform
+                                              : WGPUBufferBindingType_ReadOnlyStorage;
+    }
+    WGPUBindGroupLayoutDescriptor layoutDesc = {0};
+    layoutDesc.label = "Clustered lighting layout";
+    layoutDesc.entryCount = 4;
+    layoutDesc.entries = layoutEntries;
+    lighting->forwardLayout = wgpuDeviceCreateBindGroupLayout(lighting->device, &layoutDesc);
+    if (!lighting->forwardLayout) return false;
+
+    WGPUBuffer buffers[4] = {
+        lighting->uniformBuffer, lighting->lightBuffer,
+        lighting->clusterCountBuffer, lighting->clusterIndexBuffer,
+    };
+    WGPUBindGroupEntry entries[4] = {0};
+    for (uint32_t i = 0; i < 4; ++i) {
+        entries[i].binding = i;
+        entries[i].buffer = buffers[i];
+        entries[i].offset = 0;
+        entries[i].size = wgpuBufferGetSize(buffers[i]);
+    }
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = "Clustered lighting bind group";
+    desc.layout = lighting->forwardLayout;
+    desc.entryCount = 4;
+    desc.entries = entries;
+    lighting->forwardBindGroup = wgpuDeviceCreateBindGroup(lighting->device, &desc);
+    return lighting->forwardBindGroup != NULL;
+}
+
+bool createClusteredLighting(ClusteredLighting* lighting,
+                             WGPUDevice device,
+                             WGPUQueue queue,
+                             uint32_t maxLights)
+{
+    memset(lighting, 0, sizeof *lighting);
+    lighting->device = device;
+    lighting->queue = queue;
+    lighting->maxLights = maxLights > 0 ? maxLights : 1;
+
+    const WGPUBufferUsageFlags storage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst;
+    lighting->uniformBuffer = createBuffer(device, "Cluster uniforms", sizeof(ClusterUniforms),
+                                           WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    lighting->lightBuffer = createBuffer(device, "Lights", (uint64_t)lighting->maxLights * sizeof(Light), storage);
+    lighting->viewLightBuffer = createBuffer(device, "View-space lights",
+                                             (uint64_t)lighting->maxLights * sizeof(ViewLight),
+                                             WGPUBufferUsage_Storage);
+    lighting->clusterCountBuffer = createBuffer(device, "Cluster light counts",
+                                                kClusterCount * sizeof(uint32_t), WGPUBufferUsage_Storage);
+    lighting->clusterIndexBuffer = createBuffer(device, "Cluster light indices",
+                                                (uint64_t)kClusterCount * kClusterMaxLights * sizeof(uint32_t),
+                                                WGPUBufferUsage_Storage);
+    if (!lighting->uniformBuffer || !lighting->lightBuffer || !lighting->viewLightBuffer ||
+        !lighting->clusterCountBuffer || !lighting->clusterIndexBuffer) {
+        releaseClusteredLighting(lighting);
+        return false;
+    }
+
+    WGPUShaderModule module = createShaderModuleFromParts(device, "Light cull shader", kLightCullWGSL,
+                                                          sizeof kLightCullWGSL / sizeof kLightCullWGSL[0]);
+    if (!module) {
+        releaseClusteredLighting(lighting);
+        return false;
+    }
+    lighting->transformPipeline = createComputePipeline(device, "Light transform pipeline", module, "transformLights");
+    lighting->cullPipeline = createComputePipeline(device, "Light cull pipeline", module, "cullLights");
+    wgpuShaderModuleRelease(module);
+    if (!lighting->transformPipeline || !lighting->cullPipeline) {
+        releaseClusteredLighting(lighting);
+        return false;
+    }
+
+    // Automatic layouts only hold the bindings each entry point uses
+    const uint32_t transformBindings[3] = { 0, 1, 2 };
+    const WGPUBuffer transformBuffers[3] = {
+        lighting->uniformBuffer, lighting->lightBuffer, lighting->viewLightBuffer,
+    };
+    lighting->transformBindGroup = createPassBindGroup(device, lighting->transformPipeline,
+                                                       "Light transform bind group",
+                                                       transformBindings, transformBuffers, 3);
+    const uint32_t cullBindings[4] = { 0, 2, 3, 4 };
+    const WGPUBuffer cullBuffers[4] = {
+        lighting->uniformBuffer, lighting->viewLightBuffer,
+        lighting->clusterCountBuffer, lighting->clusterIndexBuffer,
+    };
+    lighting->cullBindGroup = createPassBindGroup(device, lighting->cullPipeline, "Light cull bind group",
+                                                  cullBindings, cullBuffers, 4);
+
+    if (!lighting->transformBindGroup || !lighting->cullBindGroup || !createForwardBindGroup(lighting)) {
+        releaseClusteredLighting(lighting);
+        return false;
+    }
+    return true;
+}
+
+void releaseClusteredLighting(ClusteredLighting* lighting)
+{
+    if (lighting->forwardBindGroup) wgpuBindGroupRelease(lighting->forwardBindGroup);
+    if (lighting->forwardLayout) wgpuBindGroupLayoutRelease(lighting->forwardLayout);
+    if (lighting->cullBindGroup) wgpuBindGroupRelease(lighting->cullBindGroup);
+    if (lighting->transformBindGroup) wgpuBindGroupRelease(lighting->transformBindGroup);
+    if (lighting->cullPipeline) wgpuComputePipelineRelease(lighting->cullPipeline);
+    if (lighting->transformPipeline) wgpuComputePipelineRelease(lighting->transformPipeline);
+
+    WGPUBuffer buffers[] = {
+        lighting->uniformBuffer, lighting->lightBuffer, lighting->viewLightBuffer,
+        lighting->clusterCountBuffer, lighting->clusterIndexBuffer,
+    };
+    for (size_t i = 0; i < sizeof buffers / sizeof buffers[0]; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    memset(lighting, 0, sizeof *lighting);
+}
+
+void lightingSetLights(ClusteredLighting* lighting, const Light* lights, uint32_t count)
+{
+    if (count > lighting->maxLights) {
+        fprintf(stderr, "lightingSetLights: %u lights, only the first %u are used\n",
+                count, lighting->maxLights);
+        count = lighting->maxLights;
+    }
+    if (count > 0) {
+        wgpuQueueWriteBuffer(lighting->queue, lighting->lightBuffer, 0, lights, (size_t)count * sizeof(Light));
+    }
+    lighting->lightCount = count;
+}
+
+void lightingUpdate(ClusteredLighting* lighting,
+                    Mat4 view,
+                    Mat4 projection,
+                    float zNear,
+                    float zFar,
+                    uint32_t width,
+                    uint32_t height)
+{
+    ClusterUniforms uniforms = {0};
+    memcpy(uniforms.view, view.m, sizeof uniforms.view);
+    Mat4 inverseProjection = mat4Inverse(projection);
+    memcpy(uniforms.inverseProjection, inverseProjection.m, sizeof uniforms.inverseProjection);
+    uniforms.gridSize[0] = kClusterGridX;
+    uniforms.gridSize[1] = kClusterGridY;
+    uniforms.gridSize[2] = kClusterGridZ;
+    uniforms.lightCount = lighting->lightCount;
+    uniforms.screenSize[0] = (float)width;
+    uniforms.screenSize[1] = (float)height;
+    uniforms.zNear = zNear;
+    uniforms.zFar = zFar;
+
+    // slice = log(depth) * scale - bias maps [zNear, zFar] onto [0, gridZ]
+    float logRatio = logf(zFar / zNear);
+    uniforms.sliceScale = kClusterGridZ / logRatio;
+    uniforms.sliceBias = kClusterGridZ * logf(zNear) / logRatio;
+
+    wgpuQueueWriteBuffer(lighting->queue, lighting->uniformBuffer, 0, &uniforms, sizeof uniforms);
+}
+
+/**
+ * Both dispatches go in one compute pass: WebGPU makes the view-space
+ * lights written by the first visible to the second.
+ */
+void lightingDispatch(ClusteredLighting* lighting, WGPUCommandEncoder encoder)
+{
+    WGPUComputePassDescriptor passDesc = {0};
+    passDesc.label = "Light cull pass";
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+
+    if (lighting->lightCount > 0) {
+        wgpuComputePassEncoderSetPipeline(pass, lighting->transformPipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, lighting->transformBindGroup, 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, (lighting->lightCount + 63) / 64, 1, 1);
+    }
+    // Runs even without lights, to clear the counts
+    wgpuComputePassEncoderSetPipeline(pass, lighting->cullPipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, lighting->cullBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, (kClusterCount + 63) / 64, 1, 1);
+
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+}
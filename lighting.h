@@ -0,0 +1,112 @@
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include "linalg.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * CLUSTERED LIGHTING
+ *
+ * The view frustum is cut into a grid of froxels: kClusterGridX x
+ * kClusterGridY screen tiles times kClusterGridZ depth slices, spaced
+ * exponentially so near slices stay thin. Every frame a compute pass
+ * tests every point and spot light against every froxel and writes, per
+ * froxel, the indices of the lights that reach it. A forward shader then
+ * only loops over the lights of the froxel its fragment falls in, instead
+ * of over every light in the scene.
+ *
+ * Per frame:
+ *      lightingSetLights(&lighting, lights, count);        // when they change
+ *      lightingUpdate(&lighting, view, projection, near, far, width, height);
+ *      lightingDispatch(&lighting, encoder);               // before the forward pass
+ *      ... forward pass with `forwardBindGroup` at group kLightingBindGroup ...
+ *
+ * Forward shaders include kClusteredLightingWGSL and call
+ * shadeClusteredLights(); their pipeline layout puts `forwardLayout` at
+ * group kLightingBindGroup. Compute shading passes (see
+ * visibility-buffer.h) can use it the same way.
+ *
+ * A froxel keeps at most kClusterMaxLights lights; further ones are
+ * dropped, so very dense light fields lose some contributions rather than
+ * overflowing.
+ */
+
+#define kClusterGridX 16
+#define kClusterGridY 9
+#define kClusterGridZ 24
+#define kClusterCount (kClusterGridX * kClusterGridY * kClusterGridZ)
+#define kClusterMaxLights 256
+
+/** Bind group index that kClusteredLightingWGSL declares its bindings in. */
+#define kLightingBindGroup 1
+
+typedef enum {
+    LightType_Point = 0,
+    LightType_Spot = 1,
+} LightType;
+
+/** One light, laid out to match the WGSL struct (64 bytes). */
+typedef struct {
+    float position[3];
+    float range;                // no contribution past this distance
+    float color[3];
+    float intensity;
+    float direction[3];         // spot lights only, normalized
+    uint32_t type;              // LightType
+    float spotInnerCos;         // full intensity inside this cone
+    float spotOuterCos;         // no light outside this cone
+    float _pad[2];
+} Light;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+
+    WGPUComputePipeline transformPipeline;
+    WGPUComputePipeline cullPipeline;
+    WGPUBindGroup transformBindGroup;
+    WGPUBindGroup cullBindGroup;
+
+    WGPUBuffer uniformBuffer;
+    WGPUBuffer lightBuffer;
+    WGPUBuffer viewLightBuffer;         // view-space bounds of every light
+    WGPUBuffer clusterCountBuffer;      // lights per froxel
+    WGPUBuffer clusterIndexBuffer;      // kClusterMaxLights slots per froxel
+
+    uint32_t maxLights;
+    uint32_t lightCount;
+
+    // What forward pipelines bind at group kLightingBindGroup
+    WGPUBindGroupLayout forwardLayout;
+    WGPUBindGroup forwardBindGroup;
+} ClusteredLighting;
+
+/** WGSL for forward shaders: bindings, cluster lookup and shading. */
+extern const char* kClusteredLightingWGSL;
+
+bool createClusteredLighting(ClusteredLighting* lighting,
+                             WGPUDevice device,
+                             WGPUQueue queue,
+                             uint32_t maxLights);
+
+void releaseClusteredLighting(ClusteredLighting* lighting);
+
+/** Upload the scene's lights (at most `maxLights`). */
+void lightingSetLights(ClusteredLighting* lighting, const Light* lights, uint32_t count);
+
+void lightingUpdate(ClusteredLighting* lighting,
+                    Mat4 view,
+                    Mat4 projection,
+                    float zNear,
+                    float zFar,
+                    uint32_t width,
+                    uint32_t height);
+
+/** Record the light transform and culling passes. */
+void lightingDispatch(ClusteredLighting* lighting, WGPUCommandEncoder encoder);
+
+#endif // LIGHTING_H
@@ -0,0 +1,202 @@
+#ifndef LINALG_H
+#define LINALG_H
+
+#include <math.h>
+#include <stdint.h>
+
+/**
+ * LINEAR ALGEBRA
+ *
+ * Tiny header-only vector/matrix helpers shared by the CPU side of the
+ * renderer. Matrices are column-major float[16], matching WGSL's
+ * mat4x4f, so they can be copied into uniform buffers as-is.
+ */
+
+typedef struct {
+    float x, y, z;
+} Vec3;
+
+typedef struct {
+    float m[16];
+} Mat4;
+
+static inline Vec3 vec3(float x, float y, float z)
+{
+    Vec3 v = { x, y, z };
+    return v;
+}
+
+static inline Vec3 vec3Add(Vec3 a, Vec3 b) { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+static inline Vec3 vec3Sub(Vec3 a, Vec3 b) { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+static inline Vec3 vec3Scale(Vec3 a, float s) { return vec3(a.x * s, a.y * s, a.z * s); }
+static inline float vec3Dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static inline float vec3Length(Vec3 a) { return sqrtf(vec3Dot(a, a)); }
+
+static inline Vec3 vec3Cross(Vec3 a, Vec3 b)
+{
+    return vec3(a.y * b.z - a.z * b.y,
+                a.z * b.x - a.x * b.z,
+                a.x * b.y - a.y * b.x);
+}
+
+static inline Vec3 vec3Normalize(Vec3 a)
+{
+    float len = vec3Length(a);
+    return len > 0.0f ? vec3Scale(a, 1.0f / len) : a;
+}
+
+static inline Vec3 vec3FromArray(const float* p) { return vec3(p[0], p[1], p[2]); }
+
+static inline Mat4 mat4Identity(void)
+{
+    Mat4 r = {{ 1, 0, 0, 0,
+                0, 1, 0, 0,
+                0, 0, 1, 0,
+                0, 0, 0, 1 }};
+    return r;
+}
+
+/**
+ * Right-handed perspective projection (camera looking down -z) onto
+ * WebGPU's [0, 1] depth range. fovY is in radians.
+ */
+static inline Mat4 mat4Perspective(float fovY, float aspect, float zNear, float zFar)
+{
+    float f = 1.0f / tanf(fovY * 0.5f);
+    Mat4 r = {{ f / aspect, 0, 0, 0,
+                0, f, 0, 0,
+                0, 0, zFar / (zNear - zFar), -1,
+                0, 0, zNear * zFar / (zNear - zFar), 0 }};
+    return r;
+}
+
+/** Right-handed orthographic projection onto the [0, 1] depth range. */
+static inline Mat4 mat4Ortho(float left, float right, float bottom, float top, float zNear, float zFar)
+{
+    Mat4 r = {{ 2.0f / (right - left), 0, 0, 0,
+                0, 2.0f / (top - bottom), 0, 0,
+                0, 0, 1.0f / (zNear - zFar), 0,
+                -(right + left) / (right - left), -(top + bottom) / (top - bottom), zNear / (zNear - zFar), 1 }};
+    return r;
+}
+
+/** View matrix of a camera at `eye` looking at `target`. */
+static inline Mat4 mat4LookAt(Vec3 eye, Vec3 target, Vec3 up)
+{
+    Vec3 f = vec3Normalize(vec3Sub(target, eye));
+    Vec3 s = vec3Normalize(vec3Cross(f, up));
+    Vec3 u = vec3Cross(s, f);
+    Mat4 r = {{ s.x, u.x, -f.x, 0,
+                s.y, u.y, -f.y, 0,
+                s.z, u.z, -f.z, 0,
+                -vec3Dot(s, eye), -vec3Dot(u, eye), vec3Dot(f, eye), 1 }};
+    return r;
+}
+
+/** r = a * b */
+static inline Mat4 mat4Mul(Mat4 a, Mat4 b)
+{
+    Mat4 r;
+    for (int c = 0; c < 4; ++c) {
+        for (int row = 0; row < 4; ++row) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; ++k) {
+                sum += a.m[k * 4 + row] * b.m[c * 4 + k];
+            }
+            r.m[c * 4 + row] = sum;
+        }
+    }
+    return r;
+}
+
+static inline Vec3 mat4TransformPoint(Mat4 a, Vec3 p)
+{
+    return vec3(a.m[0] * p.x + a.m[4] * p.y + a.m[8]  * p.z + a.m[12],
+                a.m[1] * p.x + a.m[5] * p.y + a.m[9]  * p.z + a.m[13],
+                a.m[2] * p.x + a.m[6] * p.y + a.m[10] * p.z + a.m[14]);
+}
+
+static inline Vec3 mat4TransformDir(Mat4 a, Vec3 d)
+{
+    return vec3(a.m[0] * d.x + a.m[4] * d.y + a.m[8]  * d.z,
+                a.m[1] * d.x + a.m[5] * d.y + a.m[9]  * d.z,
+                a.m[2] * d.x + a.m[6] * d.y + a.m[10] * d.z);
+}
+
+/** Homogeneous transform with the perspective divide. */
+static inline Vec3 mat4TransformProject(Mat4 a, Vec3 p)
+{
+    float w = a.m[3] * p.x + a.m[7] * p.y + a.m[11] * p.z + a.m[15];
+    return vec3Scale(mat4TransformPoint(a, p), w != 0.0f ? 1.0f / w : 1.0f);
+}
+
+/** General inverse by cofactors. Returns identity for singular matrices. */
+static inline Mat4 mat4Inverse(Mat4 a)
+{
+    const float* m = a.m;
+    Mat4 r;
+    float* inv = r.m;
+    inv[0]  =  m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[4]  = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[8]  =  m[4] * m[9]  * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inv[12] = -m[4] * m[9]  * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inv[1]  = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[5]  =  m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[9]  = -m[0] * m[9]  * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inv[13] =  m[0] * m[9]  * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inv[2]  =  m[1] * m[6]  * m[15] - m[1] * m[7]  * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7]  - m[13] * m[3] * m[6];
+    inv[6]  = -m[0] * m[6]  * m[15] + m[0] * m[7]  * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7]  + m[12] * m[3] * m[6];
+    inv[10] =  m[0] * m[5]  * m[15] - m[0] * m[7]  * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7]  - m[12] * m[3] * m[5];
+    inv[14] = -m[0] * m[5]  * m[14] + m[0] * m[6]  * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6]  + m[12] * m[2] * m[5];
+    inv[3]  = -m[1] * m[6]  * m[11] + m[1] * m[7]  * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9]  * m[2] * m[7]  + m[9]  * m[3] * m[6];
+    inv[7]  =  m[0] * m[6]  * m[11] - m[0] * m[7]  * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8]  * m[2] * m[7]  - m[8]  * m[3] * m[6];
+    inv[11] = -m[0] * m[5]  * m[11] + m[0] * m[7]  * m[9]  + m[4] * m[1] * m[11] - m[4] * m[3] * m[9]  - m[8]  * m[1] * m[7]  + m[8]  * m[3] * m[5];
+    inv[15] =  m[0] * m[5]  * m[10] - m[0] * m[6]  * m[9]  - m[4] * m[1] * m[10] + m[4] * m[2] * m[9]  + m[8]  * m[1] * m[6]  - m[8]  * m[2] * m[5];
+
+    float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    if (det == 0.0f) return mat4Identity();
+    for (int i = 0; i < 16; ++i) inv[i] /= det;
+    return r;
+}
+
+/** Largest axis scale of the upper 3x3, used to scale bounding radii. */
+static inline float mat4MaxScale(Mat4 a)
+{
+    float sx = vec3Length(vec3(a.m[0], a.m[1], a.m[2]));
+    float sy = vec3Length(vec3(a.m[4], a.m[5], a.m[6]));
+    float sz = vec3Length(vec3(a.m[8], a.m[9], a.m[10]));
+    float s = sx > sy ? sx : sy;
+    return s > sz ? s : sz;
+}
+
+/**
+ * Extract the six normalized frustum planes (left, right, bottom, top,
+ * near, far) from a view-projection matrix, as (nx, ny, nz, d) with the
+ * normal pointing inside. Uses WebGPU's [0, 1] clip-space depth range.
+ */
+static inline void mat4FrustumPlanes(Mat4 viewProj, float planes[6][4])
+{
+    const float* m = viewProj.m;
+    for (int i = 0; i < 4; ++i) {
+        float r0 = m[i * 4 + 0];
+        float r1 = m[i * 4 + 1];
+        float r2 = m[i * 4 + 2];
+        float r3 = m[i * 4 + 3];
+        planes[0][i] = r3 + r0;
+        planes[1][i] = r3 - r0;
+        planes[2][i] = r3 + r1;
+        planes[3][i] = r3 - r1;
+        planes[4][i] = r2;
+        planes[5][i] = r3 - r2;
+    }
+    for (int p = 0; p < 6; ++p) {
+        float len = sqrtf(planes[p][0] * planes[p][0] +
+                          planes[p][1] * planes[p][1] +
+                          planes[p][2] * planes[p][2]);
+        if (len > 0.0f) {
+            for (int i = 0; i < 4; ++i) planes[p][i] /= len;
+        }
+    }
+}
+
+#endif // LINALG_H
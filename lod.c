@@ -0,0 +1,236 @@
+#include "lod.h"
+#include "simplify.h"
+#include "jobs.h"
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** A level that keeps more than this share of the previous one is not worth it. */
+#define kLodMinProgress 0.9f
+
+/** Instances handled per job in cullAndSelectLods(). */
+#define kLodInstancesPerJob 256
+
+static void computeBoundingSphere(LodChain* chain, const LodSourceMesh* mesh)
+{
+    Vec3 lo = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    Vec3 hi = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (size_t v = 0; v < mesh->vertexCount; ++v) {
+        const float* p = (const float*)((const char*)mesh->positions + v * mesh->positionStride);
+        lo = vec3(fminf(lo.x, p[0]), fminf(lo.y, p[1]), fminf(lo.z, p[2]));
+        hi = vec3(fmaxf(hi.x, p[0]), fmaxf(hi.y, p[1]), fmaxf(hi.z, p[2]));
+    }
+    Vec3 center = vec3Scale(vec3Add(lo, hi), 0.5f);
+
+    float radius = 0.0f;
+    for (size_t v = 0; v < mesh->vertexCount; ++v) {
+        const float* p = (const float*)((const char*)mesh->positions + v * mesh->positionStride);
+        float d = vec3Length(vec3Sub(vec3FromArray(p), center));
+        if (d > radius) radius = d;
+    }
+
+    chain->center[0] = center.x;
+    chain->center[1] = center.y;
+    chain->center[2] = center.z;
+    chain->radius = radius;
+}
+
+/**
+ * BUILD LOD CHAIN
+ *
+ * Each level is simplified from the previous one rather than from the
+ * original mesh: it is much cheaper, and the errors simply add up, which
+ * keeps the recorded error conservative.
+ */
+bool buildLodChain(LodChain* chain, const LodSourceMesh* mesh,
+                   uint32_t maxLevels, float reduction)
+{
+    memset(chain, 0, sizeof *chain);
+    if (maxLevels == 0 || mesh->indexCount < 3) return false;
+    if (maxLevels > kLodMaxLevels) maxLevels = kLodMaxLevels;
+
+    // Worst case: every level keeps kLodMinProgress of the previous one,
+    // plus room for one rejected attempt the size of the original mesh.
+    size_t capacity = mesh->indexCount;
+    size_t levelSize = mesh->indexCount;
+    for (uint32_t i = 0; i < maxLevels; ++i) {
+        capacity += levelSize;
+        levelSize = (size_t)(levelSize * kLodMinProgress) + 3;
+    }
+
+    chain->indices = malloc(capacity * sizeof *chain->indices);
+    if (!chain->indices) {
+        fprintf(stderr, "buildLodChain: out of memory (%zu indices)\n", capacity);
+        return false;
+    }
+
+    memcpy(chain->indices, mesh->indices, mesh->indexCount * sizeof *mesh->indices);
+    chain->levels[0].indexOffset = 0;
+    chain->levels[0].indexCount = (uint32_t)mesh->indexCount;
+    chain->levels[0].error = 0.0f;
+    chain->levelCount = 1;
+    chain->indexCount = mesh->indexCount;
+
+    while (chain->levelCount < maxLevels) {
+        const LodLevel* previous = &chain->levels[chain->levelCount - 1];
+        size_t target = (size_t)(previous->indexCount * reduction) / 3 * 3;
+        if (target < 3) break;
+
+        uint32_t* destination = chain->indices + chain->indexCount;
+        float error = 0.0f;
+        size_t count = simplifyMesh(destination,
+                                    chain->indices + previous->indexOffset, previous->indexCount,
+                                    mesh->positions, mesh->vertexCount, mesh->positionStride,
+                                    target, FLT_MAX, &error);
+
+        if (count == 0 || count > previous->indexCount * kLodMinProgress) break;
+
+        LodLevel* level = &chain->levels[chain->levelCount++];
+        level->indexOffset = (uint32_t)chain->indexCount;
+        level->indexCount = (uint32_t)count;
+        level->error = previous->error + error;
+        chain->indexCount += count;
+    }
+
+    uint32_t* shrunk = realloc(chain->indices, chain->indexCount * sizeof *chain->indices);
+    if (shrunk) chain->indices = shrunk;
+
+    computeBoundingSphere(chain, mesh);
+    return true;
+}
+
+typedef struct {
+    LodChain* chains;
+    const LodSourceMesh* meshes;
+    uint32_t maxLevels;
+    float reduction;
+    bool* results;
+} LodBuildJob;
+
+static void buildLodChainJob(void* userData, uint32_t index)
+{
+    LodBuildJob* job = userData;
+    job->results[index] = buildLodChain(&job->chains[index], &job->meshes[index],
+                                        job->maxLevels, job->reduction);
+}
+
+bool buildLodChains(LodChain* chains, const LodSourceMesh* meshes, size_t meshCount,
+                    uint32_t maxLevels, float reduction)
+{
+    bool* results = calloc(meshCount, sizeof *results);
+    if (!results) {
+        fprintf(stderr, "buildLodChains: out of memory\n");
+        return false;
+    }
+
+    LodBuildJob job = { chains, meshes, maxLevels, reduction, results };
+    jobsParallelFor((uint32_t)meshCount, buildLodChainJob, &job);
+
+    bool ok = true;
+    for (size_t i = 0; i < meshCount; ++i) {
+        if (!results[i]) {
+            fprintf(stderr, "buildLodChains: mesh %zu failed\n", i);
+            ok = false;
+        }
+    }
+    free(results);
+    return ok;
+}
+
+void releaseLodChain(LodChain* chain)
+{
+    free(chain->indices);
+    memset(chain, 0, sizeof *chain);
+}
+
+/** Projected size in pixels of a world-space error at the given distance. */
+static float projectError(float error, float distance, const LodSelectParams* params)
+{
+    return error * params->projectionScale / fmaxf(distance, 1e-4f);
+}
+
+/**
+ * SELECT LOD
+ *
+ * Distance is measured to the nearest point of the bounding sphere, so the
+ * estimate is conservative for large objects the camera is close to.
+ *
+ * Without history the coarsest acceptable level is used directly. With
+ * history, we only refine once the current level exceeds the threshold by
+ * the hysteresis margin, and only coarsen once the next level is under the
+ * threshold by the same margin.
+ */
+uint32_t selectLod(const LodChain* chain, Mat4 model, uint32_t currentLod,
+                   const LodSelectParams* params)
+{
+    float scale = mat4MaxScale(model);
+    Vec3 center = mat4TransformPoint(model, vec3FromArray(chain->center));
+    float distance = vec3Length(vec3Sub(center, params->cameraPosition)) - chain->radius * scale;
+
+    float threshold = params->pixelError;
+    float low = threshold * (1.0f - params->hysteresis);
+    float high = threshold * (1.0f + params->hysteresis);
+
+    uint32_t lod = currentLod;
+    if (lod >= chain->levelCount) {
+        lod = 0;
+        low = high = threshold;
+    }
+
+    while (lod > 0 && projectError(chain->levels[lod].error * scale, distance, params) > high) {
+        lod--;
+    }
+    while (lod + 1 < chain->levelCount &&
+           projectError(chain->levels[lod + 1].error * scale, distance, params) <= low) {
+        lod++;
+    }
+    return lod;
+}
+
+typedef struct {
+    const LodInstance* instances;
+    size_t instanceCount;
+    const LodSelectParams* params;
+    uint32_t* lods;
+} LodSelectJob;
+
+static bool sphereInFrustum(Vec3 center, float radius, const float planes[6][4])
+{
+    for (int p = 0; p < 6; ++p) {
+        if (planes[p][0] * center.x + planes[p][1] * center.y +
+            planes[p][2] * center.z + planes[p][3] < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void selectLodsJob(void* userData, uint32_t jobIndex)
+{
+    LodSelectJob* job = userData;
+    size_t begin = (size_t)jobIndex * kLodInstancesPerJob;
+    size_t end = begin + kLodInstancesPerJob;
+    if (end > job->instanceCount) end = job->instanceCount;
+
+    for (size_t i = begin; i < end; ++i) {
+        const LodInstance* instance = &job->instances[i];
+        Vec3 center = mat4TransformPoint(instance->model, vec3FromArray(instance->chain->center));
+        float radius = instance->chain->radius * mat4MaxScale(instance->model);
+
+        if (!sphereInFrustum(center, radius, job->params->planes)) {
+            job->lods[i] = kLodCulled;
+            continue;
+        }
+        job->lods[i] = selectLod(instance->chain, instance->model, job->lods[i], job->params);
+    }
+}
+
+void cullAndSelectLods(const LodInstance* instances, size_t instanceCount,
+                       const LodSelectParams* params, uint32_t* lods)
+{
+    LodSelectJob job = { instances, instanceCount, params, lods };
+    uint32_t jobCount = (uint32_t)((instanceCount + kLodInstancesPerJob - 1) / kLodInstancesPerJob);
+    jobsParallelFor(jobCount, selectLodsJob, &job);
+}
@@ -0,0 +1,107 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include "linalg.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * LEVELS OF DETAIL
+ *
+ * A LodChain is a list of progressively simplified index buffers over one
+ * shared vertex buffer, stored back to back in a single index array so the
+ * whole chain uploads as one GPU index buffer and a level is selected with
+ * firstIndex/indexCount.
+ *
+ * Each level records its geometric error (in mesh units). At runtime the
+ * error is projected to pixels and the coarsest level under the pixel
+ * threshold is picked, with hysteresis so instances near a switching
+ * distance don't flicker between two levels.
+ */
+
+#define kLodMaxLevels 8
+#define kLodCulled    UINT32_MAX
+
+typedef struct {
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    float error;
+} LodLevel;
+
+typedef struct {
+    LodLevel levels[kLodMaxLevels];
+    uint32_t levelCount;
+
+    uint32_t* indices;      // all levels, level 0 first
+    size_t indexCount;
+
+    float center[3];        // bounding sphere in mesh space
+    float radius;
+} LodChain;
+
+/** Input mesh for buildLodChain(). positionStride is in bytes. */
+typedef struct {
+    const uint32_t* indices;
+    size_t indexCount;
+    const float* positions;
+    size_t vertexCount;
+    size_t positionStride;
+} LodSourceMesh;
+
+/**
+ * Build a chain of up to maxLevels levels, each targeting `reduction` times
+ * the triangles of the previous one (e.g. 0.5). Generation stops early when
+ * the simplifier can no longer make meaningful progress.
+ */
+bool buildLodChain(LodChain* chain, const LodSourceMesh* mesh,
+                   uint32_t maxLevels, float reduction);
+
+/**
+ * Same as buildLodChain() for many meshes at once, one mesh per job on the
+ * job system. Returns false if any chain failed.
+ */
+bool buildLodChains(LodChain* chains, const LodSourceMesh* meshes, size_t meshCount,
+                    uint32_t maxLevels, float reduction);
+
+void releaseLodChain(LodChain* chain);
+
+/**
+ * Runtime selection parameters.
+ *
+ * - projectionScale: viewportHeight / (2 * tan(fovY / 2)), converts
+ *                    "world units at distance d" into pixels
+ * - pixelError:      largest acceptable projected error, in pixels
+ * - hysteresis:      fraction of pixelError used as a dead zone (e.g. 0.25)
+ * - planes:          world-space frustum planes, see mat4FrustumPlanes()
+ */
+typedef struct {
+    Vec3 cameraPosition;
+    float projectionScale;
+    float pixelError;
+    float hysteresis;
+    float planes[6][4];
+} LodSelectParams;
+
+typedef struct {
+    const LodChain* chain;
+    Mat4 model;
+} LodInstance;
+
+/**
+ * Pick a level for one instance. currentLod is the level used last frame
+ * (kLodCulled if none), which is what the hysteresis is relative to.
+ */
+uint32_t selectLod(const LodChain* chain, Mat4 model, uint32_t currentLod,
+                   const LodSelectParams* params);
+
+/**
+ * Frustum-cull and select levels for a batch of instances on the job
+ * system. lods holds last frame's selection on input and this frame's on
+ * output; culled instances get kLodCulled.
+ */
+void cullAndSelectLods(const LodInstance* instances, size_t instanceCount,
+                       const LodSelectParams* params, uint32_t* lods);
+
+#endif // LOD_H
@@ -1,5 +1,19 @@
 #include "global.h"
 #include "webgpu-utils.h"
+#include "jobs.h"
+#include "block-encoder.h"
+#include "profiler.h"
+#include "text.h"
+#include "hud.h"
+#include "debug-draw.h"
+#include "texture-pool.h"
+#include "msaa.h"
+#include "dynamic-resolution.h"
+#include "bloom.h"
+#include "auto-exposure.h"
+#include "post-process.h"
+#include "boids.h"
+#include "nbody.h"
 
 
 #include <webgpu/webgpu.h>
@@ -16,11 +30,16 @@
 #endif // __EMSCRIPTEN__
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 const uint32_t kScreenWidth = 640;
 const uint32_t kScreenHeight = 480;
 
+/** HDR scene color, rendered at the dynamic resolution, post-processed and upscaled. */
+#define kSceneColorFormat WGPUTextureFormat_RGBA16Float
+
 /*
  * SDL SHIT
  *
@@ -68,74 +87,288 @@ bool initApp(Context* context)
 
     if (!initWebGPU(context)) return false;
 
+    // Worker threads for parallel asset processing and culling
+    if (!initJobSystem(0)) return false;
+
     return true;
 }
 
 void closeContext(Context* context)
 {
+    shutdownJobSystem();
     wgpuQueueRelease(context->queue);
     wgpuDeviceRelease(context->device);
     closeSDL(context);
 }
 
-
-int main ()
+/**
+ * Headless self-test of the GPU block encoders. Runs on the fallback
+ * adapter (SwiftShader with Dawn) so it behaves the same on CI machines
+ * without a GPU.
+ */
+bool runBlockEncoderTest(void)
 {
+    Context context = {0};
+    if (!initWebGPUHeadless(&context, true)) return false;
+    if (!initJobSystem(0)) return false;
+
+    BlockEncoder encoder;
+    bool ok = createBlockEncoder(&encoder, context.device, context.queue) &&
+              testBlockEncoder(&encoder);
+    releaseBlockEncoder(&encoder);
+
+    shutdownJobSystem();
+    wgpuQueueRelease(context.queue);
+    wgpuDeviceRelease(context.device);
+    return ok;
+}
 
-    /**
-     * Initialize App
-     */
+/**
+ * Headless boid throughput benchmark, on the real adapter: a crowd of
+ * `agentCount` agents for a fixed number of steps.
+ */
+bool runBoidsBenchmark(uint32_t agentCount)
+{
     Context context = {0};
-    initApp(&context);
+    if (!initWebGPUHeadless(&context, false)) return false;
 
+    bool ok = boidsBenchmark(context.device, context.queue, agentCount, 100);
+
+    wgpuQueueRelease(context.queue);
+    wgpuDeviceRelease(context.device);
+    return ok;
+}
 
+/**
+ * Headless n-body throughput benchmark, on the real adapter. Runs the same
+ * on Dawn and wgpu-native builds, to compare them.
+ */
+bool runNBodyBenchmark(NBodyMethod method, uint32_t bodyCount)
+{
+    Context context = {0};
+    if (!initWebGPUHeadless(&context, false)) return false;
 
+    bool ok = nbodyBenchmark(&context, method, bodyCount, 20);
 
+    wgpuQueueRelease(context.queue);
+    wgpuDeviceRelease(context.device);
+    return ok;
+}
 
-    // Command encoder
-    WGPUCommandEncoderDescriptor encoderDesc = {0};
-    encoderDesc.nextInChain = NULL;
-    encoderDesc.label = "My command encoder";
-    WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(context.device, &encoderDesc);
 
-    // Debug placeholder for encoder instruction (no object to manipulate yet)
-    wgpuCommandEncoderInsertDebugMarker(encoder, "Do one thing");
-    wgpuCommandEncoderInsertDebugMarker(encoder, "Do another thing");
+int main (int argc, char* argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "--test-block-encoder") == 0) {
+        return runBlockEncoderTest() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-boids") == 0) {
+        uint32_t agentCount = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 1000000;
+        return runBoidsBenchmark(agentCount) ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-nbody") == 0) {
+        // --bench-nbody [all-pairs|barnes-hut] [count]
+        NBodyMethod method = argc > 2 && strcmp(argv[2], "barnes-hut") == 0 ? NBodyMethod_BarnesHut
+                                                                            : NBodyMethod_AllPairs;
+        uint32_t bodyCount = method == NBodyMethod_BarnesHut ? 1000000 : 65536;
+        if (argc > 3) bodyCount = (uint32_t)strtoul(argv[3], NULL, 10);
+        return runNBodyBenchmark(method, bodyCount) ? 0 : 1;
+    }
 
-    // Generate command buffer using encoder
-    WGPUCommandBufferDescriptor cmdBufferDescriptor = {0};
-    cmdBufferDescriptor.nextInChain = NULL;
-    cmdBufferDescriptor.label = "Command buffer";
-    WGPUCommandBuffer command = wgpuCommandEncoderFinish(encoder, &cmdBufferDescriptor);
+    /**
+     * Initialize App
+     */
+    Context context = {0};
+    if (!initApp(&context)) return 1;
 
-    // Release encoder
-    wgpuCommandEncoderRelease(encoder); 
 
-    // Finally, submit command queue
-    printf("Submitting command...\n");
-    wgpuQueueSubmit(context.queue, 1, &command);
-    wgpuCommandBufferRelease(command);
-    printf("Command submitted.\n");
-    // Must wait or else we destroy the device before command submission. 
-    for (int i = 0; i < 5; ++i) {
-        printf("Tick/Poll device...\n");
-#if defined(WEBGPU_BACKEND_DAWN)
-        wgpuDeviceTick(context.device);
-#elif defined(WEBGPU_BACKEND_WGPU)
-        wgpuDevicePoll(device, false, NULL);
-#elif defined(WEBGPU_BACKEND_EMSCRIPTEN)
-        emscripten_sleep(100);
-#endif
-    }
 
 
 
+    Profiler profiler;
+    TextRenderer text;
+    PerfHud hud;
+    DebugDraw debugDraw;
+    TexturePool texturePool;
+    DynamicResolution resolution;
+    PostChain post;
+    Bloom bloom;
+    AutoExposure autoExposure;
+    if (!createProfiler(&profiler, &context) ||
+        !createTextRenderer(&text, context.device, context.queue, context.surfaceFormat) ||
+        !createDebugDraw(&debugDraw, context.device, context.queue, kSceneColorFormat,
+                         WGPUTextureFormat_Undefined, context.sampleCount) ||
+        !createDynamicResolution(&resolution, context.device, &profiler, context.surfaceFormat, NULL)) {
+        closeContext(&context);
+        return 1;
+    }
+    initPerfHud(&hud);
+    createTexturePool(&texturePool, context.device, 120);
+    if (!createPostChain(&post, context.device, context.queue, &texturePool, kSceneColorFormat) ||
+        !createBloom(&bloom, context.device, context.queue) ||
+        !createAutoExposure(&autoExposure, context.device, context.queue, NULL)) {
+        closeContext(&context);
+        return 1;
+    }
+    bloomSetOutputSize(&bloom, kScreenWidth, kScreenHeight);
+    PostEffect bloomComposite = postBloomComposite(0.04f);
+    PostEffect tonemap = postTonemap(1.0f);
+    PostEffect vignette = postVignette(0.3f, 0.4f, 0.6f);
+    postChainAdd(&post, &bloomComposite);
+    postChainAdd(&post, &tonemap);
+    postChainAdd(&post, &vignette);
+    resolutionSetOutputSize(&resolution, kScreenWidth, kScreenHeight);
+
+    uint32_t glyphCounter = profilerCounter(&profiler, "text glyphs", ProfilerUnit_Count);
+    uint32_t uploadCounter = profilerCounter(&profiler, "atlas upload", ProfilerUnit_Bytes);
+    uint32_t atlasCounter = profilerCounter(&profiler, "atlas memory", ProfilerUnit_Bytes);
+    uint32_t scaleCounter = profilerCounter(&profiler, "render scale %", ProfilerUnit_Count);
+    uint32_t poolCounter = profilerCounter(&profiler, "texture pool", ProfilerUnit_Bytes);
 
     // main loop
-    while(1)
+    bool running = true;
+    uint64_t previousTicks = SDL_GetTicksNS();
+    while (running)
     {
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_EVENT_QUIT) running = false;
+            if (event.type == SDL_EVENT_KEY_DOWN) {
+                if (event.key.key == SDLK_ESCAPE) running = false;
+                if (event.key.key == SDLK_F1) hudToggle(&hud, &profiler);
+                if (event.key.key == SDLK_F2) resolutionSetEnabled(&resolution, !resolution.enabled);
+            }
+        }
+
+        profilerBeginFrame(&profiler);
+        resolutionUpdate(&resolution);
+        uint64_t ticks = SDL_GetTicksNS();
+        float timeDelta = (float)((double)(ticks - previousTicks) / 1e9);
+        previousTicks = ticks;
+
+        WGPUSurfaceTexture surfaceTexture;
+        wgpuSurfaceGetCurrentTexture(context.surface, &surfaceTexture);
+        if (surfaceTexture.status != WGPUSurfaceGetCurrentTextureStatus_Success) {
+            if (surfaceTexture.texture) wgpuTextureRelease(surfaceTexture.texture);
+            continue;
+        }
+        WGPUTextureView targetView = wgpuTextureCreateView(surfaceTexture.texture, NULL);
+
+        profilerSetCounter(&profiler, scaleCounter, resolution.scale * 100.0);
+        profilerSetCounter(&profiler, poolCounter, (double)texturePool.memoryBytes);
+        profilerSetCounter(&profiler, glyphCounter, text.drawCount); // last frame's, this one is still queuing
+        profilerSetCounter(&profiler, atlasCounter,
+                           (double)text.atlas.width * text.atlas.height * text.atlas.layerCount *
+                               text.atlas.bytesPerPixel);
+        hudDraw(&hud, &profiler, &text);
+        textRendererUpload(&text, kScreenWidth, kScreenHeight);
+        debugDrawUpload(&debugDraw, mat4Identity());
+        profilerSetCounter(&profiler, uploadCounter, (double)text.atlas.uploadedBytes);
+
+        WGPUCommandEncoderDescriptor encoderDesc = {0};
+        encoderDesc.label = "Frame encoder";
+        WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(context.device, &encoderDesc);
+
+        // The scene renders at the dynamic resolution...
+        TexturePoolDesc sceneDesc = {0};
+        sceneDesc.width = resolution.renderWidth;
+        sceneDesc.height = resolution.renderHeight;
+        sceneDesc.format = kSceneColorFormat;
+        sceneDesc.usage = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_TextureBinding;
+        PooledTexture* scene = texturePoolAcquire(&texturePool, &sceneDesc);
+
+        // ...multisampled, resolved into the pooled scene texture
+        WGPURenderPassColorAttachment colorAttachment = {0};
+        PooledTexture* sceneSamples = NULL;
+        if (!scene || !msaaColorAttachment(&colorAttachment, &sceneSamples, &texturePool, context.sampleCount,
+                                           scene->view, kSceneColorFormat, sceneDesc.width,
+                                           sceneDesc.height)) {
+            colorAttachment.view = targetView;
+            colorAttachment.resolveTarget = NULL;
+            colorAttachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+            colorAttachment.storeOp = WGPUStoreOp_Store;
+            if (scene) {
+                texturePoolRelease(&texturePool, scene);
+                scene = NULL;
+            }
+        }
+        colorAttachment.loadOp = WGPULoadOp_Clear;
+        colorAttachment.clearValue = (WGPUColor){0.05, 0.05, 0.08, 1.0};
+
+        WGPURenderPassDescriptor passDesc = {0};
+        passDesc.label = "Scene pass";
+        passDesc.colorAttachmentCount = 1;
+        passDesc.colorAttachments = &colorAttachment;
+        passDesc.timestampWrites = profilerRenderPass(&profiler, "scene");
+        WGPURenderPassEncoder pass = wgpuCommandEncoderBeginRenderPass(encoder, &passDesc);
+        if (scene) debugDrawRender(&debugDraw, pass);
+        wgpuRenderPassEncoderEnd(pass);
+        wgpuRenderPassEncoderRelease(pass);
+        if (sceneSamples) texturePoolRelease(&texturePool, sceneSamples);
+
+        // ...is post-processed at that resolution...
+        PooledTexture* processed = scene ? texturePoolAcquire(&texturePool, &sceneDesc) : NULL;
+        if (processed) {
+            exposureUpdate(&autoExposure, encoder, scene->view, sceneDesc.width, sceneDesc.height, timeDelta,
+                           profilerComputePass(&profiler, "exposure"));
+            bloomRender(&bloom, encoder, scene->view, profilerComputePass(&profiler, "bloom"));
+
+            PostChainInput postInput = {0};
+            postInput.source = scene->view;
+            postInput.bloom = bloomOutput(&bloom);
+            postInput.exposure = autoExposure.stateBuffer;
+            postInput.width = sceneDesc.width;
+            postInput.height = sceneDesc.height;
+            postChainRender(&post, encoder, &postInput, processed->view, &profiler);
+            texturePoolRelease(&texturePool, scene);
+        }
+
+        // ...then is upscaled to the surface, and the UI drawn at full resolution
+        if (processed) {
+            resolutionUpscale(&resolution, encoder, processed->view, targetView,
+                              profilerRenderPass(&profiler, "upscale"));
+        }
+
+        colorAttachment.view = targetView;
+        colorAttachment.resolveTarget = NULL;
+        colorAttachment.loadOp = WGPULoadOp_Load;
+        colorAttachment.storeOp = WGPUStoreOp_Store;
+        passDesc.label = "UI pass";
+        passDesc.timestampWrites = profilerRenderPass(&profiler, "ui");
+        pass = wgpuCommandEncoderBeginRenderPass(encoder, &passDesc);
+        textRendererDraw(&text, pass);
+        wgpuRenderPassEncoderEnd(pass);
+        wgpuRenderPassEncoderRelease(pass);
+
+        profilerResolve(&profiler, encoder);
+
+        WGPUCommandBufferDescriptor cmdBufferDescriptor = {0};
+        cmdBufferDescriptor.label = "Frame commands";
+        WGPUCommandBuffer command = wgpuCommandEncoderFinish(encoder, &cmdBufferDescriptor);
+        wgpuCommandEncoderRelease(encoder);
+        wgpuQueueSubmit(context.queue, 1, &command);
+        wgpuCommandBufferRelease(command);
+        profilerEndFrame(&profiler);
+
+        wgpuSurfacePresent(context.surface);
+        wgpuTextureViewRelease(targetView);
+        wgpuTextureRelease(surfaceTexture.texture);
+        texturePoolEndFrame(&texturePool);
+
+#if defined(WEBGPU_BACKEND_DAWN)
+        wgpuDeviceTick(context.device);
+#elif defined(WEBGPU_BACKEND_WGPU)
+        wgpuDevicePoll(context.device, false, NULL);
+#endif
     }
 
+    releaseAutoExposure(&autoExposure);
+    releaseBloom(&bloom);
+    releasePostChain(&post);
+    releaseTexturePool(&texturePool);
+    releaseDynamicResolution(&resolution);
+    releaseDebugDraw(&debugDraw);
+    releaseTextRenderer(&text);
+    releaseProfiler(&profiler);
     closeContext(&context);
 
     return 0;
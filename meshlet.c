@@ -0,0 +1,804 @@
+#include "meshlet.h"
+#include "webgpu-utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#define kNoLocalIndex 0xff
+// Unused triangles, in index order, a meshlet without neighbours picks its next one from
+#define kMeshletFallbackWindow 64
+
+/**
+ * Uniform block of the culling shader. Must match CullUniforms in
+ * kMeshletCullWGSL (288 bytes).
+ */
+typedef struct {
+    float model[16];
+    float viewProj[16];
+    float planes[6][4];
+    float cameraPosition[3];
+    float scale;
+    float objectCenter[3];
+    float objectRadius;
+    uint32_t meshletCount;
+    uint32_t flags;
+    uint32_t hizMipCount;
+    uint32_t _pad0;
+    float hizSize[2];
+    float _pad1[2];
+} MeshletCullUniforms;
+
+#define kCullFlagFrustum   1u
+#define kCullFlagCone      2u
+#define kCullFlagOcclusion 4u
+
+/** Two DrawIndexedIndirect records: the early phase, then the late one. */
+#define kDrawArgsSize (2 * 5 * sizeof(uint32_t))
+#define kLateDrawOffset (5 * sizeof(uint32_t))
+
+static const char* const kMeshletCullWGSL[] = {
+"struct Meshlet {\n"
+"    vertexOffset: u32,\n"
+"    triangleOffset: u32,\n"
+"    vertexCount: u32,\n"
+"    triangleCount: u32,\n"
+"}\n"
+"struct MeshletBounds {\n"
+"    center: vec3f,\n"
+"    radius: f32,\n"
+"    coneAxis: vec3f,\n"
+"    coneCutoff: f32,\n"
+"}\n"
+"struct CullUniforms {\n"
+"    model: mat4x4f,\n"
+"    viewProj: mat4x4f,\n"
+"    planes: array<vec4f, 6>,\n"
+"    cameraPosition: vec3f,\n"
+"    scale: f32,\n"
+"    objectCenter: vec3f,\n"
+"    objectRadius: f32,\n"
+"    meshletCount: u32,\n"
+"    flags: u32,\n"
+"    hizMipCount: u32,\n"
+"    hizSize: vec2f,\n"
+"}\n"
+"struct DrawIndexedArgs {\n"
+"    indexCount: atomic<u32>,\n"
+"    instanceCount: atomic<u32>,\n"
+"    firstIndex: u32,\n"
+"    baseVertex: i32,\n"
+"    firstInstance: u32,\n"
+"}\n"
+"\n"
+"@group(0) @binding(0) var<uniform> cull: CullUniforms;\n"
+"@group(0) @binding(1) var<storage, read> meshlets: array<Meshlet>;\n"
+"@group(0) @binding(2) var<storage, read> bounds: array<MeshletBounds>;\n"
+"@group(0) @binding(3) var<storage, read> meshletVertices: array<u32>;\n"
+"@group(0) @binding(4) var<storage, read> meshletTriangles: array<u32>;\n"
+"@group(0) @binding(5) var<storage, read_write> draws: array<DrawIndexedArgs, 2>;\n"
+"@group(0) @binding(6) var<storage, read_write> outIndices: array<u32>;\n"
+"@group(0) @binding(7) var<storage, read_write> visibility: array<u32>;\n"
+"@group(0) @binding(8) var hiz: texture_2d<f32>;\n"
+"\n"
+"const kCulled = 0xffffffffu;\n"
+"var<workgroup> firstIndex: u32;\n"
+"\n"
+"fn isVisible(b: MeshletBounds) -> bool {\n"
+"    let center = (cull.model * vec4f(b.center, 1.0)).xyz;\n"
+"    let radius = b.radius * cull.scale;\n"
+"    if ((cull.flags & 1u) != 0u) {\n"
+"        for (var i = 0u; i < 6u; i++) {\n"
+"            let plane = cull.planes[i];\n"
+"            if (dot(plane.xyz, center) + plane.w < -radius) {\n"
+"                return false;\n"
+"            }\n"
+"        }\n"
+"    }\n"
+"    if ((cull.flags & 2u) != 0u && b.coneCutoff < 1.0) {\n"
+"        let axis = normalize((cull.model * vec4f(b.coneAxis, 0.0)).xyz);\n"
+"        let toCenter = center - cull.cameraPosition;\n"
+"        if (dot(toCenter, axis) >= b.coneCutoff * length(toCenter) + radius) {\n"
+"            return false;\n"
+"        }\n"
+"    }\n"
+"    return true;\n"
+"}\n"
+"\n",
+"// Conservative Hi-Z test of a world-space sphere: the screen rectangle and\n"
+"// nearest depth of its bounding box against the farthest depth of the (at\n"
+"// most 2x2) pyramid texels of the level where the rectangle is one texel\n"
+"fn isOccluded(center: vec3f, radius: f32) -> bool {\n"
+"    var ndcMin = vec3f(1e30);\n"
+"    var ndcMax = vec3f(-1e30);\n"
+"    for (var i = 0u; i < 8u; i++) {\n"
+"        let corner = center + radius * vec3f(select(-1.0, 1.0, (i & 1u) != 0u),\n"
+"                                             select(-1.0, 1.0, (i & 2u) != 0u),\n"
+"                                             select(-1.0, 1.0, (i & 4u) != 0u));\n"
+"        let clip = cull.viewProj * vec4f(corner, 1.0);\n"
+"        if (clip.w <= 0.0) {\n"
+"            return false; // reaches behind the camera\n"
+"        }\n"
+"        let ndc = clip.xyz / clip.w;\n"
+"        ndcMin = min(ndcMin, ndc);\n"
+"        ndcMax = max(ndcMax, ndc);\n"
+"    }\n"
+"    // Texture space has y going down\n"
+"    let uvMin = saturate(vec2f(ndcMin.x * 0.5 + 0.5, 0.5 - ndcMax.y * 0.5));\n"
+"    let uvMax = saturate(vec2f(ndcMax.x * 0.5 + 0.5, 0.5 - ndcMin.y * 0.5));\n"
+"    let extent = (uvMax - uvMin) * cull.hizSize;\n"
+"    let level = min(u32(ceil(log2(max(max(extent.x, extent.y), 1.0)))), cull.hizMipCount - 1u);\n"
+"    let levelSize = max(vec2u(cull.hizSize) >> vec2u(level), vec2u(1u));\n"
+"    let texelMin = min(vec2u(uvMin * vec2f(levelSize)), levelSize - 1u);\n"
+"    let texelMax = min(vec2u(uvMax * vec2f(levelSize)), levelSize - 1u);\n"
+"    let farthest = max(max(textureLoad(hiz, texelMin, level).r,\n"
+"                           textureLoad(hiz, vec2u(texelMax.x, texelMin.y), level).r),\n"
+"                       max(textureLoad(hiz, vec2u(texelMin.x, texelMax.y), level).r,\n"
+"                           textureLoad(hiz, texelMax, level).r));\n"
+"    return ndcMin.z > farthest;\n"
+"}\n"
+"\n"
+"fn meshletOccluded(b: MeshletBounds) -> bool {\n"
+"    // The whole mesh first: one test rejects every meshlet of a hidden object\n"
+"    let objectCenter = (cull.model * vec4f(cull.objectCenter, 1.0)).xyz;\n"
+"    if (isOccluded(objectCenter, cull.objectRadius * cull.scale)) {\n"
+"        return true;\n"
+"    }\n"
+"    return isOccluded((cull.model * vec4f(b.center, 1.0)).xyz, b.radius * cull.scale);\n"
+"}\n"
+"\n"
+"// Invocation 0 of a meshlet's workgroup decides whether a phase draws it\n"
+"// and reserves space in the output; these return the first output index.\n"
+"// The early phase takes the meshlets visible last frame (every visible\n"
+"// one without occlusion culling).\n"
+"fn reserveEarly(index: u32) -> u32 {\n"
+"    if (index >= cull.meshletCount || !isVisible(bounds[index])) {\n"
+"        return kCulled;\n"
+"    }\n"
+"    if ((cull.flags & 4u) != 0u && visibility[index] == 0u) {\n"
+"        return kCulled;\n"
+"    }\n"
+"    atomicStore(&draws[0].instanceCount, 1u);\n"
+"    return atomicAdd(&draws[0].indexCount, meshlets[index].triangleCount * 3u);\n"
+"}\n"
+"\n"
+"// The late phase tests the others against the Hi-Z of the early phase's\n"
+"// depth, and records which meshlets are visible for the next frame.\n"
+"fn reserveLate(index: u32) -> u32 {\n"
+"    if (index == 0u) {\n"
+"        draws[1].firstIndex = atomicLoad(&draws[0].indexCount);\n"
+"    }\n"
+"    if (index >= cull.meshletCount) {\n"
+"        return kCulled;\n"
+"    }\n"
+"    let wasVisible = visibility[index] != 0u;\n"
+"    let nowVisible = isVisible(bounds[index]) && !meshletOccluded(bounds[index]);\n"
+"    visibility[index] = select(0u, 1u, nowVisible);\n"
+"    if (!nowVisible || wasVisible) {\n"
+"        return kCulled;\n"
+"    }\n"
+"    // Late indices go after the early ones, in the same buffer\n"
+"    atomicStore(&draws[1].instanceCount, 1u);\n"
+"    return atomicLoad(&draws[0].indexCount) +\n"
+"           atomicAdd(&draws[1].indexCount, meshlets[index].triangleCount * 3u);\n"
+"}\n"
+"\n",
+"// One workgroup per meshlet: once invocation 0 has reserved space in the\n"
+"// output, the whole group copies the triangles.\n"
+"fn emitTriangles(index: u32, lid: u32) {\n"
+"    let base = workgroupUniformLoad(&firstIndex);\n"
+"    if (base == kCulled) {\n"
+"        return;\n"
+"    }\n"
+"    let m = meshlets[index];\n"
+"    for (var t = lid; t < m.triangleCount; t += 64u) {\n"
+"        let packed = meshletTriangles[m.triangleOffset + t];\n"
+"        let dst = base + t * 3u;\n"
+"        outIndices[dst + 0u] = meshletVertices[m.vertexOffset + (packed & 0xffu)];\n"
+"        outIndices[dst + 1u] = meshletVertices[m.vertexOffset + ((packed >> 8u) & 0xffu)];\n"
+"        outIndices[dst + 2u] = meshletVertices[m.vertexOffset + ((packed >> 16u) & 0xffu)];\n"
+"    }\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(64)\n"
+"fn cullEarly(@builtin(workgroup_id) groupId: vec3u,\n"
+"             @builtin(num_workgroups) groupCount: vec3u,\n"
+"             @builtin(local_invocation_index) lid: u32) {\n"
+"    let index = groupId.x + groupId.y * groupCount.x;\n"
+"    if (lid == 0u) {\n"
+"        firstIndex = reserveEarly(index);\n"
+"    }\n"
+"    emitTriangles(index, lid);\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(64)\n"
+"fn cullLate(@builtin(workgroup_id) groupId: vec3u,\n"
+"            @builtin(num_workgroups) groupCount: vec3u,\n"
+"            @builtin(local_invocation_index) lid: u32) {\n"
+"    let index = groupId.x + groupId.y * groupCount.x;\n"
+"    if (lid == 0u) {\n"
+"        firstIndex = reserveLate(index);\n"
+"    }\n"
+"    emitTriangles(index, lid);\n"
+"}\n",
+};
+
+static Vec3 loadPosition(const float* positions, size_t stride, uint32_t index)
+{
+    const float* p = (const float*)((const char*)positions + (size_t)index * stride);
+    return vec3(p[0], p[1], p[2]);
+}
+
+/**
+ * Ritter's bounding sphere: start from the two farthest points along an
+ * initial sweep, then grow the sphere to include every outlier.
+ */
+static void computeBoundingSphere(const MeshletMesh* mesh, const Meshlet* m,
+                                  const float* positions, size_t stride,
+                                  MeshletBounds* bounds)
+{
+    const uint32_t* verts = mesh->vertices + m->vertexOffset;
+
+    Vec3 first = loadPosition(positions, stride, verts[0]);
+    Vec3 a = first;
+    float best = -1.0f;
+    for (uint32_t i = 0; i < m->vertexCount; ++i) {
+        Vec3 p = loadPosition(positions, stride, verts[i]);
+        float d = vec3Length(vec3Sub(p, first));
+        if (d > best) { best = d; a = p; }
+    }
+    Vec3 b = a;
+    best = -1.0f;
+    for (uint32_t i = 0; i < m->vertexCount; ++i) {
+        Vec3 p = loadPosition(positions, stride, verts[i]);
+        float d = vec3Length(vec3Sub(p, a));
+        if (d > best) { best = d; b = p; }
+    }
+
+    Vec3 center = vec3Scale(vec3Add(a, b), 0.5f);
+    float radius = best * 0.5f;
+    for (uint32_t i = 0; i < m->vertexCount; ++i) {
+        Vec3 p = loadPosition(positions, stride, verts[i]);
+        float d = vec3Length(vec3Sub(p, center));
+        if (d > radius) {
+            float newRadius = (radius + d) * 0.5f;
+            center = vec3Add(center, vec3Scale(vec3Sub(p, center), (newRadius - radius) / d));
+            radius = newRadius;
+        }
+    }
+
+    bounds->center[0] = center.x;
+    bounds->center[1] = center.y;
+    bounds->center[2] = center.z;
+    bounds->radius = radius;
+}
+
+/**
+ * Normal cone: the axis is the average triangle normal and the cutoff is
+ * the sine of the widest angle between the axis and any normal. Clusters
+ * whose normals spread past ~84 degrees are never cone-culled.
+ */
+static void computeNormalCone(const MeshletMesh* mesh, const Meshlet* m,
+                              const float* positions, size_t stride,
+                              MeshletBounds* bounds)
+{
+    const uint32_t* verts = mesh->vertices + m->vertexOffset;
+    const uint8_t* tris = mesh->triangles + (size_t)m->triangleOffset * 3;
+
+    Vec3 normals[kMeshletMaxTriangles];
+    uint32_t normalCount = 0;
+    Vec3 axis = vec3(0.0f, 0.0f, 0.0f);
+
+    for (uint32_t t = 0; t < m->triangleCount; ++t) {
+        Vec3 p0 = loadPosition(positions, stride, verts[tris[t * 3 + 0]]);
+        Vec3 p1 = loadPosition(positions, stride, verts[tris[t * 3 + 1]]);
+        Vec3 p2 = loadPosition(positions, stride, verts[tris[t * 3 + 2]]);
+        Vec3 n = vec3Cross(vec3Sub(p1, p0), vec3Sub(p2, p0));
+        float len = vec3Length(n);
+        if (len <= FLT_EPSILON) continue; // degenerate triangles don't constrain the cone
+        n = vec3Scale(n, 1.0f / len);
+        normals[normalCount++] = n;
+        axis = vec3Add(axis, n);
+    }
+
+    bounds->coneAxis[0] = 0.0f;
+    bounds->coneAxis[1] = 0.0f;
+    bounds->coneAxis[2] = 0.0f;
+    bounds->coneCutoff = 1.0f;
+
+    if (normalCount == 0 || vec3Length(axis) <= FLT_EPSILON) return;
+    axis = vec3Normalize(axis);
+
+    float minDot = 1.0f;
+    for (uint32_t i = 0; i < normalCount; ++i) {
+        float d = vec3Dot(normals[i], axis);
+        if (d < minDot) minDot = d;
+    }
+    if (minDot <= 0.1f) return;
+
+    bounds->coneAxis[0] = axis.x;
+    bounds->coneAxis[1] = axis.y;
+    bounds->coneAxis[2] = axis.z;
+    bounds->coneCutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+/**
+ * BUILD MESHLETS
+ *
+ * Greedy clustering: start a meshlet from the next unused triangle in
+ * index order, then keep adding the adjacent triangle that introduces the
+ * fewest new vertices (preferring vertices with few remaining triangles,
+ * so the cluster "closes off" its border). When no unused triangle is
+ * adjacent (the cluster's region is used up, or the mesh isn't welded),
+ * the closest of the next kMeshletFallbackWindow unused triangles is taken
+ * instead. Meshlets are only flushed when the vertex or triangle limit is
+ * reached.
+ */
+bool buildMeshlets(MeshletMesh* out,
+                   const uint32_t* indices, size_t indexCount,
+                   const float* positions, size_t vertexCount,
+                   size_t positionStride)
+{
+    memset(out, 0, sizeof *out);
+
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0 || vertexCount == 0) {
+        fprintf(stderr, "buildMeshlets: empty mesh\n");
+        return false;
+    }
+
+    // Vertex -> triangle adjacency (CSR layout)
+    uint32_t* adjacencyOffsets = calloc(vertexCount + 1, sizeof *adjacencyOffsets);
+    uint32_t* adjacency = malloc(triangleCount * 3 * sizeof *adjacency);
+    uint32_t* liveTriangles = calloc(vertexCount, sizeof *liveTriangles);
+    uint8_t* localIndex = malloc(vertexCount);
+    bool* used = calloc(triangleCount, sizeof *used);
+
+    out->meshlets = malloc(triangleCount * sizeof *out->meshlets);
+    out->vertices = malloc(triangleCount * 3 * sizeof *out->vertices);
+    out->triangles = malloc(triangleCount * 3);
+
+    if (!adjacencyOffsets || !adjacency || !liveTriangles || !localIndex || !used ||
+        !out->meshlets || !out->vertices || !out->triangles) {
+        fprintf(stderr, "buildMeshlets: out of memory (%zu triangles)\n", triangleCount);
+        free(adjacencyOffsets); free(adjacency); free(liveTriangles); free(localIndex); free(used);
+        releaseMeshlets(out);
+        return false;
+    }
+
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        liveTriangles[indices[i]]++;
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+    }
+    {
+        uint32_t* fill = calloc(vertexCount, sizeof *fill);
+        if (!fill) {
+            fprintf(stderr, "buildMeshlets: out of memory\n");
+            free(adjacencyOffsets); free(adjacency); free(liveTriangles); free(localIndex); free(used);
+            releaseMeshlets(out);
+            return false;
+        }
+        for (size_t t = 0; t < triangleCount; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = indices[t * 3 + k];
+                adjacency[adjacencyOffsets[v] + fill[v]++] = (uint32_t)t;
+            }
+        }
+        free(fill);
+    }
+    memset(localIndex, kNoLocalIndex, vertexCount);
+
+    Meshlet current = {0};
+    Vec3 centroidSum = vec3(0.0f, 0.0f, 0.0f);  // of the current meshlet's vertices
+    size_t scanCursor = 0;
+    size_t remaining = triangleCount;
+
+    while (remaining > 0) {
+        // 1. Pick the best triangle adjacent to the current meshlet
+        uint32_t bestTriangle = UINT32_MAX;
+        int bestNew = 4;
+        uint32_t bestLive = UINT32_MAX;
+
+        for (uint32_t i = 0; i < current.vertexCount; ++i) {
+            uint32_t v = out->vertices[current.vertexOffset + i];
+            for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a) {
+                uint32_t t = adjacency[a];
+                if (used[t]) continue;
+
+                int newVertices = 0;
+                uint32_t live = 0;
+                for (int k = 0; k < 3; ++k) {
+                    uint32_t tv = indices[t * 3 + k];
+                    newVertices += localIndex[tv] == kNoLocalIndex;
+                    live += liveTriangles[tv];
+                }
+                if (newVertices < bestNew || (newVertices == bestNew && live < bestLive)) {
+                    bestTriangle = t;
+                    bestNew = newVertices;
+                    bestLive = live;
+                }
+            }
+        }
+
+        // 2. Otherwise the unused triangle nearest to the meshlet among the
+        //    next few in index order (the first one for an empty meshlet)
+        if (bestTriangle == UINT32_MAX) {
+            while (used[scanCursor]) scanCursor++;
+            bestTriangle = (uint32_t)scanCursor;
+            if (current.vertexCount > 0) {
+                Vec3 center = vec3Scale(centroidSum, 1.0f / (float)current.vertexCount);
+                float bestDistance = INFINITY;
+                size_t candidates = 0;
+                for (size_t t = scanCursor; t < triangleCount && candidates < kMeshletFallbackWindow; ++t) {
+                    if (used[t]) continue;
+                    candidates++;
+                    Vec3 sum = vec3(0.0f, 0.0f, 0.0f);
+                    for (int k = 0; k < 3; ++k) {
+                        sum = vec3Add(sum, loadPosition(positions, positionStride, indices[t * 3 + k]));
+                    }
+                    Vec3 offset = vec3Sub(vec3Scale(sum, 1.0f / 3.0f), center);
+                    float distance = vec3Dot(offset, offset);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        bestTriangle = (uint32_t)t;
+                    }
+                }
+            }
+            bestNew = 0;
+            for (int k = 0; k < 3; ++k) {
+                bestNew += localIndex[indices[bestTriangle * 3 + k]] == kNoLocalIndex;
+            }
+        }
+
+        // 3. Flush when the triangle doesn't fit
+        if (current.vertexCount + bestNew > kMeshletMaxVertices ||
+            current.triangleCount + 1 > kMeshletMaxTriangles) {
+            for (uint32_t i = 0; i < current.vertexCount; ++i) {
+                localIndex[out->vertices[current.vertexOffset + i]] = kNoLocalIndex;
+            }
+            out->meshlets[out->meshletCount++] = current;
+            current.vertexOffset += current.vertexCount;
+            current.triangleOffset += current.triangleCount;
+            current.vertexCount = 0;
+            current.triangleCount = 0;
+            centroidSum = vec3(0.0f, 0.0f, 0.0f);
+            continue; // re-pick: the new meshlet has no neighbours yet
+        }
+
+        // 4. Append the triangle
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = indices[bestTriangle * 3 + k];
+            if (localIndex[v] == kNoLocalIndex) {
+                localIndex[v] = (uint8_t)current.vertexCount;
+                out->vertices[current.vertexOffset + current.vertexCount++] = v;
+                centroidSum = vec3Add(centroidSum, loadPosition(positions, positionStride, v));
+            }
+            out->triangles[(size_t)(current.triangleOffset + current.triangleCount) * 3 + k] = localIndex[v];
+            liveTriangles[v]--;
+        }
+        current.triangleCount++;
+        used[bestTriangle] = true;
+        remaining--;
+    }
+
+    if (current.triangleCount > 0) {
+        out->meshlets[out->meshletCount++] = current;
+    }
+    out->vertexCount = current.vertexOffset + current.vertexCount;
+    out->triangleCount = triangleCount;
+
+    free(adjacencyOffsets);
+    free(adjacency);
+    free(liveTriangles);
+    free(localIndex);
+    free(used);
+
+    // Shrink the worst-case allocations (failure just keeps the larger block)
+    Meshlet* meshlets = realloc(out->meshlets, out->meshletCount * sizeof *meshlets);
+    if (meshlets) out->meshlets = meshlets;
+    uint32_t* vertices = realloc(out->vertices, out->vertexCount * sizeof *vertices);
+    if (vertices) out->vertices = vertices;
+
+    out->bounds = malloc(out->meshletCount * sizeof *out->bounds);
+    if (!out->bounds) {
+        fprintf(stderr, "buildMeshlets: out of memory (bounds)\n");
+        releaseMeshlets(out);
+        return false;
+    }
+    for (size_t i = 0; i < out->meshletCount; ++i) {
+        computeBoundingSphere(out, &out->meshlets[i], positions, positionStride, &out->bounds[i]);
+        computeNormalCone(out, &out->meshlets[i], positions, positionStride, &out->bounds[i]);
+    }
+
+    return true;
+}
+
+void releaseMeshlets(MeshletMesh* mesh)
+{
+    free(mesh->meshlets);
+    free(mesh->bounds);
+    free(mesh->vertices);
+    free(mesh->triangles);
+    memset(mesh, 0, sizeof *mesh);
+}
+
+#define kCullBufferCount 8
+
+/** Bindings 0-7 of both culling phases. */
+static void fillBufferEntries(const MeshletCuller* culler, WGPUBindGroupEntry entries[kCullBufferCount])
+{
+    WGPUBuffer buffers[kCullBufferCount] = {
+        culler->uniformBuffer, culler->meshletBuffer, culler->boundsBuffer,
+        culler->vertexBuffer, culler->triangleBuffer, culler->drawArgsBuffer,
+        culler->indexBuffer, culler->visibilityBuffer
+    };
+    for (uint32_t i = 0; i < kCullBufferCount; ++i) {
+        entries[i].binding = i;
+        entries[i].buffer = buffers[i];
+        entries[i].offset = 0;
+        entries[i].size = wgpuBufferGetSize(buffers[i]);
+    }
+}
+
+/**
+ * CREATE MESHLET CULLER
+ *
+ * Uploads the meshlet data and builds the culling pipeline. Triangles are
+ * repacked from 3 bytes into one u32 each so the shader can fetch a whole
+ * triangle with a single load.
+ */
+bool createMeshletCuller(MeshletCuller* culler,
+                         WGPUDevice device,
+                         WGPUQueue queue,
+                         const MeshletMesh* mesh)
+{
+    memset(culler, 0, sizeof *culler);
+
+    if (mesh->meshletCount == 0) {
+        fprintf(stderr, "createMeshletCuller: mesh has no meshlets\n");
+        return false;
+    }
+
+    uint32_t* packedTriangles = malloc(mesh->triangleCount * sizeof *packedTriangles);
+    if (!packedTriangles) {
+        fprintf(stderr, "createMeshletCuller: out of memory\n");
+        return false;
+    }
+    for (size_t t = 0; t < mesh->triangleCount; ++t) {
+        packedTriangles[t] = (uint32_t)mesh->triangles[t * 3 + 0] |
+                             (uint32_t)mesh->triangles[t * 3 + 1] << 8 |
+                             (uint32_t)mesh->triangles[t * 3 + 2] << 16;
+    }
+
+    culler->meshletCount = (uint32_t)mesh->meshletCount;
+    culler->frustumCulling = true;
+    culler->coneCulling = true;
+
+    // Sphere around every meshlet sphere, for the whole-object occlusion test
+    float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (size_t i = 0; i < mesh->meshletCount; ++i) {
+        const MeshletBounds* b = &mesh->bounds[i];
+        for (int k = 0; k < 3; ++k) {
+            lo[k] = fminf(lo[k], b->center[k] - b->radius);
+            hi[k] = fmaxf(hi[k], b->center[k] + b->radius);
+        }
+    }
+    Vec3 center = vec3((lo[0] + hi[0]) * 0.5f, (lo[1] + hi[1]) * 0.5f, (lo[2] + hi[2]) * 0.5f);
+    for (size_t i = 0; i < mesh->meshletCount; ++i) {
+        const MeshletBounds* b = &mesh->bounds[i];
+        Vec3 c = {b->center[0], b->center[1], b->center[2]};
+        float r = vec3Length(vec3Sub(c, center)) + b->radius;
+        if (r > culler->objectRadius) culler->objectRadius = r;
+    }
+    culler->objectCenter = center;
+
+    const WGPUBufferUsageFlags storage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst;
+    culler->uniformBuffer = createBuffer(device, "Meshlet cull uniforms", sizeof(MeshletCullUniforms),
+                                         WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    culler->meshletBuffer = createBuffer(device, "Meshlets", mesh->meshletCount * sizeof(Meshlet), storage);
+    culler->boundsBuffer = createBuffer(device, "Meshlet bounds", mesh->meshletCount * sizeof(MeshletBounds), storage);
+    culler->vertexBuffer = createBuffer(device, "Meshlet vertices", mesh->vertexCount * sizeof(uint32_t), storage);
+    culler->triangleBuffer = createBuffer(device, "Meshlet triangles", mesh->triangleCount * sizeof(uint32_t), storage);
+    culler->drawArgsBuffer = createBuffer(device, "Meshlet draw args", kDrawArgsSize,
+                                          WGPUBufferUsage_Storage | WGPUBufferUsage_Indirect | WGPUBufferUsage_CopyDst);
+    culler->indexBuffer = createBuffer(device, "Meshlet visible indices", mesh->triangleCount * 3 * sizeof(uint32_t),
+                                       WGPUBufferUsage_Storage | WGPUBufferUsage_Index);
+    culler->visibilityBuffer = createBuffer(device, "Meshlet visibility", mesh->meshletCount * sizeof(uint32_t), storage);
+
+    if (!culler->uniformBuffer || !culler->meshletBuffer || !culler->boundsBuffer ||
+        !culler->vertexBuffer || !culler->triangleBuffer || !culler->drawArgsBuffer || !culler->indexBuffer ||
+        !culler->visibilityBuffer) {
+        free(packedTriangles);
+        releaseMeshletCuller(culler);
+        return false;
+    }
+
+    wgpuQueueWriteBuffer(queue, culler->meshletBuffer, 0, mesh->meshlets, mesh->meshletCount * sizeof(Meshlet));
+    wgpuQueueWriteBuffer(queue, culler->boundsBuffer, 0, mesh->bounds, mesh->meshletCount * sizeof(MeshletBounds));
+    wgpuQueueWriteBuffer(queue, culler->vertexBuffer, 0, mesh->vertices, mesh->vertexCount * sizeof(uint32_t));
+    wgpuQueueWriteBuffer(queue, culler->triangleBuffer, 0, packedTriangles, mesh->triangleCount * sizeof(uint32_t));
+    free(packedTriangles);
+
+    // Everything counts as visible in the first frame; the late phase corrects it
+    uint32_t* visible = malloc(mesh->meshletCount * sizeof *visible);
+    if (!visible) {
+        fprintf(stderr, "createMeshletCuller: out of memory\n");
+        releaseMeshletCuller(culler);
+        return false;
+    }
+    for (size_t i = 0; i < mesh->meshletCount; ++i) visible[i] = 1;
+    wgpuQueueWriteBuffer(queue, culler->visibilityBuffer, 0, visible, mesh->meshletCount * sizeof(uint32_t));
+    free(visible);
+
+    WGPUShaderModule module = createShaderModuleFromParts(device, "Meshlet cull shader", kMeshletCullWGSL,
+                                                          sizeof kMeshletCullWGSL / sizeof kMeshletCullWGSL[0]);
+    if (!module) {
+        releaseMeshletCuller(culler);
+        return false;
+    }
+    culler->pipeline = createComputePipeline(device, "Meshlet cull pipeline", module, "cullEarly");
+    culler->latePipeline = createComputePipeline(device, "Meshlet late cull pipeline", module, "cullLate");
+    wgpuShaderModuleRelease(module);
+    if (!culler->pipeline || !culler->latePipeline) {
+        releaseMeshletCuller(culler);
+        return false;
+    }
+
+    WGPUBindGroupEntry entries[kCullBufferCount] = {0};
+    fillBufferEntries(culler, entries);
+
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(culler->pipeline, 0);
+    WGPUBindGroupDescriptor bindGroupDesc = {0};
+    bindGroupDesc.label = "Meshlet cull bind group";
+    bindGroupDesc.layout = layout;
+    bindGroupDesc.entryCount = kCullBufferCount;
+    bindGroupDesc.entries = entries;
+    culler->bindGroup = wgpuDeviceCreateBindGroup(device, &bindGroupDesc);
+    wgpuBindGroupLayoutRelease(layout);
+
+    return culler->bindGroup != NULL;
+}
+
+void meshletCullerUpdate(MeshletCuller* culler,
+                         WGPUQueue queue,
+                         Mat4 model,
+                         Mat4 viewProj,
+                         Vec3 cameraPosition)
+{
+    MeshletCullUniforms uniforms = {0};
+    memcpy(uniforms.model, model.m, sizeof uniforms.model);
+    memcpy(uniforms.viewProj, viewProj.m, sizeof uniforms.viewProj);
+    // The shader tests world-space spheres, so the planes are world-space too
+    mat4FrustumPlanes(viewProj, uniforms.planes);
+    uniforms.cameraPosition[0] = cameraPosition.x;
+    uniforms.cameraPosition[1] = cameraPosition.y;
+    uniforms.cameraPosition[2] = cameraPosition.z;
+    uniforms.scale = mat4MaxScale(model);
+    uniforms.objectCenter[0] = culler->objectCenter.x;
+    uniforms.objectCenter[1] = culler->objectCenter.y;
+    uniforms.objectCenter[2] = culler->objectCenter.z;
+    uniforms.objectRadius = culler->objectRadius;
+    uniforms.meshletCount = culler->meshletCount;
+    uniforms.flags = (culler->frustumCulling ? kCullFlagFrustum : 0) |
+                     (culler->coneCulling ? kCullFlagCone : 0) |
+                     (culler->occlusionCulling && culler->lateBindGroup ? kCullFlagOcclusion : 0);
+    uniforms.hizMipCount = culler->hizMipCount;
+    uniforms.hizSize[0] = (float)culler->hizWidth;
+    uniforms.hizSize[1] = (float)culler->hizHeight;
+
+    wgpuQueueWriteBuffer(queue, culler->uniformBuffer, 0, &uniforms, sizeof uniforms);
+}
+
+bool meshletCullerSetHiZ(MeshletCuller* culler, WGPUDevice device, const HiZPyramid* hiz)
+{
+    if (culler->lateBindGroup) {
+        wgpuBindGroupRelease(culler->lateBindGroup);
+        culler->lateBindGroup = NULL;
+    }
+
+    WGPUBindGroupEntry entries[kCullBufferCount + 1] = {0};
+    fillBufferEntries(culler, entries);
+    entries[kCullBufferCount].binding = kCullBufferCount;
+    entries[kCullBufferCount].textureView = hiz->view;
+
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(culler->latePipeline, 0);
+    WGPUBindGroupDescriptor bindGroupDesc = {0};
+    bindGroupDesc.label = "Meshlet late cull bind group";
+    bindGroupDesc.layout = layout;
+    bindGroupDesc.entryCount = kCullBufferCount + 1;
+    bindGroupDesc.entries = entries;
+    culler->lateBindGroup = wgpuDeviceCreateBindGroup(device, &bindGroupDesc);
+    wgpuBindGroupLayoutRelease(layout);
+
+    culler->hizWidth = hiz->width;
+    culler->hizHeight = hiz->height;
+    culler->hizMipCount = hiz->mipCount;
+    culler->occlusionCulling = culler->lateBindGroup != NULL;
+    return culler->lateBindGroup != NULL;
+}
+
+static void dispatchCull(MeshletCuller* culler, WGPUCommandEncoder encoder, const char* label,
+                         WGPUComputePipeline pipeline, WGPUBindGroup bindGroup)
+{
+    WGPUComputePassDescriptor passDesc = {0};
+    passDesc.label = label;
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+
+    // One workgroup per meshlet, folded into 2D past the per-dimension limit
+    const uint32_t maxGroups = 65535;
+    uint32_t groupsX = culler->meshletCount < maxGroups ? culler->meshletCount : maxGroups;
+    uint32_t groupsY = (culler->meshletCount + maxGroups - 1) / maxGroups;
+
+    wgpuComputePassEncoderSetPipeline(pass, pipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, bindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, groupsX, groupsY, 1);
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+}
+
+/**
+ * Record the early culling pass. Both phases' draw args are cleared first
+ * so that an entirely culled mesh ends up with indexCount = instanceCount = 0.
+ */
+void meshletCullerDispatch(MeshletCuller* culler, WGPUCommandEncoder encoder)
+{
+    wgpuCommandEncoderClearBuffer(encoder, culler->drawArgsBuffer, 0, kDrawArgsSize);
+    dispatchCull(culler, encoder, "Meshlet cull pass", culler->pipeline, culler->bindGroup);
+}
+
+/**
+ * Record the late culling pass, after the Hi-Z pyramid was built from the
+ * early phase's depth. Without occlusion culling there is nothing left to
+ * find and the late draw args stay zero.
+ */
+void meshletCullerDispatchLate(MeshletCuller* culler, WGPUCommandEncoder encoder)
+{
+    if (!culler->occlusionCulling || !culler->lateBindGroup) return;
+    dispatchCull(culler, encoder, "Meshlet late cull pass", culler->latePipeline, culler->lateBindGroup);
+}
+
+/**
+ * Issue the single indirect draw for every surviving meshlet. The caller
+ * has already bound its render pipeline and the mesh's vertex buffer; the
+ * compacted indices refer to the original mesh vertices.
+ */
+void meshletCullerDraw(MeshletCuller* culler, WGPURenderPassEncoder pass)
+{
+    wgpuRenderPassEncoderSetIndexBuffer(pass, culler->indexBuffer, WGPUIndexFormat_Uint32,
+                                        0, wgpuBufferGetSize(culler->indexBuffer));
+    wgpuRenderPassEncoderDrawIndexedIndirect(pass, culler->drawArgsBuffer, 0);
+}
+
+/** Same as meshletCullerDraw(), for the meshlets the late phase found. */
+void meshletCullerDrawLate(MeshletCuller* culler, WGPURenderPassEncoder pass)
+{
+    wgpuRenderPassEncoderSetIndexBuffer(pass, culler->indexBuffer, WGPUIndexFormat_Uint32,
+                                        0, wgpuBufferGetSize(culler->indexBuffer));
+    wgpuRenderPassEncoderDrawIndexedIndirect(pass, culler->drawArgsBuffer, kLateDrawOffset);
+}
+
+void releaseMeshletCuller(MeshletCuller* culler)
+{
+    if (culler->bindGroup) wgpuBindGroupRelease(culler->bindGroup);
+    if (culler->lateBindGroup) wgpuBindGroupRelease(culler->lateBindGroup);
+    if (culler->pipeline) wgpuComputePipelineRelease(culler->pipeline);
+    if (culler->latePipeline) wgpuComputePipelineRelease(culler->latePipeline);
+
+    WGPUBuffer buffers[] = {
+        culler->uniformBuffer, culler->meshletBuffer, culler->boundsBuffer,
+        culler->vertexBuffer, culler->triangleBuffer, culler->drawArgsBuffer,
+        culler->indexBuffer, culler->visibilityBuffer
+    };
+    for (size_t i = 0; i < sizeof buffers / sizeof buffers[0]; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    memset(culler, 0, sizeof *culler);
+}
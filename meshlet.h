@@ -0,0 +1,167 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include "hiz.h"
+#include "linalg.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * MESHLETS
+ *
+ * A meshlet is a small cluster of triangles (at most kMeshletMaxVertices
+ * unique vertices and kMeshletMaxTriangles triangles) that can be culled
+ * as a unit. Clusters are built once, at pack/load time, together with a
+ * bounding sphere and a normal cone. At runtime a compute pass rejects
+ * clusters that are outside the frustum or entirely back-facing, and
+ * appends the indices of the survivors into a single indirect draw.
+ */
+
+#define kMeshletMaxVertices  64
+#define kMeshletMaxTriangles 124
+
+/**
+ * One cluster. Offsets index into MeshletMesh.vertices and
+ * MeshletMesh.triangles (in triangles, i.e. 3 local indices each).
+ */
+typedef struct {
+    uint32_t vertexOffset;
+    uint32_t triangleOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+} Meshlet;
+
+/**
+ * Culling data for one cluster, laid out to match the WGSL struct
+ * (vec3f + f32 pairs, 32 bytes).
+ *
+ * - center/radius:     bounding sphere in mesh space
+ * - coneAxis/coneCutoff: the cluster is back-facing from any viewpoint where
+ *                      dot(center - eye, axis) >= cutoff * |center - eye| + radius.
+ *                      A cutoff of 1 means the cone is too wide to cull.
+ */
+typedef struct {
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;
+} MeshletBounds;
+
+typedef struct {
+    Meshlet* meshlets;
+    MeshletBounds* bounds;
+    size_t meshletCount;
+
+    uint32_t* vertices;     // meshlet-local vertex -> mesh vertex index
+    size_t vertexCount;
+
+    uint8_t* triangles;     // 3 meshlet-local indices per triangle
+    size_t triangleCount;
+} MeshletMesh;
+
+/**
+ * Split an indexed triangle list into meshlets and compute their bounds.
+ *
+ * positions points at the first vertex position (3 floats); positionStride
+ * is the distance in bytes between two consecutive positions.
+ *
+ * Returns false on allocation failure or empty input.
+ */
+bool buildMeshlets(MeshletMesh* out,
+                   const uint32_t* indices, size_t indexCount,
+                   const float* positions, size_t vertexCount,
+                   size_t positionStride);
+
+void releaseMeshlets(MeshletMesh* mesh);
+
+/**
+ * GPU MESHLET CULLER
+ *
+ * Owns the GPU copies of a MeshletMesh plus the compacted index buffer and
+ * DrawIndexedIndirect arguments produced by the culling pass.
+ *
+ * Per frame:
+ *      meshletCullerUpdate(&culler, queue, model, viewProj, eye);
+ *      meshletCullerDispatch(&culler, encoder);     // before the render pass
+ *      ... bind pipeline + the mesh's vertex buffer ...
+ *      meshletCullerDraw(&culler, renderPass);
+ *
+ * The model matrix is assumed to have a uniform scale.
+ *
+ * OCCLUSION CULLING
+ *
+ * After meshletCullerSetHiZ(), culling runs in two phases so that nothing
+ * that becomes visible is ever missing for a frame:
+ *  - early: draws the meshlets that were visible last frame (and pass the
+ *    frustum and cone tests), which are very likely the main occluders
+ *  - the Hi-Z pyramid is built from the depth the early draw left
+ *  - late: tests every meshlet against the pyramid (the object's bounding
+ *    sphere first, then the meshlet's), draws the ones that are visible now
+ *    but weren't drawn early, and records visibility for the next frame
+ *
+ *      meshletCullerDispatch(&culler, encoder);
+ *      ... render pass: meshletCullerDraw(&culler, pass) ...
+ *      hizBuild(&hiz, encoder, depthView);
+ *      meshletCullerDispatchLate(&culler, encoder);
+ *      ... render pass, loading color and depth: meshletCullerDrawLate(&culler, pass) ...
+ *
+ * Both phases compact into the same index buffer, the late indices after
+ * the early ones.
+ */
+typedef struct {
+    WGPUComputePipeline pipeline;       // early phase
+    WGPUComputePipeline latePipeline;
+    WGPUBindGroup bindGroup;
+    WGPUBindGroup lateBindGroup;        // with the Hi-Z pyramid
+
+    WGPUBuffer uniformBuffer;
+    WGPUBuffer meshletBuffer;
+    WGPUBuffer boundsBuffer;
+    WGPUBuffer vertexBuffer;
+    WGPUBuffer triangleBuffer;
+    WGPUBuffer drawArgsBuffer;   // DrawIndexedIndirect args (Indirect | Storage)
+    WGPUBuffer indexBuffer;      // compacted indices of visible meshlets
+    WGPUBuffer visibilityBuffer; // per meshlet, visible in the last late phase
+
+    uint32_t meshletCount;
+    Vec3 objectCenter;           // sphere around all meshlets, mesh space
+    float objectRadius;
+    uint32_t hizWidth, hizHeight;
+    uint32_t hizMipCount;
+    bool frustumCulling;
+    bool coneCulling;
+    bool occlusionCulling;       // needs meshletCullerSetHiZ()
+} MeshletCuller;
+
+bool createMeshletCuller(MeshletCuller* culler,
+                         WGPUDevice device,
+                         WGPUQueue queue,
+                         const MeshletMesh* mesh);
+
+void meshletCullerUpdate(MeshletCuller* culler,
+                         WGPUQueue queue,
+                         Mat4 model,
+                         Mat4 viewProj,
+                         Vec3 cameraPosition);
+
+/**
+ * Use a Hi-Z pyramid for occlusion culling and turn it on. Call again
+ * whenever the pyramid is recreated.
+ */
+bool meshletCullerSetHiZ(MeshletCuller* culler, WGPUDevice device, const HiZPyramid* hiz);
+
+void meshletCullerDispatch(MeshletCuller* culler, WGPUCommandEncoder encoder);
+
+void meshletCullerDispatchLate(MeshletCuller* culler, WGPUCommandEncoder encoder);
+
+void meshletCullerDraw(MeshletCuller* culler, WGPURenderPassEncoder pass);
+
+void meshletCullerDrawLate(MeshletCuller* culler, WGPURenderPassEncoder pass);
+
+void releaseMeshletCuller(MeshletCuller* culler);
+
+#endif // MESHLET_H
@@ -0,0 +1,77 @@
+#include "msaa.h"
+
+#include <stdio.h>
+#include <string.h>
+
+uint32_t msaaSampleCount(uint32_t requested)
+{
+    return requested >= 4 ? 4 : 1;
+}
+
+bool msaaColorAttachment(WGPURenderPassColorAttachment* attachment,
+                         PooledTexture** samples,
+                         TexturePool* pool,
+                         uint32_t sampleCount,
+                         WGPUTextureView target,
+                         WGPUTextureFormat format,
+                         uint32_t width,
+                         uint32_t height)
+{
+    memset(attachment, 0, sizeof *attachment);
+    attachment->depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+    *samples = NULL;
+
+    if (sampleCount <= 1) {
+        attachment->view = target;
+        attachment->storeOp = WGPUStoreOp_Store;
+        return true;
+    }
+
+    // Only ever a render attachment: never sampled, copied or stored
+    TexturePoolDesc desc = {0};
+    desc.width = width;
+    desc.height = height;
+    desc.format = format;
+    desc.usage = WGPUTextureUsage_RenderAttachment;
+    desc.sampleCount = sampleCount;
+    *samples = texturePoolAcquire(pool, &desc);
+    if (!*samples) {
+        fprintf(stderr, "Could not acquire a %ux multisampled color attachment\n", sampleCount);
+        return false;
+    }
+
+    attachment->view = (*samples)->view;
+    attachment->resolveTarget = target;
+    attachment->storeOp = WGPUStoreOp_Discard;
+    return true;
+}
+
+bool msaaDepthAttachment(WGPURenderPassDepthStencilAttachment* attachment,
+                         PooledTexture** samples,
+                         TexturePool* pool,
+                         uint32_t sampleCount,
+                         WGPUTextureFormat format,
+                         uint32_t width,
+                         uint32_t height,
+                         float clearDepth)
+{
+    memset(attachment, 0, sizeof *attachment);
+
+    TexturePoolDesc desc = {0};
+    desc.width = width;
+    desc.height = height;
+    desc.format = format;
+    desc.usage = WGPUTextureUsage_RenderAttachment;
+    desc.sampleCount = sampleCount;
+    *samples = texturePoolAcquire(pool, &desc);
+    if (!*samples) {
+        fprintf(stderr, "Could not acquire a %ux multisampled depth attachment\n", sampleCount);
+        return false;
+    }
+
+    attachment->view = (*samples)->view;
+    attachment->depthLoadOp = WGPULoadOp_Clear;
+    attachment->depthStoreOp = WGPUStoreOp_Discard;
+    attachment->depthClearValue = clearDepth;
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef MSAA_H
+#define MSAA_H
+
+#include "texture-pool.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * MULTISAMPLING
+ *
+ * Multisampled passes render into transient attachments from the texture
+ * pool and resolve, at the end of the pass, straight into their
+ * single-sampled target: the surface texture or an offscreen one. Nothing
+ * reads the samples after the resolve, so they are discarded (storeOp
+ * Discard); on tile-based GPUs they then never leave tile memory and the
+ * resolved pixels are the only thing written out.
+ *
+ * WebGPU guarantees 1 and 4 samples for every renderable format we use
+ * and exposes no query for other counts, so the sample count is one of
+ * those two (Context.sampleCount). Pipelines drawn in a multisampled pass
+ * must be created with the same count.
+ *
+ * Depth can't be resolved: a multisampled depth attachment is only good
+ * for testing within its pass.
+ */
+
+/** The supported count closest to `requested`: 1 or 4. */
+uint32_t msaaSampleCount(uint32_t requested);
+
+/**
+ * Point `attachment` at `target` through a transient multisampled texture
+ * of `sampleCount` samples, resolved into `target` and discarded. With a
+ * sampleCount of 1 it renders to `target` directly. The caller sets the
+ * load op and clear value.
+ *
+ * `*samples` receives the pooled texture to give back after the pass, NULL
+ * when none is needed. Returns false if it couldn't be acquired.
+ */
+bool msaaColorAttachment(WGPURenderPassColorAttachment* attachment,
+                         PooledTexture** samples,
+                         TexturePool* pool,
+                         uint32_t sampleCount,
+                         WGPUTextureView target,
+                         WGPUTextureFormat format,
+                         uint32_t width,
+                         uint32_t height);
+
+/**
+ * A transient depth attachment of `sampleCount` samples, cleared to
+ * `clearDepth` and discarded after the pass. `format` must be depth-only
+ * (Depth16Unorm, Depth24Plus, Depth32Float). Same contract for `*samples`.
+ */
+bool msaaDepthAttachment(WGPURenderPassDepthStencilAttachment* attachment,
+                         PooledTexture** samples,
+                         TexturePool* pool,
+                         uint32_t sampleCount,
+                         WGPUTextureFormat format,
+                         uint32_t width,
+                         uint32_t height,
+                         float clearDepth);
+
+#endif // MSAA_H
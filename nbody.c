@@ -0,0 +1,901 @@
+#include "nbody.h"
+#include "webgpu-utils.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Uniform block of every n-body shader. Must match NBodyUniforms in kNBodyCommonWGSL (176 bytes). */
+typedef struct {
+    float viewProj[16];
+    float view[16];
+    float gravity;
+    float softening;
+    float timeDelta;
+    float theta;
+    float rootHalfExtent;
+    uint32_t bodyCount;
+    uint32_t depth;
+    uint32_t seed;
+    float discRadius;
+    float totalMass;
+    float pointSize;
+    uint32_t _pad0;
+} NBodyUniforms;
+
+/** Must match Body in kNBodyCommonWGSL. */
+typedef struct {
+    float position[3];
+    float mass;
+    float velocity[3];
+    float _pad0;
+} GpuBody;
+
+#define kNBodyGroupSize 256
+#define kLevelStride kUniformOffsetAlignment
+
+#define kNBodyCommonWGSL \
+"struct NBodyUniforms {\n" \
+"    viewProj: mat4x4f,\n" \
+"    view: mat4x4f,\n" \
+"    gravity: f32,\n" \
+"    softening: f32,\n" \
+"    timeDelta: f32,\n" \
+"    theta: f32,\n" \
+"    rootHalfExtent: f32,\n" \
+"    bodyCount: u32,\n" \
+"    depth: u32,\n" \
+"    seed: u32,\n" \
+"    discRadius: f32,\n" \
+"    totalMass: f32,\n" \
+"    pointSize: f32,\n" \
+"    _pad0: u32,\n" \
+"}\n" \
+"struct Body {\n" \
+"    position: vec3f,\n" \
+"    mass: f32,\n" \
+"    velocity: vec3f,\n" \
+"}\n"
+
+static const char* const kNBodyWGSL[] = {
+kNBodyCommonWGSL
+"struct Level {\n"
+"    index: u32,\n"
+"}\n"
+"\n"
+"@group(0) @binding(0) var<uniform> settings: NBodyUniforms;\n"
+"@group(0) @binding(1) var<storage, read_write> bodiesIn: array<Body>;\n"
+"@group(0) @binding(2) var<storage, read_write> bodiesOut: array<Body>;\n"
+"@group(0) @binding(3) var<storage, read_write> keys: array<u32>;\n"
+"@group(0) @binding(4) var<storage, read_write> indices: array<u32>;\n"
+"@group(0) @binding(5) var<storage, read_write> sortedBodies: array<Body>;\n"
+"@group(0) @binding(6) var<storage, read_write> leaves: array<vec2u>;\n"
+"@group(0) @binding(7) var<storage, read_write> nodes: array<vec4f>;\n"
+"@group(0) @binding(8) var<storage, read_write> interactionCount: array<atomic<u32>, 2>;\n"
+"@group(0) @binding(9) var<uniform> level: Level;\n"
+"\n"
+"const kTileSize = 256u;\n"
+"const kStackSize = 64u;\n"
+"\n"
+"var<workgroup> tile: array<vec4f, 256>;\n"
+"var<workgroup> groupInteractions: atomic<u32>;\n"
+"\n"
+kRandomWGSL
+"\n"
+"// Acceleration towards a point mass (xyz, w = mass), without G\n"
+"fn pull(position: vec3f, massPoint: vec4f) -> vec3f {\n"
+"    let offset = massPoint.xyz - position;\n"
+"    let inverse = inverseSqrt(dot(offset, offset) + settings.softening * settings.softening);\n"
+"    return offset * (massPoint.w * inverse * inverse * inverse);\n"
+"}\n"
+"\n"
+"fn integrate(body: ptr<function, Body>, acceleration: vec3f) {\n"
+"    (*body).velocity += acceleration * settings.gravity * settings.timeDelta;\n"
+"    (*body).position += (*body).velocity * settings.timeDelta;\n"
+"}\n"
+"\n"
+"// A uniform disc of circular orbits around its own center of mass\n"
+"@compute @workgroup_size(256)\n"
+"fn spawn(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (id.x >= settings.bodyCount) {\n"
+"        return;\n"
+"    }\n"
+"    var seed = pcg(id.x ^ pcg(settings.seed));\n"
+"    let r = settings.discRadius * sqrt(random(&seed));\n"
+"    let phi = random(&seed) * 6.28318531;\n"
+"    let height = (random(&seed) - 0.5) * settings.discRadius * 0.02;\n"
+"    let enclosed = settings.totalMass * (r * r) / (settings.discRadius * settings.discRadius);\n"
+"    let distance2 = r * r + settings.softening * settings.softening;\n"
+"    let speed = sqrt(settings.gravity * enclosed * r * r / (distance2 * sqrt(distance2)));\n"
+"\n"
+"    var body: Body;\n"
+"    body.position = vec3f(r * cos(phi), height, r * sin(phi));\n"
+"    body.mass = settings.totalMass / f32(settings.bodyCount);\n"
+"    body.velocity = vec3f(-sin(phi), 0.0, cos(phi)) * speed;\n"
+"    bodiesIn[id.x] = body;\n"
+"}\n"
+"\n",
+"@compute @workgroup_size(256)\n"
+"fn allPairs(@builtin(global_invocation_id) id: vec3u, @builtin(local_invocation_index) lane: u32) {\n"
+"    let valid = id.x < settings.bodyCount;\n"
+"    var body: Body;\n"
+"    if (valid) {\n"
+"        body = bodiesIn[id.x];\n"
+"    }\n"
+"    var acceleration = vec3f(0.0);\n"
+"    for (var start = 0u; start < settings.bodyCount; start += kTileSize) {\n"
+"        // Past the last body, massless points pull nothing\n"
+"        var massPoint = vec4f(0.0);\n"
+"        if (start + lane < settings.bodyCount) {\n"
+"            let other = bodiesIn[start + lane];\n"
+"            massPoint = vec4f(other.position, other.mass);\n"
+"        }\n"
+"        tile[lane] = massPoint;\n"
+"        workgroupBarrier();\n"
+"        // The body itself is in some tile: at zero distance it pulls nothing either\n"
+"        for (var k = 0u; k < kTileSize; k++) {\n"
+"            acceleration += pull(body.position, tile[k]);\n"
+"        }\n"
+"        workgroupBarrier();\n"
+"    }\n"
+"    if (valid) {\n"
+"        integrate(&body, acceleration);\n"
+"        bodiesOut[id.x] = body;\n"
+"    }\n"
+"}\n"
+"\n"
+"// Every third bit, for 10-bit coordinates\n"
+"fn spreadBits(v: u32) -> u32 {\n"
+"    var x = v & 0x3ffu;\n"
+"    x = (x | (x << 16u)) & 0x030000ffu;\n"
+"    x = (x | (x << 8u)) & 0x0300f00fu;\n"
+"    x = (x | (x << 4u)) & 0x030c30c3u;\n"
+"    x = (x | (x << 2u)) & 0x09249249u;\n"
+"    return x;\n"
+"}\n"
+"\n"
+"// Morton code of the leaf a position is in; outside the root box, the nearest one.\n"
+"// The parent of node m is node m >> 3 one level up.\n"
+"fn leafOf(position: vec3f) -> u32 {\n"
+"    let resolution = 1u << settings.depth;\n"
+"    let cell = (position / (2.0 * settings.rootHalfExtent) + 0.5) * f32(resolution);\n"
+"    let c = vec3u(clamp(cell, vec3f(0.0), vec3f(f32(resolution) - 0.5)));\n"
+"    return spreadBits(c.x) | (spreadBits(c.y) << 1u) | (spreadBits(c.z) << 2u);\n"
+"}\n"
+"\n"
+"// Nodes are stored root first, then each level in Morton order\n"
+"fn levelStart(depth: u32) -> u32 {\n"
+"    return ((1u << (3u * depth)) - 1u) / 7u;\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(256)\n"
+"fn hashBodies(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (id.x >= settings.bodyCount) {\n"
+"        return;\n"
+"    }\n"
+"    keys[id.x] = leafOf(bodiesIn[id.x].position);\n"
+"    indices[id.x] = id.x;\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(256)\n"
+"fn clearLeaves(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (id.x < (1u << (3u * settings.depth))) {\n"
+"        leaves[id.x] = vec2u(0u);\n"
+"    }\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(256)\n"
+"fn findLeaves(@builtin(global_invocation_id) id: vec3u) {\n"
+"    let i = id.x;\n"
+"    if (i >= settings.bodyCount) {\n"
+"        return;\n"
+"    }\n"
+"    let key = keys[i];\n"
+"    if (i == 0u || keys[i - 1u] != key) {\n"
+"        leaves[key].x = i;\n"
+"    }\n"
+"    if (i == settings.bodyCount - 1u || keys[i + 1u] != key) {\n"
+"        leaves[key].y = i + 1u;\n"
+"    }\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(256)\n"
+"fn gather(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (id.x < settings.bodyCount) {\n"
+"        sortedBodies[id.x] = bodiesIn[indices[id.x]];\n"
+"    }\n"
+"}\n"
+"\n"
+"// Mass-weighted position and mass, turned into a node\n"
+"fn toNode(weighted: vec4f) -> vec4f {\n"
+"    if (weighted.w <= 0.0) {\n"
+"        return vec4f(0.0);\n"
+"    }\n"
+"    return vec4f(weighted.xyz / weighted.w, weighted.w);\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(256)\n"
+"fn leafMass(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (id.x >= (1u << (3u * settings.depth))) {\n"
+"        return;\n"
+"    }\n"
+"    let range = leaves[id.x];\n"
+"    var weighted = vec4f(0.0);\n"
+"    for (var j = range.x; j < range.y; j++) {\n"
+"        let body = sortedBodies[j];\n"
+"        weighted += vec4f(body.position * body.mass, body.mass);\n"
+"    }\n"
+"    nodes[levelStart(settings.depth) + id.x] = toNode(weighted);\n"
+"}\n"
+"\n",
+"// Nodes of `level.index` from their eight children\n"
+"@compute @workgroup_size(256)\n"
+"fn reduceLevel(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (id.x >= (1u << (3u * level.index))) {\n"
+"        return;\n"
+"    }\n"
+"    let children = levelStart(level.index + 1u) + id.x * 8u;\n"
+"    var weighted = vec4f(0.0);\n"
+"    for (var k = 0u; k < 8u; k++) {\n"
+"        let child = nodes[children + k];\n"
+"        weighted += vec4f(child.xyz * child.w, child.w);\n"
+"    }\n"
+"    nodes[levelStart(level.index) + id.x] = toNode(weighted);\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(256)\n"
+"fn force(@builtin(global_invocation_id) id: vec3u, @builtin(local_invocation_index) lane: u32) {\n"
+"    if (lane == 0u) {\n"
+"        atomicStore(&groupInteractions, 0u);\n"
+"    }\n"
+"    workgroupBarrier();\n"
+"\n"
+"    let i = id.x;\n"
+"    if (i < settings.bodyCount) {\n"
+"        var body = sortedBodies[i];\n"
+"        let theta2 = settings.theta * settings.theta;\n"
+"        var acceleration = vec3f(0.0);\n"
+"        var interactions = 0u;\n"
+"\n"
+"        // Node entries: level in the top 8 bits, Morton code in the rest. Each\n"
+"        // level pops one entry and pushes at most eight: 7 * depth + 1 at most.\n"
+"        var stack: array<u32, kStackSize>;\n"
+"        stack[0] = 0u;\n"
+"        var top = 1u;\n"
+"        while (top > 0u) {\n"
+"            top--;\n"
+"            let entry = stack[top];\n"
+"            let depth = entry >> 24u;\n"
+"            let code = entry & 0xffffffu;\n"
+"            let node = nodes[levelStart(depth) + code];\n"
+"            if (node.w <= 0.0) {\n"
+"                continue;\n"
+"            }\n"
+"            let offset = node.xyz - body.position;\n"
+"            let side = 2.0 * settings.rootHalfExtent / f32(1u << depth);\n"
+"            if (side * side < theta2 * dot(offset, offset)) {\n"
+"                acceleration += pull(body.position, node);\n"
+"                interactions++;\n"
+"            } else if (depth == settings.depth) {\n"
+"                let range = leaves[code];\n"
+"                for (var j = range.x; j < range.y; j++) {\n"
+"                    if (j != i) {\n"
+"                        let other = sortedBodies[j];\n"
+"                        acceleration += pull(body.position, vec4f(other.position, other.mass));\n"
+"                    }\n"
+"                }\n"
+"                interactions += range.y - range.x;\n"
+"            } else {\n"
+"                for (var k = 0u; k < 8u; k++) {\n"
+"                    stack[top] = ((depth + 1u) << 24u) | (code * 8u + k);\n"
+"                    top++;\n"
+"                }\n"
+"            }\n"
+"        }\n"
+"\n"
+"        integrate(&body, acceleration);\n"
+"        bodiesOut[indices[i]] = body;\n"
+"        atomicAdd(&groupInteractions, interactions);\n"
+"    }\n"
+"\n"
+"    // One 64-bit add per workgroup: the carry goes to the high word\n"
+"    workgroupBarrier();\n"
+"    if (lane == 0u) {\n"
+"        let count = atomicLoad(&groupInteractions);\n"
+"        let low = atomicAdd(&interactionCount[0], count);\n"
+"        if (low > 0xffffffffu - count) {\n"
+"            atomicAdd(&interactionCount[1], 1u);\n"
+"        }\n"
+"    }\n"
+"}\n",
+};
+
+static const char* kNBodyRenderWGSL = kNBodyCommonWGSL
+"@group(0) @binding(0) var<uniform> settings: NBodyUniforms;\n"
+"@group(0) @binding(1) var<storage, read> bodies: array<Body>;\n"
+"\n"
+"struct VertexOutput {\n"
+"    @builtin(position) position: vec4f,\n"
+"    @location(0) color: vec3f,\n"
+"    @location(1) corner: vec2f,\n"
+"}\n"
+"\n"
+"@vertex\n"
+"fn vs_main(@builtin(vertex_index) vertex: u32, @builtin(instance_index) instance: u32) -> VertexOutput {\n"
+"    var corners = array<vec2f, 6>(vec2f(-1.0, -1.0), vec2f(1.0, -1.0), vec2f(1.0, 1.0),\n"
+"                                  vec2f(-1.0, -1.0), vec2f(1.0, 1.0), vec2f(-1.0, 1.0));\n"
+"    let body = bodies[instance];\n"
+"    let corner = corners[vertex];\n"
+"\n"
+"    // Camera-facing: the camera's right and up axes are the view matrix's first two rows\n"
+"    let right = vec3f(settings.view[0].x, settings.view[1].x, settings.view[2].x);\n"
+"    let up = vec3f(settings.view[0].y, settings.view[1].y, settings.view[2].y);\n"
+"    let world = body.position + (right * corner.x + up * corner.y) * (settings.pointSize * 0.5);\n"
+"\n"
+"    // Blue when slow, white when fast\n"
+"    let speed = length(body.velocity);\n"
+"    let heat = saturate(speed * speed / (settings.gravity * settings.totalMass / settings.discRadius));\n"
+"\n"
+"    var out: VertexOutput;\n"
+"    out.position = settings.viewProj * vec4f(world, 1.0);\n"
+"    out.color = mix(vec3f(0.1, 0.2, 0.6), vec3f(1.0, 0.9, 0.8), heat) * 0.2;\n"
+"    out.corner = corner;\n"
+"    return out;\n"
+"}\n"
+"\n"
+"@fragment\n"
+"fn fs_main(in: VertexOutput) -> @location(0) vec4f {\n"
+"    let falloff = saturate(1.0 - dot(in.corner, in.corner));\n"
+"    return vec4f(in.color * falloff * falloff, 0.0);\n"
+"}\n";
+
+NBodySettings defaultNBodySettings(void)
+{
+    NBodySettings settings;
+    memset(&settings, 0, sizeof settings);
+    settings.gravity = 1.0f;
+    settings.softening = 0.5f;
+    settings.theta = 0.5f;
+    settings.timeDelta = 1.0f / 60.0f;
+    settings.discRadius = 40.0f;
+    settings.totalMass = 20000.0f;
+    settings.rootHalfExtent = 50.0f;
+    settings.pointSize = 0.4f;
+    return settings;
+}
+
+const char* nbodyMethodName(NBodyMethod method)
+{
+    return method == NBodyMethod_BarnesHut ? "barnes-hut" : "all-pairs";
+}
+
+static uint32_t levelNodeCount(uint32_t level)
+{
+    return 1u << (3 * level);
+}
+
+/** Nodes of every level down to `depth`: must match levelStart() in kNBodyWGSL. */
+static uint32_t treeNodeCount(uint32_t depth)
+{
+    return (levelNodeCount(depth + 1) - 1) / 7;
+}
+
+/**
+ * Bind group entry `binding` of kNBodyWGSL. `current` is the body buffer
+ * read, the other one written; `level` picks the block of levelBuffer.
+ */
+static void fillNBodyEntry(const NBody* nbody, uint32_t binding, uint32_t current, uint32_t level,
+                           WGPUBindGroupEntry* entry)
+{
+    memset(entry, 0, sizeof *entry);
+    entry->binding = binding;
+    const uint64_t bodiesSize = (uint64_t)nbody->bodyCount * sizeof(GpuBody);
+    switch (binding) {
+    case 0:
+        entry->buffer = nbody->uniformBuffer;
+        entry->size = sizeof(NBodyUniforms);
+        break;
+    case 1:
+    case 2:
+        entry->buffer = nbody->bodyBuffers[binding == 1 ? current : current ^ 1];
+        entry->size = bodiesSize;
+        break;
+    case 3:
+        entry->buffer = nbody->keyBuffer;
+        entry->size = (uint64_t)nbody->sort.capacity * sizeof(uint32_t);
+        break;
+    case 4:
+        entry->buffer = nbody->indexBuffer;
+        entry->size = (uint64_t)nbody->sort.capacity * sizeof(uint32_t);
+        break;
+    case 5:
+        entry->buffer = nbody->sortedBodyBuffer;
+        entry->size = bodiesSize;
+        break;
+    case 6:
+        entry->buffer = nbody->leafBuffer;
+        entry->size = (uint64_t)levelNodeCount(nbody->depth) * 2 * sizeof(uint32_t);
+        break;
+    case 7:
+        entry->buffer = nbody->nodeBuffer;
+        entry->size = (uint64_t)treeNodeCount(nbody->depth) * 4 * sizeof(float);
+        break;
+    case 8:
+        entry->buffer = nbody->statsBuffer;
+        entry->size = 2 * sizeof(uint32_t);
+        break;
+    case 9:
+        entry->buffer = nbody->levelBuffer;
+        entry->offset = (uint64_t)level * kLevelStride;
+        entry->size = sizeof(uint32_t);
+        break;
+    }
+}
+
+/** What fillNBodyEntry() needs besides the binding. */
+typedef struct {
+    const NBody* nbody;
+    uint32_t current;
+    uint32_t level;
+} NBodyBindings;
+
+static void fillKernelEntry(void* userData, uint32_t binding, WGPUBindGroupEntry* entry)
+{
+    const NBodyBindings* kernel = userData;
+    fillNBodyEntry(kernel->nbody, binding, kernel->current, kernel->level, entry);
+}
+
+static WGPUBindGroup createNBodyBindGroup(const NBody* nbody, WGPUComputePipeline pipeline, const char* label,
+                                          const uint32_t* bindings, uint32_t bindingCount,
+                                          uint32_t current, uint32_t level)
+{
+    NBodyBindings kernel = { nbody, current, level };
+    return createAutoLayoutBindGroup(nbody->device, pipeline, label, bindings, bindingCount, fillKernelEntry,
+                                     &kernel);
+}
+
+static const uint32_t kSpawnBindings[] = { 0, 1 };
+static const uint32_t kAllPairsBindings[] = { 0, 1, 2 };
+static const uint32_t kHashBindings[] = { 0, 1, 3, 4 };
+static const uint32_t kClearLeavesBindings[] = { 0, 6 };
+static const uint32_t kFindLeavesBindings[] = { 0, 3, 6 };
+static const uint32_t kGatherBindings[] = { 0, 1, 4, 5 };
+static const uint32_t kLeafMassBindings[] = { 0, 5, 6, 7 };
+static const uint32_t kReduceBindings[] = { 7, 9 };
+static const uint32_t kForceBindings[] = { 0, 2, 4, 5, 6, 7, 8 };
+
+static bool createKernels(NBody* nbody)
+{
+    WGPUShaderModule module = createShaderModuleFromParts(nbody->device, "N-body shader", kNBodyWGSL,
+                                                          sizeof kNBodyWGSL / sizeof kNBodyWGSL[0]);
+    if (!module) return false;
+    WGPUDevice device = nbody->device;
+    bool barnesHut = nbody->method == NBodyMethod_BarnesHut;
+    nbody->spawnPipeline = createComputePipeline(device, "N-body spawn pipeline", module, "spawn");
+    if (barnesHut) {
+        nbody->hashPipeline = createComputePipeline(device, "N-body hash pipeline", module, "hashBodies");
+        nbody->clearLeavesPipeline = createComputePipeline(device, "N-body clear leaves pipeline", module,
+                                                           "clearLeaves");
+        nbody->findLeavesPipeline = createComputePipeline(device, "N-body find leaves pipeline", module,
+                                                          "findLeaves");
+        nbody->gatherPipeline = createComputePipeline(device, "N-body gather pipeline", module, "gather");
+        nbody->leafMassPipeline = createComputePipeline(device, "N-body leaf mass pipeline", module, "leafMass");
+        nbody->reducePipeline = createComputePipeline(device, "N-body reduce pipeline", module, "reduceLevel");
+        nbody->forcePipeline = createComputePipeline(device, "N-body force pipeline", module, "force");
+    } else {
+        nbody->allPairsPipeline = createComputePipeline(device, "N-body all-pairs pipeline", module, "allPairs");
+    }
+    wgpuShaderModuleRelease(module);
+    if (!nbody->spawnPipeline) return false;
+    if (barnesHut && (!nbody->hashPipeline || !nbody->clearLeavesPipeline || !nbody->findLeavesPipeline ||
+                      !nbody->gatherPipeline || !nbody->leafMassPipeline || !nbody->reducePipeline ||
+                      !nbody->forcePipeline)) {
+        return false;
+    }
+    if (!barnesHut && !nbody->allPairsPipeline) return false;
+
+    for (uint32_t current = 0; current < 2; ++current) {
+        nbody->spawnBindGroups[current] =
+            createNBodyBindGroup(nbody, nbody->spawnPipeline, "N-body spawn bind group",
+                                 kSpawnBindings, kBindingCount(kSpawnBindings), current, 0);
+        if (!nbody->spawnBindGroups[current]) return false;
+        if (!barnesHut) {
+            nbody->allPairsBindGroups[current] =
+                createNBodyBindGroup(nbody, nbody->allPairsPipeline, "N-body all-pairs bind group",
+                                     kAllPairsBindings, kBindingCount(kAllPairsBindings), current, 0);
+            if (!nbody->allPairsBindGroups[current]) return false;
+            continue;
+        }
+        nbody->hashBindGroups[current] =
+            createNBodyBindGroup(nbody, nbody->hashPipeline, "N-body hash bind group",
+                                 kHashBindings, kBindingCount(kHashBindings), current, 0);
+        nbody->gatherBindGroups[current] =
+            createNBodyBindGroup(nbody, nbody->gatherPipeline, "N-body gather bind group",
+                                 kGatherBindings, kBindingCount(kGatherBindings), current, 0);
+        nbody->forceBindGroups[current] =
+            createNBodyBindGroup(nbody, nbody->forcePipeline, "N-body force bind group",
+                                 kForceBindings, kBindingCount(kForceBindings), current, 0);
+        if (!nbody->hashBindGroups[current] || !nbody->gatherBindGroups[current] ||
+            !nbody->forceBindGroups[current]) {
+            return false;
+        }
+    }
+    if (!barnesHut) return true;
+
+    nbody->clearLeavesBindGroup = createNBodyBindGroup(nbody, nbody->clearLeavesPipeline,
+                                                       "N-body clear leaves bind group", kClearLeavesBindings,
+                                                       kBindingCount(kClearLeavesBindings), 0, 0);
+    nbody->findLeavesBindGroup = createNBodyBindGroup(nbody, nbody->findLeavesPipeline,
+                                                      "N-body find leaves bind group", kFindLeavesBindings,
+                                                      kBindingCount(kFindLeavesBindings), 0, 0);
+    nbody->leafMassBindGroup = createNBodyBindGroup(nbody, nbody->leafMassPipeline, "N-body leaf mass bind group",
+                                                    kLeafMassBindings, kBindingCount(kLeafMassBindings), 0, 0);
+    if (!nbody->clearLeavesBindGroup || !nbody->findLeavesBindGroup || !nbody->leafMassBindGroup) return false;
+    for (uint32_t level = 0; level < nbody->depth; ++level) {
+        nbody->reduceBindGroups[level] = createNBodyBindGroup(nbody, nbody->reducePipeline,
+                                                              "N-body reduce bind group", kReduceBindings,
+                                                              kBindingCount(kReduceBindings), 0, level);
+        if (!nbody->reduceBindGroups[level]) return false;
+    }
+    return true;
+}
+
+static bool createRenderPipeline(NBody* nbody,
+                                 WGPUTextureFormat colorFormat,
+                                 WGPUTextureFormat depthFormat,
+                                 uint32_t sampleCount)
+{
+    WGPUShaderModule module = createShaderModule(nbody->device, "N-body render shader", kNBodyRenderWGSL);
+    if (!module) return false;
+
+    // Glow: added on top, keeping the destination alpha
+    WGPUBlendState blend = {0};
+    blend.color.operation = WGPUBlendOperation_Add;
+    blend.color.srcFactor = WGPUBlendFactor_One;
+    blend.color.dstFactor = WGPUBlendFactor_One;
+    blend.alpha.operation = WGPUBlendOperation_Add;
+    blend.alpha.srcFactor = WGPUBlendFactor_Zero;
+    blend.alpha.dstFactor = WGPUBlendFactor_One;
+
+    WGPUColorTargetState colorTarget = {0};
+    colorTarget.format = colorFormat;
+    colorTarget.blend = &blend;
+    colorTarget.writeMask = WGPUColorWriteMask_All;
+
+    WGPUFragmentState fragment = {0};
+    fragment.module = module;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &colorTarget;
+
+    // Tested against the scene, never written: additive points don't occlude each other
+    WGPUDepthStencilState depthStencil = {0};
+    depthStencil.format = depthFormat;
+    depthStencil.depthWriteEnabled = false;
+    depthStencil.depthCompare = WGPUCompareFunction_LessEqual;
+    depthStencil.stencilFront.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilBack.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilReadMask = 0;
+    depthStencil.stencilWriteMask = 0;
+
+    WGPURenderPipelineDescriptor desc = {0};
+    desc.label = "N-body render pipeline";
+    desc.layout = NULL; // auto layout
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
+    desc.primitive.frontFace = WGPUFrontFace_CCW;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.depthStencil = depthFormat != WGPUTextureFormat_Undefined ? &depthStencil : NULL;
+    desc.multisample.count = sampleCount > 1 ? sampleCount : 1;
+    desc.multisample.mask = ~0u;
+    desc.multisample.alphaToCoverageEnabled = false;
+    desc.fragment = &fragment;
+
+    nbody->renderPipeline = wgpuDeviceCreateRenderPipeline(nbody->device, &desc);
+    wgpuShaderModuleRelease(module);
+    if (!nbody->renderPipeline) {
+        fprintf(stderr, "Failed to create %s\n", desc.label);
+        return false;
+    }
+
+    WGPUBindGroupLayout layout = wgpuRenderPipelineGetBindGroupLayout(nbody->renderPipeline, 0);
+    for (uint32_t current = 0; current < 2; ++current) {
+        WGPUBindGroupEntry entries[2];
+        fillNBodyEntry(nbody, 0, current, 0, &entries[0]);
+        fillNBodyEntry(nbody, 1, current, 0, &entries[1]);
+
+        WGPUBindGroupDescriptor bindGroupDesc = {0};
+        bindGroupDesc.label = "N-body render bind group";
+        bindGroupDesc.layout = layout;
+        bindGroupDesc.entryCount = 2;
+        bindGroupDesc.entries = entries;
+        nbody->renderBindGroups[current] = wgpuDeviceCreateBindGroup(nbody->device, &bindGroupDesc);
+    }
+    wgpuBindGroupLayoutRelease(layout);
+    return nbody->renderBindGroups[0] && nbody->renderBindGroups[1];
+}
+
+/** Octree buffers, the level blocks and the sort of the Barnes-Hut method. */
+static bool createTree(NBody* nbody)
+{
+    WGPUDevice device = nbody->device;
+    if (!createGpuSort(&nbody->sort, device, nbody->queue, nbody->bodyCount)) return false;
+
+    const WGPUBufferUsageFlags storage = WGPUBufferUsage_Storage;
+    const uint64_t listSize = (uint64_t)nbody->sort.capacity * sizeof(uint32_t);
+    nbody->sortedBodyBuffer = createBuffer(device, "N-body sorted bodies",
+                                           (uint64_t)nbody->bodyCount * sizeof(GpuBody), storage);
+    nbody->keyBuffer = createBuffer(device, "N-body leaf keys", listSize, storage);
+    nbody->indexBuffer = createBuffer(device, "N-body body indices", listSize, storage);
+    nbody->leafBuffer = createBuffer(device, "N-body leaf ranges",
+                                     (uint64_t)levelNodeCount(nbody->depth) * 2 * sizeof(uint32_t), storage);
+    nbody->nodeBuffer = createBuffer(device, "N-body nodes",
+                                     (uint64_t)treeNodeCount(nbody->depth) * 4 * sizeof(float), storage);
+    nbody->countBuffer = createBuffer(device, "N-body count", sizeof(uint32_t), storage | WGPUBufferUsage_CopyDst);
+    nbody->levelBuffer = createBuffer(device, "N-body levels", (uint64_t)kNBodyMaxDepth * kLevelStride,
+                                      WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    if (!nbody->sortedBodyBuffer || !nbody->keyBuffer || !nbody->indexBuffer || !nbody->leafBuffer ||
+        !nbody->nodeBuffer || !nbody->countBuffer || !nbody->levelBuffer) {
+        return false;
+    }
+
+    uint8_t levels[kNBodyMaxDepth * kLevelStride] = {0};
+    for (uint32_t level = 0; level < kNBodyMaxDepth; ++level) {
+        memcpy(levels + level * kLevelStride, &level, sizeof level);
+    }
+    wgpuQueueWriteBuffer(nbody->queue, nbody->levelBuffer, 0, levels, sizeof levels);
+    wgpuQueueWriteBuffer(nbody->queue, nbody->countBuffer, 0, &nbody->bodyCount, sizeof nbody->bodyCount);
+
+    return createGpuSortList(&nbody->sort, &nbody->sortList, nbody->keyBuffer, nbody->indexBuffer,
+                             nbody->countBuffer, 0);
+}
+
+bool createNBody(NBody* nbody,
+                 WGPUDevice device,
+                 WGPUQueue queue,
+                 NBodyMethod method,
+                 uint32_t bodyCount,
+                 const NBodySettings* settings,
+                 WGPUTextureFormat colorFormat,
+                 WGPUTextureFormat depthFormat,
+                 uint32_t sampleCount)
+{
+    memset(nbody, 0, sizeof *nbody);
+    if (bodyCount == 0 || bodyCount > kNBodyMaxBodies) {
+        fprintf(stderr, "createNBody: body count %u out of range (1..%u)\n", bodyCount, kNBodyMaxBodies);
+        return false;
+    }
+    nbody->device = device;
+    nbody->queue = queue;
+    nbody->method = method;
+    nbody->bodyCount = bodyCount;
+    nbody->pendingSpawn = true;
+    nbody->view = mat4Identity();
+    nbody->projection = mat4Identity();
+    nbodySetSettings(nbody, settings);
+
+    // The disc is thin, so about 4^depth leaves are occupied: some 16 bodies each
+    nbody->depth = 2;
+    while (nbody->depth < kNBodyMaxDepth && (16ull << (2 * nbody->depth)) < bodyCount) ++nbody->depth;
+
+    const uint64_t bodiesSize = (uint64_t)bodyCount * sizeof(GpuBody);
+    const WGPUBufferUsageFlags storage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopySrc;
+    nbody->uniformBuffer = createBuffer(device, "N-body uniforms", sizeof(NBodyUniforms),
+                                        WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    nbody->bodyBuffers[0] = createBuffer(device, "N-body bodies", bodiesSize, storage);
+    nbody->bodyBuffers[1] = createBuffer(device, "N-body bodies", bodiesSize, storage);
+    nbody->statsBuffer = createBuffer(device, "N-body interactions", 2 * sizeof(uint32_t), storage);
+
+    bool drawable = colorFormat != WGPUTextureFormat_Undefined;
+    if (!nbody->uniformBuffer || !nbody->bodyBuffers[0] || !nbody->bodyBuffers[1] || !nbody->statsBuffer ||
+        (method == NBodyMethod_BarnesHut && !createTree(nbody)) || !createKernels(nbody) ||
+        (drawable && !createRenderPipeline(nbody, colorFormat, depthFormat, sampleCount))) {
+        releaseNBody(nbody);
+        return false;
+    }
+    return true;
+}
+
+void releaseNBody(NBody* nbody)
+{
+    WGPUBindGroup bindGroups[15] = {
+        nbody->spawnBindGroups[0], nbody->spawnBindGroups[1],
+        nbody->allPairsBindGroups[0], nbody->allPairsBindGroups[1],
+        nbody->hashBindGroups[0], nbody->hashBindGroups[1],
+        nbody->gatherBindGroups[0], nbody->gatherBindGroups[1],
+        nbody->forceBindGroups[0], nbody->forceBindGroups[1],
+        nbody->clearLeavesBindGroup, nbody->findLeavesBindGroup, nbody->leafMassBindGroup,
+        nbody->renderBindGroups[0], nbody->renderBindGroups[1],
+    };
+    for (int i = 0; i < 15; ++i) {
+        if (bindGroups[i]) wgpuBindGroupRelease(bindGroups[i]);
+    }
+    for (int i = 0; i < kNBodyMaxDepth; ++i) {
+        if (nbody->reduceBindGroups[i]) wgpuBindGroupRelease(nbody->reduceBindGroups[i]);
+    }
+    WGPUComputePipeline pipelines[9] = {
+        nbody->spawnPipeline, nbody->allPairsPipeline, nbody->hashPipeline,
+        nbody->clearLeavesPipeline, nbody->findLeavesPipeline, nbody->gatherPipeline,
+        nbody->leafMassPipeline, nbody->reducePipeline, nbody->forcePipeline,
+    };
+    for (int i = 0; i < 9; ++i) {
+        if (pipelines[i]) wgpuComputePipelineRelease(pipelines[i]);
+    }
+    if (nbody->renderPipeline) wgpuRenderPipelineRelease(nbody->renderPipeline);
+    releaseGpuSortList(&nbody->sortList);
+    releaseGpuSort(&nbody->sort);
+    WGPUBuffer buffers[11] = {
+        nbody->uniformBuffer, nbody->bodyBuffers[0], nbody->bodyBuffers[1], nbody->statsBuffer,
+        nbody->levelBuffer, nbody->sortedBodyBuffer, nbody->keyBuffer, nbody->indexBuffer,
+        nbody->leafBuffer, nbody->nodeBuffer, nbody->countBuffer,
+    };
+    for (int i = 0; i < 11; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    memset(nbody, 0, sizeof *nbody);
+}
+
+void nbodySetSettings(NBody* nbody, const NBodySettings* settings)
+{
+    nbody->settings = settings ? *settings : defaultNBodySettings();
+    // Without softening, a body would pull itself with 0/0
+    nbody->settings.softening = fmaxf(nbody->settings.softening, 1e-3f);
+    nbody->settings.rootHalfExtent = fmaxf(nbody->settings.rootHalfExtent, 1e-3f);
+    nbody->settings.discRadius = fmaxf(nbody->settings.discRadius, 1e-3f);
+}
+
+void nbodyRespawn(NBody* nbody, uint32_t seed)
+{
+    nbody->seed = seed;
+    nbody->pendingSpawn = true;
+}
+
+void nbodySetCamera(NBody* nbody, Mat4 view, Mat4 projection)
+{
+    nbody->view = view;
+    nbody->projection = projection;
+}
+
+void nbodyStep(NBody* nbody, WGPUCommandEncoder encoder, const WGPUComputePassTimestampWrites* timestamps)
+{
+    const NBodySettings* settings = &nbody->settings;
+
+    NBodyUniforms uniforms = {0};
+    Mat4 viewProj = mat4Mul(nbody->projection, nbody->view);
+    memcpy(uniforms.viewProj, viewProj.m, sizeof uniforms.viewProj);
+    memcpy(uniforms.view, nbody->view.m, sizeof uniforms.view);
+    uniforms.gravity = settings->gravity;
+    uniforms.softening = settings->softening;
+    uniforms.timeDelta = settings->timeDelta;
+    uniforms.theta = settings->theta;
+    uniforms.rootHalfExtent = settings->rootHalfExtent;
+    uniforms.bodyCount = nbody->bodyCount;
+    uniforms.depth = nbody->depth;
+    uniforms.seed = nbody->seed;
+    uniforms.discRadius = settings->discRadius;
+    uniforms.totalMass = settings->totalMass;
+    uniforms.pointSize = settings->pointSize;
+    wgpuQueueWriteBuffer(nbody->queue, nbody->uniformBuffer, 0, &uniforms, sizeof uniforms);
+
+    WGPUComputePassDescriptor passDesc = {0};
+    passDesc.label = "N-body pass";
+    passDesc.timestampWrites = timestamps;
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+
+    const uint32_t current = nbody->current;
+    const uint32_t groups = (nbody->bodyCount + kNBodyGroupSize - 1) / kNBodyGroupSize;
+    if (nbody->pendingSpawn) {
+        wgpuComputePassEncoderSetPipeline(pass, nbody->spawnPipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, nbody->spawnBindGroups[current], 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, groups, 1, 1);
+        nbody->pendingSpawn = false;
+    }
+
+    if (nbody->method == NBodyMethod_AllPairs) {
+        wgpuComputePassEncoderSetPipeline(pass, nbody->allPairsPipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, nbody->allPairsBindGroups[current], 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, groups, 1, 1);
+    } else {
+        const uint32_t leafGroups = (levelNodeCount(nbody->depth) + kNBodyGroupSize - 1) / kNBodyGroupSize;
+
+        wgpuComputePassEncoderSetPipeline(pass, nbody->hashPipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, nbody->hashBindGroups[current], 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, groups, 1, 1);
+
+        gpuSortRecord(&nbody->sort, &nbody->sortList, pass);
+
+        wgpuComputePassEncoderSetPipeline(pass, nbody->clearLeavesPipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, nbody->clearLeavesBindGroup, 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, leafGroups, 1, 1);
+
+        wgpuComputePassEncoderSetPipeline(pass, nbody->findLeavesPipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, nbody->findLeavesBindGroup, 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, groups, 1, 1);
+
+        wgpuComputePassEncoderSetPipeline(pass, nbody->gatherPipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, nbody->gatherBindGroups[current], 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, groups, 1, 1);
+
+        wgpuComputePassEncoderSetPipeline(pass, nbody->leafMassPipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, nbody->leafMassBindGroup, 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, leafGroups, 1, 1);
+
+        // Up the tree, one level per dispatch
+        wgpuComputePassEncoderSetPipeline(pass, nbody->reducePipeline);
+        for (uint32_t level = nbody->depth; level-- > 0;) {
+            wgpuComputePassEncoderSetBindGroup(pass, 0, nbody->reduceBindGroups[level], 0, NULL);
+            wgpuComputePassEncoderDispatchWorkgroups(pass, (levelNodeCount(level) + kNBodyGroupSize - 1) /
+                                                     kNBodyGroupSize, 1, 1);
+        }
+
+        wgpuComputePassEncoderSetPipeline(pass, nbody->forcePipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, nbody->forceBindGroups[current], 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, groups, 1, 1);
+    }
+
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+    nbody->current ^= 1;
+}
+
+void nbodyDraw(NBody* nbody, WGPURenderPassEncoder pass)
+{
+    if (!nbody->renderPipeline) return;
+    wgpuRenderPassEncoderSetPipeline(pass, nbody->renderPipeline);
+    wgpuRenderPassEncoderSetBindGroup(pass, 0, nbody->renderBindGroups[nbody->current], 0, NULL);
+    wgpuRenderPassEncoderDraw(pass, 6, nbody->bodyCount, 0, 0);
+}
+
+#define kBenchmarkWarmupSteps 2
+
+static void benchmarkStep(void* userData, WGPUCommandEncoder encoder)
+{
+    nbodyStep(userData, encoder, NULL);
+}
+
+/** The 64-bit interaction count of statsBuffer, low word first. */
+static uint64_t interactionCount(const uint32_t words[2])
+{
+    return ((uint64_t)words[1] << 32) | words[0];
+}
+
+bool nbodyBenchmark(const Context* context, NBodyMethod method, uint32_t bodyCount, uint32_t steps)
+{
+    NBody nbody;
+    if (!createNBody(&nbody, context->device, context->queue, method, bodyCount, NULL,
+                     WGPUTextureFormat_Undefined, WGPUTextureFormat_Undefined, 1)) {
+        return false;
+    }
+
+    // The running interaction count comes back as the result
+    GpuBenchmark benchmark = {0};
+    benchmark.label = "N-body benchmark";
+    benchmark.step = benchmarkStep;
+    benchmark.userData = &nbody;
+    benchmark.warmupSteps = kBenchmarkWarmupSteps;
+    benchmark.steps = steps;
+    benchmark.resultBuffer = nbody.statsBuffer;
+    benchmark.resultSize = 2 * sizeof(uint32_t);
+    uint32_t before[2], after[2];
+    double seconds = runGpuBenchmark(context->device, context->queue, &benchmark, before, after);
+    bool ok = seconds >= 0.0;
+
+    if (ok) {
+        // All pairs: every body against every body, N^2 a step
+        uint64_t interactions = method == NBodyMethod_AllPairs ? (uint64_t)bodyCount * bodyCount * steps
+                                                                : interactionCount(after) - interactionCount(before);
+        printf("N-body %s, %u bodies, %s/%s on %s: %.3f ms/step, %"PRIu64" interactions/step, "
+               "%.2f G interactions/s\n",
+               nbodyMethodName(method), bodyCount, kWebGPUImplementation, backendTypeName(context->backendType),
+               context->adapterName, seconds * 1e3 / steps, interactions / steps, (double)interactions / seconds / 1e9);
+    }
+
+    releaseNBody(&nbody);
+    return ok;
+}
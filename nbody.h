@@ -0,0 +1,157 @@
+#ifndef NBODY_H
+#define NBODY_H
+
+#include "global.h"
+#include "gpu-sort.h"
+#include "linalg.h"
+#include "webgpu-utils.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * N-BODY GRAVITY
+ *
+ * Softened Newtonian gravity between every pair of bodies, integrated in
+ * compute, two ways:
+ *  - all pairs: every body sums the pull of every other one, exactly. The
+ *    bodies are streamed through workgroup memory one 256-body tile at a
+ *    time, so each is read from storage once per workgroup instead of once
+ *    per invocation. O(N^2).
+ *  - Barnes-Hut: bodies are sorted along a Morton curve over a fixed-depth
+ *    octree of the root box (GPU sort, see gpu-sort.h), leaves find their
+ *    range of the sorted bodies, and every node's mass and center of mass
+ *    are summed up the tree one level per dispatch. Each body then walks
+ *    the tree from the root, taking a node as one point mass when it is
+ *    seen under less than `theta` (side over distance), and summing the
+ *    bodies of the leaves it can't. O(N log N).
+ *
+ * Both double-buffer the bodies: a step reads one copy and writes the
+ * other. Bodies leaving the root box still count, at their real position;
+ * they only sit in its border leaves, which then open more often.
+ *
+ * nbodyBenchmark() reports the body-body interactions per second of either
+ * method; Barnes-Hut counts the interactions its walks actually did, node
+ * or body. The report names the implementation, backend and adapter, so
+ * Dawn and wgpu-native builds compare on the same machine.
+ */
+
+// Body storage, 32 bytes each, must fit in one storage buffer binding
+#define kNBodyMaxBodies (uint32_t)(kMaxStorageBindingSize / 32)
+// Leaves per axis are 2^depth; nodes of every level are kept
+#define kNBodyMaxDepth 7
+
+typedef enum {
+    NBodyMethod_AllPairs,
+    NBodyMethod_BarnesHut,
+} NBodyMethod;
+
+typedef struct {
+    float gravity;              // G
+    float softening;            // length added in quadrature to every distance; > 0
+    float theta;                // Barnes-Hut opening angle; under 0.57 a body never approximates its own node
+    float timeDelta;            // of one step, seconds
+    float discRadius;           // bodies spawn as a rotating disc of this radius
+    float totalMass;
+    float rootHalfExtent;       // Barnes-Hut root box, centered on the origin
+    float pointSize;            // world units, when drawn
+} NBodySettings;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+    NBodyMethod method;
+    NBodySettings settings;
+    uint32_t bodyCount;
+    uint32_t depth;             // Barnes-Hut leaf level
+    uint32_t current;           // body buffer holding the latest step
+    uint32_t seed;
+    bool pendingSpawn;
+    Mat4 view, projection;
+
+    WGPUBuffer uniformBuffer;
+    WGPUBuffer bodyBuffers[2];
+    WGPUBuffer statsBuffer;     // 64-bit count of Barnes-Hut interactions
+
+    // Barnes-Hut only
+    WGPUBuffer levelBuffer;     // one level index per 256 bytes, bound at an offset
+    WGPUBuffer sortedBodyBuffer;
+    WGPUBuffer keyBuffer;
+    WGPUBuffer indexBuffer;
+    WGPUBuffer leafBuffer;      // per leaf: first and one past the last sorted body
+    WGPUBuffer nodeBuffer;      // per node: center of mass and mass, level by level
+    WGPUBuffer countBuffer;     // the body count, for the sort
+    GpuSort sort;
+    GpuSortList sortList;
+
+    WGPUComputePipeline spawnPipeline;
+    WGPUComputePipeline allPairsPipeline;
+    WGPUComputePipeline hashPipeline;
+    WGPUComputePipeline clearLeavesPipeline;
+    WGPUComputePipeline findLeavesPipeline;
+    WGPUComputePipeline gatherPipeline;
+    WGPUComputePipeline leafMassPipeline;
+    WGPUComputePipeline reducePipeline;
+    WGPUComputePipeline forcePipeline;
+    WGPUBindGroup spawnBindGroups[2];   // by current body buffer
+    WGPUBindGroup allPairsBindGroups[2];
+    WGPUBindGroup hashBindGroups[2];
+    WGPUBindGroup gatherBindGroups[2];
+    WGPUBindGroup forceBindGroups[2];
+    WGPUBindGroup clearLeavesBindGroup;
+    WGPUBindGroup findLeavesBindGroup;
+    WGPUBindGroup leafMassBindGroup;
+    WGPUBindGroup reduceBindGroups[kNBodyMaxDepth];     // by parent level
+
+    WGPURenderPipeline renderPipeline;  // NULL when created without a color format
+    WGPUBindGroup renderBindGroups[2];
+} NBody;
+
+/** A disc galaxy in about a 100-unit box. */
+NBodySettings defaultNBodySettings(void);
+
+/**
+ * `bodyCount` bodies, up to kNBodyMaxBodies, spawned as a disc of circular
+ * orbits. With a color format the bodies can be drawn, additively, in
+ * passes with these formats and sample count; pass
+ * WGPUTextureFormat_Undefined to only simulate.
+ */
+bool createNBody(NBody* nbody,
+                 WGPUDevice device,
+                 WGPUQueue queue,
+                 NBodyMethod method,
+                 uint32_t bodyCount,
+                 const NBodySettings* settings,
+                 WGPUTextureFormat colorFormat,
+                 WGPUTextureFormat depthFormat,
+                 uint32_t sampleCount);
+
+void releaseNBody(NBody* nbody);
+
+/** Takes effect on the next step. */
+void nbodySetSettings(NBody* nbody, const NBodySettings* settings);
+
+/** Respawn every body on the next step. */
+void nbodyRespawn(NBody* nbody, uint32_t seed);
+
+/** The camera of the next nbodyDraw(), uploaded by the next step. */
+void nbodySetCamera(NBody* nbody, Mat4 view, Mat4 projection);
+
+/** Record one step in its own compute pass. */
+void nbodyStep(NBody* nbody, WGPUCommandEncoder encoder, const WGPUComputePassTimestampWrites* timestamps);
+
+void nbodyDraw(NBody* nbody, WGPURenderPassEncoder pass);
+
+/** "all-pairs" or "barnes-hut". */
+const char* nbodyMethodName(NBodyMethod method);
+
+/**
+ * Simulate `bodyCount` bodies for `steps` steps with `method`, waiting for
+ * the GPU at the end, and print the interactions per second with the
+ * adapter they ran on. Blocking, meant for a headless device.
+ */
+bool nbodyBenchmark(const Context* context, NBodyMethod method, uint32_t bodyCount, uint32_t steps);
+
+#endif // NBODY_H
@@ -0,0 +1,757 @@
+#include "particles.h"
+#include "webgpu-utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Uniform block of every particle shader. Must match ParticleUniforms in
+ * kParticleCommonWGSL (288 bytes).
+ */
+typedef struct {
+    float viewProj[16];
+    float view[16];
+    float projection[4];        // P[0][0], P[1][1], P[2][2], P[3][2]: enough to linearize depth
+    float emitterPosition[3];
+    float emitterRadius;
+    float emitVelocity[3];
+    float velocitySpread;
+    float gravity[3];
+    float drag;
+    float colorStart[4];
+    float colorEnd[4];
+    float lifetimeMin;
+    float lifetimeMax;
+    float sizeStart;
+    float sizeEnd;
+    float timeDelta;
+    float restitution;
+    float friction;
+    float collisionThickness;
+    float depthSize[2];
+    uint32_t emitRequest;
+    uint32_t frameIndex;
+    uint32_t current;
+    uint32_t flags;
+    uint32_t capacity;
+    uint32_t _pad0;
+} ParticleUniforms;
+
+/** Must match Particle in kParticleCommonWGSL. */
+typedef struct {
+    float position[3];
+    float age;
+    float velocity[3];
+    float lifetime;
+} GpuParticle;
+
+#define kParticleFlagCollide 1u
+#define kParticleFlagSort    2u
+
+/** argsBuffer, in u32s: the emit and simulate dispatches, then the draw. */
+#define kArgsEmit      0
+#define kArgsSimulate  3
+#define kArgsDraw      6
+#define kArgsCount     10
+
+/** counterBuffer, in u32s: dead count, both alive counts, emitted count. */
+#define kCounterAlive  1
+#define kCounterCount  4
+
+#define kParticleCommonWGSL \
+"struct ParticleUniforms {\n" \
+"    viewProj: mat4x4f,\n" \
+"    view: mat4x4f,\n" \
+"    projection: vec4f,\n" \
+"    emitterPosition: vec3f,\n" \
+"    emitterRadius: f32,\n" \
+"    emitVelocity: vec3f,\n" \
+"    velocitySpread: f32,\n" \
+"    gravity: vec3f,\n" \
+"    drag: f32,\n" \
+"    colorStart: vec4f,\n" \
+"    colorEnd: vec4f,\n" \
+"    lifetimeMin: f32,\n" \
+"    lifetimeMax: f32,\n" \
+"    sizeStart: f32,\n" \
+"    sizeEnd: f32,\n" \
+"    timeDelta: f32,\n" \
+"    restitution: f32,\n" \
+"    friction: f32,\n" \
+"    collisionThickness: f32,\n" \
+"    depthSize: vec2f,\n" \
+"    emitRequest: u32,\n" \
+"    frameIndex: u32,\n" \
+"    current: u32,\n" \
+"    flags: u32,\n" \
+"    capacity: u32,\n" \
+"    _pad0: u32,\n" \
+"}\n" \
+"struct Particle {\n" \
+"    position: vec3f,\n" \
+"    age: f32,\n" \
+"    velocity: vec3f,\n" \
+"    lifetime: f32,\n" \
+"}\n"
+
+static const char* const kParticleWGSL[] = {
+kParticleCommonWGSL kGpuSortKeyWGSL
+"struct Counters {\n"
+"    dead: atomic<u32>,\n"
+"    alive: array<atomic<u32>, 2>,\n"
+"    emitted: atomic<u32>,\n"
+"}\n"
+"\n"
+"@group(0) @binding(0) var<uniform> settings: ParticleUniforms;\n"
+"@group(0) @binding(1) var<storage, read_write> particles: array<Particle>;\n"
+"@group(0) @binding(2) var<storage, read_write> deadList: array<u32>;\n"
+"@group(0) @binding(3) var<storage, read_write> aliveIn: array<u32>;\n"
+"@group(0) @binding(4) var<storage, read_write> aliveOut: array<u32>;\n"
+"@group(0) @binding(5) var<storage, read_write> counters: Counters;\n"
+"@group(0) @binding(6) var<storage, read_write> args: array<u32, 10>;\n"
+"@group(0) @binding(7) var<storage, read_write> sortKeys: array<u32>;\n"
+"@group(0) @binding(8) var depth: texture_depth_2d;\n"
+"\n"
+"const kFlagCollide = 1u;\n"
+"const kFlagSort = 2u;\n"
+"const kEmitGroupSize = 64u;\n"
+"const kSimulateGroupSize = 256u;\n"
+"\n"
+kRandomWGSL
+"\n"
+"@compute @workgroup_size(256)\n"
+"fn reset(@builtin(global_invocation_id) id: vec3u) {\n"
+"    // Every slot free; the stack pops from the end, so slot 0 goes first\n"
+"    if (id.x < settings.capacity) {\n"
+"        deadList[id.x] = settings.capacity - 1u - id.x;\n"
+"    }\n"
+"    if (id.x == 0u) {\n"
+"        atomicStore(&counters.dead, settings.capacity);\n"
+"        atomicStore(&counters.alive[0], 0u);\n"
+"        atomicStore(&counters.alive[1], 0u);\n"
+"        atomicStore(&counters.emitted, 0u);\n"
+"    }\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(1)\n"
+"fn begin() {\n"
+"    let emitted = min(settings.emitRequest, atomicLoad(&counters.dead));\n"
+"    atomicStore(&counters.emitted, emitted);\n"
+"    atomicStore(&counters.alive[settings.current ^ 1u], 0u);\n"
+"\n"
+"    // New particles are appended to the current list, and simulated with it\n"
+"    let alive = atomicLoad(&counters.alive[settings.current]);\n"
+"    args[0] = (emitted + kEmitGroupSize - 1u) / kEmitGroupSize;\n"
+"    args[1] = 1u;\n"
+"    args[2] = 1u;\n"
+"    args[3] = (alive + emitted + kSimulateGroupSize - 1u) / kSimulateGroupSize;\n"
+"    args[4] = 1u;\n"
+"    args[5] = 1u;\n"
+"}\n"
+"\n",
+"@compute @workgroup_size(64)\n"
+"fn emit(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (id.x >= atomicLoad(&counters.emitted)) {\n"
+"        return;\n"
+"    }\n"
+"    // begin() made sure there are enough free slots\n"
+"    let index = deadList[atomicSub(&counters.dead, 1u) - 1u];\n"
+"    var seed = pcg(id.x ^ pcg(settings.frameIndex));\n"
+"\n"
+"    var p: Particle;\n"
+"    p.position = settings.emitterPosition +\n"
+"                 randomDirection(&seed) * settings.emitterRadius * pow(random(&seed), 1.0 / 3.0);\n"
+"    p.age = 0.0;\n"
+"    p.velocity = settings.emitVelocity + randomDirection(&seed) * settings.velocitySpread * random(&seed);\n"
+"    p.lifetime = mix(settings.lifetimeMin, settings.lifetimeMax, random(&seed));\n"
+"    particles[index] = p;\n"
+"    aliveIn[atomicAdd(&counters.alive[settings.current], 1u)] = index;\n"
+"}\n"
+"\n"
+"// View-space z (negative in front of the camera) of a depth buffer value\n"
+"fn viewDepth(ndcDepth: f32) -> f32 {\n"
+"    return -settings.projection.w / (ndcDepth + settings.projection.z);\n"
+"}\n"
+"\n"
+"fn viewPosition(pixel: vec2i) -> vec3f {\n"
+"    let z = viewDepth(textureLoad(depth, pixel, 0));\n"
+"    let ndc = (vec2f(pixel) + 0.5) / settings.depthSize * vec2f(2.0, -2.0) + vec2f(-1.0, 1.0);\n"
+"    return vec3f(-ndc.x * z / settings.projection.x, -ndc.y * z / settings.projection.y, z);\n"
+"}\n"
+"\n"
+"fn collide(p: ptr<function, Particle>, previous: vec3f) {\n"
+"    let clip = settings.viewProj * vec4f((*p).position, 1.0);\n"
+"    if (clip.w <= 0.0) {\n"
+"        return;\n"
+"    }\n"
+"    let ndc = clip.xy / clip.w;\n"
+"    if (any(abs(ndc) >= vec2f(1.0))) {\n"
+"        return;\n"
+"    }\n"
+"    let pixel = vec2i((ndc * vec2f(0.5, -0.5) + 0.5) * settings.depthSize);\n"
+"    let particleZ = (settings.view * vec4f((*p).position, 1.0)).z;\n"
+"    let surfaceZ = viewDepth(textureLoad(depth, pixel, 0));\n"
+"    if (particleZ > surfaceZ || particleZ < surfaceZ - settings.collisionThickness) {\n"
+"        return;\n"
+"    }\n"
+"\n"
+"    // Surface normal from the depth of the neighbouring pixels\n"
+"    let base = min(pixel, vec2i(settings.depthSize) - 2);\n"
+"    let center = viewPosition(base);\n"
+"    let edges = cross(viewPosition(base + vec2i(0, 1)) - center, viewPosition(base + vec2i(1, 0)) - center);\n"
+"    var viewNormal = vec3f(0.0, 0.0, 1.0);\n"
+"    if (dot(edges, edges) > 1e-12) {\n"
+"        viewNormal = normalize(edges);\n"
+"    }\n"
+"    // The view matrix only rotates and translates: its transposed rotation goes back to world space\n"
+"    let rotation = mat3x3f(settings.view[0].xyz, settings.view[1].xyz, settings.view[2].xyz);\n"
+"    let normal = transpose(rotation) * viewNormal;\n"
+"\n"
+"    let speed = dot((*p).velocity, normal);\n"
+"    if (speed < 0.0) {\n"
+"        let tangent = (*p).velocity - normal * speed;\n"
+"        (*p).velocity = tangent * (1.0 - settings.friction) - normal * speed * settings.restitution;\n"
+"    }\n"
+"    (*p).position = previous;\n"
+"}\n"
+"\n",
+"@compute @workgroup_size(256)\n"
+"fn simulate(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (id.x >= atomicLoad(&counters.alive[settings.current])) {\n"
+"        return;\n"
+"    }\n"
+"    let index = aliveIn[id.x];\n"
+"    var p = particles[index];\n"
+"    p.age += settings.timeDelta;\n"
+"    if (p.age >= p.lifetime) {\n"
+"        deadList[atomicAdd(&counters.dead, 1u)] = index;\n"
+"        return;\n"
+"    }\n"
+"\n"
+"    let previous = p.position;\n"
+"    p.velocity = (p.velocity + settings.gravity * settings.timeDelta) / (1.0 + settings.drag * settings.timeDelta);\n"
+"    p.position += p.velocity * settings.timeDelta;\n"
+"    if ((settings.flags & kFlagCollide) != 0u) {\n"
+"        collide(&p, previous);\n"
+"    }\n"
+"    particles[index] = p;\n"
+"\n"
+"    let slot = atomicAdd(&counters.alive[settings.current ^ 1u], 1u);\n"
+"    aliveOut[slot] = index;\n"
+"    if ((settings.flags & kFlagSort) != 0u) {\n"
+"        // Ascending view z: farthest first\n"
+"        sortKeys[slot] = sortableFloat((settings.view * vec4f(p.position, 1.0)).z);\n"
+"    }\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(1)\n"
+"fn finish() {\n"
+"    args[6] = 6u;\n"
+"    args[7] = atomicLoad(&counters.alive[settings.current ^ 1u]);\n"
+"    args[8] = 0u;\n"
+"    args[9] = 0u;\n"
+"}\n",
+};
+
+static const char* kParticleRenderWGSL = kParticleCommonWGSL
+"@group(0) @binding(0) var<uniform> settings: ParticleUniforms;\n"
+"@group(0) @binding(1) var<storage, read> particles: array<Particle>;\n"
+"@group(0) @binding(2) var<storage, read> drawList: array<u32>;\n"
+"\n"
+"struct VertexOutput {\n"
+"    @builtin(position) position: vec4f,\n"
+"    @location(0) color: vec4f,\n"
+"    @location(1) corner: vec2f,\n"
+"}\n"
+"\n"
+"@vertex\n"
+"fn vs_main(@builtin(vertex_index) vertex: u32, @builtin(instance_index) instance: u32) -> VertexOutput {\n"
+"    var corners = array<vec2f, 6>(vec2f(-1.0, -1.0), vec2f(1.0, -1.0), vec2f(1.0, 1.0),\n"
+"                                  vec2f(-1.0, -1.0), vec2f(1.0, 1.0), vec2f(-1.0, 1.0));\n"
+"    let p = particles[drawList[instance]];\n"
+"    let t = saturate(p.age / p.lifetime);\n"
+"    let corner = corners[vertex];\n"
+"\n"
+"    // Camera-facing: the camera's right and up axes are the view matrix's first two rows\n"
+"    let right = vec3f(settings.view[0].x, settings.view[1].x, settings.view[2].x);\n"
+"    let up = vec3f(settings.view[0].y, settings.view[1].y, settings.view[2].y);\n"
+"    let halfSize = mix(settings.sizeStart, settings.sizeEnd, t) * 0.5;\n"
+"    let world = p.position + (right * corner.x + up * corner.y) * halfSize;\n"
+"\n"
+"    var out: VertexOutput;\n"
+"    out.position = settings.viewProj * vec4f(world, 1.0);\n"
+"    out.color = mix(settings.colorStart, settings.colorEnd, t);\n"
+"    out.corner = corner;\n"
+"    return out;\n"
+"}\n"
+"\n"
+"@fragment\n"
+"fn fs_main(in: VertexOutput) -> @location(0) vec4f {\n"
+"    // Soft round sprite, premultiplied\n"
+"    let alpha = in.color.a * saturate(1.0 - dot(in.corner, in.corner));\n"
+"    return vec4f(in.color.rgb * alpha, alpha);\n"
+"}\n";
+
+ParticleSettings defaultParticleSettings(void)
+{
+    ParticleSettings settings;
+    memset(&settings, 0, sizeof settings);
+    settings.position = vec3(0.0f, 0.0f, 0.0f);
+    settings.radius = 0.1f;
+    settings.velocity = vec3(0.0f, 4.0f, 0.0f);
+    settings.velocitySpread = 1.0f;
+    settings.rate = 2000.0f;
+    settings.lifetimeMin = 1.5f;
+    settings.lifetimeMax = 3.0f;
+    settings.sizeStart = 0.05f;
+    settings.sizeEnd = 0.02f;
+    const float colorStart[4] = { 1.0f, 0.8f, 0.4f, 1.0f };
+    const float colorEnd[4] = { 1.0f, 0.2f, 0.05f, 0.0f };
+    memcpy(settings.colorStart, colorStart, sizeof colorStart);
+    memcpy(settings.colorEnd, colorEnd, sizeof colorEnd);
+    settings.gravity = vec3(0.0f, -9.81f, 0.0f);
+    settings.drag = 0.1f;
+    settings.collide = true;
+    settings.restitution = 0.4f;
+    settings.friction = 0.2f;
+    settings.collisionThickness = 0.5f;
+    settings.sort = true;
+    return settings;
+}
+
+/**
+ * Bind group entry `binding` of kParticleWGSL. Alive lists are by parity:
+ * `parity` is read, the other one written.
+ */
+static void fillParticleEntry(const ParticleSystem* particles, uint32_t binding, uint32_t parity,
+                              WGPUTextureView depth, WGPUBindGroupEntry* entry)
+{
+    memset(entry, 0, sizeof *entry);
+    entry->binding = binding;
+    switch (binding) {
+    case 0:
+        entry->buffer = particles->uniformBuffer;
+        entry->size = sizeof(ParticleUniforms);
+        break;
+    case 1:
+        entry->buffer = particles->particleBuffer;
+        entry->size = (uint64_t)particles->capacity * sizeof(GpuParticle);
+        break;
+    case 2:
+        entry->buffer = particles->deadBuffer;
+        entry->size = (uint64_t)particles->capacity * sizeof(uint32_t);
+        break;
+    case 3:
+    case 4:
+        entry->buffer = particles->aliveBuffers[binding == 3 ? parity : parity ^ 1];
+        entry->size = (uint64_t)particles->sort.capacity * sizeof(uint32_t);
+        break;
+    case 5:
+        entry->buffer = particles->counterBuffer;
+        entry->size = kCounterCount * sizeof(uint32_t);
+        break;
+    case 6:
+        entry->buffer = particles->argsBuffer;
+        entry->size = kArgsCount * sizeof(uint32_t);
+        break;
+    case 7:
+        entry->buffer = particles->keyBuffer;
+        entry->size = (uint64_t)particles->sort.capacity * sizeof(uint32_t);
+        break;
+    case 8:
+        entry->textureView = depth;
+        break;
+    }
+}
+
+/** What fillParticleEntry() needs besides the binding. */
+typedef struct {
+    const ParticleSystem* particles;
+    uint32_t parity;
+    WGPUTextureView depth;
+} ParticleBindings;
+
+static void fillKernelEntry(void* userData, uint32_t binding, WGPUBindGroupEntry* entry)
+{
+    const ParticleBindings* kernel = userData;
+    fillParticleEntry(kernel->particles, binding, kernel->parity, kernel->depth, entry);
+}
+
+static WGPUBindGroup createParticleBindGroup(const ParticleSystem* particles, WGPUComputePipeline pipeline,
+                                             const char* label, const uint32_t* bindings, uint32_t bindingCount,
+                                             uint32_t parity, WGPUTextureView depth)
+{
+    ParticleBindings kernel = { particles, parity, depth };
+    return createAutoLayoutBindGroup(particles->device, pipeline, label, bindings, bindingCount, fillKernelEntry,
+                                     &kernel);
+}
+
+static const uint32_t kResetBindings[] = { 0, 2, 5 };
+static const uint32_t kBeginBindings[] = { 0, 5, 6 };
+static const uint32_t kEmitBindings[] = { 0, 1, 2, 3, 5 };
+static const uint32_t kSimulateBindings[] = { 0, 1, 2, 3, 4, 5, 7, 8 };
+static const uint32_t kFinishBindings[] = { 0, 5, 6 };
+
+static bool createKernels(ParticleSystem* particles)
+{
+    WGPUShaderModule module = createShaderModuleFromParts(particles->device, "Particle shader", kParticleWGSL,
+                                                          sizeof kParticleWGSL / sizeof kParticleWGSL[0]);
+    if (!module) return false;
+    particles->resetPipeline = createComputePipeline(particles->device, "Particle reset pipeline", module, "reset");
+    particles->beginPipeline = createComputePipeline(particles->device, "Particle begin pipeline", module, "begin");
+    particles->emitPipeline = createComputePipeline(particles->device, "Particle emit pipeline", module, "emit");
+    particles->simulatePipeline = createComputePipeline(particles->device, "Particle simulate pipeline", module,
+                                                        "simulate");
+    particles->finishPipeline = createComputePipeline(particles->device, "Particle finish pipeline", module, "finish");
+    wgpuShaderModuleRelease(module);
+    if (!particles->resetPipeline || !particles->beginPipeline || !particles->emitPipeline ||
+        !particles->simulatePipeline || !particles->finishPipeline) {
+        return false;
+    }
+
+    particles->resetBindGroup = createParticleBindGroup(particles, particles->resetPipeline,
+                                                        "Particle reset bind group",
+                                                        kResetBindings, kBindingCount(kResetBindings), 0, NULL);
+    particles->beginBindGroup = createParticleBindGroup(particles, particles->beginPipeline,
+                                                        "Particle begin bind group",
+                                                        kBeginBindings, kBindingCount(kBeginBindings), 0, NULL);
+    particles->finishBindGroup = createParticleBindGroup(particles, particles->finishPipeline,
+                                                         "Particle finish bind group",
+                                                         kFinishBindings, kBindingCount(kFinishBindings), 0, NULL);
+    for (uint32_t parity = 0; parity < 2; ++parity) {
+        particles->emitBindGroups[parity] = createParticleBindGroup(particles, particles->emitPipeline,
+                                                                    "Particle emit bind group", kEmitBindings,
+                                                                    kBindingCount(kEmitBindings), parity, NULL);
+    }
+    return particles->resetBindGroup && particles->beginBindGroup && particles->finishBindGroup &&
+           particles->emitBindGroups[0] && particles->emitBindGroups[1];
+}
+
+static bool createSortLists(ParticleSystem* particles)
+{
+    // The update from each parity writes, and sorts, the other alive list
+    for (uint32_t parity = 0; parity < 2; ++parity) {
+        if (!createGpuSortList(&particles->sort, &particles->sortLists[parity], particles->keyBuffer,
+                               particles->aliveBuffers[parity ^ 1], particles->counterBuffer,
+                               kCounterAlive + (parity ^ 1))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool createRenderPipeline(ParticleSystem* particles,
+                                 WGPUTextureFormat colorFormat,
+                                 WGPUTextureFormat depthFormat,
+                                 uint32_t sampleCount,
+                                 bool additive)
+{
+    WGPUShaderModule module = createShaderModule(particles->device, "Particle render shader", kParticleRenderWGSL);
+    if (!module) return false;
+
+    // Premultiplied "over", or added on top keeping the destination alpha
+    WGPUBlendState blend = {0};
+    blend.color.operation = WGPUBlendOperation_Add;
+    blend.color.srcFactor = WGPUBlendFactor_One;
+    blend.color.dstFactor = additive ? WGPUBlendFactor_One : WGPUBlendFactor_OneMinusSrcAlpha;
+    blend.alpha.operation = WGPUBlendOperation_Add;
+    blend.alpha.srcFactor = additive ? WGPUBlendFactor_Zero : WGPUBlendFactor_One;
+    blend.alpha.dstFactor = additive ? WGPUBlendFactor_One : WGPUBlendFactor_OneMinusSrcAlpha;
+
+    WGPUColorTargetState colorTarget = {0};
+    colorTarget.format = colorFormat;
+    colorTarget.blend = &blend;
+    colorTarget.writeMask = WGPUColorWriteMask_All;
+
+    WGPUFragmentState fragment = {0};
+    fragment.module = module;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &colorTarget;
+
+    // Tested against the scene, never written: particles don't occlude each other
+    WGPUDepthStencilState depthStencil = {0};
+    depthStencil.format = depthFormat;
+    depthStencil.depthWriteEnabled = false;
+    depthStencil.depthCompare = WGPUCompareFunction_LessEqual;
+    depthStencil.stencilFront.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilBack.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilReadMask = 0;
+    depthStencil.stencilWriteMask = 0;
+
+    WGPURenderPipelineDescriptor desc = {0};
+    desc.label = "Particle render pipeline";
+    desc.layout = NULL; // auto layout
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
+    desc.primitive.frontFace = WGPUFrontFace_CCW;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.depthStencil = depthFormat != WGPUTextureFormat_Undefined ? &depthStencil : NULL;
+    desc.multisample.count = sampleCount > 1 ? sampleCount : 1;
+    desc.multisample.mask = ~0u;
+    desc.multisample.alphaToCoverageEnabled = false;
+    desc.fragment = &fragment;
+
+    particles->renderPipeline = wgpuDeviceCreateRenderPipeline(particles->device, &desc);
+    wgpuShaderModuleRelease(module);
+    if (!particles->renderPipeline) {
+        fprintf(stderr, "Failed to create %s\n", desc.label);
+        return false;
+    }
+
+    WGPUBindGroupLayout layout = wgpuRenderPipelineGetBindGroupLayout(particles->renderPipeline, 0);
+    for (uint32_t parity = 0; parity < 2; ++parity) {
+        WGPUBindGroupEntry entries[3];
+        fillParticleEntry(particles, 0, parity, NULL, &entries[0]);
+        fillParticleEntry(particles, 1, parity, NULL, &entries[1]);
+        fillParticleEntry(particles, 3, parity, NULL, &entries[2]);
+        entries[2].binding = 2;
+
+        WGPUBindGroupDescriptor bindGroupDesc = {0};
+        bindGroupDesc.label = "Particle render bind group";
+        bindGroupDesc.layout = layout;
+        bindGroupDesc.entryCount = 3;
+        bindGroupDesc.entries = entries;
+        particles->renderBindGroups[parity] = wgpuDeviceCreateBindGroup(particles->device, &bindGroupDesc);
+    }
+    wgpuBindGroupLayoutRelease(layout);
+    return particles->renderBindGroups[0] && particles->renderBindGroups[1];
+}
+
+bool createParticleSystem(ParticleSystem* particles,
+                          WGPUDevice device,
+                          WGPUQueue queue,
+                          uint32_t capacity,
+                          WGPUTextureFormat colorFormat,
+                          WGPUTextureFormat depthFormat,
+                          uint32_t sampleCount,
+                          bool additive,
+                          const ParticleSettings* settings)
+{
+    memset(particles, 0, sizeof *particles);
+    if (capacity == 0 || capacity > kParticleMaxCapacity) {
+        fprintf(stderr, "createParticleSystem: capacity %u out of range (1..%u)\n", capacity, kParticleMaxCapacity);
+        return false;
+    }
+    particles->device = device;
+    particles->queue = queue;
+    particles->capacity = capacity;
+    particleSetSettings(particles, settings);
+    particles->pendingReset = true;
+    if (!createGpuSort(&particles->sort, device, queue, capacity)) return false;
+
+    // Alive lists and keys are sized for the sort, which pads them to a power of two
+    const WGPUBufferUsageFlags storage = WGPUBufferUsage_Storage;
+    particles->uniformBuffer = createBuffer(device, "Particle uniforms", sizeof(ParticleUniforms),
+                                            WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    particles->particleBuffer = createBuffer(device, "Particles", (uint64_t)capacity * sizeof(GpuParticle), storage);
+    particles->deadBuffer = createBuffer(device, "Particle dead list", (uint64_t)capacity * sizeof(uint32_t), storage);
+    particles->aliveBuffers[0] = createBuffer(device, "Particle alive list",
+                                              (uint64_t)particles->sort.capacity * sizeof(uint32_t), storage);
+    particles->aliveBuffers[1] = createBuffer(device, "Particle alive list",
+                                              (uint64_t)particles->sort.capacity * sizeof(uint32_t), storage);
+    particles->counterBuffer = createBuffer(device, "Particle counters", kCounterCount * sizeof(uint32_t), storage);
+    particles->argsBuffer = createBuffer(device, "Particle indirect args", kArgsCount * sizeof(uint32_t),
+                                         WGPUBufferUsage_Storage | WGPUBufferUsage_Indirect);
+    particles->keyBuffer = createBuffer(device, "Particle sort keys",
+                                        (uint64_t)particles->sort.capacity * sizeof(uint32_t), storage);
+
+    // Bound in place of the depth buffer when there is none: collisions are off then
+    WGPUTextureDescriptor textureDesc = {0};
+    textureDesc.label = "Particle dummy depth";
+    textureDesc.usage = WGPUTextureUsage_TextureBinding;
+    textureDesc.dimension = WGPUTextureDimension_2D;
+    textureDesc.size = (WGPUExtent3D){ 1, 1, 1 };
+    textureDesc.format = WGPUTextureFormat_Depth32Float;
+    textureDesc.mipLevelCount = 1;
+    textureDesc.sampleCount = 1;
+    particles->dummyDepthTexture = wgpuDeviceCreateTexture(device, &textureDesc);
+    if (particles->dummyDepthTexture) {
+        particles->dummyDepthView = wgpuTextureCreateView(particles->dummyDepthTexture, NULL);
+    }
+
+    if (!particles->uniformBuffer || !particles->particleBuffer || !particles->deadBuffer ||
+        !particles->aliveBuffers[0] || !particles->aliveBuffers[1] || !particles->counterBuffer ||
+        !particles->argsBuffer || !particles->keyBuffer || !particles->dummyDepthView ||
+        !createKernels(particles) || !createSortLists(particles) ||
+        !createRenderPipeline(particles, colorFormat, depthFormat, sampleCount, additive)) {
+        releaseParticleSystem(particles);
+        return false;
+    }
+    return true;
+}
+
+void releaseParticleSystem(ParticleSystem* particles)
+{
+    WGPUBindGroup bindGroups[7] = {
+        particles->resetBindGroup, particles->beginBindGroup, particles->finishBindGroup,
+        particles->emitBindGroups[0], particles->emitBindGroups[1],
+        particles->renderBindGroups[0], particles->renderBindGroups[1],
+    };
+    for (int i = 0; i < 7; ++i) {
+        if (bindGroups[i]) wgpuBindGroupRelease(bindGroups[i]);
+    }
+    WGPUComputePipeline pipelines[5] = {
+        particles->resetPipeline, particles->beginPipeline, particles->emitPipeline,
+        particles->simulatePipeline, particles->finishPipeline,
+    };
+    for (int i = 0; i < 5; ++i) {
+        if (pipelines[i]) wgpuComputePipelineRelease(pipelines[i]);
+    }
+    if (particles->renderPipeline) wgpuRenderPipelineRelease(particles->renderPipeline);
+    releaseGpuSortList(&particles->sortLists[0]);
+    releaseGpuSortList(&particles->sortLists[1]);
+    releaseGpuSort(&particles->sort);
+    if (particles->dummyDepthView) wgpuTextureViewRelease(particles->dummyDepthView);
+    if (particles->dummyDepthTexture) {
+        wgpuTextureDestroy(particles->dummyDepthTexture);
+        wgpuTextureRelease(particles->dummyDepthTexture);
+    }
+    WGPUBuffer buffers[8] = {
+        particles->uniformBuffer, particles->particleBuffer, particles->deadBuffer,
+        particles->aliveBuffers[0], particles->aliveBuffers[1], particles->counterBuffer,
+        particles->argsBuffer, particles->keyBuffer,
+    };
+    for (int i = 0; i < 8; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    memset(particles, 0, sizeof *particles);
+}
+
+void particleSetSettings(ParticleSystem* particles, const ParticleSettings* settings)
+{
+    particles->settings = settings ? *settings : defaultParticleSettings();
+    // A zero lifetime would divide by zero in the vertex shader
+    particles->settings.lifetimeMin = fmaxf(particles->settings.lifetimeMin, 1e-3f);
+    particles->settings.lifetimeMax = fmaxf(particles->settings.lifetimeMax, particles->settings.lifetimeMin);
+}
+
+void particleBurst(ParticleSystem* particles, uint32_t count)
+{
+    uint64_t total = (uint64_t)particles->pendingBurst + count;
+    particles->pendingBurst = total < particles->capacity ? (uint32_t)total : particles->capacity;
+}
+
+void particleReset(ParticleSystem* particles)
+{
+    particles->pendingReset = true;
+    particles->pendingBurst = 0;
+    particles->emitAccumulator = 0.0f;
+}
+
+void particleUpdate(ParticleSystem* particles,
+                    WGPUCommandEncoder encoder,
+                    const ParticleFrame* frame,
+                    const WGPUComputePassTimestampWrites* timestamps)
+{
+    const ParticleSettings* settings = &particles->settings;
+
+    // Whole particles only: the fraction carries over to the next frames
+    float wanted = particles->emitAccumulator + fmaxf(settings->rate, 0.0f) * frame->timeDelta;
+    wanted = fminf(wanted, (float)particles->capacity);
+    uint32_t emitCount = (uint32_t)wanted;
+    particles->emitAccumulator = wanted - (float)emitCount;
+    emitCount += particles->pendingBurst;
+    if (emitCount > particles->capacity) emitCount = particles->capacity;
+    particles->pendingBurst = 0;
+
+    bool collide = settings->collide && frame->depth && frame->depthWidth >= 2 && frame->depthHeight >= 2;
+
+    ParticleUniforms uniforms = {0};
+    Mat4 viewProj = mat4Mul(frame->projection, frame->view);
+    memcpy(uniforms.viewProj, viewProj.m, sizeof uniforms.viewProj);
+    memcpy(uniforms.view, frame->view.m, sizeof uniforms.view);
+    uniforms.projection[0] = frame->projection.m[0];
+    uniforms.projection[1] = frame->projection.m[5];
+    uniforms.projection[2] = frame->projection.m[10];
+    uniforms.projection[3] = frame->projection.m[14];
+    uniforms.emitterPosition[0] = settings->position.x;
+    uniforms.emitterPosition[1] = settings->position.y;
+    uniforms.emitterPosition[2] = settings->position.z;
+    uniforms.emitterRadius = settings->radius;
+    uniforms.emitVelocity[0] = settings->velocity.x;
+    uniforms.emitVelocity[1] = settings->velocity.y;
+    uniforms.emitVelocity[2] = settings->velocity.z;
+    uniforms.velocitySpread = settings->velocitySpread;
+    uniforms.gravity[0] = settings->gravity.x;
+    uniforms.gravity[1] = settings->gravity.y;
+    uniforms.gravity[2] = settings->gravity.z;
+    uniforms.drag = settings->drag;
+    memcpy(uniforms.colorStart, settings->colorStart, sizeof uniforms.colorStart);
+    memcpy(uniforms.colorEnd, settings->colorEnd, sizeof uniforms.colorEnd);
+    uniforms.lifetimeMin = settings->lifetimeMin;
+    uniforms.lifetimeMax = settings->lifetimeMax;
+    uniforms.sizeStart = settings->sizeStart;
+    uniforms.sizeEnd = settings->sizeEnd;
+    uniforms.timeDelta = frame->timeDelta;
+    uniforms.restitution = settings->restitution;
+    uniforms.friction = settings->friction;
+    uniforms.collisionThickness = settings->collisionThickness;
+    uniforms.depthSize[0] = (float)frame->depthWidth;
+    uniforms.depthSize[1] = (float)frame->depthHeight;
+    uniforms.emitRequest = emitCount;
+    uniforms.frameIndex = particles->frameIndex;
+    uniforms.current = particles->current;
+    uniforms.flags = (collide ? kParticleFlagCollide : 0) | (settings->sort ? kParticleFlagSort : 0);
+    uniforms.capacity = particles->capacity;
+    wgpuQueueWriteBuffer(particles->queue, particles->uniformBuffer, 0, &uniforms, sizeof uniforms);
+
+    // Per frame, for collisions against this frame's depth view
+    WGPUBindGroup simulateBindGroup =
+        createParticleBindGroup(particles, particles->simulatePipeline, "Particle simulate bind group",
+                                kSimulateBindings, kBindingCount(kSimulateBindings), particles->current,
+                                collide ? frame->depth : particles->dummyDepthView);
+    if (!simulateBindGroup) return;
+
+    WGPUComputePassDescriptor passDesc = {0};
+    passDesc.label = "Particle pass";
+    passDesc.timestampWrites = timestamps;
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+
+    if (particles->pendingReset) {
+        wgpuComputePassEncoderSetPipeline(pass, particles->resetPipeline);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, particles->resetBindGroup, 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass, (particles->capacity + 255) / 256, 1, 1);
+        particles->pendingReset = false;
+    }
+
+    wgpuComputePassEncoderSetPipeline(pass, particles->beginPipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, particles->beginBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, 1, 1, 1);
+
+    wgpuComputePassEncoderSetPipeline(pass, particles->emitPipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, particles->emitBindGroups[particles->current], 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroupsIndirect(pass, particles->argsBuffer, kArgsEmit * sizeof(uint32_t));
+
+    wgpuComputePassEncoderSetPipeline(pass, particles->simulatePipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, simulateBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroupsIndirect(pass, particles->argsBuffer, kArgsSimulate * sizeof(uint32_t));
+
+    wgpuComputePassEncoderSetPipeline(pass, particles->finishPipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, particles->finishBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, 1, 1, 1);
+
+    if (settings->sort) {
+        gpuSortRecord(&particles->sort, &particles->sortLists[particles->current], pass);
+    }
+
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+    wgpuBindGroupRelease(simulateBindGroup);
+
+    particles->current ^= 1;
+    ++particles->frameIndex;
+}
+
+void particleDraw(ParticleSystem* particles, WGPURenderPassEncoder pass)
+{
+    wgpuRenderPassEncoderSetPipeline(pass, particles->renderPipeline);
+    wgpuRenderPassEncoderSetBindGroup(pass, 0, particles->renderBindGroups[particles->current], 0, NULL);
+    wgpuRenderPassEncoderDrawIndirect(pass, particles->argsBuffer, kArgsDraw * sizeof(uint32_t));
+}
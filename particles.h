@@ -0,0 +1,158 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include "gpu-sort.h"
+#include "linalg.h"
+#include "webgpu-utils.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * GPU PARTICLES
+ *
+ * A particle system that lives entirely on the GPU: the CPU only writes
+ * one uniform block and records a fixed set of dispatches per frame, so
+ * its cost doesn't depend on the particle count.
+ *
+ * Particles are slots in a fixed-capacity pool. Free slots are a stack
+ * (the dead list); live ones are listed in one of two alive lists, which
+ * swap every frame. One compute pass per update:
+ *  - begin: clamps this frame's emission to the free slots and writes the
+ *    indirect dispatch arguments of the next two kernels
+ *  - emit: pops slots off the dead list, initializes them at the emitter
+ *    and appends them to the current alive list
+ *  - simulate: ages and integrates every live particle (gravity, drag),
+ *    bounces it off the depth buffer, and pushes it back onto the dead list
+ *    or compacts it into the other alive list
+ *  - finish: writes the indirect draw arguments, one instance per live
+ *    particle
+ *  - sort (optional): the new alive list, back to front for alpha
+ *    blending, by view depth (see gpu-sort.h)
+ *
+ * Drawing is one indirect, non-indexed draw of camera-facing quads, read
+ * from the alive list in the vertex shader.
+ *
+ * Collisions use the depth buffer of the camera the particles are seen
+ * from (usually last frame's), so they only happen on visible surfaces:
+ * particles behind the surface by less than `collisionThickness` are put
+ * back where they were and reflected off the normal reconstructed from
+ * depth.
+ */
+
+// Particle storage, 32 bytes each, must fit in one storage buffer binding
+#define kParticleMaxCapacity (uint32_t)(kMaxStorageBindingSize / 32)
+
+typedef struct {
+    // Emitter
+    Vec3 position;
+    float radius;               // particles spawn uniformly in this sphere
+    Vec3 velocity;
+    float velocitySpread;       // random velocity added, in any direction, up to this length
+    float rate;                 // particles per second
+    float lifetimeMin, lifetimeMax;     // seconds
+
+    // Appearance, interpolated over the lifetime
+    float sizeStart, sizeEnd;           // world units
+    float colorStart[4], colorEnd[4];   // linear, straight alpha
+
+    // Simulation
+    Vec3 gravity;
+    float drag;                 // 1/s
+    bool collide;
+    float restitution;          // 0 = stick, 1 = perfect bounce
+    float friction;             // fraction of the tangential velocity lost per bounce
+    float collisionThickness;   // world units
+
+    bool sort;                  // back to front, for alpha blending
+} ParticleSettings;
+
+/** What the particles are seen from this frame. */
+typedef struct {
+    Mat4 view;
+    Mat4 projection;            // perspective
+    WGPUTextureView depth;      // single-sampled Depth32Float/Depth24Plus seen with `projection`, or NULL
+    uint32_t depthWidth, depthHeight;
+    float timeDelta;            // seconds
+} ParticleFrame;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+    ParticleSettings settings;
+    uint32_t capacity;
+    uint32_t current;           // alive list drawn, and read by the next update
+    uint32_t frameIndex;
+    float emitAccumulator;      // fraction of a particle left over from the last frames
+    uint32_t pendingBurst;
+    bool pendingReset;
+
+    WGPUBuffer uniformBuffer;
+    WGPUBuffer particleBuffer;
+    WGPUBuffer deadBuffer;
+    WGPUBuffer aliveBuffers[2];
+    WGPUBuffer counterBuffer;   // dead count, alive counts, emitted count
+    WGPUBuffer argsBuffer;      // indirect dispatch and draw arguments (Indirect | Storage)
+    WGPUBuffer keyBuffer;       // sort keys, parallel to the alive list being written
+    WGPUTexture dummyDepthTexture;
+    WGPUTextureView dummyDepthView;
+
+    WGPUComputePipeline resetPipeline;
+    WGPUComputePipeline beginPipeline;
+    WGPUComputePipeline emitPipeline;
+    WGPUComputePipeline simulatePipeline;
+    WGPUComputePipeline finishPipeline;
+    WGPUBindGroup resetBindGroup;
+    WGPUBindGroup beginBindGroup;
+    WGPUBindGroup finishBindGroup;
+    WGPUBindGroup emitBindGroups[2];    // by alive list parity
+
+    // Alive lists are sized for the sort, which pads them to sort.capacity
+    GpuSort sort;
+    GpuSortList sortLists[2];           // the list written by the update from each parity
+
+    WGPURenderPipeline renderPipeline;
+    WGPUBindGroup renderBindGroups[2];
+} ParticleSystem;
+
+/** A small upward fountain, sorted, colliding. */
+ParticleSettings defaultParticleSettings(void);
+
+/**
+ * `capacity` is the maximum live particle count, up to
+ * kParticleMaxCapacity. The particles are drawn in passes with the given
+ * formats and sample count; `additive` blends them additively, which needs
+ * no sorting, instead of premultiplied "over".
+ */
+bool createParticleSystem(ParticleSystem* particles,
+                          WGPUDevice device,
+                          WGPUQueue queue,
+                          uint32_t capacity,
+                          WGPUTextureFormat colorFormat,
+                          WGPUTextureFormat depthFormat,
+                          uint32_t sampleCount,
+                          bool additive,
+                          const ParticleSettings* settings);
+
+void releaseParticleSystem(ParticleSystem* particles);
+
+void particleSetSettings(ParticleSystem* particles, const ParticleSettings* settings);
+
+/** Emit `count` particles at once on the next update, on top of the rate. */
+void particleBurst(ParticleSystem* particles, uint32_t count);
+
+/** Kill every particle on the next update. */
+void particleReset(ParticleSystem* particles);
+
+/** Record the update in its own compute pass. Once per frame. */
+void particleUpdate(ParticleSystem* particles,
+                    WGPUCommandEncoder encoder,
+                    const ParticleFrame* frame,
+                    const WGPUComputePassTimestampWrites* timestamps);
+
+/** Draw the particles of the last update, in a pass matching the creation formats. */
+void particleDraw(ParticleSystem* particles, WGPURenderPassEncoder pass);
+
+#endif // PARTICLES_H
@@ -0,0 +1,530 @@
+#include "post-process.h"
+#include "webgpu-utils.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Uniform block of every pass. Must match PostUniforms in kPostHeaderWGSL
+ * (272 bytes).
+ */
+typedef struct {
+    float size[2];
+    uint32_t frameIndex;
+    uint32_t _pad;
+    float params[kPostMaxEffects][4];
+} PostUniforms;
+
+/** One label per possible pass: literals, so the profiler can keep them as pass names. */
+static const char* const kPostPassLabels[kPostMaxEffects] = {
+    "post 0", "post 1", "post 2",  "post 3",  "post 4",  "post 5",  "post 6",  "post 7",
+    "post 8", "post 9", "post 10", "post 11", "post 12", "post 13", "post 14", "post 15",
+};
+
+#define kPostHeaderWGSL \
+"struct PostUniforms {\n" \
+"    size: vec2f,\n" \
+"    frameIndex: u32,\n" \
+"    params: array<vec4f, %d>,\n" \
+"}\n" \
+"struct ExposureState {\n" \
+"    luminance: f32,\n" \
+"    exposure: f32,\n" \
+"}\n" \
+"\n" \
+"@group(0) @binding(0) var<uniform> post: PostUniforms;\n" \
+"@group(0) @binding(1) var source: texture_2d<f32>;\n" \
+"@group(0) @binding(2) var sourceSampler: sampler;\n" \
+"@group(0) @binding(3) var bloom: texture_2d<f32>;\n" \
+"@group(0) @binding(4) var<storage, read> exposure: ExposureState;\n" \
+"\n" \
+"struct VertexOutput {\n" \
+"    @builtin(position) position: vec4f,\n" \
+"    @location(0) uv: vec2f,\n" \
+"}\n" \
+"\n" \
+"// One triangle covering the whole target\n" \
+"@vertex\n" \
+"fn vs_main(@builtin(vertex_index) vertex: u32) -> VertexOutput {\n" \
+"    let corner = vec2f(f32((vertex << 1u) & 2u), f32(vertex & 2u));\n" \
+"    var out: VertexOutput;\n" \
+"    out.position = vec4f(corner * vec2f(2.0, -2.0) + vec2f(-1.0, 1.0), 0.0, 1.0);\n" \
+"    out.uv = corner;\n" \
+"    return out;\n" \
+"}\n" \
+"\n" \
+"fn sampleSource(uv: vec2f) -> vec4f {\n" \
+"    return textureSampleLevel(source, sourceSampler, uv, 0.0);\n" \
+"}\n" \
+"\n" \
+"fn sampleBloom(uv: vec2f) -> vec4f {\n" \
+"    return textureSampleLevel(bloom, sourceSampler, uv, 0.0);\n" \
+"}\n"
+
+// Built-in effects
+
+static const char* kTonemapWGSL =
+"    // ACES filmic fit (Narkowicz)\n"
+"    let x = color.rgb * params.x * exposure.exposure;\n"
+"    let mapped = (x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14);\n"
+"    return vec4f(clamp(mapped, vec3f(0.0), vec3f(1.0)), color.a);\n";
+
+static const char* kColorGradeWGSL =
+"    let luma = dot(color.rgb, vec3f(0.2126, 0.7152, 0.0722));\n"
+"    var graded = mix(vec3f(luma), color.rgb, params.x);\n"
+"    graded = (graded - 0.5) * params.y + 0.5;\n"
+"    graded *= vec3f(1.0 + params.z, 1.0, 1.0 - params.z) * params.w;\n"
+"    return vec4f(max(graded, vec3f(0.0)), color.a);\n";
+
+static const char* kVignetteWGSL =
+"    let centered = (uv - 0.5) * vec2f(post.size.x / post.size.y, 1.0);\n"
+"    let falloff = smoothstep(params.y, params.y + params.z, length(centered));\n"
+"    return vec4f(color.rgb * (1.0 - params.x * falloff), color.a);\n";
+
+static const char* kFilmGrainWGSL =
+"    // PCG hash of the pixel and frame\n"
+"    let pixel = vec2u(uv * post.size);\n"
+"    var h = pixel.x * 1973u + pixel.y * 9277u + post.frameIndex * 26699u;\n"
+"    h = h * 747796405u + 2891336453u;\n"
+"    h = ((h >> ((h >> 28u) + 4u)) ^ h) * 277803737u;\n"
+"    h = (h >> 22u) ^ h;\n"
+"    let noise = f32(h) / 4294967295.0 - 0.5;\n"
+"    return vec4f(max(color.rgb + noise * params.x, vec3f(0.0)), color.a);\n";
+
+static const char* kChromaticAberrationWGSL =
+"    // Red and blue pulled apart along the radius, params.x pixels at the edges\n"
+"    let offset = (uv - 0.5) * 2.0 * params.x / post.size;\n"
+"    let center = sampleSource(uv);\n"
+"    let red = sampleSource(uv + offset).r;\n"
+"    let blue = sampleSource(uv - offset).b;\n"
+"    return vec4f(red, center.g, blue, center.a);\n";
+
+static const char* kBloomCompositeWGSL =
+"    return vec4f(color.rgb + sampleBloom(uv).rgb * params.x, color.a);\n";
+
+static PostEffect makeEffect(const char* name, PostEffectKind kind, const char* wgsl,
+                             float a, float b, float c, float d)
+{
+    PostEffect effect = {0};
+    effect.name = name;
+    effect.kind = kind;
+    effect.wgsl = wgsl;
+    effect.params[0] = a;
+    effect.params[1] = b;
+    effect.params[2] = c;
+    effect.params[3] = d;
+    effect.enabled = true;
+    return effect;
+}
+
+PostEffect postTonemap(float exposure)
+{
+    return makeEffect("tonemap", PostEffect_Pixel, kTonemapWGSL, exposure, 0.0f, 0.0f, 0.0f);
+}
+
+PostEffect postColorGrade(float saturation, float contrast, float temperature, float gain)
+{
+    return makeEffect("color grade", PostEffect_Pixel, kColorGradeWGSL, saturation, contrast, temperature, gain);
+}
+
+PostEffect postVignette(float intensity, float radius, float softness)
+{
+    return makeEffect("vignette", PostEffect_Pixel, kVignetteWGSL, intensity, radius, softness, 0.0f);
+}
+
+PostEffect postFilmGrain(float intensity)
+{
+    return makeEffect("film grain", PostEffect_Pixel, kFilmGrainWGSL, intensity, 0.0f, 0.0f, 0.0f);
+}
+
+PostEffect postChromaticAberration(float pixels)
+{
+    return makeEffect("chromatic aberration", PostEffect_Neighbourhood, kChromaticAberrationWGSL,
+                      pixels, 0.0f, 0.0f, 0.0f);
+}
+
+PostEffect postBloomComposite(float intensity)
+{
+    return makeEffect("bloom composite", PostEffect_Pixel, kBloomCompositeWGSL, intensity, 0.0f, 0.0f, 0.0f);
+}
+
+// Shader generation
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} ShaderSource;
+
+static void appendf(ShaderSource* source, const char* format, ...)
+{
+    if (source->failed) return;
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        size_t available = source->capacity - source->length;
+        int written = vsnprintf(source->data ? source->data + source->length : NULL, available, format, args);
+        va_end(args);
+        if (written < 0) {
+            source->failed = true;
+            return;
+        }
+        if ((size_t)written < available) {
+            source->length += (size_t)written;
+            return;
+        }
+        size_t capacity = source->capacity ? source->capacity * 2 : 4096;
+        while (capacity - source->length <= (size_t)written) capacity *= 2;
+        char* data = realloc(source->data, capacity);
+        if (!data) {
+            source->failed = true;
+            return;
+        }
+        source->data = data;
+        source->capacity = capacity;
+    }
+}
+
+/** WGSL of one pass: the header, a function per enabled effect, and fs_main calling them in order. */
+static char* generatePassWGSL(const PostChain* chain, const PostPass* pass)
+{
+    ShaderSource source = {0};
+    appendf(&source, kPostHeaderWGSL, kPostMaxEffects);
+
+    for (uint32_t i = pass->firstEffect; i < pass->endEffect; ++i) {
+        const PostEffect* effect = &chain->effects[i];
+        if (!effect->enabled) continue;
+        if (effect->kind == PostEffect_Pixel) {
+            appendf(&source, "\n// %s\nfn effect%u(color: vec4f, uv: vec2f, params: vec4f) -> vec4f {\n%s}\n",
+                    effect->name, i, effect->wgsl);
+        } else {
+            appendf(&source, "\n// %s\nfn effect%u(uv: vec2f, params: vec4f) -> vec4f {\n%s}\n",
+                    effect->name, i, effect->wgsl);
+        }
+    }
+
+    appendf(&source, "\n@fragment\nfn fs_main(in: VertexOutput) -> @location(0) vec4f {\n");
+    bool first = true;
+    for (uint32_t i = pass->firstEffect; i < pass->endEffect; ++i) {
+        const PostEffect* effect = &chain->effects[i];
+        if (!effect->enabled) continue;
+        if (first && effect->kind == PostEffect_Neighbourhood) {
+            appendf(&source, "    var color = effect%u(in.uv, post.params[%u]);\n", i, i);
+        } else {
+            if (first) appendf(&source, "    var color = sampleSource(in.uv);\n");
+            appendf(&source, "    color = effect%u(color, in.uv, post.params[%u]);\n", i, i);
+        }
+        first = false;
+    }
+    if (first) appendf(&source, "    let color = sampleSource(in.uv);\n");
+    appendf(&source, "    return color;\n}\n");
+
+    if (source.failed) {
+        fprintf(stderr, "postChainCompile: out of memory\n");
+        free(source.data);
+        return NULL;
+    }
+    return source.data;
+}
+
+static WGPURenderPipeline createPassPipeline(PostChain* chain, const PostPass* pass, WGPUTextureFormat format)
+{
+    char* wgsl = generatePassWGSL(chain, pass);
+    if (!wgsl) return NULL;
+    WGPUShaderModule module = createShaderModule(chain->device, pass->label, wgsl);
+    free(wgsl);
+    if (!module) return NULL;
+
+    WGPUColorTargetState colorTarget = {0};
+    colorTarget.format = format;
+    colorTarget.blend = NULL;
+    colorTarget.writeMask = WGPUColorWriteMask_All;
+
+    WGPUFragmentState fragment = {0};
+    fragment.module = module;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &colorTarget;
+
+    WGPURenderPipelineDescriptor desc = {0};
+    desc.label = pass->label;
+    desc.layout = chain->pipelineLayout;
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.vertex.bufferCount = 0;
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
+    desc.primitive.frontFace = WGPUFrontFace_CCW;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.depthStencil = NULL;
+    desc.multisample.count = 1;
+    desc.multisample.mask = ~0u;
+    desc.multisample.alphaToCoverageEnabled = false;
+    desc.fragment = &fragment;
+
+    WGPURenderPipeline pipeline = wgpuDeviceCreateRenderPipeline(chain->device, &desc);
+    wgpuShaderModuleRelease(module);
+    if (!pipeline) {
+        fprintf(stderr, "Failed to create %s pipeline\n", pass->label);
+    }
+    return pipeline;
+}
+
+static void releasePasses(PostChain* chain)
+{
+    for (uint32_t i = 0; i < chain->passCount; ++i) {
+        if (chain->passes[i].pipeline) wgpuRenderPipelineRelease(chain->passes[i].pipeline);
+    }
+    memset(chain->passes, 0, sizeof chain->passes);
+    chain->passCount = 0;
+}
+
+bool postChainCompile(PostChain* chain)
+{
+    releasePasses(chain);
+    chain->dirty = false;
+
+    // A pass runs from a neighbourhood effect (or the start) to the next one
+    for (uint32_t i = 0; i < chain->effectCount; ++i) {
+        const PostEffect* effect = &chain->effects[i];
+        if (!effect->enabled) continue;
+        if (chain->passCount == 0 || effect->kind == PostEffect_Neighbourhood) {
+            chain->passes[chain->passCount++].firstEffect = i;
+        }
+        chain->passes[chain->passCount - 1].endEffect = i + 1;
+    }
+    // Nothing enabled: still copy the source to the target
+    if (chain->passCount == 0) chain->passCount = 1;
+
+    for (uint32_t i = 0; i < chain->passCount; ++i) {
+        PostPass* pass = &chain->passes[i];
+        pass->label = kPostPassLabels[i];
+        bool last = i == chain->passCount - 1;
+        pass->pipeline = createPassPipeline(chain, pass, last ? chain->outputFormat : kPostIntermediateFormat);
+        if (!pass->pipeline) {
+            releasePasses(chain);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool createPostChain(PostChain* chain,
+                     WGPUDevice device,
+                     WGPUQueue queue,
+                     TexturePool* pool,
+                     WGPUTextureFormat outputFormat)
+{
+    memset(chain, 0, sizeof *chain);
+    chain->device = device;
+    chain->queue = queue;
+    chain->pool = pool;
+    chain->outputFormat = outputFormat;
+    chain->dirty = true;
+
+    WGPUBindGroupLayoutEntry layoutEntries[5] = {0};
+    for (uint32_t i = 0; i < 5; ++i) {
+        layoutEntries[i].binding = i;
+        layoutEntries[i].visibility = WGPUShaderStage_Fragment;
+    }
+    layoutEntries[0].buffer.type = WGPUBufferBindingType_Uniform;
+    layoutEntries[0].buffer.minBindingSize = sizeof(PostUniforms);
+    layoutEntries[1].texture.sampleType = WGPUTextureSampleType_Float;
+    layoutEntries[1].texture.viewDimension = WGPUTextureViewDimension_2D;
+    layoutEntries[2].sampler.type = WGPUSamplerBindingType_Filtering;
+    layoutEntries[3].texture.sampleType = WGPUTextureSampleType_Float;
+    layoutEntries[3].texture.viewDimension = WGPUTextureViewDimension_2D;
+    layoutEntries[4].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+    layoutEntries[4].buffer.minBindingSize = sizeof(ExposureState);
+
+    WGPUBindGroupLayoutDescriptor layoutDesc = {0};
+    layoutDesc.label = "Post-processing layout";
+    layoutDesc.entryCount = 5;
+    layoutDesc.entries = layoutEntries;
+    chain->layout = wgpuDeviceCreateBindGroupLayout(device, &layoutDesc);
+    if (chain->layout) {
+        WGPUPipelineLayoutDescriptor pipelineLayoutDesc = {0};
+        pipelineLayoutDesc.label = "Post-processing pipeline layout";
+        pipelineLayoutDesc.bindGroupLayoutCount = 1;
+        pipelineLayoutDesc.bindGroupLayouts = &chain->layout;
+        chain->pipelineLayout = wgpuDeviceCreatePipelineLayout(device, &pipelineLayoutDesc);
+    }
+
+    chain->uniformBuffer = createBuffer(device, "Post-processing uniforms", sizeof(PostUniforms),
+                                        WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+
+    WGPUSamplerDescriptor samplerDesc = {0};
+    samplerDesc.label = "Post-processing sampler";
+    samplerDesc.addressModeU = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeV = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeW = WGPUAddressMode_ClampToEdge;
+    samplerDesc.magFilter = WGPUFilterMode_Linear;
+    samplerDesc.minFilter = WGPUFilterMode_Linear;
+    samplerDesc.mipmapFilter = WGPUMipmapFilterMode_Nearest;
+    samplerDesc.lodMinClamp = 0.0f;
+    samplerDesc.lodMaxClamp = 1.0f;
+    samplerDesc.maxAnisotropy = 1;
+    chain->sampler = wgpuDeviceCreateSampler(device, &samplerDesc);
+
+    // Zero-initialized, i.e. black
+    WGPUTextureDescriptor bloomDesc = {0};
+    bloomDesc.label = "Post-processing no bloom";
+    bloomDesc.usage = WGPUTextureUsage_TextureBinding;
+    bloomDesc.dimension = WGPUTextureDimension_2D;
+    bloomDesc.size = (WGPUExtent3D){ 1, 1, 1 };
+    bloomDesc.format = kPostIntermediateFormat;
+    bloomDesc.mipLevelCount = 1;
+    bloomDesc.sampleCount = 1;
+    chain->noBloomTexture = wgpuDeviceCreateTexture(device, &bloomDesc);
+    if (chain->noBloomTexture) chain->noBloomView = wgpuTextureCreateView(chain->noBloomTexture, NULL);
+
+    chain->fixedExposure = createBuffer(device, "Post-processing fixed exposure", sizeof(ExposureState),
+                                        WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst);
+
+    if (!chain->pipelineLayout || !chain->uniformBuffer || !chain->sampler || !chain->noBloomView ||
+        !chain->fixedExposure) {
+        fprintf(stderr, "createPostChain: failed to create the shared resources\n");
+        releasePostChain(chain);
+        return false;
+    }
+    ExposureState fixed = { 0.0f, 1.0f };
+    wgpuQueueWriteBuffer(queue, chain->fixedExposure, 0, &fixed, sizeof fixed);
+    return true;
+}
+
+void releasePostChain(PostChain* chain)
+{
+    releasePasses(chain);
+    if (chain->noBloomView) wgpuTextureViewRelease(chain->noBloomView);
+    if (chain->noBloomTexture) {
+        wgpuTextureDestroy(chain->noBloomTexture);
+        wgpuTextureRelease(chain->noBloomTexture);
+    }
+    if (chain->sampler) wgpuSamplerRelease(chain->sampler);
+    WGPUBuffer buffers[2] = { chain->uniformBuffer, chain->fixedExposure };
+    for (int i = 0; i < 2; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    if (chain->pipelineLayout) wgpuPipelineLayoutRelease(chain->pipelineLayout);
+    if (chain->layout) wgpuBindGroupLayoutRelease(chain->layout);
+    memset(chain, 0, sizeof *chain);
+}
+
+int postChainAdd(PostChain* chain, const PostEffect* effect)
+{
+    if (chain->effectCount == kPostMaxEffects) {
+        fprintf(stderr, "postChainAdd: more than %d effects\n", kPostMaxEffects);
+        return -1;
+    }
+    chain->effects[chain->effectCount] = *effect;
+    chain->effects[chain->effectCount].enabled = true;
+    chain->dirty = true;
+    return (int)chain->effectCount++;
+}
+
+void postChainSetEnabled(PostChain* chain, uint32_t index, bool enabled)
+{
+    if (index >= chain->effectCount || chain->effects[index].enabled == enabled) return;
+    chain->effects[index].enabled = enabled;
+    chain->dirty = true;
+}
+
+void postChainSetParams(PostChain* chain, uint32_t index, const float params[4])
+{
+    if (index >= chain->effectCount) return;
+    memcpy(chain->effects[index].params, params, sizeof chain->effects[index].params);
+}
+
+void postChainRender(PostChain* chain,
+                     WGPUCommandEncoder encoder,
+                     const PostChainInput* input,
+                     WGPUTextureView target,
+                     Profiler* profiler)
+{
+    if (chain->dirty && !postChainCompile(chain)) return;
+
+    PostUniforms uniforms = {0};
+    uniforms.size[0] = (float)input->width;
+    uniforms.size[1] = (float)input->height;
+    uniforms.frameIndex = chain->frameIndex++;
+    for (uint32_t i = 0; i < chain->effectCount; ++i) {
+        memcpy(uniforms.params[i], chain->effects[i].params, sizeof uniforms.params[i]);
+    }
+    wgpuQueueWriteBuffer(chain->queue, chain->uniformBuffer, 0, &uniforms, sizeof uniforms);
+
+    WGPUTextureView source = input->source;
+    PooledTexture* sourceTexture = NULL;
+    for (uint32_t i = 0; i < chain->passCount; ++i) {
+        const PostPass* pass = &chain->passes[i];
+        bool last = i == chain->passCount - 1;
+
+        // Every pass but the last writes an intermediate frame for the next
+        PooledTexture* intermediate = NULL;
+        WGPUTextureView destination = target;
+        if (!last) {
+            TexturePoolDesc desc = {0};
+            desc.width = input->width;
+            desc.height = input->height;
+            desc.format = kPostIntermediateFormat;
+            desc.usage = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_TextureBinding;
+            intermediate = texturePoolAcquire(chain->pool, &desc);
+            if (!intermediate) break;
+            destination = intermediate->view;
+        }
+
+        WGPUBindGroupEntry entries[5] = {0};
+        entries[0].binding = 0;
+        entries[0].buffer = chain->uniformBuffer;
+        entries[0].size = sizeof(PostUniforms);
+        entries[1].binding = 1;
+        entries[1].textureView = source;
+        entries[2].binding = 2;
+        entries[2].sampler = chain->sampler;
+        entries[3].binding = 3;
+        entries[3].textureView = input->bloom ? input->bloom : chain->noBloomView;
+        entries[4].binding = 4;
+        entries[4].buffer = input->exposure ? input->exposure : chain->fixedExposure;
+        entries[4].size = sizeof(ExposureState);
+
+        WGPUBindGroupDescriptor bindGroupDesc = {0};
+        bindGroupDesc.label = "Post-processing bind group";
+        bindGroupDesc.layout = chain->layout;
+        bindGroupDesc.entryCount = 5;
+        bindGroupDesc.entries = entries;
+        WGPUBindGroup bindGroup = wgpuDeviceCreateBindGroup(chain->device, &bindGroupDesc);
+
+        WGPURenderPassColorAttachment colorAttachment = {0};
+        colorAttachment.view = destination;
+        colorAttachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+        colorAttachment.loadOp = WGPULoadOp_Clear;
+        colorAttachment.storeOp = WGPUStoreOp_Store;
+        colorAttachment.clearValue = (WGPUColor){0.0, 0.0, 0.0, 1.0};
+
+        WGPURenderPassDescriptor passDesc = {0};
+        passDesc.label = pass->label;
+        passDesc.colorAttachmentCount = 1;
+        passDesc.colorAttachments = &colorAttachment;
+        passDesc.timestampWrites = profiler ? profilerRenderPass(profiler, pass->label) : NULL;
+        WGPURenderPassEncoder renderPass = wgpuCommandEncoderBeginRenderPass(encoder, &passDesc);
+        if (bindGroup) {
+            wgpuRenderPassEncoderSetPipeline(renderPass, pass->pipeline);
+            wgpuRenderPassEncoderSetBindGroup(renderPass, 0, bindGroup, 0, NULL);
+            wgpuRenderPassEncoderDraw(renderPass, 3, 1, 0, 0);
+        }
+        wgpuRenderPassEncoderEnd(renderPass);
+        wgpuRenderPassEncoderRelease(renderPass);
+        if (bindGroup) wgpuBindGroupRelease(bindGroup);
+
+        // Passes are ordered in the encoder: the frame just read can be reused
+        if (sourceTexture) texturePoolRelease(chain->pool, sourceTexture);
+        sourceTexture = intermediate;
+        source = destination;
+    }
+    if (sourceTexture) texturePoolRelease(chain->pool, sourceTexture);
+}
@@ -0,0 +1,129 @@
+#ifndef POST_PROCESS_H
+#define POST_PROCESS_H
+
+#include "auto-exposure.h"
+#include "profiler.h"
+#include "texture-pool.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * POST-PROCESSING CHAIN
+ *
+ * Effects are snippets of WGSL, and the chain compiles them into as few
+ * fullscreen passes as it can: every pass reads and writes the whole
+ * frame, which at 4K costs more than most effects themselves.
+ *
+ *  - pixel effects only look at their own pixel (tonemap, grading,
+ *    vignette, grain, compositing a bloom texture at the same UV), so a
+ *    run of them is fused into the pass before, as function calls on a
+ *    color kept in registers
+ *  - neighbourhood effects sample the frame around the pixel (chromatic
+ *    aberration), so they need everything before them written out: each
+ *    one starts a new pass, which it begins by sampling the frame itself
+ *
+ * The chain is recompiled (WGSL generated, pipelines created) on the next
+ * render after effects are added or toggled; parameters are uniforms and
+ * change without recompiling. Intermediate frames come from the texture
+ * pool, and the last pass draws straight into the target.
+ *
+ * Effect WGSL is the body of a function that returns the new color:
+ *      pixel:          fn(color: vec4f, uv: vec2f, params: vec4f) -> vec4f
+ *      neighbourhood:  fn(uv: vec2f, params: vec4f) -> vec4f
+ * Bodies can call sampleSource(uv) (neighbourhood effects only) and
+ * sampleBloom(uv) (black without a bloom input), and read post.size
+ * (pixels), post.frameIndex and exposure.exposure (1 without an exposure
+ * input).
+ */
+
+#define kPostMaxEffects 16
+#define kPostIntermediateFormat WGPUTextureFormat_RGBA16Float
+
+typedef enum {
+    PostEffect_Pixel,
+    PostEffect_Neighbourhood,
+} PostEffectKind;
+
+typedef struct {
+    const char* name;
+    PostEffectKind kind;
+    const char* wgsl;
+    float params[4];
+    bool enabled;
+} PostEffect;
+
+/** One compiled pass: effects [firstEffect, endEffect) of the chain, enabled ones only. */
+typedef struct {
+    WGPURenderPipeline pipeline;
+    uint32_t firstEffect, endEffect;
+    const char* label;          // a literal, also the profiler's pass name
+} PostPass;
+
+typedef struct {
+    WGPUTextureView source;     // HDR scene color
+    WGPUTextureView bloom;      // any size; NULL for none
+    WGPUBuffer exposure;        // an AutoExposure's stateBuffer; NULL for none
+    uint32_t width, height;     // of source and target
+} PostChainInput;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+    TexturePool* pool;
+    WGPUTextureFormat outputFormat;
+
+    PostEffect effects[kPostMaxEffects];
+    uint32_t effectCount;
+
+    PostPass passes[kPostMaxEffects];
+    uint32_t passCount;
+    bool dirty;                 // recompile before the next render
+    uint32_t frameIndex;
+
+    // Shared by every pass, whatever its effects use
+    WGPUBindGroupLayout layout;
+    WGPUPipelineLayout pipelineLayout;
+    WGPUBuffer uniformBuffer;
+    WGPUSampler sampler;
+    WGPUTexture noBloomTexture; // bound when there is no bloom input
+    WGPUTextureView noBloomView;
+    WGPUBuffer fixedExposure;   // bound when there is no exposure input
+} PostChain;
+
+/** Built-in effects. */
+PostEffect postTonemap(float exposure);     // times the exposure input
+PostEffect postColorGrade(float saturation, float contrast, float temperature, float gain);
+PostEffect postVignette(float intensity, float radius, float softness);
+PostEffect postFilmGrain(float intensity);
+PostEffect postChromaticAberration(float pixels);
+PostEffect postBloomComposite(float intensity);
+
+bool createPostChain(PostChain* chain,
+                     WGPUDevice device,
+                     WGPUQueue queue,
+                     TexturePool* pool,
+                     WGPUTextureFormat outputFormat);
+
+void releasePostChain(PostChain* chain);
+
+/** Append an effect (enabled). Returns its index, or -1 when the chain is full. */
+int postChainAdd(PostChain* chain, const PostEffect* effect);
+
+void postChainSetEnabled(PostChain* chain, uint32_t index, bool enabled);
+
+void postChainSetParams(PostChain* chain, uint32_t index, const float params[4]);
+
+/** Generate and build the passes. Done by postChainRender() when needed. */
+bool postChainCompile(PostChain* chain);
+
+/** Record the chain's passes, drawing the result into all of `target`. */
+void postChainRender(PostChain* chain,
+                     WGPUCommandEncoder encoder,
+                     const PostChainInput* input,
+                     WGPUTextureView target,
+                     Profiler* profiler);
+
+#endif // POST_PROCESS_H
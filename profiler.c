@@ -0,0 +1,250 @@
+#include "profiler.h"
+#include "webgpu-utils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/** Weight of the newest sample in the smoothed pass timings. */
+#define kProfilerSmoothing 0.1
+
+#define kNotTimed UINT32_MAX
+
+static const uint64_t kReadbackStride = kProfilerMaxPasses * 2 * sizeof(uint64_t);
+
+bool createProfiler(Profiler* profiler, const Context* context)
+{
+    memset(profiler, 0, sizeof *profiler);
+    profiler->device = context->device;
+    profiler->queue = context->queue;
+    profiler->frameStart = SDL_GetPerformanceCounter();
+    profiler->currentReadback = kNotTimed;
+    profiler->gpuTimingSupported = context->timestampQuery;
+
+    if (!profiler->gpuTimingSupported) {
+        printf("Profiler: no timestamp queries, GPU pass timings disabled\n");
+        return true;
+    }
+
+    WGPUQuerySetDescriptor queryDesc = {0};
+    queryDesc.label = "Profiler timestamps";
+    queryDesc.type = WGPUQueryType_Timestamp;
+    queryDesc.count = kProfilerFramesInFlight * kProfilerMaxPasses * 2;
+    profiler->querySet = wgpuDeviceCreateQuerySet(context->device, &queryDesc);
+
+    profiler->resolveBuffer = createBuffer(context->device, "Profiler resolve",
+                                           kProfilerFramesInFlight * kReadbackStride,
+                                           WGPUBufferUsage_QueryResolve | WGPUBufferUsage_CopySrc);
+    bool ok = profiler->querySet && profiler->resolveBuffer;
+    for (uint32_t i = 0; ok && i < kProfilerFramesInFlight; ++i) {
+        profiler->readbacks[i].buffer = createBuffer(context->device, "Profiler readback", kReadbackStride,
+                                                     WGPUBufferUsage_MapRead | WGPUBufferUsage_CopyDst);
+        ok = profiler->readbacks[i].buffer != NULL;
+    }
+    if (!ok) {
+        releaseProfiler(profiler);
+        return false;
+    }
+    return true;
+}
+
+void releaseProfiler(Profiler* profiler)
+{
+    if (profiler->querySet) {
+        wgpuQuerySetDestroy(profiler->querySet);
+        wgpuQuerySetRelease(profiler->querySet);
+    }
+    if (profiler->resolveBuffer) {
+        wgpuBufferDestroy(profiler->resolveBuffer);
+        wgpuBufferRelease(profiler->resolveBuffer);
+    }
+    for (uint32_t i = 0; i < kProfilerFramesInFlight; ++i) {
+        if (profiler->readbacks[i].buffer) {
+            wgpuBufferDestroy(profiler->readbacks[i].buffer);
+            wgpuBufferRelease(profiler->readbacks[i].buffer);
+        }
+    }
+    memset(profiler, 0, sizeof *profiler);
+}
+
+static void onReadbackMapped(WGPUBufferMapAsyncStatus status, void* pUserData)
+{
+    ProfilerReadback* readback = (ProfilerReadback*)pUserData;
+    readback->state = status == WGPUBufferMapAsyncStatus_Success ? ProfilerReadback_Mapped
+                                                                 : ProfilerReadback_Free;
+}
+
+static void onFrameWorkDone(WGPUQueueWorkDoneStatus status, void* pUserData)
+{
+    (void)status;
+    Profiler* profiler = (Profiler*)pUserData;
+    profiler->completedFrames++;
+}
+
+/** Fold one frame of timestamps into the smoothed per-pass results. */
+static void collectReadback(Profiler* profiler, ProfilerReadback* readback)
+{
+    const uint64_t* timestamps = wgpuBufferGetConstMappedRange(readback->buffer, 0, kReadbackStride);
+    if (timestamps) {
+        double total = 0.0;
+        for (uint32_t i = 0; i < readback->passCount; ++i) {
+            uint64_t begin = timestamps[2 * i];
+            uint64_t end = timestamps[2 * i + 1];
+            // Timestamps may be reset or reordered by the driver: drop those
+            double milliseconds = end > begin ? (double)(end - begin) / 1e6 : 0.0;
+            total += milliseconds;
+
+            ProfilerPass* pass = NULL;
+            for (uint32_t p = 0; p < profiler->passCount; ++p) {
+                if (profiler->passes[p].name == readback->passNames[i] ||
+                    strcmp(profiler->passes[p].name, readback->passNames[i]) == 0) {
+                    pass = &profiler->passes[p];
+                    break;
+                }
+            }
+            if (!pass && profiler->passCount < kProfilerMaxPasses) {
+                pass = &profiler->passes[profiler->passCount++];
+                pass->name = readback->passNames[i];
+                pass->milliseconds = milliseconds;
+            }
+            if (pass) {
+                pass->milliseconds += (milliseconds - pass->milliseconds) * kProfilerSmoothing;
+            }
+        }
+        profiler->gpuMilliseconds += (total - profiler->gpuMilliseconds) * kProfilerSmoothing;
+        profiler->gpuFrameMilliseconds = total;
+        profiler->gpuFrameCount++;
+    }
+    wgpuBufferUnmap(readback->buffer);
+    readback->state = ProfilerReadback_Free;
+}
+
+void profilerBeginFrame(Profiler* profiler)
+{
+    profiler->frameStart = SDL_GetPerformanceCounter();
+    profiler->framePassCount = 0;
+    profiler->currentReadback = kNotTimed;
+
+    if (!profiler->gpuTimingSupported) return;
+
+    for (uint32_t i = 0; i < kProfilerFramesInFlight; ++i) {
+        if (profiler->readbacks[i].state == ProfilerReadback_Mapped) {
+            collectReadback(profiler, &profiler->readbacks[i]);
+        }
+    }
+
+    if (!profiler->gpuTimingEnabled) return;
+
+    for (uint32_t i = 0; i < kProfilerFramesInFlight; ++i) {
+        if (profiler->readbacks[i].state == ProfilerReadback_Free) {
+            profiler->currentReadback = i;
+            profiler->readbacks[i].passCount = 0;
+            break;
+        }
+    }
+}
+
+/** Next pair of queries of this frame's slice of the query set. */
+static bool allocateQueries(Profiler* profiler, const char* name, uint32_t* first)
+{
+    if (profiler->currentReadback == kNotTimed) return false;
+    if (profiler->framePassCount == kProfilerMaxPasses) return false;
+
+    ProfilerReadback* readback = &profiler->readbacks[profiler->currentReadback];
+    readback->passNames[profiler->framePassCount] = name;
+    *first = (profiler->currentReadback * kProfilerMaxPasses + profiler->framePassCount) * 2;
+    readback->passCount = ++profiler->framePassCount;
+    return true;
+}
+
+const WGPUComputePassTimestampWrites* profilerComputePass(Profiler* profiler, const char* name)
+{
+    uint32_t first;
+    if (!allocateQueries(profiler, name, &first)) return NULL;
+
+    WGPUComputePassTimestampWrites* writes = &profiler->computeWrites[profiler->framePassCount - 1];
+    writes->querySet = profiler->querySet;
+    writes->beginningOfPassWriteIndex = first;
+    writes->endOfPassWriteIndex = first + 1;
+    return writes;
+}
+
+const WGPURenderPassTimestampWrites* profilerRenderPass(Profiler* profiler, const char* name)
+{
+    uint32_t first;
+    if (!allocateQueries(profiler, name, &first)) return NULL;
+
+    WGPURenderPassTimestampWrites* writes = &profiler->renderWrites[profiler->framePassCount - 1];
+    writes->querySet = profiler->querySet;
+    writes->beginningOfPassWriteIndex = first;
+    writes->endOfPassWriteIndex = first + 1;
+    return writes;
+}
+
+void profilerResolve(Profiler* profiler, WGPUCommandEncoder encoder)
+{
+    if (profiler->currentReadback == kNotTimed || profiler->framePassCount == 0) return;
+
+    uint32_t slot = profiler->currentReadback;
+    uint64_t offset = slot * kReadbackStride;
+    wgpuCommandEncoderResolveQuerySet(encoder, profiler->querySet, slot * kProfilerMaxPasses * 2,
+                                      profiler->framePassCount * 2, profiler->resolveBuffer, offset);
+    wgpuCommandEncoderCopyBufferToBuffer(encoder, profiler->resolveBuffer, offset,
+                                         profiler->readbacks[slot].buffer, 0,
+                                         profiler->framePassCount * 2 * sizeof(uint64_t));
+    profiler->readbacks[slot].state = ProfilerReadback_Pending;
+}
+
+void profilerEndFrame(Profiler* profiler)
+{
+    uint64_t now = SDL_GetPerformanceCounter();
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    uint32_t index = profiler->frameIndex % kProfilerHistory;
+
+    // Frame time runs from the previous frame's start; CPU time stops here
+    uint64_t frameTicks = profiler->previousFrameStart ? profiler->frameStart - profiler->previousFrameStart
+                                                       : now - profiler->frameStart;
+    profiler->frameMilliseconds[index] = (float)(frameTicks * 1000.0 / frequency);
+    profiler->previousFrameStart = profiler->frameStart;
+    profiler->cpuMilliseconds[index] = (float)((now - profiler->frameStart) * 1000.0 / frequency);
+    profiler->frameIndex++;
+
+    profiler->submittedFrames++;
+    wgpuQueueOnSubmittedWorkDone(profiler->queue, onFrameWorkDone, profiler);
+
+    if (profiler->currentReadback != kNotTimed) {
+        ProfilerReadback* readback = &profiler->readbacks[profiler->currentReadback];
+        if (readback->state == ProfilerReadback_Pending) {
+            readback->state = ProfilerReadback_Mapping;
+            wgpuBufferMapAsync(readback->buffer, WGPUMapMode_Read, 0, (size_t)kReadbackStride,
+                               onReadbackMapped, readback);
+        }
+    }
+    profiler->currentReadback = kNotTimed;
+}
+
+uint32_t profilerCounter(Profiler* profiler, const char* name, ProfilerUnit unit)
+{
+    for (uint32_t i = 0; i < profiler->counterCount; ++i) {
+        if (strcmp(profiler->counters[i].name, name) == 0) return i;
+    }
+    if (profiler->counterCount == kProfilerMaxCounters) {
+        fprintf(stderr, "profilerCounter: too many counters, '%s' is ignored\n", name);
+        return UINT32_MAX;
+    }
+    ProfilerCounter* counter = &profiler->counters[profiler->counterCount];
+    counter->name = name;
+    counter->unit = unit;
+    counter->value = 0.0;
+    return profiler->counterCount++;
+}
+
+float profilerFrameMilliseconds(const Profiler* profiler, uint32_t ago)
+{
+    if (ago >= kProfilerHistory || ago >= profiler->frameIndex) return 0.0f;
+    return profiler->frameMilliseconds[(profiler->frameIndex - 1 - ago) % kProfilerHistory];
+}
+
+uint32_t profilerQueueDepth(const Profiler* profiler)
+{
+    return profiler->submittedFrames - profiler->completedFrames;
+}
@@ -0,0 +1,147 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "global.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * PROFILER
+ *
+ * Frame-level instrumentation that the perf HUD (and anything else) reads:
+ *  - CPU frame time and CPU work time per frame, with a short history
+ *  - GPU time per pass, from timestamp queries written at the beginning
+ *    and end of every pass that asks for them
+ *  - queue depth: frames submitted whose work hasn't completed yet
+ *  - named counters that subsystems set every frame (memory, uploads,
+ *    draw counts, ...)
+ *
+ * Timestamps are resolved into one of kProfilerFramesInFlight readback
+ * buffers and read a few frames later without stalling; a frame whose
+ * readback buffer is still busy is simply not timed. GPU timing runs while
+ * anything asked for it with profilerWantGpuTiming() (the HUD, dynamic
+ * resolution, ...) and the device has TimestampQuery.
+ *
+ * Pass and counter names must outlive the profiler (string literals).
+ */
+
+#define kProfilerHistory 240
+#define kProfilerMaxPasses 32
+#define kProfilerMaxCounters 64
+#define kProfilerFramesInFlight 3
+
+typedef enum {
+    ProfilerUnit_Count,
+    ProfilerUnit_Bytes,
+    ProfilerUnit_Milliseconds,
+} ProfilerUnit;
+
+typedef struct {
+    const char* name;
+    ProfilerUnit unit;
+    double value;
+} ProfilerCounter;
+
+typedef struct {
+    const char* name;
+    double milliseconds;        // smoothed over recent frames
+} ProfilerPass;
+
+typedef enum {
+    ProfilerReadback_Free,
+    ProfilerReadback_Pending,   // copy recorded, not yet submitted/mapped
+    ProfilerReadback_Mapping,
+    ProfilerReadback_Mapped,
+} ProfilerReadbackState;
+
+typedef struct {
+    WGPUBuffer buffer;
+    ProfilerReadbackState state;
+    uint32_t passCount;
+    const char* passNames[kProfilerMaxPasses];
+} ProfilerReadback;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+
+    // CPU timing
+    uint64_t frameStart;
+    uint64_t previousFrameStart;
+    uint64_t frameIndex;
+    float frameMilliseconds[kProfilerHistory];  // ring, indexed by frameIndex
+    float cpuMilliseconds[kProfilerHistory];
+
+    // GPU timing
+    bool gpuTimingSupported;
+    bool gpuTimingEnabled;
+    uint32_t gpuTimingUsers;
+    WGPUQuerySet querySet;
+    WGPUBuffer resolveBuffer;
+    ProfilerReadback readbacks[kProfilerFramesInFlight];
+    uint32_t currentReadback;   // UINT32_MAX when this frame isn't timed
+    uint32_t framePassCount;
+    WGPUComputePassTimestampWrites computeWrites[kProfilerMaxPasses];
+    WGPURenderPassTimestampWrites renderWrites[kProfilerMaxPasses];
+    ProfilerPass passes[kProfilerMaxPasses];    // latest results, smoothed
+    uint32_t passCount;
+    double gpuMilliseconds;                     // sum over the timed passes
+    double gpuFrameMilliseconds;                // same, latest frame, not smoothed
+    uint64_t gpuFrameCount;                     // frames timed so far
+
+    // Queue depth
+    uint32_t submittedFrames;
+    uint32_t completedFrames;
+
+    ProfilerCounter counters[kProfilerMaxCounters];
+    uint32_t counterCount;
+} Profiler;
+
+bool createProfiler(Profiler* profiler, const Context* context);
+
+void releaseProfiler(Profiler* profiler);
+
+/** Ask for GPU timing (or stop asking). Calls must be balanced. */
+static inline void profilerWantGpuTiming(Profiler* profiler, bool want)
+{
+    if (want) {
+        profiler->gpuTimingUsers++;
+    } else if (profiler->gpuTimingUsers > 0) {
+        profiler->gpuTimingUsers--;
+    }
+    profiler->gpuTimingEnabled = profiler->gpuTimingUsers > 0;
+}
+
+/** Start a frame: collects finished GPU timings, starts the CPU clock. */
+void profilerBeginFrame(Profiler* profiler);
+
+/**
+ * Timestamp writes for the descriptor of a pass about to begin, or NULL
+ * when this frame isn't GPU-timed.
+ */
+const WGPUComputePassTimestampWrites* profilerComputePass(Profiler* profiler, const char* name);
+const WGPURenderPassTimestampWrites* profilerRenderPass(Profiler* profiler, const char* name);
+
+/** Record the timestamp resolve into the frame's last command encoder. */
+void profilerResolve(Profiler* profiler, WGPUCommandEncoder encoder);
+
+/** Call right after the frame's submit. */
+void profilerEndFrame(Profiler* profiler);
+
+/** Register a counter (or find it by name). Returns its id. */
+uint32_t profilerCounter(Profiler* profiler, const char* name, ProfilerUnit unit);
+
+static inline void profilerSetCounter(Profiler* profiler, uint32_t id, double value)
+{
+    if (id < profiler->counterCount) profiler->counters[id].value = value;
+}
+
+/** Frame time `ago` frames back; 0 is the last completed frame. */
+float profilerFrameMilliseconds(const Profiler* profiler, uint32_t ago);
+
+uint32_t profilerQueueDepth(const Profiler* profiler);
+
+#endif // PROFILER_H
@@ -0,0 +1,840 @@
+#include "shadows.h"
+#include "webgpu-utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define kShadowLevels 6             // 4096 down to 128
+#define kViewUniformStride 256      // minUniformBufferOffsetAlignment
+#define kCascadeSplitLambda 0.75f   // 0 = uniform splits, 1 = logarithmic
+#define kNoView UINT32_MAX
+
+/** One view as the sampling shader sees it. Must match kShadowSamplingWGSL. */
+typedef struct {
+    float viewProj[16];
+    float rect[4];              // u, v, size in uv, unused
+} GpuShadowView;
+
+typedef struct {
+    float cascadeSplits[4];
+    uint32_t cascadeCount;
+    float atlasTexel;
+    float _pad[2];
+} ShadowUniforms;
+
+static const char* kShadowUtilityWGSL =
+"@group(0) @binding(0) var cachedDepth: texture_depth_2d;\n"
+"\n"
+"// One triangle covering the viewport\n"
+"@vertex\n"
+"fn fullscreen(@builtin(vertex_index) vertex: u32) -> @builtin(position) vec4f {\n"
+"    let uv = vec2f(f32((vertex << 1u) & 2u), f32(vertex & 2u));\n"
+"    return vec4f(uv * 2.0 - 1.0, 1.0, 1.0);\n"
+"}\n"
+"\n"
+"// The viewport is the tile, and both atlases share tile positions, so the\n"
+"// fragment coordinate is the texel to copy\n"
+"@fragment\n"
+"fn restore(@builtin(position) position: vec4f) -> @builtin(frag_depth) f32 {\n"
+"    return textureLoad(cachedDepth, vec2i(position.xy), 0);\n"
+"}\n";
+
+const char* kShadowSamplingWGSL =
+"struct ShadowView {\n"
+"    viewProj: mat4x4f,\n"
+"    rect: vec4f,\n"
+"}\n"
+"struct ShadowUniforms {\n"
+"    cascadeSplits: vec4f,\n"
+"    cascadeCount: u32,\n"
+"    atlasTexel: f32,\n"
+"}\n"
+"\n"
+"@group(2) @binding(0) var<storage, read> shadowViews: array<ShadowView>;\n"
+"@group(2) @binding(1) var shadowAtlas: texture_depth_2d;\n"
+"@group(2) @binding(2) var shadowSampler: sampler_comparison;\n"
+"@group(2) @binding(3) var<uniform> shadowUniforms: ShadowUniforms;\n"
+"\n"
+"// 3x3 filtered lookup; 1 is lit. Points outside the view are lit.\n"
+"fn sampleShadowView(viewIndex: u32, worldPosition: vec3f, bias: f32) -> f32 {\n"
+"    let view = shadowViews[viewIndex];\n"
+"    let clip = view.viewProj * vec4f(worldPosition, 1.0);\n"
+"    let ndc = clip.xyz / clip.w;\n"
+"    if (any(abs(ndc.xy) > vec2f(1.0)) || ndc.z > 1.0) {\n"
+"        return 1.0;\n"
+"    }\n"
+"    let texel = shadowUniforms.atlasTexel;\n"
+"    let uv = view.rect.xy + vec2f(ndc.x * 0.5 + 0.5, 0.5 - ndc.y * 0.5) * view.rect.z;\n"
+"    // Keep the filter inside the tile\n"
+"    let lo = view.rect.xy + vec2f(texel * 1.5);\n"
+"    let hi = view.rect.xy + vec2f(view.rect.z - texel * 1.5);\n"
+"    var lit = 0.0;\n"
+"    for (var y = -1; y <= 1; y++) {\n"
+"        for (var x = -1; x <= 1; x++) {\n"
+"            let coords = clamp(uv + vec2f(f32(x), f32(y)) * texel, lo, hi);\n"
+"            lit += textureSampleCompareLevel(shadowAtlas, shadowSampler, coords, ndc.z - bias);\n"
+"        }\n"
+"    }\n"
+"    return lit / 9.0;\n"
+"}\n"
+"\n"
+"// Cascades are views 0 to cascadeCount - 1; viewDepth is positive\n"
+"fn sunShadow(worldPosition: vec3f, viewDepth: f32, bias: f32) -> f32 {\n"
+"    for (var i = 0u; i < shadowUniforms.cascadeCount; i++) {\n"
+"        if (viewDepth < shadowUniforms.cascadeSplits[i]) {\n"
+"            return sampleShadowView(i, worldPosition, bias);\n"
+"        }\n"
+"    }\n"
+"    return 1.0;\n"
+"}\n"
+"\n"
+"// Point lights own six views: +X, -X, +Y, -Y, +Z, -Z\n"
+"fn pointShadow(firstView: u32, lightPosition: vec3f, worldPosition: vec3f, bias: f32) -> f32 {\n"
+"    let d = worldPosition - lightPosition;\n"
+"    let a = abs(d);\n"
+"    var face = 0u;\n"
+"    if (a.x >= a.y && a.x >= a.z) {\n"
+"        face = select(1u, 0u, d.x > 0.0);\n"
+"    } else if (a.y >= a.z) {\n"
+"        face = select(3u, 2u, d.y > 0.0);\n"
+"    } else {\n"
+"        face = select(5u, 4u, d.z > 0.0);\n"
+"    }\n"
+"    return sampleShadowView(firstView + face, worldPosition, bias);\n"
+"}\n";
+
+/*
+ * TILE ALLOCATOR
+ *
+ * A quadtree over the atlas: level L holds tiles of kShadowAtlasSize >> L
+ * texels. Allocation splits the smallest larger free tile; freeing merges
+ * a tile back with its three siblings once they are all free.
+ */
+
+static uint32_t tileLevel(uint32_t size)
+{
+    uint32_t level = 0;
+    while (level + 1 < kShadowLevels && ((uint32_t)kShadowAtlasSize >> (level + 1)) >= size) level++;
+    return level;
+}
+
+static void pushFreeNode(ShadowSystem* shadows, uint32_t level, uint32_t x, uint32_t y)
+{
+    ShadowTileNode* node = &shadows->freeNodes[level][shadows->freeCount[level]++];
+    node->x = x;
+    node->y = y;
+}
+
+static bool takeFreeNode(ShadowSystem* shadows, uint32_t level, uint32_t x, uint32_t y)
+{
+    for (uint32_t i = 0; i < shadows->freeCount[level]; ++i) {
+        if (shadows->freeNodes[level][i].x == x && shadows->freeNodes[level][i].y == y) {
+            shadows->freeNodes[level][i] = shadows->freeNodes[level][--shadows->freeCount[level]];
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool allocateTileRect(ShadowSystem* shadows, uint32_t level, uint32_t* x, uint32_t* y)
+{
+    int32_t source = (int32_t)level;
+    while (source >= 0 && shadows->freeCount[source] == 0) source--;
+    if (source < 0) return false;
+
+    ShadowTileNode node = shadows->freeNodes[source][--shadows->freeCount[source]];
+    for (uint32_t l = (uint32_t)source; l < level; ++l) {
+        uint32_t half = kShadowAtlasSize >> (l + 1);
+        pushFreeNode(shadows, l + 1, node.x + half, node.y);
+        pushFreeNode(shadows, l + 1, node.x, node.y + half);
+        pushFreeNode(shadows, l + 1, node.x + half, node.y + half);
+    }
+    *x = node.x;
+    *y = node.y;
+    return true;
+}
+
+static void freeTileRect(ShadowSystem* shadows, uint32_t level, uint32_t x, uint32_t y)
+{
+    while (level > 0) {
+        uint32_t size = kShadowAtlasSize >> level;
+        uint32_t px = x & ~(2 * size - 1);
+        uint32_t py = y & ~(2 * size - 1);
+        uint32_t siblings[3][2] = { {0, 0}, {0, 0}, {0, 0} };
+        uint32_t found = 0;
+        for (uint32_t i = 0; i < 4; ++i) {
+            uint32_t sx = px + (i & 1) * size;
+            uint32_t sy = py + (i >> 1) * size;
+            if (sx == x && sy == y) continue;
+            bool isFree = false;
+            for (uint32_t n = 0; n < shadows->freeCount[level] && !isFree; ++n) {
+                isFree = shadows->freeNodes[level][n].x == sx && shadows->freeNodes[level][n].y == sy;
+            }
+            if (!isFree) break;
+            siblings[found][0] = sx;
+            siblings[found][1] = sy;
+            found++;
+        }
+        if (found < 3) break;
+        for (uint32_t i = 0; i < 3; ++i) takeFreeNode(shadows, level, siblings[i][0], siblings[i][1]);
+        x = px;
+        y = py;
+        level--;
+    }
+    pushFreeNode(shadows, level, x, y);
+}
+
+/** A tile of at least `size` texels, or kNoView when the atlas is full. */
+static uint32_t allocateTile(ShadowSystem* shadows, uint32_t size)
+{
+    uint32_t index = 0;
+    while (index < kShadowMaxViews && shadows->tileUsed[index]) index++;
+    if (index == kShadowMaxViews) return kNoView;
+
+    uint32_t level = tileLevel(size);
+    ShadowTile* tile = &shadows->tiles[index];
+    if (!allocateTileRect(shadows, level, &tile->x, &tile->y)) return kNoView;
+    tile->size = kShadowAtlasSize >> level;
+    tile->cacheValid = false;
+    tile->hadDynamic = false;
+    shadows->tileUsed[index] = true;
+    return index;
+}
+
+static void freeTile(ShadowSystem* shadows, uint32_t index)
+{
+    ShadowTile* tile = &shadows->tiles[index];
+    freeTileRect(shadows, tileLevel(tile->size), tile->x, tile->y);
+    shadows->tileUsed[index] = false;
+}
+
+/*
+ * GPU SETUP
+ */
+
+static WGPUTexture createDepthAtlas(WGPUDevice device, const char* label, WGPUTextureView* view)
+{
+    WGPUTextureDescriptor desc = {0};
+    desc.label = label;
+    desc.usage = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_TextureBinding;
+    desc.dimension = WGPUTextureDimension_2D;
+    desc.size.width = kShadowAtlasSize;
+    desc.size.height = kShadowAtlasSize;
+    desc.size.depthOrArrayLayers = 1;
+    desc.format = kShadowDepthFormat;
+    desc.mipLevelCount = 1;
+    desc.sampleCount = 1;
+    WGPUTexture texture = wgpuDeviceCreateTexture(device, &desc);
+    *view = texture ? wgpuTextureCreateView(texture, NULL) : NULL;
+    return texture;
+}
+
+/** Depth-only full-tile pipeline: clears (no fragment) or copies from the cache. */
+static WGPURenderPipeline createTilePipeline(WGPUDevice device, WGPUShaderModule module, bool restore)
+{
+    WGPUDepthStencilState depthStencil = {0};
+    depthStencil.format = kShadowDepthFormat;
+    depthStencil.depthWriteEnabled = true;
+    depthStencil.depthCompare = WGPUCompareFunction_Always;
+    depthStencil.stencilFront.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilBack.compare = WGPUCompareFunction_Always;
+
+    WGPUFragmentState fragment = {0};
+    fragment.module = module;
+    fragment.entryPoint = "restore";
+    fragment.targetCount = 0;
+
+    WGPURenderPipelineDescriptor desc = {0};
+    desc.label = restore ? "Shadow restore pipeline" : "Shadow clear pipeline";
+    desc.layout = NULL; // auto layout
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "fullscreen";
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
+    desc.primitive.frontFace = WGPUFrontFace_CCW;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.depthStencil = &depthStencil;
+    desc.multisample.count = 1;
+    desc.multisample.mask = ~0u;
+    desc.fragment = restore ? &fragment : NULL;
+
+    WGPURenderPipeline pipeline = wgpuDeviceCreateRenderPipeline(device, &desc);
+    if (!pipeline) {
+        fprintf(stderr, "Failed to create %s\n", desc.label);
+    }
+    return pipeline;
+}
+
+static bool createViewBindings(ShadowSystem* shadows)
+{
+    WGPUBindGroupLayoutEntry layoutEntry = {0};
+    layoutEntry.binding = 0;
+    layoutEntry.visibility = WGPUShaderStage_Vertex;
+    layoutEntry.buffer.type = WGPUBufferBindingType_Uniform;
+    layoutEntry.buffer.hasDynamicOffset = true;
+    layoutEntry.buffer.minBindingSize = sizeof(Mat4);
+
+    WGPUBindGroupLayoutDescriptor layoutDesc = {0};
+    layoutDesc.label = "Shadow view layout";
+    layoutDesc.entryCount = 1;
+    layoutDesc.entries = &layoutEntry;
+    shadows->viewLayout = wgpuDeviceCreateBindGroupLayout(shadows->device, &layoutDesc);
+
+    shadows->viewUniformBuffer = createBuffer(shadows->device, "Shadow view uniforms",
+                                              kShadowMaxViews * kViewUniformStride,
+                                              WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    if (!shadows->viewLayout || !shadows->viewUniformBuffer) return false;
+
+    WGPUBindGroupEntry entry = {0};
+    entry.binding = 0;
+    entry.buffer = shadows->viewUniformBuffer;
+    entry.offset = 0;
+    entry.size = sizeof(Mat4);
+
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = "Shadow view bind group";
+    desc.layout = shadows->viewLayout;
+    desc.entryCount = 1;
+    desc.entries = &entry;
+    shadows->viewBindGroup = wgpuDeviceCreateBindGroup(shadows->device, &desc);
+    return shadows->viewBindGroup != NULL;
+}
+
+static bool createSamplingBindings(ShadowSystem* shadows)
+{
+    shadows->samplingViewBuffer = createBuffer(shadows->device, "Shadow views",
+                                               kShadowMaxViews * sizeof(GpuShadowView),
+                                               WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst);
+    shadows->samplingUniformBuffer = createBuffer(shadows->device, "Shadow uniforms", sizeof(ShadowUniforms),
+                                                  WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+
+    WGPUSamplerDescriptor samplerDesc = {0};
+    samplerDesc.label = "Shadow sampler";
+    samplerDesc.addressModeU = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeV = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeW = WGPUAddressMode_ClampToEdge;
+    samplerDesc.magFilter = WGPUFilterMode_Linear;
+    samplerDesc.minFilter = WGPUFilterMode_Linear;
+    samplerDesc.mipmapFilter = WGPUMipmapFilterMode_Nearest;
+    samplerDesc.lodMinClamp = 0.0f;
+    samplerDesc.lodMaxClamp = 1.0f;
+    samplerDesc.compare = WGPUCompareFunction_LessEqual;
+    samplerDesc.maxAnisotropy = 1;
+    shadows->comparisonSampler = wgpuDeviceCreateSampler(shadows->device, &samplerDesc);
+
+    WGPUBindGroupLayoutEntry layoutEntries[4] = {0};
+    for (uint32_t i = 0; i < 4; ++i) {
+        layoutEntries[i].binding = i;
+        layoutEntries[i].visibility = WGPUShaderStage_Fragment;
+    }
+    layoutEntries[0].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+    layoutEntries[1].texture.sampleType = WGPUTextureSampleType_Depth;
+    layoutEntries[1].texture.viewDimension = WGPUTextureViewDimension_2D;
+    layoutEntries[2].sampler.type = WGPUSamplerBindingType_Comparison;
+    layoutEntries[3].buffer.type = WGPUBufferBindingType_Uniform;
+
+    WGPUBindGroupLayoutDescriptor layoutDesc = {0};
+    layoutDesc.label = "Shadow sampling layout";
+    layoutDesc.entryCount = 4;
+    layoutDesc.entries = layoutEntries;
+    shadows->samplingLayout = wgpuDeviceCreateBindGroupLayout(shadows->device, &layoutDesc);
+
+    if (!shadows->samplingViewBuffer || !shadows->samplingUniformBuffer ||
+        !shadows->comparisonSampler || !shadows->samplingLayout) {
+        return false;
+    }
+
+    WGPUBindGroupEntry entries[4] = {0};
+    entries[0].binding = 0;
+    entries[0].buffer = shadows->samplingViewBuffer;
+    entries[0].size = wgpuBufferGetSize(shadows->samplingViewBuffer);
+    entries[1].binding = 1;
+    entries[1].textureView = shadows->atlasView;
+    entries[2].binding = 2;
+    entries[2].sampler = shadows->comparisonSampler;
+    entries[3].binding = 3;
+    entries[3].buffer = shadows->samplingUniformBuffer;
+    entries[3].size = sizeof(ShadowUniforms);
+
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = "Shadow sampling bind group";
+    desc.layout = shadows->samplingLayout;
+    desc.entryCount = 4;
+    desc.entries = entries;
+    shadows->samplingBindGroup = wgpuDeviceCreateBindGroup(shadows->device, &desc);
+    return shadows->samplingBindGroup != NULL;
+}
+
+bool createShadowSystem(ShadowSystem* shadows, WGPUDevice device, WGPUQueue queue)
+{
+    memset(shadows, 0, sizeof *shadows);
+    shadows->device = device;
+    shadows->queue = queue;
+
+    for (uint32_t level = 0; level < kShadowLevels; ++level) {
+        shadows->freeNodes[level] = malloc(((size_t)1 << (2 * level)) * sizeof(ShadowTileNode));
+        if (!shadows->freeNodes[level]) {
+            fprintf(stderr, "createShadowSystem: out of memory\n");
+            releaseShadowSystem(shadows);
+            return false;
+        }
+    }
+    pushFreeNode(shadows, 0, 0, 0);
+
+    // Cascades keep tiles 0 to kShadowCascadeCount - 1 for good
+    for (uint32_t i = 0; i < kShadowCascadeCount; ++i) allocateTile(shadows, kShadowCascadeSize);
+    for (uint32_t i = 0; i < kShadowMaxLights; ++i) shadows->lights[i].firstView = kNoView;
+
+    shadows->atlas = createDepthAtlas(device, "Shadow atlas", &shadows->atlasView);
+    shadows->cache = createDepthAtlas(device, "Shadow cache", &shadows->cacheView);
+    if (!shadows->atlasView || !shadows->cacheView ||
+        !createViewBindings(shadows) || !createSamplingBindings(shadows)) {
+        releaseShadowSystem(shadows);
+        return false;
+    }
+
+    WGPUShaderModule module = createShaderModule(device, "Shadow tile shader", kShadowUtilityWGSL);
+    if (!module) {
+        releaseShadowSystem(shadows);
+        return false;
+    }
+    shadows->clearPipeline = createTilePipeline(device, module, false);
+    shadows->restorePipeline = createTilePipeline(device, module, true);
+    wgpuShaderModuleRelease(module);
+    if (!shadows->clearPipeline || !shadows->restorePipeline) {
+        releaseShadowSystem(shadows);
+        return false;
+    }
+
+    WGPUBindGroupEntry entry = {0};
+    entry.binding = 0;
+    entry.textureView = shadows->cacheView;
+    WGPUBindGroupLayout layout = wgpuRenderPipelineGetBindGroupLayout(shadows->restorePipeline, 0);
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = "Shadow restore bind group";
+    desc.layout = layout;
+    desc.entryCount = 1;
+    desc.entries = &entry;
+    shadows->restoreBindGroup = wgpuDeviceCreateBindGroup(device, &desc);
+    wgpuBindGroupLayoutRelease(layout);
+
+    if (!shadows->restoreBindGroup) {
+        releaseShadowSystem(shadows);
+        return false;
+    }
+    return true;
+}
+
+void releaseShadowSystem(ShadowSystem* shadows)
+{
+    if (shadows->samplingBindGroup) wgpuBindGroupRelease(shadows->samplingBindGroup);
+    if (shadows->samplingLayout) wgpuBindGroupLayoutRelease(shadows->samplingLayout);
+    if (shadows->comparisonSampler) wgpuSamplerRelease(shadows->comparisonSampler);
+    if (shadows->restoreBindGroup) wgpuBindGroupRelease(shadows->restoreBindGroup);
+    if (shadows->viewBindGroup) wgpuBindGroupRelease(shadows->viewBindGroup);
+    if (shadows->viewLayout) wgpuBindGroupLayoutRelease(shadows->viewLayout);
+    if (shadows->clearPipeline) wgpuRenderPipelineRelease(shadows->clearPipeline);
+    if (shadows->restorePipeline) wgpuRenderPipelineRelease(shadows->restorePipeline);
+
+    WGPUBuffer buffers[] = {
+        shadows->viewUniformBuffer, shadows->samplingViewBuffer, shadows->samplingUniformBuffer,
+    };
+    for (size_t i = 0; i < sizeof buffers / sizeof buffers[0]; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    if (shadows->atlasView) wgpuTextureViewRelease(shadows->atlasView);
+    if (shadows->cacheView) wgpuTextureViewRelease(shadows->cacheView);
+    WGPUTexture textures[] = { shadows->atlas, shadows->cache };
+    for (size_t i = 0; i < sizeof textures / sizeof textures[0]; ++i) {
+        if (textures[i]) {
+            wgpuTextureDestroy(textures[i]);
+            wgpuTextureRelease(textures[i]);
+        }
+    }
+
+    for (uint32_t level = 0; level < kShadowLevels; ++level) free(shadows->freeNodes[level]);
+    free(shadows->casterLists);
+    memset(shadows, 0, sizeof *shadows);
+}
+
+/*
+ * VIEW SETUP
+ */
+
+/** Any vector not parallel to `direction`, to build a look-at basis. */
+static Vec3 upFor(Vec3 direction)
+{
+    return fabsf(direction.y) < 0.99f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+}
+
+/**
+ * Practical split scheme: a blend of uniform and logarithmic splits, so
+ * near cascades get resolution without the far ones becoming huge.
+ */
+static void computeCascadeSplits(float zNear, float zFar, float splits[kShadowCascadeCount])
+{
+    for (uint32_t i = 1; i <= kShadowCascadeCount; ++i) {
+        float t = (float)i / kShadowCascadeCount;
+        float uniform = zNear + (zFar - zNear) * t;
+        float logarithmic = zNear * powf(zFar / zNear, t);
+        splits[i - 1] = uniform + (logarithmic - uniform) * kCascadeSplitLambda;
+    }
+}
+
+/**
+ * Light view-projection for one cascade. The slice of the camera frustum
+ * is enclosed in a sphere, which doesn't change as the camera turns, and
+ * the projection is snapped to whole texels so that moving the camera
+ * doesn't make the shadow edges crawl.
+ */
+static Mat4 cascadeViewProj(const ShadowFrame* frame, float sliceNear, float sliceFar)
+{
+    float tanY = tanf(frame->fovY * 0.5f);
+    float tanX = tanY * frame->aspect;
+    Mat4 cameraToWorld = mat4Inverse(frame->cameraView);
+
+    Vec3 corners[8];
+    Vec3 center = vec3(0.0f, 0.0f, 0.0f);
+    for (int i = 0; i < 8; ++i) {
+        float depth = i & 4 ? sliceFar : sliceNear;
+        corners[i] = vec3((i & 1 ? 1.0f : -1.0f) * tanX * depth, (i & 2 ? 1.0f : -1.0f) * tanY * depth, -depth);
+        center = vec3Add(center, vec3Scale(corners[i], 1.0f / 8.0f));
+    }
+    float radius = 0.0f;
+    for (int i = 0; i < 8; ++i) {
+        float d = vec3Length(vec3Sub(corners[i], center));
+        if (d > radius) radius = d;
+    }
+    radius = ceilf(radius * 16.0f) / 16.0f;
+    center = mat4TransformPoint(cameraToWorld, center);
+
+    // Back far enough to see every caster of the scene in front of the slice
+    Vec3 direction = vec3Normalize(frame->sunDirection);
+    float behind = vec3Dot(vec3Sub(center, frame->sceneCenter), direction) + frame->sceneRadius;
+    if (behind < radius) behind = radius;
+    Vec3 eye = vec3Sub(center, vec3Scale(direction, behind));
+
+    Mat4 view = mat4LookAt(eye, center, upFor(direction));
+    Mat4 projection = mat4Ortho(-radius, radius, -radius, radius, 0.0f, behind + radius);
+    Mat4 viewProj = mat4Mul(projection, view);
+
+    // Snap the world origin to a texel: the whole grid then moves in whole texels
+    float halfSize = kShadowCascadeSize * 0.5f;
+    float ox = viewProj.m[12] * halfSize;
+    float oy = viewProj.m[13] * halfSize;
+    viewProj.m[12] += (roundf(ox) - ox) / halfSize;
+    viewProj.m[13] += (roundf(oy) - oy) / halfSize;
+    return viewProj;
+}
+
+static Mat4 spotViewProj(const ShadowLight* light)
+{
+    Vec3 direction = vec3Normalize(light->direction);
+    float cosAngle = light->spotOuterCos > 0.05f ? light->spotOuterCos : 0.05f;
+    float fovY = 2.0f * acosf(cosAngle) * 1.05f;
+    float zNear = light->range * 0.01f > 0.05f ? light->range * 0.01f : 0.05f;
+    Mat4 view = mat4LookAt(light->position, vec3Add(light->position, direction), upFor(direction));
+    return mat4Mul(mat4Perspective(fovY, 1.0f, zNear, light->range), view);
+}
+
+static Mat4 pointFaceViewProj(const ShadowLight* light, uint32_t face)
+{
+    static const float kFaces[6][3] = {
+        { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+    };
+    Vec3 direction = vec3FromArray(kFaces[face]);
+    float zNear = light->range * 0.01f > 0.05f ? light->range * 0.01f : 0.05f;
+    Mat4 view = mat4LookAt(light->position, vec3Add(light->position, direction), upFor(direction));
+    return mat4Mul(mat4Perspective(3.14159265f * 0.5f, 1.0f, zNear, light->range), view);
+}
+
+static uint32_t nextPowerOfTwo(uint32_t value)
+{
+    uint32_t result = kShadowMinTileSize;
+    while (result < value && result < kShadowAtlasSize) result <<= 1;
+    return result;
+}
+
+static uint32_t faceCount(LightType type)
+{
+    return type == LightType_Point ? 6 : 1;
+}
+
+static void releaseLightSlot(ShadowSystem* shadows, ShadowLightSlot* slot)
+{
+    for (uint32_t face = 0; face < faceCount(slot->type); ++face) {
+        if (slot->tiles[face] != kNoView) freeTile(shadows, slot->tiles[face]);
+    }
+    slot->id = 0;
+    slot->firstView = kNoView;
+}
+
+/** The light's slot with its tiles, allocating them on first sight. */
+static ShadowLightSlot* acquireLightSlot(ShadowSystem* shadows, const ShadowLight* light)
+{
+    uint32_t resolution = nextPowerOfTwo(light->resolution);
+    ShadowLightSlot* freeSlot = NULL;
+    for (uint32_t i = 0; i < kShadowMaxLights; ++i) {
+        ShadowLightSlot* slot = &shadows->lights[i];
+        if (slot->id == light->id) {
+            if (slot->type == light->type && slot->resolution == resolution) return slot;
+            releaseLightSlot(shadows, slot);
+            freeSlot = slot;
+            break;
+        }
+        if (slot->id == 0 && !freeSlot) freeSlot = slot;
+    }
+    if (!freeSlot) return NULL;
+
+    freeSlot->id = light->id;
+    freeSlot->type = light->type;
+    freeSlot->resolution = resolution;
+    for (uint32_t face = 0; face < 6; ++face) freeSlot->tiles[face] = kNoView;
+    for (uint32_t face = 0; face < faceCount(light->type); ++face) {
+        freeSlot->tiles[face] = allocateTile(shadows, resolution);
+        if (freeSlot->tiles[face] == kNoView) {
+            fprintf(stderr, "shadowsUpdate: shadow atlas full, light %u has no shadows\n", light->id);
+            releaseLightSlot(shadows, freeSlot);
+            return NULL;
+        }
+    }
+    return freeSlot;
+}
+
+static bool reserveCasterLists(ShadowSystem* shadows, uint32_t count)
+{
+    if (count <= shadows->casterListCapacity) return true;
+    uint32_t capacity = shadows->casterListCapacity ? shadows->casterListCapacity : 1024;
+    while (capacity < count) capacity *= 2;
+    uint32_t* lists = realloc(shadows->casterLists, (size_t)capacity * sizeof *lists);
+    if (!lists) {
+        fprintf(stderr, "shadowsUpdate: out of memory\n");
+        return false;
+    }
+    shadows->casterLists = lists;
+    shadows->casterListCapacity = capacity;
+    return true;
+}
+
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Cull the casters for one view into the shared lists and decide what has
+ * to be redrawn, from the cache key of the light and its static casters.
+ */
+static void addView(ShadowSystem* shadows, const ShadowFrame* frame, Mat4 viewProj, uint32_t tileIndex,
+                    uint32_t* listCount)
+{
+    ShadowView* view = &shadows->views[shadows->viewCount++];
+    ShadowTile* tile = &shadows->tiles[tileIndex];
+    view->viewProj = viewProj;
+    view->tile = tileIndex;
+
+    float planes[6][4];
+    mat4FrustumPlanes(viewProj, planes);
+
+    // Static casters first, then dynamic ones
+    for (int pass = 0; pass < 2; ++pass) {
+        bool wantStatic = pass == 0;
+        uint32_t first = *listCount;
+        for (uint32_t i = 0; i < frame->casterCount; ++i) {
+            const ShadowCaster* caster = &frame->casters[i];
+            if (caster->isStatic != wantStatic) continue;
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; ++p) {
+                inside = planes[p][0] * caster->center[0] + planes[p][1] * caster->center[1] +
+                         planes[p][2] * caster->center[2] + planes[p][3] >= -caster->radius;
+            }
+            if (inside) shadows->casterLists[(*listCount)++] = i;
+        }
+        if (wantStatic) {
+            view->staticFirst = first;
+            view->staticCount = *listCount - first;
+        } else {
+            view->dynamicFirst = first;
+            view->dynamicCount = *listCount - first;
+        }
+    }
+
+    uint64_t key = 14695981039346656037ull;
+    key = hashBytes(key, viewProj.m, sizeof viewProj.m);
+    for (uint32_t i = 0; i < view->staticCount; ++i) {
+        uint32_t index = shadows->casterLists[view->staticFirst + i];
+        key = hashBytes(key, &index, sizeof index);
+        key = hashBytes(key, &frame->casters[index].version, sizeof frame->casters[index].version);
+    }
+
+    view->redrawCache = !tile->cacheValid || tile->cacheKey != key;
+    view->redrawAtlas = view->redrawCache || view->dynamicCount > 0 || tile->hadDynamic;
+    tile->cacheKey = key;
+    tile->cacheValid = true;
+    tile->hadDynamic = view->dynamicCount > 0;
+}
+
+void shadowsUpdate(ShadowSystem* shadows, const ShadowFrame* frame)
+{
+    shadows->viewCount = 0;
+    shadows->cacheRedraws = 0;
+    shadows->atlasRedraws = 0;
+
+    // Lights that went away give their tiles back before new ones ask
+    for (uint32_t i = 0; i < kShadowMaxLights; ++i) {
+        ShadowLightSlot* slot = &shadows->lights[i];
+        if (slot->id == 0) continue;
+        bool present = false;
+        for (uint32_t l = 0; l < frame->lightCount && !present; ++l) {
+            present = frame->lights[l].id == slot->id;
+        }
+        if (!present) releaseLightSlot(shadows, slot);
+        slot->firstView = kNoView;
+    }
+
+    // Worst case every caster lands in every view
+    uint32_t maxViews = kShadowCascadeCount + 6 * frame->lightCount;
+    if (maxViews > kShadowMaxViews) maxViews = kShadowMaxViews;
+    if (!reserveCasterLists(shadows, maxViews * frame->casterCount)) return;
+    uint32_t listCount = 0;
+
+    ShadowUniforms uniforms = {0};
+    uniforms.atlasTexel = 1.0f / kShadowAtlasSize;
+    if (frame->sunEnabled) {
+        computeCascadeSplits(frame->zNear, frame->shadowDistance, shadows->cascadeSplits);
+        float sliceNear = frame->zNear;
+        for (uint32_t i = 0; i < kShadowCascadeCount; ++i) {
+            addView(shadows, frame, cascadeViewProj(frame, sliceNear, shadows->cascadeSplits[i]), i, &listCount);
+            uniforms.cascadeSplits[i] = shadows->cascadeSplits[i];
+            sliceNear = shadows->cascadeSplits[i];
+        }
+        uniforms.cascadeCount = kShadowCascadeCount;
+    }
+
+    for (uint32_t l = 0; l < frame->lightCount; ++l) {
+        const ShadowLight* light = &frame->lights[l];
+        if (shadows->viewCount + faceCount(light->type) > kShadowMaxViews) break;
+        ShadowLightSlot* slot = acquireLightSlot(shadows, light);
+        if (!slot) continue;
+
+        slot->firstView = shadows->viewCount;
+        for (uint32_t face = 0; face < faceCount(light->type); ++face) {
+            Mat4 viewProj = light->type == LightType_Point ? pointFaceViewProj(light, face)
+                                                           : spotViewProj(light);
+            addView(shadows, frame, viewProj, slot->tiles[face], &listCount);
+        }
+    }
+
+    uint8_t viewUniforms[kShadowMaxViews * kViewUniformStride];
+    GpuShadowView gpuViews[kShadowMaxViews];
+    for (uint32_t i = 0; i < shadows->viewCount; ++i) {
+        const ShadowView* view = &shadows->views[i];
+        const ShadowTile* tile = &shadows->tiles[view->tile];
+        memcpy(viewUniforms + i * kViewUniformStride, view->viewProj.m, sizeof view->viewProj.m);
+        memcpy(gpuViews[i].viewProj, view->viewProj.m, sizeof view->viewProj.m);
+        gpuViews[i].rect[0] = (float)tile->x / kShadowAtlasSize;
+        gpuViews[i].rect[1] = (float)tile->y / kShadowAtlasSize;
+        gpuViews[i].rect[2] = (float)tile->size / kShadowAtlasSize;
+        gpuViews[i].rect[3] = 0.0f;
+        shadows->cacheRedraws += view->redrawCache;
+        shadows->atlasRedraws += view->redrawAtlas;
+    }
+    if (shadows->viewCount > 0) {
+        wgpuQueueWriteBuffer(shadows->queue, shadows->viewUniformBuffer, 0, viewUniforms,
+                             (size_t)shadows->viewCount * kViewUniformStride);
+        wgpuQueueWriteBuffer(shadows->queue, shadows->samplingViewBuffer, 0, gpuViews,
+                             (size_t)shadows->viewCount * sizeof(GpuShadowView));
+    }
+    wgpuQueueWriteBuffer(shadows->queue, shadows->samplingUniformBuffer, 0, &uniforms, sizeof uniforms);
+}
+
+static WGPURenderPassEncoder beginDepthPass(WGPUCommandEncoder encoder, WGPUTextureView target, const char* label)
+{
+    // Load: tiles that aren't redrawn keep last frame's content
+    WGPURenderPassDepthStencilAttachment depth = {0};
+    depth.view = target;
+    depth.depthLoadOp = WGPULoadOp_Load;
+    depth.depthStoreOp = WGPUStoreOp_Store;
+    depth.depthReadOnly = false;
+    depth.stencilLoadOp = WGPULoadOp_Undefined;
+    depth.stencilStoreOp = WGPUStoreOp_Undefined;
+    depth.stencilReadOnly = true;
+
+    WGPURenderPassDescriptor desc = {0};
+    desc.label = label;
+    desc.colorAttachmentCount = 0;
+    desc.depthStencilAttachment = &depth;
+    return wgpuCommandEncoderBeginRenderPass(encoder, &desc);
+}
+
+static void setTileViewport(WGPURenderPassEncoder pass, const ShadowTile* tile)
+{
+    wgpuRenderPassEncoderSetViewport(pass, (float)tile->x, (float)tile->y, (float)tile->size,
+                                     (float)tile->size, 0.0f, 1.0f);
+    wgpuRenderPassEncoderSetScissorRect(pass, tile->x, tile->y, tile->size, tile->size);
+}
+
+void shadowsRender(ShadowSystem* shadows,
+                   WGPUCommandEncoder encoder,
+                   ShadowDrawFunction draw,
+                   void* userData)
+{
+    if (shadows->cacheRedraws > 0) {
+        WGPURenderPassEncoder pass = beginDepthPass(encoder, shadows->cacheView, "Shadow cache pass");
+        for (uint32_t i = 0; i < shadows->viewCount; ++i) {
+            const ShadowView* view = &shadows->views[i];
+            if (!view->redrawCache) continue;
+
+            setTileViewport(pass, &shadows->tiles[view->tile]);
+            wgpuRenderPassEncoderSetPipeline(pass, shadows->clearPipeline);
+            wgpuRenderPassEncoderDraw(pass, 3, 1, 0, 0);
+            if (view->staticCount > 0) {
+                uint32_t offset = i * kViewUniformStride;
+                wgpuRenderPassEncoderSetBindGroup(pass, 0, shadows->viewBindGroup, 1, &offset);
+                draw(userData, pass, shadows->casterLists + view->staticFirst, view->staticCount);
+            }
+        }
+        wgpuRenderPassEncoderEnd(pass);
+        wgpuRenderPassEncoderRelease(pass);
+    }
+
+    if (shadows->atlasRedraws > 0) {
+        WGPURenderPassEncoder pass = beginDepthPass(encoder, shadows->atlasView, "Shadow atlas pass");
+        for (uint32_t i = 0; i < shadows->viewCount; ++i) {
+            const ShadowView* view = &shadows->views[i];
+            if (!view->redrawAtlas) continue;
+
+            setTileViewport(pass, &shadows->tiles[view->tile]);
+            wgpuRenderPassEncoderSetPipeline(pass, shadows->restorePipeline);
+            wgpuRenderPassEncoderSetBindGroup(pass, 0, shadows->restoreBindGroup, 0, NULL);
+            wgpuRenderPassEncoderDraw(pass, 3, 1, 0, 0);
+            if (view->dynamicCount > 0) {
+                uint32_t offset = i * kViewUniformStride;
+                wgpuRenderPassEncoderSetBindGroup(pass, 0, shadows->viewBindGroup, 1, &offset);
+                draw(userData, pass, shadows->casterLists + view->dynamicFirst, view->dynamicCount);
+            }
+        }
+        wgpuRenderPassEncoderEnd(pass);
+        wgpuRenderPassEncoderRelease(pass);
+    }
+}
+
+int32_t shadowsLightView(const ShadowSystem* shadows, uint32_t lightId)
+{
+    for (uint32_t i = 0; i < kShadowMaxLights; ++i) {
+        if (shadows->lights[i].id == lightId && shadows->lights[i].firstView != kNoView) {
+            return (int32_t)shadows->lights[i].firstView;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,187 @@
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include "lighting.h"
+#include "linalg.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * SHADOWS
+ *
+ * Every shadow map lives in one depth atlas:
+ *  - the sun gets kShadowCascadeCount cascades that split the camera's
+ *    shadow distance, each a fixed tile fitted around its slice of the view
+ *    frustum and snapped to whole texels so it doesn't shimmer
+ *  - spot lights get one tile and point lights six (a cube's faces), from
+ *    a quadtree allocator, at the resolution each light asks for
+ *
+ * Each tile (a "view") gets its own caster list, culled on the CPU against
+ * its frustum, and is only redrawn when something it shows changes. Static
+ * casters are drawn into a second atlas that works as a cache: a tile there
+ * is redrawn only when its light moves or one of its static casters moves
+ * (its `version` changes). The main atlas tile is then rebuilt from the
+ * cache with one full-tile copy draw, plus the dynamic casters, and only
+ * when there are dynamic casters or the cached tile changed.
+ *
+ * Per frame:
+ *      shadowsUpdate(&shadows, &frame);                // CPU: tiles, culling, caching
+ *      shadowsRender(&shadows, encoder, drawCasters, userData);
+ *      ... lighting samples the atlas through `samplingBindGroup` ...
+ *
+ * Caster pipelines depth-only render kShadowDepthFormat and put
+ * `viewLayout` at group 0: a uniform `mat4x4f` view-projection, already
+ * bound with the right offset when the draw callback runs.
+ */
+
+#define kShadowAtlasSize 4096
+#define kShadowMinTileSize 128
+#define kShadowCascadeCount 4
+#define kShadowCascadeSize 1024
+#define kShadowMaxViews 64
+#define kShadowMaxLights 32
+#define kShadowDepthFormat WGPUTextureFormat_Depth32Float
+
+/** Bind group index that kShadowSamplingWGSL declares its bindings in. */
+#define kShadowBindGroup 2
+
+/** Something that casts shadows, as seen by the CPU culling. */
+typedef struct {
+    float center[3];
+    float radius;               // bounding sphere, world space
+    uint32_t version;           // bump whenever the caster moves or changes
+    bool isStatic;              // static casters are drawn into the cache
+} ShadowCaster;
+
+typedef struct {
+    uint32_t id;                // stable across frames, never 0
+    LightType type;
+    Vec3 position;
+    Vec3 direction;             // spot lights
+    float range;
+    float spotOuterCos;
+    uint32_t resolution;        // tile size, rounded up to a power of two
+} ShadowLight;
+
+/** Everything shadowsUpdate() needs for a frame. */
+typedef struct {
+    Mat4 cameraView;
+    float fovY, aspect, zNear;
+    float shadowDistance;       // cascades cover [zNear, shadowDistance]
+
+    bool sunEnabled;
+    Vec3 sunDirection;          // direction the light travels
+    Vec3 sceneCenter;           // bounds of everything that may cast
+    float sceneRadius;
+
+    const ShadowLight* lights;  // local lights with shadows
+    uint32_t lightCount;
+
+    const ShadowCaster* casters;
+    uint32_t casterCount;
+} ShadowFrame;
+
+/** Draw `count` casters (indices into ShadowFrame.casters) into the bound view. */
+typedef void (*ShadowDrawFunction)(void* userData,
+                                   WGPURenderPassEncoder pass,
+                                   const uint32_t* casters,
+                                   uint32_t count);
+
+typedef struct {
+    uint32_t x, y, size;        // texels in the atlas
+    uint64_t cacheKey;          // light + static casters last drawn in the cache
+    bool cacheValid;
+    bool hadDynamic;            // main atlas tile holds dynamic casters
+} ShadowTile;
+
+typedef struct {
+    Mat4 viewProj;
+    uint32_t tile;
+    uint32_t staticFirst, staticCount;      // into ShadowSystem.casterLists
+    uint32_t dynamicFirst, dynamicCount;
+    bool redrawCache;
+    bool redrawAtlas;
+} ShadowView;
+
+typedef struct {
+    uint32_t id;
+    LightType type;
+    uint32_t resolution;
+    uint32_t tiles[6];
+    uint32_t firstView;         // this frame's view of face 0, or UINT32_MAX
+    bool used;
+} ShadowLightSlot;
+
+typedef struct {
+    uint32_t x, y;
+} ShadowTileNode;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+
+    WGPUTexture atlas;
+    WGPUTextureView atlasView;
+    WGPUTexture cache;          // static casters only
+    WGPUTextureView cacheView;
+
+    WGPUBindGroupLayout viewLayout;
+    WGPUBuffer viewUniformBuffer;   // one 256-byte slot per view
+    WGPUBindGroup viewBindGroup;
+
+    WGPURenderPipeline clearPipeline;
+    WGPURenderPipeline restorePipeline;
+    WGPUBindGroup restoreBindGroup;
+
+    // Tile allocator: free nodes per level, level 0 = the whole atlas
+    ShadowTileNode* freeNodes[8];
+    uint32_t freeCount[8];
+
+    ShadowTile tiles[kShadowMaxViews];
+    bool tileUsed[kShadowMaxViews];
+    ShadowLightSlot lights[kShadowMaxLights];
+
+    ShadowView views[kShadowMaxViews];
+    uint32_t viewCount;
+    uint32_t* casterLists;
+    uint32_t casterListCapacity;
+    float cascadeSplits[kShadowCascadeCount];
+
+    // What lighting shaders bind at kShadowBindGroup
+    WGPUBuffer samplingViewBuffer;
+    WGPUBuffer samplingUniformBuffer;
+    WGPUSampler comparisonSampler;
+    WGPUBindGroupLayout samplingLayout;
+    WGPUBindGroup samplingBindGroup;
+
+    // Stats for the last frame
+    uint32_t cacheRedraws;
+    uint32_t atlasRedraws;
+} ShadowSystem;
+
+/** WGSL for lighting shaders: cascade selection and filtered lookups. */
+extern const char* kShadowSamplingWGSL;
+
+bool createShadowSystem(ShadowSystem* shadows, WGPUDevice device, WGPUQueue queue);
+
+void releaseShadowSystem(ShadowSystem* shadows);
+
+/**
+ * Place this frame's views, cull casters for each, and work out which
+ * tiles need drawing. Lights missing from `frame` lose their tiles.
+ */
+void shadowsUpdate(ShadowSystem* shadows, const ShadowFrame* frame);
+
+/** Record the cache and atlas passes for the tiles that changed. */
+void shadowsRender(ShadowSystem* shadows,
+                   WGPUCommandEncoder encoder,
+                   ShadowDrawFunction draw,
+                   void* userData);
+
+/** Index of a light's first view (its only one for spot lights), or -1. */
+int32_t shadowsLightView(const ShadowSystem* shadows, uint32_t lightId);
+
+#endif // SHADOWS_H
@@ -0,0 +1,356 @@
+#include "simplify.h"
+#include "linalg.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Weight of the wall planes that keep open borders in place. */
+#define kBorderWeight 10.0
+
+#define kEmptyEdge UINT64_MAX
+
+/**
+ * Symmetric 4x4 error quadric, upper triangle only:
+ *
+ *      | a2 ab ac ad |
+ *      |    b2 bc bd |
+ *      |       c2 cd |
+ *      |          d2 |
+ *
+ * w is the accumulated plane weight; dividing by it turns the weighted
+ * sum back into a mean squared distance.
+ */
+typedef struct {
+    double a2, ab, ac, ad;
+    double b2, bc, bd;
+    double c2, cd;
+    double d2;
+    double w;
+} Quadric;
+
+typedef struct {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+} Collapse;
+
+static void quadricAddPlane(Quadric* q, double a, double b, double c, double d, double w)
+{
+    q->a2 += w * a * a; q->ab += w * a * b; q->ac += w * a * c; q->ad += w * a * d;
+    q->b2 += w * b * b; q->bc += w * b * c; q->bd += w * b * d;
+    q->c2 += w * c * c; q->cd += w * c * d;
+    q->d2 += w * d * d;
+    q->w += w;
+}
+
+static void quadricAdd(Quadric* q, const Quadric* r)
+{
+    q->a2 += r->a2; q->ab += r->ab; q->ac += r->ac; q->ad += r->ad;
+    q->b2 += r->b2; q->bc += r->bc; q->bd += r->bd;
+    q->c2 += r->c2; q->cd += r->cd;
+    q->d2 += r->d2;
+    q->w += r->w;
+}
+
+/** v^T Q v / w for v = (p, 1): mean squared distance to the planes. */
+static double quadricError(const Quadric* q, Vec3 p)
+{
+    double x = p.x, y = p.y, z = p.z;
+    double e = q->a2 * x * x + 2.0 * q->ab * x * y + 2.0 * q->ac * x * z + 2.0 * q->ad * x
+             + q->b2 * y * y + 2.0 * q->bc * y * z + 2.0 * q->bd * y
+             + q->c2 * z * z + 2.0 * q->cd * z
+             + q->d2;
+    if (q->w > 0.0) e /= q->w;
+    return e > 0.0 ? e : 0.0;
+}
+
+static Vec3 vertexPosition(const float* positions, size_t stride, uint32_t index)
+{
+    const float* p = (const float*)((const char*)positions + (size_t)index * stride);
+    return vec3(p[0], p[1], p[2]);
+}
+
+static uint64_t hashEdge(uint64_t key)
+{
+    // 64-bit finalizer from MurmurHash3
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+/**
+ * Open-addressing set of directed edges, used to find border edges. Keyed
+ * (min, max) it holds undirected edges instead.
+ */
+typedef struct {
+    uint64_t* keys;
+    size_t mask;
+} EdgeSet;
+
+static bool edgeSetInit(EdgeSet* set, size_t edgeCount)
+{
+    size_t capacity = 16;
+    while (capacity < edgeCount * 2) capacity *= 2;
+    set->keys = malloc(capacity * sizeof *set->keys);
+    set->mask = capacity - 1;
+    if (!set->keys) return false;
+    memset(set->keys, 0xff, capacity * sizeof *set->keys);
+    return true;
+}
+
+static void edgeSetInsert(EdgeSet* set, uint32_t a, uint32_t b)
+{
+    uint64_t key = (uint64_t)a << 32 | b;
+    size_t slot = hashEdge(key) & set->mask;
+    while (set->keys[slot] != kEmptyEdge && set->keys[slot] != key) {
+        slot = (slot + 1) & set->mask;
+    }
+    set->keys[slot] = key;
+}
+
+static void edgeSetClear(EdgeSet* set)
+{
+    memset(set->keys, 0xff, (set->mask + 1) * sizeof *set->keys);
+}
+
+static bool edgeSetContains(const EdgeSet* set, uint32_t a, uint32_t b)
+{
+    uint64_t key = (uint64_t)a << 32 | b;
+    size_t slot = hashEdge(key) & set->mask;
+    while (set->keys[slot] != kEmptyEdge) {
+        if (set->keys[slot] == key) return true;
+        slot = (slot + 1) & set->mask;
+    }
+    return false;
+}
+
+static int compareCollapses(const void* pa, const void* pb)
+{
+    const Collapse* a = pa;
+    const Collapse* b = pb;
+    return (a->cost > b->cost) - (a->cost < b->cost);
+}
+
+/**
+ * Face and border quadrics for every vertex. Triangle planes are weighted
+ * by area so large flat regions dominate slivers.
+ */
+static bool computeQuadrics(Quadric* quadrics,
+                            const uint32_t* indices, size_t indexCount,
+                            const float* positions, size_t stride)
+{
+    EdgeSet edges;
+    if (!edgeSetInit(&edges, indexCount)) return false;
+
+    for (size_t i = 0; i < indexCount; i += 3) {
+        for (int k = 0; k < 3; ++k) {
+            edgeSetInsert(&edges, indices[i + k], indices[i + (k + 1) % 3]);
+        }
+    }
+
+    for (size_t i = 0; i < indexCount; i += 3) {
+        Vec3 p[3];
+        for (int k = 0; k < 3; ++k) p[k] = vertexPosition(positions, stride, indices[i + k]);
+
+        Vec3 n = vec3Cross(vec3Sub(p[1], p[0]), vec3Sub(p[2], p[0]));
+        float doubleArea = vec3Length(n);
+        if (doubleArea <= 0.0f) continue;
+        n = vec3Scale(n, 1.0f / doubleArea);
+
+        double d = -vec3Dot(n, p[0]);
+        for (int k = 0; k < 3; ++k) {
+            quadricAddPlane(&quadrics[indices[i + k]], n.x, n.y, n.z, d, 0.5 * doubleArea);
+        }
+
+        // A directed edge without its twin lies on a border: add a plane
+        // through the edge, perpendicular to the face.
+        for (int k = 0; k < 3; ++k) {
+            uint32_t a = indices[i + k];
+            uint32_t b = indices[i + (k + 1) % 3];
+            if (edgeSetContains(&edges, b, a)) continue;
+
+            Vec3 edge = vec3Sub(p[(k + 1) % 3], p[k]);
+            float length = vec3Length(edge);
+            Vec3 wall = vec3Normalize(vec3Cross(edge, n));
+            double wd = -vec3Dot(wall, p[k]);
+            double w = kBorderWeight * length * length;
+            quadricAddPlane(&quadrics[a], wall.x, wall.y, wall.z, wd, w);
+            quadricAddPlane(&quadrics[b], wall.x, wall.y, wall.z, wd, w);
+        }
+    }
+
+    free(edges.keys);
+    return true;
+}
+
+/**
+ * Would moving `from` onto `to` flip any triangle that survives?
+ */
+static bool collapseFlips(uint32_t from, uint32_t to,
+                          const uint32_t* indices,
+                          const uint32_t* adjacencyOffsets, const uint32_t* adjacency,
+                          const float* positions, size_t stride)
+{
+    Vec3 target = vertexPosition(positions, stride, to);
+
+    for (uint32_t a = adjacencyOffsets[from]; a < adjacencyOffsets[from + 1]; ++a) {
+        const uint32_t* tri = &indices[adjacency[a] * 3];
+        if (tri[0] == to || tri[1] == to || tri[2] == to) continue; // becomes degenerate
+
+        Vec3 before[3], after[3];
+        for (int k = 0; k < 3; ++k) {
+            before[k] = vertexPosition(positions, stride, tri[k]);
+            after[k] = tri[k] == from ? target : before[k];
+        }
+        Vec3 n0 = vec3Cross(vec3Sub(before[1], before[0]), vec3Sub(before[2], before[0]));
+        Vec3 n1 = vec3Cross(vec3Sub(after[1], after[0]), vec3Sub(after[2], after[0]));
+        if (vec3Dot(n0, n1) <= 0.0f) return true;
+    }
+    return false;
+}
+
+/**
+ * SIMPLIFY MESH
+ *
+ * Works in passes: every pass scores all edges, sorts them by error and
+ * greedily applies the cheapest collapses whose neighbourhood has not been
+ * touched yet in this pass. Indices are then remapped and degenerate
+ * triangles dropped, until the target count or error is reached.
+ */
+size_t simplifyMesh(uint32_t* destination,
+                    const uint32_t* indices, size_t indexCount,
+                    const float* positions, size_t vertexCount,
+                    size_t positionStride,
+                    size_t targetIndexCount,
+                    float targetError,
+                    float* resultError)
+{
+    indexCount -= indexCount % 3;
+    memcpy(destination, indices, indexCount * sizeof *indices);
+    if (resultError) *resultError = 0.0f;
+    if (indexCount <= targetIndexCount) return indexCount;
+
+    Quadric* quadrics = calloc(vertexCount, sizeof *quadrics);
+    uint32_t* remap = malloc(vertexCount * sizeof *remap);
+    bool* locked = malloc(vertexCount * sizeof *locked);
+    uint32_t* adjacencyOffsets = malloc((vertexCount + 1) * sizeof *adjacencyOffsets);
+    uint32_t* adjacency = malloc(indexCount * sizeof *adjacency);
+    Collapse* collapses = malloc(indexCount * sizeof *collapses);
+    EdgeSet scored = {0};
+
+    if (!quadrics || !remap || !locked || !adjacencyOffsets || !adjacency || !collapses ||
+        !edgeSetInit(&scored, indexCount) ||
+        !computeQuadrics(quadrics, indices, indexCount, positions, positionStride)) {
+        fprintf(stderr, "simplifyMesh: out of memory (%zu indices)\n", indexCount);
+        free(quadrics); free(remap); free(locked); free(adjacencyOffsets); free(adjacency); free(collapses);
+        free(scored.keys);
+        return indexCount;
+    }
+
+    double maxCost = (double)targetError * (double)targetError;
+    double worstCost = 0.0;
+
+    for (;;) {
+        if (indexCount <= targetIndexCount) break;
+
+        // 1. Vertex -> triangle adjacency of the current mesh
+        memset(adjacencyOffsets, 0, (vertexCount + 1) * sizeof *adjacencyOffsets);
+        for (size_t i = 0; i < indexCount; ++i) adjacencyOffsets[destination[i] + 1]++;
+        for (size_t v = 0; v < vertexCount; ++v) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        for (size_t i = 0; i < indexCount; ++i) {
+            adjacency[adjacencyOffsets[destination[i]]++] = (uint32_t)(i / 3);
+        }
+        for (size_t v = vertexCount; v > 0; --v) adjacencyOffsets[v] = adjacencyOffsets[v - 1];
+        adjacencyOffsets[0] = 0;
+
+        // 2. Score every edge once, in its cheaper direction. Interior
+        // edges come up twice (a, b) and (b, a), border edges only once in
+        // either order, so they are keyed (min, max).
+        size_t collapseCount = 0;
+        edgeSetClear(&scored);
+        for (size_t i = 0; i < indexCount; ++i) {
+            uint32_t a = destination[i];
+            uint32_t b = destination[i - i % 3 + (i + 1) % 3];
+            if (a > b) {
+                uint32_t t = a;
+                a = b;
+                b = t;
+            }
+            if (edgeSetContains(&scored, a, b)) continue;
+            edgeSetInsert(&scored, a, b);
+
+            Quadric q = quadrics[a];
+            quadricAdd(&q, &quadrics[b]);
+            double costAB = quadricError(&q, vertexPosition(positions, positionStride, b));
+            double costBA = quadricError(&q, vertexPosition(positions, positionStride, a));
+
+            Collapse c;
+            c.from = costAB <= costBA ? a : b;
+            c.to = costAB <= costBA ? b : a;
+            c.cost = costAB <= costBA ? costAB : costBA;
+            collapses[collapseCount++] = c;
+        }
+        qsort(collapses, collapseCount, sizeof *collapses, compareCollapses);
+
+        // 3. Apply independent collapses, cheapest first
+        for (size_t v = 0; v < vertexCount; ++v) remap[v] = (uint32_t)v;
+        memset(locked, 0, vertexCount * sizeof *locked);
+
+        size_t trianglesToRemove = (indexCount - targetIndexCount) / 3;
+        size_t removed = 0;
+        size_t applied = 0;
+
+        for (size_t c = 0; c < collapseCount && removed < trianglesToRemove; ++c) {
+            const Collapse* col = &collapses[c];
+            if (col->cost > maxCost) break;
+            if (locked[col->from] || locked[col->to]) continue;
+            if (collapseFlips(col->from, col->to, destination, adjacencyOffsets, adjacency,
+                              positions, positionStride)) continue;
+
+            remap[col->from] = col->to;
+            quadricAdd(&quadrics[col->to], &quadrics[col->from]);
+            if (col->cost > worstCost) worstCost = col->cost;
+
+            // Lock the one-ring of the removed vertex so the flip test
+            // above stays valid for the rest of the pass.
+            for (uint32_t a = adjacencyOffsets[col->from]; a < adjacencyOffsets[col->from + 1]; ++a) {
+                const uint32_t* tri = &destination[adjacency[a] * 3];
+                locked[tri[0]] = locked[tri[1]] = locked[tri[2]] = true;
+                removed += tri[0] == col->to || tri[1] == col->to || tri[2] == col->to;
+            }
+            applied++;
+        }
+
+        if (applied == 0) break;
+
+        // 4. Remap and drop degenerate triangles
+        size_t write = 0;
+        for (size_t i = 0; i < indexCount; i += 3) {
+            uint32_t a = remap[destination[i + 0]];
+            uint32_t b = remap[destination[i + 1]];
+            uint32_t c = remap[destination[i + 2]];
+            if (a == b || b == c || c == a) continue;
+            destination[write++] = a;
+            destination[write++] = b;
+            destination[write++] = c;
+        }
+        indexCount = write;
+    }
+
+    if (resultError) *resultError = (float)sqrt(worstCost);
+
+    free(quadrics);
+    free(remap);
+    free(locked);
+    free(adjacencyOffsets);
+    free(adjacency);
+    free(collapses);
+    free(scored.keys);
+
+    return indexCount;
+}
@@ -0,0 +1,40 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * MESH SIMPLIFICATION
+ *
+ * Quadric error metric (Garland & Heckbert) edge-collapse simplifier.
+ * Vertices are only ever collapsed onto other existing vertices, so the
+ * result is a new index buffer over the *same* vertex buffer: every LOD of
+ * a mesh can share one set of vertices.
+ *
+ * Open boundaries (and attribute seams, which look like boundaries since
+ * the two sides use different vertex indices) are protected by extra
+ * "wall" quadrics so they are only collapsed along their own direction.
+ */
+
+/**
+ * Simplify an indexed triangle list.
+ *
+ * - destination:      receives the simplified indices, must hold indexCount entries
+ * - positions/positionStride: 3 floats per vertex, stride in bytes
+ * - targetIndexCount: stop once the mesh has this many indices or fewer
+ * - targetError:      never perform a collapse whose error (a distance, in
+ *                     mesh units) exceeds this value
+ * - resultError:      optional, receives the largest error introduced
+ *
+ * Returns the number of indices written to destination.
+ */
+size_t simplifyMesh(uint32_t* destination,
+                    const uint32_t* indices, size_t indexCount,
+                    const float* positions, size_t vertexCount,
+                    size_t positionStride,
+                    size_t targetIndexCount,
+                    float targetError,
+                    float* resultError);
+
+#endif // SIMPLIFY_H
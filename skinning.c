@@ -0,0 +1,379 @@
+#include "skinning.h"
+#include "webgpu-utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define kSkinMaxGroupsPerDimension 65535u
+
+static const char* kSkinningWGSL =
+"struct SkinVertex {\n"
+"    px: f32, py: f32, pz: f32,\n"
+"    nx: f32, ny: f32, nz: f32,\n"
+"    joints: u32,\n"
+"    weights: u32,\n"
+"}\n"
+"\n"
+"struct MorphDelta {\n"
+"    px: f32, py: f32, pz: f32,\n"
+"    nx: f32, ny: f32, nz: f32,\n"
+"}\n"
+"\n"
+"struct SkinInstance {\n"
+"    firstVertex: u32,\n"
+"    vertexCount: u32,\n"
+"    firstDelta: u32,\n"
+"    targetCount: u32,\n"
+"    firstJoint: u32,\n"
+"    firstWeight: u32,\n"
+"    outputVertex: u32,\n"
+"    firstChunk: u32,\n"
+"}\n"
+"\n"
+"struct Joint {\n"
+"    rows: array<vec4f, 3>,\n"
+"}\n"
+"\n"
+"@group(0) @binding(0) var<storage, read> vertices: array<SkinVertex>;\n"
+"@group(0) @binding(1) var<storage, read> deltas: array<MorphDelta>;\n"
+"@group(0) @binding(2) var<storage, read> instances: array<SkinInstance>;\n"
+"@group(0) @binding(3) var<storage, read> chunks: array<u32>;\n"
+"@group(0) @binding(4) var<storage, read> palette: array<Joint>;\n"
+"@group(0) @binding(5) var<storage, read> morphWeights: array<f32>;\n"
+"@group(0) @binding(6) var<storage, read_write> outputVertices: array<f32>;\n"
+"\n"
+"@compute @workgroup_size(64)\n"
+"fn skin(@builtin(workgroup_id) group: vec3u,\n"
+"        @builtin(num_workgroups) groups: vec3u,\n"
+"        @builtin(local_invocation_index) lane: u32) {\n"
+"    let chunk = group.x + group.y * groups.x;\n"
+"    if (chunk >= arrayLength(&chunks)) {\n"
+"        return;\n"
+"    }\n"
+"    let inst = instances[chunks[chunk]];\n"
+"    let v = (chunk - inst.firstChunk) * 64u + lane;\n"
+"    if (v >= inst.vertexCount) {\n"
+"        return;\n"
+"    }\n"
+"    let source = vertices[inst.firstVertex + v];\n"
+"    var position = vec3f(source.px, source.py, source.pz);\n"
+"    var normal = vec3f(source.nx, source.ny, source.nz);\n"
+"\n"
+"    // Morph targets, in the bind pose\n"
+"    for (var t = 0u; t < inst.targetCount; t++) {\n"
+"        let w = morphWeights[inst.firstWeight + t];\n"
+"        if (w != 0.0) {\n"
+"            let d = deltas[inst.firstDelta + t * inst.vertexCount + v];\n"
+"            position += w * vec3f(d.px, d.py, d.pz);\n"
+"            normal += w * vec3f(d.nx, d.ny, d.nz);\n"
+"        }\n"
+"    }\n"
+"\n"
+"    // Linear blend of up to four joints\n"
+"    let weights = unpack4x8unorm(source.weights);\n"
+"    var rows = array<vec4f, 3>(vec4f(0.0), vec4f(0.0), vec4f(0.0));\n"
+"    for (var k = 0u; k < 4u; k++) {\n"
+"        if (weights[k] > 0.0) {\n"
+"            let joint = palette[inst.firstJoint + ((source.joints >> (8u * k)) & 0xffu)];\n"
+"            rows[0] += weights[k] * joint.rows[0];\n"
+"            rows[1] += weights[k] * joint.rows[1];\n"
+"            rows[2] += weights[k] * joint.rows[2];\n"
+"        }\n"
+"    }\n"
+"\n"
+"    let p = vec4f(position, 1.0);\n"
+"    let n = normalize(vec3f(dot(rows[0].xyz, normal), dot(rows[1].xyz, normal), dot(rows[2].xyz, normal)));\n"
+"    let out = (inst.outputVertex + v) * 6u;\n"
+"    outputVertices[out + 0u] = dot(rows[0], p);\n"
+"    outputVertices[out + 1u] = dot(rows[1], p);\n"
+"    outputVertices[out + 2u] = dot(rows[2], p);\n"
+"    outputVertices[out + 3u] = n.x;\n"
+"    outputVertices[out + 4u] = n.y;\n"
+"    outputVertices[out + 5u] = n.z;\n"
+"}\n";
+
+bool createSkinning(Skinning* skin, WGPUDevice device, WGPUQueue queue)
+{
+    memset(skin, 0, sizeof *skin);
+    skin->device = device;
+    skin->queue = queue;
+
+    WGPUShaderModule module = createShaderModule(device, "Skinning shader", kSkinningWGSL);
+    if (!module) return false;
+    skin->pipeline = createComputePipeline(device, "Skinning pipeline", module, "skin");
+    wgpuShaderModuleRelease(module);
+    if (!skin->pipeline) {
+        releaseSkinning(skin);
+        return false;
+    }
+    return true;
+}
+
+static void releaseBuffer(WGPUBuffer* buffer)
+{
+    if (*buffer) {
+        wgpuBufferDestroy(*buffer);
+        wgpuBufferRelease(*buffer);
+        *buffer = NULL;
+    }
+}
+
+void releaseSkinning(Skinning* skin)
+{
+    if (skin->bindGroup) wgpuBindGroupRelease(skin->bindGroup);
+    if (skin->pipeline) wgpuComputePipelineRelease(skin->pipeline);
+    WGPUBuffer* buffers[] = {
+        &skin->vertexBuffer, &skin->deltaBuffer, &skin->instanceBuffer, &skin->chunkBuffer,
+        &skin->paletteBuffer, &skin->weightBuffer, &skin->outputBuffer,
+    };
+    for (size_t i = 0; i < sizeof buffers / sizeof buffers[0]; ++i) {
+        releaseBuffer(buffers[i]);
+    }
+    free(skin->instances);
+    free(skin->palette);
+    free(skin->morphWeights);
+    memset(skin, 0, sizeof *skin);
+}
+
+/** Storage bindings can't be empty: a few bytes stand in for nothing. */
+static uint64_t bindingSize(uint64_t size)
+{
+    return size > 0 ? size : 64;
+}
+
+/** Rebuilt whenever a buffer is replaced; NULL until geometry and instances are both set. */
+static bool updateBindGroup(Skinning* skin)
+{
+    if (skin->bindGroup) {
+        wgpuBindGroupRelease(skin->bindGroup);
+        skin->bindGroup = NULL;
+    }
+    WGPUBuffer buffers[7] = {
+        skin->vertexBuffer, skin->deltaBuffer, skin->instanceBuffer, skin->chunkBuffer,
+        skin->paletteBuffer, skin->weightBuffer, skin->outputBuffer,
+    };
+    WGPUBindGroupEntry entries[7];
+    for (uint32_t i = 0; i < 7; ++i) {
+        if (!buffers[i]) return true;
+        memset(&entries[i], 0, sizeof entries[i]);
+        entries[i].binding = i;
+        entries[i].buffer = buffers[i];
+        entries[i].size = wgpuBufferGetSize(buffers[i]);
+    }
+
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(skin->pipeline, 0);
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = "Skinning bind group";
+    desc.layout = layout;
+    desc.entryCount = 7;
+    desc.entries = entries;
+    skin->bindGroup = wgpuDeviceCreateBindGroup(skin->device, &desc);
+    wgpuBindGroupLayoutRelease(layout);
+    return skin->bindGroup != NULL;
+}
+
+bool skinSetGeometry(Skinning* skin,
+                     const SkinVertex* vertices, uint32_t vertexCount,
+                     const SkinMorphDelta* deltas, uint32_t deltaCount)
+{
+    if (!deltas) deltaCount = 0;
+
+    const WGPUBufferUsageFlags storage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst;
+    uint64_t vertexSize = (uint64_t)vertexCount * sizeof(SkinVertex);
+    uint64_t deltaSize = (uint64_t)deltaCount * sizeof(SkinMorphDelta);
+    if (vertexSize > kMaxStorageBindingSize || deltaSize > kMaxStorageBindingSize) {
+        fprintf(stderr, "skinSetGeometry: %u vertices and %u deltas don't fit a storage binding\n",
+                vertexCount, deltaCount);
+        return false;
+    }
+    // The previous geometry, and the bind group using it, stay in place if this fails
+    WGPUBuffer vertexBuffer = createBuffer(skin->device, "Skinning source vertices", bindingSize(vertexSize), storage);
+    WGPUBuffer deltaBuffer = createBuffer(skin->device, "Skinning morph deltas", bindingSize(deltaSize), storage);
+    if (!vertexBuffer || !deltaBuffer) {
+        releaseBuffer(&vertexBuffer);
+        releaseBuffer(&deltaBuffer);
+        return false;
+    }
+    releaseBuffer(&skin->vertexBuffer);
+    releaseBuffer(&skin->deltaBuffer);
+    skin->vertexBuffer = vertexBuffer;
+    skin->deltaBuffer = deltaBuffer;
+    skin->vertexCount = vertexCount;
+    skin->deltaCount = deltaCount;
+
+    if (vertexSize > 0) wgpuQueueWriteBuffer(skin->queue, skin->vertexBuffer, 0, vertices, (size_t)vertexSize);
+    if (deltaSize > 0) wgpuQueueWriteBuffer(skin->queue, skin->deltaBuffer, 0, deltas, (size_t)deltaSize);
+    return updateBindGroup(skin);
+}
+
+bool skinSetInstances(Skinning* skin, const SkinMesh* meshes, uint32_t count)
+{
+    // Lay out every instance's chunks, output, palette and weights back to back
+    SkinInstance* instances = count > 0 ? malloc((size_t)count * sizeof *instances) : NULL;
+    if (count > 0 && !instances) {
+        fprintf(stderr, "skinSetInstances: out of memory\n");
+        return false;
+    }
+    uint64_t chunkCount = 0, outputCount = 0, jointCount = 0, weightCount = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const SkinMesh* mesh = &meshes[i];
+        if (mesh->jointCount > kSkinMaxJoints || mesh->targetCount > kSkinMaxTargets) {
+            fprintf(stderr, "skinSetInstances: instance %u has %u joints and %u targets (at most %u and %u)\n",
+                    i, mesh->jointCount, mesh->targetCount, kSkinMaxJoints, kSkinMaxTargets);
+            free(instances);
+            return false;
+        }
+        uint64_t deltaEnd = (uint64_t)mesh->firstDelta + (uint64_t)mesh->targetCount * mesh->vertexCount;
+        if ((uint64_t)mesh->firstVertex + mesh->vertexCount > skin->vertexCount ||
+            (mesh->targetCount > 0 && deltaEnd > skin->deltaCount)) {
+            fprintf(stderr, "skinSetInstances: instance %u is outside the geometry (%u vertices, %u deltas)\n",
+                    i, skin->vertexCount, skin->deltaCount);
+            free(instances);
+            return false;
+        }
+        instances[i] = (SkinInstance){
+            .firstVertex = mesh->firstVertex,
+            .vertexCount = mesh->vertexCount,
+            .firstDelta = mesh->firstDelta,
+            .targetCount = mesh->targetCount,
+            .firstJoint = (uint32_t)jointCount,
+            .firstWeight = (uint32_t)weightCount,
+            .outputVertex = (uint32_t)outputCount,
+            .firstChunk = (uint32_t)chunkCount,
+        };
+        chunkCount += (mesh->vertexCount + kSkinGroupSize - 1) / kSkinGroupSize;
+        outputCount += mesh->vertexCount;
+        jointCount += mesh->jointCount;
+        weightCount += mesh->targetCount;
+    }
+    if (outputCount * sizeof(SkinnedVertex) > kMaxStorageBindingSize ||
+        jointCount * sizeof(SkinJoint) > kMaxStorageBindingSize) {
+        fprintf(stderr, "skinSetInstances: %llu output vertices and %llu joints don't fit a storage binding\n",
+                (unsigned long long)outputCount, (unsigned long long)jointCount);
+        free(instances);
+        return false;
+    }
+    if (chunkCount > (uint64_t)kSkinMaxGroupsPerDimension * kSkinMaxGroupsPerDimension) {
+        fprintf(stderr, "skinSetInstances: %llu workgroups are over the %u x %u a dispatch can have\n",
+                (unsigned long long)chunkCount, kSkinMaxGroupsPerDimension, kSkinMaxGroupsPerDimension);
+        free(instances);
+        return false;
+    }
+
+    uint32_t* chunks = chunkCount > 0 ? malloc((size_t)chunkCount * sizeof *chunks) : NULL;
+    SkinJoint* palette = jointCount > 0 ? malloc((size_t)jointCount * sizeof *palette) : NULL;
+    float* morphWeights = weightCount > 0 ? calloc((size_t)weightCount, sizeof *morphWeights) : NULL;
+    if ((chunkCount > 0 && !chunks) || (jointCount > 0 && !palette) || (weightCount > 0 && !morphWeights)) {
+        fprintf(stderr, "skinSetInstances: out of memory\n");
+        free(instances);
+        free(chunks);
+        free(palette);
+        free(morphWeights);
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t end = i + 1 < count ? instances[i + 1].firstChunk : (uint32_t)chunkCount;
+        for (uint32_t chunk = instances[i].firstChunk; chunk < end; ++chunk) {
+            chunks[chunk] = i;
+        }
+    }
+    const SkinJoint identity = { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f } } };
+    for (uint64_t joint = 0; joint < jointCount; ++joint) {
+        palette[joint] = identity;
+    }
+
+    // New buffers first: on failure the previous instances stay in place, bind group included
+    const WGPUBufferUsageFlags storage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst;
+    WGPUBuffer buffers[5] = {
+        createBuffer(skin->device, "Skinning instances", bindingSize((uint64_t)count * sizeof(SkinInstance)), storage),
+        createBuffer(skin->device, "Skinning chunks", bindingSize(chunkCount * sizeof(uint32_t)), storage),
+        createBuffer(skin->device, "Skinning palettes", bindingSize(jointCount * sizeof(SkinJoint)), storage),
+        createBuffer(skin->device, "Skinning morph weights", bindingSize(weightCount * sizeof(float)), storage),
+        createBuffer(skin->device, "Skinned vertices", bindingSize(outputCount * sizeof(SkinnedVertex)),
+                     WGPUBufferUsage_Storage | WGPUBufferUsage_Vertex),
+    };
+    if (!buffers[0] || !buffers[1] || !buffers[2] || !buffers[3] || !buffers[4]) {
+        for (int i = 0; i < 5; ++i) {
+            releaseBuffer(&buffers[i]);
+        }
+        free(instances);
+        free(chunks);
+        free(palette);
+        free(morphWeights);
+        return false;
+    }
+
+    WGPUBuffer* current[5] = {
+        &skin->instanceBuffer, &skin->chunkBuffer, &skin->paletteBuffer, &skin->weightBuffer, &skin->outputBuffer,
+    };
+    for (int i = 0; i < 5; ++i) {
+        releaseBuffer(current[i]);
+        *current[i] = buffers[i];
+    }
+    free(skin->instances);
+    free(skin->palette);
+    free(skin->morphWeights);
+    skin->instances = instances;
+    skin->instanceCount = count;
+    skin->chunkCount = (uint32_t)chunkCount;
+    skin->outputVertexCount = (uint32_t)outputCount;
+    skin->palette = palette;
+    skin->jointCount = (uint32_t)jointCount;
+    skin->morphWeights = morphWeights;
+    skin->weightCount = (uint32_t)weightCount;
+
+    if (count > 0) {
+        wgpuQueueWriteBuffer(skin->queue, skin->instanceBuffer, 0, instances, (size_t)count * sizeof *instances);
+    }
+    if (chunkCount > 0) {
+        wgpuQueueWriteBuffer(skin->queue, skin->chunkBuffer, 0, chunks, (size_t)chunkCount * sizeof *chunks);
+    }
+    free(chunks);
+    skinUpload(skin);
+    return updateBindGroup(skin);
+}
+
+SkinJoint* skinJointPalette(Skinning* skin, uint32_t instance)
+{
+    return skin->palette + skin->instances[instance].firstJoint;
+}
+
+float* skinMorphWeights(Skinning* skin, uint32_t instance)
+{
+    return skin->morphWeights + skin->instances[instance].firstWeight;
+}
+
+uint32_t skinOutputVertex(const Skinning* skin, uint32_t instance)
+{
+    return skin->instances[instance].outputVertex;
+}
+
+void skinUpload(Skinning* skin)
+{
+    if (skin->jointCount > 0) {
+        wgpuQueueWriteBuffer(skin->queue, skin->paletteBuffer, 0, skin->palette,
+                             (size_t)skin->jointCount * sizeof(SkinJoint));
+    }
+    if (skin->weightCount > 0) {
+        wgpuQueueWriteBuffer(skin->queue, skin->weightBuffer, 0, skin->morphWeights,
+                             (size_t)skin->weightCount * sizeof(float));
+    }
+}
+
+void skinDispatch(Skinning* skin, WGPUCommandEncoder encoder, const WGPUComputePassTimestampWrites* timestamps)
+{
+    if (!skin->bindGroup || skin->chunkCount == 0) return;
+
+    WGPUComputePassDescriptor passDesc = {0};
+    passDesc.label = "Skinning pass";
+    passDesc.timestampWrites = timestamps;
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+    wgpuComputePassEncoderSetPipeline(pass, skin->pipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, skin->bindGroup, 0, NULL);
+    // Past 65535 chunks the grid wraps into rows; the shader skips the tail of the last one
+    uint32_t columns = skin->chunkCount < kSkinMaxGroupsPerDimension ? skin->chunkCount : kSkinMaxGroupsPerDimension;
+    wgpuComputePassEncoderDispatchWorkgroups(pass, columns, (skin->chunkCount + columns - 1) / columns, 1);
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+}
@@ -0,0 +1,159 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * GPU SKINNING
+ *
+ * Skinned and morphed meshes are deformed once per frame, in compute, into
+ * one shared output buffer of plain vertices, bindable as a vertex or a
+ * storage buffer. A pass that draws them (the main pass, each shadow
+ * cascade and tile) can read the same deformed vertices like any static
+ * mesh instead of re-skinning in its vertex shader: with four cascades
+ * that is five times the skinning work saved, and caster pipelines need
+ * no skinned variant. Nothing in the renderer draws from it yet.
+ *
+ * Each instance (a character) is a mesh range of the source vertices, its
+ * own range of the output, a joint palette and morph target weights. One
+ * dispatch covers every instance: a chunk table maps each 64-vertex
+ * workgroup to its instance. Per vertex, the morph target deltas are added
+ * first (targets with a zero weight are skipped), then up to four joints
+ * blend the result.
+ *
+ * Joint palettes and morph weights are written by the CPU straight into
+ * their upload region (skinJointPalette(), skinMorphWeights()) and sent in
+ * one write each per frame by skinUpload(). They live in storage buffers:
+ * thousands of characters' palettes don't fit a 64 KiB uniform binding.
+ *
+ * Per frame:
+ *      ... animate into skinJointPalette(&skin, i) / skinMorphWeights(&skin, i) ...
+ *      skinUpload(&skin);
+ *      skinDispatch(&skin, encoder, NULL);
+ *      ... draw `outputBuffer` from skinOutputVertex(&skin, i) in every pass ...
+ */
+
+#define kSkinGroupSize 64
+#define kSkinMaxJoints 256          // joint indices are 8-bit
+#define kSkinMaxTargets 64
+
+/** A source vertex, laid out to match the WGSL struct (32 bytes). */
+typedef struct {
+    float position[3];
+    float normal[3];
+    uint32_t joints;            // four 8-bit indices into the instance's palette
+    uint32_t weights;           // four unorm8 weights, summing to 255
+} SkinVertex;
+
+/** What a morph target adds to one vertex at weight 1 (24 bytes). */
+typedef struct {
+    float position[3];
+    float normal[3];
+} SkinMorphDelta;
+
+/**
+ * A deformed vertex in the output buffer (24 bytes): the layout of
+ * VisVertex, and of a float32x3 position + float32x3 normal vertex buffer.
+ */
+typedef struct {
+    float position[3];
+    float normal[3];
+} SkinnedVertex;
+
+/**
+ * One affine joint transform, row-major 3x4 (48 bytes): from the mesh's
+ * bind pose to where it is drawn, inverse bind matrix included. Normals
+ * use its 3x3 part, so joints should scale uniformly.
+ */
+typedef struct {
+    float rows[3][4];
+} SkinJoint;
+
+/** One skinned instance, as set by skinSetInstances(). */
+typedef struct {
+    uint32_t firstVertex;       // into the source vertices
+    uint32_t vertexCount;
+    uint32_t firstDelta;        // target t of vertex v is delta firstDelta + t * vertexCount + v
+    uint32_t targetCount;       // up to kSkinMaxTargets
+    uint32_t jointCount;        // up to kSkinMaxJoints
+} SkinMesh;
+
+/** One instance, laid out to match the WGSL struct (32 bytes). */
+typedef struct {
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint32_t firstDelta;
+    uint32_t targetCount;
+    uint32_t firstJoint;        // into the palette
+    uint32_t firstWeight;       // into the morph weights
+    uint32_t outputVertex;
+    uint32_t firstChunk;
+} SkinInstance;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+
+    WGPUComputePipeline pipeline;
+    WGPUBindGroup bindGroup;
+
+    WGPUBuffer vertexBuffer;
+    WGPUBuffer deltaBuffer;
+    uint32_t vertexCount;       // of the geometry, which meshes must lie in
+    uint32_t deltaCount;
+    WGPUBuffer instanceBuffer;
+    WGPUBuffer chunkBuffer;     // instance of each workgroup
+    WGPUBuffer paletteBuffer;
+    WGPUBuffer weightBuffer;
+    WGPUBuffer outputBuffer;    // SkinnedVertex, usable as storage and vertex buffer
+
+    SkinInstance* instances;    // CPU copy
+    uint32_t instanceCount;
+    uint32_t chunkCount;
+    uint32_t outputVertexCount;
+
+    // Upload regions, sent by skinUpload()
+    SkinJoint* palette;
+    uint32_t jointCount;
+    float* morphWeights;
+    uint32_t weightCount;
+} Skinning;
+
+bool createSkinning(Skinning* skin, WGPUDevice device, WGPUQueue queue);
+
+void releaseSkinning(Skinning* skin);
+
+/**
+ * Upload the source vertices and morph target deltas of every mesh
+ * (`deltas` may be NULL without targets).
+ */
+bool skinSetGeometry(Skinning* skin,
+                     const SkinVertex* vertices, uint32_t vertexCount,
+                     const SkinMorphDelta* deltas, uint32_t deltaCount);
+
+/**
+ * Lay out `count` instances: their output ranges, palettes (identity) and
+ * morph weights (zero). Call again when characters come or go. Each mesh's
+ * vertices and deltas must lie in the geometry set by skinSetGeometry().
+ */
+bool skinSetInstances(Skinning* skin, const SkinMesh* meshes, uint32_t count);
+
+/** The palette of `instance`, its mesh's jointCount joints, for the CPU to write. */
+SkinJoint* skinJointPalette(Skinning* skin, uint32_t instance);
+
+/** The morph target weights of `instance`, for the CPU to write. */
+float* skinMorphWeights(Skinning* skin, uint32_t instance);
+
+/** The first output vertex of `instance`: the base vertex of its draws. */
+uint32_t skinOutputVertex(const Skinning* skin, uint32_t instance);
+
+/** Send this frame's palettes and morph weights. */
+void skinUpload(Skinning* skin);
+
+/** Record the skinning of every instance in its own compute pass. */
+void skinDispatch(Skinning* skin, WGPUCommandEncoder encoder, const WGPUComputePassTimestampWrites* timestamps);
+
+#endif // SKINNING_H
@@ -0,0 +1,470 @@
+#include "ssao.h"
+#include "webgpu-utils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define kSsaoTemporal 1u
+#define kSsaoHistoryValid 2u
+#define kSsaoLowFormat WGPUTextureFormat_RG32Float
+
+/**
+ * Uniform block of every dispatch. Must match SsaoUniforms in kSsaoWGSL
+ * (176 bytes).
+ */
+typedef struct {
+    float inverseProjection[16];
+    float viewToPreviousClip[16];
+    float fullSize[2];
+    float lowSize[2];
+    float radius;
+    float intensity;
+    float bias;
+    float projectionScale;
+    uint32_t divisor;
+    uint32_t sampleCount;
+    uint32_t frameIndex;
+    uint32_t flags;
+} SsaoUniforms;
+
+static const char* const kSsaoWGSL[] = {
+"struct SsaoUniforms {\n"
+"    inverseProjection: mat4x4f,\n"
+"    viewToPreviousClip: mat4x4f,\n"
+"    fullSize: vec2f,\n"
+"    lowSize: vec2f,\n"
+"    radius: f32,\n"
+"    intensity: f32,\n"
+"    bias: f32,\n"
+"    projectionScale: f32,   // pixels per world unit at distance 1\n"
+"    divisor: u32,\n"
+"    sampleCount: u32,\n"
+"    frameIndex: u32,\n"
+"    flags: u32,\n"
+"}\n"
+"\n"
+"@group(0) @binding(0) var<uniform> ssao: SsaoUniforms;\n"
+"@group(0) @binding(1) var depth: texture_depth_2d;\n"
+"@group(0) @binding(2) var source: texture_2d<f32>;\n"
+"@group(0) @binding(3) var history: texture_2d<f32>;\n"
+"@group(0) @binding(4) var lowOutput: texture_storage_2d<rg32float, write>;\n"
+"@group(0) @binding(5) var occlusion: texture_storage_2d<rgba8unorm, write>;\n"
+"\n"
+"const kTemporal = 1u;\n"
+"const kHistoryValid = 2u;\n"
+"const kPi = 3.14159265;\n"
+"const kSpiralTurns = 7.0;\n"
+"const kSkyDepth = 1e6;\n"
+"// Share of the new frame in the accumulation\n"
+"const kTemporalBlend = 0.15;\n"
+"// Relative depth difference where the blur stops mixing pixels\n"
+"const kBlurDepthTolerance = 0.05;\n"
+"\n"
+"// Low-res pixels have the occlusion of the full-res texel in their middle\n"
+"fn fullTexel(low: vec2u) -> vec2i {\n"
+"    return vec2i(low * ssao.divisor + ssao.divisor / 2u);\n"
+"}\n"
+"\n"
+"fn viewPosition(texel: vec2i) -> vec3f {\n"
+"    let clamped = clamp(texel, vec2i(0), vec2i(ssao.fullSize) - 1);\n"
+"    let z = textureLoad(depth, clamped, 0);\n"
+"    let uv = (vec2f(clamped) + 0.5) / ssao.fullSize;\n"
+"    let p = ssao.inverseProjection * vec4f(uv.x * 2.0 - 1.0, 1.0 - uv.y * 2.0, z, 1.0);\n"
+"    return p.xyz / p.w;\n"
+"}\n"
+"\n",
+"@compute @workgroup_size(8, 8)\n"
+"fn computeOcclusion(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (any(vec2f(id.xy) >= ssao.lowSize)) {\n"
+"        return;\n"
+"    }\n"
+"    let texel = min(fullTexel(id.xy), vec2i(ssao.fullSize) - 1);\n"
+"    if (textureLoad(depth, texel, 0) >= 1.0) {\n"
+"        textureStore(lowOutput, id.xy, vec4f(1.0, kSkyDepth, 0.0, 0.0));\n"
+"        return;\n"
+"    }\n"
+"    let center = viewPosition(texel);\n"
+"    let linearDepth = -center.z;\n"
+"\n"
+"    // Normal from the smaller depth step on each axis, so edges don't bend it\n"
+"    let right = viewPosition(texel + vec2i(1, 0)) - center;\n"
+"    let left = center - viewPosition(texel - vec2i(1, 0));\n"
+"    let below = viewPosition(texel + vec2i(0, 1)) - center;\n"
+"    let above = center - viewPosition(texel - vec2i(0, 1));\n"
+"    let dx = select(right, left, abs(left.z) < abs(right.z));\n"
+"    let dy = select(below, above, abs(above.z) < abs(below.z));\n"
+"    var normal = normalize(cross(dx, dy));\n"
+"    if (dot(normal, center) > 0.0) {\n"
+"        normal = -normal;\n"
+"    }\n"
+"\n"
+"    // 4x4 interleaved rotations and radial offsets, turned every frame when accumulating\n"
+"    let index = (id.x & 3u) + (id.y & 3u) * 4u;\n"
+"    var rotation = f32(index) / 16.0;\n"
+"    var jitter = fract(f32(index) * 0.3125 + 0.5);\n"
+"    if ((ssao.flags & kTemporal) != 0u) {\n"
+"        let frame = f32(ssao.frameIndex % 64u);\n"
+"        rotation = fract(rotation + frame * 0.618034);\n"
+"        jitter = fract(jitter + frame * 0.754878);\n"
+"    }\n"
+"\n"
+"    let screenRadius = ssao.radius * ssao.projectionScale / linearDepth;\n"
+"    let radiusSquared = ssao.radius * ssao.radius;\n"
+"    var sum = 0.0;\n"
+"    for (var i = 0u; i < ssao.sampleCount; i++) {\n"
+"        let alpha = (f32(i) + jitter) / f32(ssao.sampleCount);\n"
+"        let angle = (alpha * kSpiralTurns + rotation) * 2.0 * kPi;\n"
+"        let offset = vec2f(cos(angle), sin(angle)) * alpha * screenRadius;\n"
+"        let v = viewPosition(texel + vec2i(round(offset))) - center;\n"
+"        let vv = dot(v, v);\n"
+"        let falloff = max(radiusSquared - vv, 0.0);\n"
+"        sum += falloff * falloff * falloff * max((dot(v, normal) - ssao.bias) / (vv + 0.01), 0.0);\n"
+"    }\n"
+"    let scale = 5.0 * ssao.intensity /\n"
+"                (radiusSquared * radiusSquared * radiusSquared * f32(max(ssao.sampleCount, 1u)));\n"
+"    textureStore(lowOutput, id.xy, vec4f(max(1.0 - sum * scale, 0.0), linearDepth, 0.0, 0.0));\n"
+"}\n"
+"\n",
+"@compute @workgroup_size(8, 8)\n"
+"fn accumulate(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (any(vec2f(id.xy) >= ssao.lowSize)) {\n"
+"        return;\n"
+"    }\n"
+"    let current = textureLoad(source, id.xy, 0).xy;\n"
+"    var visibility = current.x;\n"
+"    if ((ssao.flags & kHistoryValid) != 0u && current.y < kSkyDepth) {\n"
+"        // Back to view space along the pixel's ray, then into the previous frame\n"
+"        let uv = (vec2f(fullTexel(id.xy)) + 0.5) / ssao.fullSize;\n"
+"        let rayPoint = ssao.inverseProjection * vec4f(uv.x * 2.0 - 1.0, 1.0 - uv.y * 2.0, 0.5, 1.0);\n"
+"        let ray = rayPoint.xyz / rayPoint.w;\n"
+"        let previous = ssao.viewToPreviousClip * vec4f(ray * (current.y / -ray.z), 1.0);\n"
+"        let previousNdc = previous.xy / previous.w;\n"
+"        let previousUv = vec2f(previousNdc.x * 0.5 + 0.5, 0.5 - previousNdc.y * 0.5);\n"
+"        if (previous.w > 0.0 && all(previousUv >= vec2f(0.0)) && all(previousUv < vec2f(1.0))) {\n"
+"            let stored = textureLoad(history, vec2i(previousUv * ssao.lowSize), 0).xy;\n"
+"            // A different depth there means a disocclusion: start over\n"
+"            if (abs(stored.y - previous.w) < 0.05 * previous.w) {\n"
+"                visibility = mix(stored.x, current.x, kTemporalBlend);\n"
+"            }\n"
+"        }\n"
+"    }\n"
+"    textureStore(lowOutput, id.xy, vec4f(visibility, current.y, 0.0, 0.0));\n"
+"}\n"
+"\n"
+"fn blur(id: vec2u, direction: vec2i) {\n"
+"    if (any(vec2f(id) >= ssao.lowSize)) {\n"
+"        return;\n"
+"    }\n"
+"    let center = textureLoad(source, id, 0).xy;\n"
+"    let maxTexel = vec2i(ssao.lowSize) - 1;\n"
+"    var sum = center.x;\n"
+"    var weightSum = 1.0;\n"
+"    for (var i = -4; i <= 4; i++) {\n"
+"        if (i == 0) {\n"
+"            continue;\n"
+"        }\n"
+"        let s = textureLoad(source, clamp(vec2i(id) + direction * i, vec2i(0), maxTexel), 0).xy;\n"
+"        let depthWeight = max(1.0 - abs(s.y - center.y) / (kBlurDepthTolerance * center.y), 0.0);\n"
+"        let w = exp(-f32(i * i) / 8.0) * depthWeight;\n"
+"        sum += s.x * w;\n"
+"        weightSum += w;\n"
+"    }\n"
+"    textureStore(lowOutput, id, vec4f(sum / weightSum, center.y, 0.0, 0.0));\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn blurHorizontal(@builtin(global_invocation_id) id: vec3u) {\n"
+"    blur(id.xy, vec2i(1, 0));\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn blurVertical(@builtin(global_invocation_id) id: vec3u) {\n"
+"    blur(id.xy, vec2i(0, 1));\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn upsample(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (any(vec2f(id.xy) >= ssao.fullSize)) {\n"
+"        return;\n"
+"    }\n"
+"    if (textureLoad(depth, vec2i(id.xy), 0) >= 1.0) {\n"
+"        textureStore(occlusion, id.xy, vec4f(1.0));\n"
+"        return;\n"
+"    }\n"
+"    let linearDepth = -viewPosition(vec2i(id.xy)).z;\n"
+"\n"
+"    // Bilinear among the 4 low-res pixels around, scaled down for depth mismatches\n"
+"    let position = (vec2f(id.xy) - f32(ssao.divisor / 2u)) / f32(ssao.divisor);\n"
+"    let base = vec2i(floor(position));\n"
+"    let f = position - floor(position);\n"
+"    let maxTexel = vec2i(ssao.lowSize) - 1;\n"
+"    var sum = 0.0;\n"
+"    var weightSum = 0.0;\n"
+"    for (var y = 0; y <= 1; y++) {\n"
+"        for (var x = 0; x <= 1; x++) {\n"
+"            let s = textureLoad(source, clamp(base + vec2i(x, y), vec2i(0), maxTexel), 0).xy;\n"
+"            let bilinear = select(1.0 - f.x, f.x, x == 1) * select(1.0 - f.y, f.y, y == 1);\n"
+"            let w = (bilinear + 1e-3) / (1e-3 + abs(s.y - linearDepth) / linearDepth);\n"
+"            sum += s.x * w;\n"
+"            weightSum += w;\n"
+"        }\n"
+"    }\n"
+"    let visibility = sum / weightSum;\n"
+"    textureStore(occlusion, id.xy, vec4f(visibility, visibility, visibility, 1.0));\n"
+"}\n",
+};
+
+SsaoSettings defaultSsaoSettings(void)
+{
+    SsaoSettings settings;
+    settings.divisor = 2;
+    settings.sampleCount = 8;
+    settings.radius = 0.5f;
+    settings.intensity = 1.0f;
+    settings.bias = 0.01f;
+    settings.temporal = true;
+    return settings;
+}
+
+static void releaseHistory(Ssao* ssao)
+{
+    for (int i = 0; i < 2; ++i) {
+        if (ssao->historyViews[i]) wgpuTextureViewRelease(ssao->historyViews[i]);
+        if (ssao->historyTextures[i]) {
+            wgpuTextureDestroy(ssao->historyTextures[i]);
+            wgpuTextureRelease(ssao->historyTextures[i]);
+        }
+        ssao->historyViews[i] = NULL;
+        ssao->historyTextures[i] = NULL;
+    }
+    ssao->historyWidth = 0;
+    ssao->historyHeight = 0;
+    ssao->historyValid = false;
+}
+
+static bool createHistory(Ssao* ssao, uint32_t width, uint32_t height)
+{
+    releaseHistory(ssao);
+    for (int i = 0; i < 2; ++i) {
+        WGPUTextureDescriptor desc = {0};
+        desc.label = "SSAO history";
+        desc.usage = WGPUTextureUsage_StorageBinding | WGPUTextureUsage_TextureBinding;
+        desc.dimension = WGPUTextureDimension_2D;
+        desc.size = (WGPUExtent3D){ width, height, 1 };
+        desc.format = kSsaoLowFormat;
+        desc.mipLevelCount = 1;
+        desc.sampleCount = 1;
+        ssao->historyTextures[i] = wgpuDeviceCreateTexture(ssao->device, &desc);
+        if (ssao->historyTextures[i]) {
+            ssao->historyViews[i] = wgpuTextureCreateView(ssao->historyTextures[i], NULL);
+        }
+        if (!ssao->historyViews[i]) {
+            fprintf(stderr, "ssaoRender: failed to create a %ux%u history\n", width, height);
+            releaseHistory(ssao);
+            return false;
+        }
+    }
+    ssao->historyWidth = width;
+    ssao->historyHeight = height;
+    return true;
+}
+
+bool createSsao(Ssao* ssao,
+                WGPUDevice device,
+                WGPUQueue queue,
+                TexturePool* pool,
+                const SsaoSettings* settings)
+{
+    memset(ssao, 0, sizeof *ssao);
+    ssao->device = device;
+    ssao->queue = queue;
+    ssao->pool = pool;
+    ssao->settings = settings ? *settings : defaultSsaoSettings();
+
+    ssao->uniformBuffer = createBuffer(device, "SSAO uniforms", sizeof(SsaoUniforms),
+                                       WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+
+    WGPUShaderModule module = createShaderModuleFromParts(device, "SSAO shader", kSsaoWGSL,
+                                                          sizeof kSsaoWGSL / sizeof kSsaoWGSL[0]);
+    if (module) {
+        ssao->occlusionPipeline = createComputePipeline(device, "SSAO occlusion pipeline", module, "computeOcclusion");
+        ssao->accumulatePipeline = createComputePipeline(device, "SSAO accumulate pipeline", module, "accumulate");
+        ssao->blurHorizontalPipeline = createComputePipeline(device, "SSAO blur pipeline", module, "blurHorizontal");
+        ssao->blurVerticalPipeline = createComputePipeline(device, "SSAO blur pipeline", module, "blurVertical");
+        ssao->upsamplePipeline = createComputePipeline(device, "SSAO upsample pipeline", module, "upsample");
+        wgpuShaderModuleRelease(module);
+    }
+    if (!ssao->uniformBuffer || !ssao->occlusionPipeline || !ssao->accumulatePipeline ||
+        !ssao->blurHorizontalPipeline || !ssao->blurVerticalPipeline || !ssao->upsamplePipeline) {
+        releaseSsao(ssao);
+        return false;
+    }
+    return true;
+}
+
+void releaseSsao(Ssao* ssao)
+{
+    releaseHistory(ssao);
+    WGPUComputePipeline pipelines[5] = {
+        ssao->occlusionPipeline, ssao->accumulatePipeline, ssao->blurHorizontalPipeline,
+        ssao->blurVerticalPipeline, ssao->upsamplePipeline,
+    };
+    for (int i = 0; i < 5; ++i) {
+        if (pipelines[i]) wgpuComputePipelineRelease(pipelines[i]);
+    }
+    if (ssao->uniformBuffer) {
+        wgpuBufferDestroy(ssao->uniformBuffer);
+        wgpuBufferRelease(ssao->uniformBuffer);
+    }
+    memset(ssao, 0, sizeof *ssao);
+}
+
+void ssaoSetSettings(Ssao* ssao, const SsaoSettings* settings)
+{
+    ssao->settings = *settings;
+    ssao->historyValid = false;
+}
+
+/**
+ * Bind group of one dispatch. The layouts are automatic, so the entries
+ * must be exactly the bindings the entry point uses: the non-NULL views.
+ */
+static WGPUBindGroup createDispatchBindGroup(Ssao* ssao, WGPUComputePipeline pipeline,
+                                             WGPUTextureView depth, WGPUTextureView source,
+                                             WGPUTextureView history, WGPUTextureView lowOutput,
+                                             WGPUTextureView occlusion)
+{
+    WGPUTextureView views[5] = { depth, source, history, lowOutput, occlusion };
+    WGPUBindGroupEntry entries[6] = {0};
+    uint32_t count = 0;
+    entries[count].binding = 0;
+    entries[count].buffer = ssao->uniformBuffer;
+    entries[count].size = sizeof(SsaoUniforms);
+    count++;
+    for (uint32_t i = 0; i < 5; ++i) {
+        if (!views[i]) continue;
+        entries[count].binding = i + 1;
+        entries[count].textureView = views[i];
+        count++;
+    }
+
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(pipeline, 0);
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = "SSAO bind group";
+    desc.layout = layout;
+    desc.entryCount = count;
+    desc.entries = entries;
+    WGPUBindGroup bindGroup = wgpuDeviceCreateBindGroup(ssao->device, &desc);
+    wgpuBindGroupLayoutRelease(layout);
+    return bindGroup;
+}
+
+WGPUTextureView ssaoRender(Ssao* ssao,
+                           WGPUCommandEncoder encoder,
+                           const SsaoInput* input,
+                           const WGPUComputePassTimestampWrites* timestamps)
+{
+    const SsaoSettings* settings = &ssao->settings;
+    uint32_t divisor = settings->divisor ? settings->divisor : 1;
+    uint32_t lowWidth = (input->width + divisor - 1) / divisor;
+    uint32_t lowHeight = (input->height + divisor - 1) / divisor;
+    bool temporal = settings->temporal;
+
+    // The history follows the low-res size; dynamic resolution only changes it now and then
+    if (temporal && (ssao->historyWidth != lowWidth || ssao->historyHeight != lowHeight)) {
+        if (!createHistory(ssao, lowWidth, lowHeight)) temporal = false;
+    }
+    if (!temporal) releaseHistory(ssao);
+
+    Mat4 viewProj = mat4Mul(input->projection, input->view);
+    Mat4 viewToPreviousClip = mat4Mul(ssao->previousViewProj, mat4Inverse(input->view));
+    Mat4 inverseProjection = mat4Inverse(input->projection);
+
+    SsaoUniforms uniforms = {0};
+    memcpy(uniforms.inverseProjection, inverseProjection.m, sizeof uniforms.inverseProjection);
+    memcpy(uniforms.viewToPreviousClip, viewToPreviousClip.m, sizeof uniforms.viewToPreviousClip);
+    uniforms.fullSize[0] = (float)input->width;
+    uniforms.fullSize[1] = (float)input->height;
+    uniforms.lowSize[0] = (float)lowWidth;
+    uniforms.lowSize[1] = (float)lowHeight;
+    uniforms.radius = settings->radius;
+    uniforms.intensity = settings->intensity;
+    uniforms.bias = settings->bias;
+    uniforms.projectionScale = input->projection.m[5] * 0.5f * (float)input->height;
+    uniforms.divisor = divisor;
+    uniforms.sampleCount = settings->sampleCount;
+    uniforms.frameIndex = ssao->frameIndex++;
+    if (temporal) uniforms.flags |= kSsaoTemporal;
+    if (temporal && ssao->historyValid) uniforms.flags |= kSsaoHistoryValid;
+    wgpuQueueWriteBuffer(ssao->queue, ssao->uniformBuffer, 0, &uniforms, sizeof uniforms);
+
+    TexturePoolDesc lowDesc = {0};
+    lowDesc.width = lowWidth;
+    lowDesc.height = lowHeight;
+    lowDesc.format = kSsaoLowFormat;
+    lowDesc.usage = WGPUTextureUsage_StorageBinding | WGPUTextureUsage_TextureBinding;
+    TexturePoolDesc outputDesc = lowDesc;
+    outputDesc.width = input->width;
+    outputDesc.height = input->height;
+    outputDesc.format = kSsaoOutputFormat;
+    PooledTexture* raw = texturePoolAcquire(ssao->pool, &lowDesc);
+    PooledTexture* blurred = texturePoolAcquire(ssao->pool, &lowDesc);
+    PooledTexture* output = texturePoolAcquire(ssao->pool, &outputDesc);
+    if (!raw || !blurred || !output) {
+        if (raw) texturePoolRelease(ssao->pool, raw);
+        if (blurred) texturePoolRelease(ssao->pool, blurred);
+        if (output) texturePoolRelease(ssao->pool, output);
+        return NULL;
+    }
+
+    // raw -> (history) -> blurred -> raw -> output
+    uint32_t previous = ssao->current;
+    if (temporal) ssao->current ^= 1;
+    WGPUTextureView accumulated = temporal ? ssao->historyViews[ssao->current] : raw->view;
+
+    WGPUComputePipeline pipelines[5] = {
+        ssao->occlusionPipeline, ssao->accumulatePipeline, ssao->blurHorizontalPipeline,
+        ssao->blurVerticalPipeline, ssao->upsamplePipeline,
+    };
+    WGPUBindGroup bindGroups[5] = {0};
+    bindGroups[0] = createDispatchBindGroup(ssao, pipelines[0], input->depth, NULL, NULL, raw->view, NULL);
+    if (temporal) {
+        bindGroups[1] = createDispatchBindGroup(ssao, pipelines[1], NULL, raw->view,
+                                                ssao->historyViews[previous], accumulated, NULL);
+    }
+    bindGroups[2] = createDispatchBindGroup(ssao, pipelines[2], NULL, accumulated, NULL, blurred->view, NULL);
+    bindGroups[3] = createDispatchBindGroup(ssao, pipelines[3], NULL, blurred->view, NULL, raw->view, NULL);
+    bindGroups[4] = createDispatchBindGroup(ssao, pipelines[4], input->depth, raw->view, NULL, NULL, output->view);
+
+    bool complete = bindGroups[0] && (bindGroups[1] || !temporal) && bindGroups[2] && bindGroups[3] && bindGroups[4];
+    if (complete) {
+        WGPUComputePassDescriptor passDesc = {0};
+        passDesc.label = "SSAO pass";
+        passDesc.timestampWrites = timestamps;
+        WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+        for (uint32_t i = 0; i < 5; ++i) {
+            if (!bindGroups[i]) continue;
+            uint32_t width = i == 4 ? input->width : lowWidth;
+            uint32_t height = i == 4 ? input->height : lowHeight;
+            wgpuComputePassEncoderSetPipeline(pass, pipelines[i]);
+            wgpuComputePassEncoderSetBindGroup(pass, 0, bindGroups[i], 0, NULL);
+            wgpuComputePassEncoderDispatchWorkgroups(pass, (width + 7) / 8, (height + 7) / 8, 1);
+        }
+        wgpuComputePassEncoderEnd(pass);
+        wgpuComputePassEncoderRelease(pass);
+    }
+    for (uint32_t i = 0; i < 5; ++i) {
+        if (bindGroups[i]) wgpuBindGroupRelease(bindGroups[i]);
+    }
+
+    texturePoolRelease(ssao->pool, raw);
+    texturePoolRelease(ssao->pool, blurred);
+    if (!complete) {
+        texturePoolRelease(ssao->pool, output);
+        ssao->historyValid = false;
+        return NULL;
+    }
+    ssao->previousViewProj = viewProj;
+    ssao->historyValid = temporal;
+    return output->view;
+}
@@ -0,0 +1,102 @@
+#ifndef SSAO_H
+#define SSAO_H
+
+#include "linalg.h"
+#include "texture-pool.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * SCREEN-SPACE AMBIENT OCCLUSION
+ *
+ * Scalable Ambient Obscurance from the depth buffer alone, computed at a
+ * fraction of the resolution (`divisor` 2 or 4, i.e. a quarter or a
+ * sixteenth of the pixels) in one compute pass:
+ *  - occlusion: every low-res pixel takes `sampleCount` depth samples on a
+ *    spiral in a world-space radius around its full-res position, normals
+ *    reconstructed from depth. The spiral's rotation follows a 4x4
+ *    interleaved pattern, so neighbours sample different directions.
+ *  - accumulation (`temporal`): the pattern also rotates every frame, and
+ *    the result is blended with the previous frames', reprojected with the
+ *    camera motion and rejected where the depth doesn't match
+ *  - blur: separable, 9 taps, weighted by depth so occlusion doesn't leak
+ *    across edges; it averages out the interleaved pattern
+ *  - upsample: each full-res pixel blends the 4 low-res pixels around it,
+ *    weighted by how close their depth is to its own
+ *
+ * Cost scales with divisor and sampleCount: the quality knobs. Low-res
+ * intermediates and the output come from the texture pool, so the depth
+ * size can follow dynamic resolution; only the history is owned.
+ *
+ * The output is RGBA8Unorm at the depth buffer's size, with the ambient
+ * visibility (1 = unoccluded) in every channel.
+ */
+
+#define kSsaoOutputFormat WGPUTextureFormat_RGBA8Unorm
+
+typedef struct {
+    uint32_t divisor;           // 1, 2 or 4
+    uint32_t sampleCount;
+    float radius;               // world units
+    float intensity;
+    float bias;                 // world units, against self-occlusion on flat surfaces
+    bool temporal;
+} SsaoSettings;
+
+typedef struct {
+    WGPUTextureView depth;      // Depth32Float or Depth24Plus
+    uint32_t width, height;
+    Mat4 view;
+    Mat4 projection;            // the one depth was rendered with
+} SsaoInput;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+    TexturePool* pool;
+    SsaoSettings settings;
+    uint32_t frameIndex;
+
+    // Accumulated low-res occlusion and depth, ping-pong
+    uint32_t historyWidth, historyHeight;
+    WGPUTexture historyTextures[2];
+    WGPUTextureView historyViews[2];
+    uint32_t current;
+    bool historyValid;
+    Mat4 previousViewProj;
+
+    WGPUComputePipeline occlusionPipeline;
+    WGPUComputePipeline accumulatePipeline;
+    WGPUComputePipeline blurHorizontalPipeline;
+    WGPUComputePipeline blurVerticalPipeline;
+    WGPUComputePipeline upsamplePipeline;
+    WGPUBuffer uniformBuffer;
+} Ssao;
+
+/** Half resolution, 8 samples, temporal accumulation. */
+SsaoSettings defaultSsaoSettings(void);
+
+bool createSsao(Ssao* ssao,
+                WGPUDevice device,
+                WGPUQueue queue,
+                TexturePool* pool,
+                const SsaoSettings* settings);
+
+void releaseSsao(Ssao* ssao);
+
+/** Takes effect on the next render, and drops the history. */
+void ssaoSetSettings(Ssao* ssao, const SsaoSettings* settings);
+
+/**
+ * Record the occlusion of `input` in its own compute pass. Returns the
+ * output, a pooled texture valid until the end of the frame, or NULL.
+ */
+WGPUTextureView ssaoRender(Ssao* ssao,
+                           WGPUCommandEncoder encoder,
+                           const SsaoInput* input,
+                           const WGPUComputePassTimestampWrites* timestamps);
+
+#endif // SSAO_H
@@ -0,0 +1,410 @@
+#include "temporal.h"
+#include "webgpu-utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define kTemporalHasMotion 1u
+#define kTemporalReset 2u
+
+/**
+ * Uniform block of the resolve. Must match TemporalUniforms in
+ * kTemporalWGSL (96 bytes).
+ */
+typedef struct {
+    float reprojection[16];     // this frame's clip space -> previous frame's
+    float renderSize[2];
+    float outputSize[2];
+    float jitter[2];
+    uint32_t flags;
+    uint32_t _pad;
+} TemporalUniforms;
+
+static const char* const kTemporalWGSL[] = {
+"struct TemporalUniforms {\n"
+"    reprojection: mat4x4f,\n"
+"    renderSize: vec2f,\n"
+"    outputSize: vec2f,\n"
+"    jitter: vec2f,\n"
+"    flags: u32,\n"
+"}\n"
+"\n"
+"@group(0) @binding(0) var<uniform> taa: TemporalUniforms;\n"
+"@group(0) @binding(1) var color: texture_2d<f32>;\n"
+"@group(0) @binding(2) var depth: texture_depth_2d;\n"
+"@group(0) @binding(3) var motion: texture_2d<f32>;\n"
+"@group(0) @binding(4) var history: texture_2d<f32>;\n"
+"@group(0) @binding(5) var historySampler: sampler;\n"
+"@group(0) @binding(6) var resolved: texture_storage_2d<rgba16float, write>;\n"
+"\n"
+"const kHasMotion = 1u;\n"
+"const kReset = 2u;\n"
+"// Share of the current frame in the blend, far from / on a sample\n"
+"const kMinBlend = 0.04;\n"
+"const kMaxBlend = 0.2;\n"
+"// Width of the variance box, in standard deviations\n"
+"const kBoxGamma = 1.25;\n"
+"\n"
+"fn rgbToYCoCg(c: vec3f) -> vec3f {\n"
+"    return vec3f(0.25 * c.r + 0.5 * c.g + 0.25 * c.b,\n"
+"                 0.5 * c.r - 0.5 * c.b,\n"
+"                 -0.25 * c.r + 0.5 * c.g - 0.25 * c.b);\n"
+"}\n"
+"\n"
+"fn yCoCgToRgb(c: vec3f) -> vec3f {\n"
+"    return vec3f(c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z);\n"
+"}\n"
+"\n"
+"fn lumaWeight(c: vec3f) -> f32 {\n"
+"    return 1.0 / (1.0 + dot(c, vec3f(0.2126, 0.7152, 0.0722)));\n"
+"}\n"
+"\n"
+"fn tap(uv: vec2f) -> vec3f {\n"
+"    return textureSampleLevel(history, historySampler, uv, 0.0).rgb;\n"
+"}\n"
+"\n"
+"// Catmull-Rom with bilinear taps like the upscale, minus the four corner\n"
+"// taps, whose weights are small\n"
+"fn sampleHistory(uv: vec2f) -> vec3f {\n"
+"    let size = vec2f(textureDimensions(history));\n"
+"    let position = uv * size;\n"
+"    let center = floor(position - 0.5) + 0.5;\n"
+"    let f = position - center;\n"
+"\n"
+"    let w0 = f * (-0.5 + f * (1.0 - 0.5 * f));\n"
+"    let w1 = 1.0 + f * f * (-2.5 + 1.5 * f);\n"
+"    let w2 = f * (0.5 + f * (2.0 - 1.5 * f));\n"
+"    let w3 = f * f * (-0.5 + 0.5 * f);\n"
+"    let w12 = w1 + w2;\n"
+"\n"
+"    let uv0 = (center - 1.0) / size;\n"
+"    let uv12 = (center + w2 / w12) / size;\n"
+"    let uv3 = (center + 2.0) / size;\n"
+"\n"
+"    var sum = tap(vec2f(uv12.x, uv0.y)) * w12.x * w0.y;\n"
+"    sum += tap(vec2f(uv0.x, uv12.y)) * w0.x * w12.y;\n"
+"    sum += tap(vec2f(uv12.x, uv12.y)) * w12.x * w12.y;\n"
+"    sum += tap(vec2f(uv3.x, uv12.y)) * w3.x * w12.y;\n"
+"    sum += tap(vec2f(uv12.x, uv3.y)) * w12.x * w3.y;\n"
+"    let weight = w12.x * w0.y + w0.x * w12.y + w12.x * w12.y + w3.x * w12.y + w12.x * w3.y;\n"
+"    return max(sum / weight, vec3f(0.0));\n"
+"}\n"
+"\n"
+"// Offset from a UV of this frame to the previous frame's, for static geometry\n"
+"fn depthMotion(uv: vec2f, z: f32) -> vec2f {\n"
+"    let ndc = vec4f(uv.x * 2.0 - 1.0, 1.0 - uv.y * 2.0, z, 1.0);\n"
+"    let previous = taa.reprojection * ndc;\n"
+"    let previousNdc = previous.xy / previous.w;\n"
+"    return vec2f(previousNdc.x * 0.5 + 0.5, 0.5 - previousNdc.y * 0.5) - uv;\n"
+"}\n"
+"\n",
+"@compute @workgroup_size(8, 8)\n"
+"fn resolve(@builtin(global_invocation_id) id: vec3u) {\n"
+"    if (any(id.xy >= vec2u(taa.outputSize))) {\n"
+"        return;\n"
+"    }\n"
+"    let uv = (vec2f(id.xy) + 0.5) / taa.outputSize;\n"
+"    let position = uv * taa.renderSize;\n"
+"\n"
+"    // Render pixel i was shaded at i + 0.5 + jitter: start from the nearest\n"
+"    let nearest = vec2i(floor(position - taa.jitter));\n"
+"    let maxTexel = vec2i(taa.renderSize) - 1;\n"
+"    var sum = vec3f(0.0);\n"
+"    var weightSum = 0.0;\n"
+"    var peak = 0.0;\n"
+"    var moment1 = vec3f(0.0);\n"
+"    var moment2 = vec3f(0.0);\n"
+"    var closestDepth = 2.0;\n"
+"    var closestTexel = nearest;\n"
+"    for (var y = -1; y <= 1; y++) {\n"
+"        for (var x = -1; x <= 1; x++) {\n"
+"            let texel = clamp(nearest + vec2i(x, y), vec2i(0), maxTexel);\n"
+"            let c = max(textureLoad(color, texel, 0).rgb, vec3f(0.0));\n"
+"            // Gaussian fit of a Blackman-Harris window, in render pixels\n"
+"            let d = vec2f(texel) + 0.5 + taa.jitter - position;\n"
+"            let w = exp(-2.29 * dot(d, d));\n"
+"            let lw = w * lumaWeight(c);\n"
+"            sum += c * lw;\n"
+"            weightSum += lw;\n"
+"            peak = max(peak, w);\n"
+"\n"
+"            let ycocg = rgbToYCoCg(c);\n"
+"            moment1 += ycocg;\n"
+"            moment2 += ycocg * ycocg;\n"
+"\n"
+"            let z = textureLoad(depth, texel, 0);\n"
+"            if (z < closestDepth) {\n"
+"                closestDepth = z;\n"
+"                closestTexel = texel;\n"
+"            }\n"
+"        }\n"
+"    }\n"
+"    let current = sum / max(weightSum, 1e-5);\n"
+"\n"
+"    var velocity: vec2f;\n"
+"    if ((taa.flags & kHasMotion) != 0u) {\n"
+"        velocity = textureLoad(motion, closestTexel, 0).xy;\n"
+"    } else {\n"
+"        let closestUv = (vec2f(closestTexel) + 0.5 + taa.jitter) / taa.renderSize;\n"
+"        velocity = depthMotion(closestUv, closestDepth);\n"
+"    }\n"
+"    let previousUv = uv + velocity;\n"
+"\n"
+"    var result = current;\n"
+"    let onScreen = all(previousUv >= vec2f(0.0)) && all(previousUv <= vec2f(1.0));\n"
+"    if ((taa.flags & kReset) == 0u && onScreen) {\n"
+"        let mean = moment1 / 9.0;\n"
+"        let sigma = sqrt(max(moment2 / 9.0 - mean * mean, vec3f(0.0)));\n"
+"        let boxMin = mean - kBoxGamma * sigma;\n"
+"        let boxMax = mean + kBoxGamma * sigma;\n"
+"        let previous = yCoCgToRgb(clamp(rgbToYCoCg(sampleHistory(previousUv)), boxMin, boxMax));\n"
+"\n"
+"        let alpha = mix(kMinBlend, kMaxBlend, peak);\n"
+"        let currentWeight = alpha * lumaWeight(current);\n"
+"        let previousWeight = (1.0 - alpha) * lumaWeight(previous);\n"
+"        result = (current * currentWeight + previous * previousWeight) / (currentWeight + previousWeight);\n"
+"    }\n"
+"    textureStore(resolved, id.xy, vec4f(result, 1.0));\n"
+"}\n",
+};
+
+/** Radical inverse of `index` in `base`: the Halton sequence, in [0, 1). */
+static float halton(uint32_t index, uint32_t base)
+{
+    float result = 0.0f;
+    float fraction = 1.0f;
+    while (index > 0) {
+        fraction /= (float)base;
+        result += fraction * (float)(index % base);
+        index /= base;
+    }
+    return result;
+}
+
+static WGPUTexture createHistoryTexture(WGPUDevice device, uint32_t width, uint32_t height)
+{
+    WGPUTextureDescriptor desc = {0};
+    desc.label = "Temporal history";
+    desc.usage = WGPUTextureUsage_StorageBinding | WGPUTextureUsage_TextureBinding;
+    desc.dimension = WGPUTextureDimension_2D;
+    desc.size = (WGPUExtent3D){ width, height, 1 };
+    desc.format = kTemporalOutputFormat;
+    desc.mipLevelCount = 1;
+    desc.sampleCount = 1;
+    return wgpuDeviceCreateTexture(device, &desc);
+}
+
+static void releaseHistory(TemporalUpscaler* temporal)
+{
+    for (int i = 0; i < 2; ++i) {
+        if (temporal->historyViews[i]) wgpuTextureViewRelease(temporal->historyViews[i]);
+        if (temporal->historyTextures[i]) {
+            wgpuTextureDestroy(temporal->historyTextures[i]);
+            wgpuTextureRelease(temporal->historyTextures[i]);
+        }
+        temporal->historyViews[i] = NULL;
+        temporal->historyTextures[i] = NULL;
+    }
+}
+
+bool createTemporalUpscaler(TemporalUpscaler* temporal, WGPUDevice device, WGPUQueue queue)
+{
+    memset(temporal, 0, sizeof *temporal);
+    temporal->device = device;
+    temporal->queue = queue;
+    temporal->phaseCount = 8;
+    temporal->previousViewProj = mat4Identity();
+
+    WGPUShaderModule module = createShaderModuleFromParts(device, "Temporal shader", kTemporalWGSL,
+                                                          sizeof kTemporalWGSL / sizeof kTemporalWGSL[0]);
+    if (!module) return false;
+    temporal->pipeline = createComputePipeline(device, "Temporal resolve pipeline", module, "resolve");
+    wgpuShaderModuleRelease(module);
+
+    WGPUSamplerDescriptor samplerDesc = {0};
+    samplerDesc.label = "Temporal history sampler";
+    samplerDesc.addressModeU = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeV = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeW = WGPUAddressMode_ClampToEdge;
+    samplerDesc.magFilter = WGPUFilterMode_Linear;
+    samplerDesc.minFilter = WGPUFilterMode_Linear;
+    samplerDesc.mipmapFilter = WGPUMipmapFilterMode_Nearest;
+    samplerDesc.lodMinClamp = 0.0f;
+    samplerDesc.lodMaxClamp = 1.0f;
+    samplerDesc.maxAnisotropy = 1;
+    temporal->sampler = wgpuDeviceCreateSampler(device, &samplerDesc);
+
+    temporal->uniformBuffer = createBuffer(device, "Temporal uniforms", sizeof(TemporalUniforms),
+                                           WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+
+    WGPUTextureDescriptor motionDesc = {0};
+    motionDesc.label = "Temporal no motion";
+    motionDesc.usage = WGPUTextureUsage_TextureBinding;
+    motionDesc.dimension = WGPUTextureDimension_2D;
+    motionDesc.size = (WGPUExtent3D){ 1, 1, 1 };
+    motionDesc.format = kTemporalMotionFormat;
+    motionDesc.mipLevelCount = 1;
+    motionDesc.sampleCount = 1;
+    temporal->noMotionTexture = wgpuDeviceCreateTexture(device, &motionDesc);
+    if (temporal->noMotionTexture) {
+        temporal->noMotionView = wgpuTextureCreateView(temporal->noMotionTexture, NULL);
+    }
+
+    if (!temporal->pipeline || !temporal->sampler || !temporal->uniformBuffer || !temporal->noMotionView) {
+        fprintf(stderr, "createTemporalUpscaler: failed to create the resolve resources\n");
+        releaseTemporalUpscaler(temporal);
+        return false;
+    }
+    if (!temporalSetOutputSize(temporal, 1, 1)) {
+        releaseTemporalUpscaler(temporal);
+        return false;
+    }
+    return true;
+}
+
+void releaseTemporalUpscaler(TemporalUpscaler* temporal)
+{
+    releaseHistory(temporal);
+    if (temporal->noMotionView) wgpuTextureViewRelease(temporal->noMotionView);
+    if (temporal->noMotionTexture) {
+        wgpuTextureDestroy(temporal->noMotionTexture);
+        wgpuTextureRelease(temporal->noMotionTexture);
+    }
+    if (temporal->uniformBuffer) {
+        wgpuBufferDestroy(temporal->uniformBuffer);
+        wgpuBufferRelease(temporal->uniformBuffer);
+    }
+    if (temporal->sampler) wgpuSamplerRelease(temporal->sampler);
+    if (temporal->pipeline) wgpuComputePipelineRelease(temporal->pipeline);
+    memset(temporal, 0, sizeof *temporal);
+}
+
+bool temporalSetOutputSize(TemporalUpscaler* temporal, uint32_t width, uint32_t height)
+{
+    releaseHistory(temporal);
+    temporal->outputWidth = width;
+    temporal->outputHeight = height;
+    temporal->historyValid = false;
+
+    for (int i = 0; i < 2; ++i) {
+        temporal->historyTextures[i] = createHistoryTexture(temporal->device, width, height);
+        if (temporal->historyTextures[i]) {
+            temporal->historyViews[i] = wgpuTextureCreateView(temporal->historyTextures[i], NULL);
+        }
+        if (!temporal->historyViews[i]) {
+            fprintf(stderr, "temporalSetOutputSize: failed to create a %ux%u history\n", width, height);
+            releaseHistory(temporal);
+            return false;
+        }
+    }
+    return true;
+}
+
+void temporalReset(TemporalUpscaler* temporal)
+{
+    temporal->historyValid = false;
+}
+
+void temporalBeginFrame(TemporalUpscaler* temporal, uint32_t renderWidth, uint32_t renderHeight)
+{
+    temporal->renderWidth = renderWidth ? renderWidth : 1;
+    temporal->renderHeight = renderHeight ? renderHeight : 1;
+
+    // Fewer render pixels per output pixel need more phases to cover them all
+    float ratio = (float)temporal->outputWidth / (float)temporal->renderWidth;
+    uint32_t phaseCount = (uint32_t)ceilf(8.0f * ratio * ratio);
+    if (phaseCount < 8) phaseCount = 8;
+    if (phaseCount > kTemporalMaxPhases) phaseCount = kTemporalMaxPhases;
+    temporal->phaseCount = phaseCount;
+
+    // Halton index 0 is (0, 0) for every base: start at 1
+    uint32_t index = temporal->frameIndex++ % phaseCount + 1;
+    temporal->jitterX = halton(index, 2) - 0.5f;
+    temporal->jitterY = halton(index, 3) - 0.5f;
+}
+
+Mat4 temporalJitterProjection(const TemporalUpscaler* temporal, Mat4 projection)
+{
+    // Move clip space by the jitter times w, so a render pixel's center
+    // sees the scene at pixel + 0.5 + jitter (y down)
+    float dx = -2.0f * temporal->jitterX / (float)temporal->renderWidth;
+    float dy = 2.0f * temporal->jitterY / (float)temporal->renderHeight;
+    for (int column = 0; column < 4; ++column) {
+        float w = projection.m[column * 4 + 3];
+        projection.m[column * 4 + 0] += dx * w;
+        projection.m[column * 4 + 1] += dy * w;
+    }
+    return projection;
+}
+
+void temporalResolve(TemporalUpscaler* temporal,
+                     WGPUCommandEncoder encoder,
+                     const TemporalInput* input,
+                     const WGPUComputePassTimestampWrites* timestamps)
+{
+    uint32_t previous = temporal->current;
+    temporal->current ^= 1;
+
+    TemporalUniforms uniforms = {0};
+    Mat4 reprojection = mat4Mul(temporal->previousViewProj, mat4Inverse(input->viewProj));
+    memcpy(uniforms.reprojection, reprojection.m, sizeof uniforms.reprojection);
+    uniforms.renderSize[0] = (float)temporal->renderWidth;
+    uniforms.renderSize[1] = (float)temporal->renderHeight;
+    uniforms.outputSize[0] = (float)temporal->outputWidth;
+    uniforms.outputSize[1] = (float)temporal->outputHeight;
+    uniforms.jitter[0] = temporal->jitterX;
+    uniforms.jitter[1] = temporal->jitterY;
+    if (input->motion) uniforms.flags |= kTemporalHasMotion;
+    if (!temporal->historyValid) uniforms.flags |= kTemporalReset;
+    wgpuQueueWriteBuffer(temporal->queue, temporal->uniformBuffer, 0, &uniforms, sizeof uniforms);
+
+    temporal->previousViewProj = input->viewProj;
+    temporal->historyValid = true;
+
+    // The inputs come from the texture pool and the history alternates, so
+    // the bind group is made for this pass only
+    WGPUBindGroupEntry entries[7] = {0};
+    entries[0].binding = 0;
+    entries[0].buffer = temporal->uniformBuffer;
+    entries[0].size = sizeof(TemporalUniforms);
+    entries[1].binding = 1;
+    entries[1].textureView = input->color;
+    entries[2].binding = 2;
+    entries[2].textureView = input->depth;
+    entries[3].binding = 3;
+    entries[3].textureView = input->motion ? input->motion : temporal->noMotionView;
+    entries[4].binding = 4;
+    entries[4].textureView = temporal->historyViews[previous];
+    entries[5].binding = 5;
+    entries[5].sampler = temporal->sampler;
+    entries[6].binding = 6;
+    entries[6].textureView = temporal->historyViews[temporal->current];
+
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(temporal->pipeline, 0);
+    WGPUBindGroupDescriptor bindGroupDesc = {0};
+    bindGroupDesc.label = "Temporal bind group";
+    bindGroupDesc.layout = layout;
+    bindGroupDesc.entryCount = 7;
+    bindGroupDesc.entries = entries;
+    WGPUBindGroup bindGroup = wgpuDeviceCreateBindGroup(temporal->device, &bindGroupDesc);
+    wgpuBindGroupLayoutRelease(layout);
+    if (!bindGroup) return;
+
+    WGPUComputePassDescriptor passDesc = {0};
+    passDesc.label = "Temporal resolve pass";
+    passDesc.timestampWrites = timestamps;
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, &passDesc);
+    wgpuComputePassEncoderSetPipeline(pass, temporal->pipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, bindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, (temporal->outputWidth + 7) / 8,
+                                             (temporal->outputHeight + 7) / 8, 1);
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+    wgpuBindGroupRelease(bindGroup);
+}
+
+WGPUTextureView temporalOutput(const TemporalUpscaler* temporal)
+{
+    return temporal->historyViews[temporal->current];
+}
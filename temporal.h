@@ -0,0 +1,118 @@
+#ifndef TEMPORAL_H
+#define TEMPORAL_H
+
+#include "linalg.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * TEMPORAL UPSCALING
+ *
+ * Temporal anti-aliasing that also upscales: the scene is rendered at the
+ * (dynamic) render resolution with a different sub-pixel jitter every
+ * frame, and a compute pass accumulates those samples into a history at
+ * the output resolution. A still image converges to several samples per
+ * output pixel, so rendering half the pixels looks close to native.
+ *
+ * JITTER
+ *  The projection is offset by a Halton(2, 3) sequence in render pixels.
+ *  The sequence is longer when the render size is smaller relative to the
+ *  output (8 phases per output-to-render pixel ratio), so every output
+ *  pixel still gets covered.
+ *
+ * MOTION
+ *  The history is reprojected with per-pixel motion vectors, taken from
+ *  the nearest depth of the 3x3 neighbourhood so edges follow the
+ *  foreground. Renderers with moving objects supply a motion texture
+ *  (RG16Float, offset from this frame's UV to the previous frame's);
+ *  without one the motion of static geometry is reconstructed from depth
+ *  and the previous frame's view-projection.
+ *
+ * RESOLVE
+ *  - the current color at each output pixel is reconstructed from the 3x3
+ *    render pixels around it, weighted by their distance to the jittered
+ *    sample positions
+ *  - the history is fetched with a Catmull-Rom filter (it would blur after
+ *    a few bilinear reprojections) and clamped, in YCoCg, to the variance
+ *    box of the current neighbourhood, which rejects stale colors from
+ *    disocclusions and lighting changes
+ *  - the blend favours the current frame where a sample landed close to
+ *    the output pixel, and weights both by inverse luminance so HDR
+ *    highlights don't flicker
+ *
+ * The output is RGBA16Float at the output resolution, ready for
+ * post-processing or a 1:1 resolutionUpscale() to the surface.
+ *
+ * Per frame:
+ *      temporalBeginFrame(&temporal, renderWidth, renderHeight);
+ *      projection = temporalJitterProjection(&temporal, projection);
+ *      ... render color and depth at renderWidth x renderHeight ...
+ *      temporalResolve(&temporal, encoder, &input, timestamps);
+ *      ... read temporalOutput(&temporal) ...
+ */
+
+#define kTemporalOutputFormat WGPUTextureFormat_RGBA16Float
+#define kTemporalMotionFormat WGPUTextureFormat_RG16Float
+#define kTemporalMaxPhases 64
+
+typedef struct {
+    WGPUTextureView color;      // render size, filterable float
+    WGPUTextureView depth;      // render size, Depth32Float or Depth24Plus
+    WGPUTextureView motion;     // render size, kTemporalMotionFormat; NULL for static scenes
+    Mat4 viewProj;              // this frame's, without the jitter
+} TemporalInput;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+    uint32_t outputWidth, outputHeight;
+    uint32_t renderWidth, renderHeight;     // this frame's, from temporalBeginFrame()
+
+    // Jitter of this frame, in render pixels, within (-0.5, 0.5)
+    uint32_t frameIndex;
+    uint32_t phaseCount;
+    float jitterX, jitterY;
+
+    // History ping-pong at the output size; `current` is this frame's output
+    WGPUTexture historyTextures[2];
+    WGPUTextureView historyViews[2];
+    uint32_t current;
+    bool historyValid;
+    Mat4 previousViewProj;
+
+    WGPUComputePipeline pipeline;
+    WGPUSampler sampler;
+    WGPUBuffer uniformBuffer;
+    WGPUTexture noMotionTexture;            // bound when the input has no motion
+    WGPUTextureView noMotionView;
+} TemporalUpscaler;
+
+bool createTemporalUpscaler(TemporalUpscaler* temporal, WGPUDevice device, WGPUQueue queue);
+
+void releaseTemporalUpscaler(TemporalUpscaler* temporal);
+
+/** Recreate the history for a new output size. Drops the history. */
+bool temporalSetOutputSize(TemporalUpscaler* temporal, uint32_t width, uint32_t height);
+
+/** Drop the history, e.g. on a camera cut. */
+void temporalReset(TemporalUpscaler* temporal);
+
+/** Advance the jitter sequence. Call before rendering the scene. */
+void temporalBeginFrame(TemporalUpscaler* temporal, uint32_t renderWidth, uint32_t renderHeight);
+
+/** `projection` offset by this frame's jitter. */
+Mat4 temporalJitterProjection(const TemporalUpscaler* temporal, Mat4 projection);
+
+/** Record the resolve of this frame's render into the history, in its own compute pass. */
+void temporalResolve(TemporalUpscaler* temporal,
+                     WGPUCommandEncoder encoder,
+                     const TemporalInput* input,
+                     const WGPUComputePassTimestampWrites* timestamps);
+
+/** This frame's result, valid after temporalResolve(). */
+WGPUTextureView temporalOutput(const TemporalUpscaler* temporal);
+
+#endif // TEMPORAL_H
@@ -0,0 +1,538 @@
+#include "text.h"
+#include "jobs.h"
+#include "webgpu-utils.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Font cell: 5x8 pixels drawn, advancing by 6, lines 10 apart. */
+#define kFontColumns 5
+#define kFontRows 8
+#define kFontAdvance 6
+#define kFontLineHeight 10
+
+/** Distance field resolution and reach, per font pixel. */
+#define kSdfTexelsPerPixel 4
+#define kSdfSpread 1
+#define kSdfWidth ((kFontColumns + 2 * kSdfSpread) * kSdfTexelsPerPixel)
+#define kSdfHeight ((kFontRows + 2 * kSdfSpread) * kSdfTexelsPerPixel)
+#define kSolidSize 4
+
+#define kTextAtlasSize 512
+
+/**
+ * Printable ASCII, 5 columns per glyph, least significant bit at the top.
+ * Bit 7 holds descenders.
+ */
+static const uint8_t kFont5x8[kTextGlyphCount][kFontColumns] = {
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00}, // ' ' ! "
+    {0x14,0x7F,0x14,0x7F,0x14}, {0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62}, // # $ %
+    {0x36,0x49,0x56,0x20,0x50}, {0x00,0x08,0x07,0x03,0x00}, {0x00,0x1C,0x22,0x41,0x00}, // & ' (
+    {0x00,0x41,0x22,0x1C,0x00}, {0x2A,0x1C,0x7F,0x1C,0x2A}, {0x08,0x08,0x3E,0x08,0x08}, // ) * +
+    {0x00,0x80,0x70,0x30,0x00}, {0x08,0x08,0x08,0x08,0x08}, {0x00,0x00,0x60,0x60,0x00}, // , - .
+    {0x20,0x10,0x08,0x04,0x02}, {0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00}, // / 0 1
+    {0x72,0x49,0x49,0x49,0x46}, {0x21,0x41,0x49,0x4D,0x33}, {0x18,0x14,0x12,0x7F,0x10}, // 2 3 4
+    {0x27,0x45,0x45,0x45,0x39}, {0x3C,0x4A,0x49,0x49,0x31}, {0x41,0x21,0x11,0x09,0x07}, // 5 6 7
+    {0x36,0x49,0x49,0x49,0x36}, {0x46,0x49,0x49,0x29,0x1E}, {0x00,0x00,0x14,0x00,0x00}, // 8 9 :
+    {0x00,0x40,0x34,0x00,0x00}, {0x00,0x08,0x14,0x22,0x41}, {0x14,0x14,0x14,0x14,0x14}, // ; < =
+    {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x59,0x09,0x06}, {0x3E,0x41,0x5D,0x59,0x4E}, // > ? @
+    {0x7C,0x12,0x11,0x12,0x7C}, {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22}, // A B C
+    {0x7F,0x41,0x41,0x41,0x3E}, {0x7F,0x49,0x49,0x49,0x41}, {0x7F,0x09,0x09,0x09,0x01}, // D E F
+    {0x3E,0x41,0x41,0x51,0x73}, {0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00}, // G H I
+    {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41}, {0x7F,0x40,0x40,0x40,0x40}, // J K L
+    {0x7F,0x02,0x1C,0x02,0x7F}, {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E}, // M N O
+    {0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E}, {0x7F,0x09,0x19,0x29,0x46}, // P Q R
+    {0x26,0x49,0x49,0x49,0x32}, {0x03,0x01,0x7F,0x01,0x03}, {0x3F,0x40,0x40,0x40,0x3F}, // S T U
+    {0x1F,0x20,0x40,0x20,0x1F}, {0x3F,0x40,0x38,0x40,0x3F}, {0x63,0x14,0x08,0x14,0x63}, // V W X
+    {0x03,0x04,0x78,0x04,0x03}, {0x61,0x59,0x49,0x4D,0x43}, {0x00,0x7F,0x41,0x41,0x41}, // Y Z [
+    {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x41,0x7F}, {0x04,0x02,0x01,0x02,0x04}, // \ ] ^
+    {0x40,0x40,0x40,0x40,0x40}, {0x00,0x03,0x07,0x08,0x00}, {0x20,0x54,0x54,0x78,0x40}, // _ ` a
+    {0x7F,0x28,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x28}, {0x38,0x44,0x44,0x28,0x7F}, // b c d
+    {0x38,0x54,0x54,0x54,0x18}, {0x00,0x08,0x7E,0x09,0x02}, {0x18,0xA4,0xA4,0x9C,0x78}, // e f g
+    {0x7F,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7D,0x40,0x00}, {0x20,0x40,0x40,0x3D,0x00}, // h i j
+    {0x7F,0x10,0x28,0x44,0x00}, {0x00,0x41,0x7F,0x40,0x00}, {0x7C,0x04,0x78,0x04,0x78}, // k l m
+    {0x7C,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38}, {0xFC,0x18,0x24,0x24,0x18}, // n o p
+    {0x18,0x24,0x24,0x18,0xFC}, {0x7C,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x24}, // q r s
+    {0x04,0x04,0x3F,0x44,0x24}, {0x3C,0x40,0x40,0x20,0x7C}, {0x1C,0x20,0x40,0x20,0x1C}, // t u v
+    {0x3C,0x40,0x30,0x40,0x3C}, {0x44,0x28,0x10,0x28,0x44}, {0x4C,0x90,0x90,0x90,0x7C}, // w x y
+    {0x44,0x64,0x54,0x4C,0x44}, {0x00,0x08,0x36,0x41,0x00}, {0x00,0x00,0x77,0x00,0x00}, // z { |
+    {0x00,0x41,0x36,0x08,0x00}, {0x02,0x01,0x02,0x04,0x02},                             // } ~
+};
+
+static const char* kTextWGSL =
+"struct TextUniforms {\n"
+"    viewport: vec2f,\n"
+"}\n"
+"\n"
+"struct VertexInput {\n"
+"    @builtin(vertex_index) vertex: u32,\n"
+"    @location(0) rect: vec4f,\n"
+"    @location(1) uv: vec4f,\n"
+"    @location(2) color: vec4f,\n"
+"    @location(3) layer: u32,\n"
+"}\n"
+"\n"
+"struct VertexOutput {\n"
+"    @builtin(position) position: vec4f,\n"
+"    @location(0) uv: vec2f,\n"
+"    @location(1) color: vec4f,\n"
+"    @location(2) @interpolate(flat) layer: u32,\n"
+"}\n"
+"\n"
+"@group(0) @binding(0) var<uniform> uniforms: TextUniforms;\n"
+"@group(0) @binding(1) var glyphs: texture_2d_array<f32>;\n"
+"@group(0) @binding(2) var glyphSampler: sampler;\n"
+"\n"
+"@vertex\n"
+"fn vs_main(in: VertexInput) -> VertexOutput {\n"
+"    var corners = array<vec2f, 6>(\n"
+"        vec2f(0.0, 0.0), vec2f(1.0, 0.0), vec2f(0.0, 1.0),\n"
+"        vec2f(0.0, 1.0), vec2f(1.0, 0.0), vec2f(1.0, 1.0));\n"
+"    let corner = corners[in.vertex];\n"
+"    let pixel = in.rect.xy + corner * in.rect.zw;\n"
+"\n"
+"    var out: VertexOutput;\n"
+"    out.position = vec4f(pixel.x / uniforms.viewport.x * 2.0 - 1.0,\n"
+"                         1.0 - pixel.y / uniforms.viewport.y * 2.0, 0.0, 1.0);\n"
+"    out.uv = mix(in.uv.xy, in.uv.zw, corner);\n"
+"    out.color = in.color;\n"
+"    out.layer = in.layer;\n"
+"    return out;\n"
+"}\n"
+"\n"
+"@fragment\n"
+"fn fs_main(in: VertexOutput) -> @location(0) vec4f {\n"
+"    let distance = textureSample(glyphs, glyphSampler, in.uv, in.layer).r;\n"
+"    // Antialias over about one screen pixel, whatever the text size\n"
+"    let width = max(fwidth(distance), 1e-4) * 0.5;\n"
+"    let coverage = smoothstep(0.5 - width, 0.5 + width, distance);\n"
+"    return vec4f(in.color.rgb, in.color.a * coverage);\n"
+"}\n";
+
+static bool fontPixel(uint32_t glyph, int column, int row)
+{
+    if (column < 0 || column >= kFontColumns || row < 0 || row >= kFontRows) return false;
+    return (kFont5x8[glyph][column] >> row) & 1;
+}
+
+static bool glyphIsEmpty(uint32_t glyph)
+{
+    for (int column = 0; column < kFontColumns; ++column) {
+        if (kFont5x8[glyph][column]) return false;
+    }
+    return true;
+}
+
+/**
+ * Signed distance (in font pixels, positive inside) from a point of the
+ * glyph box to the outline of its lit pixels. The glyph is a union of
+ * squares, so the exact distance is the closest square of the other kind.
+ */
+static float glyphDistance(uint32_t glyph, float px, float py)
+{
+    bool inside = fontPixel(glyph, (int)floorf(px), (int)floorf(py));
+
+    float best = FLT_MAX;
+    if (inside) {
+        // Everything outside the glyph box is unlit
+        best = fminf(fminf(px, kFontColumns - px), fminf(py, kFontRows - py));
+    }
+    for (int row = 0; row < kFontRows; ++row) {
+        for (int column = 0; column < kFontColumns; ++column) {
+            if (fontPixel(glyph, column, row) == inside) continue;
+            float dx = fmaxf(fmaxf(column - px, px - (column + 1)), 0.0f);
+            float dy = fmaxf(fmaxf(row - py, py - (row + 1)), 0.0f);
+            best = fminf(best, sqrtf(dx * dx + dy * dy));
+        }
+    }
+    return inside ? best : -best;
+}
+
+static void rasterizeGlyphJob(void* userData, uint32_t glyph)
+{
+    uint8_t* field = (uint8_t*)userData + (size_t)glyph * kSdfWidth * kSdfHeight;
+    for (uint32_t y = 0; y < kSdfHeight; ++y) {
+        for (uint32_t x = 0; x < kSdfWidth; ++x) {
+            float px = (x + 0.5f) / kSdfTexelsPerPixel - kSdfSpread;
+            float py = (y + 0.5f) / kSdfTexelsPerPixel - kSdfSpread;
+            float d = glyphDistance(glyph, px, py);
+            float value = 0.5f + d / (2.0f * kSdfSpread);
+            value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+            field[y * kSdfWidth + x] = (uint8_t)(value * 255.0f + 0.5f);
+        }
+    }
+}
+
+static bool createGlyphs(TextRenderer* text)
+{
+    uint8_t* fields = malloc((size_t)kTextGlyphCount * kSdfWidth * kSdfHeight);
+    if (!fields) {
+        fprintf(stderr, "createTextRenderer: out of memory\n");
+        return false;
+    }
+    jobsParallelFor(kTextGlyphCount, rasterizeGlyphJob, fields);
+
+    // The atlas isn't thread-safe: insert once every field is ready
+    bool ok = true;
+    for (uint32_t glyph = 0; glyph < kTextGlyphCount && ok; ++glyph) {
+        if (glyphIsEmpty(glyph)) continue;
+        text->glyphHandles[glyph] = atlasInsert(&text->atlas, kSdfWidth, kSdfHeight,
+                                                fields + (size_t)glyph * kSdfWidth * kSdfHeight,
+                                                kSdfWidth);
+        ok = text->glyphHandles[glyph] != kAtlasInvalidHandle;
+    }
+    free(fields);
+
+    // Fully inside everywhere: sampled at its centre it gives solid quads
+    uint8_t solid[kSolidSize * kSolidSize];
+    memset(solid, 255, sizeof solid);
+    if (ok) {
+        text->solidHandle = atlasInsert(&text->atlas, kSolidSize, kSolidSize, solid, kSolidSize);
+        ok = text->solidHandle != kAtlasInvalidHandle;
+    }
+    return ok;
+}
+
+static void cacheGlyphRegions(TextRenderer* text)
+{
+    for (uint32_t glyph = 0; glyph < kTextGlyphCount; ++glyph) {
+        AtlasRegion region;
+        if (!atlasGetRegion(&text->atlas, text->glyphHandles[glyph], &region)) continue;
+        text->glyphs[glyph].uv[0] = (float)region.x / text->atlas.width;
+        text->glyphs[glyph].uv[1] = (float)region.y / text->atlas.height;
+        text->glyphs[glyph].uv[2] = (float)(region.x + region.width) / text->atlas.width;
+        text->glyphs[glyph].uv[3] = (float)(region.y + region.height) / text->atlas.height;
+        text->glyphs[glyph].layer = region.layer;
+    }
+    AtlasRegion region;
+    if (atlasGetRegion(&text->atlas, text->solidHandle, &region)) {
+        float u = (region.x + 0.5f * region.width) / text->atlas.width;
+        float v = (region.y + 0.5f * region.height) / text->atlas.height;
+        text->solid.uv[0] = text->solid.uv[2] = u;
+        text->solid.uv[1] = text->solid.uv[3] = v;
+        text->solid.layer = region.layer;
+    }
+    text->glyphGeneration = text->atlas.generation;
+}
+
+/** Repacking the atlas moves glyphs: look their regions up again. */
+static void refreshGlyphs(TextRenderer* text)
+{
+    if (text->glyphGeneration != text->atlas.generation) {
+        cacheGlyphRegions(text);
+    }
+}
+
+static WGPURenderPipeline createTextPipeline(WGPUDevice device, WGPUTextureFormat targetFormat)
+{
+    WGPUShaderModule module = createShaderModule(device, "Text shader", kTextWGSL);
+    if (!module) return NULL;
+
+    WGPUVertexAttribute attributes[4] = {
+        { WGPUVertexFormat_Float32x4, offsetof(TextInstance, rect), 0 },
+        { WGPUVertexFormat_Float32x4, offsetof(TextInstance, uv), 1 },
+        { WGPUVertexFormat_Unorm8x4, offsetof(TextInstance, color), 2 },
+        { WGPUVertexFormat_Uint32, offsetof(TextInstance, layer), 3 },
+    };
+    WGPUVertexBufferLayout instanceLayout = {0};
+    instanceLayout.arrayStride = sizeof(TextInstance);
+    instanceLayout.stepMode = WGPUVertexStepMode_Instance;
+    instanceLayout.attributeCount = 4;
+    instanceLayout.attributes = attributes;
+
+    WGPUBlendState blend = {0};
+    blend.color.operation = WGPUBlendOperation_Add;
+    blend.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+    blend.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    blend.alpha.operation = WGPUBlendOperation_Add;
+    blend.alpha.srcFactor = WGPUBlendFactor_One;
+    blend.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+
+    WGPUColorTargetState colorTarget = {0};
+    colorTarget.format = targetFormat;
+    colorTarget.blend = &blend;
+    colorTarget.writeMask = WGPUColorWriteMask_All;
+
+    WGPUFragmentState fragment = {0};
+    fragment.module = module;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &colorTarget;
+
+    WGPURenderPipelineDescriptor desc = {0};
+    desc.label = "Text pipeline";
+    desc.layout = NULL; // auto layout
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.vertex.bufferCount = 1;
+    desc.vertex.buffers = &instanceLayout;
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
+    desc.primitive.frontFace = WGPUFrontFace_CCW;
+    desc.primitive.cullMode = WGPUCullMode_None;
+    desc.depthStencil = NULL;
+    desc.multisample.count = 1;
+    desc.multisample.mask = ~0u;
+    desc.multisample.alphaToCoverageEnabled = false;
+    desc.fragment = &fragment;
+
+    WGPURenderPipeline pipeline = wgpuDeviceCreateRenderPipeline(device, &desc);
+    wgpuShaderModuleRelease(module);
+    if (!pipeline) {
+        fprintf(stderr, "Failed to create text pipeline\n");
+    }
+    return pipeline;
+}
+
+bool createTextRenderer(TextRenderer* text,
+                        WGPUDevice device,
+                        WGPUQueue queue,
+                        WGPUTextureFormat targetFormat)
+{
+    memset(text, 0, sizeof *text);
+    text->device = device;
+    text->queue = queue;
+
+    TextureAtlasDescriptor atlasDesc = {0};
+    atlasDesc.label = "Glyph atlas";
+    atlasDesc.width = kTextAtlasSize;
+    atlasDesc.height = kTextAtlasSize;
+    atlasDesc.layerCount = 1;
+    atlasDesc.format = WGPUTextureFormat_R8Unorm;
+    atlasDesc.padding = 1;
+    atlasDesc.defragThreshold = 0.5f;
+    if (!createTextureAtlas(&text->atlas, device, queue, &atlasDesc)) {
+        return false;
+    }
+    if (!createGlyphs(text)) {
+        releaseTextRenderer(text);
+        return false;
+    }
+    cacheGlyphRegions(text);
+
+    text->pipeline = createTextPipeline(device, targetFormat);
+
+    WGPUSamplerDescriptor samplerDesc = {0};
+    samplerDesc.label = "Glyph sampler";
+    samplerDesc.addressModeU = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeV = WGPUAddressMode_ClampToEdge;
+    samplerDesc.addressModeW = WGPUAddressMode_ClampToEdge;
+    samplerDesc.magFilter = WGPUFilterMode_Linear;
+    samplerDesc.minFilter = WGPUFilterMode_Linear;
+    samplerDesc.mipmapFilter = WGPUMipmapFilterMode_Nearest;
+    samplerDesc.lodMinClamp = 0.0f;
+    samplerDesc.lodMaxClamp = 1.0f;
+    samplerDesc.compare = WGPUCompareFunction_Undefined;
+    samplerDesc.maxAnisotropy = 1;
+    text->sampler = wgpuDeviceCreateSampler(device, &samplerDesc);
+
+    text->uniformBuffer = createBuffer(device, "Text uniforms", 4 * sizeof(float),
+                                       WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+
+    if (!text->pipeline || !text->sampler || !text->uniformBuffer) {
+        releaseTextRenderer(text);
+        return false;
+    }
+
+    WGPUBindGroupEntry entries[3] = {0};
+    entries[0].binding = 0;
+    entries[0].buffer = text->uniformBuffer;
+    entries[0].offset = 0;
+    entries[0].size = 4 * sizeof(float);
+    entries[1].binding = 1;
+    entries[1].textureView = text->atlas.view;
+    entries[2].binding = 2;
+    entries[2].sampler = text->sampler;
+
+    WGPUBindGroupLayout layout = wgpuRenderPipelineGetBindGroupLayout(text->pipeline, 0);
+    WGPUBindGroupDescriptor bindGroupDesc = {0};
+    bindGroupDesc.label = "Text bind group";
+    bindGroupDesc.layout = layout;
+    bindGroupDesc.entryCount = 3;
+    bindGroupDesc.entries = entries;
+    text->bindGroup = wgpuDeviceCreateBindGroup(device, &bindGroupDesc);
+    wgpuBindGroupLayoutRelease(layout);
+
+    if (!text->bindGroup) {
+        releaseTextRenderer(text);
+        return false;
+    }
+    return true;
+}
+
+void releaseTextRenderer(TextRenderer* text)
+{
+    if (text->bindGroup) wgpuBindGroupRelease(text->bindGroup);
+    if (text->pipeline) wgpuRenderPipelineRelease(text->pipeline);
+    if (text->sampler) wgpuSamplerRelease(text->sampler);
+
+    WGPUBuffer buffers[] = { text->uniformBuffer, text->instanceBuffer };
+    for (size_t i = 0; i < sizeof buffers / sizeof buffers[0]; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    releaseTextureAtlas(&text->atlas);
+    free(text->instances);
+    memset(text, 0, sizeof *text);
+}
+
+static bool reserveInstances(TextRenderer* text, size_t count)
+{
+    if (text->instanceCount + count <= text->instanceCapacity) return true;
+
+    size_t capacity = text->instanceCapacity ? text->instanceCapacity : 1024;
+    while (capacity < text->instanceCount + count) capacity *= 2;
+
+    TextInstance* instances = realloc(text->instances, capacity * sizeof *instances);
+    if (!instances) {
+        fprintf(stderr, "textDraw: out of memory\n");
+        return false;
+    }
+    text->instances = instances;
+    text->instanceCapacity = (uint32_t)capacity;
+    return true;
+}
+
+/**
+ * TEXT DRAW
+ *
+ * The hot path of every HUD: no allocation in the steady state, one table
+ * lookup and one instance write per character.
+ */
+float textDraw(TextRenderer* text, float x, float y, float size,
+               uint32_t color, const char* string)
+{
+    size_t length = strlen(string);
+    if (!reserveInstances(text, length)) return x;
+    refreshGlyphs(text);
+
+    float scale = size / kFontRows;
+    float margin = kSdfSpread * scale;
+    float quadWidth = (kFontColumns + 2 * kSdfSpread) * scale;
+    float quadHeight = (kFontRows + 2 * kSdfSpread) * scale;
+
+    float penX = x;
+    float penY = y;
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = (unsigned char)string[i];
+        if (c == '\n') {
+            penX = x;
+            penY += kFontLineHeight * scale;
+            continue;
+        }
+
+        uint32_t glyph = c - kTextFirstGlyph;
+        if (glyph >= kTextGlyphCount) glyph = '?' - kTextFirstGlyph;
+
+        if (text->glyphHandles[glyph] != kAtlasInvalidHandle) {
+            const TextGlyph* cached = &text->glyphs[glyph];
+            TextInstance* instance = &text->instances[text->instanceCount++];
+            instance->rect[0] = penX - margin;
+            instance->rect[1] = penY - margin;
+            instance->rect[2] = quadWidth;
+            instance->rect[3] = quadHeight;
+            memcpy(instance->uv, cached->uv, sizeof instance->uv);
+            instance->color = color;
+            instance->layer = cached->layer;
+        }
+        penX += kFontAdvance * scale;
+    }
+    return penX;
+}
+
+void textDrawRect(TextRenderer* text, float x, float y, float width, float height, uint32_t color)
+{
+    if (!reserveInstances(text, 1)) return;
+    refreshGlyphs(text);
+
+    TextInstance* instance = &text->instances[text->instanceCount++];
+    instance->rect[0] = x;
+    instance->rect[1] = y;
+    instance->rect[2] = width;
+    instance->rect[3] = height;
+    memcpy(instance->uv, text->solid.uv, sizeof instance->uv);
+    instance->color = color;
+    instance->layer = text->solid.layer;
+}
+
+float textPrintf(TextRenderer* text, float x, float y, float size,
+                 uint32_t color, const char* format, ...)
+{
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof buffer, format, args);
+    va_end(args);
+    return textDraw(text, x, y, size, color, buffer);
+}
+
+float textMeasure(float size, const char* string)
+{
+    uint32_t longest = 0;
+    uint32_t current = 0;
+    for (const char* c = string; *c; ++c) {
+        if (*c == '\n') {
+            current = 0;
+            continue;
+        }
+        if (++current > longest) longest = current;
+    }
+    // The last character's spacing column isn't part of the text
+    if (longest == 0) return 0.0f;
+    return (longest * kFontAdvance - (kFontAdvance - kFontColumns)) * size / kFontRows;
+}
+
+float textLineHeight(float size)
+{
+    return kFontLineHeight * size / kFontRows;
+}
+
+void textRendererUpload(TextRenderer* text, uint32_t viewportWidth, uint32_t viewportHeight)
+{
+    atlasFlush(&text->atlas);
+
+    float uniforms[4] = { (float)viewportWidth, (float)viewportHeight, 0.0f, 0.0f };
+    wgpuQueueWriteBuffer(text->queue, text->uniformBuffer, 0, uniforms, sizeof uniforms);
+
+    text->drawCount = 0;
+    if (text->instanceCount > text->instanceBufferCapacity) {
+        if (text->instanceBuffer) {
+            wgpuBufferDestroy(text->instanceBuffer);
+            wgpuBufferRelease(text->instanceBuffer);
+        }
+        text->instanceBufferCapacity = text->instanceCapacity;
+        text->instanceBuffer = createBuffer(text->device, "Text instances",
+                                            (uint64_t)text->instanceBufferCapacity * sizeof(TextInstance),
+                                            WGPUBufferUsage_Vertex | WGPUBufferUsage_CopyDst);
+        if (!text->instanceBuffer) {
+            text->instanceBufferCapacity = 0;
+            text->instanceCount = 0;
+            return;
+        }
+    }
+
+    if (text->instanceCount > 0) {
+        wgpuQueueWriteBuffer(text->queue, text->instanceBuffer, 0, text->instances,
+                             (size_t)text->instanceCount * sizeof(TextInstance));
+    }
+    text->drawCount = text->instanceCount;
+    text->instanceCount = 0;
+}
+
+void textRendererDraw(TextRenderer* text, WGPURenderPassEncoder pass)
+{
+    if (text->drawCount == 0) return;
+
+    wgpuRenderPassEncoderSetPipeline(pass, text->pipeline);
+    wgpuRenderPassEncoderSetBindGroup(pass, 0, text->bindGroup, 0, NULL);
+    wgpuRenderPassEncoderSetVertexBuffer(pass, 0, text->instanceBuffer, 0,
+                                         (uint64_t)text->drawCount * sizeof(TextInstance));
+    wgpuRenderPassEncoderDraw(pass, 6, text->drawCount, 0, 0);
+}
@@ -0,0 +1,116 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include "atlas.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * TEXT RENDERING
+ *
+ * A built-in 5x8 pixel font (printable ASCII) is turned into signed
+ * distance fields at startup, one glyph per job, and the fields are packed
+ * into an R8 atlas. Distance fields stay sharp under magnification, so one
+ * set of glyphs serves every text size.
+ *
+ * textDraw() only appends one 40-byte instance per visible glyph to a CPU
+ * array. textRendererUpload() copies the frame's instances to the GPU with
+ * a single WriteBuffer, and textRendererDraw() draws all of them with a
+ * single instanced draw call. Solid rectangles (textDrawRect()) are glyph
+ * instances too and share that draw.
+ *
+ * Coordinates are in pixels, with the origin at the top-left corner and
+ * (x, y) the top-left of the first character cell. `size` is the height
+ * of a character cell in pixels.
+ */
+
+#define kTextFirstGlyph 32
+#define kTextGlyphCount 95
+
+/** One glyph quad. Must match the vertex layout in text.c. */
+typedef struct {
+    float rect[4];              // x, y, width, height in pixels
+    float uv[4];                // u0, v0, u1, v1
+    uint32_t color;             // RGBA8, see textColor()
+    uint32_t layer;
+} TextInstance;
+
+typedef struct {
+    float uv[4];
+    uint32_t layer;
+} TextGlyph;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+
+    TextureAtlas atlas;
+    AtlasHandle glyphHandles[kTextGlyphCount];
+    TextGlyph glyphs[kTextGlyphCount];  // cached atlas regions
+    AtlasHandle solidHandle;            // opaque texels, for textDrawRect()
+    TextGlyph solid;
+    uint32_t glyphGeneration;           // atlas generation the cache matches
+
+    WGPURenderPipeline pipeline;
+    WGPUSampler sampler;
+    WGPUBuffer uniformBuffer;
+    WGPUBindGroup bindGroup;
+
+    WGPUBuffer instanceBuffer;
+    uint32_t instanceBufferCapacity;
+
+    TextInstance* instances;            // this frame's glyphs
+    uint32_t instanceCount;
+    uint32_t instanceCapacity;
+    uint32_t drawCount;                 // instances uploaded for drawing
+} TextRenderer;
+
+/** Pack a color for textDraw(). */
+static inline uint32_t textColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    return (uint32_t)r | (uint32_t)g << 8 | (uint32_t)b << 16 | (uint32_t)a << 24;
+}
+
+bool createTextRenderer(TextRenderer* text,
+                        WGPUDevice device,
+                        WGPUQueue queue,
+                        WGPUTextureFormat targetFormat);
+
+void releaseTextRenderer(TextRenderer* text);
+
+/**
+ * Queue a string ('\n' starts a new line). Returns the x coordinate
+ * where the next character would go.
+ */
+float textDraw(TextRenderer* text, float x, float y, float size,
+               uint32_t color, const char* string);
+
+/**
+ * Queue a solid rectangle. It is drawn with the text, in the same draw
+ * call, so HUD panels and graphs cost no extra draws.
+ */
+void textDrawRect(TextRenderer* text, float x, float y, float width, float height, uint32_t color);
+
+/** textDraw() with printf-style formatting. */
+float textPrintf(TextRenderer* text, float x, float y, float size,
+                 uint32_t color, const char* format, ...);
+
+/** Width in pixels of the longest line of `string`. */
+float textMeasure(float size, const char* string);
+
+/** Line height in pixels, for stacking lines of a given size. */
+float textLineHeight(float size);
+
+/**
+ * Upload this frame's glyphs (and any pending atlas changes), then start
+ * collecting the next frame.
+ */
+void textRendererUpload(TextRenderer* text, uint32_t viewportWidth, uint32_t viewportHeight);
+
+/** Draw everything uploaded by the last textRendererUpload(). */
+void textRendererDraw(TextRenderer* text, WGPURenderPassEncoder pass);
+
+#endif // TEXT_H
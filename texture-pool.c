@@ -0,0 +1,130 @@
+#include "texture-pool.h"
+#include "webgpu-utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void createTexturePool(TexturePool* pool, WGPUDevice device, uint32_t maxIdleFrames)
+{
+    memset(pool, 0, sizeof *pool);
+    pool->device = device;
+    pool->maxIdleFrames = maxIdleFrames;
+}
+
+static void destroyPooledTexture(PooledTexture* texture)
+{
+    if (texture->view) wgpuTextureViewRelease(texture->view);
+    if (texture->texture) {
+        wgpuTextureDestroy(texture->texture);
+        wgpuTextureRelease(texture->texture);
+    }
+    free(texture);
+}
+
+void releaseTexturePool(TexturePool* pool)
+{
+    for (uint32_t i = 0; i < pool->count; ++i) {
+        destroyPooledTexture(pool->textures[i]);
+    }
+    free(pool->textures);
+    memset(pool, 0, sizeof *pool);
+}
+
+static bool sameDesc(const TexturePoolDesc* a, const TexturePoolDesc* b)
+{
+    return a->width == b->width && a->height == b->height && a->format == b->format &&
+           a->usage == b->usage && a->sampleCount == b->sampleCount;
+}
+
+static uint64_t textureBytes(const TexturePoolDesc* desc)
+{
+    uint32_t blockWidth, blockHeight, bytesPerBlock;
+    if (!textureFormatBlockInfo(desc->format, &blockWidth, &blockHeight, &bytesPerBlock)) {
+        // Depth formats: close enough for the stats
+        blockWidth = blockHeight = 1;
+        bytesPerBlock = 4;
+    }
+    uint64_t blocks = (uint64_t)((desc->width + blockWidth - 1) / blockWidth) *
+                      ((desc->height + blockHeight - 1) / blockHeight);
+    return blocks * bytesPerBlock * desc->sampleCount;
+}
+
+PooledTexture* texturePoolAcquire(TexturePool* pool, const TexturePoolDesc* desc)
+{
+    TexturePoolDesc key = *desc;
+    if (key.sampleCount == 0) key.sampleCount = 1;
+
+    for (uint32_t i = 0; i < pool->count; ++i) {
+        PooledTexture* texture = pool->textures[i];
+        if (!texture->inUse && sameDesc(&texture->desc, &key)) {
+            texture->inUse = true;
+            texture->lastUsedFrame = pool->frame;
+            return texture;
+        }
+    }
+
+    if (pool->count == pool->capacity) {
+        uint32_t capacity = pool->capacity ? pool->capacity * 2 : 16;
+        PooledTexture** textures = realloc(pool->textures, capacity * sizeof *textures);
+        if (!textures) {
+            fprintf(stderr, "texturePoolAcquire: out of memory\n");
+            return NULL;
+        }
+        pool->textures = textures;
+        pool->capacity = capacity;
+    }
+
+    PooledTexture* texture = calloc(1, sizeof *texture);
+    if (!texture) {
+        fprintf(stderr, "texturePoolAcquire: out of memory\n");
+        return NULL;
+    }
+    WGPUTextureDescriptor textureDesc = {0};
+    textureDesc.label = "Pooled texture";
+    textureDesc.usage = key.usage;
+    textureDesc.dimension = WGPUTextureDimension_2D;
+    textureDesc.size = (WGPUExtent3D){ key.width, key.height, 1 };
+    textureDesc.format = key.format;
+    textureDesc.mipLevelCount = 1;
+    textureDesc.sampleCount = key.sampleCount;
+    texture->texture = wgpuDeviceCreateTexture(pool->device, &textureDesc);
+    texture->view = texture->texture ? wgpuTextureCreateView(texture->texture, NULL) : NULL;
+    if (!texture->view) {
+        fprintf(stderr, "texturePoolAcquire: failed to create a %ux%u texture\n", key.width, key.height);
+        destroyPooledTexture(texture);
+        return NULL;
+    }
+    texture->desc = key;
+    texture->bytes = textureBytes(&key);
+    texture->lastUsedFrame = pool->frame;
+    texture->inUse = true;
+
+    pool->textures[pool->count++] = texture;
+    pool->memoryBytes += texture->bytes;
+    pool->createdCount++;
+    return texture;
+}
+
+void texturePoolRelease(TexturePool* pool, PooledTexture* texture)
+{
+    (void)pool;
+    texture->inUse = false;
+}
+
+void texturePoolEndFrame(TexturePool* pool)
+{
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < pool->count; ++i) {
+        PooledTexture* texture = pool->textures[i];
+        texture->inUse = false;
+        if (pool->frame - texture->lastUsedFrame > pool->maxIdleFrames) {
+            pool->memoryBytes -= texture->bytes;
+            destroyPooledTexture(texture);
+        } else {
+            pool->textures[kept++] = texture;
+        }
+    }
+    pool->count = kept;
+    pool->frame++;
+}
@@ -0,0 +1,71 @@
+#ifndef TEXTURE_POOL_H
+#define TEXTURE_POOL_H
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * TEXTURE POOL
+ *
+ * Transient render targets (scene color at the current render resolution,
+ * post-processing intermediates, ...) are acquired from the pool when a
+ * pass needs them instead of being owned by the pass. A released texture
+ * is handed to the next acquire with the same description, in the same
+ * frame or a later one, so passes that don't overlap share memory.
+ *
+ * Everything still acquired is released by texturePoolEndFrame(), and
+ * textures that nobody acquired for `maxIdleFrames` frames are destroyed:
+ * a size that changes over time (dynamic resolution) only allocates the
+ * first time each size is seen, and sizes that stop being used are freed.
+ *
+ * Pooled textures have a single mip level and their default view. A view
+ * is only good for the frame it was acquired in, since the next acquire
+ * may return another texture: bind groups on pooled views are made per
+ * frame and released once the frame is recorded.
+ */
+
+typedef struct {
+    uint32_t width, height;
+    WGPUTextureFormat format;
+    WGPUTextureUsageFlags usage;
+    uint32_t sampleCount;       // 0 means 1
+} TexturePoolDesc;
+
+typedef struct {
+    WGPUTexture texture;
+    WGPUTextureView view;
+    TexturePoolDesc desc;
+    uint64_t lastUsedFrame;
+    uint64_t bytes;
+    bool inUse;
+} PooledTexture;
+
+typedef struct {
+    WGPUDevice device;
+    PooledTexture** textures;   // stable pointers, handed out by acquire
+    uint32_t count;
+    uint32_t capacity;
+    uint64_t frame;
+    uint32_t maxIdleFrames;
+
+    // Stats
+    uint64_t memoryBytes;       // approximate, every pooled texture
+    uint32_t createdCount;      // total allocations since creation
+} TexturePool;
+
+void createTexturePool(TexturePool* pool, WGPUDevice device, uint32_t maxIdleFrames);
+
+void releaseTexturePool(TexturePool* pool);
+
+/** A free texture matching `desc`, created if there is none. NULL on failure. */
+PooledTexture* texturePoolAcquire(TexturePool* pool, const TexturePoolDesc* desc);
+
+/** Give a texture back before the end of the frame, for later passes to reuse. */
+void texturePoolRelease(TexturePool* pool, PooledTexture* texture);
+
+/** Release everything still acquired and free long-unused textures. */
+void texturePoolEndFrame(TexturePool* pool);
+
+#endif // TEXTURE_POOL_H
@@ -0,0 +1,336 @@
+#include "texture-stream.h"
+#include "webgpu-utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Levels this size or smaller form the always-resident mip tail. */
+#define kMipTailSize 64
+
+static uint32_t mipExtent(uint32_t size, uint32_t level)
+{
+    uint32_t s = size >> level;
+    return s ? s : 1;
+}
+
+static uint64_t mipByteSize(const StreamedTexture* t, uint32_t level)
+{
+    uint64_t blocksWide = (mipExtent(t->desc.width, level) + t->blockWidth - 1) / t->blockWidth;
+    uint64_t blocksHigh = (mipExtent(t->desc.height, level) + t->blockHeight - 1) / t->blockHeight;
+    return blocksWide * blocksHigh * t->bytesPerBlock;
+}
+
+/**
+ * First level of the tail: the largest level that fits in kMipTailSize and
+ * whose size is still a whole number of blocks, since a compressed texture
+ * needs a block-aligned level 0.
+ */
+static uint32_t computeTailMip(const StreamedTexture* t)
+{
+    uint32_t tail = t->desc.mipCount - 1;
+    for (uint32_t level = 0; level < t->desc.mipCount; ++level) {
+        uint32_t w = mipExtent(t->desc.width, level);
+        uint32_t h = mipExtent(t->desc.height, level);
+        if (w <= kMipTailSize && h <= kMipTailSize) {
+            tail = level;
+            break;
+        }
+    }
+    while (tail > 0 &&
+           (mipExtent(t->desc.width, tail) % t->blockWidth != 0 ||
+            mipExtent(t->desc.height, tail) % t->blockHeight != 0)) {
+        tail--;
+    }
+    return tail;
+}
+
+/** GPU texture holding levels [firstMip, mipCount). */
+static WGPUTexture createResidentTexture(TextureStreamer* s, const StreamedTexture* t, uint32_t firstMip)
+{
+    WGPUTextureDescriptor desc = {0};
+    desc.label = t->desc.label;
+    desc.usage = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst | WGPUTextureUsage_CopySrc;
+    desc.dimension = WGPUTextureDimension_2D;
+    desc.size.width = mipExtent(t->desc.width, firstMip);
+    desc.size.height = mipExtent(t->desc.height, firstMip);
+    desc.size.depthOrArrayLayers = 1;
+    desc.format = t->desc.format;
+    desc.mipLevelCount = t->desc.mipCount - firstMip;
+    desc.sampleCount = 1;
+    return wgpuDeviceCreateTexture(s->device, &desc);
+}
+
+/** Upload one source level into level `gpuLevel` of the resident texture. */
+static void uploadMip(TextureStreamer* s, StreamedTexture* t, WGPUTexture texture,
+                      uint32_t mipLevel, uint32_t gpuLevel, const void* data, size_t size)
+{
+    uint32_t w = mipExtent(t->desc.width, mipLevel);
+    uint32_t h = mipExtent(t->desc.height, mipLevel);
+    uint32_t blocksWide = (w + t->blockWidth - 1) / t->blockWidth;
+    uint32_t blocksHigh = (h + t->blockHeight - 1) / t->blockHeight;
+
+    WGPUImageCopyTexture destination = {0};
+    destination.texture = texture;
+    destination.mipLevel = gpuLevel;
+    destination.aspect = WGPUTextureAspect_All;
+
+    WGPUTextureDataLayout layout = {0};
+    layout.offset = 0;
+    layout.bytesPerRow = blocksWide * t->bytesPerBlock;
+    layout.rowsPerImage = blocksHigh;
+
+    // Copy extents of compressed levels are in whole blocks
+    WGPUExtent3D extent = { blocksWide * t->blockWidth, blocksHigh * t->blockHeight, 1 };
+    wgpuQueueWriteTexture(s->queue, &destination, data, size, &layout, &extent);
+}
+
+/**
+ * Move to a texture whose finest level is `newTop`, copying every level
+ * both textures have in common.
+ */
+static bool reallocate(TextureStreamer* s, StreamedTexture* t, uint32_t newTop,
+                       WGPUCommandEncoder encoder)
+{
+    WGPUTexture texture = createResidentTexture(s, t, newTop);
+    if (!texture) {
+        fprintf(stderr, "Texture streaming: could not allocate '%s' at mip %u\n",
+                t->desc.label ? t->desc.label : "", newTop);
+        return false;
+    }
+
+    uint32_t first = newTop > t->residentMip ? newTop : t->residentMip;
+    for (uint32_t level = first; level < t->desc.mipCount; ++level) {
+        WGPUImageCopyTexture src = {0};
+        src.texture = t->texture;
+        src.mipLevel = level - t->residentMip;
+        src.aspect = WGPUTextureAspect_All;
+
+        WGPUImageCopyTexture dst = {0};
+        dst.texture = texture;
+        dst.mipLevel = level - newTop;
+        dst.aspect = WGPUTextureAspect_All;
+
+        uint32_t w = mipExtent(t->desc.width, level);
+        uint32_t h = mipExtent(t->desc.height, level);
+        WGPUExtent3D extent = {
+            (w + t->blockWidth - 1) / t->blockWidth * t->blockWidth,
+            (h + t->blockHeight - 1) / t->blockHeight * t->blockHeight,
+            1
+        };
+        wgpuCommandEncoderCopyTextureToTexture(encoder, &src, &dst, &extent);
+    }
+
+    // Released, not destroyed: the copies above still read from it
+    wgpuTextureViewRelease(t->view);
+    wgpuTextureRelease(t->texture);
+
+    t->texture = texture;
+    t->view = wgpuTextureCreateView(texture, NULL);
+    t->residentMip = newTop;
+    t->generation++;
+    return true;
+}
+
+bool createTextureStreamer(TextureStreamer* streamer,
+                           WGPUDevice device,
+                           WGPUQueue queue,
+                           uint64_t uploadBudget,
+                           uint64_t memoryBudget)
+{
+    memset(streamer, 0, sizeof *streamer);
+    streamer->device = device;
+    streamer->queue = queue;
+    streamer->uploadBudget = uploadBudget;
+    streamer->memoryBudget = memoryBudget;
+    return true;
+}
+
+void releaseTextureStreamer(TextureStreamer* streamer)
+{
+    for (size_t i = 0; i < streamer->textureCount; ++i) {
+        StreamedTexture* t = streamer->textures[i];
+        wgpuTextureViewRelease(t->view);
+        wgpuTextureDestroy(t->texture);
+        wgpuTextureRelease(t->texture);
+        free(t);
+    }
+    free(streamer->textures);
+    memset(streamer, 0, sizeof *streamer);
+}
+
+/**
+ * STREAM TEXTURE
+ */
+StreamedTexture* streamTexture(TextureStreamer* streamer,
+                               const StreamedTextureDescriptor* desc)
+{
+    if (desc->mipCount == 0 || !desc->source) {
+        fprintf(stderr, "streamTexture: '%s' needs mips and a source\n", desc->label ? desc->label : "");
+        return NULL;
+    }
+
+    StreamedTexture* t = calloc(1, sizeof *t);
+    if (!t) return NULL;
+    t->desc = *desc;
+    if (!textureFormatBlockInfo(desc->format, &t->blockWidth, &t->blockHeight, &t->bytesPerBlock)) {
+        fprintf(stderr, "streamTexture: unsupported format 0x%x\n", (unsigned)desc->format);
+        free(t);
+        return NULL;
+    }
+
+    if (streamer->textureCount == streamer->textureCapacity) {
+        size_t capacity = streamer->textureCapacity ? streamer->textureCapacity * 2 : 64;
+        StreamedTexture** textures = realloc(streamer->textures, capacity * sizeof *textures);
+        if (!textures) {
+            free(t);
+            return NULL;
+        }
+        streamer->textures = textures;
+        streamer->textureCapacity = capacity;
+    }
+
+    t->tailMip = computeTailMip(t);
+    t->residentMip = t->tailMip;
+    t->requestedMip = desc->mipCount;
+    t->texture = createResidentTexture(streamer, t, t->tailMip);
+    if (!t->texture) {
+        free(t);
+        return NULL;
+    }
+    t->view = wgpuTextureCreateView(t->texture, NULL);
+
+    for (uint32_t level = t->tailMip; level < desc->mipCount; ++level) {
+        size_t size = 0;
+        const void* data = desc->source(desc->userData, level, &size);
+        if (!data || size < mipByteSize(t, level)) {
+            fprintf(stderr, "streamTexture: '%s' is missing tail mip %u\n",
+                    desc->label ? desc->label : "", level);
+            continue;
+        }
+        uploadMip(streamer, t, t->texture, level, level - t->tailMip, data, size);
+        t->residentBytes += mipByteSize(t, level);
+    }
+
+    streamer->residentBytes += t->residentBytes;
+    streamer->textures[streamer->textureCount++] = t;
+    return t;
+}
+
+void requestTextureMip(TextureStreamer* streamer, StreamedTexture* texture, uint32_t mipLevel)
+{
+    if (mipLevel >= texture->desc.mipCount) mipLevel = texture->desc.mipCount - 1;
+    if (mipLevel < texture->requestedMip) texture->requestedMip = mipLevel;
+    texture->lastUsedFrame = streamer->frame;
+}
+
+uint32_t estimateRequiredMip(const StreamedTexture* texture, float screenPixels)
+{
+    uint32_t size = texture->desc.width > texture->desc.height ? texture->desc.width : texture->desc.height;
+    if (screenPixels < 1.0f) screenPixels = 1.0f;
+
+    float level = log2f((float)size / screenPixels);
+    if (level <= 0.0f) return 0;
+    uint32_t mip = (uint32_t)level;
+    return mip < texture->desc.mipCount ? mip : texture->desc.mipCount - 1;
+}
+
+/** Biggest missing gap first, most recently used first on ties. */
+static int comparePromotionPriority(const void* pa, const void* pb)
+{
+    const StreamedTexture* a = *(StreamedTexture* const*)pa;
+    const StreamedTexture* b = *(StreamedTexture* const*)pb;
+    uint32_t gapA = a->residentMip - a->requestedMip;
+    uint32_t gapB = b->residentMip - b->requestedMip;
+    if (gapA != gapB) return gapA > gapB ? -1 : 1;
+    return (a->lastUsedFrame < b->lastUsedFrame) - (a->lastUsedFrame > b->lastUsedFrame);
+}
+
+static StreamedTexture* findEvictionCandidate(TextureStreamer* s, bool allowUsedThisFrame)
+{
+    StreamedTexture* oldest = NULL;
+    for (size_t i = 0; i < s->textureCount; ++i) {
+        StreamedTexture* t = s->textures[i];
+        if (t->residentMip >= t->tailMip) continue;
+        if (!allowUsedThisFrame && t->lastUsedFrame == s->frame) continue;
+        if (!oldest || t->lastUsedFrame < oldest->lastUsedFrame) oldest = t;
+    }
+    return oldest;
+}
+
+/**
+ * UPDATE TEXTURE STREAMER
+ *
+ * 1. Promote: textures missing requested levels get one more level each,
+ *    in priority order, until the upload budget is spent. A promotion that
+ *    would exceed the memory budget first tries to make room by evicting
+ *    textures that were not used this frame.
+ * 2. Evict: while over the memory budget, drop the finest level of the
+ *    least recently used texture.
+ */
+void updateTextureStreamer(TextureStreamer* streamer, WGPUCommandEncoder encoder)
+{
+    streamer->uploadedBytes = 0;
+    streamer->promotions = 0;
+    streamer->evictions = 0;
+
+    StreamedTexture** wanting = malloc(streamer->textureCount * sizeof *wanting);
+    size_t wantingCount = 0;
+    for (size_t i = 0; wanting && i < streamer->textureCount; ++i) {
+        StreamedTexture* t = streamer->textures[i];
+        if (t->requestedMip < t->residentMip) wanting[wantingCount++] = t;
+    }
+    if (wanting) qsort(wanting, wantingCount, sizeof *wanting, comparePromotionPriority);
+
+    for (size_t i = 0; i < wantingCount; ++i) {
+        StreamedTexture* t = wanting[i];
+        uint32_t level = t->residentMip - 1;
+        uint64_t bytes = mipByteSize(t, level);
+
+        if (streamer->uploadedBytes + bytes > streamer->uploadBudget &&
+            streamer->uploadedBytes > 0) {
+            continue; // try smaller uploads; an oversized level still goes alone
+        }
+
+        while (streamer->residentBytes + bytes > streamer->memoryBudget) {
+            StreamedTexture* victim = findEvictionCandidate(streamer, false);
+            if (!victim) break;
+            uint64_t freed = mipByteSize(victim, victim->residentMip);
+            if (!reallocate(streamer, victim, victim->residentMip + 1, encoder)) break;
+            victim->residentBytes -= freed;
+            streamer->residentBytes -= freed;
+            streamer->evictions++;
+        }
+        if (streamer->residentBytes + bytes > streamer->memoryBudget) continue;
+
+        size_t size = 0;
+        const void* data = t->desc.source(t->desc.userData, level, &size);
+        if (!data || size < bytes) continue;
+
+        if (!reallocate(streamer, t, level, encoder)) continue;
+        uploadMip(streamer, t, t->texture, level, 0, data, size);
+
+        t->residentBytes += bytes;
+        streamer->residentBytes += bytes;
+        streamer->uploadedBytes += bytes;
+        streamer->promotions++;
+    }
+    free(wanting);
+
+    while (streamer->residentBytes > streamer->memoryBudget) {
+        StreamedTexture* victim = findEvictionCandidate(streamer, true);
+        if (!victim) break;
+        uint64_t freed = mipByteSize(victim, victim->residentMip);
+        if (!reallocate(streamer, victim, victim->residentMip + 1, encoder)) break;
+        victim->residentBytes -= freed;
+        streamer->residentBytes -= freed;
+        streamer->evictions++;
+    }
+
+    // Requests are per frame
+    for (size_t i = 0; i < streamer->textureCount; ++i) {
+        streamer->textures[i]->requestedMip = streamer->textures[i]->desc.mipCount;
+    }
+    streamer->frame++;
+}
@@ -0,0 +1,114 @@
+#ifndef TEXTURE_STREAM_H
+#define TEXTURE_STREAM_H
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * TEXTURE STREAMING
+ *
+ * Textures start with only their mip tail (every level of 64x64 or less)
+ * resident, and finer levels are streamed in one level per texture per
+ * frame, as they are requested, within a per-frame upload budget.
+ *
+ * WebGPU has no sparse/partially resident textures, so the resident range
+ * [residentMip, mipCount) lives in its own GPU texture whose level 0 is
+ * the finest resident mip. Gaining or dropping a level reallocates that
+ * texture and copies the levels that are kept on the GPU. Whenever that
+ * happens `generation` is bumped: views and bind groups built from the old
+ * texture must be recreated.
+ *
+ * Under the memory budget, the finest level of the least recently used
+ * texture is evicted first. Mip tails are never evicted.
+ */
+
+/**
+ * Supplies the pixels of one mip level, tightly packed (rows of whole
+ * blocks, no padding). Returns NULL if the data isn't available (yet); the
+ * streamer simply retries on a later frame.
+ */
+typedef const void* (*TextureMipSource)(void* userData, uint32_t mipLevel, size_t* size);
+
+typedef struct {
+    const char* label;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    WGPUTextureFormat format;
+    TextureMipSource source;
+    void* userData;
+} StreamedTextureDescriptor;
+
+typedef struct {
+    StreamedTextureDescriptor desc;
+    uint32_t blockWidth, blockHeight, bytesPerBlock;
+
+    WGPUTexture texture;        // holds levels [residentMip, mipCount)
+    WGPUTextureView view;
+    uint32_t generation;        // bumped every time texture/view change
+
+    uint32_t tailMip;           // first level of the always-resident tail
+    uint32_t residentMip;       // finest resident level
+    uint32_t requestedMip;      // finest level requested this frame
+    uint64_t lastUsedFrame;
+    uint64_t residentBytes;
+} StreamedTexture;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+
+    StreamedTexture** textures;
+    size_t textureCount;
+    size_t textureCapacity;
+
+    uint64_t frame;
+    uint64_t uploadBudget;      // bytes uploaded per frame
+    uint64_t memoryBudget;      // bytes resident across all textures
+    uint64_t residentBytes;
+
+    // Stats for the last update
+    uint64_t uploadedBytes;
+    uint32_t promotions;
+    uint32_t evictions;
+} TextureStreamer;
+
+bool createTextureStreamer(TextureStreamer* streamer,
+                           WGPUDevice device,
+                           WGPUQueue queue,
+                           uint64_t uploadBudget,
+                           uint64_t memoryBudget);
+
+void releaseTextureStreamer(TextureStreamer* streamer);
+
+/**
+ * Register a texture and upload its mip tail right away (ignoring the
+ * upload budget, so that something can always be sampled).
+ */
+StreamedTexture* streamTexture(TextureStreamer* streamer,
+                               const StreamedTextureDescriptor* desc);
+
+/**
+ * Ask for `mipLevel` to be resident. Call every frame the texture is
+ * used; the finest request of the frame wins.
+ */
+void requestTextureMip(TextureStreamer* streamer, StreamedTexture* texture, uint32_t mipLevel);
+
+/**
+ * CPU estimate of the mip level needed to draw the texture over roughly
+ * `screenPixels` pixels along its larger axis (e.g. the projected diameter
+ * of the object using it).
+ */
+uint32_t estimateRequiredMip(const StreamedTexture* texture, float screenPixels);
+
+/**
+ * Schedule this frame's uploads and evictions. Copies between the old and
+ * new GPU textures are recorded into `encoder`, which must be submitted
+ * before the new views are sampled.
+ */
+void updateTextureStreamer(TextureStreamer* streamer, WGPUCommandEncoder encoder);
+
+#endif // TEXTURE_STREAM_H
@@ -0,0 +1,526 @@
+#include "visibility-buffer.h"
+#include "webgpu-utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Uniform block of both passes. Must match VisUniforms in kVisCommonWGSL
+ * (144 bytes).
+ */
+typedef struct {
+    float viewProj[16];
+    float view[16];
+    float screenSize[2];
+    float _pad[2];
+} VisUniforms;
+
+#define kVisCommonWGSL \
+"struct VisUniforms {\n" \
+"    viewProj: mat4x4f,\n" \
+"    view: mat4x4f,\n" \
+"    screenSize: vec2f,\n" \
+"}\n" \
+"struct Vertex {\n" \
+"    px: f32, py: f32, pz: f32,\n" \
+"    nx: f32, ny: f32, nz: f32,\n" \
+"}\n" \
+"struct Instance {\n" \
+"    model: mat4x4f,\n" \
+"    firstIndex: u32,\n" \
+"    indexCount: u32,\n" \
+"    baseVertex: u32,\n" \
+"    color: u32,\n" \
+"}\n" \
+"\n" \
+"const kTriangleBits = 20u;\n" \
+"const kTriangleMask = (1u << kTriangleBits) - 1u;\n" \
+"const kEmpty = 0xffffffffu;\n" \
+"\n" \
+"@group(0) @binding(0) var<uniform> frame: VisUniforms;\n" \
+"@group(0) @binding(1) var<storage, read> instances: array<Instance>;\n" \
+"@group(0) @binding(2) var<storage, read> indices: array<u32>;\n" \
+"@group(0) @binding(3) var<storage, read> vertices: array<Vertex>;\n" \
+"\n" \
+"fn vertexIndex(instance: Instance, corner: u32) -> u32 {\n" \
+"    return indices[instance.firstIndex + corner] + instance.baseVertex;\n" \
+"}\n" \
+"\n" \
+"fn vertexPosition(v: Vertex) -> vec3f {\n" \
+"    return vec3f(v.px, v.py, v.pz);\n" \
+"}\n"
+
+static const char* kVisGeometryWGSL =
+kVisCommonWGSL
+"\n"
+"struct VertexOutput {\n"
+"    @builtin(position) position: vec4f,\n"
+"    @location(0) @interpolate(flat) id: u32,\n"
+"}\n"
+"\n"
+"// Non-indexed draw of indexCount vertices: the index is pulled here, and\n"
+"// vertex_index / 3 is the triangle, identical on all three corners\n"
+"@vertex\n"
+"fn vs_main(@builtin(vertex_index) corner: u32,\n"
+"           @builtin(instance_index) instanceIndex: u32) -> VertexOutput {\n"
+"    let instance = instances[instanceIndex];\n"
+"    let v = vertices[vertexIndex(instance, corner)];\n"
+"    var out: VertexOutput;\n"
+"    out.position = frame.viewProj * instance.model * vec4f(vertexPosition(v), 1.0);\n"
+"    out.id = (instanceIndex << kTriangleBits) | (corner / 3u);\n"
+"    return out;\n"
+"}\n"
+"\n"
+"@fragment\n"
+"fn fs_main(in: VertexOutput) -> @location(0) u32 {\n"
+"    return in.id;\n"
+"}\n";
+
+static const char* kVisResolveWGSL =
+kVisCommonWGSL
+"\n"
+"@group(0) @binding(4) var visibility: texture_2d<u32>;\n"
+"@group(0) @binding(5) var shaded: texture_storage_2d<rgba16float, write>;\n"
+"\n"
+"const kAmbient = vec3f(0.03);\n"
+"const kBackground = vec3f(0.0);\n"
+"\n"
+"fn cross2(a: vec2f, b: vec2f) -> f32 {\n"
+"    return a.x * b.y - a.y * b.x;\n"
+"}\n"
+"\n"
+"// Perspective-correct barycentrics of an NDC point: screen-space weights\n"
+"// from the projected corners, then divided by w and renormalized\n"
+"fn barycentrics(c0: vec4f, c1: vec4f, c2: vec4f, ndc: vec2f) -> vec3f {\n"
+"    let a0 = c0.xy / c0.w;\n"
+"    let e1 = c1.xy / c1.w - a0;\n"
+"    let e2 = c2.xy / c2.w - a0;\n"
+"    let p = ndc - a0;\n"
+"    let area = cross2(e1, e2);\n"
+"    let l1 = cross2(p, e2) / area;\n"
+"    let l2 = cross2(e1, p) / area;\n"
+"    let q = vec3f(1.0 - l1 - l2, l1, l2) / vec3f(c0.w, c1.w, c2.w);\n"
+"    return q / (q.x + q.y + q.z);\n"
+"}\n"
+"\n"
+"@compute @workgroup_size(8, 8)\n"
+"fn resolve(@builtin(global_invocation_id) id: vec3u) {\n"
+"    let size = textureDimensions(visibility);\n"
+"    if (any(id.xy >= size)) {\n"
+"        return;\n"
+"    }\n"
+"    let packed = textureLoad(visibility, id.xy, 0).r;\n"
+"    if (packed == kEmpty) {\n"
+"        textureStore(shaded, id.xy, vec4f(kBackground, 1.0));\n"
+"        return;\n"
+"    }\n"
+"    let instance = instances[packed >> kTriangleBits];\n"
+"    let firstCorner = (packed & kTriangleMask) * 3u;\n"
+"    let v0 = vertices[vertexIndex(instance, firstCorner)];\n"
+"    let v1 = vertices[vertexIndex(instance, firstCorner + 1u)];\n"
+"    let v2 = vertices[vertexIndex(instance, firstCorner + 2u)];\n"
+"\n"
+"    let w0 = (instance.model * vec4f(vertexPosition(v0), 1.0)).xyz;\n"
+"    let w1 = (instance.model * vec4f(vertexPosition(v1), 1.0)).xyz;\n"
+"    let w2 = (instance.model * vec4f(vertexPosition(v2), 1.0)).xyz;\n"
+"    let fragCoord = vec2f(id.xy) + 0.5;\n"
+"    let ndc = vec2f(fragCoord.x / frame.screenSize.x * 2.0 - 1.0,\n"
+"                    1.0 - fragCoord.y / frame.screenSize.y * 2.0);\n"
+"    let b = barycentrics(frame.viewProj * vec4f(w0, 1.0),\n"
+"                         frame.viewProj * vec4f(w1, 1.0),\n"
+"                         frame.viewProj * vec4f(w2, 1.0), ndc);\n"
+"\n"
+"    let worldPosition = b.x * w0 + b.y * w1 + b.z * w2;\n"
+"    let localNormal = b.x * vec3f(v0.nx, v0.ny, v0.nz) +\n"
+"                      b.y * vec3f(v1.nx, v1.ny, v1.nz) +\n"
+"                      b.z * vec3f(v2.nx, v2.ny, v2.nz);\n"
+"    let normal = normalize((instance.model * vec4f(localNormal, 0.0)).xyz);\n"
+"    let viewDepth = -(frame.view * vec4f(worldPosition, 1.0)).z;\n"
+"\n"
+"    let albedo = unpack4x8unorm(instance.color);\n"
+"    let light = shadeClusteredLights(fragCoord, worldPosition, normal, viewDepth);\n"
+"    textureStore(shaded, id.xy, vec4f(albedo.rgb * (light + kAmbient), albedo.a));\n"
+"}\n";
+
+static WGPUTexture createTarget(WGPUDevice device, const char* label, WGPUTextureFormat format,
+                                WGPUTextureUsageFlags usage, uint32_t width, uint32_t height,
+                                WGPUTextureView* view)
+{
+    WGPUTextureDescriptor desc = {0};
+    desc.label = label;
+    desc.usage = usage;
+    desc.dimension = WGPUTextureDimension_2D;
+    desc.size = (WGPUExtent3D){ width, height, 1 };
+    desc.format = format;
+    desc.mipLevelCount = 1;
+    desc.sampleCount = 1;
+    WGPUTexture texture = wgpuDeviceCreateTexture(device, &desc);
+    *view = texture ? wgpuTextureCreateView(texture, NULL) : NULL;
+    return texture;
+}
+
+static void releaseTargets(VisibilityRenderer* vis)
+{
+    WGPUTextureView views[] = { vis->visibilityView, vis->depthView, vis->colorView };
+    WGPUTexture textures[] = { vis->visibilityTexture, vis->depthTexture, vis->colorTexture };
+    for (size_t i = 0; i < sizeof textures / sizeof textures[0]; ++i) {
+        if (views[i]) wgpuTextureViewRelease(views[i]);
+        if (textures[i]) {
+            wgpuTextureDestroy(textures[i]);
+            wgpuTextureRelease(textures[i]);
+        }
+    }
+    vis->visibilityView = vis->depthView = vis->colorView = NULL;
+    vis->visibilityTexture = vis->depthTexture = vis->colorTexture = NULL;
+}
+
+/**
+ * (Re)create both bind groups; they reference every buffer and target, so
+ * this runs whenever one of them is replaced. Does nothing until the
+ * geometry and the instances have been set.
+ */
+static bool updateBindGroups(VisibilityRenderer* vis)
+{
+    if (vis->geometryBindGroup) wgpuBindGroupRelease(vis->geometryBindGroup);
+    if (vis->resolveBindGroup) wgpuBindGroupRelease(vis->resolveBindGroup);
+    vis->geometryBindGroup = vis->resolveBindGroup = NULL;
+
+    if (!vis->vertexBuffer || !vis->indexBuffer || !vis->instanceBuffer) return true;
+
+    WGPUBuffer buffers[4] = { vis->uniformBuffer, vis->instanceBuffer, vis->indexBuffer, vis->vertexBuffer };
+    WGPUBindGroupEntry entries[6] = {0};
+    for (uint32_t i = 0; i < 4; ++i) {
+        entries[i].binding = i;
+        entries[i].buffer = buffers[i];
+        entries[i].offset = 0;
+        entries[i].size = wgpuBufferGetSize(buffers[i]);
+    }
+    entries[4].binding = 4;
+    entries[4].textureView = vis->visibilityView;
+    entries[5].binding = 5;
+    entries[5].textureView = vis->colorView;
+
+    WGPUBindGroupLayout geometryLayout = wgpuRenderPipelineGetBindGroupLayout(vis->geometryPipeline, 0);
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = "Visibility geometry bind group";
+    desc.layout = geometryLayout;
+    desc.entryCount = 4;
+    desc.entries = entries;
+    vis->geometryBindGroup = wgpuDeviceCreateBindGroup(vis->device, &desc);
+    wgpuBindGroupLayoutRelease(geometryLayout);
+
+    desc.label = "Visibility resolve bind group";
+    desc.layout = vis->resolveLayout;
+    desc.entryCount = 6;
+    vis->resolveBindGroup = wgpuDeviceCreateBindGroup(vis->device, &desc);
+
+    return vis->geometryBindGroup && vis->resolveBindGroup;
+}
+
+static WGPURenderPipeline createGeometryPipeline(WGPUDevice device)
+{
+    WGPUShaderModule module = createShaderModule(device, "Visibility geometry shader", kVisGeometryWGSL);
+    if (!module) return NULL;
+
+    WGPUColorTargetState colorTarget = {0};
+    colorTarget.format = WGPUTextureFormat_R32Uint;
+    colorTarget.blend = NULL;
+    colorTarget.writeMask = WGPUColorWriteMask_All;
+
+    WGPUFragmentState fragment = {0};
+    fragment.module = module;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &colorTarget;
+
+    WGPUDepthStencilState depthStencil = {0};
+    depthStencil.format = kVisDepthFormat;
+    depthStencil.depthWriteEnabled = true;
+    depthStencil.depthCompare = WGPUCompareFunction_Less;
+    depthStencil.stencilFront.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilBack.compare = WGPUCompareFunction_Always;
+    depthStencil.stencilReadMask = 0;
+    depthStencil.stencilWriteMask = 0;
+
+    // No vertex buffers: vertices are pulled from storage
+    WGPURenderPipelineDescriptor desc = {0};
+    desc.label = "Visibility geometry pipeline";
+    desc.layout = NULL;
+    desc.vertex.module = module;
+    desc.vertex.entryPoint = "vs_main";
+    desc.vertex.bufferCount = 0;
+    desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+    desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
+    desc.primitive.frontFace = WGPUFrontFace_CCW;
+    desc.primitive.cullMode = WGPUCullMode_Back;
+    desc.depthStencil = &depthStencil;
+    desc.multisample.count = 1;
+    desc.multisample.mask = ~0u;
+    desc.multisample.alphaToCoverageEnabled = false;
+    desc.fragment = &fragment;
+
+    WGPURenderPipeline pipeline = wgpuDeviceCreateRenderPipeline(device, &desc);
+    wgpuShaderModuleRelease(module);
+    if (!pipeline) {
+        fprintf(stderr, "Failed to create %s\n", desc.label);
+    }
+    return pipeline;
+}
+
+/**
+ * The resolve shares group kLightingBindGroup with forward shaders, so its
+ * layout is explicit: an automatic one wouldn't accept forwardBindGroup.
+ */
+static bool createResolvePipeline(VisibilityRenderer* vis)
+{
+    WGPUBindGroupLayoutEntry layoutEntries[6] = {0};
+    for (uint32_t i = 0; i < 6; ++i) {
+        layoutEntries[i].binding = i;
+        layoutEntries[i].visibility = WGPUShaderStage_Compute;
+    }
+    layoutEntries[0].buffer.type = WGPUBufferBindingType_Uniform;
+    layoutEntries[0].buffer.minBindingSize = sizeof(VisUniforms);
+    layoutEntries[1].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+    layoutEntries[2].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+    layoutEntries[3].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+    layoutEntries[4].texture.sampleType = WGPUTextureSampleType_Uint;
+    layoutEntries[4].texture.viewDimension = WGPUTextureViewDimension_2D;
+    layoutEntries[5].storageTexture.access = WGPUStorageTextureAccess_WriteOnly;
+    layoutEntries[5].storageTexture.format = kVisColorFormat;
+    layoutEntries[5].storageTexture.viewDimension = WGPUTextureViewDimension_2D;
+
+    WGPUBindGroupLayoutDescriptor layoutDesc = {0};
+    layoutDesc.label = "Visibility resolve layout";
+    layoutDesc.entryCount = 6;
+    layoutDesc.entries = layoutEntries;
+    vis->resolveLayout = wgpuDeviceCreateBindGroupLayout(vis->device, &layoutDesc);
+    if (!vis->resolveLayout) return false;
+
+    WGPUBindGroupLayout groups[2] = { vis->resolveLayout, vis->lighting->forwardLayout };
+    WGPUPipelineLayoutDescriptor pipelineLayoutDesc = {0};
+    pipelineLayoutDesc.label = "Visibility resolve pipeline layout";
+    pipelineLayoutDesc.bindGroupLayoutCount = 2;
+    pipelineLayoutDesc.bindGroupLayouts = groups;
+    WGPUPipelineLayout pipelineLayout = wgpuDeviceCreatePipelineLayout(vis->device, &pipelineLayoutDesc);
+    if (!pipelineLayout) return false;
+
+    // kClusteredLightingWGSL isn't a literal, so the source is put together here
+    size_t commonLength = strlen(kClusteredLightingWGSL);
+    size_t resolveLength = strlen(kVisResolveWGSL);
+    char* source = malloc(commonLength + resolveLength + 1);
+    if (!source) {
+        fprintf(stderr, "createVisibilityRenderer: out of memory\n");
+        wgpuPipelineLayoutRelease(pipelineLayout);
+        return false;
+    }
+    memcpy(source, kClusteredLightingWGSL, commonLength);
+    memcpy(source + commonLength, kVisResolveWGSL, resolveLength + 1);
+    WGPUShaderModule module = createShaderModule(vis->device, "Visibility resolve shader", source);
+    free(source);
+    if (!module) {
+        wgpuPipelineLayoutRelease(pipelineLayout);
+        return false;
+    }
+
+    WGPUComputePipelineDescriptor desc = {0};
+    desc.label = "Visibility resolve pipeline";
+    desc.layout = pipelineLayout;
+    desc.compute.module = module;
+    desc.compute.entryPoint = "resolve";
+    vis->resolvePipeline = wgpuDeviceCreateComputePipeline(vis->device, &desc);
+    wgpuShaderModuleRelease(module);
+    wgpuPipelineLayoutRelease(pipelineLayout);
+    if (!vis->resolvePipeline) {
+        fprintf(stderr, "Failed to create %s\n", desc.label);
+        return false;
+    }
+    return true;
+}
+
+bool createVisibilityRenderer(VisibilityRenderer* vis,
+                              WGPUDevice device,
+                              WGPUQueue queue,
+                              const ClusteredLighting* lighting,
+                              uint32_t width,
+                              uint32_t height)
+{
+    memset(vis, 0, sizeof *vis);
+    vis->device = device;
+    vis->queue = queue;
+    vis->lighting = lighting;
+
+    vis->uniformBuffer = createBuffer(device, "Visibility uniforms", sizeof(VisUniforms),
+                                      WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst);
+    vis->geometryPipeline = createGeometryPipeline(device);
+    if (!vis->uniformBuffer || !vis->geometryPipeline || !createResolvePipeline(vis) ||
+        !visResize(vis, width, height)) {
+        releaseVisibilityRenderer(vis);
+        return false;
+    }
+    return true;
+}
+
+void releaseVisibilityRenderer(VisibilityRenderer* vis)
+{
+    releaseTargets(vis);
+    if (vis->geometryBindGroup) wgpuBindGroupRelease(vis->geometryBindGroup);
+    if (vis->resolveBindGroup) wgpuBindGroupRelease(vis->resolveBindGroup);
+    if (vis->resolveLayout) wgpuBindGroupLayoutRelease(vis->resolveLayout);
+    if (vis->geometryPipeline) wgpuRenderPipelineRelease(vis->geometryPipeline);
+    if (vis->resolvePipeline) wgpuComputePipelineRelease(vis->resolvePipeline);
+
+    WGPUBuffer buffers[] = { vis->uniformBuffer, vis->vertexBuffer, vis->indexBuffer, vis->instanceBuffer };
+    for (size_t i = 0; i < sizeof buffers / sizeof buffers[0]; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    free(vis->instances);
+    memset(vis, 0, sizeof *vis);
+}
+
+bool visResize(VisibilityRenderer* vis, uint32_t width, uint32_t height)
+{
+    releaseTargets(vis);
+    vis->width = width;
+    vis->height = height;
+
+    vis->visibilityTexture = createTarget(vis->device, "Visibility IDs", WGPUTextureFormat_R32Uint,
+                                          WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_TextureBinding,
+                                          width, height, &vis->visibilityView);
+    vis->depthTexture = createTarget(vis->device, "Visibility depth", kVisDepthFormat,
+                                     WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_TextureBinding,
+                                     width, height, &vis->depthView);
+    vis->colorTexture = createTarget(vis->device, "Visibility color", kVisColorFormat,
+                                     WGPUTextureUsage_StorageBinding | WGPUTextureUsage_TextureBinding,
+                                     width, height, &vis->colorView);
+    if (!vis->visibilityView || !vis->depthView || !vis->colorView) {
+        fprintf(stderr, "visResize: failed to create %ux%u targets\n", width, height);
+        return false;
+    }
+    return updateBindGroups(vis);
+}
+
+bool visSetGeometry(VisibilityRenderer* vis,
+                    const VisVertex* vertices, uint32_t vertexCount,
+                    const uint32_t* indices, uint32_t indexCount)
+{
+    WGPUBuffer buffers[] = { vis->vertexBuffer, vis->indexBuffer };
+    for (size_t i = 0; i < sizeof buffers / sizeof buffers[0]; ++i) {
+        if (buffers[i]) {
+            wgpuBufferDestroy(buffers[i]);
+            wgpuBufferRelease(buffers[i]);
+        }
+    }
+    const WGPUBufferUsageFlags storage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst;
+    vis->vertexBuffer = createBuffer(vis->device, "Visibility vertices", (uint64_t)vertexCount * sizeof(VisVertex), storage);
+    vis->indexBuffer = createBuffer(vis->device, "Visibility indices", (uint64_t)indexCount * sizeof(uint32_t), storage);
+    if (!vis->vertexBuffer || !vis->indexBuffer) return false;
+
+    wgpuQueueWriteBuffer(vis->queue, vis->vertexBuffer, 0, vertices, (size_t)vertexCount * sizeof(VisVertex));
+    wgpuQueueWriteBuffer(vis->queue, vis->indexBuffer, 0, indices, (size_t)indexCount * sizeof(uint32_t));
+    return updateBindGroups(vis);
+}
+
+bool visSetInstances(VisibilityRenderer* vis, const VisInstance* instances, uint32_t count)
+{
+    if (count > kVisMaxInstances) {
+        fprintf(stderr, "visSetInstances: %u instances, only the first %u are drawn\n", count, kVisMaxInstances);
+        count = kVisMaxInstances;
+    }
+
+    if (count > vis->instanceCapacity || !vis->instanceBuffer) {
+        uint32_t capacity = vis->instanceCapacity ? vis->instanceCapacity : 64;
+        while (capacity < count) capacity *= 2;
+
+        VisInstance* copy = realloc(vis->instances, (size_t)capacity * sizeof *copy);
+        if (!copy) {
+            fprintf(stderr, "visSetInstances: out of memory\n");
+            return false;
+        }
+        vis->instances = copy;
+        if (vis->instanceBuffer) {
+            wgpuBufferDestroy(vis->instanceBuffer);
+            wgpuBufferRelease(vis->instanceBuffer);
+        }
+        vis->instanceBuffer = createBuffer(vis->device, "Visibility instances",
+                                           (uint64_t)capacity * sizeof(VisInstance),
+                                           WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst);
+        vis->instanceCapacity = vis->instanceBuffer ? capacity : 0;
+        if (!updateBindGroups(vis) || !vis->instanceBuffer) return false;
+    }
+
+    memcpy(vis->instances, instances, (size_t)count * sizeof *instances);
+    vis->instanceCount = count;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (vis->instances[i].indexCount > 3 * kVisMaxTriangles) {
+            fprintf(stderr, "visSetInstances: instance %u has more than %u triangles\n", i, kVisMaxTriangles);
+            vis->instances[i].indexCount = 3 * kVisMaxTriangles;
+        }
+    }
+    if (count > 0) {
+        wgpuQueueWriteBuffer(vis->queue, vis->instanceBuffer, 0, vis->instances, (size_t)count * sizeof(VisInstance));
+    }
+    return true;
+}
+
+void visUpdate(VisibilityRenderer* vis, Mat4 view, Mat4 viewProj)
+{
+    VisUniforms uniforms = {0};
+    memcpy(uniforms.viewProj, viewProj.m, sizeof uniforms.viewProj);
+    memcpy(uniforms.view, view.m, sizeof uniforms.view);
+    uniforms.screenSize[0] = (float)vis->width;
+    uniforms.screenSize[1] = (float)vis->height;
+    wgpuQueueWriteBuffer(vis->queue, vis->uniformBuffer, 0, &uniforms, sizeof uniforms);
+}
+
+void visRender(VisibilityRenderer* vis, WGPUCommandEncoder encoder)
+{
+    // Geometry: IDs and depth only
+    WGPURenderPassColorAttachment colorAttachment = {0};
+    colorAttachment.view = vis->visibilityView;
+    colorAttachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+    colorAttachment.loadOp = WGPULoadOp_Clear;
+    colorAttachment.storeOp = WGPUStoreOp_Store;
+    colorAttachment.clearValue = (WGPUColor){ (double)kVisEmpty, 0.0, 0.0, 0.0 };
+
+    WGPURenderPassDepthStencilAttachment depthAttachment = {0};
+    depthAttachment.view = vis->depthView;
+    depthAttachment.depthLoadOp = WGPULoadOp_Clear;
+    depthAttachment.depthStoreOp = WGPUStoreOp_Store;
+    depthAttachment.depthClearValue = 1.0f;
+    depthAttachment.stencilLoadOp = WGPULoadOp_Undefined;
+    depthAttachment.stencilStoreOp = WGPUStoreOp_Undefined;
+
+    WGPURenderPassDescriptor passDesc = {0};
+    passDesc.label = "Visibility geometry pass";
+    passDesc.colorAttachmentCount = 1;
+    passDesc.colorAttachments = &colorAttachment;
+    passDesc.depthStencilAttachment = &depthAttachment;
+    WGPURenderPassEncoder pass = wgpuCommandEncoderBeginRenderPass(encoder, &passDesc);
+    if (vis->geometryBindGroup) {
+        wgpuRenderPassEncoderSetPipeline(pass, vis->geometryPipeline);
+        wgpuRenderPassEncoderSetBindGroup(pass, 0, vis->geometryBindGroup, 0, NULL);
+        for (uint32_t i = 0; i < vis->instanceCount; ++i) {
+            // firstInstance carries the instance ID into the shader
+            wgpuRenderPassEncoderDraw(pass, vis->instances[i].indexCount, 1, 0, i);
+        }
+    }
+    wgpuRenderPassEncoderEnd(pass);
+    wgpuRenderPassEncoderRelease(pass);
+
+    // Resolve: one invocation per pixel
+    if (!vis->resolveBindGroup) return;
+
+    WGPUComputePassDescriptor computeDesc = {0};
+    computeDesc.label = "Visibility resolve pass";
+    WGPUComputePassEncoder compute = wgpuCommandEncoderBeginComputePass(encoder, &computeDesc);
+    wgpuComputePassEncoderSetPipeline(compute, vis->resolvePipeline);
+    wgpuComputePassEncoderSetBindGroup(compute, 0, vis->resolveBindGroup, 0, NULL);
+    wgpuComputePassEncoderSetBindGroup(compute, kLightingBindGroup, vis->lighting->forwardBindGroup, 0, NULL);
+    wgpuComputePassEncoderDispatchWorkgroups(compute, (vis->width + 7) / 8, (vis->height + 7) / 8, 1);
+    wgpuComputePassEncoderEnd(compute);
+    wgpuComputePassEncoderRelease(compute);
+}
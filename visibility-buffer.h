@@ -0,0 +1,121 @@
+#ifndef VISIBILITY_BUFFER_H
+#define VISIBILITY_BUFFER_H
+
+#include "lighting.h"
+#include "linalg.h"
+
+#include <webgpu/webgpu.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * VISIBILITY BUFFER RENDERER
+ *
+ * An alternative to forward shading for scenes with heavy overdraw and
+ * small triangles. Two passes:
+ *  - geometry: rasterizes every instance with depth testing but writes
+ *    only a 32-bit ID per pixel, (instance << kVisTriangleBits) | triangle.
+ *    Vertices are pulled from storage buffers, so the triangle index is
+ *    simply vertex_index / 3 and no per-pixel attributes are stored.
+ *  - resolve (compute): for each pixel, fetches the three vertices of its
+ *    triangle, recomputes perspective-correct barycentrics at the pixel
+ *    center, interpolates position and normal, and shades with the
+ *    clustered lights. Every pixel is shaded exactly once, whatever the
+ *    overdraw, and the only per-pixel target is 4 bytes.
+ *
+ * All meshes share one vertex and one index buffer (visSetGeometry());
+ * an instance selects its mesh with firstIndex/indexCount/baseVertex.
+ *
+ * Per frame:
+ *      visUpdate(&vis, view, viewProj);
+ *      lightingDispatch(&lighting, encoder);
+ *      visRender(&vis, encoder);
+ *      ... `colorView` holds the shaded HDR image, `depthView` the depth ...
+ */
+
+#define kVisTriangleBits 20
+#define kVisMaxTriangles (1u << kVisTriangleBits)
+/** The all-ones ID marks empty pixels, so the last instance ID is unused. */
+#define kVisMaxInstances ((1u << (32 - kVisTriangleBits)) - 1)
+#define kVisEmpty 0xffffffffu
+
+#define kVisColorFormat WGPUTextureFormat_RGBA16Float
+#define kVisDepthFormat WGPUTextureFormat_Depth32Float
+
+/** One vertex, laid out to match the WGSL struct (24 bytes). */
+typedef struct {
+    float position[3];
+    float normal[3];
+} VisVertex;
+
+/** One instance, laid out to match the WGSL struct (80 bytes). */
+typedef struct {
+    float model[16];            // uniform scale
+    uint32_t firstIndex;
+    uint32_t indexCount;        // at most 3 * kVisMaxTriangles
+    uint32_t baseVertex;
+    uint32_t color;             // RGBA8 albedo
+} VisInstance;
+
+typedef struct {
+    WGPUDevice device;
+    WGPUQueue queue;
+    const ClusteredLighting* lighting;
+
+    uint32_t width, height;
+    WGPUTexture visibilityTexture;      // R32Uint IDs
+    WGPUTextureView visibilityView;
+    WGPUTexture depthTexture;
+    WGPUTextureView depthView;
+    WGPUTexture colorTexture;           // shaded result
+    WGPUTextureView colorView;
+
+    WGPURenderPipeline geometryPipeline;
+    WGPUComputePipeline resolvePipeline;
+    WGPUBindGroupLayout resolveLayout;
+    WGPUBindGroup geometryBindGroup;
+    WGPUBindGroup resolveBindGroup;
+
+    WGPUBuffer uniformBuffer;
+    WGPUBuffer vertexBuffer;
+    WGPUBuffer indexBuffer;
+    WGPUBuffer instanceBuffer;
+    uint32_t instanceCapacity;
+
+    VisInstance* instances;             // CPU copy, for the per-instance draws
+    uint32_t instanceCount;
+} VisibilityRenderer;
+
+/** Pack an albedo for VisInstance.color. */
+static inline uint32_t visColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    return (uint32_t)r | (uint32_t)g << 8 | (uint32_t)b << 16 | (uint32_t)a << 24;
+}
+
+bool createVisibilityRenderer(VisibilityRenderer* vis,
+                              WGPUDevice device,
+                              WGPUQueue queue,
+                              const ClusteredLighting* lighting,
+                              uint32_t width,
+                              uint32_t height);
+
+void releaseVisibilityRenderer(VisibilityRenderer* vis);
+
+/** Recreate the targets for a new size. */
+bool visResize(VisibilityRenderer* vis, uint32_t width, uint32_t height);
+
+/** Upload the vertices and indices of every mesh. */
+bool visSetGeometry(VisibilityRenderer* vis,
+                    const VisVertex* vertices, uint32_t vertexCount,
+                    const uint32_t* indices, uint32_t indexCount);
+
+/** Upload the instances (at most kVisMaxInstances). */
+bool visSetInstances(VisibilityRenderer* vis, const VisInstance* instances, uint32_t count);
+
+void visUpdate(VisibilityRenderer* vis, Mat4 view, Mat4 viewProj);
+
+/** Record the geometry and resolve passes. */
+void visRender(VisibilityRenderer* vis, WGPUCommandEncoder encoder);
+
+#endif // VISIBILITY_BUFFER_H
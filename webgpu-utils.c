@@ -1,4 +1,5 @@
 #include "webgpu-utils.h"
+#include "msaa.h"
 
 #ifdef __EMSCRIPTEN__
 #   include <emscripten.h>
@@ -7,6 +8,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <inttypes.h>
 
@@ -144,6 +146,33 @@ WGPUDevice requestDeviceSync(WGPUAdapter adapter, WGPUDeviceDescriptor const * d
 }
 
 
+/**
+ * Human readable name of the optional features this project cares about,
+ * or NULL for the others (those are still printed as hex).
+ */
+static const char* featureName(WGPUFeatureName feature)
+{
+    switch (feature) {
+    case WGPUFeatureName_TimestampQuery:            return "TimestampQuery";
+    case WGPUFeatureName_TextureCompressionBC:      return "TextureCompressionBC";
+    case WGPUFeatureName_TextureCompressionETC2:    return "TextureCompressionETC2";
+    case WGPUFeatureName_TextureCompressionASTC:    return "TextureCompressionASTC";
+    case WGPUFeatureName_ShaderF16:                 return "ShaderF16";
+    case WGPUFeatureName_Float32Filterable:         return "Float32Filterable";
+    default:                                        return NULL;
+    }
+}
+
+static void printFeature(WGPUFeatureName feature)
+{
+    const char* name = featureName(feature);
+    if (name) {
+        printf(" - 0x%x (%s)\n", (unsigned)feature, name);
+    } else {
+        printf(" - 0x%x\n", (unsigned)feature);
+    }
+}
+
 /** 
  * INSPECT ADAPTER
  * 
@@ -187,8 +216,7 @@ if (success) {
     // for feature names.
     printf("Adapter features:\n");
     for (size_t i = 0; i < featureCount; ++i) {
-        WGPUFeatureName f = features[i];
-        printf(" - 0x%x\n", (unsigned)f);
+        printFeature(features[i]);
     }
 
     free(features);
@@ -214,6 +242,21 @@ if (success) {
     printf(" - backendType: 0x%x\n", properties.backendType);    
 }
 
+const char* backendTypeName(WGPUBackendType backendType)
+{
+    switch (backendType) {
+    case WGPUBackendType_Null: return "Null";
+    case WGPUBackendType_WebGPU: return "WebGPU";
+    case WGPUBackendType_D3D11: return "D3D11";
+    case WGPUBackendType_D3D12: return "D3D12";
+    case WGPUBackendType_Metal: return "Metal";
+    case WGPUBackendType_Vulkan: return "Vulkan";
+    case WGPUBackendType_OpenGL: return "OpenGL";
+    case WGPUBackendType_OpenGLES: return "OpenGLES";
+    default: return "unknown backend";
+    }
+}
+
 /**
  * INSPECT DEVICE
  *
@@ -233,8 +276,7 @@ void inspectDevice(WGPUDevice device)
     
     printf("Device features:\n");
     for (size_t i = 0; i < featureCount; ++i) {
-        WGPUFeatureName f = features[i];
-        printf(" - 0x%x\n", (unsigned)f);
+        printFeature(features[i]);
     }
 
     free(features);
@@ -359,11 +401,11 @@ static void onDeviceError(WGPUErrorType type,
 }
 
 /**
+ * CREATE WebGPU INSTANCE
  *
- * INITIALIZE WebGPU
+ * Shared by initWebGPU() and initWebGPUHeadless().
  */
-
-bool initWebGPU(Context* context)
+static WGPUInstance createInstance(void)
 {
     /**
      * CREATE WebGPU INSTANCE 
@@ -420,6 +462,118 @@ bool initWebGPU(Context* context)
     // Display instance pointer (for basic debugging / sanity check)
     printf("WGPU instance: %p\n", (void*)instance);
 
+    return instance;
+}
+
+/**
+ * SELECT DEVICE
+ *
+ * Request the device (with every optional feature we use) and its queue.
+ * Shared by initWebGPU() and initWebGPUHeadless().
+ */
+static bool createDevice(Context* context, WGPUAdapter adapter)
+{
+    /** 
+     * SELECT DEVICE
+     *
+     * A WebGPU device represents a context of use of the API
+     */
+    printf("Requesting device...\n");
+    
+    /**
+     * OPTIONAL FEATURES
+     *
+     * Request every block-compressed texture family the adapter supports.
+     * Loaders check the flags in the Context and fall back to transcoding
+     * on the CPU when a family is missing. Timestamp queries feed the
+     * profiler's GPU pass timings.
+     */
+    WGPUFeatureName requiredFeatures[4];
+    size_t requiredFeatureCount = 0;
+
+    context->textureCompressionBC = wgpuAdapterHasFeature(adapter, WGPUFeatureName_TextureCompressionBC);
+    context->textureCompressionETC2 = wgpuAdapterHasFeature(adapter, WGPUFeatureName_TextureCompressionETC2);
+    context->textureCompressionASTC = wgpuAdapterHasFeature(adapter, WGPUFeatureName_TextureCompressionASTC);
+    context->timestampQuery = wgpuAdapterHasFeature(adapter, WGPUFeatureName_TimestampQuery);
+
+    if (context->textureCompressionBC) requiredFeatures[requiredFeatureCount++] = WGPUFeatureName_TextureCompressionBC;
+    if (context->textureCompressionETC2) requiredFeatures[requiredFeatureCount++] = WGPUFeatureName_TextureCompressionETC2;
+    if (context->textureCompressionASTC) requiredFeatures[requiredFeatureCount++] = WGPUFeatureName_TextureCompressionASTC;
+    if (context->timestampQuery) requiredFeatures[requiredFeatureCount++] = WGPUFeatureName_TimestampQuery;
+
+    printf("Texture compression: BC %s, ETC2 %s, ASTC %s\n",
+           context->textureCompressionBC ? "yes" : "no",
+           context->textureCompressionETC2 ? "yes" : "no",
+           context->textureCompressionASTC ? "yes" : "no");
+    printf("Timestamp queries: %s\n", context->timestampQuery ? "yes" : "no");
+
+    /**
+     * MULTISAMPLING
+     *
+     * 4 samples are supported by every adapter for the formats we render
+     * to, and resolving them is cheap on GPUs. A CPU adapter pays for each
+     * sample in full, so it renders single-sampled.
+     */
+    WGPUAdapterProperties properties = {0};
+    wgpuAdapterGetProperties(adapter, &properties);
+    context->sampleCount = msaaSampleCount(properties.adapterType == WGPUAdapterType_CPU ? 1 : 4);
+    printf("MSAA samples: %"PRIu32"\n", context->sampleCount);
+
+    snprintf(context->adapterName, sizeof context->adapterName, "%s",
+             properties.name ? properties.name : "unknown adapter");
+    context->backendType = properties.backendType;
+
+    WGPUDeviceDescriptor deviceDesc = {0}; 
+    deviceDesc.nextInChain = NULL;
+    // minimal device initializion options
+    deviceDesc.label = "My Device"; // sed in error messages / debugging
+    deviceDesc.requiredFeatureCount = requiredFeatureCount;
+    deviceDesc.requiredFeatures = requiredFeatures;
+    deviceDesc.requiredLimits = NULL; // use implmentation defaults
+    deviceDesc.defaultQueue.nextInChain = NULL;
+    deviceDesc.defaultQueue.label = "The default queue";
+    // New device lost callback. deviceLostCallback is deprecated
+    deviceDesc.deviceLostCallbackInfo.mode = WGPUCallbackMode_AllowSpontaneous;
+    deviceDesc.deviceLostCallbackInfo.callback = onDeviceLost;
+    deviceDesc.deviceLostCallbackInfo.userdata = NULL;
+
+    
+    context->device = requestDeviceSync(adapter, &deviceDesc);
+    printf("Got device: %p\n", (void*)context->device);
+
+    // Invoked whenever there is an error in the use of the device
+    wgpuDeviceSetUncapturedErrorCallback(context->device, onDeviceError, NULL /* pUserData */);
+
+    if (!context->device) {
+        return false;
+    }
+
+    /**
+     * CREATE COMMAND QUEUE
+     */
+    context->queue = wgpuDeviceGetQueue(context->device);
+
+    if (!context->queue) {
+        fprintf(stderr, "Failed to get queue\n");
+        return false;
+    }
+    
+    wgpuQueueOnSubmittedWorkDone(context->queue, onQueueWorkDone, NULL);
+
+    return true;
+}
+
+/**
+ *
+ * INITIALIZE WebGPU
+ */
+
+bool initWebGPU(Context* context)
+{
+    WGPUInstance instance = createInstance();
+    if (!instance) {
+        return false;
+    }
     
     /**
      * Create WGPU Surface
@@ -465,32 +619,10 @@ bool initWebGPU(Context* context)
      */
     wgpuInstanceRelease(instance); 
  
-    /** 
-     * SELECT DEVICE
-     *
-     * A WebGPU device represents a context of use of the API
-     */
-    printf("Requesting device...\n");
-    
-    WGPUDeviceDescriptor deviceDesc = {0}; 
-    deviceDesc.nextInChain = NULL;
-    // minimal device initializion options
-    deviceDesc.label = "My Device"; // sed in error messages / debugging
-    deviceDesc.requiredFeatureCount = 0; // no optional features required
-    deviceDesc.requiredLimits = NULL; // use implmentation defaults
-    deviceDesc.defaultQueue.nextInChain = NULL;
-    deviceDesc.defaultQueue.label = "The default queue";
-    // New device lost callback. deviceLostCallback is deprecated
-    deviceDesc.deviceLostCallbackInfo.mode = WGPUCallbackMode_AllowSpontaneous;
-    deviceDesc.deviceLostCallbackInfo.callback = onDeviceLost;
-    deviceDesc.deviceLostCallbackInfo.userdata = NULL;
-
-    
-    context->device = requestDeviceSync(adapter, &deviceDesc);
-    printf("Got device: %p\n", (void*)context->device);
-
-    // Invoked whenever there is an error in the use of the device
-    wgpuDeviceSetUncapturedErrorCallback(context->device, onDeviceError, NULL /* pUserData */);
+    if (!createDevice(context, adapter)) {
+        wgpuAdapterRelease(adapter);
+        return false;
+    }
 
     /* DESTROY ADAPTER
      *
@@ -498,10 +630,12 @@ bool initWebGPU(Context* context)
      */
     wgpuAdapterRelease(adapter);
 
-    // Configure device Surface
+    // Configure device Surface. The surface itself is never multisampled:
+    // multisampled passes resolve into it (see msaa.h)
+    context->surfaceFormat = WGPUTextureFormat_BGRA8Unorm; // Or get preferred format from adapter
     WGPUSurfaceConfiguration config = {
         .device = context->device,
-        .format = WGPUTextureFormat_BGRA8Unorm, // Or get preferred format from adapter
+        .format = context->surfaceFormat,
         .usage = WGPUTextureUsage_RenderAttachment,
         .width = kScreenWidth,
         .height = kScreenHeight,
@@ -512,22 +646,355 @@ bool initWebGPU(Context* context)
     // Inspect the adapter
     inspectDevice(context->device);
 
-    /**
-     * CREATE COMMAND QUEUE
-     *
-     *
-     *
-     *
-     */
-    context->queue = wgpuDeviceGetQueue(context->device);
+    return true;
+}
 
-    if (!context->queue) {
-        fprintf(stderr, "Failed to get queue\n");
+/**
+ * INITIALIZE WebGPU HEADLESS
+ *
+ * Same device setup as initWebGPU(), without window or surface: for tools,
+ * benchmarks and compute-only tests. With `forceFallbackAdapter`, Dawn
+ * hands out its CPU implementation (SwiftShader), so GPU code paths can be
+ * exercised on machines without a GPU.
+ */
+bool initWebGPUHeadless(Context* context, bool forceFallbackAdapter)
+{
+    WGPUInstance instance = createInstance();
+    if (!instance) {
         return false;
     }
-    
-    wgpuQueueOnSubmittedWorkDone(context->queue, onQueueWorkDone, NULL);
+
+    printf("Requesting %sadapter (headless)...\n", forceFallbackAdapter ? "fallback " : "");
+
+    WGPURequestAdapterOptions adapterOpts = {
+        .nextInChain = NULL,
+        .compatibleSurface = NULL,
+        .forceFallbackAdapter = forceFallbackAdapter
+    };
+    WGPUAdapter adapter = requestAdapterSync(instance, &adapterOpts);
+    wgpuInstanceRelease(instance);
+
+    if (!adapter) {
+        fprintf(stderr, "No %sadapter available\n", forceFallbackAdapter ? "fallback " : "");
+        return false;
+    }
+
+    printf("Got adapter: %p\n", (void*)adapter);
+    inspectAdapter(adapter);
+
+    bool ok = createDevice(context, adapter);
+    wgpuAdapterRelease(adapter);
+    if (!ok) {
+        return false;
+    }
+
+    context->window = NULL;
+    context->surface = NULL;
+
+    inspectDevice(context->device);
 
     return true;
 }
 
+
+/**
+ * CREATE SHADER MODULE
+ *
+ * Compile a WGSL source string into a shader module. Returns NULL (and
+ * prints the label) if the device refuses it; the actual compile error is
+ * reported through the uncaptured error callback.
+ */
+WGPUShaderModule createShaderModule(WGPUDevice device,
+                                        const char* label,
+                                    const char* wgsl)
+{
+    WGPUShaderModuleWGSLDescriptor wgslDesc = {0};
+    wgslDesc.chain.next = NULL;
+    wgslDesc.chain.sType = WGPUSType_ShaderModuleWGSLDescriptor;
+    wgslDesc.code = wgsl;
+
+    WGPUShaderModuleDescriptor desc = {0};
+    desc.nextInChain = &wgslDesc.chain;
+    desc.label = label;
+
+    WGPUShaderModule module = wgpuDeviceCreateShaderModule(device, &desc);
+    if (!module) {
+        fprintf(stderr, "Failed to create shader module '%s'\n", label);
+    }
+    return module;
+}
+
+WGPUShaderModule createShaderModuleFromParts(WGPUDevice device,
+                                                 const char* label,
+                                             const char* const* parts,
+                                             uint32_t partCount)
+{
+    size_t length = 0;
+    for (uint32_t i = 0; i < partCount; ++i) {
+        length += strlen(parts[i]);
+    }
+    char* wgsl = malloc(length + 1);
+    if (!wgsl) {
+        fprintf(stderr, "Failed to create shader module '%s': out of memory\n", label);
+        return NULL;
+    }
+    size_t offset = 0;
+    for (uint32_t i = 0; i < partCount; ++i) {
+        size_t partLength = strlen(parts[i]);
+        memcpy(wgsl + offset, parts[i], partLength);
+        offset += partLength;
+    }
+    wgsl[length] = '\0';
+
+    WGPUShaderModule module = createShaderModule(device, label, wgsl);
+    free(wgsl);
+    return module;
+}
+
+/**
+ * CREATE COMPUTE PIPELINE
+ *
+ * Compute pipelines in this project use the "auto" layout (layout = NULL),
+ * so bind group layouts are fetched back from the pipeline with
+ * wgpuComputePipelineGetBindGroupLayout().
+ */
+WGPUComputePipeline createComputePipeline(WGPUDevice device,
+                                              const char* label,
+                                          WGPUShaderModule module,
+                                          const char* entryPoint)
+{
+    WGPUComputePipelineDescriptor desc = {0};
+    desc.nextInChain = NULL;
+    desc.label = label;
+    desc.layout = NULL; // auto layout
+    desc.compute.module = module;
+    desc.compute.entryPoint = entryPoint;
+
+    WGPUComputePipeline pipeline = wgpuDeviceCreateComputePipeline(device, &desc);
+    if (!pipeline) {
+        fprintf(stderr, "Failed to create compute pipeline '%s'\n", label);
+    }
+    return pipeline;
+}
+
+WGPUBindGroup createAutoLayoutBindGroup(WGPUDevice device,
+                                        WGPUComputePipeline pipeline,
+                                        const char* label,
+                                        const uint32_t* bindings,
+                                        uint32_t bindingCount,
+                                        BindGroupEntryFunction fillEntry,
+                                        void* userData)
+{
+    if (bindingCount > kKernelMaxBindings) {
+        fprintf(stderr, "createAutoLayoutBindGroup: '%s' has %u bindings, more than %u\n",
+                label, bindingCount, kKernelMaxBindings);
+        return NULL;
+    }
+
+    WGPUBindGroupEntry entries[kKernelMaxBindings];
+    for (uint32_t i = 0; i < bindingCount; ++i) {
+        fillEntry(userData, bindings[i], &entries[i]);
+    }
+
+    WGPUBindGroupLayout layout = wgpuComputePipelineGetBindGroupLayout(pipeline, 0);
+    WGPUBindGroupDescriptor desc = {0};
+    desc.label = label;
+    desc.layout = layout;
+    desc.entryCount = bindingCount;
+    desc.entries = entries;
+    WGPUBindGroup bindGroup = wgpuDeviceCreateBindGroup(device, &desc);
+    wgpuBindGroupLayoutRelease(layout);
+    return bindGroup;
+}
+
+/**
+ * CREATE BUFFER
+ *
+ * Thin wrapper so call sites only spell out what differs between buffers.
+ */
+WGPUBuffer createBuffer(WGPUDevice device,
+                        const char* label,
+                        uint64_t size,
+                        WGPUBufferUsageFlags usage)
+{
+    WGPUBufferDescriptor desc = {0};
+    desc.nextInChain = NULL;
+    desc.label = label;
+    desc.usage = usage;
+    // WebGPU requires buffer sizes that are a multiple of 4
+    desc.size = (size + 3) & ~(uint64_t)3;
+    desc.mappedAtCreation = false;
+
+    WGPUBuffer buffer = wgpuDeviceCreateBuffer(device, &desc);
+    if (!buffer) {
+        fprintf(stderr, "Failed to create buffer '%s' (%"PRIu64" bytes)\n", label, size);
+    }
+    return buffer;
+}
+
+/**
+ * TEXTURE FORMAT BLOCK INFO
+ *
+ * Size of the smallest addressable unit of a format: 1x1 texels for plain
+ * formats. Returns false for formats this project doesn't upload from the
+ * CPU (depth, packed float, ...).
+ */
+bool textureFormatBlockInfo(WGPUTextureFormat format,
+                            uint32_t* blockWidth,
+                            uint32_t* blockHeight,
+                            uint32_t* bytesPerBlock)
+{
+    uint32_t bytes = 0;
+    switch (format) {
+    case WGPUTextureFormat_R8Unorm:         bytes = 1; break;
+    case WGPUTextureFormat_RG8Unorm:        bytes = 2; break;
+    case WGPUTextureFormat_R16Float:        bytes = 2; break;
+    case WGPUTextureFormat_RGBA8Unorm:
+    case WGPUTextureFormat_RGBA8UnormSrgb:
+    case WGPUTextureFormat_BGRA8Unorm:
+    case WGPUTextureFormat_BGRA8UnormSrgb:
+    case WGPUTextureFormat_R32Float:
+    case WGPUTextureFormat_R32Uint:
+    case WGPUTextureFormat_RG16Float:       bytes = 4; break;
+    case WGPUTextureFormat_RGBA16Float:
+    case WGPUTextureFormat_RG32Float:       bytes = 8; break;
+    case WGPUTextureFormat_RGBA32Float:     bytes = 16; break;
+
+    // 4x4 block-compressed formats
+    case WGPUTextureFormat_BC1RGBAUnorm:
+    case WGPUTextureFormat_BC1RGBAUnormSrgb:
+    case WGPUTextureFormat_BC4RUnorm:
+    case WGPUTextureFormat_ETC2RGB8Unorm:
+        *blockWidth = 4;
+        *blockHeight = 4;
+        *bytesPerBlock = 8;
+        return true;
+    case WGPUTextureFormat_BC2RGBAUnorm:
+    case WGPUTextureFormat_BC2RGBAUnormSrgb:
+    case WGPUTextureFormat_BC3RGBAUnorm:
+    case WGPUTextureFormat_BC3RGBAUnormSrgb:
+    case WGPUTextureFormat_BC5RGUnorm:
+    case WGPUTextureFormat_BC7RGBAUnorm:
+    case WGPUTextureFormat_BC7RGBAUnormSrgb:
+    case WGPUTextureFormat_ETC2RGBA8Unorm:
+    case WGPUTextureFormat_ASTC4x4Unorm:
+        *blockWidth = 4;
+        *blockHeight = 4;
+        *bytesPerBlock = 16;
+        return true;
+
+    default:
+        return false;
+    }
+    *blockWidth = 1;
+    *blockHeight = 1;
+    *bytesPerBlock = bytes;
+    return true;
+}
+
+/**
+ * Small struct used to pass data between readBufferSync() and
+ * onBufferMapped().
+ */
+typedef struct {
+    WGPUBufferMapAsyncStatus status;
+    bool mapEnded;
+} BufferMapData;
+
+static void onBufferMapped(WGPUBufferMapAsyncStatus status, void* pUserData)
+{
+    BufferMapData* mapData = (BufferMapData*)pUserData;
+    mapData->status = status;
+    mapData->mapEnded = true;
+}
+
+/**
+ * READ BUFFER SYNC
+ *
+ * Map a MapRead buffer and copy `size` bytes out of it, ticking the device
+ * until the mapping is done. Meant for tests, tools and benchmarks: a real
+ * frame never waits on the GPU like this.
+ */
+bool readBufferSync(WGPUDevice device,
+                    WGPUBuffer buffer,
+                    uint64_t offset,
+                    uint64_t size,
+                    void* destination)
+{
+    BufferMapData mapData = { WGPUBufferMapAsyncStatus_Success, false };
+    wgpuBufferMapAsync(buffer, WGPUMapMode_Read, (size_t)offset, (size_t)size,
+                       onBufferMapped, &mapData);
+
+    while (!mapData.mapEnded) {
+#if defined(WEBGPU_BACKEND_DAWN)
+        wgpuDeviceTick(device);
+#elif defined(WEBGPU_BACKEND_WGPU)
+        wgpuDevicePoll(device, false, NULL);
+#elif defined(WEBGPU_BACKEND_EMSCRIPTEN)
+        emscripten_sleep(10);
+#else
+        (void)device;
+#endif
+    }
+
+    if (mapData.status != WGPUBufferMapAsyncStatus_Success) {
+        fprintf(stderr, "Failed to map buffer for reading (status %d)\n", (int)mapData.status);
+        return false;
+    }
+
+    const void* mapped = wgpuBufferGetConstMappedRange(buffer, (size_t)offset, (size_t)size);
+    if (mapped) {
+        memcpy(destination, mapped, (size_t)size);
+    }
+    wgpuBufferUnmap(buffer);
+    return mapped != NULL;
+}
+
+/** Submit `steps` steps, then wait for their result to come back. */
+static bool runBenchmarkSteps(WGPUDevice device, WGPUQueue queue, const GpuBenchmark* benchmark,
+                              WGPUBuffer readback, uint32_t steps, void* result)
+{
+    for (uint32_t step = 0; step < steps; ++step) {
+        WGPUCommandEncoderDescriptor encoderDesc = {0};
+        encoderDesc.label = benchmark->label;
+        WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(device, &encoderDesc);
+        benchmark->step(benchmark->userData, encoder);
+        if (step + 1 == steps) {
+            wgpuCommandEncoderCopyBufferToBuffer(encoder, benchmark->resultBuffer, 0, readback, 0,
+                                                 benchmark->resultSize);
+        }
+        WGPUCommandBuffer commands = wgpuCommandEncoderFinish(encoder, NULL);
+        wgpuCommandEncoderRelease(encoder);
+        wgpuQueueSubmit(queue, 1, &commands);
+        wgpuCommandBufferRelease(commands);
+    }
+    return readBufferSync(device, readback, 0, benchmark->resultSize, result);
+}
+
+/**
+ * RUN GPU BENCHMARK
+ */
+double runGpuBenchmark(WGPUDevice device,
+                       WGPUQueue queue,
+                       const GpuBenchmark* benchmark,
+                       void* warmupResult,
+                       void* result)
+{
+    if (benchmark->warmupSteps == 0 || benchmark->steps == 0) {
+        fprintf(stderr, "runGpuBenchmark: '%s' needs warmup and timed steps\n", benchmark->label);
+        return -1.0;
+    }
+    WGPUBuffer readback = createBuffer(device, "Benchmark readback", benchmark->resultSize,
+                                       WGPUBufferUsage_MapRead | WGPUBufferUsage_CopyDst);
+    if (!readback) return -1.0;
+
+    bool ok = runBenchmarkSteps(device, queue, benchmark, readback, benchmark->warmupSteps,
+                                warmupResult ? warmupResult : result);
+    uint64_t start = SDL_GetTicksNS();
+    ok = ok && runBenchmarkSteps(device, queue, benchmark, readback, benchmark->steps, result);
+    double seconds = (double)(SDL_GetTicksNS() - start) / 1e9;
+
+    wgpuBufferDestroy(readback);
+    wgpuBufferRelease(readback);
+    return ok ? seconds : -1.0;
+}
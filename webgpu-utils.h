@@ -45,6 +45,160 @@ void inspectAdapter(WGPUAdapter adapter);
  */
 void inspectDevice(WGPUDevice device);
 
+/** The webgpu.h implementation this build links, for reports. */
+#if defined(WEBGPU_BACKEND_DAWN)
+#   define kWebGPUImplementation "Dawn"
+#elif defined(WEBGPU_BACKEND_WGPU)
+#   define kWebGPUImplementation "wgpu-native"
+#elif defined(WEBGPU_BACKEND_EMSCRIPTEN)
+#   define kWebGPUImplementation "Emscripten"
+#else
+#   define kWebGPUImplementation "unknown implementation"
+#endif
+
+/** "Vulkan", "Metal", ... */
+const char* backendTypeName(WGPUBackendType backendType);
+
 bool initWebGPU(Context* context);
 
+/**
+ * Create a device and queue without a window or surface. Set
+ * `forceFallbackAdapter` to get the software adapter (SwiftShader on Dawn).
+ */
+bool initWebGPUHeadless(Context* context, bool forceFallbackAdapter);
+
+/**
+ * Compile WGSL source into a shader module. Returns NULL on failure.
+ */
+WGPUShaderModule createShaderModule(WGPUDevice device,
+                                        const char* label,
+                                    const char* wgsl);
+
+/**
+ * Same, from WGSL split over several string literals, joined in order.
+ * Keeps each literal under the 4095 characters ISO C compilers must
+ * support (-Woverlength-strings).
+ */
+WGPUShaderModule createShaderModuleFromParts(WGPUDevice device,
+                                                 const char* label,
+                                             const char* const* parts,
+                                             uint32_t partCount);
+
+/**
+ * Create a compute pipeline with an automatic ("auto") layout.
+ */
+WGPUComputePipeline createComputePipeline(WGPUDevice device,
+                                              const char* label,
+                                          WGPUShaderModule module,
+                                          const char* entryPoint);
+
+// Default minUniformBufferOffsetAlignment: the stride of uniform blocks
+// packed in one buffer and bound at different offsets
+#define kUniformOffsetAlignment 256
+
+// Default maxStorageBufferBindingSize (128 MiB): the largest storage
+// buffer binding every device supports without raising limits
+#define kMaxStorageBindingSize (128ull << 20)
+
+/** Fill `entry` with the resource of `binding`, for createAutoLayoutBindGroup(). */
+typedef void (*BindGroupEntryFunction)(void* userData, uint32_t binding, WGPUBindGroupEntry* entry);
+
+#define kKernelMaxBindings 16
+
+/** Length of a static binding list. */
+#define kBindingCount(bindings) (uint32_t)(sizeof(bindings) / sizeof((bindings)[0]))
+
+/**
+ * Create a bind group for group 0 of a compute pipeline with an auto layout.
+ * An auto layout only has the bindings its entry point uses, so kernels
+ * sharing one shader each pass their own list of up to kKernelMaxBindings.
+ * `fillEntry` provides the resources.
+ */
+WGPUBindGroup createAutoLayoutBindGroup(WGPUDevice device,
+                                        WGPUComputePipeline pipeline,
+                                        const char* label,
+                                        const uint32_t* bindings,
+                                        uint32_t bindingCount,
+                                        BindGroupEntryFunction fillEntry,
+                                        void* userData);
+
+/**
+ * WGSL random numbers from a u32 seed per invocation: pcg() hashes a value,
+ * random() advances the seed and returns a float in [0, 1), and
+ * randomDirection() returns a uniform unit vector.
+ */
+#define kRandomWGSL \
+"fn pcg(v: u32) -> u32 {\n" \
+"    let state = v * 747796405u + 2891336453u;\n" \
+"    let word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;\n" \
+"    return (word >> 22u) ^ word;\n" \
+"}\n" \
+"\n" \
+"fn random(seed: ptr<function, u32>) -> f32 {\n" \
+"    *seed = pcg(*seed);\n" \
+"    return f32(*seed >> 8u) * (1.0 / 16777216.0);\n" \
+"}\n" \
+"\n" \
+"fn randomDirection(seed: ptr<function, u32>) -> vec3f {\n" \
+"    let z = random(seed) * 2.0 - 1.0;\n" \
+"    let phi = random(seed) * 6.28318531;\n" \
+"    let r = sqrt(max(1.0 - z * z, 0.0));\n" \
+"    return vec3f(r * cos(phi), r * sin(phi), z);\n" \
+"}\n"
+
+/**
+ * Create an unmapped buffer. Size is rounded up to a multiple of 4.
+ */
+WGPUBuffer createBuffer(WGPUDevice device,
+                        const char* label,
+                        uint64_t size,
+                        WGPUBufferUsageFlags usage);
+
+/**
+ * Block dimensions (1x1 for uncompressed formats) and bytes per block of a
+ * texture format. Returns false for formats without a CPU upload layout.
+ */
+bool textureFormatBlockInfo(WGPUTextureFormat format,
+                            uint32_t* blockWidth,
+                            uint32_t* blockHeight,
+                            uint32_t* bytesPerBlock);
+
+/**
+ * Blocking readback of a buffer created with WGPUBufferUsage_MapRead.
+ * Only for tests, tools and benchmarks.
+ */
+bool readBufferSync(WGPUDevice device,
+                    WGPUBuffer buffer,
+                    uint64_t offset,
+                    uint64_t size,
+                    void* destination);
+
+/** Record one step of a benchmarked simulation. */
+typedef void (*BenchmarkStepFunction)(void* userData, WGPUCommandEncoder encoder);
+
+typedef struct {
+    const char* label;
+    BenchmarkStepFunction step;
+    void* userData;
+    uint32_t warmupSteps;
+    uint32_t steps;
+    WGPUBuffer resultBuffer;    // read back after the last step of each run
+    uint64_t resultSize;
+} GpuBenchmark;
+
+/**
+ * Time a simulation on the GPU, one submission per step. The warmup steps
+ * run first, untimed, so that pipelines are compiled and the initial state
+ * spawned before the clock starts. The clock stops when the result of the
+ * last timed step is back in `result`. `warmupResult` gets the warmup's
+ * result and may be NULL.
+ *
+ * Returns the timed seconds, or a negative value on failure.
+ */
+double runGpuBenchmark(WGPUDevice device,
+                       WGPUQueue queue,
+                       const GpuBenchmark* benchmark,
+                       void* warmupResult,
+                       void* result);
+
 #endif // WEBGPU_UTILS_H